@@ -0,0 +1,924 @@
+// bufcache.cc
+//	Routines to cache disk sectors in memory.  The file system
+//	reads and writes whole sectors through the cache; only misses
+//	and the write-back of dirty buffers reach the disk.
+//
+//	A lock serializes all operations on the cache, but it is not
+//	held during disk I/O: a buffer being read in or written out is
+//	marked busy instead, and anyone who wants it waits on "ioDone".
+//	The sector is entered in "bufferOf" before the read starts, so
+//	two threads can never end up fetching the same sector into two
+//	different buffers.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "bufcache.h"
+#include "ftable.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize an empty cache of sectors in front of a disk.
+//
+//	"disk" -- the synchronous disk holding the real data
+//	"numBuffers" -- the number of sectors the cache can hold
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(SynchDisk *disk, int numBuffers)
+{
+    ASSERT(numBuffers > 0);
+    this->disk = disk;
+    this->numBuffers = numBuffers;
+    buffers = new CacheBuffer[numBuffers];
+    for (int i = 0; i < numBuffers; i++) {
+	buffers[i].sector = -1;
+	buffers[i].dirty = FALSE;
+	buffers[i].referenced = FALSE;
+	buffers[i].busy = FALSE;
+	buffers[i].pinned = FALSE;
+    }
+    volumeSectors = disk->VolumeSectors();
+    bufferOf = new int[volumeSectors];
+    for (int i = 0; i < volumeSectors; i++)
+	bufferOf[i] = -1;
+    clockHand = 0;
+    lock = new Lock("buffer cache lock");
+    ioDone = new Condition("buffer cache I/O done");
+    numDirty = 0;
+    numDelayed = 0;
+    flusher = NULL;
+    wakeup = NULL;
+    flushPending = FALSE;
+    flushInterval = flushThreshold = 0;
+    lastFlush = 0;
+    reader = NULL;
+    readWakeup = NULL;
+    readQueue = new List<CacheRun *>;
+    logged = NULL;
+    numLogged = maxLogged = 0;
+    numHits = numMisses = numEvictions = numWriteBacks = numFlushes = numPrefetches = 0;
+    numUnchanged = 0;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	De-allocate the cache.  Dirty sectors are not written back here;
+//	Interrupt::Halt flushes the cache before tearing the kernel down,
+//	since disk I/O needs the interrupt and debug machinery.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    delete wakeup;
+    delete readWakeup;
+    delete readQueue;
+    delete ioDone;
+    delete lock;
+    delete [] logged;
+    delete [] bufferOf;
+    delete [] buffers;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+// 	Read the contents of a disk sector into a buffer, from memory if
+//	the sector is cached, otherwise from disk.
+//
+//	"sectorNumber" -- the disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSector(int sectorNumber, char* data)
+{
+    lock->Acquire();
+    int which = GetBuffer(sectorNumber, TRUE);
+    bcopy(buffers[which].data, data, SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadPart
+// 	Read "numBytes" bytes starting "offset" bytes into a disk sector,
+//	copied straight from the sector's buffer, which is filled from
+//	disk first if the sector is not cached.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadPart(int sectorNumber, int offset, int numBytes, char* data)
+{
+    ASSERT((offset >= 0) && (numBytes >= 0) &&
+	   (offset + numBytes <= SectorSize));
+    lock->Acquire();
+    int which = GetBuffer(sectorNumber, TRUE);
+    bcopy(&buffers[which].data[offset], data, numBytes);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+// 	Read "numSectors" consecutive sectors into "data".  Cached
+//	sectors are copied from memory; each run of sectors that miss is
+//	read from disk with a single request, as long as clean buffers
+//	are at hand for it.  If "data" is NULL, the sectors are only
+//	brought into the cache.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    CacheRun run;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber + numSectors <= volumeSectors));
+    lock->Acquire();
+    for (int i = 0; i < numSectors; ) {
+	ReserveRun(&run, sectorNumber + i, numSectors - i);
+	if (run.count > 0) {
+	    numMisses += run.count;
+	    ReadRun(&run);
+	    for (int j = 0; j < run.count && data != NULL; j++)
+		bcopy(buffers[run.which[j]].data,
+		      &data[(i + j) * SectorSize], SectorSize);
+	    i += run.count;
+	} else {		// cached, or no clean buffer to be had
+	    int which = GetBuffer(sectorNumber + i, TRUE);
+	    if (data != NULL)
+		bcopy(buffers[which].data, &data[i * SectorSize], SectorSize);
+	    i++;
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSectors
+// 	Write "numSectors" consecutive sectors from "data" through to the
+//	disk, up to MaxCacheRun of them with each request, instead of
+//	leaving them dirty for write-behind.  Each sector still gets a
+//	buffer, so later reads hit and no stale copy can be read in while
+//	the write is under way (the buffers are busy until it is done).
+//	A sector that the journal has pinned is only updated in its
+//	buffer, and goes to disk when the journal commits it.
+//
+//	"sectorNumber" -- the first disk sector to be written
+//	"numSectors" -- the number of sectors
+//	"data" -- the new contents of the sectors
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    CacheRun run;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber + numSectors <= volumeSectors));
+    lock->Acquire();
+    for (int i = 0; i < numSectors; ) {
+	run.sector = sectorNumber + i;
+	run.count = 0;
+	while (i < numSectors && run.count < MaxCacheRun) {
+	    int which = GetBuffer(sectorNumber + i, FALSE);
+	    CacheBuffer *b = &buffers[which];
+	    bcopy(&data[i * SectorSize], b->data, SectorSize);
+	    i++;
+	    if (b->pinned) {		// the journal writes it
+		if (!b->dirty) {
+		    b->dirty = TRUE;
+		    numDirty++;
+		}
+		break;
+	    }
+	    if (b->dirty) {
+		b->dirty = FALSE;
+		numDirty--;
+	    }
+	    b->busy = TRUE;
+	    run.which[run.count++] = which;
+	}
+	if (run.count == 0)
+	    continue;
+	lock->Release();
+	disk->WriteSectors(run.sector, run.count,
+			   &data[(run.sector - sectorNumber) * SectorSize]);
+	lock->Acquire();
+	for (int j = 0; j < run.count; j++)
+	    buffers[run.which[j]].busy = FALSE;
+	numWriteBacks += run.count;
+	ioDone->Broadcast(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+// 	Write the contents of a buffer into a disk sector.  The data is
+//	only copied into the cache; it reaches the disk when the buffer
+//	is evicted or flushed.
+//
+//	A write that would not change the cached sector is dropped.
+//	If the running thread is in a logged operation, the buffer is
+//	pinned until the journal commits it.
+//
+//	Enough dirty buffers, or enough time, wake the write-behind
+//	thread -- but not from the write-behind thread itself, which is
+//	where Interrupt::Halt syncs the disk if that thread was the last
+//	to go to sleep.
+//
+//	"sectorNumber" -- the disk sector to be written
+//	"data" -- the new contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSector(int sectorNumber, char* data)
+{
+    lock->Acquire();
+    int which = bufferOf[sectorNumber];
+    if (which >= 0 && !buffers[which].busy &&
+	    bcmp(data, buffers[which].data, SectorSize) == 0) {
+	buffers[which].referenced = TRUE;
+	numUnchanged++;
+	lock->Release();
+	return;
+    }
+    which = GetBuffer(sectorNumber, FALSE);
+    bcopy(data, buffers[which].data, SectorSize);
+    Dirtied(which);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CopySector
+// 	Write disk sector "toSector" with the contents of "fromSector",
+//	copied from the one's buffer straight into the other's, as
+//	WriteSector would write them.  "fromSector" is read into the
+//	cache first if need be, and is kept busy meanwhile, so that
+//	finding a buffer for "toSector" does not take it back.
+//----------------------------------------------------------------------
+
+void
+BufferCache::CopySector(int fromSector, int toSector)
+{
+    ASSERT(fromSector != toSector);
+    lock->Acquire();
+    int from = GetBuffer(fromSector, TRUE);
+    buffers[from].busy = TRUE;
+    int to = GetBuffer(toSector, FALSE);
+    buffers[from].busy = FALSE;
+    ioDone->Broadcast(lock);
+    bcopy(buffers[from].data, buffers[to].data, SectorSize);
+    Dirtied(to);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Dirtied
+// 	Buffer "which" has just been written to: mark it dirty, pin it
+//	if the running thread is in a logged operation, and see if a
+//	write-behind pass is due.  Journal::Begin and Journal::Reserve
+//	leave room in the batch for what an operation writes, so a logged
+//	write always finds a slot; one that did not would reach the disk
+//	before the commit, and the operation would not be atomic.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Dirtied(int which)
+{
+    if (!buffers[which].dirty) {
+	buffers[which].dirty = TRUE;
+	numDirty++;
+    }
+    if (logged != NULL && kernel->currentThread->journalDepth > 0 &&
+	    !buffers[which].pinned) {
+	ASSERT(numLogged < maxLogged);
+	buffers[which].pinned = TRUE;
+	logged[numLogged++] = buffers[which].sector;
+	kernel->currentThread->journalUsed++;
+    }
+    WakeFlusher();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::NoteDelayed
+// 	"count" more sectors of data are waiting in file headers for
+//	delayed allocation (fewer, if it is negative: they were given
+//	sectors, or dropped).  The next write-behind pass gives them their
+//	sectors first.  They do not count as dirty buffers: the longer a
+//	file is left to grow, the longer the run it gets; it is only
+//	written once enough time has gone by, or it has MaxDelayed
+//	sectors waiting (see OpenFile::WriteDelayed).
+//----------------------------------------------------------------------
+
+void
+BufferCache::NoteDelayed(int count)
+{
+    numDelayed += count;
+    ASSERT(numDelayed >= 0);
+    if (count > 0)
+	WakeFlusher();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WakeFlusher
+// 	Wake the write-behind thread if enough buffers are dirty, or
+//	enough time has gone by since the last pass.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WakeFlusher()
+{
+    if (flusher != NULL && !flushPending &&
+	    kernel->currentThread != flusher &&
+	    ((flushThreshold > 0 && numDirty - numLogged >= flushThreshold) ||
+	     (flushInterval > 0 &&
+	      kernel->stats->totalTicks - lastFlush >= flushInterval))) {
+	flushPending = TRUE;
+	wakeup->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Demote
+// 	Clear the reference bit of "sectorNumber", if it is cached, so
+//	that the clock hand replaces it the first time it comes by: the
+//	sector has just been read into the page cache (see frames.h),
+//	which keeps it from now on.  A dirty sector is written back as
+//	any other would be.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Demote(int sectorNumber)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < volumeSectors));
+    lock->Acquire();
+    int which = bufferOf[sectorNumber];
+    if (which >= 0)
+	buffers[which].referenced = FALSE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+// 	Write every dirty buffer back to disk, except pinned ones (the
+//	journal has to commit those first).  The sectors stay cached.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+    lock->Acquire();
+    if (disk->IsLogged())
+	WriteDirtyGather();
+    for (int i = 0; i < numBuffers; i++) {
+	while (buffers[i].busy)
+	    ioDone->Wait(lock);
+	WriteBack(i);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FlushSector
+// 	Write "sectorNumber" back to disk if it is cached and dirty,
+//	e.g. to make one file durable.
+//----------------------------------------------------------------------
+
+void
+BufferCache::FlushSector(int sectorNumber)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < volumeSectors));
+    lock->Acquire();
+    while (bufferOf[sectorNumber] >= 0 && buffers[bufferOf[sectorNumber]].busy)
+	ioDone->Wait(lock);
+    if (bufferOf[sectorNumber] >= 0)
+	WriteBack(bufferOf[sectorNumber]);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// WriteBehindThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the write-behind loop of the cache.
+//----------------------------------------------------------------------
+
+static void
+WriteBehindThread(BufferCache *cache)
+{
+    cache->WriteBehind();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StartFlusher
+// 	Fork the write-behind thread.  From now on, a write that finds
+//	"threshold" buffers dirty, or that comes "interval" ticks after
+//	the last pass, starts a new pass.  Either can be 0 to not use it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::StartFlusher(int interval, int threshold)
+{
+    ASSERT(flusher == NULL);
+    flushInterval = interval;
+    flushThreshold = threshold;
+    lastFlush = kernel->stats->totalTicks;
+    wakeup = new Semaphore("write-behind", 0);
+    flusher = new Thread("write-behind", -1);
+    flusher->Fork((VoidFunctionPtr) WriteBehindThread, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBehind
+// 	Loop forever, waiting to be woken up and then writing every dirty
+//	buffer back in increasing sector order, so the disk head sweeps
+//	across the disk once -- or, if the volume is kept as a log, all
+//	of them with one request, which appends them one after another.
+//	The lock is given up during each write,
+//	so other threads keep using the cache meanwhile.  The data that
+//	is waiting for delayed allocation is given its sectors, and
+//	written, first (see FileTable::AllocateDelayed).
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBehind()
+{
+    for (;;) {
+	wakeup->P();
+	if (numDelayed > 0)
+	    kernel->fileTable->AllocateDelayed();
+	lock->Acquire();
+	DEBUG(dbgCache, "Write-behind pass, " << numDirty << " dirty buffers");
+	if (disk->IsLogged())
+	    WriteDirtyGather();
+	else
+	    for (int sector = NextDirty(0); sector >= 0;
+		 sector = NextDirty(sector))
+		sector += WriteDirtyRun(sector);
+	lock->Release();
+	numFlushes++;
+	lastFlush = kernel->stats->totalTicks;
+	flushPending = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// ReadAheadThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the read-ahead loop of the cache.
+//----------------------------------------------------------------------
+
+static void
+ReadAheadThread(BufferCache *cache)
+{
+    cache->ReadAhead();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StartReadAhead
+// 	Fork the read-ahead thread.  Until this is called, Prefetch does
+//	nothing.
+//----------------------------------------------------------------------
+
+void
+BufferCache::StartReadAhead()
+{
+    ASSERT(reader == NULL);
+    readWakeup = new Semaphore("read-ahead", 0);
+    reader = new Thread("read-ahead", -1);
+    reader->Fork((VoidFunctionPtr) ReadAheadThread, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Arrange for the "numSectors" sectors starting at "sectorNumber"
+//	to be read into the cache by the read-ahead thread, and return
+//	without waiting.  The sectors get buffers right away, marked
+//	busy, so a reader that wants one before it arrives simply waits
+//	for the read.  Sectors already cached are skipped, and nothing
+//	is done once making room would mean writing a dirty buffer -- a
+//	guess is not worth a disk write.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Prefetch(int sectorNumber, int numSectors)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber + numSectors <= volumeSectors));
+    if (reader == NULL)
+	return;
+    lock->Acquire();
+    while (numSectors > 0) {
+	if (bufferOf[sectorNumber] >= 0) {	// already there
+	    sectorNumber++;
+	    numSectors--;
+	    continue;
+	}
+	CacheRun *run = new CacheRun;
+	ReserveRun(run, sectorNumber, numSectors);
+	if (run->count == 0) {			// no clean buffer left
+	    delete run;
+	    break;
+	}
+	numPrefetches += run->count;
+	sectorNumber += run->count;
+	numSectors -= run->count;
+	readQueue->Append(run);
+	readWakeup->V();
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadAhead
+// 	Loop forever, reading the runs Prefetch queued, in order.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadAhead()
+{
+    for (;;) {
+	readWakeup->P();
+	lock->Acquire();
+	CacheRun *run = readQueue->RemoveFront();
+	DEBUG(dbgCache, "Read-ahead of sectors " << run->sector << " to "
+		    << run->sector + run->count - 1);
+	ReadRun(run);
+	lock->Release();
+	delete run;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StartLogging
+// 	Make room to remember up to "maxLogged" pinned sectors, so the
+//	journal can log writes.  The journal keeps the batch below that,
+//	and well below the size of the cache.
+//----------------------------------------------------------------------
+
+void
+BufferCache::StartLogging(int maxLogged)
+{
+    ASSERT(logged == NULL && maxLogged < numBuffers);
+    logged = new int[maxLogged];
+    this->maxLogged = maxLogged;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CopyLogged
+// 	Copy the current contents of the logged sectors into "data", one
+//	after another, and their sector numbers into "sectors".  Return
+//	the number of logged sectors.  They stay pinned.
+//----------------------------------------------------------------------
+
+int
+BufferCache::CopyLogged(int *sectors, char *data)
+{
+    lock->Acquire();
+    for (int i = 0; i < numLogged; i++) {
+	int which = bufferOf[logged[i]];
+	ASSERT(which >= 0 && buffers[which].pinned);
+	sectors[i] = logged[i];
+	bcopy(buffers[which].data, &data[i * SectorSize], SectorSize);
+    }
+    lock->Release();
+    return numLogged;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteLogged
+// 	The journal has committed the logged sectors: unpin them, and
+//	write them back in sector order, in runs where they are
+//	consecutive.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteLogged()
+{
+    lock->Acquire();
+    for (int i = 0; i < numLogged; i++) {	// sort, and unpin
+	int sector = logged[i], j;
+	for (j = i; j > 0 && logged[j - 1] > sector; j--)
+	    logged[j] = logged[j - 1];
+	logged[j] = sector;
+	buffers[bufferOf[sector]].pinned = FALSE;
+    }
+    for (int i = 0; i < numLogged; i++)
+	WriteDirtyRun(logged[i]);
+    numLogged = 0;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Print
+// 	Print the hit/miss counts for the cache.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Print()
+{
+    printf("Buffer cache: %d buffers, hits %d, misses %d, write-backs %d, "
+		"write-behind passes %d, read-aheads %d, unchanged writes %d\n",
+		numBuffers, numHits, numMisses, numWriteBacks, numFlushes,
+		numPrefetches, numUnchanged);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffer
+// 	Return the index of the buffer holding "sectorNumber", marking
+//	it referenced.  On a miss, CLOCK picks a buffer to reuse (writing
+//	it back first if dirty), and the sector is read from disk when
+//	"fetch" is set.  A caller that is about to overwrite the whole
+//	sector passes FALSE to skip the read.
+//
+//	Must be called with the cache lock held.  The lock is released
+//	while waiting for a busy buffer or for the disk, so the state of
+//	the cache is looked at again after each wait.
+//----------------------------------------------------------------------
+
+int
+BufferCache::GetBuffer(int sectorNumber, bool fetch)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < volumeSectors));
+
+    for (;;) {
+	int which = bufferOf[sectorNumber];
+	if (which >= 0) {
+	    if (buffers[which].busy) {	// being read in or written out
+		ioDone->Wait(lock);
+		continue;
+	    }
+	    numHits++;
+	    buffers[which].referenced = TRUE;
+	    return which;
+	}
+
+	which = FindVictim();
+	if (which < 0) {		// every buffer is doing I/O
+	    ioDone->Wait(lock);
+	    continue;
+	}
+	if (buffers[which].dirty) {
+	    WriteBack(which);		// gives up the lock; start over
+	    continue;
+	}
+
+	numMisses++;
+	if (buffers[which].sector >= 0) {
+	    bufferOf[buffers[which].sector] = -1;
+	    numEvictions++;
+	}
+	DEBUG(dbgCache, "Cache miss on sector " << sectorNumber
+		    << ", replacing buffer " << which);
+	buffers[which].sector = sectorNumber;
+	buffers[which].referenced = TRUE;
+	bufferOf[sectorNumber] = which;
+	if (fetch) {
+	    buffers[which].busy = TRUE;
+	    lock->Release();
+	    disk->ReadSector(sectorNumber, buffers[which].data);
+	    lock->Acquire();
+	    buffers[which].busy = FALSE;
+	    ioDone->Broadcast(lock);
+	}
+	return which;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FindVictim
+// 	Advance the clock hand to the first buffer that has not been
+//	referenced since the hand last passed it, clearing reference
+//	bits along the way.  Free buffers are taken immediately, and
+//	busy and pinned ones are skipped.  Return -1 if every buffer is
+//	busy or pinned.
+//----------------------------------------------------------------------
+
+int
+BufferCache::FindVictim()
+{
+    for (int i = 0; i < 2 * numBuffers; i++) {
+	int which = clockHand;
+	clockHand = (clockHand + 1) % numBuffers;
+	if (buffers[which].busy || buffers[which].pinned)
+	    continue;
+	if (buffers[which].sector < 0 || !buffers[which].referenced)
+	    return which;
+	buffers[which].referenced = FALSE;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Reserve
+// 	If "sectorNumber" is not cached and a clean buffer can be had
+//	without waiting, give it to the sector, mark it busy (its data
+//	is not there yet), and return it.  Otherwise return -1.  Never
+//	gives up the lock, so a run of sectors can be reserved at once.
+//----------------------------------------------------------------------
+
+int
+BufferCache::Reserve(int sectorNumber)
+{
+    if (bufferOf[sectorNumber] >= 0)
+	return -1;
+    int which = FindVictim();
+    if (which < 0 || buffers[which].dirty)
+	return -1;
+    if (buffers[which].sector >= 0) {
+	bufferOf[buffers[which].sector] = -1;
+	numEvictions++;
+    }
+    buffers[which].sector = sectorNumber;
+    buffers[which].referenced = TRUE;
+    buffers[which].busy = TRUE;
+    bufferOf[sectorNumber] = which;
+    return which;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReserveRun
+// 	Reserve buffers for the sectors starting at "sectorNumber", at
+//	most "numSectors" (and MaxCacheRun) of them, stopping at the
+//	first one that cannot be reserved.  "run->count" may be 0.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReserveRun(CacheRun *run, int sectorNumber, int numSectors)
+{
+    run->sector = sectorNumber;
+    run->count = 0;
+    while (run->count < numSectors && run->count < MaxCacheRun) {
+	int which = Reserve(sectorNumber + run->count);
+	if (which < 0)
+	    break;
+	run->which[run->count++] = which;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadRun
+// 	Read the reserved buffers of "run" from disk with one request,
+//	then mark them ready.  Called with the lock held; it is released
+//	during the read.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadRun(CacheRun *run)
+{
+    char *data = new char[run->count * SectorSize];
+
+    lock->Release();
+    disk->ReadSectors(run->sector, run->count, data);
+    lock->Acquire();
+    for (int i = 0; i < run->count; i++) {
+	CacheBuffer *b = &buffers[run->which[i]];
+	ASSERT(b->busy && b->sector == run->sector + i);
+	bcopy(&data[i * SectorSize], b->data, SectorSize);
+	b->busy = FALSE;
+    }
+    ioDone->Broadcast(lock);
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::NextDirty
+// 	Return the lowest sector from "sectorNumber" on that a buffer
+//	holds dirty, and neither busy nor pinned, or -1 if there is none.
+//	It looks at the buffers rather than the sectors, so a pass over
+//	the dirty ones takes no longer on a large disk.
+//----------------------------------------------------------------------
+
+int
+BufferCache::NextDirty(int sectorNumber)
+{
+    int next = -1;
+
+    for (int i = 0; i < numBuffers; i++) {
+	CacheBuffer *b = &buffers[i];
+
+	if (b->sector >= sectorNumber && b->dirty && !b->busy &&
+		!b->pinned && (next < 0 || b->sector < next))
+	    next = b->sector;
+    }
+    return next;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteDirtyRun
+// 	Write back, with one request, the run of consecutive cached
+//	sectors starting at "sectorNumber" that are dirty, and neither
+//	busy nor pinned.
+//	Return how many sectors were written (0 if "sectorNumber" itself
+//	does not qualify).  Called with the lock held; it is released
+//	during the write.
+//----------------------------------------------------------------------
+
+int
+BufferCache::WriteDirtyRun(int sectorNumber)
+{
+    CacheRun run;
+    char *data;
+
+    run.sector = sectorNumber;
+    run.count = 0;
+    while (run.count < MaxCacheRun && sectorNumber + run.count < volumeSectors) {
+	int which = bufferOf[sectorNumber + run.count];
+	if (which < 0 || buffers[which].busy || !buffers[which].dirty ||
+		buffers[which].pinned)
+	    break;
+	run.which[run.count++] = which;
+    }
+    if (run.count == 0)
+	return 0;
+
+    data = new char[run.count * SectorSize];
+    for (int i = 0; i < run.count; i++) {
+	CacheBuffer *b = &buffers[run.which[i]];
+	bcopy(b->data, &data[i * SectorSize], SectorSize);
+	b->busy = TRUE;
+	b->dirty = FALSE;
+    }
+    numDirty -= run.count;
+    lock->Release();
+    disk->WriteSectors(run.sector, run.count, data);
+    lock->Acquire();
+    for (int i = 0; i < run.count; i++)
+	buffers[run.which[i]].busy = FALSE;
+    numWriteBacks += run.count;
+    ioDone->Broadcast(lock);
+    delete [] data;
+    return run.count;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteDirtyGather
+// 	Write back, with one request, every cached sector that is dirty,
+//	and neither busy nor pinned, wherever it is: on a volume kept as
+//	a log, they are appended together, however scattered.
+//	Return how many sectors were written.  Called with the lock held;
+//	it is released during the write.
+//----------------------------------------------------------------------
+
+int
+BufferCache::WriteDirtyGather()
+{
+    int *sectors = new int[numBuffers];
+    int *which = new int[numBuffers];
+    int count = 0;
+    char *data;
+
+    for (int sector = NextDirty(0); sector >= 0;
+	 sector = NextDirty(sector + 1)) {
+	sectors[count] = sector;
+	which[count++] = bufferOf[sector];
+    }
+    data = new char[max(count, 1) * SectorSize];
+    for (int i = 0; i < count; i++) {
+	CacheBuffer *b = &buffers[which[i]];
+	bcopy(b->data, &data[i * SectorSize], SectorSize);
+	b->busy = TRUE;
+	b->dirty = FALSE;
+    }
+    if (count > 0) {
+	numDirty -= count;
+	lock->Release();
+	disk->WriteGathered(sectors, count, data);
+	lock->Acquire();
+	for (int i = 0; i < count; i++)
+	    buffers[which[i]].busy = FALSE;
+	numWriteBacks += count;
+	ioDone->Broadcast(lock);
+    }
+    delete [] sectors;
+    delete [] which;
+    delete [] data;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBack
+// 	If buffer "which" is dirty, and not pinned by the journal, write
+//	it to disk and mark it clean.
+//	The buffer is busy during the write, and the lock is released,
+//	so nobody touches its data meanwhile but other buffers can be
+//	used.  Must be called with the lock held, on a buffer that is
+//	not busy.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteBack(int which)
+{
+    ASSERT(!buffers[which].busy);
+    if (buffers[which].sector >= 0 && buffers[which].dirty &&
+	    !buffers[which].pinned) {
+	buffers[which].busy = TRUE;
+	buffers[which].dirty = FALSE;
+	numDirty--;
+	lock->Release();
+	disk->WriteSector(buffers[which].sector, buffers[which].data);
+	lock->Acquire();
+	buffers[which].busy = FALSE;
+	numWriteBacks++;
+	ioDone->Broadcast(lock);
+    }
+}
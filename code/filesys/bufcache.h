@@ -0,0 +1,207 @@
+// bufcache.h
+//	Data structures for a cache of disk sectors kept in memory
+//	between the file system and the synchronous disk.
+//
+//	The cache holds a fixed number of sector-sized buffers.  Reads
+//	that hit in the cache are satisfied without touching the disk;
+//	writes only mark the buffer dirty, and the data is written back
+//	when the buffer is evicted or when the cache is flushed.
+//
+//	Replacement uses the CLOCK algorithm: every buffer has a
+//	reference bit that is set on each access, and the clock hand
+//	sweeps over the buffers clearing reference bits until it finds
+//	one that has not been used since the last sweep.
+//
+//	A write-behind thread can be started to clean the cache in the
+//	background: it is woken when too many buffers are dirty, or when
+//	enough time has passed since its last pass, and writes every
+//	dirty buffer back in sector order.  Writers then rarely have to
+//	wait for an eviction.
+//
+//	A read-ahead thread reads the sectors that Prefetch is asked for,
+//	so a sequential reader finds them cached without waiting.
+//
+//	Runs of consecutive sectors that miss together are read with one
+//	multi-sector disk request, and the write-behind thread writes
+//	runs of consecutive dirty sectors the same way.  A large write
+//	can also go straight through to the disk, a run at a time,
+//	leaving the sectors cached and clean.
+//
+//	While a thread is in a logged operation (see journal.h), each
+//	sector it writes is pinned: it stays in the cache, and is not
+//	written back, until the journal has committed it.  Writes by
+//	other threads, outside any operation, are not logged.  A write that leaves a cached sector
+//	unchanged does not dirty it, so rewriting a whole directory or
+//	bitmap costs only the sectors that really changed.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BUFCACHE_H
+#define BUFCACHE_H
+
+#include "disk.h"
+#include "synch.h"
+#include "synchdisk.h"
+#include "list.h"
+
+#define NumCacheBuffers		64	// number of sectors kept in memory
+#define FlushInterval		10000	// ticks between write-behind passes
+#define FlushThreshold		(NumCacheBuffers / 4)
+					// dirty buffers that start a pass
+#define MaxCacheRun		16	// most sectors moved by one request
+
+// The following class defines one buffer of the cache: a copy of
+// a single disk sector, plus the state needed for replacement.
+
+class CacheBuffer {
+  public:
+    int sector;			// disk sector held here, -1 if none
+    bool dirty;			// in-memory copy differs from the disk
+    bool referenced;		// used since the clock hand last passed
+    bool busy;			// being read from or written to disk
+    bool pinned;		// logged, and not to be written back
+				// until the journal commits it
+    char data[SectorSize];	// contents of the sector
+};
+
+// The following class defines a run of consecutive sectors, each in
+// its own (busy) buffer, that is moved to or from the disk at once.
+
+class CacheRun {
+  public:
+    int sector;			// first disk sector of the run
+    int count;			// number of sectors in the run
+    int which[MaxCacheRun];	// buffer holding each sector
+};
+
+// The following class defines the buffer cache.  It exports the same
+// interface as SynchDisk, so the file system can use it in place of
+// the disk.
+
+class BufferCache {
+  public:
+    BufferCache(SynchDisk *disk, int numBuffers);
+    					// Create an empty cache in front
+					// of "disk"
+    ~BufferCache();			// De-allocate the cache
+
+    void ReadSector(int sectorNumber, char* data);
+    					// Read/write a disk sector through
+					// the cache
+    void WriteSector(int sectorNumber, char* data);
+    void CopySector(int fromSector, int toSector);
+    					// Write a sector with the contents
+					// of another, buffer to buffer
+    void ReadPart(int sectorNumber, int offset, int numBytes,
+		  char* data);		// Read part of a sector, copied
+					// straight from its buffer
+
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+    					// Read consecutive sectors, fetching
+					// runs of misses with one request
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+    					// Write consecutive sectors through
+					// to disk, with one request a run
+
+    void Demote(int sectorNumber);	// Replace this sector first, its
+					// data being kept elsewhere
+
+    void Flush();			// Write every dirty buffer back
+					// to disk
+    void FlushSector(int sectorNumber);	// Write one sector back, if it is
+					// cached and dirty
+
+    void StartFlusher(int interval, int threshold);
+    					// Fork the write-behind thread
+    void WriteBehind();			// Body of the write-behind thread
+    void NoteDelayed(int count);	// Sectors of data waiting in file
+					// headers for delayed allocation
+
+    void Prefetch(int sectorNumber, int numSectors);
+    					// Start reading consecutive sectors
+					// that will probably be needed soon
+    void StartReadAhead();		// Fork the read-ahead thread
+    void ReadAhead();			// Body of the read-ahead thread
+
+    void StartLogging(int maxLogged);	// Let the journal log writes, at
+					// most "maxLogged" sectors a batch
+    int NumLogged() { return numLogged; }
+    int CopyLogged(int *sectors, char *data);
+    					// Copy out the logged sectors, and
+					// return how many there are
+    void WriteLogged();			// Unpin the logged sectors and
+					// write them back
+
+    void Print();			// Print cache statistics
+    int Hits() { return numHits; }
+    int Misses() { return numMisses; }
+    int Evictions() { return numEvictions; }
+
+  private:
+    int GetBuffer(int sectorNumber, bool fetch);
+    					// Return the buffer holding
+					// "sectorNumber", evicting
+					// another sector if necessary
+    int FindVictim();			// Choose a buffer to replace, or
+					// -1 if all are busy
+    void WriteBack(int which);		// Write buffer back if it is dirty
+    void Dirtied(int which);		// A buffer was just written to
+    void WakeFlusher();			// Start a write-behind pass, if
+					// one is due
+    int Reserve(int sectorNumber);	// Give an uncached sector a clean
+					// buffer, marked busy, without I/O
+    void ReserveRun(CacheRun *run, int sectorNumber, int numSectors);
+    					// Reserve as many of the sectors
+					// as possible, in order
+    void ReadRun(CacheRun *run);	// Read a reserved run from disk
+    int NextDirty(int sectorNumber);	// The next sector to write behind
+    int WriteDirtyRun(int sectorNumber);// Write back the dirty sectors
+					// starting at "sectorNumber"
+    int WriteDirtyGather();		// Write back all the dirty sectors,
+					// with one request to the log
+
+    SynchDisk *disk;			// The disk under the cache
+    CacheBuffer *buffers;		// The cached sectors
+    int numBuffers;			// Number of buffers in "buffers"
+    int volumeSectors;			// Sectors on the disk
+    int *bufferOf;			// For each disk sector, the buffer
+					// holding it, or -1
+    int clockHand;			// Next buffer the clock will examine
+    Lock *lock;				// Only one thread in the cache at
+					// a time
+    Condition *ioDone;			// Signalled when a busy buffer
+					// finishes its I/O
+    int numDirty;			// Buffers waiting to be written
+    int numDelayed;			// Sectors waiting in file headers
+					// for delayed allocation
+
+    Thread *flusher;			// The write-behind thread, or NULL
+    Semaphore *wakeup;			// Starts a write-behind pass
+    bool flushPending;			// "wakeup" was signalled, and the
+					// pass has not finished yet
+    int flushInterval;			// Ticks between passes
+    int flushThreshold;			// Dirty buffers that start a pass
+    int lastFlush;			// When the last pass finished
+
+    Thread *reader;			// The read-ahead thread, or NULL
+    Semaphore *readWakeup;		// Counts the queued prefetches
+    List<CacheRun *> *readQueue;	// Runs waiting to be read
+
+    int *logged;			// The sectors pinned by logging
+    int numLogged;			// Sectors in "logged"
+    int maxLogged;			// Room in "logged"
+
+    int numHits;			// Requests satisfied from memory
+    int numMisses;			// Requests that went to the disk
+    int numEvictions;			// Cached sectors replaced by others
+    int numWriteBacks;			// Dirty buffers written to disk
+    int numFlushes;			// Write-behind passes
+    int numUnchanged;			// Writes that changed nothing
+    int numPrefetches;			// Sectors read ahead
+};
+
+#endif // BUFCACHE_H
@@ -0,0 +1,200 @@
+// dcache.cc
+//	Routines to manage the directory entry (dentry) cache.
+//
+//	The cache is a small hash table of chained entries keyed by the
+//	absolute path name.  It is bounded: when it holds MaxDentries
+//	entries, it is simply emptied and refilled by later lookups.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dcache.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// Dentry::Dentry
+// 	Initialize an entry mapping "path" to "sector".
+//----------------------------------------------------------------------
+
+Dentry::Dentry(char *path, int sector)
+{
+    this->path = new char[strlen(path) + 1];
+    strcpy(this->path, path);
+    this->sector = sector;
+    next = NULL;
+}
+
+Dentry::~Dentry()
+{
+    delete [] path;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize an empty dentry cache.
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache()
+{
+    for (int i = 0; i < NumDentryBuckets; i++)
+	buckets[i] = NULL;
+    numEntries = 0;
+    numHits = numMisses = numEvictions = 0;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::~DentryCache
+// 	De-allocate the dentry cache.
+//----------------------------------------------------------------------
+
+DentryCache::~DentryCache()
+{
+    Clear();
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Hash
+// 	Return the hash chain for "path".
+//----------------------------------------------------------------------
+
+unsigned
+DentryCache::Hash(char *path)
+{
+    unsigned h = 0;
+
+    for (; *path != '\0'; path++)
+	h = h * 31 + (unsigned char) *path;
+    return h % NumDentryBuckets;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Look "path" up in the cache.  Return TRUE if it is there, with
+//	the sector of its file header (or -1 if the path is known not to
+//	exist) stored in "sector".
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(char *path, int *sector)
+{
+    for (Dentry *d = buckets[Hash(path)]; d != NULL; d = d->next) {
+	if (strcmp(d->path, path) == 0) {
+	    numHits++;
+	    *sector = d->sector;
+	    return TRUE;
+	}
+    }
+    numMisses++;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember that "path" resolves to "sector" (-1 if it does not
+//	exist), replacing whatever was cached for it before.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(char *path, int sector)
+{
+    unsigned h = Hash(path);
+
+    for (Dentry *d = buckets[h]; d != NULL; d = d->next) {
+	if (strcmp(d->path, path) == 0) {
+	    d->sector = sector;
+	    return;
+	}
+    }
+    if (numEntries >= MaxDentries) {
+	numEvictions += numEntries;
+	Clear();
+    }
+    DEBUG(dbgFile, "Dentry cache: " << path << " -> " << sector);
+    Dentry *d = new Dentry(path, sector);
+    d->next = buckets[h];
+    buckets[h] = d;
+    numEntries++;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Invalidate
+// 	Forget "path" and every path below it (a directory that is
+//	removed takes its whole subtree with it).
+//----------------------------------------------------------------------
+
+void
+DentryCache::Invalidate(char *path)
+{
+    int len = strlen(path);
+
+    for (int i = 0; i < NumDentryBuckets; i++) {
+	Dentry **prev = &buckets[i];
+	while (*prev != NULL) {
+	    Dentry *d = *prev;
+	    if (strncmp(d->path, path, len) == 0 &&
+			(d->path[len] == '\0' || d->path[len] == '/')) {
+		*prev = d->next;
+		delete d;
+		numEntries--;
+	    } else {
+		prev = &d->next;
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// DentryCache::InvalidateSector
+// 	Forget every path that resolves to the file header in "sector",
+//	e.g. because the file is being deleted.
+//----------------------------------------------------------------------
+
+void
+DentryCache::InvalidateSector(int sector)
+{
+    for (int i = 0; i < NumDentryBuckets; i++) {
+	Dentry **prev = &buckets[i];
+	while (*prev != NULL) {
+	    Dentry *d = *prev;
+	    if (d->sector == sector) {
+		*prev = d->next;
+		delete d;
+		numEntries--;
+	    } else {
+		prev = &d->next;
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Clear
+// 	Forget every cached path.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Clear()
+{
+    for (int i = 0; i < NumDentryBuckets; i++) {
+	while (buckets[i] != NULL) {
+	    Dentry *d = buckets[i];
+	    buckets[i] = d->next;
+	    delete d;
+	}
+    }
+    numEntries = 0;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Print
+// 	Print the hit/miss counts for the cache.
+//----------------------------------------------------------------------
+
+void
+DentryCache::Print()
+{
+    printf("Dentry cache: %d entries, hits %d, misses %d\n",
+		numEntries, numHits, numMisses);
+}
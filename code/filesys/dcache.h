@@ -0,0 +1,73 @@
+// dcache.h
+//	Data structures for the directory entry (dentry) cache, which
+//	remembers the result of resolving absolute path names to the
+//	sector of the file header.
+//
+//	Resolving "/t0/bb/f3" through FileSystem::WalkPath opens and reads
+//	every directory along the way.  The dentry cache keeps the answer
+//	for each path looked up recently, including negative answers
+//	("no such file"), so repeated lookups do not touch the directories
+//	at all.  Anything that adds or removes a name must invalidate the
+//	affected paths.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#define NumDentryBuckets	64	// hash chains in the cache
+#define MaxDentries		256	// entries kept before starting over
+
+// The following class defines one cached path.
+
+class Dentry {
+  public:
+    Dentry(char *path, int sector);	// Copies "path"
+    ~Dentry();
+
+    char *path;				// Absolute path name
+    int sector;				// Its file header, or -1 if the path
+					// is known not to exist
+    Dentry *next;			// Next entry in the same hash chain
+};
+
+// The following class defines the cache of path lookups.
+
+class DentryCache {
+  public:
+    DentryCache();			// Create an empty cache
+    ~DentryCache();			// De-allocate all the entries
+
+    bool Lookup(char *path, int *sector);
+    					// If "path" is cached, store its
+					// header sector (or -1) in "sector"
+					// and return TRUE
+    void Enter(char *path, int sector);	// Remember the result of a lookup
+
+    void Invalidate(char *path);	// Forget "path" and every path
+					// below it
+    void InvalidateSector(int sector);	// Forget every path that resolves
+					// to "sector"
+    void Clear();			// Forget everything
+
+    void Print();			// Print cache statistics
+    int Hits() { return numHits; }
+    int Misses() { return numMisses; }
+    int Evictions() { return numEvictions; }
+
+  private:
+    unsigned Hash(char *path);		// Which chain "path" belongs to
+
+    Dentry *buckets[NumDentryBuckets];	// Hash chains of entries
+    int numEntries;			// Entries in the cache
+
+    int numHits;			// Lookups answered by the cache
+    int numMisses;			// Lookups that had to walk the tree
+    int numEvictions;			// Entries dropped to make room
+};
+
+#endif // DCACHE_H
@@ -0,0 +1,334 @@
+// defrag.cc
+//	Routines to defragment the file system, when asked or in a
+//	background thread.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "defrag.h"
+#include "filehdr.h"
+#include "directory.h"
+#include "filesys.h"
+#include "ftable.h"
+#include "journal.h"
+#include "bufcache.h"
+#include "synch.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Defragmenter::Defragmenter
+// 	Set up to defragment the files, allocating their new runs from
+//	"freeMap", which is written back to "freeMapFile".  No background
+//	thread runs until Start is called.
+//----------------------------------------------------------------------
+
+Defragmenter::Defragmenter(PersistentBitmap *freeMap, OpenFile *freeMapFile)
+{
+    this->freeMap = freeMap;
+    this->freeMapFile = freeMapFile;
+    lock = new Lock("defragmenter");
+    old = new int[freeMap->NumBits()];
+    buffer = new char[SectorsPerTrack * SectorSize];
+    thread = NULL;
+    wakeup = NULL;
+    removes = numRemoved = numCopied = 0;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::~Defragmenter
+// 	The background thread, if any, is left blocked; Nachos is halting.
+//----------------------------------------------------------------------
+
+Defragmenter::~Defragmenter()
+{
+    delete wakeup;
+    delete lock;
+    delete [] old;
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Pass
+// 	Move each file that is in more than one run of sectors to a
+//	single run, if one is free for it, going through the directory
+//	tree from the root.  If "verbose", print the fragmentation score
+//	before and after.  Return the number of files moved.
+//----------------------------------------------------------------------
+
+int
+Defragmenter::Pass(bool verbose)
+{
+    List<int> *headers = new List<int>;
+    OpenFile *dirFile;
+    Directory *directory;
+    int before, after, moved = 0;
+
+    lock->Acquire();
+    numCopied = 0;
+    headers->Append(DirectorySector);
+    dirFile = new OpenFile(DirectorySector);
+    directory = new Directory(NumDirEntries);
+    directory->FetchFrom(dirFile);
+    directory->Collect(headers);
+    delete directory;
+    delete dirFile;
+
+    if (verbose)
+        printf("Before defragmenting: ");
+    before = Score(headers, verbose);
+    ListIterator<int> it(headers);
+    for (; !it.IsDone(); it.Next())
+        if (Move(it.Item()))
+            moved++;
+    if (verbose)
+        printf("After defragmenting:  ");
+    after = Score(headers, verbose);
+    if (verbose)
+        printf("Moved %d files, copying %d sectors\n", moved, numCopied);
+
+    DEBUG(dbgFile, "Defragmenting moved " << moved << " files, fragmentation "
+          << before << "% -> " << after << "%");
+    lock->Release();
+    delete headers;
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Score
+// 	Return the fragmentation score of the files whose headers are in
+//	"headers": the percentage of steps from one data sector of a file
+//	to the next that need a seek.  If "verbose", print it, and what
+//	it was computed from.
+//----------------------------------------------------------------------
+
+int
+Defragmenter::Score(List<int> *headers, bool verbose)
+{
+    ListIterator<int> it(headers);
+    int numFiles = 0, numData = 0, numRuns = 0, score = 0;
+
+    for (; !it.IsDone(); it.Next()) {
+        int data, runs;
+        FileHeader *hdr = kernel->fileTable->Acquire(it.Item());
+        runs = hdr->DataRuns(&data);
+        kernel->fileTable->Release(it.Item());
+        if (data > 0) {
+            numFiles++;
+            numData += data;
+            numRuns += runs;
+        }
+    }
+    if (numData > numFiles)
+        score = 100 * (numRuns - numFiles) / (numData - numFiles);
+    if (verbose)
+        printf("%d files, %d data sectors in %d runs, fragmentation %d%%\n",
+               numFiles, numData, numRuns, score);
+    return score;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Move
+// 	Move the data of the file whose header is at "sector" to a single
+//	run of sectors, and return TRUE; or return FALSE, leaving it
+//	where it is, if it is in one run already, is open, shares sectors
+//	with a snapshot, is compressed, or no free run is big enough.
+//
+//	The run is taken from the bitmap first, so no one else allocates
+//	it, and the data written so far is copied into it and flushed,
+//	and the bitmap written with the run in use.  Only then, in one
+//	journal operation, is the header switched to the new run and the
+//	old sectors given back -- unless someone has opened the file in
+//	the meantime, and may have written to the old sectors, in which
+//	case the run is given back instead.  A large file has more index
+//	blocks than one commit holds, so the switch may be committed in
+//	pieces: the old sectors stay in use on disk until the last piece,
+//	and hold the same data as the new ones, so a file that a crash
+//	leaves half switched reads the same either way.
+//----------------------------------------------------------------------
+
+bool
+Defragmenter::Move(int sector)
+{
+    FileHeader *hdr;
+    int numData, numCopy, numSectors, opens, start = -1;
+    bool moved = FALSE;
+
+    if (!freeMap->Test(sector) || kernel->fileTable->Users(sector) > 0)
+        return FALSE;				// removed, or open
+    hdr = kernel->fileTable->Acquire(sector);
+    opens = kernel->fileTable->Opens(sector);
+    if (hdr->DataRuns(&numData) > 1 && !hdr->IsShared(freeMap) &&
+            !hdr->IsCompressed())
+        start = FindRun(numData, sector);
+    if (start < 0) {
+        kernel->fileTable->Release(sector);
+        return FALSE;
+    }
+    for (int i = 0; i < numData; i++)
+        freeMap->Mark(start + i);
+
+    // list the sectors to copy; those above the high-water mark are
+    // not, they read as zeros wherever they are
+    numCopy = 0;
+    numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    for (int i = 0, n = 0; i < numSectors; i++) {
+        int s = hdr->ByteToSector(i * SectorSize);
+        if (s < 0)
+            continue;				// a hole
+        old[n++] = s;
+        if (i < hdr->HighWater())
+            numCopy = n;
+    }
+    DEBUG(dbgFile, "Moving " << numData << " sectors of the file at sector "
+          << sector << " to sector " << start);
+    Copy(start, numCopy);
+    kernel->journal->Begin(JournalSlots);	// alone, so Reserve never waits
+    freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+
+    kernel->journal->Begin(JournalSlots);
+    if (kernel->fileTable->Users(sector) == 1 &&
+            kernel->fileTable->Opens(sector) == opens) {
+        hdr->Relocate(freeMap, start);
+        kernel->fileTable->MarkDirty(sector);
+        kernel->fileTable->WriteBack(sector);
+        moved = TRUE;
+    } else {
+        for (int i = 0; i < numData; i++)	// opened while copying
+            freeMap->Clear(start + i);
+    }
+    freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    kernel->journal->Commit();		// before the old sectors are reused
+    kernel->fileTable->Release(sector);
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::FindRun
+// 	Return the first sector of a free run for a file of "length" data
+//	sectors, or -1 if there is none.  A file of a track or more gets
+//	a run that starts on a track boundary, and a smaller file one
+//	that fits in a track, in the track closest to "goal" that has
+//	one; failing that, the first free run that is long enough.
+//----------------------------------------------------------------------
+
+int
+Defragmenter::FindRun(int length, int goal)
+{
+    int numSectors = freeMap->NumBits();
+    int numTracks = numSectors / SectorsPerTrack;
+    int track = goal / SectorsPerTrack;
+    int start, found;
+
+    for (int d = 0; d < numTracks; d++) {
+        for (int side = 0; side < 2; side++) {
+            int t = (side == 0) ? track - d : track + d;
+            if (t < 0 || t >= numTracks || (side == 1 && d == 0))
+                continue;
+            int first = t * SectorsPerTrack;
+            if (length >= SectorsPerTrack) {
+                if (first + length <= numSectors &&
+                        freeMap->FindRun(first, first + 1, length,
+                                         &found) == first &&
+                        found == length)
+                    return first;
+            } else {
+                start = freeMap->FindRun(first, first + SectorsPerTrack,
+                                         length, &found);
+                if (start >= 0 && found == length &&
+                        start + length <= first + SectorsPerTrack)
+                    return start;
+            }
+        }
+    }
+    start = freeMap->FindRun(0, numSectors, length, &found);
+    return (start >= 0 && found == length) ? start : -1;
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Copy
+// 	Copy the data in the first "numCopy" sectors of "old" to the run
+//	of sectors starting at "start", and flush it, so it is on disk
+//	before the header points at it.  Old sectors that follow each
+//	other are read with one request, up to a track at a time.
+//----------------------------------------------------------------------
+
+void
+Defragmenter::Copy(int start, int numCopy)
+{
+    for (int i = 0; i < numCopy; ) {
+        int n = 1;
+        while (i + n < numCopy && n < SectorsPerTrack &&
+               old[i + n] == old[i] + n)
+            n++;
+        kernel->bufferCache->ReadSectors(old[i], n, buffer);
+        for (int j = 0; j < n; j++)
+            kernel->bufferCache->WriteSector(start + i + j,
+                                             &buffer[j * SectorSize]);
+        i += n;
+    }
+    numCopied += numCopy;
+    kernel->bufferCache->Flush();
+}
+
+//----------------------------------------------------------------------
+// DefragThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the background defragmenter.
+//----------------------------------------------------------------------
+
+static void
+DefragThread(Defragmenter *defrag)
+{
+    defrag->Daemon();
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Start
+// 	Fork the background thread.  From now on, every "removes" files
+//	removed start a pass.
+//----------------------------------------------------------------------
+
+void
+Defragmenter::Start(int removes)
+{
+    ASSERT(thread == NULL && removes > 0);
+    this->removes = removes;
+    wakeup = new Semaphore("defragmenter wakeup", 0);
+    thread = new Thread("defragmenter", -1);
+    thread->ioClass = IoIdle;		// only when the disk is free
+    thread->Fork((VoidFunctionPtr) DefragThread, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::NoteRemove
+// 	Count a file removed, and wake up the background thread if it is
+//	time for a pass.
+//----------------------------------------------------------------------
+
+void
+Defragmenter::NoteRemove()
+{
+    if (thread != NULL && ++numRemoved >= removes) {
+        numRemoved = 0;
+        wakeup->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// Defragmenter::Daemon
+// 	Loop forever, running a quiet pass each time we are woken up.
+//----------------------------------------------------------------------
+
+void
+Defragmenter::Daemon()
+{
+    for (;;) {
+        wakeup->P();
+        Pass(FALSE);
+    }
+}
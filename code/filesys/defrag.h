@@ -0,0 +1,87 @@
+// defrag.h
+//	Data structures for defragmenting the file system.
+//
+//	After many files have been created and removed, with first-fit
+//	allocation, a file's data can end up scattered over the disk a
+//	few sectors at a time, and reading it takes a seek per piece.
+//	The defragmenter moves each such file, one at a time, to a
+//	single run of free sectors: a run starting on a track boundary
+//	for a file of a track or more, or a run within one track for a
+//	smaller one, as close to the file's header as possible.  A file
+//	is only moved if such a run is free; the data is copied to it,
+//	and then the header and index blocks are switched over to it,
+//	and the old sectors freed, in one journal transaction.
+//
+//	Files that are open are left alone, and a file that is opened
+//	while its data is being copied is left where it was, so the
+//	defragmenter can run while the rest of the system is using the
+//	disk.  It runs when asked (nachos -defrag), or in the background,
+//	after every so many files have been removed.  Files that share
+//	sectors with a snapshot are left alone too: moving one would give
+//	it a copy of all of them.  So are compressed files, whose last
+//	chunk has sectors past the end of the file.
+//
+//	How fragmented the files are is measured by a score: the percentage
+//	of the steps from one data sector of a file to the next that need
+//	a seek.  0 means every file is one run.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DEFRAG_H
+#define DEFRAG_H
+
+#include "list.h"
+
+class PersistentBitmap;
+class OpenFile;
+class Lock;
+class Semaphore;
+class Thread;
+
+// The following class defines the defragmenter.
+
+class Defragmenter {
+  public:
+    Defragmenter(PersistentBitmap *freeMap, OpenFile *freeMapFile);
+    					// Defragment the files, allocating
+					// from "freeMap"
+    ~Defragmenter();
+
+    int Pass(bool verbose);		// Move every fragmented file that
+					// can be; return how many were
+
+    void Start(int removes);		// Fork the background thread, to
+					// run a pass every "removes" removals
+    void NoteRemove();			// A file has been removed
+    void Daemon();			// Body of the background thread
+
+  private:
+    int Score(List<int> *headers, bool verbose);
+    					// Fragmentation of the files whose
+					// headers are in "headers"
+    bool Move(int sector);		// Move the file whose header is at
+					// "sector" to one run, if it can be
+    int FindRun(int length, int goal);	// First sector of a free run for
+					// "length" sectors, near "goal"
+    void Copy(int start, int numCopy);	// Copy the first "numCopy" sectors
+					// of "old" to the run at "start"
+
+    PersistentBitmap *freeMap;		// The bit map of free disk sectors
+    OpenFile *freeMapFile;		// Where to write it back
+    Lock *lock;				// One pass at a time
+    int *old;				// The data sectors of the file
+					// being moved, in file order
+    char *buffer;			// A track of data being copied
+
+    Thread *thread;			// The background thread, or NULL
+    Semaphore *wakeup;			// V'd to start a background pass
+    int removes;			// Removals between background passes
+    int numRemoved;			// Removals since the last one
+    int numCopied;			// Sectors copied by this pass
+};
+
+#endif // DEFRAG_H
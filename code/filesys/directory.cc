@@ -1,19 +1,39 @@
 // directory.cc
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
-//	entry represents a single file, and contains the file name,
-//	and the location of the file header on disk.  The fixed size
-//	of each directory entry means that we have the restriction
-//	of a fixed maximum size for file names.
+//	The directory is a table of entries; each entry represents a
+//	single file, and contains the file name, and the location of
+//	the file header on disk.  In the directory file, each entry is
+//	a record just long enough for its name (see DirectoryRecord),
+//	and records may run across sector boundaries, since the file is
+//	read by bytes, not sectors.  A name can be up to FileNameMaxLen
+//	characters long.
+//
+//	As in the UNIX (ext2) file system, each record gives the number
+//	of bytes to the next one.  A removed record is added to the one
+//	before it, and a new name goes into the first record with room
+//	to spare for it, or else at the end of the records.  Only the
+//	first record, which has none before it, is ever left free.
 //
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	In memory, the entries in use are also indexed by name in a hash
+//	table, and the free entries are kept in a heap, so name
+//	lookups and Add do not scan the whole table.
+//
+//	The directory file holds only the records that have ever been
+//	needed: when none has room, Add appends a new one, and the file
+//	is extended to hold it.  A directory with a handful of files
+//	therefore occupies (and is read in) a single sector, or fits in
+//	its header.
+//
+//	Once a directory has more than DirIndexThreshold names, the next
+//	Reserve gives it an index (see dirindex.h), and from then on a
+//	path name is looked up in it without reading the rest of it.
+//	Records removed from an indexed directory are not reused: new
+//	ones always go at the end.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -23,7 +43,88 @@
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "dirindex.h"
 #include "debug.h"
+#include "ftable.h"
+#include "bufcache.h"
+#include "workpool.h"
+#include "main.h"
+#include "journal.h"
+#include "slab.h"
+
+// A Directory, and its table, is made for each directory a path name
+// goes through, so both come from caches -- the table, while it has
+// the room it starts with.
+static SlabCache directoryCache("directories", sizeof(Directory));
+static SlabCache tableCache("directory tables",
+			    NumDirEntries * sizeof(DirectoryEntry), 4);
+
+#define ReadWindow	(4 * SectorSize)	// bytes ReadEntries reads at
+						// once
+
+//----------------------------------------------------------------------
+// NewTable, DeleteTable
+// 	Allocate a table of "capacity" entries for a directory, or give
+//	one back.
+//----------------------------------------------------------------------
+
+static DirectoryEntry *
+NewTable(int capacity)
+{
+    if (capacity == NumDirEntries)
+	return (DirectoryEntry *) tableCache.Alloc();
+    return new DirectoryEntry[capacity];
+}
+
+static void
+DeleteTable(DirectoryEntry *table, int capacity)
+{
+    if (capacity == NumDirEntries)
+	tableCache.Free(table);
+    else
+	delete [] table;
+}
+
+//----------------------------------------------------------------------
+// EntryKey, HashName, CompareSlots
+//	Helpers for the in-core index of a directory: the key of an
+//	entry, the hash of a key (over the characters strncmp in
+//	EntryName compares), and the order of the free-slot list.
+//----------------------------------------------------------------------
+
+static EntryName
+EntryKey(DirectoryEntry *entry)
+{
+    return EntryName(entry->name);
+}
+
+static unsigned
+HashName(EntryName key)
+{
+    unsigned h = 0;
+
+    for (int i = 0; i < FileNameMaxLen && key.name[i] != '\0'; i++)
+	h = h * 31 + (unsigned char) key.name[i];
+    return h;
+}
+
+static int
+CompareSlots(int x, int y)
+{
+    return x - y;
+}
+
+//----------------------------------------------------------------------
+// RecordSize
+//	The bytes a record for a name of "nameLen" characters needs.
+//----------------------------------------------------------------------
+
+static int
+RecordSize(int nameLen)
+{
+    return divRoundUp(sizeof(DirectoryRecord) + nameLen, RecordAlign) *
+		RecordAlign;
+}
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -32,20 +133,29 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of entries to make room for in memory; the
+//	table grows past it as needed
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
+    : index(EntryKey, HashName), freeSlots(CompareSlots)
 {
-    table = new DirectoryEntry[size];
+    ASSERT(size > 0);
+    table = NewTable(size);
 
 	// MP4 mod tag
 	memset(table, 0, sizeof(DirectoryEntry) * size);  // dummy operation to keep valgrind happy
 
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-        table[i].inUse = FALSE;
+    capacity = size;
+    tableSize = 0;
+    numBytes = 0;
+    dirtyFrom = dirtyTo = 0;
+    indexSector = -1;
+    tree = NULL;
+    records = NULL;
+    changed = NULL;
 
+    BuildIndex();
 }
 
 //----------------------------------------------------------------------
@@ -55,12 +165,86 @@ Directory::Directory(int size)
 
 Directory::~Directory()
 {
-    delete [] table;
+    DropTree();
+    ClearIndex();
+    DeleteTable(table, capacity);
+}
+
+//----------------------------------------------------------------------
+// Directory::operator new, Directory::operator delete
+// 	Allocate a directory from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+Directory::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Directory));
+    return directoryCache.Alloc();
+}
+
+void
+Directory::operator delete(void *object)
+{
+    directoryCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// Directory::BuildIndex
+// 	Fill the (empty) name index and free-slot list from the table.
+//	A free record is not a free slot: it still has its place in the
+//	file.  The record naming the on-disk index has no name to find.
+//----------------------------------------------------------------------
+
+void
+Directory::BuildIndex()
+{
+    for (int i = 0; i < tableSize; i++) {
+	if (table[i].inUse && table[i].type != IndexType)
+	    index.Insert(&table[i]);
+	else if (table[i].recLen == 0)
+	    freeSlots.Insert(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::ClearIndex
+// 	Empty the name index and the free-slot list.  Must be called
+//	while they still describe the table, i.e. before its contents
+//	are replaced.
+//----------------------------------------------------------------------
+
+void
+Directory::ClearIndex()
+{
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].inUse && table[i].type != IndexType)
+	    (void) index.Remove(EntryName(table[i].name));
+    while (!freeSlots.IsEmpty())
+	(void) freeSlots.RemoveFront();
+}
+
+//----------------------------------------------------------------------
+// Directory::Resize
+// 	Make room for "newCapacity" entries in memory, keeping the ones
+//	there are.  The caller takes care of the index.
+//----------------------------------------------------------------------
+
+void
+Directory::Resize(int newCapacity)
+{
+    DirectoryEntry *newTable = NewTable(newCapacity);
+
+    memset(newTable, 0, sizeof(DirectoryEntry) * newCapacity);
+    memcpy(newTable, table, sizeof(DirectoryEntry) * tableSize);
+    DeleteTable(table, capacity);
+    table = newTable;
+    capacity = newCapacity;
 }
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk.  The file holds
+//	exactly the records of the table, so only those are read.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
@@ -68,12 +252,327 @@ Directory::~Directory()
 void
 Directory::FetchFrom(OpenFile *file)
 {
-    (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    Arena *scratch = kernel->currentThread->Scratch();
+    ArenaMark mark(scratch);
+    int length = file->Length();
+    char *contents = scratch->Alloc(length);
+
+    (void) file->ReadAt(contents, length, 0);
+    bool ok = Unpack(contents, length);
+    ASSERT(ok);
+}
+
+//----------------------------------------------------------------------
+// Directory::Unpack
+// 	Fill the table from the records in "contents", the "length" bytes
+//	of a directory file.  Return FALSE if a record is damaged -- it
+//	runs past the end, or is too short for its name -- in which case
+//	the table holds the records before it.
+//----------------------------------------------------------------------
+
+bool
+Directory::Unpack(char *contents, int length)
+{
+    DirectoryRecord rec;
+
+    ClearIndex();
+    DropTree();
+    tableSize = 0;
+    numBytes = 0;
+    dirtyFrom = dirtyTo = 0;
+    indexSector = -1;
+    for (int offset = 0; offset + (int) sizeof(rec) <= length;
+	    offset += rec.recLen) {
+	bcopy(&contents[offset], (char *) &rec, sizeof(rec));
+	if (rec.recLen == 0)
+	    break;			// no more records
+	if ((rec.recLen % RecordAlign) != 0 ||
+		rec.recLen < RecordSize(rec.nameLen) ||
+		offset + rec.recLen > length) {
+	    BuildIndex();
+	    return FALSE;
+	}
+	if (tableSize == capacity)
+	    Resize(capacity * 2);
+	DirectoryEntry *entry = &table[tableSize++];
+	entry->inUse = (rec.sector != -1);
+	entry->type = rec.type;
+	entry->sector = rec.sector;
+	entry->offset = offset;
+	entry->recLen = rec.recLen;
+	bcopy(&contents[offset + sizeof(rec)], entry->name, rec.nameLen);
+	entry->name[rec.nameLen] = '\0';
+	numBytes = offset + rec.recLen;
+	if (offset == 0 && entry->inUse && entry->type == IndexType)
+	    indexSector = entry->sector;
+    }
+    BuildIndex();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::FetchFor
+// 	Read in the entry of "name" -- none, if it is not there -- and
+//	what Add, Remove and WriteBack need, through the index of the
+//	directory, if it has one: a sector on each level of the index,
+//	and the sector of the record, instead of the whole directory.
+//	Other names can be looked up after; see FindIndex.  A directory
+//	with no index is read in whole, by FetchFrom.
+//
+//	"file" -- file containing the directory contents; it must stay
+//		open until the directory is fetched again, or deleted
+//	"name" -- the name to look up, without any path
+//----------------------------------------------------------------------
+
+void
+Directory::FetchFor(OpenFile *file, char *name)
+{
+    DirectoryRecord rec;
+
+    if (file->ReadAt((char *) &rec, sizeof(rec), 0) != (int) sizeof(rec) ||
+	    rec.recLen == 0 || rec.sector == -1 || rec.type != IndexType) {
+	FetchFrom(file);
+	return;
+    }
+    ClearIndex();
+    DropTree();
+    tableSize = 0;
+    dirtyFrom = dirtyTo = 0;
+    indexSector = rec.sector;
+    tree = new DirIndex(indexSector);
+    records = file;
+    changed = new ::List<int>;
+    numBytes = tree->RecordsEnd();
+    (void) LoadEntry(name);
+}
+
+//----------------------------------------------------------------------
+// Directory::DropTree
+// 	Close the index FetchFor opened, if any; the table is about to
+//	be filled in afresh, or given back.
+//----------------------------------------------------------------------
+
+void
+Directory::DropTree()
+{
+    if (tree == NULL)
+	return;
+    delete tree;
+    delete changed;
+    tree = NULL;
+    records = NULL;
+    changed = NULL;
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadEntry
+// 	Look "name" up in the on-disk index, read its record, and give it
+//	an entry in the table.  Each record with the name's hash is read
+//	until the one with the name is found, skipping those already in
+//	the table (one removed since it was read is no longer in use).
+//	Return the entry, or -1 if the name is not there.
+//----------------------------------------------------------------------
+
+int
+Directory::LoadEntry(char *name)
+{
+    ::List<int> *offsets = new ::List<int>;
+    int nameLen = strlen(name);
+    int slot = -1;
+
+    if (nameLen <= FileNameMaxLen)
+	tree->Find(HashName(EntryName(name)), offsets);
+    while (!offsets->IsEmpty()) {
+	int offset = offsets->RemoveFront();
+	DirectoryRecord rec;
+	char found[FileNameMaxLen];
+
+	if (slot != -1 || HasRecord(offset))
+	    continue;
+	(void) records->ReadAt((char *) &rec, sizeof(rec), offset);
+	if (rec.sector == -1 || rec.nameLen != nameLen)
+	    continue;
+	(void) records->ReadAt(found, nameLen, offset + sizeof(rec));
+	if (bcmp(found, name, nameLen) != 0)
+	    continue;			// another name with the same hash
+	slot = NewSlot();
+	DirectoryEntry *entry = &table[slot];
+	entry->inUse = TRUE;
+	entry->type = rec.type;
+	entry->sector = rec.sector;
+	entry->offset = offset;
+	entry->recLen = rec.recLen;
+	strcpy(entry->name, name);
+	index.Insert(entry);
+    }
+    delete offsets;
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// Directory::HasRecord
+// 	Return TRUE if the record at "offset" has an entry in the table.
+//----------------------------------------------------------------------
+
+bool
+Directory::HasRecord(int offset)
+{
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].recLen > 0 && table[i].offset == offset)
+	    return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Reserve
+// 	Extend the directory file, if the records have grown, so that
+//	WriteBack can store all of them.  Return FALSE if the disk is
+//	full.
+//
+//	The file at least doubles each time, so a large directory is
+//	made of a few long runs rather than one sector per append; the
+//	extra bytes are zeros, which read back as the end of the records.
+//
+//	The index of a directory read by FetchFor is extended too, for
+//	the names added.  A directory read in whole that has grown past
+//	DirIndexThreshold names is given an index here -- unless the disk
+//	is too full for it, in which case it just goes on without one.
+//
+//	"file" -- file containing the directory contents
+//	"freeMap" -- the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+Directory::Reserve(OpenFile *file, PersistentBitmap *freeMap)
+{
+    int length = file->Length();
+    bool indexing = (indexSector == -1 && NumInUse() > DirIndexThreshold);
+    int need = numBytes;
+
+    if (indexing && table[FirstRecord()].inUse)	// it will be moved
+	need += RecordSize(strlen(table[FirstRecord()].name));
+    if (length < need && !(2 * length > need &&
+			   file->Extend(freeMap, 2 * length)) &&
+	    !file->Extend(freeMap, need))
+	return FALSE;			// no room for the records
+    if (tree != NULL)
+	return tree->Reserve(freeMap, changed->NumInList());
+    if (indexing)
+	(void) MakeIndex(file, freeMap);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::FirstRecord, Directory::NumInUse
+// 	Return the entry of the first record of the directory, which a
+//	directory read in whole with any record in it has; and the number
+//	of names in it.
+//----------------------------------------------------------------------
+
+int
+Directory::FirstRecord()
+{
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].recLen > 0 && table[i].offset == 0)
+	    return i;
+    ASSERTNOTREACHED();
+    return -1;
+}
+
+int
+Directory::NumInUse()
+{
+    int count = 0;
+
+    for (int i = 0; i < tableSize; i++)
+	if (table[i].inUse && table[i].type != IndexType)
+	    count++;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// Directory::MakeIndex
+// 	Give a directory read in whole an index of the names in it.  The
+//	index has to be named by the first record, so the name there, if
+//	any, moves to a new record at the end, and is entered in the index
+//	at its new place.  Reserve has made room for it.  Only the table
+//	changes, besides the new index file; WriteBack writes the two
+//	records.  Nothing names the index until then, so filling it may
+//	take more than one commit.  Return FALSE, changing nothing, if the
+//	disk is too full.
+//
+//	"file" -- file containing the directory contents
+//	"freeMap" -- the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+Directory::MakeIndex(OpenFile *file, PersistentBitmap *freeMap)
+{
+    int first = FirstRecord();
+    int end = numBytes;
+    int sector = DirIndex::Create(freeMap, file->HeaderSector());
+    DirIndex *made;
+
+    if (sector == -1)
+	return FALSE;
+    made = new DirIndex(sector);
+    if (table[first].inUse)
+	end += RecordSize(strlen(table[first].name));
+    for (int i = 0; i < tableSize; i++) {
+	if (!table[i].inUse)
+	    continue;
+	if (!made->Reserve(freeMap, 1)) {
+	    delete made;
+	    DirIndex::Destroy(freeMap, sector);
+	    return FALSE;
+	}
+	kernel->journal->Reserve(made->InsertSectors());
+	made->Insert(HashName(EntryKey(&table[i])),
+		     (i == first) ? numBytes : table[i].offset);
+    }
+    kernel->journal->Reserve(1);
+    made->SetRecordsEnd(end);
+    delete made;
+
+    if (table[first].inUse) {		// move the name out of the way
+	int slot = NewSlot();		// may move the table
+	(void) index.Remove(EntryName(table[first].name));
+	table[slot] = table[first];
+	table[slot].offset = numBytes;
+	table[slot].recLen = end - numBytes;
+	index.Insert(&table[slot]);
+	Touch(&table[slot]);
+	numBytes = end;
+    }
+    table[first].inUse = TRUE;
+    table[first].type = IndexType;
+    table[first].sector = sector;
+    table[first].name[0] = '\0';
+    Touch(&table[first]);
+    indexSector = sector;
+    DEBUG(dbgFile, "Indexed a directory of " << NumInUse() << " names");
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk: just the
+//	bytes of the records that changed since it was read, or last
+//	written back, packed alone, so that adding or removing a name
+//	writes the one sector holding them (two, if they straddle a
+//	sector boundary), and the journal logs only that.  If the records
+//	have grown, Reserve must have extended the file first.  A new
+//	directory, as a snapshot makes, may be more than a journal
+//	operation holds, so it is written a piece at a time, each piece
+//	reserving its slots; nothing names it until it is all written.
+//
+//	A directory read by FetchFor has only some of its records in the
+//	table, so each one that changed is written by itself, and the
+//	index is brought up to date: a new record is written before its
+//	key is added, and the key of a removed one taken out before the
+//	record is freed, for a lookup going on meanwhile.  Each record
+//	reserves the slots for itself and the index nodes it may split,
+//	so that the two are committed together.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
@@ -81,13 +580,114 @@ Directory::FetchFrom(OpenFile *file)
 void
 Directory::WriteBack(OpenFile *file)
 {
-    (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    Arena *scratch = kernel->currentThread->Scratch();
+    ArenaMark mark(scratch);
+    int length = dirtyTo - dirtyFrom;
+    char *image;
+
+    if (tree != NULL) {
+	while (!changed->IsEmpty()) {
+	    DirectoryEntry *entry = &table[changed->RemoveFront()];
+	    unsigned hash = HashName(EntryKey(entry));
+	    int last = entry->offset + sizeof(DirectoryRecord) +
+		strlen(entry->name) - 1;
+
+	    kernel->journal->Reserve(last / SectorSize -
+				     entry->offset / SectorSize + 1 +
+				     tree->InsertSectors());
+	    if (entry->inUse) {
+		WriteRecord(file, entry);
+		tree->Insert(hash, entry->offset);
+	    } else {
+		tree->Remove(hash, entry->offset);
+		entry->name[0] = '\0';
+		WriteRecord(file, entry);
+	    }
+	}
+	kernel->journal->Reserve(1);
+	tree->SetRecordsEnd(numBytes);
+	dirtyFrom = dirtyTo = 0;
+	return;
+    }
+    if (length <= 0)
+	return;				// nothing changed
+    ASSERT(file->Length() >= numBytes);
+    image = scratch->Alloc(length);
+    bzero(image, length);
+    for (int i = 0; i < tableSize; i++) {
+	DirectoryEntry *entry = &table[i];
+	DirectoryRecord rec;
+	if (entry->recLen == 0 || entry->offset < dirtyFrom ||
+		entry->offset >= dirtyTo)
+	    continue;			// not in the bytes that changed
+	rec.sector = entry->inUse ? entry->sector : -1;
+	rec.recLen = entry->recLen;
+	rec.type = entry->type;
+	rec.nameLen = strlen(entry->name);
+	ASSERT(entry->offset + RecordSize(rec.nameLen) <= dirtyTo);
+	char *where = &image[entry->offset - dirtyFrom];
+	bcopy((char *) &rec, where, sizeof(rec));
+	bcopy(entry->name, where + sizeof(rec), rec.nameLen);
+    }
+    for (int from = dirtyFrom, to; from < dirtyTo; from = to) {
+	to = min(dirtyTo, (from / SectorSize + MaxOpSectors) * SectorSize);
+	kernel->journal->Reserve(divRoundUp(to, SectorSize) -
+				 from / SectorSize);
+	(void) file->WriteAt(image + from - dirtyFrom, to - from, from);
+    }
+    dirtyFrom = dirtyTo = 0;
+}
+
+//----------------------------------------------------------------------
+// Directory::WriteRecord
+// 	Write the record of "entry" to "file": its fixed part, and its
+//	name, if it is in use.
+//----------------------------------------------------------------------
+
+void
+Directory::WriteRecord(OpenFile *file, DirectoryEntry *entry)
+{
+    char image[sizeof(DirectoryRecord) + FileNameMaxLen];
+    DirectoryRecord rec;
+
+    ASSERT(entry->offset + entry->recLen <= file->Length());
+    rec.sector = entry->inUse ? entry->sector : -1;
+    rec.recLen = entry->recLen;
+    rec.type = entry->type;
+    rec.nameLen = strlen(entry->name);
+    bcopy((char *) &rec, image, sizeof(rec));
+    bcopy(entry->name, image + sizeof(rec), rec.nameLen);
+    (void) file->WriteAt(image, sizeof(rec) + rec.nameLen, entry->offset);
+}
+
+//----------------------------------------------------------------------
+// Directory::Touch
+// 	Note that the record of "entry" changed, so that WriteBack
+//	writes it.  Only its header and name are noted: the slack after
+//	them, if any, is never read, so a record that just grew over the
+//	one removed after it costs no more than its own bytes to write.
+//----------------------------------------------------------------------
+
+void
+Directory::Touch(DirectoryEntry *entry)
+{
+    int end = entry->offset + RecordSize(strlen(entry->name));
+
+    if (dirtyFrom >= dirtyTo) {
+	dirtyFrom = entry->offset;
+	dirtyTo = end;
+    } else {
+	dirtyFrom = min(dirtyFrom, entry->offset);
+	dirtyTo = max(dirtyTo, end);
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
 // 	Look up file name in directory, and return its location in the table of
 //	directory entries.  Return -1 if the name isn't in the directory.
+//	In a directory read by FetchFor, a name not read in yet is looked
+//	up in the index.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
@@ -95,190 +695,234 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-	    return i;
+    DirectoryEntry *entry;
+
+    if (index.Find(EntryName(name), &entry))
+	return entry - table;
+    if (tree != NULL)
+	return LoadEntry(name);	// not read in yet
     return -1;		// name not in directory
 }
 
 //----------------------------------------------------------------------
-// Directory::Find
-// 	Look up file name in directory, and return the disk sector number
-//	where the file's header is stored. Return -1 if the name isn't
-//	in the directory.
+// Directory::NewSlot
+// 	Return the lowest unused entry of the table, or append one if
+//	there is none.  The index is rebuilt if the table has to grow.
+//----------------------------------------------------------------------
+
+int
+Directory::NewSlot()
+{
+    if (!freeSlots.IsEmpty())
+	return freeSlots.RemoveFront();
+    if (tableSize == capacity) {
+	ClearIndex();
+	Resize(capacity * 2);
+	BuildIndex();
+    }
+    table[tableSize].recLen = 0;
+    return tableSize++;
+}
+
+//----------------------------------------------------------------------
+// Directory::AddEntry
+// 	Give "name" a record, and index it: the free first record, if it
+//	has room, or the slack at the end of the first record in use with
+//	room enough, split off; if there is none, a new record at the end.
+//	Return the entry's index, or -1 if the name is too long.  The
+//	file is not extended here; see Reserve.  In a directory read by
+//	FetchFor, where the records with room to spare are not known, the
+//	record always goes at the end.
 //
-//	"name" -- the file name to look up
+//	"name" -- the file name, without any path
+//	"newSector" -- the disk sector containing the file's header
+//	"inType" -- 'F' for a file, 'D' for a directory
 //----------------------------------------------------------------------
 
 int
-Directory::Find(char *name)
-{
-    //printf("Find String: %s\n", name);
-    name++;
-    char localName[256] = {0}, localIdx = 0;
-    bool findNext = false;
-    while (name[0] != '\0') {
-        if (name[0] == '/') {
-            findNext = true;
-            break;
-        }
-        localName[localIdx++] = name[0];
-        name++;
+Directory::AddEntry(char *name, int newSector, char inType)
+{
+    int nameLen = strlen(name);
+    int need = RecordSize(nameLen);
+    int i, slot = -1;
+
+    if (nameLen > FileNameMaxLen)
+	return -1;
+    ASSERT(indexSector == -1 || tree != NULL);	// or it would not be indexed
+    for (i = 0; tree == NULL && i < tableSize && slot < 0; i++) {
+	if (table[i].recLen == 0)
+	    continue;
+	if (!table[i].inUse) {
+	    if (table[i].recLen >= need)
+		slot = i;		// the free first record
+	    continue;
+	}
+	int used = RecordSize(strlen(table[i].name));
+	if (table[i].recLen - used >= need) {
+	    slot = NewSlot();		// may move the table
+	    table[slot].offset = table[i].offset + used;
+	    table[slot].recLen = table[i].recLen - used;
+	    table[i].recLen = used;
+	    Touch(&table[i]);
+	}
     }
-    //printf("Local name: %s\n", localName);
-    int i = FindIndex(localName);
-    if (i != -1) {
-        if (findNext) {
-            //printf("Start to find next with %s..., directory sector: %d\n", name, table[i].sector);
-            OpenFile *openNextDir = new OpenFile(table[i].sector);
-            Directory *nextDir = new Directory(NumDirEntries);
-            nextDir->FetchFrom(openNextDir);
-            int result = nextDir->Find(name);
-            delete openNextDir;
-            delete nextDir;
-            return result;
-        } else {
-            //printf("Return sector num: %d, directory idx: %d\n", table[i].sector, i);
-            //List();
-            return table[i].sector;
-        }
-    } else {
-        //printf("Failed to find\n");
-        return -1;
+    if (slot < 0) {			// append a record
+	slot = NewSlot();
+	table[slot].offset = numBytes;
+	table[slot].recLen = need;
+	numBytes += need;
     }
+    table[slot].inUse = TRUE;
+    strcpy(table[slot].name, name);
+    table[slot].sector = newSector;
+    table[slot].type = inType;
+    index.Insert(&table[slot]);
+    Touch(&table[slot]);
+    if (tree != NULL)
+	changed->Append(slot);
+    return slot;
 }
 
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
-//	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	return FALSE if the file name is already in the directory, or is
+//	longer than FileNameMaxLen.
+//
+//	The duplicate is looked for through the name index, and the new
+//	entry takes the lowest free slot.  Only the in-memory table
+//	changes; the caller must Reserve and WriteBack, holding the
+//	directory for update (see OpenFile::BeginUpdate) from before it
+//	fetched the table (see FileSystem::WalkPath).
 //
-//	"name" -- the name of the file being added
+//	"name" -- the name of the file being added, without any path
 //	"newSector" -- the disk sector containing the added file's header
+//	"inType" -- 'F' for a file, 'D' for a directory
 //----------------------------------------------------------------------
 
 bool
 Directory::Add(char *name, int newSector, char inType)
 {
-    if (Find(name) != -1)
-        return FALSE;
-    char nameWithOnlyPath[256] = {0};
-    char nameWithOnlyFile[256] = {0};
-    int len = strlen(name), slashIdx, tempIdx = 0;
-    for (int i = len - 1; i >= 0; i--) {
-        if (name[i] == '/') {
-            slashIdx = i;
-            break;
-        }
-    }
-    for (int i = 0; i < slashIdx; i++)
-        nameWithOnlyPath[i] = name[i];
-    for (int i = slashIdx + 1; i < len; i++)
-        nameWithOnlyFile[tempIdx++] = name[i];
-    if (nameWithOnlyPath[0] != 0) {
-        int sector = Find(nameWithOnlyPath);
-        OpenFile *openNextDir = new OpenFile(sector);
-        Directory *nextDir = new Directory(NumDirEntries);
-        nextDir->FetchFrom(openNextDir);
-        for (int i = 0; i < tableSize; i++)
-            if (!nextDir->table[i].inUse) {
-                nextDir->table[i].inUse = TRUE;
-                strncpy(nextDir->table[i].name, nameWithOnlyFile, FileNameMaxLen);
-                nextDir->table[i].sector = newSector;
-                nextDir->table[i].type = inType;
-                nextDir->WriteBack(openNextDir);
-                delete openNextDir;
-                delete nextDir;
-                return TRUE;
-            }
-        return FALSE;
-    } else {
-        for (int i = 0; i < tableSize; i++)
-            if (!table[i].inUse) {
-                table[i].inUse = TRUE;
-                strncpy(table[i].name, nameWithOnlyFile, FileNameMaxLen);
-                table[i].sector = newSector;
-                table[i].type = inType;
-                return TRUE;
-            }
-        return FALSE;
-    }
+    return FindIndex(name) == -1 && AddEntry(name, newSector, inType) != -1;
 }
 
 //----------------------------------------------------------------------
 // Directory::Remove
 // 	Remove a file name from the directory.  Return TRUE if successful;
-//	return FALSE if the file isn't in the directory.
+//	return FALSE if the file isn't in the directory.  As for Add, the
+//	caller writes the change back.
 //
-//	"name" -- the file name to be removed
+//	"name" -- the file name to be removed, without any path
 //----------------------------------------------------------------------
 
 bool
 Directory::Remove(char *name)
 {
-    if (Find(name) == -1)
-        return FALSE;
-    char nameWithOnlyPath[256] = {0};
-    char nameWithOnlyFile[256] = {0};
-    int len = strlen(name), slashIdx, tempIdx = 0;
-    for (int i = len - 1; i >= 0; i--) {
-        if (name[i] == '/') {
-            slashIdx = i;
-            break;
+    int i = FindIndex(name);
+
+    if (i == -1)
+	return FALSE; 		// name not in directory
+    deactiveEntry(i);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::RecurRemove
+// 	Remove everything in this directory, and in every directory below
+//	it.  Nothing is freed here: the header, index blocks and data
+//	sectors of each file are only marked in "doomed", for the caller
+//	to give back to the free map all at once (sectors shared with a
+//	snapshot just lose a holder, see FileHeader::MarkSectors).  Each header and
+//	directory is read once.  Nothing is written: the directories
+//	below are going away too.  Return how many files and directories
+//	were removed; the index of a directory goes too, but is neither.
+//
+//	"doomed" -- the sectors to free
+//----------------------------------------------------------------------
+
+int
+Directory::RecurRemove(Bitmap *doomed)
+{
+    int removed = 0;
+
+    for (int i = 0; i < tableSize; i++) {
+        if (!table[i].inUse)
+            continue;
+        if (table[i].type == 'D') {
+            OpenFile *dirFile = new OpenFile(table[i].sector);
+            Directory *dir = new Directory(NumDirEntries);
+            dir->FetchFrom(dirFile);
+            removed += dir->RecurRemove(doomed);
+            delete dirFile;
+            delete dir;
         }
+        FileHeader *fileHdr = kernel->fileTable->Acquire(table[i].sector);
+        fileHdr->MarkSectors(doomed, kernel->fileSystem->FreeMap());
+        doomed->Mark(table[i].sector);
+        kernel->fileTable->MarkRemoved(table[i].sector);
+        kernel->fileTable->Release(table[i].sector);
+        if (table[i].type != IndexType)
+            removed++;
     }
-    for (int i = 0; i < slashIdx; i++)
-        nameWithOnlyPath[i] = name[i];
-    for (int i = slashIdx + 1; i < len; i++)
-        nameWithOnlyFile[tempIdx++] = name[i];
-    //printf("path: %s, file: %s\n", nameWithOnlyPath, nameWithOnlyFile);
-    if (nameWithOnlyPath[0] != 0) {
-        int sector = Find(nameWithOnlyPath);
-        OpenFile *openNextDir = new OpenFile(sector);
-        Directory *nextDir = new Directory(NumDirEntries);
-        nextDir->FetchFrom(openNextDir);
-        int idx = nextDir->FindIndex(nameWithOnlyFile);
-        if (idx == -1)
-            return FALSE;
-        nextDir->table[idx].inUse = FALSE;
-        nextDir->WriteBack(openNextDir);
-        delete openNextDir;
-        delete nextDir;
-        return TRUE;
-    } else {
-        int idx = FindIndex(name);
-        if (idx == -1)
-            return FALSE;
-        table[idx].inUse = FALSE;
-        return TRUE;
-    }
+    return removed;
 }
 
-void Directory::RecurRemove(PersistentBitmap *freeMap) {
-    for (int i = 0; i < NumDirEntries; i++) {
-        if (table[i].inUse) {
-            //printf("%s\n", table[i].name);
-            if (table[i].type == 'D') {
-                OpenFile *dirFile = new OpenFile(table[i].sector);
-                Directory *dir = new Directory(NumDirEntries);
-                dir->FetchFrom(dirFile);
-                dir->RecurRemove(freeMap);
-                delete dirFile;
-                delete dir;
-            }
-            FileHeader *fileheader = new FileHeader;
-            fileheader->FetchFrom(table[i].sector);
-            fileheader->Deallocate(freeMap);
-            freeMap->Clear(table[i].sector);
-            delete fileheader;
+//----------------------------------------------------------------------
+// Directory::Collect
+// 	Append to "headers" the header sector of each file in this
+//	directory, and of each directory below it followed by its own
+//	contents.  (List has to be qualified here, since it is also the
+//	name of a member function.)
+//----------------------------------------------------------------------
+
+void
+Directory::Collect(::List<int> *headers)
+{
+    for (int i = 0; i < tableSize; i++) {
+        if (!table[i].inUse)
+            continue;
+        headers->Append(table[i].sector);
+        if (table[i].type == 'D') {
+            OpenFile *dirFile = new OpenFile(table[i].sector);
+            Directory *dir = new Directory(NumDirEntries);
+            dir->FetchFrom(dirFile);
+            dir->Collect(headers);
+            delete dirFile;
+            delete dir;
         }
     }
 }
 
+//----------------------------------------------------------------------
+// Directory::deactiveEntry
+// 	Mark entry "idx" unused, and take it out of the name index.  Its
+//	record is added to the one before it in the file; the first
+//	record has none, and is left as a free record instead.  In a
+//	directory read by FetchFor, the record before it may not be in
+//	the table, so it is always left free, keeping its name until
+//	WriteBack has taken it out of the index.
+//----------------------------------------------------------------------
+
 void Directory::deactiveEntry(int idx) {
+    ASSERT(table[idx].inUse && table[idx].type != IndexType);
+    index.Remove(EntryName(table[idx].name));
     table[idx].inUse = FALSE;
+    if (tree != NULL) {
+        ASSERT(!changed->IsInList(idx));	// not added since
+        changed->Append(idx);
+        return;
+    }
+    table[idx].name[0] = '\0';
+    for (int i = 0; i < tableSize; i++)
+        if (table[i].recLen > 0 &&
+                table[i].offset + table[i].recLen == table[idx].offset) {
+            table[i].recLen += table[idx].recLen;
+            Touch(&table[i]);
+            table[idx].recLen = 0;
+            freeSlots.Insert(idx);
+            return;
+        }
+    Touch(&table[idx]);			// the free first record
 }
 
 //----------------------------------------------------------------------
@@ -290,25 +934,225 @@ void
 Directory::List()
 {
     for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
+        if (table[i].inUse && table[i].type != IndexType)
             printf("[%d] %s %c\n",i , table[i].name, table[i].type);
 }
 
-void Directory::recurList(int depth) {
+// The following class defines one directory of the tree recurList
+// walks: where its header is, its table once it has been fetched, and
+// the subdirectory fetched for each slot of that table.
+
+class TreeNode {
+  public:
+    int sector;				// header of the directory
+    Directory *dir;			// its table
+    TreeNode **below;			// per table slot, the directory
+					// there, or NULL
+    Completion done;			// finished once "dir" is filled
+};
+
+//----------------------------------------------------------------------
+// FetchDirectory
+// 	Work for a tree walker: read in the table of the directory
+//	"node".
+//----------------------------------------------------------------------
+
+static int
+FetchDirectory(void *arg)
+{
+    TreeNode *node = (TreeNode *) arg;
+    OpenFile *file = new OpenFile(node->sector);
+
+    node->dir->FetchFrom(file);
+    delete file;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// SectorCompare, PrefetchSorted
+// 	Empty "sectors" into read-ahead requests, in sector order, one
+//	for each run of adjacent sectors, so they are read with one sweep
+//	of the disk.
+//----------------------------------------------------------------------
+
+static int
+SectorCompare(int x, int y)
+{
+    return x - y;
+}
+
+static void
+PrefetchSorted(SortedList<int> *sectors)
+{
+    while (!sectors->IsEmpty()) {
+	int first = sectors->RemoveFront(), count = 1;
+
+	while (!sectors->IsEmpty() && sectors->Front() == first + count) {
+	    (void) sectors->RemoveFront();
+	    count++;
+	}
+	kernel->bufferCache->Prefetch(first, count);
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::PrefetchHeaders
+// 	Start reading the headers of the "count" entries in "entries",
+//	for a listing that will need them all: without this, each would
+//	be a separate read, in directory order.
+//----------------------------------------------------------------------
+
+void
+Directory::PrefetchHeaders(DirectoryEntry *entries, int count)
+{
+    SortedList<int> *headers = new SortedList<int>(SectorCompare);
+
+    for (int i = 0; i < count; i++)
+	headers->Insert(entries[i].sector);
+    PrefetchSorted(headers);
+    delete headers;
+}
+
+//----------------------------------------------------------------------
+// Directory::ReadEntries
+// 	Copy up to "count" of the entries in use in the directory "file"
+//	into "entries", from the record at byte "*cursor" on, and leave
+//	"*cursor" at the record after the last one copied.  Return how
+//	many were copied, 0 at the end of the records.
+//
+//	Only the sectors of the records gone through are read, a few at
+//	a time, so a listing of a large directory reads each of its
+//	sectors once over all the calls, rather than the whole directory
+//	on each; and no table or index is built.  The record of an index
+//	is passed over, like a free one.
+//----------------------------------------------------------------------
+
+int
+Directory::ReadEntries(OpenFile *file, int *cursor, DirectoryEntry *entries,
+		       int count)
+{
+    Arena *scratch = kernel->currentThread->Scratch();
+    ArenaMark mark(scratch);
+    char *window = scratch->Alloc(ReadWindow);
+    int length = file->Length();
+    int start = 0, got = 0;		// the bytes of the file in "window"
+    int n = 0;
+    DirectoryRecord rec;
+
+    while (n < count && *cursor + (int) sizeof(rec) <= length) {
+	int at = *cursor;
+	int want = min((int) sizeof(rec) + FileNameMaxLen, length - at);
+
+	if (at < start || at + want > start + got) {
+	    start = at;
+	    got = file->ReadAt(window, min(ReadWindow, length - at), at);
+	    if (got < want)
+		break;
+	}
+	bcopy(&window[at - start], (char *) &rec, sizeof(rec));
+	if (rec.recLen == 0 || (rec.recLen % RecordAlign) != 0 ||
+		rec.recLen < RecordSize(rec.nameLen) ||
+		(int) sizeof(rec) + rec.nameLen > want)
+	    break;			// the end of the records
+	*cursor += rec.recLen;
+	if (rec.sector == -1 || rec.type == IndexType)
+	    continue;
+	DirectoryEntry *entry = &entries[n++];
+	entry->inUse = TRUE;
+	entry->type = rec.type;
+	entry->sector = rec.sector;
+	entry->offset = at;
+	entry->recLen = rec.recLen;
+	bcopy(&window[at - start + sizeof(rec)], entry->name, rec.nameLen);
+	entry->name[rec.nameLen] = '\0';
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------
+// Directory::recurList
+// 	List the names in the directory, each directory followed by
+//	everything below it, indented by "depth".
+//
+//	The tree is read a level at a time rather than depth first.  The
+//	headers of every directory on the next level are sorted and
+//	prefetched, so adjacent ones come in with one disk request, and
+//	"walkers" fetch all of their tables at once, leaving the disk to
+//	schedule the requests; so a tree takes about one disk round trip
+//	per level, plus the sectors it takes up, instead of a seek per
+//	directory.  The listing is printed from the fetched tree, in the
+//	same order as a depth-first walk.
+//----------------------------------------------------------------------
+
+void
+Directory::recurList(int depth, WorkerPool *walkers)
+{
+    TreeNode *root = new TreeNode;
+    ::List<TreeNode *> *level = new ::List<TreeNode *>;
+
+    root->sector = -1;
+    root->dir = this;
+    level->Append(root);
+    while (!level->IsEmpty()) {
+	::List<TreeNode *> *next = new ::List<TreeNode *>;
+	SortedList<int> *headers = new SortedList<int>(SectorCompare);
+
+	while (!level->IsEmpty()) {
+	    TreeNode *node = level->RemoveFront();
+	    DirectoryEntry *entries = node->dir->table;
+
+	    node->below = new TreeNode *[node->dir->tableSize];
+	    for (int i = 0; i < node->dir->tableSize; i++) {
+		node->below[i] = NULL;
+		if (entries[i].inUse && entries[i].type == 'D') {
+		    TreeNode *child = new TreeNode;
+		    child->sector = entries[i].sector;
+		    child->dir = new Directory(NumDirEntries);
+		    node->below[i] = child;
+		    next->Append(child);
+		    headers->Insert(child->sector);
+		}
+	    }
+	}
+	PrefetchSorted(headers);
+	delete headers;
+
+	ListIterator<TreeNode *> fetching(next), waiting(next);
+	for (; !fetching.IsDone(); fetching.Next())
+	    walkers->Submit(FetchDirectory, fetching.Item(),
+			    &fetching.Item()->done);
+	for (; !waiting.IsDone(); waiting.Next())
+	    (void) waiting.Item()->done.Wait();
+	delete level;
+	level = next;
+    }
+    delete level;
+    root->dir = NULL;			// not ours to delete
+    PrintTree(root, depth);
+}
+
+//----------------------------------------------------------------------
+// Directory::PrintTree
+// 	Print the part of the tree recurList fetched that is at "node"
+//	and below it, indented by "depth", and free it.
+//----------------------------------------------------------------------
+
+void
+Directory::PrintTree(TreeNode *node, int depth)
+{
     for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse) {
+        if (table[i].inUse && table[i].type != IndexType) {
             for (int j = 0; j < depth * 8; j++)
                 putchar(' ');
             printf("[%d] %s %c\n",i , table[i].name, table[i].type);
-            if (table[i].type == 'D') {
-                OpenFile *dirFile = new OpenFile(table[i].sector);
-                Directory *dir = new Directory(NumDirEntries);
-                dir->FetchFrom(dirFile);
-                dir->recurList(depth + 1);
-                delete dirFile;
-                delete dir;
-            }
+            if (node->below[i] != NULL) {
+		Directory *dir = node->below[i]->dir;
+		dir->PrintTree(node->below[i], depth + 1);
+		delete dir;
+	    }
         }
+    delete [] node->below;
+    delete node;
 }
 
 //----------------------------------------------------------------------
@@ -320,15 +1164,12 @@ void Directory::recurList(int depth) {
 void
 Directory::Print()
 {
-    FileHeader *hdr = new FileHeader;
-
     printf("Directory contents:\n");
     for (int i = 0; i < tableSize; i++)
-	if (table[i].inUse) {
+	if (table[i].inUse && table[i].type != IndexType) {
 	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-	    hdr->FetchFrom(table[i].sector);
-	    hdr->Print();
+	    kernel->fileTable->Acquire(table[i].sector)->Print();
+	    kernel->fileTable->Release(table[i].sector);
 	}
     printf("\n");
-    delete hdr;
 }
@@ -6,6 +6,16 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	On disk, the pairs are packed into variable length records, in
+//	the manner of the UNIX (ext2) file system: each record gives the
+//	length of the name, and the number of bytes to the next record,
+//	so a record takes only the room its name needs, and a removed
+//	one is given to the record before it.
+//
+//	A large directory also has an index on disk (see dirindex.h):
+//	its first record names the index file instead of a name.  A
+//	lookup in it then reads only the entries with the name's hash.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -18,10 +28,19 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#include "list.h"
+#include "openhash.h"
+#include "heap.h"
+
+class WorkerPool;
+class TreeNode;
+class DirIndex;
 
-#define FileNameMaxLen 		9	// for simplicity, we assume
-#define NumDirEntries 		64
-					// file names are <= 9 characters long
+#define FileNameMaxLen 		255	// longest file name
+#define NumDirEntries 		64	// entries a directory has room for
+					// in memory before its table grows
+#define NumTreeWalkers		4	// threads fetching directories for
+					// recurList at once
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
@@ -29,6 +48,12 @@
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
+//
+// An entry in memory also gives where its record is in the directory
+// file.  Besides the entries in use, there are the free records, and
+// slots that hold no record at all (recLen is 0).  The first record of
+// an indexed directory is an entry in use, of type IndexType, that no
+// name finds.
 
 class DirectoryEntry {
   public:
@@ -36,10 +61,44 @@ class DirectoryEntry {
     char type;
     int sector;				// Location on disk to find the
 					//   FileHeader for this file
+    int offset;				// Where the record starts in the file
+    int recLen;				// Bytes to the next record
     char name[FileNameMaxLen + 1];	// Text name for file, with +1 for
 					// the trailing '\0'
 };
 
+// The following class defines the fixed part of a record in the
+// directory file.  It is followed by the "nameLen" characters of the
+// name (with no trailing '\0'), padded out to RecordAlign bytes, and
+// then any slack left for the record to grow into.  A free record has
+// sector -1; a record length of 0 marks the end of the records, the
+// rest of the file being zeros.
+
+#define RecordAlign		4	// records start on this boundary
+#define IndexType		'I'	// the type of the first record of an
+					// indexed directory, with no name
+
+class DirectoryRecord {
+  public:
+    int sector;				// FileHeader of the file, or -1
+    unsigned short recLen;		// Bytes to the next record
+    char type;				// 'F' for a file, 'D' for a directory
+    unsigned char nameLen;		// Length of the name that follows
+};
+
+// The following class is the key of the in-core name index of a
+// directory: a file name, compared the way FindIndex always has,
+// on at most FileNameMaxLen characters.
+
+class EntryName {
+  public:
+    EntryName(char *name) { this->name = name; }
+    bool operator==(const EntryName &other) const
+	{ return strncmp(name, other.name, FileNameMaxLen) == 0; }
+
+    char *name;
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
@@ -49,6 +108,19 @@ class DirectoryEntry {
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
 // from/to disk.
+//
+// In core, the entries in use are indexed by name in a hash table, and
+// the unused slots are kept in a heap, lowest first, so neither a lookup nor
+// an Add has to scan the table.  The index is rebuilt by FetchFrom,
+// and every change to an entry goes through AddEntry/deactiveEntry to
+// keep it up to date.  Only the bytes of the records that changed are
+// written back.
+//
+// FetchFor reads an indexed directory only in part: the entries of the
+// name looked up, through the index, and after that of each other name
+// FindIndex is asked for.  An entry added then goes at the end of the
+// records, and a removed one is left free where it is; WriteBack writes
+// each changed record, and the index, on its own.
 
 class Directory {
   public:
@@ -56,25 +128,54 @@ class Directory {
 					// with space for "size" files
     ~Directory();			// De-allocate the directory
 
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
+    void FetchFor(OpenFile *file, char *name);
+    					// Just what is needed to look up
+					// "name", if the directory has an
+					// index; all of it, if not
+    bool Unpack(char *contents, int length);
+    					// Init them from the "length" bytes
+					// of a directory file; FALSE if
+					// they are damaged
+    bool Reserve(OpenFile *file, PersistentBitmap *freeMap);
+    					// Grow the file to hold the table
     void WriteBack(OpenFile *file);	// Write modifications to
 					// directory contents back to disk
 
-    int Find(char *name);		// Find the sector number of the
-					// FileHeader for file: "name"
-
-    bool Add(char *name, int newSector, char inType);  // Add a file name into the directory
+    bool Add(char *name, int newSector, char inType);
+					// Add a file name into the directory
 
     bool Remove(char *name);		// Remove a file from the directory
 
-    void RecurRemove(PersistentBitmap *freeMap);
+    int RecurRemove(Bitmap *doomed);	// Remove everything in and below
+					//  this directory, noting the
+					//  sectors to free in "doomed";
+					//  return how many entries went
+
+    void Collect(::List<int> *headers);// Append the header sectors of
+					//  everything in and below this
+					//  directory to "headers"
 
     void deactiveEntry(int idx);
 
     void List();			// Print the names of all the files
 					//  in the directory
-    void recurList(int depth);
-
+    void recurList(int depth, WorkerPool *walkers);
+    					// Print the names of everything in
+					//  and below this directory, with
+					//  "walkers" fetching subdirectories
+
+    static int ReadEntries(OpenFile *file, int *cursor,
+			   DirectoryEntry *entries, int count);
+    					// Read up to "count" entries of a
+					//  directory file, from the record
+					//  at "*cursor" on
+    static void PrefetchHeaders(DirectoryEntry *entries, int count);
+    					// Start reading the headers of
+					//  "count" entries
     void Print();			// Verbose print of the contents
 					//  of the directory -- all the file
 					//  names and their contents.
@@ -90,10 +191,54 @@ class Directory {
 		In-core part: tableSize
 	*/
 
-    int tableSize;			// Number of directory entries
+    void PrintTree(TreeNode *node, int depth);
+    					// Print what recurList fetched
+
+    friend class Fsck;			// walks the table it unpacked
+    friend class FileSystem;		// and so does Snapshot
+
+    int tableSize;			// Number of directory entries, in
+					// use or not
+    int capacity;			// Entries "table" has room for
     DirectoryEntry *table;		// Table of pairs:
 					// <file name, file header location>
-
+    int numBytes;			// Bytes of the file the records
+					// take up
+    int dirtyFrom, dirtyTo;		// The bytes that changed since the
+					// directory was read
+
+    OpenHashTable<EntryName, DirectoryEntry *> index;
+    					// In-use entries, by name
+    Heap<int> freeSlots;		// Unused entries, lowest first
+
+    int indexSector;			// Header of the on-disk index, or
+					// -1 if the directory has none
+    DirIndex *tree;			// The index, if FetchFor read only
+					// part of the directory; or NULL
+    OpenFile *records;			// and the file it read it from
+    ::List<int> *changed;		// The entries added or removed
+					// since, for WriteBack
+
+    void Resize(int newCapacity);	// Reallocate "table"
+    void BuildIndex();			// Fill index and freeSlots from
+					// the table
+    void ClearIndex();			// Empty index and freeSlots
+    int AddEntry(char *name, int newSector, char inType);
+    					// Give "name" a record, in the slack
+					// of another or at the end; return
+					// its index, or -1 if it is too long
+    int NewSlot();			// An unused entry of the table
+    int LoadEntry(char *name);		// Read the entry of "name" through
+					// the index; return its index
+    bool HasRecord(int offset);		// Is the record at "offset" read?
+    void DropTree();			// Forget what FetchFor opened
+    int FirstRecord();			// The entry of the record at 0
+    int NumInUse();			// Names in the directory
+    bool MakeIndex(OpenFile *file, PersistentBitmap *freeMap);
+    					// Give the directory an index
+    void WriteRecord(OpenFile *file, DirectoryEntry *entry);
+    					// Write just the record of "entry"
+    void Touch(DirectoryEntry *entry);	// The record of "entry" changed
 
 };
 
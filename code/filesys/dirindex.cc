@@ -0,0 +1,355 @@
+// dirindex.cc
+//	Routines to look up, add and remove the names of a large
+//	directory in its on-disk index, a B+tree of one-sector nodes.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dirindex.h"
+#include "openfile.h"
+#include "filehdr.h"
+#include "filesys.h"
+#include "ftable.h"
+#include "pbitmap.h"
+#include "debug.h"
+#include "journal.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// DirIndex::DirIndex
+// 	Open the index whose header is at "sector", reading its first
+//	sector.
+//----------------------------------------------------------------------
+
+DirIndex::DirIndex(int sector)
+{
+    file = new OpenFile(sector);
+    (void) file->ReadAt((char *) &meta, sizeof(IndexMeta), 0);
+    ASSERT(meta.magic == IndexMagic);
+}
+
+//----------------------------------------------------------------------
+// DirIndex::~DirIndex
+// 	Close the index file.
+//----------------------------------------------------------------------
+
+DirIndex::~DirIndex()
+{
+    delete file;
+}
+
+//----------------------------------------------------------------------
+// DirIndex::Create
+// 	Make a new index file, holding a tree with no keys: its first
+//	sector, and an empty leaf as the root.  Return the sector of its
+//	header, or -1 if the disk is full.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//	"goal" -- where to put it, if there is room: the directory's
+//		header
+//----------------------------------------------------------------------
+
+int
+DirIndex::Create(PersistentBitmap *freeMap, int goal)
+{
+    int sector = freeMap->FindAndSetNear(goal);
+    FileHeader *hdr;
+    OpenFile *file;
+    IndexMeta meta;
+    IndexNode root;
+
+    if (sector == -1)
+	return -1;
+    hdr = new FileHeader;
+    if (!hdr->Allocate(freeMap, 2 * SectorSize,
+		       kernel->fileSystem->Layout(), sector + 1)) {
+	delete hdr;
+	freeMap->Clear(sector);
+	return -1;
+    }
+    hdr->WriteBack(sector);
+    delete hdr;
+
+    meta.magic = IndexMagic;
+    meta.root = 1;
+    meta.height = 1;
+    meta.numNodes = 2;
+    meta.recordsEnd = 0;
+    bzero((char *) &root, sizeof(IndexNode));
+    file = new OpenFile(sector);
+    kernel->journal->Reserve(2);
+    (void) file->WriteAt((char *) &meta, sizeof(IndexMeta), 0);
+    (void) file->WriteAt((char *) &root, sizeof(IndexNode), SectorSize);
+    delete file;
+    DEBUG(dbgFile, "Made a directory index, header at " << sector);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// DirIndex::Destroy
+// 	Give back the sectors of the index whose header is at "sector",
+//	when it could not be filled; nothing else refers to it yet.
+//----------------------------------------------------------------------
+
+void
+DirIndex::Destroy(PersistentBitmap *freeMap, int sector)
+{
+    FileHeader *hdr = kernel->fileTable->Acquire(sector);
+
+    hdr->Deallocate(freeMap);
+    freeMap->Clear(sector);
+    kernel->fileTable->MarkRemoved(sector);
+    kernel->fileTable->Release(sector);
+}
+
+//----------------------------------------------------------------------
+// DirIndex::Reserve
+// 	Extend the index file, if need be, so that "inserts" keys can be
+//	added without running out of nodes: each may split a node on
+//	every level, and add a level.  As for a directory, the file at
+//	least doubles each time.  Return FALSE if the disk is full.
+//----------------------------------------------------------------------
+
+bool
+DirIndex::Reserve(PersistentBitmap *freeMap, int inserts)
+{
+    int length = file->Length();
+    int need = (meta.numNodes + inserts * (meta.height + 1)) * SectorSize;
+
+    if (length >= need)
+	return TRUE;
+    if (2 * length > need && file->Extend(freeMap, 2 * length))
+	return TRUE;
+    return file->Extend(freeMap, need);
+}
+
+//----------------------------------------------------------------------
+// DirIndex::ReadNode, DirIndex::WriteNode, DirIndex::WriteMeta
+// 	Move node "n" of the tree, or the first sector, between memory
+//	and the index file.
+//----------------------------------------------------------------------
+
+void
+DirIndex::ReadNode(int n, IndexNode *node)
+{
+    ASSERT(n > 0 && n < meta.numNodes);
+    (void) file->ReadAt((char *) node, sizeof(IndexNode), n * SectorSize);
+}
+
+void
+DirIndex::WriteNode(int n, IndexNode *node)
+{
+    ASSERT(n > 0 && n < meta.numNodes);
+    (void) file->WriteAt((char *) node, sizeof(IndexNode), n * SectorSize);
+}
+
+void
+DirIndex::WriteMeta()
+{
+    (void) file->WriteAt((char *) &meta, sizeof(IndexMeta), 0);
+}
+
+//----------------------------------------------------------------------
+// ChildFor
+// 	The child of the inner node "node" that "hash" belongs in: the
+//	last one whose smallest hash is below it.  A name whose hash
+//	is equal to that of the child after may still be in this one,
+//	as a leaf is split without regard to equal hashes.
+//----------------------------------------------------------------------
+
+static int
+ChildFor(IndexNode *node, unsigned hash)
+{
+    int i = 0;
+
+    while (i + 1 < node->count && node->keys[i + 1].hash < hash)
+	i++;
+    return i;
+}
+
+//----------------------------------------------------------------------
+// DirIndex::FirstLeaf
+// 	Return the leftmost leaf a key with "hash" could be in,
+//	reading a node on each level on the way down.
+//----------------------------------------------------------------------
+
+int
+DirIndex::FirstLeaf(unsigned hash)
+{
+    IndexNode node;
+    int n = meta.root;
+
+    for (;;) {
+	ReadNode(n, &node);
+	if (node.level == 0)
+	    return n;
+	n = node.keys[ChildFor(&node, hash)].value;
+    }
+}
+
+//----------------------------------------------------------------------
+// DirIndex::Find
+// 	Append to "offsets" the record offset of each key with "hash": the
+//	names whose records may be the one looked for.  They are in the
+//	leaf FirstLeaf finds and, if they run to its end, in the leaves
+//	after it.
+//----------------------------------------------------------------------
+
+void
+DirIndex::Find(unsigned hash, ::List<int> *offsets)
+{
+    IndexNode node;
+
+    for (int n = FirstLeaf(hash); n != 0; n = node.next) {
+	ReadNode(n, &node);
+	for (int i = 0; i < node.count; i++) {
+	    if (node.keys[i].hash > hash)
+		return;
+	    if (node.keys[i].hash == hash)
+		offsets->Append(node.keys[i].value);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// DirIndex::InsertAt
+// 	Add the key ("hash", "value") to the subtree at node "n".  Return
+//	TRUE if "n" had to be split, with the key of the node made for
+//	the upper half of it in "upHash" and "upNode", for the parent to
+//	add.  The new node is written before "n" is, so that a lookup
+//	meanwhile finds it through the old "n", or through the link from
+//	the new one.
+//----------------------------------------------------------------------
+
+bool
+DirIndex::InsertAt(int n, unsigned hash, int value, unsigned *upHash,
+		   int *upNode)
+{
+    IndexNode node, upper;
+    int i, half;
+
+    ReadNode(n, &node);
+    if (node.level == 0) {
+	for (i = node.count; i > 0 && node.keys[i - 1].hash > hash; i--)
+	    continue;			// after the keys with the same hash
+    } else {
+	i = ChildFor(&node, hash);
+	if (!InsertAt(node.keys[i].value, hash, value, &hash, &value))
+	    return FALSE;		// the child had room
+	i++;				// its new neighbour goes after it
+    }
+
+    if (node.count < IndexFanout) {
+	for (int j = node.count; j > i; j--)
+	    node.keys[j] = node.keys[j - 1];
+	node.keys[i].hash = hash;
+	node.keys[i].value = value;
+	node.count++;
+	WriteNode(n, &node);
+	return FALSE;
+    }
+
+    // full: the upper half of the keys, with the new one, goes to a
+    // new node
+    IndexKey all[IndexFanout + 1];
+    for (int j = 0, k = 0; j <= IndexFanout; j++) {
+	if (j == i) {
+	    all[j].hash = hash;
+	    all[j].value = value;
+	} else {
+	    all[j] = node.keys[k++];
+	}
+    }
+    half = (IndexFanout + 1) / 2;
+    bzero((char *) &upper, sizeof(IndexNode));
+    upper.level = node.level;
+    upper.count = IndexFanout + 1 - half;
+    for (int j = 0; j < upper.count; j++)
+	upper.keys[j] = all[half + j];
+    node.count = half;
+    for (int j = 0; j < half; j++)
+	node.keys[j] = all[j];
+    *upNode = meta.numNodes++;
+    *upHash = upper.keys[0].hash;
+    if (node.level == 0) {
+	upper.next = node.next;
+	node.next = *upNode;
+    }
+    ASSERT(meta.numNodes * SectorSize <= file->Length());	// Reserve
+    WriteNode(*upNode, &upper);
+    WriteNode(n, &node);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DirIndex::Insert
+// 	Add the key ("hash", "offset") for a record just written; Reserve
+//	must have made room.  If the root splits, a new root is made above
+//	it, and written before the first sector that names it.
+//----------------------------------------------------------------------
+
+void
+DirIndex::Insert(unsigned hash, int offset)
+{
+    unsigned upHash;
+    int upNode;
+
+    if (!InsertAt(meta.root, hash, offset, &upHash, &upNode)) {
+	return;
+    }
+    IndexNode root;
+    bzero((char *) &root, sizeof(IndexNode));
+    root.level = meta.height;
+    root.count = 2;
+    root.keys[0].hash = 0;
+    root.keys[0].value = meta.root;
+    root.keys[1].hash = upHash;
+    root.keys[1].value = upNode;
+    meta.root = meta.numNodes++;
+    meta.height++;
+    ASSERT(meta.numNodes * SectorSize <= file->Length());
+    WriteNode(meta.root, &root);
+    WriteMeta();
+}
+
+//----------------------------------------------------------------------
+// DirIndex::Remove
+// 	Take out the key ("hash", "offset"), which must be there.  Its
+//	leaf is not merged with another, however few keys it is left with.
+//----------------------------------------------------------------------
+
+void
+DirIndex::Remove(unsigned hash, int offset)
+{
+    IndexNode node;
+
+    for (int n = FirstLeaf(hash); n != 0; n = node.next) {
+	ReadNode(n, &node);
+	for (int i = 0; i < node.count; i++) {
+	    if (node.keys[i].hash != hash || node.keys[i].value != offset)
+		continue;
+	    for (int j = i + 1; j < node.count; j++)
+		node.keys[j - 1] = node.keys[j];
+	    node.count--;
+	    WriteNode(n, &node);
+	    return;
+	}
+    }
+    ASSERTNOTREACHED();
+}
+
+//----------------------------------------------------------------------
+// DirIndex::SetRecordsEnd
+// 	Note that the directory's records now take up "end" bytes.
+//----------------------------------------------------------------------
+
+void
+DirIndex::SetRecordsEnd(int end)
+{
+    if (end == meta.recordsEnd)
+	return;
+    meta.recordsEnd = end;
+    WriteMeta();
+}
@@ -0,0 +1,124 @@
+// dirindex.h
+//	Data structures for the on-disk index of a large directory: a
+//	B+tree, keyed by the hash of each name, giving where the name's
+//	record is in the directory file.
+//
+//	A directory with more than DirIndexThreshold names in it gets an
+//	index, the first time a name is added to it after that.  The
+//	index is a Nachos file of its own, whose header is named by the
+//	first record of the directory (see directory.h).  Each node of
+//	the tree is one sector of that file; the first sector is the
+//	root's address, the height, and the other numbers the tree needs.
+//	So a name is looked up by reading a sector per level, and then
+//	the sector holding its record, rather than the whole directory.
+//
+//	A leaf holds (hash, record offset) pairs, and the number of the
+//	next leaf, so names with the same hash can be followed from one
+//	leaf to the next.  An inner node holds (hash, child) pairs; the
+//	hash of each but the first is the smallest that could be in its
+//	child.  Nodes are split when full, but never merged: a removed
+//	name just leaves its leaf with one key less.
+//
+//	Like the directory, the index is only changed by a thread holding
+//	the directory for update.  Nodes are written children first, and
+//	a leaf's new neighbour before the leaf that links to it, so a
+//	lookup that reads the tree meanwhile still finds every name there
+//	was.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include "disk.h"
+#include "list.h"
+
+#define DirIndexThreshold	128	// names that make a directory get
+					// an index
+#define IndexMagic	0x44495831	// marks the first sector of an index
+
+class OpenFile;
+class PersistentBitmap;
+
+// The following class defines a key of a node: a hash, and the record
+// offset (in a leaf) or the child node (in an inner node) it leads to.
+
+class IndexKey {
+  public:
+    unsigned hash;
+    int value;
+};
+
+#define IndexFanout	((int) ((SectorSize - 3 * sizeof(int)) / sizeof(IndexKey)))
+					// keys in a node
+
+// The following class defines a node of the tree, one sector of the
+// index file.
+
+class IndexNode {
+  public:
+    int level;				// 0 for a leaf
+    int count;				// Keys in use
+    int next;				// The next leaf, or 0 for none
+    IndexKey keys[IndexFanout];		// Sorted by hash
+};
+
+// The following class defines the first sector of the index file.
+
+class IndexMeta {
+  public:
+    int magic;				// IndexMagic
+    int root;				// Node at the top of the tree
+    int height;				// Levels of nodes, 1 for a lone leaf
+    int numNodes;			// Nodes in use, with this one
+    int recordsEnd;			// Bytes of the directory file the
+					// records take up
+};
+
+// The following class defines the index of a directory, in the file
+// whose header is at "sector".
+
+class DirIndex {
+  public:
+    DirIndex(int sector);		// Open the index
+    ~DirIndex();
+
+    static int Create(PersistentBitmap *freeMap, int goal);
+    					// Make an empty index, near "goal";
+					// return its header, or -1
+    static void Destroy(PersistentBitmap *freeMap, int sector);
+    					// Give back an index Create made
+
+    bool Reserve(PersistentBitmap *freeMap, int inserts);
+    					// Grow the file, so that "inserts"
+					// more keys can be added
+    void Find(unsigned hash, ::List<int> *offsets);
+    					// Append the offsets of the records
+					// with "hash" to "offsets"
+    void Insert(unsigned hash, int offset);
+    void Remove(unsigned hash, int offset);
+
+    int RecordsEnd() { return meta.recordsEnd; }
+    int InsertSectors() { return 2 * meta.height + 2; }
+					// The most an Insert writes
+    void SetRecordsEnd(int end);	// The records have grown to "end"
+
+  private:
+    void ReadNode(int n, IndexNode *node);
+    void WriteNode(int n, IndexNode *node);
+    void WriteMeta();
+    int FirstLeaf(unsigned hash);	// The leftmost leaf "hash" could
+					// be in
+    bool InsertAt(int n, unsigned hash, int value, unsigned *upHash,
+		  int *upNode);		// Insert below node "n"; if it
+					// splits, the new node's key
+
+    OpenFile *file;			// The index file
+    IndexMeta meta;			// Its first sector
+};
+
+#endif // DIRINDEX_H
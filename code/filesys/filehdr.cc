@@ -4,15 +4,27 @@
 //
 //	The file header is used to locate where on disk the 
 //	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the 
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect 
-//	blocks). The table size is chosen so that the file header
+//	table of pointers -- the first NumDirect entries point to the 
+//	disk sectors containing the start of the file data, and the last
+//	three to a single, a double and a triple indirect block, each
+//	of which holds PointersPerIndex pointers to the next level down.
+//	The table size is chosen so that the file header
 //	will be just big enough to fit in one disk sector, 
 //
 //      Unlike in a real system, we do not keep track of file permissions, 
 //	ownership, last modification date, etc., in the file header. 
 //
+//	A file header can also describe its data as extents -- runs of
+//	contiguous sectors -- instead of index lists.  Which layout a new
+//	file gets is chosen by the file system when the disk is formatted.
+//	Either way, a file small enough to fit in the sector table is kept
+//	inline, in the header itself, until it grows.  Index lists can
+//	also map blocks of several sectors each, chosen at format time.
+//
+//	New data sectors are not zeroed on disk.  The header remembers how
+//	many of the file's sectors have been written (its high-water mark),
+//	and OpenFile reads the sectors beyond it as zeros.
+//
 //	A file header can be initialized in two ways:
 //	   for a new file, by modifying the in-memory data structure
 //	     to point to the newly allocated data blocks
@@ -22,83 +34,1434 @@
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
-#include "copyright.h"
+#include "copyright.h"
+
+#include "filehdr.h"
+#include "debug.h"
+#include "bufcache.h"
+#include "synchdisk.h"
+#include "main.h"
+#include "journal.h"
+#include "slab.h"
+
+// The following class is the in-core copy of an index block of the
+// indirect tree.  "entry" is exactly the on-disk contents: the sectors
+// of the blocks one level down.  Those blocks are read into "child"
+// the first time a lookup passes through them, and stay resident
+// until the FileHeader is deleted or re-fetched.  Unused entries
+// are -1.  A block changed by Extend is "dirty" until it is written.
+
+class IndexBlock {
+  public:
+    IndexBlock(int sector);		// An empty block stored at "sector"
+    ~IndexBlock();			// Also deletes the resident children
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
+    int sector;				// Where the block lives on disk
+    int entry[PointersPerIndex];	// Sectors one level down
+    IndexBlock *child[PointersPerIndex];// In-core children, or NULL
+    bool dirty;				// Changed since read or written
+};
+
+IndexBlock::IndexBlock(int sector)
+{
+    this->sector = sector;
+    dirty = FALSE;
+    for (int i = 0; i < PointersPerIndex; i++) {
+        entry[i] = -1;
+        child[i] = NULL;
+    }
+}
+
+IndexBlock::~IndexBlock()
+{
+    for (int i = 0; i < PointersPerIndex; i++)
+        delete child[i];
+}
+
+// In-core headers and index blocks are made each time a file is opened
+// that no one has open.
+static SlabCache fileHeaderCache("file headers", sizeof(FileHeader));
+static SlabCache indexBlockCache("index blocks", sizeof(IndexBlock));
+
+void *
+IndexBlock::operator new(size_t size)
+{
+    ASSERT(size == sizeof(IndexBlock));
+    return indexBlockCache.Alloc();
+}
+
+void
+IndexBlock::operator delete(void *object)
+{
+    indexBlockCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// LastSector
+//	Return the last sector of the volume (see SynchDisk): no goal is
+//	past it.
+//----------------------------------------------------------------------
+
+static int
+LastSector()
+{
+    return kernel->synchDisk->VolumeSectors() - 1;
+}
+
+//----------------------------------------------------------------------
+// Span
+//	Return the number of data blocks reachable through one entry of
+//	an index block "level" levels above the data (level 1 entries
+//	point straight at data blocks; see FileHeader::BlockSectors).
+//----------------------------------------------------------------------
+
+static int
+Span(int level)
+{
+    int span = 1;
+    for (int i = 1; i < level; i++)
+        span *= PointersPerIndex;
+    return span;
+}
+
+//----------------------------------------------------------------------
+// NumIndexSectors
+//	Return the number of index blocks needed by an index tree "level"
+//	levels deep that maps "count" data blocks.
+//----------------------------------------------------------------------
+
+static int
+NumIndexSectors(int level, int count)
+{
+    int total = 1;
+    if (level > 1) {
+        int span = Span(level);
+        for (; count > 0; count -= span)
+            total += NumIndexSectors(level - 1, min(count, span));
+    }
+    return total;
+}
+
+//----------------------------------------------------------------------
+// TotalIndexSectors
+//	Return the number of index blocks an IndexLayout file of
+//	"numBlocks" data blocks needs, over all its indirect trees.
+//----------------------------------------------------------------------
+
+static int
+TotalIndexSectors(int numBlocks)
+{
+    int total = 0, remaining = numBlocks - NumDirect;
+
+    for (int level = 1; level <= NumIndirectLevels && remaining > 0; level++) {
+        int count = min(remaining, Span(level + 1));
+        total += NumIndexSectors(level, count);
+        remaining -= count;
+    }
+    return total;
+}
+
+//----------------------------------------------------------------------
+// MP4 mod tag
+// FileHeader::FileHeader
+//	There is no need to initialize a fileheader,
+//	since all the information should be initialized by Allocate or FetchFrom.
+//	The purpose of this function is to keep valgrind happy.
+//----------------------------------------------------------------------
+FileHeader::FileHeader()
+{
+	numBytes = -1;
+	numSectors = -1;
+    numWritten = -1;
+    layout = IndexLayout;
+    compressed = FALSE;
+    blockShift = 0;
+    numExtents = -1;
+	memset(dataSectors, -1, sizeof(dataSectors));
+    for (int i = 0; i < NumIndirectLevels; i++)
+        indirect[i] = NULL;
+    delayed = NULL;
+    numDelayed = 0;
+    delayedBytes = 0;
+    numReserved = 0;
+}
+
+//----------------------------------------------------------------------
+// MP4 mod tag
+// FileHeader::~FileHeader
+//	Deallocate the in-core copies of the index blocks, and any data
+//	still waiting for delayed allocation (the file was removed).
+//----------------------------------------------------------------------
+FileHeader::~FileHeader()
+{
+    FreeIndex();
+    delete [] delayed;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::operator new, FileHeader::operator delete
+// 	Allocate a file header from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+FileHeader::operator new(size_t size)
+{
+    ASSERT(size == sizeof(FileHeader));
+    return fileHeaderCache.Alloc();
+}
+
+void
+FileHeader::operator delete(void *object)
+{
+    fileHeaderCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::GetIndex
+//	Return the root of the "level" indirect tree (1 for single
+//	indirect, up to NumIndirectLevels).  The block is read from disk
+//	the first time it is needed; after that it is a memory lookup.
+//----------------------------------------------------------------------
+
+IndexBlock *
+FileHeader::GetIndex(int level)
+{
+    ASSERT(level >= 1 && level <= NumIndirectLevels);
+    if (indirect[level - 1] == NULL) {
+        IndexBlock *block = new IndexBlock(dataSectors[NumDirect + level - 1]);
+        kernel->bufferCache->ReadSector(block->sector, (char *) block->entry);
+        indirect[level - 1] = block;
+    }
+    return indirect[level - 1];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::GetChild
+//	Return the index block that entry "which" of "block" points to,
+//	reading it from disk the first time.
+//----------------------------------------------------------------------
+
+IndexBlock *
+FileHeader::GetChild(IndexBlock *block, int which)
+{
+    if (block->child[which] == NULL) {
+        IndexBlock *child = new IndexBlock(block->entry[which]);
+        kernel->bufferCache->ReadSector(child->sector, (char *) child->entry);
+        block->child[which] = child;
+    }
+    return block->child[which];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeIndex
+//	Drop the in-core copies of the index blocks, e.g. before the header
+//	is overwritten by FetchFrom.
+//----------------------------------------------------------------------
+
+void
+FileHeader::FreeIndex()
+{
+    for (int i = 0; i < NumIndirectLevels; i++) {
+        delete indirect[i];
+        indirect[i] = NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Allocate
+// 	Initialize a fresh file header for a newly created file.
+//	Allocate data blocks for the file out of the map of free disk blocks.
+//	Return FALSE if there are not enough free blocks to accomodate
+//	the new file.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSize" is the bit map of free disk sectors
+//	"layout" is how the header describes the data blocks, with the
+//		block size or'ed in (see BlockFlag) for IndexLayout
+//	"goal" is where the data should go, usually near the header
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize, int layout,
+                     int goal)
+{ 
+    this->layout = layout & ~BlockMask;
+    blockShift = (this->layout == IndexLayout) ? BlockShiftOf(layout) : 0;
+    compressed = FALSE;
+    numBytes = 0;
+    numSectors = 0;
+    numWritten = 0;
+    numExtents = 0;
+    FreeIndex();
+    memset(dataSectors, -1, sizeof(dataSectors));
+    if (layout == ExtentLayout)
+        memset(extents, 0, sizeof(extents));
+    return Extend(freeMap, fileSize, goal);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Grow the file to "newSize" bytes, allocating the data sectors (and
+//	for IndexLayout, the index blocks) it needs beyond the current
+//	ones.  New index blocks are written, but new data sectors are
+//	left as they are: they lie above the high-water mark, so they read
+//	as zeros until they are written.  The header itself is only changed
+//	in memory.  Return FALSE, leaving
+//	the file as it was, if there is not enough free space.
+//
+//	New sectors are placed near the end of the existing data, or near
+//	"goal" if there is none, so a file (and its index blocks) stays
+//	in one allocation group as far as possible.
+//
+//	A file that is growing by small appends asks for "spare" sectors
+//	beyond what "newSize" needs, so most appends find their sector
+//	already allocated and only change the length.  The spare sectors
+//	are only taken if they fit; Trim gives back whatever is left over.
+//	A file with blocks of several sectors takes them up to the end of
+//	a block, so that it grows a whole block at a time.
+//
+//	A compressed file only gets its sectors as its chunks are stored,
+//	so it is grown with a hole instead (see ExtendSparse).
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, at least the current one
+//	"goal" is where the data should start, for an empty file
+//	"spare" is how many sectors to allocate ahead of need
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Extend(PersistentBitmap *freeMap, int newSize, int goal,
+                   int spare)
+{
+    int newSectors = divRoundUp(newSize, SectorSize);
+
+    ASSERT(newSize >= numBytes);
+    if (compressed)
+        return ExtendSparse(freeMap, newSize, goal);
+    if (IsInline() && newSize <= MaxInlineSize) {
+        memset(inlineData + numBytes, 0, newSize - numBytes);
+        numBytes = newSize;
+        return TRUE;
+    }
+    if (newSectors <= numSectors) {		// allocated ahead already
+        numBytes = newSize;
+        return TRUE;
+    }
+    if (IsInline() && numBytes > 0)
+        return Uninline(freeMap, newSize, goal, spare);
+    if (numSectors > 0 && ByteToSector((numSectors - 1) * SectorSize) >= 0)
+        goal = ByteToSector((numSectors - 1) * SectorSize) + 1;
+    goal = min(max(goal, 0), LastSector());
+    if (spare > 0)
+        spare = NumBlocks(newSectors + spare) * BlockSectors() - newSectors;
+    if (!(spare > 0 && AddSectors(freeMap, newSectors + spare, goal)) &&
+            !AddSectors(freeMap, newSectors, goal))
+        return FALSE;
+    numBytes = newSize;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddSectors
+// 	Allocate data sectors (and for IndexLayout, index blocks) until the
+//	file has "newSectors" of them, starting near "goal".  Return FALSE,
+//	leaving the file as it was, if they do not fit.  (A short last
+//	block that had to be moved stays moved.)
+//----------------------------------------------------------------------
+
+bool
+FileHeader::AddSectors(PersistentBitmap *freeMap, int newSectors, int goal)
+{
+    if (layout == ExtentLayout)
+        return ExtendExtents(freeMap, newSectors, goal);
+
+    // count the index blocks on top of the new data, to see if it all fits
+    // (plus one per level, in case the blocks at the end of the old
+    // data are missing because it ends in a hole)
+    int needed = newSectors - numSectors + NumIndirectLevels +
+            TotalIndexSectors(NumBlocks(newSectors)) -
+            TotalIndexSectors(NumBlocks(numSectors));
+    if (newSectors > MaxFileSectors || freeMap->NumFree() < needed)
+        return FALSE;
+
+    // a short last block is filled out first, so the rest starts a block
+    int oldSectors = numSectors;
+    if (numSectors % BlockSectors() != 0 && !GrowLastBlock(freeMap,
+            min(NumBlocks(numSectors) * BlockSectors(), newSectors), goal))
+        return FALSE;
+
+    // take the data sectors in runs that are as long as possible, so
+    // the file is laid out sequentially on disk -- or, if the disk wants
+    // them interleaved, one at a time, each that far after the one before
+    // (not a block, which is read with one request anyway)
+    int interleave = (BlockSectors() == 1) ? kernel->synchDisk->Interleave()
+                                           : 1;
+
+    for (int i = numSectors; i < newSectors; ) {
+        int previous = (i > 0) ? ByteToSector((i - 1) * SectorSize) : -1;
+        int length = 1, start;
+
+        if (interleave > 1 && previous >= 0)
+            start = freeMap->FindAndSetInterleaved(previous, interleave);
+        else if (interleave > 1)
+            start = freeMap->FindAndSetNear(goal);
+        else
+            start = TakeRun(freeMap, goal, newSectors - i, &length);
+        if (start < 0) {			// no run as long as a block
+            numSectors = i;
+            TrimTo(freeMap, oldSectors);
+            return FALSE;
+        }
+        goal = min(start + length, LastSector());
+        for (int j = 0; j < length; j++, i++)
+            MapSector(freeMap, i, start + j);
+    }
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (indirect[level - 1] != NULL)
+            WriteIndex(indirect[level - 1]);
+    numSectors = newSectors;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::GrowLastBlock
+// 	Grow the last block of an IndexLayout file, which is shorter than
+//	a block, until the file has "newSectors" data sectors, at most to
+//	the end of the block: in place, if the sectors after it are free,
+//	or else by moving it to a new run near "goal", copying the sectors
+//	written so far.  A hole just gets longer.  Changed index blocks
+//	are left dirty for the caller to write.  Return FALSE, leaving the
+//	file as it was, if there is no run that long.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::GrowLastBlock(PersistentBitmap *freeMap, int newSectors,
+                          int goal)
+{
+    int first = (numSectors - 1) & ~(BlockSectors() - 1);
+    int old = ByteToSector(first * SectorSize), sector, n;
+    int length = numSectors - first, want = newSectors - first;
+
+    ASSERT(want > length && want <= BlockSectors());
+    if (old >= 0) {
+        for (n = length; n < want && old + n <= LastSector() &&
+                !freeMap->Test(old + n); n++)
+            continue;
+        if (n == want) {			// room right after it
+            for (n = length; n < want; n++)
+                freeMap->Mark(old + n);
+        } else {
+            if ((sector = TakeBlock(freeMap, goal, want)) < 0)
+                return FALSE;
+            DEBUG(dbgFile, "Moving the last block, sector " << old
+                    << ", to " << sector);
+            for (n = 0; n < length; n++) {
+                if (first + n < numWritten)
+                    kernel->bufferCache->CopySector(old + n, sector + n);
+                freeMap->Clear(old + n);
+            }
+            MapSector(freeMap, first, sector);	// the index blocks exist
+        }
+    }
+    numSectors = newSectors;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TakeRun
+// 	Allocate a run of up to "want" data sectors, as close to "goal"
+//	as possible, for the data of an IndexLayout file from the start
+//	of a block on: it ends at the end of a block unless it is all
+//	"want" sectors, as no block may be split.  Return its first
+//	sector, with its length in "length", or -1 if there is no run as
+//	long as a block (or as "want").
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+int
+FileHeader::TakeRun(PersistentBitmap *freeMap, int goal, int want,
+                    int *length)
+{
+    int start = freeMap->FindAndSetRunNear(goal, want, length);
+    int extra;
+
+    if (start < 0 || *length == want)
+        return start;
+    extra = (*length < min(want, BlockSectors())) ? *length
+                                                  : *length % BlockSectors();
+    for (int j = *length - extra; j < *length; j++)
+        freeMap->Clear(start + j);		// give back the part block
+    *length -= extra;
+    return (*length > 0) ? start : -1;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TakeBlock
+// 	Allocate a run of exactly "length" sectors, at most a block, as
+//	close to "goal" as possible.  Return its first sector, or -1 if
+//	there is none.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+int
+FileHeader::TakeBlock(PersistentBitmap *freeMap, int goal, int length)
+{
+    int start, found;
+
+    if (length == 1)
+        return freeMap->FindAndSetNear(goal);
+    start = TakeRun(freeMap, goal, length, &found);
+    ASSERT(start < 0 || found == length);
+    return start;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendSparse
+// 	Grow the file to "newSize" bytes by adding a hole at the end: the
+//	new part reads as zeros, and takes no disk space until FillHole
+//	allocates it a sector at a time.  An inline file that is grown
+//	past MaxInlineSize first has its data moved to a sector near
+//	"goal".  The header itself is only changed in memory.  Return
+//	FALSE if that sector cannot be allocated, or if an ExtentLayout
+//	file has no extent left for the hole.
+//
+//	A compressed file is never inline, and its sector table is grown
+//	to the end of the last chunk.  A short last block is filled out
+//	first (see GrowLastBlock), as only the last block may be short.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, at least the current one
+//	"goal" is where the data should go, for an inline file
+//----------------------------------------------------------------------
+
+bool
+FileHeader::ExtendSparse(PersistentBitmap *freeMap, int newSize, int goal)
+{
+    int newSectors = divRoundUp(newSize, SectorSize);
+
+    ASSERT(newSize >= numBytes);
+    if (compressed)
+        newSectors = divRoundUp(newSectors, SectorsPerChunk) * SectorsPerChunk;
+    else if (newSize <= MaxInlineSize || newSectors <= numSectors)
+        return Extend(freeMap, newSize, goal);
+    if (layout == IndexLayout && newSectors > MaxFileSectors)
+        return FALSE;
+    if (IsInline() && numBytes > 0 &&
+            !Extend(freeMap, min(newSize, SectorSize), goal))
+        return FALSE;				// moved to a sector
+    if (layout == IndexLayout && numSectors % BlockSectors() != 0 &&
+            !AddSectors(freeMap, min(NumBlocks(numSectors) * BlockSectors(),
+                                     newSectors), goal))
+        return FALSE;
+    if (newSectors > numSectors && layout == ExtentLayout) {
+        if (numExtents > 0 && extents[numExtents - 1].start < 0) {
+            extents[numExtents - 1].length += newSectors - numSectors;
+        } else if (numExtents < MaxExtentNum) {
+            extents[numExtents].start = -1;
+            extents[numExtents].length = newSectors - numSectors;
+            numExtents++;
+        } else {
+            return FALSE;
+        }
+    }
+    numSectors = max(numSectors, newSectors);
+    numBytes = newSize;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillHole
+// 	Allocate a data sector for "sectorIdx", which is in a hole.  It
+//	goes right after the sector before it if that is free, or else
+//	near "goal".  The sector's contents are garbage; the caller is
+//	about to write it.  Changed index blocks are written, but the
+//	header itself is only changed in memory.  Return FALSE if the disk
+//	is full, or an ExtentLayout file has no extents left to split the
+//	hole with.
+//
+//	With blocks of several sectors, the whole block of "sectorIdx" is
+//	allocated, and its other sectors below the high-water mark are
+//	zeroed, as they will be read.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"goal" is where the sector should go, if the one before is a hole
+//----------------------------------------------------------------------
+
+bool
+FileHeader::FillHole(PersistentBitmap *freeMap, int sectorIdx, int goal)
+{
+    int first = sectorIdx & ~(BlockSectors() - 1);
+    int sector;
+
+    ASSERT(sectorIdx < numSectors && ByteToSector(sectorIdx * SectorSize) < 0);
+    if (first > 0 && ByteToSector((first - 1) * SectorSize) >= 0)
+        goal = ByteToSector((first - 1) * SectorSize) + 1;
+    goal = min(max(goal, 0), LastSector());
+    if (layout == IndexLayout) {
+        int length = BlockLength(sectorIdx >> blockShift);
+        char zeros[SectorSize] = {0};
+
+        if (freeMap->NumFree() < length + NumIndirectLevels ||
+                (sector = TakeBlock(freeMap, goal, length)) < 0)
+            return FALSE;			// the data, and index blocks
+        for (int j = 0; j < length; j++)
+            if (first + j != sectorIdx && first + j < numWritten)
+                kernel->bufferCache->WriteSector(sector + j, zeros);
+        MapSector(freeMap, first, sector);
+        for (int level = 1; level <= NumIndirectLevels; level++)
+            if (indirect[level - 1] != NULL)
+                WriteIndex(indirect[level - 1]);
+        return TRUE;
+    }
+    return RemapExtent(freeMap, sectorIdx, goal);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Preallocate
+// 	Give the first "size" bytes of the file data sectors now, before
+//	they are written, so that a writer that knows how big the file
+//	will be gets it laid out in long runs, rather than a sector at a
+//	time as its writes reach each hole.  The holes are filled, and the
+//	file grown, with runs from FindAndSetRunNear, each starting right
+//	after the sector before it if that is free; on a disk with room,
+//	the file ends up as one run (one extent, for ExtentLayout).
+//
+//	Nothing is written to the new sectors past the high-water mark:
+//	they read as zeros anyway (see SetHighWater); only a hole before
+//	it is cleared, as its sector will be read.  If "keepSize", the
+//	length stays as it is, and the sectors past the end are spare,
+//	like those Extend allocates ahead -- given back by Trim if they
+//	are still past the end when the file is last closed.  Changed
+//	index blocks are written, but the header itself is only changed
+//	in memory.
+//
+//	Return FALSE if the disk is full, an ExtentLayout file has no
+//	extents left, or the file is compressed (its chunks get their
+//	sectors as they are stored); the sectors given so far are kept.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"size" is how many bytes of the file should have sectors
+//	"goal" is where the data should start, for an empty file
+//	"keepSize" is whether the length stays as it is
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Preallocate(PersistentBitmap *freeMap, int size, int goal,
+                        bool keepSize)
+{
+    int oldSize = numBytes;
+
+    if (compressed)
+        return FALSE;
+    if (!FillHoles(freeMap, min(divRoundUp(size, SectorSize), numSectors),
+                   goal))
+        return FALSE;
+    if (size > numBytes) {
+        if (keepSize && IsInline() && size <= MaxInlineSize)
+            return TRUE;		// the header has room for it all
+        if (!Extend(freeMap, size, goal))
+            return FALSE;
+        if (keepSize)
+            numBytes = oldSize;		// the rest is spare
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillHoles
+// 	Allocate data sectors for the holes among the first "count" data
+//	sectors of the file, a run per hole as far as the free space
+//	allows (see Preallocate), zeroing those before the high-water
+//	mark.  A hole is filled to the end of its block.  Return FALSE if
+//	the disk is full, an ExtentLayout file has no extents left, or no
+//	run is as long as a block.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"goal" is where the first hole's sectors should go, if the file
+//	has no data sector before it
+//----------------------------------------------------------------------
+
+bool
+FileHeader::FillHoles(PersistentBitmap *freeMap, int count, int goal)
+{
+    char zeros[SectorSize] = {0};
+    int i = 0, length, start;
+
+    goal = min(max(goal, 0), LastSector());
+    if (layout == ExtentLayout) {
+        for (int e = 0; e < numExtents && i < count; ) {
+            if (extents[e].start >= 0) {
+                i += extents[e].length;
+                goal = min(extents[e].start + extents[e].length,
+                           LastSector());
+                e++;
+                continue;
+            }
+            start = freeMap->FindAndSetRunNear(goal,
+                    min(extents[e].length, count - i), &length);
+            if (start < 0)
+                return FALSE;		// the disk is full
+            for (int j = 0; j < length && i + j < numWritten; j++)
+                kernel->bufferCache->WriteSector(start + j, zeros);
+            if (e > 0 && extents[e - 1].start >= 0 &&
+                    extents[e - 1].start + extents[e - 1].length == start) {
+                extents[e - 1].length += length;	// continue it
+            } else if (numExtents < MaxExtentNum) {
+                InsertExtents(e, 1);
+                extents[e].start = start;
+                extents[e++].length = length;
+            } else {
+                for (int j = 0; j < length; j++)
+                    freeMap->Clear(start + j);
+                return FALSE;		// no extent left for the run
+            }
+            if ((extents[e].length -= length) == 0)
+                RemoveExtent(e);	// the hole is filled
+            i += length;
+            goal = min(start + length, LastSector());
+        }
+        return TRUE;
+    }
+
+    while (i < count) {
+        int sector = ByteToSector(i * SectorSize);
+        int end;
+
+        if (sector >= 0) {
+            goal = min(sector + 1, LastSector());
+            i++;
+            continue;
+        }
+        for (end = i + 1; end < count && ByteToSector(end * SectorSize) < 0;
+                end++)
+            ;
+        end = min(NumBlocks(end) * BlockSectors(), numSectors);
+        if (freeMap->NumFree() < end - i + NumIndirectLevels)
+            return FALSE;		// the data, and index blocks
+        for (; i < end; ) {
+            start = TakeRun(freeMap, goal, end - i, &length);
+            if (start < 0) {		// no run as long as a block
+                for (int level = 1; level <= NumIndirectLevels; level++)
+                    if (indirect[level - 1] != NULL)
+                        WriteIndex(indirect[level - 1]);
+                return FALSE;
+            }
+            for (int j = 0; j < length; j++, i++) {
+                if (i < numWritten)
+                    kernel->bufferCache->WriteSector(start + j, zeros);
+                MapSector(freeMap, i, start + j);
+            }
+            goal = min(start + length, LastSector());
+        }
+    }
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (indirect[level - 1] != NULL)
+            WriteIndex(indirect[level - 1]);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DelayWrite
+// 	In the delayed allocation mode, keep "numBytes" bytes written at
+//	"position" -- at or past the end of the last data sector, and not
+//	past the end of the file -- in memory, and only reserve in the
+//	bitmap the sectors they will need (see DelayedNeed).  An inline
+//	file's data is the first of them.  Return FALSE, keeping nothing,
+//	if there would be more than MaxDelayed of them, or there is no
+//	room on the disk; then the caller allocates them now.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::DelayWrite(PersistentBitmap *freeMap, char *from, int numBytes,
+                       int position)
+{
+    int first = numSectors * SectorSize;
+    int count = divRoundUp(position + numBytes, SectorSize) - numSectors;
+
+    ASSERT(!compressed && position >= first && position <= FileLength());
+    if (count > MaxDelayed)
+        return FALSE;
+    if (count > numDelayed) {
+        int more = DelayedNeed(count) - numReserved;
+
+        if (!freeMap->Reserve(more))
+            return FALSE;
+        numReserved += more;
+        if (delayed == NULL) {
+            delayed = new char[MaxDelayed * SectorSize];
+            memset(delayed, 0, MaxDelayed * SectorSize);
+            if (IsInline())
+                memcpy(delayed, inlineData, this->numBytes);
+            delayedBytes = this->numBytes;
+        }
+        kernel->bufferCache->NoteDelayed(count - numDelayed);
+        numDelayed = count;
+    }
+    memcpy(delayed + position - first, from, numBytes);
+    delayedBytes = max(delayedBytes, position + numBytes);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DelayedNeed
+// 	Return how many sectors "count" more data sectors past the last
+//	one need: for IndexLayout, with the index blocks on top of them,
+//	plus one a level as AddSectors counts.
+//----------------------------------------------------------------------
+
+int
+FileHeader::DelayedNeed(int count)
+{
+    if (layout == ExtentLayout)
+        return count;
+    return count + NumIndirectLevels +
+            TotalIndexSectors(NumBlocks(numSectors + count)) -
+            TotalIndexSectors(NumBlocks(numSectors));
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadDelayed
+// 	Copy "numBytes" bytes at "position" out of the data kept by
+//	DelayWrite.  The request must lie inside it.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ReadDelayed(char *into, int numBytes, int position)
+{
+    ASSERT(delayed != NULL && position >= numSectors * SectorSize &&
+           position + numBytes <= delayedBytes);
+    memcpy(into, delayed + position - numSectors * SectorSize, numBytes);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateDelayed
+// 	Give the data kept by DelayWrite its sectors, near "goal" (just
+//	after the last data sector, if there is one), in one run if the
+//	disk has one, and write it straight to disk; the unwritten
+//	sectors skipped before it are zeroed, as WriteAt does.  The
+//	header must then be written back.  An inline file is given an
+//	empty sector table first, since its data is in the first sector
+//	kept.
+//
+//	The sectors were reserved, but a sector may still be taken by an
+//	allocation that does not check for room first; if the disk fills
+//	up, the file keeps the sectors that fit, and the rest of the data
+//	is lost.  Return FALSE then.
+//
+//	This is called as the last opener closes the file, so it must not
+//	print debugging messages (see FileTable::Release).
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::AllocateDelayed(PersistentBitmap *freeMap, int goal)
+{
+    int first = numSectors, oldBytes = numBytes;
+    bool wasInline = IsInline();
+    char emptybuf[SectorSize] = {0};
+
+    if (delayed == NULL)
+        return TRUE;
+    freeMap->Unreserve(numReserved);
+    numReserved = 0;
+    kernel->bufferCache->NoteDelayed(-numDelayed);
+    if (wasInline) {
+        memset(dataSectors, -1, sizeof(dataSectors));
+        if (layout == ExtentLayout)
+            memset(extents, 0, sizeof(extents));
+        numExtents = 0;
+        numBytes = 0;
+        numWritten = 0;
+    }
+    if (!Extend(freeMap, delayedBytes, goal))
+        while (numBytes < delayedBytes && Extend(freeMap,
+                min(delayedBytes, (numSectors + 1) * SectorSize), goal))
+            ;
+    if (wasInline && IsInline()) {	// not even a sector fit
+        memcpy(inlineData, delayed, MaxInlineSize);
+        numBytes = oldBytes;
+    }
+    for (int i = numWritten; i < first; i++)
+        if (ByteToSector(i * SectorSize) >= 0)
+            kernel->bufferCache->WriteSector(ByteToSector(i * SectorSize),
+                                             emptybuf);
+    for (int i = first, run; i < numSectors; i += run) {
+        int sector = ByteToSector(i * SectorSize);
+
+        for (run = 1; i + run < numSectors; run++)
+            if (ByteToSector((i + run) * SectorSize) != sector + run)
+                break;
+        kernel->bufferCache->WriteSectors(sector, run,
+                                          delayed + (i - first) * SectorSize);
+    }
+    if (numSectors > first)
+        SetHighWater(numSectors);
+
+    bool all = (numSectors - first == numDelayed);
+    delete [] delayed;
+    delayed = NULL;
+    numDelayed = 0;
+    return all;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DropDelayed
+// 	Forget the data kept by DelayWrite, giving back the sectors
+//	reserved for it: the file is being removed.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::DropDelayed(PersistentBitmap *freeMap)
+{
+    if (delayed == NULL)
+        return;
+    freeMap->Unreserve(numReserved);
+    numReserved = 0;
+    kernel->bufferCache->NoteDelayed(-numDelayed);
+    delete [] delayed;
+    delayed = NULL;
+    numDelayed = 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::RemapExtent
+// 	Give sector "sectorIdx" of an ExtentLayout file -- a hole, or a
+//	shared sector -- a newly allocated sector near "goal", splitting
+//	its extent around it.  The new sector's contents are garbage, and
+//	the old one is left to the caller.  Return FALSE if the disk is
+//	full, or there are no extents left to split the extent with.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"goal" is where the sector should go
+//----------------------------------------------------------------------
+
+bool
+FileHeader::RemapExtent(PersistentBitmap *freeMap, int sectorIdx, int goal)
+{
+    int sector;
+
+    // find the extent, and the offset of the sector in it
+    int i, offset = sectorIdx;
+    for (i = 0; offset >= extents[i].length; i++)
+        offset -= extents[i].length;
+    Extent old = extents[i];
+
+    // at the start of the extent, just continue the one before it
+    if (offset == 0 && i > 0 && extents[i - 1].start >= 0 &&
+            extents[i - 1].start + extents[i - 1].length == goal &&
+            !freeMap->Test(goal)) {
+        freeMap->Mark(goal);
+        extents[i - 1].length++;
+        if (old.start >= 0)
+            extents[i].start++;
+        if (--extents[i].length == 0)
+            RemoveExtent(i);
+        return TRUE;
+    }
+
+    // otherwise split the extent around a new one of one sector
+    int pieces = (offset > 0) + (offset < old.length - 1);
+    if (numExtents + pieces > MaxExtentNum ||
+            (sector = freeMap->FindAndSetNear(goal)) < 0)
+        return FALSE;
+    InsertExtents(i + 1, pieces);
+    if (offset > 0)
+        extents[i++].length = offset;
+    extents[i].start = sector;
+    extents[i++].length = 1;
+    if (offset < old.length - 1) {
+        extents[i].start = (old.start < 0) ? -1 : old.start + offset + 1;
+        extents[i].length = old.length - offset - 1;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Unshare
+// 	Move data sector "sectorIdx", which the file shares with another,
+//	to a sector of its own, before it is written: it goes right after
+//	the sector before it if that is free, or else near "goal".  If
+//	"keep", the old contents are copied, for a write that only covers
+//	part of the sector.  The old sector loses a holder.  Changed index
+//	blocks are written, but the header itself is only changed in
+//	memory.  Return FALSE, leaving the sector shared, if the disk is
+//	full, or an ExtentLayout file has no extents left to split with.
+//
+//	With blocks of several sectors, the whole block of "sectorIdx"
+//	moves, and its other sectors written so far are always copied.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"goal" is where the sector should go, if the one before is a hole
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Unshare(PersistentBitmap *freeMap, int sectorIdx, int goal,
+                    bool keep)
+{
+    int first = sectorIdx & ~(BlockSectors() - 1), length = 1;
+    int old = ByteToSector(first * SectorSize), sector;
+
+    ASSERT(old >= 0 &&
+           freeMap->IsShared(ByteToSector(sectorIdx * SectorSize)));
+    if (first > 0 && ByteToSector((first - 1) * SectorSize) >= 0)
+        goal = ByteToSector((first - 1) * SectorSize) + 1;
+    goal = min(max(goal, 0), LastSector());
+    if (layout == IndexLayout) {
+        length = BlockLength(sectorIdx >> blockShift);
+        if ((sector = TakeBlock(freeMap, goal, length)) < 0)
+            return FALSE;
+        MapSector(freeMap, first, sector);	// the index blocks exist
+        for (int level = 1; level <= NumIndirectLevels; level++)
+            if (indirect[level - 1] != NULL)
+                WriteIndex(indirect[level - 1]);
+    } else {
+        if (!RemapExtent(freeMap, sectorIdx, goal))
+            return FALSE;
+        sector = ByteToSector(sectorIdx * SectorSize);
+    }
+    DEBUG(dbgFile, "Unsharing sector " << old << ", copied to " << sector);
+    for (int j = 0; j < length; j++) {
+        if ((first + j != sectorIdx || keep) && first + j < numWritten)
+            kernel->bufferCache->CopySector(old + j, sector + j);
+        freeMap->Clear(old + j);		// one holder fewer
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::InsertExtents/RemoveExtent
+// 	Shift the extents from "which" on up by "count" places, to make
+//	room for new ones; or remove extent "which", shifting the ones
+//	after it down.
+//----------------------------------------------------------------------
+
+void
+FileHeader::InsertExtents(int which, int count)
+{
+    ASSERT(numExtents + count <= MaxExtentNum);
+    memmove(&extents[which + count], &extents[which],
+            (numExtents - which) * sizeof(Extent));
+    numExtents += count;
+}
+
+void
+FileHeader::RemoveExtent(int which)
+{
+    memmove(&extents[which], &extents[which + 1],
+            (numExtents - which - 1) * sizeof(Extent));
+    numExtents--;
+    extents[numExtents].start = extents[numExtents].length = 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Trim
+// 	Give back the data sectors past the end of the file that Extend
+//	allocated ahead of need, and any index blocks they leave empty.
+//	The header itself is only changed in memory.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::Trim(PersistentBitmap *freeMap)
+{
+    TrimTo(freeMap, divRoundUp(numBytes, SectorSize));
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TrimTo
+// 	Give back the data sectors past the first "keep", and any index
+//	blocks they leave empty, for Trim; or for AddSectors, to undo
+//	what it had allocated.  With blocks of several sectors, the last
+//	block kept is cut down to the sectors it still needs.  The header
+//	itself is only changed in memory.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::TrimTo(PersistentBitmap *freeMap, int keep)
+{
+    if (numSectors <= keep)
+        return;
+    if (layout == ExtentLayout) {
+        for (; numSectors > keep; numSectors--) {
+            Extent *last = &extents[numExtents - 1];
+            if (last->start >= 0)
+                freeMap->Clear(last->start + last->length - 1);
+            if (--last->length == 0) {
+                last->start = 0;
+                numExtents--;
+            }
+        }
+        numWritten = min(numWritten, numSectors);
+        return;
+    }
+    // the sectors of the last block kept that are past "keep" go first,
+    // then the blocks past it
+    int whole = NumBlocks(keep) * BlockSectors();
+    for (int i = keep; i < whole && i < numSectors; i++)
+        if (ByteToSector(i * SectorSize) >= 0)
+            freeMap->Clear(ByteToSector(i * SectorSize));
+    for (int i = whole >> blockShift;
+            i < NumDirect && (i << blockShift) < numSectors; i++) {
+        if (dataSectors[i] >= 0)
+            for (int j = 0; j < BlockLength(i); j++)
+                freeMap->Clear(dataSectors[i] + j);
+        dataSectors[i] = -1;
+    }
+
+    // each indirect tree is either kept, trimmed, or freed as a whole
+    int first = NumDirect << blockShift;	// first sector of the tree
+    for (int level = 1; level <= NumIndirectLevels; level++) {
+        int span = Span(level + 1) << blockShift;
+        int count = min(numSectors - first, span);
+        if (dataSectors[NumDirect + level - 1] >= 0 && first + span > whole) {
+            if (whole > first) {
+                TrimIndex(freeMap, GetIndex(level), level, whole - first,
+                          count);
+            } else {
+                DeallocateIndex(freeMap, GetIndex(level), level, count);
+                delete indirect[level - 1];
+                indirect[level - 1] = NULL;
+                dataSectors[NumDirect + level - 1] = -1;
+            }
+        }
+        first += span;
+    }
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (indirect[level - 1] != NULL)
+            WriteIndex(indirect[level - 1]);
+    numSectors = keep;
+    numWritten = min(numWritten, numSectors);
+}
+//----------------------------------------------------------------------
+// FileHeader::Uninline
+// 	Grow an inline file to "newSize" bytes, too big for the header:
+//	give it an empty sector table, allocate its data sectors the
+//	normal way, and copy the old contents into the first of them.
+//	Return FALSE, leaving the file inline, if the disk is full.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Uninline(PersistentBitmap *freeMap, int newSize, int goal,
+                     int spare)
+{
+    char data[MaxInlineSize];
+    int oldSize = numBytes;
+    char buf[SectorSize] = {0};
+
+    memcpy(data, inlineData, MaxInlineSize);
+    memset(dataSectors, -1, sizeof(dataSectors));
+    if (layout == ExtentLayout)
+        memset(extents, 0, sizeof(extents));
+    numExtents = 0;
+    numBytes = 0;
+    if (!Extend(freeMap, newSize, goal, spare)) {
+        memcpy(inlineData, data, MaxInlineSize);
+        numBytes = oldSize;
+        return FALSE;
+    }
+    DEBUG(dbgFile, "Moving " << oldSize << " bytes of inline data to sector "
+            << ByteToSector(0));
+    memcpy(buf, data, oldSize);
+    kernel->bufferCache->WriteSector(ByteToSector(0), buf);
+    numWritten = 1;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadInline/WriteInline
+// 	Copy "numBytes" bytes at "position" out of/into the data of an
+//	inline file.  The request must lie inside the file.  The caller
+//	writes the header back after WriteInline.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ReadInline(char *into, int numBytes, int position)
+{
+    ASSERT(IsInline() && position >= 0 && position + numBytes <= this->numBytes);
+    memcpy(into, inlineData + position, numBytes);
+}
+
+void
+FileHeader::WriteInline(char *from, int numBytes, int position)
+{
+    ASSERT(IsInline() && position >= 0 && position + numBytes <= this->numBytes);
+    memcpy(inlineData + position, from, numBytes);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SetCompressed
+// 	Make this file, which is empty, a compressed one.  Return FALSE for
+//	an ExtentLayout file: every chunk would split an extent in two; and
+//	for blocks of several sectors, which a chunk's holes would split.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::SetCompressed()
+{
+    ASSERT(numBytes == 0 && numSectors == 0);
+    if (layout != IndexLayout || blockShift > 0)
+        return FALSE;
+    compressed = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::PunchHole
+// 	Give back data sector "sectorIdx" of an IndexLayout file, if it has
+//	one, turning it into a hole -- when a chunk of a compressed file is
+//	stored in fewer sectors than before.  A shared sector only loses a
+//	holder.  Changed index blocks are written, but the header itself is
+//	only changed in memory.
+//----------------------------------------------------------------------
+
+void
+FileHeader::PunchHole(PersistentBitmap *freeMap, int sectorIdx)
+{
+    int sector = ByteToSector(sectorIdx * SectorSize);
+
+    ASSERT(layout == IndexLayout && blockShift == 0 && sectorIdx < numSectors);
+    if (sector < 0)
+        return;				// a hole already
+    MapSector(freeMap, sectorIdx, -1);	// the index blocks exist
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (indirect[level - 1] != NULL)
+            WriteIndex(indirect[level - 1]);
+    freeMap->Clear(sector);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ShareSector
+// 	Make data sector "sectorIdx" of an IndexLayout file the disk sector
+//	"sector", which holds exactly what it is about to be written with
+//	(see OpenFile::ShareCopy), sharing it.  The sector it had loses a
+//	holder.  Changed index blocks are written, but the header itself
+//	is only changed in memory.
+//----------------------------------------------------------------------
 
-#include "filehdr.h"
-#include "debug.h"
-#include "synchdisk.h"
-#include "main.h"
+void
+FileHeader::ShareSector(PersistentBitmap *freeMap, int sectorIdx, int sector)
+{
+    int old = ByteToSector(sectorIdx * SectorSize);
+
+    ASSERT(layout == IndexLayout && blockShift == 0 && old >= 0 &&
+           old != sector);
+    freeMap->Share(sector);
+    MapSector(freeMap, sectorIdx, sector);	// the index blocks exist
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (indirect[level - 1] != NULL)
+            WriteIndex(indirect[level - 1]);
+    DEBUG(dbgFile, "Sharing sector " << sector << " instead of " << old);
+    freeMap->Clear(old);
+}
 
 //----------------------------------------------------------------------
-// MP4 mod tag
-// FileHeader::FileHeader
-//	There is no need to initialize a fileheader,
-//	since all the information should be initialized by Allocate or FetchFrom.
-//	The purpose of this function is to keep valgrind happy.
+// FileHeader::SetHighWater
+// 	Raise the high-water mark to "sectors": the file's first "sectors"
+//	data sectors have now been written.  The caller writes the header
+//	back.
 //----------------------------------------------------------------------
-FileHeader::FileHeader()
+
+void
+FileHeader::SetHighWater(int sectors)
 {
-	numBytes = -1;
-	numSectors = -1;
-    numLists = -1;
-	memset(dataSectorLists, -1, sizeof(dataSectorLists));
+    ASSERT(sectors <= numSectors);
+    numWritten = max(numWritten, sectors);
 }
 
 //----------------------------------------------------------------------
-// MP4 mod tag
-// FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+// FileHeader::MapSector
+// 	Make entry "sectorIdx" of an IndexLayout file point at data sector
+//	"dataSector", allocating any index blocks on the way that do not
+//	exist yet.  Changed blocks are marked dirty for WriteIndex.  The
+//	caller has already checked that there is enough free space.
+//
+//	With blocks of several sectors, the entry is that of the block,
+//	and is set by its first sector; the others must follow it on disk.
+//
+//	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
-FileHeader::~FileHeader()
+
+void
+FileHeader::MapSector(PersistentBitmap *freeMap, int sectorIdx, int dataSector)
+{
+    if ((sectorIdx & (BlockSectors() - 1)) != 0) {
+        ASSERT(ByteToSector(sectorIdx * SectorSize) == dataSector);
+        return;
+    }
+    sectorIdx >>= blockShift;
+    if (sectorIdx < NumDirect) {
+        dataSectors[sectorIdx] = dataSector;
+        return;
+    }
+
+    // find which indirect tree holds it, then walk down to the data
+    int level;
+    sectorIdx -= NumDirect;
+    for (level = 1; sectorIdx >= Span(level + 1); level++)
+        sectorIdx -= Span(level + 1);
+    ASSERT(level <= NumIndirectLevels);
+    IndexBlock *block;
+    if (dataSectors[NumDirect + level - 1] < 0) {
+        block = new IndexBlock(freeMap->FindAndSetNear(dataSector));
+        ASSERT(block->sector >= 0);
+        block->dirty = TRUE;
+        indirect[level - 1] = block;
+        dataSectors[NumDirect + level - 1] = block->sector;
+    } else {
+        block = GetIndex(level);
+    }
+    for (; level > 1; level--) {
+        int which = sectorIdx / Span(level);
+        if (block->entry[which] < 0) {
+            IndexBlock *child =
+                    new IndexBlock(freeMap->FindAndSetNear(dataSector));
+            ASSERT(child->sector >= 0);
+            child->dirty = TRUE;
+            block->entry[which] = child->sector;
+            block->child[which] = child;
+            block->dirty = TRUE;
+        }
+        block = GetChild(block, which);
+        sectorIdx %= Span(level);
+    }
+    block->entry[sectorIdx] = dataSector;
+    block->dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TrimIndex
+// 	Free the data sectors, and index blocks, that "block" (an index
+//	block "level" levels above the data) maps past its first "keep"
+//	of "count" data sectors.  "keep" is more than 0, and a whole
+//	number of blocks, so "block" itself stays, but is marked dirty for
+//	WriteIndex.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::TrimIndex(PersistentBitmap *freeMap, IndexBlock *block,
+                      int level, int keep, int count)
+{
+    int span = Span(level) << blockShift;
+
+    for (int i = 0; i < PointersPerIndex && i * span < count; i++) {
+        int below = min(count - i * span, span);
+        if (block->entry[i] < 0 || (i + 1) * span <= keep)
+            continue;				// a hole, or kept
+        if (level == 1) {
+            for (int j = 0; j < below; j++)
+                freeMap->Clear(block->entry[i] + j);
+        } else if (i * span < keep) {
+            TrimIndex(freeMap, GetChild(block, i), level - 1, keep - i * span,
+                      below);
+            continue;				// partly kept
+        } else {
+            DeallocateIndex(freeMap, GetChild(block, i), level - 1, below);
+            delete block->child[i];
+            block->child[i] = NULL;
+        }
+        block->entry[i] = -1;
+        block->dirty = TRUE;
+    }
+}
+//----------------------------------------------------------------------
+// FileHeader::WriteIndex
+// 	Write "block", and every resident block below it, back to disk
+//	if it is dirty.  A large file has more of them than a journal
+//	operation holds, so each reserves its slot, and the operation may
+//	be committed in pieces: the blocks are written before the header,
+//	and those a crash leaves half-written only point at sectors that
+//	are still in use.
+//----------------------------------------------------------------------
+
+void
+FileHeader::WriteIndex(IndexBlock *block)
 {
-	// nothing to do now
+    for (int i = 0; i < PointersPerIndex; i++)
+        if (block->child[i] != NULL)
+            WriteIndex(block->child[i]);
+    if (block->dirty) {
+        kernel->journal->Reserve(1);
+        kernel->bufferCache->WriteSector(block->sector, (char *) block->entry);
+        block->dirty = FALSE;
+    }
 }
 
 //----------------------------------------------------------------------
-// FileHeader::Allocate
-// 	Initialize a fresh file header for a newly created file.
-//	Allocate data blocks for the file out of the map of free disk blocks.
-//	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+// FileHeader::ExtendExtents
+// 	Grow an ExtentLayout file to "newSectors" data sectors.  The last
+//	extent is continued in place while the sectors after it are free;
+//	the rest is taken as the free run closest to "goal" that holds all
+//	that is left, or else the longest run there is.  Return FALSE, giving back
+//	anything allocated, if the free space is too fragmented to fit in
+//	MaxExtentNum extents.
 //
 //	"freeMap" is the bit map of free disk sectors
-//	"fileSize" is the bit map of free disk sectors
+//	"goal" is where new extents should preferably start
 //----------------------------------------------------------------------
 
 bool
-FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
-{ 
-    char emptybuf[128] = {0};
-    numBytes = fileSize;
-    numSectors = divRoundUp(fileSize, SectorSize);
-    numLists = divRoundUp(numSectors, SectorNumPerList);
-    // if not enough space
-    if (freeMap->NumClear() < numSectors)
+FileHeader::ExtendExtents(PersistentBitmap *freeMap, int newSectors, int goal)
+{
+    int remaining = newSectors - numSectors;
+    int oldExtents = numExtents;
+    int oldLength = (numExtents > 0) ? extents[numExtents - 1].length : 0;
+
+    if (freeMap->NumFree() < remaining)
         return FALSE;
-    int nowNumSectors = 0;
-    for (int i = 0; i < numLists; i++, nowNumSectors += SectorNumPerList) {
-        // find free sector for sector list
-        dataSectorLists[i] = freeMap->FindAndSet();
-        ASSERT(dataSectorLists[i] >= 0);
-        // find lastSectorNum for this loop
-        int lastSectorNum;
-        if (nowNumSectors + SectorNumPerList > numSectors) lastSectorNum = numSectors;
-        else lastSectorNum = nowNumSectors + SectorNumPerList;
-        // buffer to write to disk
-        int *buf = new int[SectorNumPerList];
-        memset(buf, 0, sizeof(int) * SectorNumPerList);
-        for (int j = 0; j < lastSectorNum - nowNumSectors; j++) {
-            // for each entry in the list, find a free space
-            buf[j] = freeMap->FindAndSet();
-            kernel->synchDisk->WriteSector(buf[j], emptybuf);
-            ASSERT(buf[j] >= 0);
-        }
-        // write to disk
-        kernel->synchDisk->WriteSector(dataSectorLists[i], (char *) buf);
-        delete [] buf;
+    if (numExtents > 0 && extents[numExtents - 1].start >= 0) {
+        Extent *last = &extents[numExtents - 1];
+        for (int next = last->start + last->length;
+                remaining > 0 && next <= LastSector() && !freeMap->Test(next);
+                next++) {
+            freeMap->Mark(next);
+            last->length++;
+            remaining--;
+        }
+    }
+    while (remaining > 0) {
+        int start, length;
+        if (numExtents == MaxExtentNum ||
+                (start = freeMap->FindAndSetRunNear(goal, remaining,
+                                                    &length)) < 0) {
+            // give back what was taken, newest extent first
+            for (; numExtents > oldExtents; numExtents--) {
+                Extent *e = &extents[numExtents - 1];
+                for (int j = 0; j < e->length; j++)
+                    freeMap->Clear(e->start + j);
+                e->start = e->length = 0;
+            }
+            if (oldExtents > 0) {
+                Extent *e = &extents[oldExtents - 1];
+                for (int j = oldLength; j < e->length; j++)
+                    freeMap->Clear(e->start + j);
+                e->length = oldLength;
+            }
+            return FALSE;
+        }
+        extents[numExtents].start = start;
+        extents[numExtents].length = length;
+        numExtents++;
+        remaining -= length;
+        goal = min(start + length, LastSector());
     }
+    numSectors = newSectors;
     return TRUE;
 }
 
@@ -112,23 +1475,263 @@ FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 void 
 FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
-    int nowNumSectors = 0;
-    for (int i = 0; i < numLists; i++, nowNumSectors += SectorNumPerList) {
-        // last Sector in this loop
-        int lastSectorNum;
-        if (nowNumSectors + SectorNumPerList > numSectors) lastSectorNum = numSectors;
-        else lastSectorNum = nowNumSectors + SectorNumPerList;
-        // buf to write in
-        int *buf = new int[SectorNumPerList];
-        kernel->synchDisk->ReadSector(dataSectorLists[i], (char *) buf);
-        for (int j = 0; j < lastSectorNum - nowNumSectors; j++) {
-            // check if buf[j] is marked and clear it
-            ASSERT(freeMap->Test((int) buf[j]));
-            freeMap->Clear((int) buf[j]);
+    DropDelayed(freeMap);
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++)
+            for (int j = 0; j < extents[i].length && extents[i].start >= 0;
+                    j++) {
+                ASSERT(freeMap->Test(extents[i].start + j));
+                freeMap->Clear(extents[i].start + j);
+            }
+        numExtents = 0;
+        return;
+    }
+    for (int i = 0; i < NumDirect && (i << blockShift) < numSectors; i++) {
+        if (dataSectors[i] < 0)
+            continue;				// a hole
+        for (int j = 0; j < BlockLength(i); j++) {
+            ASSERT(freeMap->Test(dataSectors[i] + j));
+            freeMap->Clear(dataSectors[i] + j);
+        }
+    }
+    int remaining = numSectors - (NumDirect << blockShift);
+    for (int level = 1; level <= NumIndirectLevels && remaining > 0; level++) {
+        int count = min(remaining, Span(level + 1) << blockShift);
+        if (dataSectors[NumDirect + level - 1] >= 0)
+            DeallocateIndex(freeMap, GetIndex(level), level, count);
+        remaining -= count;
+    }
+    FreeIndex();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DeallocateIndex
+// 	Free an index block "level" levels above the data, and the
+//	"count" data sectors (and index blocks) below it, skipping holes.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::DeallocateIndex(PersistentBitmap *freeMap, IndexBlock *block,
+                            int level, int count)
+{
+    int span = Span(level) << blockShift;
+
+    for (int i = 0; count > 0; i++, count -= span) {
+        if (block->entry[i] < 0) {
+            continue;				// a hole
+        } else if (level == 1) {
+            for (int j = 0; j < min(count, span); j++) {
+                ASSERT(freeMap->Test(block->entry[i] + j));
+                freeMap->Clear(block->entry[i] + j);
+            }
+        } else {
+            DeallocateIndex(freeMap, GetChild(block, i), level - 1,
+                            min(count, span));
         }
-        freeMap->Clear(dataSectorLists[i]);
-        delete [] buf;
     }
+    ASSERT(freeMap->Test(block->sector));
+    freeMap->Clear(block->sector);
+}
+
+//----------------------------------------------------------------------
+// Doom
+//	Note that "sector" is to be freed: set its bit in "map", to be
+//	cleared in the bitmap later -- or, if another file shares it,
+//	just drop its count now.  A sector that two of the files being
+//	freed share is then dropped by the first and freed by the second.
+//----------------------------------------------------------------------
+
+static void
+Doom(Bitmap *map, PersistentBitmap *freeMap, int sector)
+{
+    if (freeMap->IsShared(sector))
+        freeMap->Clear(sector);
+    else
+        map->Mark(sector);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::MarkSectors
+// 	Set the bit of every data sector and index block of the file in
+//	"map", skipping holes, so a caller removing many files can give
+//	all their sectors back to the free map in one pass.  Otherwise
+//	like Deallocate: the header itself is not touched.  Shared
+//	sectors lose a holder in "freeMap" instead (see Doom).
+//----------------------------------------------------------------------
+
+void
+FileHeader::MarkSectors(Bitmap *map, PersistentBitmap *freeMap)
+{
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++)
+            for (int j = 0; j < extents[i].length && extents[i].start >= 0;
+                    j++)
+                Doom(map, freeMap, extents[i].start + j);
+        return;
+    }
+    for (int i = 0; i < NumDirect && (i << blockShift) < numSectors; i++)
+        if (dataSectors[i] >= 0)
+            for (int j = 0; j < BlockLength(i); j++)
+                Doom(map, freeMap, dataSectors[i] + j);
+    int remaining = numSectors - (NumDirect << blockShift);
+    for (int level = 1; level <= NumIndirectLevels && remaining > 0; level++) {
+        int count = min(remaining, Span(level + 1) << blockShift);
+        if (dataSectors[NumDirect + level - 1] >= 0)
+            MarkIndex(map, freeMap, GetIndex(level), level, count);
+        remaining -= count;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::MarkIndex
+// 	Set the bits of an index block "level" levels above the data, and
+//	of the "count" data sectors (and index blocks) below it, in "map".
+//----------------------------------------------------------------------
+
+void
+FileHeader::MarkIndex(Bitmap *map, PersistentBitmap *freeMap,
+                      IndexBlock *block, int level, int count)
+{
+    int span = Span(level) << blockShift;
+
+    for (int i = 0; count > 0; i++, count -= span) {
+        if (block->entry[i] < 0)
+            continue;				// a hole
+        else if (level == 1)
+            for (int j = 0; j < min(count, span); j++)
+                Doom(map, freeMap, block->entry[i] + j);
+        else
+            MarkIndex(map, freeMap, GetChild(block, i), level - 1,
+                      min(count, span));
+    }
+    Doom(map, freeMap, block->sector);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Share
+// 	Make "copy" a header for the same data as this one, for a
+//	snapshot: it gets the same length and high-water mark, and points
+//	at the same data sectors, each of which gets one more holder in
+//	"freeMap".  An IndexLayout copy gets index blocks of its own,
+//	written here, so that the two files' holes can be filled apart;
+//	an inline file's data is simply copied.  "copy" is only changed in
+//	memory.  Return FALSE, leaving both as they were, if a sector
+//	already has MaxShares extra holders, or there is no room for the
+//	index blocks.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::Share(PersistentBitmap *freeMap, FileHeader *copy)
+{
+    for (int i = 0; i < numSectors; i++) {
+        int sector = ByteToSector(i * SectorSize);
+        if (sector >= 0 && freeMap->Shares(sector) == MaxShares)
+            return FALSE;			// shared too often already
+    }
+    if (layout == IndexLayout &&
+            freeMap->NumFree() < TotalIndexSectors(NumBlocks(numSectors)))
+        return FALSE;				// no room for the index blocks
+
+    copy->FreeIndex();
+    copy->numBytes = numBytes;
+    copy->numSectors = numSectors;
+    copy->numWritten = numWritten;
+    copy->layout = layout;
+    copy->compressed = compressed;
+    copy->blockShift = blockShift;
+    copy->numExtents = numExtents;
+    memcpy(copy->dataSectors, dataSectors, sizeof(dataSectors));
+    if (layout == IndexLayout && !IsInline())
+        for (int level = 1; level <= NumIndirectLevels; level++)
+            copy->dataSectors[NumDirect + level - 1] = -1;
+    for (int i = 0; i < numSectors; i++) {
+        int sector = ByteToSector(i * SectorSize);
+        if (sector < 0)
+            continue;				// a hole
+        freeMap->Share(sector);
+        if (layout == IndexLayout && i >= (NumDirect << blockShift))
+            copy->MapSector(freeMap, i, sector);
+    }
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (copy->indirect[level - 1] != NULL)
+            copy->WriteIndex(copy->indirect[level - 1]);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::IsShared
+// 	Return TRUE if any data sector of the file is shared with
+//	another file.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool
+FileHeader::IsShared(PersistentBitmap *freeMap)
+{
+    for (int i = 0; i < numSectors; i++) {
+        int sector = ByteToSector(i * SectorSize);
+        if (sector >= 0 && freeMap->IsShared(sector))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Flush
+// 	Write every data sector and index block of the file that is dirty
+//	in the buffer cache back to disk.  The header sector itself is
+//	left to the caller, who knows where it lives.
+//----------------------------------------------------------------------
+
+void
+FileHeader::Flush()
+{
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++)
+            for (int j = 0; j < extents[i].length && extents[i].start >= 0;
+                    j++)
+                kernel->bufferCache->FlushSector(extents[i].start + j);
+        return;
+    }
+    for (int i = 0; i < NumDirect && (i << blockShift) < numSectors; i++)
+        if (dataSectors[i] >= 0)
+            for (int j = 0; j < BlockLength(i); j++)
+                kernel->bufferCache->FlushSector(dataSectors[i] + j);
+    int remaining = numSectors - (NumDirect << blockShift);
+    for (int level = 1; level <= NumIndirectLevels && remaining > 0; level++) {
+        int count = min(remaining, Span(level + 1) << blockShift);
+        if (dataSectors[NumDirect + level - 1] >= 0)
+            FlushIndex(GetIndex(level), level, count);
+        remaining -= count;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FlushIndex
+// 	Flush an index block "level" levels above the data, and the
+//	"count" data sectors (and index blocks) below it.
+//----------------------------------------------------------------------
+
+void
+FileHeader::FlushIndex(IndexBlock *block, int level, int count)
+{
+    int span = Span(level) << blockShift;
+
+    for (int i = 0; count > 0; i++, count -= span) {
+        if (block->entry[i] < 0)
+            continue;				// a hole
+        else if (level == 1)
+            for (int j = 0; j < min(count, span); j++)
+                kernel->bufferCache->FlushSector(block->entry[i] + j);
+        else
+            FlushIndex(GetChild(block, i), level - 1, min(count, span));
+    }
+    kernel->bufferCache->FlushSector(block->sector);
 }
 
 //----------------------------------------------------------------------
@@ -141,13 +1744,43 @@ FileHeader::Deallocate(PersistentBitmap *freeMap)
 void
 FileHeader::FetchFrom(int sector)
 {
-    kernel->synchDisk->ReadSector(sector, (char *)this);
-	
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you will need to rebuild the header's structure
-	*/
-	
+    char buf[SectorSize];
+    kernel->bufferCache->ReadSector(sector, buf);
+    Unpack(buf);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Unpack
+// 	Initialize the file header from "buf", a copy of the sector it
+//	is stored in.  Only the disk part comes from the sector; the
+//	index blocks are read lazily by GetIndex.
+//----------------------------------------------------------------------
+
+void
+FileHeader::Unpack(char *buf)
+{
+    int offset = 0;
+    memcpy(&numBytes, buf + offset, sizeof(numBytes));
+    offset += sizeof(numBytes);
+    memcpy(&numSectors, buf + offset, sizeof(numSectors));
+    offset += sizeof(numSectors);
+    memcpy(&numWritten, buf + offset, sizeof(numWritten));
+    offset += sizeof(numWritten);
+    memcpy(&layout, buf + offset, sizeof(layout));
+    offset += sizeof(layout);
+    memcpy(dataSectors, buf + offset, sizeof(dataSectors));
+    FreeIndex();
+    compressed = (layout & CompressedFlag) != 0;
+    blockShift = BlockShiftOf(layout);
+    layout &= ~(CompressedFlag | BlockMask);
+
+    // rebuild the in-core part
+    numExtents = 0;
+    if (layout == ExtentLayout && !IsInline()) {
+        for (; numExtents < MaxExtentNum; numExtents++)
+            if (extents[numExtents].length == 0)
+                break;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -160,17 +1793,25 @@ FileHeader::FetchFrom(int sector)
 void
 FileHeader::WriteBack(int sector)
 {
-    kernel->synchDisk->WriteSector(sector, (char *)this); 
-	
-	/*
-		MP4 Hint:
-		After you add some in-core informations, you may not want to write all fields into disk.
-		Use this instead:
-		char buf[SectorSize];
-		memcpy(buf + offset, &dataToBeWritten, sizeof(dataToBeWritten));
-		...
-	*/
-	
+    char buf[SectorSize];
+    int offset = 0;
+    int flags = layout | (compressed ? CompressedFlag : 0) |
+            BlockFlag(blockShift);
+
+    memcpy(buf + offset, &numBytes, sizeof(numBytes));
+    offset += sizeof(numBytes);
+    memcpy(buf + offset, &numSectors, sizeof(numSectors));
+    offset += sizeof(numSectors);
+    memcpy(buf + offset, &numWritten, sizeof(numWritten));
+    offset += sizeof(numWritten);
+    memcpy(buf + offset, &flags, sizeof(flags));
+    offset += sizeof(flags);
+    memcpy(buf + offset, dataSectors, sizeof(dataSectors));
+    offset += sizeof(dataSectors);
+    ASSERT(offset == SectorSize);
+
+    kernel->journal->Reserve(1);
+    kernel->bufferCache->WriteSector(sector, buf);
 }
 
 //----------------------------------------------------------------------
@@ -188,15 +1829,43 @@ FileHeader::ByteToSector(int offset)
 {
     // calculate number of sectors
     int sectorIdx = offset / SectorSize;
-    // calculate where is it stored
-    int listIdx = sectorIdx / SectorNumPerList, idxInList = sectorIdx % SectorNumPerList;
-    // buf to read in
-    int *buf = new int[SectorNumPerList];
-    kernel->synchDisk->ReadSector(dataSectorLists[listIdx], (char *) buf);
-    // get the SectorNum
-    int retVal = buf[idxInList];
-    delete [] buf;
-    return retVal;
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++) {
+            if (sectorIdx < extents[i].length)
+                return (extents[i].start < 0) ? -1
+                                              : extents[i].start + sectorIdx;
+            sectorIdx -= extents[i].length;
+        }
+        ASSERTNOTREACHED();
+    }
+
+    // find the block, and the sector in it
+    int within = sectorIdx & (BlockSectors() - 1), entry;
+    sectorIdx >>= blockShift;
+    if (sectorIdx < NumDirect) {
+        entry = dataSectors[sectorIdx];
+        return (entry < 0) ? -1 : entry + within;
+    }
+
+    // find which indirect tree holds it, then walk down to the data;
+    // a missing index block is a hole
+    int level;
+    sectorIdx -= NumDirect;
+    for (level = 1; sectorIdx >= Span(level + 1); level++)
+        sectorIdx -= Span(level + 1);
+    ASSERT(level <= NumIndirectLevels);
+    if (dataSectors[NumDirect + level - 1] < 0)
+        return -1;
+    IndexBlock *block = GetIndex(level);
+    for (; level > 1; level--) {
+        int which = sectorIdx / Span(level);
+        if (block->entry[which] < 0)
+            return -1;
+        block = GetChild(block, which);
+        sectorIdx %= Span(level);
+    }
+    entry = block->entry[sectorIdx];
+    return (entry < 0) ? -1 : entry + within;
 }
 
 //----------------------------------------------------------------------
@@ -207,47 +1876,347 @@ FileHeader::ByteToSector(int offset)
 int
 FileHeader::FileLength()
 {
-    return numBytes;
+    return (delayed != NULL) ? delayedBytes : numBytes;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocatedSectors
+// 	Return the number of sectors the file's data and index blocks take
+//	up on disk, not counting the header: less than its length calls
+//	for if it has holes, more if it has spare sectors.
+//----------------------------------------------------------------------
+
+int
+FileHeader::AllocatedSectors()
+{
+    int total = 0;
+
+    if (IsInline())
+        return 0;
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++)
+            if (extents[i].start >= 0)
+                total += extents[i].length;
+        return total;
+    }
+    for (int i = 0; i < NumDirect && (i << blockShift) < numSectors; i++)
+        if (dataSectors[i] >= 0)
+            total += BlockLength(i);
+    int remaining = numSectors - (NumDirect << blockShift);
+    for (int level = 1; level <= NumIndirectLevels && remaining > 0; level++) {
+        int count = min(remaining, Span(level + 1) << blockShift);
+        if (dataSectors[NumDirect + level - 1] >= 0)
+            total += CountIndex(GetIndex(level), level, count);
+        remaining -= count;
+    }
+    return total;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::CountIndex
+// 	Return the number of sectors in use by "block", an index block
+//	"level" levels above the data, and the "count" data sectors (and
+//	index blocks) below it.
+//----------------------------------------------------------------------
+
+int
+FileHeader::CountIndex(IndexBlock *block, int level, int count)
+{
+    int span = Span(level) << blockShift;
+    int total = 1;
+
+    for (int i = 0; count > 0; i++, count -= span)
+        if (block->entry[i] >= 0)
+            total += (level == 1) ? min(count, span)
+                                  : CountIndex(GetChild(block, i), level - 1,
+                                               min(count, span));
+    return total;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DataRuns
+// 	Return the number of runs of contiguous sectors the file's data
+//	is stored in -- the number of seeks it takes to read it all --
+//	and store the number of its data sectors in "numData".  A hole
+//	does not end a run.
+//----------------------------------------------------------------------
+
+int
+FileHeader::DataRuns(int *numData)
+{
+    int runs = 0, last = -2;
+
+    *numData = 0;
+    for (int i = 0; i < numSectors; i++) {
+        int sector = ByteToSector(i * SectorSize);
+        if (sector < 0)
+            continue;				// a hole
+        if (sector != last + 1)
+            runs++;
+        last = sector;
+        (*numData)++;
+    }
+    return runs;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Relocate
+// 	Move the file's data sectors, in order, to the run of sectors
+//	starting at "start", and give the old ones back.  Holes stay
+//	holes.  The caller has already marked the run in use, and copied
+//	into it the data below the high-water mark.  For IndexLayout each
+//	block moves whole, and the index blocks stay where they are, and
+//	are rewritten; for
+//	ExtentLayout the extents that end up next to each other are
+//	merged.  The header itself is only changed in memory.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"start" is the first sector of the new run
+//----------------------------------------------------------------------
+
+void
+FileHeader::Relocate(PersistentBitmap *freeMap, int start)
+{
+    int next = start;
+
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++) {
+            if (extents[i].start < 0)
+                continue;			// a hole
+            for (int j = 0; j < extents[i].length; j++)
+                freeMap->Clear(extents[i].start + j);
+            extents[i].start = next;
+            next += extents[i].length;
+        }
+        for (int i = 1; i < numExtents; ) {
+            if (extents[i - 1].start >= 0 && extents[i].start >= 0) {
+                extents[i - 1].length += extents[i].length;
+                RemoveExtent(i);
+            } else {
+                i++;
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < numSectors; i += BlockSectors()) {
+        int sector = ByteToSector(i * SectorSize);
+        int length = min(BlockSectors(), numSectors - i);
+        if (sector < 0)
+            continue;				// a hole
+        for (int j = 0; j < length; j++)
+            freeMap->Clear(sector + j);
+        MapSector(freeMap, i, next);		// the index blocks exist
+        next += length;
+    }
+    for (int level = 1; level <= NumIndirectLevels; level++)
+        if (indirect[level - 1] != NULL)
+            WriteIndex(indirect[level - 1]);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ListSectors
+// 	Find every sector the file takes up, looking its index blocks up
+//	in "image", a copy of the whole disk, instead of reading them.
+//	The data sectors go in "data", in file order, with -1 for each
+//	hole; the index blocks in "index".  Sector numbers are not
+//	checked, but an index block outside the disk is not looked into.
+//	Return the number of data sectors, at most MaxFileSectors, and
+//	store the number of index blocks in "numIndex".
+//
+//	Used by the consistency checker, on headers read with Unpack.
+//----------------------------------------------------------------------
+
+int
+FileHeader::ListSectors(char *image, int *data, int *index, int *numIndex)
+{
+    int numData = 0;
+    int total = min(numSectors, MaxFileSectors);
+
+    *numIndex = 0;
+    if (IsInline())
+        return 0;
+    if (layout == ExtentLayout) {
+        for (int i = 0; i < numExtents; i++)
+            for (int j = 0; j < extents[i].length && numData < total; j++)
+                data[numData++] = (extents[i].start < 0) ? -1 :
+                                  extents[i].start + j;
+        return numData;
+    }
+    for (int i = 0; i < (NumDirect << blockShift) && i < total; i++) {
+        int entry = dataSectors[i >> blockShift];
+        data[numData++] = (entry < 0) ? entry
+                                      : entry + (i & (BlockSectors() - 1));
+    }
+    int remaining = total - (NumDirect << blockShift);
+    for (int level = 1; level <= NumIndirectLevels && remaining > 0; level++) {
+        int count = min(remaining, Span(level + 1) << blockShift);
+        ListIndex(image, dataSectors[NumDirect + level - 1], level, count,
+                  data, &numData, index, numIndex);
+        remaining -= count;
+    }
+    return numData;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ListIndex
+// 	Add to "data" the "count" data sectors below index block "sector",
+//	which is "level" levels above the data, and to "index" the index
+//	blocks, looking them up in "image".  A missing block is a hole.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ListIndex(char *image, int sector, int level, int count,
+                      int *data, int *numData, int *index, int *numIndex)
+{
+    int span = Span(level) << blockShift;
+
+    if (sector < 0 || sector > LastSector()) {
+        if (sector >= 0)
+            index[(*numIndex)++] = sector;	// let the caller complain
+        for (int i = 0; i < count; i++)
+            data[(*numData)++] = -1;
+        return;
+    }
+    index[(*numIndex)++] = sector;
+    int *entry = (int *) &image[sector * SectorSize];
+    for (int i = 0; count > 0 && i < PointersPerIndex; i++, count -= span) {
+        if (level == 1)
+            for (int j = 0; j < min(count, span); j++)
+                data[(*numData)++] = (entry[i] < 0) ? entry[i] : entry[i] + j;
+        else
+            ListIndex(image, entry[i], level - 1, min(count, span),
+                      data, numData, index, numIndex);
+    }
+}
+
+//----------------------------------------------------------------------
+// Escape
+//	Copy the "numBytes" bytes at "from" into "into" as they are
+//	printed by FileHeader::Print -- printable characters as they are,
+//	any other byte as a backslash and its value in hex -- and return
+//	the length of the result.  "into" needs room for 3 * "numBytes"
+//	characters.
+//----------------------------------------------------------------------
+
+static int
+Escape(char *from, int numBytes, char *into)
+{
+    int n = 0;
+
+    for (int k = 0; k < numBytes; k++) {
+        if ('\040' <= from[k] && from[k] <= '\176')
+            into[n++] = from[k];
+        else
+            n += sprintf(&into[n], "\\%x", (unsigned char) from[k]);
+    }
+    return n;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::Print
 // 	Print the contents of the file header, and the contents of all
-//	the data blocks pointed to by the file header.
+//	the data blocks pointed to by the file header.  The data is read
+//	a run of consecutive sectors at a time, into one buffer reused
+//	throughout, and each sector is printed with a single fwrite.
 //----------------------------------------------------------------------
 
 void
 FileHeader::Print()
 {
-    printf("FileHeader contents.  File size: %d.  List blocks:\n", numBytes);
-    for (int i = 0; i < numLists; i++)
-        printf("%d ", dataSectorLists[i]);
+    Arena *scratch = kernel->currentThread->Scratch();
+    ArenaMark mark(scratch);
+    int nowNumBytes = 0, sectorIdx = 0;
+    char *buf;
+
+    if (IsInline()) {
+        char line[3 * MaxInlineSize + 1];
+        printf("FileHeader contents.  File size: %d.  Inline data:\n",
+               numBytes);
+        fwrite(line, 1, Escape(inlineData, numBytes, line), stdout);
+        puts("");
+        return;
+    }
+    buf = scratch->Alloc(MaxCacheRun * SectorSize);
+    if (layout == ExtentLayout) {
+        printf("FileHeader contents.  File size: %d, %d sectors allocated."
+               "  Extents:\n", numBytes, AllocatedSectors());
+        for (int i = 0; i < numExtents; i++) {
+            if (extents[i].start < 0)
+                printf("hole+%d ", extents[i].length);
+            else
+                printf("%d+%d ", extents[i].start, extents[i].length);
+        }
+        puts("");
+        for (int i = 0; i < numExtents; i++) {
+            if (extents[i].start < 0)
+                printf("File contents in extent %d, a hole of %d sectors:\n",
+                       i, extents[i].length);
+            else
+                printf("File contents in extent %d, Sectors %d-%d:\n", i,
+                       extents[i].start,
+                       extents[i].start + extents[i].length - 1);
+            PrintSectors(sectorIdx, sectorIdx + extents[i].length,
+                         &nowNumBytes, buf);
+            sectorIdx += extents[i].length;
+        }
+        return;
+    }
+    printf("FileHeader contents.  File size: %d, %d sectors allocated%s."
+           "  Direct blocks", numBytes, AllocatedSectors(),
+           compressed ? ", compressed" : "");
+    if (blockShift > 0)
+        printf(" (of %d sectors)", BlockSectors());
+    printf(":\n");
+    for (int i = 0; i < NumDirect && i < numSectors; i++)
+        printf("%d ", dataSectors[i]);
     puts("");
-    int nowNumSectors = 0, nowNumBytes = 0;
-    for (int i = 0; i < numLists; i++, nowNumSectors += SectorNumPerList) {
-        // last Sector in this loop
-        int lastSectorNum;
-        if (nowNumSectors + SectorNumPerList > numSectors) lastSectorNum = numSectors;
-        else lastSectorNum = nowNumSectors + SectorNumPerList;
-        // buf to write in
-        int *buf = new int[SectorNumPerList];
-        kernel->synchDisk->ReadSector(dataSectorLists[i], (char *) buf);
-        printf("File contents in list %d, Sector %d:\n", i, dataSectorLists[i]);
-        for (int j = 0; j < lastSectorNum - nowNumSectors; j++) {
-            // check if buf[j] is marked and clear it
-            char *data = new char[SectorSize];
-            // read the data the idx in the list points to
-            kernel->synchDisk->ReadSector(buf[j], (char *) data);
-            // print it as original version
-            for (int k = 0; (k < SectorSize) && (nowNumBytes < numBytes); k++, nowNumBytes++) {
-                if ('\040' <= data[k] && data[k] <= '\176')
-                    printf("%c", data[k]);
-                else
-                    printf("\\%x", (unsigned char) data[k]);
-            }
-            puts("");
-            delete [] data;
+    if (numSectors > NumDirect) {
+        printf("Indirect blocks:\n");
+        for (int i = NumDirect; i < NumHeaderEntries; i++)
+            if (dataSectors[i] >= 0)
+                printf("%d ", dataSectors[i]);
+        puts("");
+    }
+    printf("File contents:\n");
+    PrintSectors(0, numSectors, &nowNumBytes, buf);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::PrintSectors
+// 	Print the part of data sectors "from" up to "to" of the file that
+//	lies inside the file, one line per sector.  Holes, and sectors
+//	above the high-water mark, are printed as zeros.  Runs of sectors
+//	that are consecutive on disk are read with one request.
+//
+//	"nowNumBytes" is the number of bytes of the file printed so far,
+//	advanced past these sectors
+//	"buf" has room for MaxCacheRun sectors
+//----------------------------------------------------------------------
+
+void
+FileHeader::PrintSectors(int from, int to, int *nowNumBytes, char *buf)
+{
+    char line[3 * SectorSize + 1];
+    int run;
+
+    for (int i = from; i < to; i += run) {
+        int sector = (i < numWritten) ? ByteToSector(i * SectorSize) : -1;
+        for (run = 1; i + run < to && run < MaxCacheRun; run++) {
+            int next = (i + run < numWritten)
+                       ? ByteToSector((i + run) * SectorSize) : -1;
+            if ((sector < 0) ? (next >= 0) : (next != sector + run))
+                break;
+        }
+        if (sector >= 0)
+            kernel->bufferCache->ReadSectors(sector, run, buf);
+        else
+            memset(buf, 0, run * SectorSize);
+        for (int j = 0; j < run; j++) {
+            int n = min(SectorSize, max(numBytes - *nowNumBytes, 0));
+            int length = Escape(&buf[j * SectorSize], n, line);
+            line[length++] = '\n';
+            fwrite(line, 1, length, stdout);
+            *nowNumBytes += n;
         }
-        delete [] buf;
     }
 }
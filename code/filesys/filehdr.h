@@ -17,20 +17,126 @@
 #include "disk.h"
 #include "pbitmap.h"
 
-#define MaxListNum 	        29
-#define SectorNumPerList    32
-#define MaxFileSize 	    MaxListNum * SectorNumPerList * SectorSize
+#define NumHeaderEntries    28	// sector table entries in the header
+#define NumIndirectLevels   3	// single, double and triple indirect
+#define NumDirect 	    (NumHeaderEntries - NumIndirectLevels)
+#define PointersPerIndex    ((int) (SectorSize / sizeof(int)))
+					// sector numbers in an index block
+#define MaxFileSectors	    (NumDirect + PointersPerIndex + \
+			     PointersPerIndex * PointersPerIndex + \
+			     PointersPerIndex * PointersPerIndex * PointersPerIndex)
+#define MaxFileSize 	    (MaxFileSectors * SectorSize)
+					// for IndexLayout; an ExtentLayout
+					// file is only limited by MaxExtentNum
+#define MaxExtentNum	    (NumHeaderEntries / 2)
+#define MaxInlineSize	    (NumHeaderEntries * (int) sizeof(int))
+					// largest file kept in the header
+
+// The ways a file header can describe where its data is.  The layout
+// used for new files is chosen when the disk is formatted.
+#define IndexLayout	    0	// direct and indirect sector pointers
+#define ExtentLayout	    1	// runs of contiguous sectors
+#define CompressedFlag	    0x100	// or'ed into the layout on disk, for
+					// a compressed file
+#define BlockFlag(shift)    ((shift) << 12)	// or'ed into the layout, for
+					// blocks of 2^shift sectors
+#define BlockMask	    BlockFlag(0xf)
+#define BlockShiftOf(layout) (((layout) & BlockMask) >> 12)
+#define MaxBlockShift	    4	// largest blocks: MaxCacheRun sectors
+
+#define SectorsPerChunk	    8	// a compressed file is compressed in
+#define ChunkSize	    (SectorsPerChunk * SectorSize)
+					// chunks of this many bytes
+
+#define MaxDelayed	    64	// data sectors a file can have waiting
+					// in memory for delayed allocation
+
+// An extent is a run of "length" contiguous data sectors starting
+// at sector "start", or a hole of "length" sectors if "start" is -1.
+
+class Extent {
+  public:
+    int start;
+    int length;
+};
+
+class IndexBlock;			// in-core copy of an indirect block
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks. 
+// The file header is organized as a table of pointers to data blocks,
+// as in a classic UNIX inode: the first NumDirect entries point at data
+// sectors, and the last three at a single, a double and a triple
+// indirect index block.  Small files only use the direct pointers.
+//
+// Alternatively (ExtentLayout), the header holds up to MaxExtentNum
+// extents, and allocation looks for contiguous runs of free sectors,
+// so a large sequential file is described entirely by its header.
+//
+// A file of at most MaxInlineSize bytes has no data sectors at all:
+// its data is kept in the header, in place of the sector table.  When
+// it grows past that, Extend moves the data to a sector of its own and
+// the file gets its normal layout.
+//
+// Data sectors are not zeroed when they are allocated.  Instead the
+// header keeps a high-water mark: the sectors below it have been
+// written (or zeroed), and the ones above it hold whatever was on the
+// disk before and read as zeros.  Creating a big file then costs no
+// data writes at all.
+//
+// A file can also have holes: parts of it that have no data sectors
+// at all, and read as zeros.  A sector table or index block entry of
+// -1 is a hole, and so is a missing index block (all of its entries
+// are), or an extent whose start is -1.  FileSystem::Create makes the
+// whole file a hole, and OpenFile::WriteAt fills in a sector the first
+// time it is written.
+//
+// A file can share its data sectors with its snapshots (see
+// FileSystem::Snapshot), which the bitmap counts.  Share makes a new
+// header for the same data, with index blocks of its own, and Unshare
+// moves one shared sector of a file that is about to be written to a
+// sector of its own.  Giving a shared sector back to the bitmap only
+// drops its count, so Deallocate and Trim need not know.  In the dedup
+// mode, ShareSector points a sector that is about to be written at one
+// that already holds the same bytes instead.
+//
+// An IndexLayout file can map its data a block at a time, where a block
+// is 2^k contiguous sectors (k chosen when the disk is formatted, see
+// FileSystem::FileSystem): each sector table and index block entry
+// then points at the first sector of a block, so the index blocks hold
+// 2^k times as much data each, and a file is read in runs at least a
+// block long.  Only the last block of the file is shorter, when the
+// file does not need all of it -- Trim gives back the rest, so that
+// the tails of small files are packed together rather than each
+// taking a whole block.  The last block is grown in place if the
+// sectors after it are free, or else moved to a run of its own.  A
+// hole is a whole block, and so is what FillHole and Unshare allocate.
+// The bitmap still counts sectors, as headers and index blocks take
+// one each.
+//
+// A file can be compressed (IndexLayout only).  Its data is cut into
+// chunks of ChunkSize bytes, and each chunk is stored, compressed, in
+// the first of the SectorsPerChunk sectors that would hold it; the
+// rest are holes.  A chunk that does not get at least a sector smaller
+// is stored as it is, in all of them.  So the sector table is the map
+// of the chunks, and reaches to the end of the last chunk, past the
+// end of the file.  OpenFile reads and writes a compressed file a
+// chunk at a time; here the file only has to keep whole chunks.
+//
+// In the delayed allocation mode (see FileSystem::StartDelayedAllocation),
+// what is written past the file's last data sector is kept in the
+// in-core header instead, up to MaxDelayed sectors of it, and only
+// the number of sectors it needs is reserved in the bitmap.  The
+// sectors are chosen, together, when the data is written out by
+// AllocateDelayed -- as the buffer cache writes behind, or the file
+// is synced or last closed -- so that a file appended to a bit at a
+// time still gets one run.  Until then, FileLength counts the data
+// waiting, but the header on disk does not.
 //
 // The file header data structure can be stored in memory or on disk.
 // When it is on disk, it is stored in a single sector -- this means
 // that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// as one disk sector.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
@@ -41,48 +147,219 @@ class FileHeader {
 	// MP4 mod tag
 	FileHeader(); // dummy constructor to keep valgrind happy
 	~FileHeader();
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
 	
-    bool Allocate(PersistentBitmap *bitMap, int fileSize);// Initialize a file header, 
+    bool Allocate(PersistentBitmap *bitMap, int fileSize, int layout,
+                  int goal);		// Initialize a file header, 
 						//  including allocating space 
-						//  on disk for the file data
+						//  on disk (near "goal") for
+						//  the file data
+    bool Extend(PersistentBitmap *bitMap, int newSize, int goal,
+                int spare = 0);		// Grow the file to "newSize" bytes,
+					//  allocating more data blocks (and
+					//  "spare" more ahead of need, if
+					//  they fit)
+    bool ExtendSparse(PersistentBitmap *bitMap, int newSize, int goal);
+    					// Grow the file to "newSize" bytes
+					//  with a hole, allocating nothing
+    bool FillHole(PersistentBitmap *bitMap, int sectorIdx, int goal);
+    					// Allocate data sector "sectorIdx",
+					//  which is a hole
+    bool Preallocate(PersistentBitmap *bitMap, int size, int goal,
+                     bool keepSize);	// Allocate data blocks for the first
+					//  "size" bytes, in runs, growing the
+					//  file to "size" unless "keepSize"
+    bool DelayWrite(PersistentBitmap *bitMap, char *from, int numBytes,
+                    int position);	// Keep data written past the last
+					//  data sector in memory, reserving
+					//  sectors for it
+    void ReadDelayed(char *into, int numBytes, int position);
+    					// Copy out data kept by DelayWrite
+    bool AllocateDelayed(PersistentBitmap *bitMap, int goal);
+    					// Give the data kept by DelayWrite
+					//  its sectors, and write it
+    void DropDelayed(PersistentBitmap *bitMap);
+    					// Forget the data kept by DelayWrite
+    bool HasDelayed() { return delayed != NULL; }
+    int AllocatedLength() { return numSectors * SectorSize; }
+    					// Bytes up to the end of the last
+					//  data sector
+    bool HasSpare() { return !compressed &&
+                             numSectors > divRoundUp(numBytes, SectorSize); }
+    void Trim(PersistentBitmap *bitMap);// Free the data blocks allocated
+					//  ahead, past the end of the file
     void Deallocate(PersistentBitmap *bitMap);  // De-allocate this file's 
 						//  data blocks
+    void MarkSectors(Bitmap *map, PersistentBitmap *freeMap);
+    					// Set the bits of the data and index
+					//  blocks in "map", to free later
+    bool Share(PersistentBitmap *freeMap, FileHeader *copy);
+    					// Make "copy" a header for the same
+					//  data, sharing the data sectors
+    bool IsShared(PersistentBitmap *freeMap);
+    					// Is a data sector shared?
+    bool Unshare(PersistentBitmap *freeMap, int sectorIdx, int goal,
+                 bool keep);		// Give data sector "sectorIdx",
+					//  which is shared, a sector of its
+					//  own (with the old data, if "keep")
+    void ShareSector(PersistentBitmap *freeMap, int sectorIdx, int sector);
+    					// Make data sector "sectorIdx" share
+					//  "sector", which holds the same
 
     void FetchFrom(int sectorNumber); 	// Initialize file header from disk
+    void Unpack(char *buf);		// Initialize it from a copy of its
+					//  sector
     void WriteBack(int sectorNumber); 	// Write modifications to file header
 					//  back to disk
+    void Flush();			// Force the data and index blocks out
+					//  of the buffer cache to disk
 
     int ByteToSector(int offset);	// Convert a byte offset into the file
 					// to the disk sector containing
-					// the byte
+					// the byte, or -1 in a hole
 
     int FileLength();			// Return the length of the file 
 					// in bytes
+    int AllocatedSectors();		// Data and index sectors the file
+					// takes up on disk
+
+    int ListSectors(char *image, int *data, int *index, int *numIndex);
+    					// The file's data sectors and index
+					//  blocks, found in "image", a copy
+					//  of the whole disk
+    int DataRuns(int *numData);		// Runs of contiguous data sectors
+    void Relocate(PersistentBitmap *freeMap, int start);
+    					// Move the data sectors to a run
+					//  starting at "start"
+
+    int Layout() { return layout; }	// IndexLayout or ExtentLayout
+    int BlockSectors() { return 1 << blockShift; }
+    					// Sectors each index entry maps
+    bool SetCompressed();		// Compress this file, which is empty
+    bool IsCompressed() { return compressed; }
+    void PunchHole(PersistentBitmap *freeMap, int sectorIdx);
+    					// Give back data sector "sectorIdx",
+					//  leaving a hole
+
+    int HighWater() { return numWritten; }
+    					// Data sectors written so far; the
+					// rest of the file reads as zeros
+    void SetHighWater(int sectors);	// Note that the first "sectors"
+					// data sectors now hold real data
+
+    bool IsInline() { return numSectors == 0; }
+    					// Is the data kept in the header?
+    void ReadInline(char *into, int numBytes, int position);
+    void WriteInline(char *from, int numBytes, int position);
+    					// Copy the data of an inline file
 
     void Print();			// Print the contents of the file.
 
   private:
+    bool AddSectors(PersistentBitmap *freeMap, int newSectors, int goal);
+    					// Allocate data up to "newSectors"
+    bool GrowLastBlock(PersistentBitmap *freeMap, int newSectors, int goal);
+    					// Grow the last, short block of an
+					// IndexLayout file to "newSectors"
+    int TakeRun(PersistentBitmap *freeMap, int goal, int want, int *length);
+    					// Allocate up to "want" sectors that
+					// do not end inside a block
+    int TakeBlock(PersistentBitmap *freeMap, int goal, int length);
+    					// Allocate a run of "length" sectors
+    int NumBlocks(int sectors) { return divRoundUp(sectors, BlockSectors()); }
+    int BlockLength(int which) { return min(BlockSectors(),
+                                     numSectors - (which << blockShift)); }
+    					// Data sectors of block "which"
+    void TrimTo(PersistentBitmap *freeMap, int keep);
+    					// Free the data past the first "keep"
+					// data sectors
+    bool ExtendExtents(PersistentBitmap *freeMap, int newSectors,
+                       int goal);	// Grow the data by contiguous runs
+    bool Uninline(PersistentBitmap *freeMap, int newSize, int goal,
+                  int spare);		// Move inline data out to a sector
+    void MapSector(PersistentBitmap *freeMap, int sectorIdx,
+                   int dataSector);	// Point entry "sectorIdx" of the
+					// index at "dataSector"
+    void TrimIndex(PersistentBitmap *freeMap, IndexBlock *block,
+                   int level, int keep, int count);
+    					// Free what "block" maps past its
+					// first "keep" of "count" data sectors
+    void WriteIndex(IndexBlock *block);	// Write the dirty index blocks
+    void DeallocateIndex(PersistentBitmap *freeMap, IndexBlock *block,
+                         int level, int count);
+    void MarkIndex(Bitmap *map, PersistentBitmap *freeMap,
+                   IndexBlock *block, int level, int count);
+    					// MarkSectors below an index block
+    int CountIndex(IndexBlock *block, int level, int count);
+    					// Sectors in use below "block"
+    int DelayedNeed(int count);		// Sectors to reserve for "count"
+					// data sectors past the last one
+    bool FillHoles(PersistentBitmap *freeMap, int count, int goal);
+    					// Allocate runs for the holes among
+					// the first "count" data sectors
+    bool RemapExtent(PersistentBitmap *freeMap, int sectorIdx, int goal);
+    					// Give sector "sectorIdx" of an
+					// ExtentLayout file a new sector
+    void InsertExtents(int which, int count);
+    void RemoveExtent(int which);	// Open up/close a gap in "extents"
+    void PrintSectors(int from, int to, int *nowNumBytes, char *buf);
+    					// Print data sectors "from" up to
+					// "to" of the file, reading them
+					// into "buf"
+    IndexBlock *GetIndex(int level);	// Return the root index block of
+					// "level", reading it on first use
+    IndexBlock *GetChild(IndexBlock *block, int which);
+    					// Return a child index block,
+					// reading it on first use
+    void ListIndex(char *image, int sector, int level, int count,
+                   int *data, int *numData, int *index, int *numIndex);
+    					// ListSectors below an index block
+    void FlushIndex(IndexBlock *block, int level, int count);
+    					// Flush an index tree and its data
+    void FreeIndex();			// Drop the in-core index blocks
 	
 	/*
-		MP4 hint:
-		You will need a data structure to store more information in a header.
 		Fields in a class can be separated into disk part and in-core part.
 		Disk part are data that will be written into disk.
 		In-core part are data only lies in memory, and are used to maintain the data structure of this class.
-		In order to implement a data structure, you will need to add some "in-core" data
-		to maintain data structure.
 		
-		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
-		written to a sector on disk.
-		In-core part - none
+		Disk Part - numBytes, numSectors, numWritten, layout (with
+		compressed and blockShift as flags in it), and dataSectors, extents or
+		inlineData occupy exactly 128 bytes and will be written to a
+		sector on disk.
+		In-core part - numExtents, indirect, and the data kept
+		for delayed allocation
 		
 	*/
 	
     int numBytes;			// Number of bytes in the file
     int numSectors;			// Number of data sectors in the file
-    int numLists;
-    int dataSectorLists[MaxListNum];		// Disk sector numbers for each data 
-					// block in the file
+    int numWritten;			// High-water mark, in data sectors
+    int layout;				// IndexLayout or ExtentLayout
+    bool compressed;			// Stored a chunk at a time?
+    int blockShift;			// IndexLayout: each entry maps 2^this
+					// data sectors
+    union {
+	int dataSectors[NumHeaderEntries];	// IndexLayout: NumDirect data
+					// blocks, then the single, double and
+					// triple indirect index blocks
+	Extent extents[MaxExtentNum];	// ExtentLayout: runs of data sectors,
+					// unused entries have length 0
+	char inlineData[MaxInlineSize];	// No data sectors: the data itself
+    };
+
+    int numExtents;			// Extents in use (ExtentLayout)
+    IndexBlock *indirect[NumIndirectLevels];
+    					// In-core index trees, loaded one
+					// block at a time as they are used
+    char *delayed;			// Data written past the last data
+					// sector, MaxDelayed sectors of
+					// room, or NULL if there is none
+    int numDelayed;			// Sectors of it in use
+    int delayedBytes;			// File length, counting it
+    int numReserved;			// Sectors reserved for it
 };
 
 #endif // FILEHDR_H
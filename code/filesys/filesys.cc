@@ -16,28 +16,37 @@
 //      Both the bitmap and the directory are represented as normal
 //	files.  Their file headers are located in specific sectors
 //	(sector 0 and sector 1), so that the file system can find them
-//	on bootup.
+//	on bootup.  The superblock, at the end of track 0, records where
+//	they are, and whether the disk was unmounted cleanly (see
+//	superblock.h).
 //
 //	The file system assumes that the bitmap and directory files are
 //	kept "open" continuously while Nachos is running.
 //
-//	For those operations (such as Create, Remove) that modify the
-//	directory and/or bitmap, if the operation succeeds, the changes
-//	are written immediately back to disk (the two files are kept
-//	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	The bitmap is also kept in memory the whole time.  Operations
+//	(such as Create, Remove) change the in-memory copy, and only the
+//	sectors of it that changed are written back.  Directory changes
+//	are written back as soon as the operation succeeds.  If an
+//	operation fails, it gives back whatever it took from the bitmap
+//	and discards the changed directory.
+//
+//	Each operation's writes -- header, directories, bitmap -- are
+//	logged by the journal (see journal.h), and reach their homes on
+//	disk only once the journal has committed them together.
 //
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
+//	   only files and directories are locked against concurrent
+//	    access (see the RWLock in ftable.h), not the name space as a
+//	    whole: a file can be opened while its directory is removed
 //	   files have a fixed size, set when the file is created
 //	   files cannot be bigger than about 3KB in size
 //	   there is no hierarchical directory structure, and only a limited
 //	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//	   only metadata is journaled: if Nachos exits in the middle of
+//	    writing a file, the data written since the last Fsync or
+//	    Sync may be lost, and the bitmap may show sectors in use that
+//	    no file holds (until the next mount checks the disk)
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -51,55 +60,87 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "bufcache.h"
+#include "dcache.h"
+#include "ftable.h"
+#include "journal.h"
+#include "fsck.h"
+#include "defrag.h"
+#include "superblock.h"
+#include "main.h"
+#include "frames.h"
+#include "workpool.h"
+#include "slab.h"
+#include "synch.h"
 
-// Sectors containing the file headers for the bitmap of free sectors,
-// and the directory of files.  These file headers are placed in well-known
-// sectors, so that they can be located on boot-up.
-#define FreeMapSector 		0
-#define DirectorySector 	1
-
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize 	(NumSectors / BitsInByte)
-#define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+// Initial file sizes for the bitmap and directory.  The bitmap's file
+// is made longer to hold the share counts when a sector is first
+// shared, and the hashes when the dedup mode is first turned on (see
+// pbitmap.h).  It is never small enough to be kept in its header (a
+// disk of fewer than 29 tracks), since it is written a sector at a
+// time.  Directories start out empty, and their files grow as entries
+// are added.
+#define FreeMapFileSize 	max(kernel->synchDisk->VolumeSectors() / BitsInByte, \
+				    MaxInlineSize + 1)
+#define DirectoryFileSize 	0
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
 // 	Initialize the file system.  If format = TRUE, the disk has
-//	nothing on it, and we need to initialize the disk to contain
-//	an empty directory, and a bitmap of free sectors (with almost but
-//	not all of the sectors marked as free).
+//	nothing on it (it is erased first), and we need to initialize the
+//	disk to contain an empty directory, and a bitmap of free sectors
+//	(with almost but not all of the sectors marked as free).
 //
 //	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	representing the bitmap and the directory, where the superblock
+//	says they are.  The layout of new files is whatever the disk was
+//	given at format time.  If the disk was unmounted cleanly, the
+//	superblock's count of free sectors is taken as it is; Mount
+//	checks a disk that was not.  A disk formatted before there were
+//	superblocks is mounted as one that was not, and is given one.
 //
 //	"format" -- should we initialize the disk?
+//	"layout" -- file header layout to format the disk with, with the
+//		size of IndexLayout blocks or'ed in (see BlockFlag)
 //----------------------------------------------------------------------
 
 static const int TransferSize = 128;
 
-FileSystem::FileSystem(bool format)
+FileSystem::FileSystem(bool format, int layout)
 {
     DEBUG(dbgFile, "Initializing the file system.");
     if (format) {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
+        this->layout = layout;
+        freeMap = new PersistentBitmap(kernel->synchDisk->VolumeSectors());
         Directory *directory = new Directory(NumDirEntries);
 		FileHeader *mapHdr = new FileHeader;
 		FileHeader *dirHdr = new FileHeader;
 
         DEBUG(dbgFile, "Formatting the file system.");
 
+		// a quick format: whatever the disk held is erased, without
+		// writing a sector, and only the headers and the bitmap and the
+		// superblock are written below; the sectors of the journal,
+		// and of files yet to be written, just read as zeros
+		kernel->synchDisk->Erase();
+
 		// First, allocate space for FileHeaders for the directory and bitmap
 		// (make sure no one else grabs these!)
 		freeMap->Mark(FreeMapSector);
 		freeMap->Mark(DirectorySector);
+		kernel->journal->Format(freeMap);
+		freeMap->Mark(SuperblockSector);
 
 		// Second, allocate space for the data blocks containing the contents
 		// of the directory and bitmap files.  There better be enough space!
 
-		ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize));
-		ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
+		ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize, layout,
+					FreeMapSector));
+		ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize, layout,
+					DirectorySector));
+		mapHdr->SetHighWater(divRoundUp(FreeMapFileSize, SectorSize));
+					// all written below, so that the
+					// header need not be written again
 
 		// Flush the bitmap and directory FileHeaders back to disk
 		// We need to do this before we can "Open" the file, since open
@@ -131,16 +172,45 @@ FileSystem::FileSystem(bool format)
 			freeMap->Print();
 			directory->Print();
         }
-        delete freeMap;
 		delete directory;
 		delete mapHdr;
 		delete dirHdr;
+		kernel->bufferCache->Flush();	// straight home, unjournaled:
+						// a format that stops is just
+						// done again
+
+		// the disk is empty, and the summary says so: it is as good
+		// as unmounted cleanly
+		superblock = new Superblock(layout);
+		superblock->clean = TRUE;
+		superblock->numFree = freeMap->NumClear();
     } else {
-		// if we are not formatting the disk, just open the files representing
-		// the bitmap and directory; these are left open while Nachos is running
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
+		// if we are not formatting the disk, finish the last batch of the
+		// journal, if Nachos stopped in the middle of writing it home; then
+		// just open the files representing the bitmap and directory; these
+		// are left open while Nachos is running
+        kernel->journal->Recover();
+        superblock = new Superblock;
+        if (!superblock->FetchFrom()) {
+            FileHeader *dirHdr = new FileHeader;
+
+            dirHdr->FetchFrom(DirectorySector);
+            delete superblock;
+            superblock = new Superblock(dirHdr->Layout());
+            delete dirHdr;
+        }
+        ASSERT(superblock->Fits());	// formatted by another Nachos
+        freeMapFile = new OpenFile(superblock->freeMapSector);
+        directoryFile = new OpenFile(superblock->directorySector);
+        freeMap = new PersistentBitmap(freeMapFile,
+                            kernel->synchDisk->VolumeSectors(),
+                            superblock->clean ? superblock->numFree : -1);
+        this->layout = superblock->layout;
     }
+    defrag = new Defragmenter(freeMap, freeMapFile);
+    dedup = FALSE;
+    delayAlloc = FALSE;
+    renameLock = new Lock("rename");
 }
 
 //----------------------------------------------------------------------
@@ -149,6 +219,10 @@ FileSystem::FileSystem(bool format)
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
+	delete renameLock;
+	delete superblock;
+	delete defrag;
+	delete freeMap;
 	delete freeMapFile;
 	delete directoryFile;
 }
@@ -156,117 +230,122 @@ FileSystem::~FileSystem()
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	Files grow as they are written past the end.  The initial size
+//	allocates nothing: the file starts out as one big hole, and gets
+//	its data sectors as they are first written.
+//
+//	A file can be created compressed: its data is then stored in
+//	chunks, each in as few sectors as the chunk compresses to (see
+//	OpenFile::WriteChunks), so text-like data takes fewer sectors to
+//	read.  Only disks formatted with IndexLayout headers, and blocks of
+//	one sector, have them.
 //
 //	The steps to create a file are:
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
-// 	  Allocate space on disk for the data blocks for the file
-//	  Add the name to the directory
+// 	  Make the file "initialSize" bytes long, all of it a hole
+//	  Add the name to the directory, growing it if it is full
 //	  Store the new file header on disk
-//	  Flush the changes to the bitmap and the directory back to disk
+//	  Flush the changes to the directory back to disk (the bitmap
+//	    stays in memory until the next Sync)
 //
 //	Return TRUE if everything goes ok, otherwise, return FALSE.
 //
 // 	Create fails if:
 //   		file is already in directory
 //	 	no free space for file header
-//	 	no free entry for file in directory
-//	 	no free space for data blocks for the file
+//	 	no room in the header for the hole
+//	 	no free space to grow the directory
+//		"compressed", on a disk formatted with extents or blocks
 //
-// 	Note that this implementation assumes there is no concurrent access
-//	to the file system!
+//	The directory that gets the new name is held for update while it
+//	changes (see OpenFile::BeginUpdate), so other threads' lookups
+//	wait for it, and their changes to it come before or after.
+//
+//	"name" -- name of file to be created
+//	"initialSize" -- size of file to be created
+//	"compressed" -- whether its data is to be compressed
+//----------------------------------------------------------------------
+
+bool FileSystem::Create(char *name, int initialSize, bool compressed)
+{
+    DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
+    return CreateEntry(name, initialSize, 'F', compressed);
+}
+
+bool FileSystem::CreateDir(char *name) {
+    DEBUG(dbgFile, "Creating directory " << name);
+    return CreateEntry(name, DirectoryFileSize, 'D', FALSE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CreateEntry
+// 	Create a file or a directory of "initialSize" bytes.  The header
+//	and data are allocated first, so that if the name cannot be added
+//	(it is already there, or a directory could not grow) everything
+//	can simply be given back to the bitmap.
 //
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
+//	"type" -- 'F' for a file, 'D' for a directory
+//	"compressed" -- whether a file is compressed
 //----------------------------------------------------------------------
 
-bool FileSystem::Create(char *name, int initialSize)
+bool
+FileSystem::CreateEntry(char *name, int initialSize, char type,
+                        bool compressed)
 {
-    Directory *directory;
-    PersistentBitmap *freeMap;
+    PathWalk walk;
     FileHeader *hdr;
     int sector;
     bool success;
+    int start = kernel->stats->totalTicks;
 
-    DEBUG(dbgFile, "Creating file " << name << " size " << initialSize);
-
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-
-    if (directory->Find(name) != -1) {
-        success = FALSE;			// file is already in directory
-        /*freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-        freeMap->Print();
-        printf("1\n");*/
+    kernel->journal->Begin();
+    if (!WalkPath(name, &walk, TRUE) || walk.sector != -1) {
+        success = FALSE;		// no such directory, or the file is
+					// already in it
     } else {
-        freeMap = new PersistentBitmap(freeMapFile,NumSectors);
-        sector = freeMap->FindAndSet();	// find a sector to hold the file header
+        // put a file's header in its parent directory's group, and a
+        // new directory in the emptiest group, to leave room for its
+        // files; the data goes right after the header
+        int goal = walk.dirSector;
+        if (type == 'D')
+            goal = freeMap->EmptiestGroup(goal);
+        sector = freeMap->FindAndSetNear(goal);
     	if (sector == -1) {
             success = FALSE;		// no free block for file header
-            //printf("2\n");
-        } else if (!directory->Add(name, sector, 'F')) {
-            success = FALSE;	// no space in directory
-            //printf("3\n");
         } else {
+            // a program run from here must not find the pages of an
+            // executable whose header was here before
+            kernel->frameAllocator->ForgetImage(sector);
     	    hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize)) {
+            hdr->Allocate(freeMap, 0, layout, sector + 1);
+            if ((compressed && !hdr->SetCompressed()) ||
+                    !hdr->ExtendSparse(freeMap, initialSize, sector + 1)) {
                 success = FALSE;	// no space on disk for data
-                //printf("4\n");
-            }
-            else {
+                freeMap->Clear(sector);
+            } else if (!walk.dir->Add(walk.leaf, sector, type) ||
+                    !walk.dir->Reserve(walk.dirFile, freeMap)) {
+                success = FALSE;	// no space to grow the directory
+                hdr->Deallocate(freeMap);
+                freeMap->Clear(sector);
+            } else {
                 success = TRUE;
-                // everthing worked, flush all changes back to disk
+                superblock->numFiles++;
+                // everthing worked; write it all, to be committed together
     	    	hdr->WriteBack(sector);
-    	    	directory->WriteBack(directoryFile);
+    	    	walk.dir->WriteBack(walk.dirFile);
     	    	freeMap->WriteBack(freeMapFile);
             }
             delete hdr;
         }
-        delete freeMap;
-    }
-    delete directory;
-    return success;
-}
-
-bool FileSystem::CreateDir(char *name) {
-    Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *hdr;
-    int sector;
-    bool success;
-
-    DEBUG(dbgFile, "Creating directory " << name);
-
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-
-    if (directory->Find(name) != -1)
-        success = FALSE;
-    else {
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-        sector = freeMap->FindAndSet();
-        if (sector == -1)
-            success = FALSE;
-        else if (!directory->Add(name, sector, 'D'))
-            success = FALSE;
-        else {
-            hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, DirectoryFileSize))
-                success = FALSE;
-            else {
-                success = TRUE;
-                //printf("Create Dir at sector %d\n", sector);
-                hdr->WriteBack(sector);
-                directory->WriteBack(directoryFile);
-                freeMap->WriteBack(freeMapFile);
-            }
-            delete hdr;
-        }
-        delete freeMap;
     }
-    delete directory;
+    walk.Done();
+    if (success)
+        kernel->dentryCache->Invalidate(name);	// a negative entry, likely
+    kernel->journal->End();
+    kernel->stats->AddFsOp(FsCreate, start);
     return success;
 }
 
@@ -282,146 +361,853 @@ bool FileSystem::CreateDir(char *name) {
 
 OpenFile *FileSystem::Open(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
     int sector;
+    int start = kernel->stats->totalTicks;
 
     DEBUG(dbgFile, "Opening file" << name);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
+    sector = Lookup(name);
     if (sector >= 0)
 	openFile = new OpenFile(sector);	// name was found in directory
-    delete directory;
+    kernel->stats->AddFsOp(FsOpen, start);
     return openFile;				// return NULL if not found
 }
 
+//----------------------------------------------------------------------
+// PathWalk::PathWalk
+// 	Initialize a walk that has found nothing yet, and holds nothing.
+//----------------------------------------------------------------------
+
+PathWalk::PathWalk()
+{
+    dirFile = NULL;
+    dir = NULL;
+    dirSector = -1;
+    leaf = NULL;
+    index = sector = -1;
+    ownFile = updating = FALSE;
+}
+
+//----------------------------------------------------------------------
+// PathWalk::Done
+// 	Give back the parent directory the walk found: end the update on
+//	it, if it was held for one, and free its contents and its file
+//	(unless that is the root's, which the file system keeps open).
+//	Doing so twice, or when the walk failed, does nothing.
+//----------------------------------------------------------------------
+
+void
+PathWalk::Done()
+{
+    if (dir == NULL)
+        return;
+    if (updating)
+        dirFile->EndUpdate();
+    if (ownFile)
+        delete dirFile;
+    delete dir;
+    dir = NULL;
+    dirFile = NULL;
+    updating = ownFile = FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FetchDirectory
+// 	Read the directory whose header is at "sector" into "dir", and
+//	look up "name" in it: only that entry is read, if the directory
+//	is indexed (see Directory::FetchFor).  Return the index of the
+//	entry, or -1 if the name is not there.
+//----------------------------------------------------------------------
+
+int
+FileSystem::FetchDirectory(int sector, Directory *dir, char *name)
+{
+    int i;
+
+    if (sector == DirectorySector) {
+        dir->FetchFor(directoryFile, name);
+        i = dir->FindIndex(name);
+    } else {
+        OpenFile *file = new OpenFile(sector);
+        dir->FetchFor(file, name);
+        i = dir->FindIndex(name);
+        delete file;
+    }
+    return i;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WalkPath
+// 	Walk the absolute path "name" down to the directory that holds its
+//	last component, the leaf, and look the leaf up in it: all that
+//	creating, removing or looking up the leaf needs, in one pass.  The
+//	parent comes from the dentry cache if it can, and otherwise each
+//	directory along the way is read once, into the same Directory,
+//	and the parent is entered in the cache.  The parent's contents
+//	are left in "walk", for the caller to change and write back, and
+//	given back by walk->Done.
+//
+//	If "update", the parent is held for update (see
+//	OpenFile::BeginUpdate) from before it is read until walk->Done, so
+//	that two changes to it cannot lose one another; the caller must
+//	have begun its journal operation first.
+//
+//	Return FALSE, holding nothing, if the parent does not exist, or
+//	the leaf is empty or longer than FileNameMaxLen.  Whether the leaf
+//	itself exists is up to the caller: walk->sector is -1 if not.
+//
+//	"name" -- the text name of a file; a name without a '/' is in
+//		the root
+//	"walk" -- where the result goes; nothing walked yet
+//	"update" -- whether the parent is to be changed
+//----------------------------------------------------------------------
+
+bool
+FileSystem::WalkPath(char *name, PathWalk *walk, bool update)
+{
+    char component[FileNameMaxLen + 1];
+    char *slash = strrchr(name, '/');
+    char *path = (name[0] == '/') ? name + 1 : name;
+    int sector = DirectorySector;
+    Directory *dir;
+
+    ASSERT(walk->dir == NULL);
+    walk->leaf = (slash != NULL) ? slash + 1 : name;
+    if (walk->leaf[0] == '\0' || strlen(walk->leaf) > FileNameMaxLen)
+        return FALSE;
+    dir = new Directory(NumDirEntries);
+
+    if (slash != NULL && slash > path) {	// the parent is not the root
+        Arena *scratch = kernel->currentThread->Scratch();
+        ArenaMark mark(scratch);
+        char *parent = scratch->Alloc(slash - name + 1);
+
+        strncpy(parent, name, slash - name);
+        parent[slash - name] = '\0';
+        if (!kernel->dentryCache->Lookup(parent, &sector)) {
+            sector = DirectorySector;
+            while (sector != -1 && path < slash) {
+                char *end = strchr(path, '/');	// at "slash", at the latest
+                int len = end - path;
+                int i;
+
+                kernel->stats->numLookupComponents++;
+                if (len > FileNameMaxLen) {
+                    sector = -1;	// too long to be in any directory
+                    break;
+                }
+                strncpy(component, path, len);
+                component[len] = '\0';
+                i = FetchDirectory(sector, dir, component);
+                sector = (i == -1) ? -1 : dir->table[i].sector;
+                path = end + 1;
+            }
+            kernel->dentryCache->Enter(parent, sector);
+        }
+    }
+    if (sector == -1) {
+        delete dir;
+        return FALSE;			// no such directory
+    }
+
+    walk->dir = dir;
+    walk->dirSector = sector;
+    walk->ownFile = (sector != DirectorySector);
+    walk->dirFile = walk->ownFile ? new OpenFile(sector) : directoryFile;
+    walk->updating = update;
+    if (update)
+        walk->dirFile->BeginUpdate();
+    kernel->stats->numLookupComponents++;
+    dir->FetchFor(walk->dirFile, walk->leaf);
+    walk->index = dir->FindIndex(walk->leaf);
+    walk->sector = (walk->index == -1) ? -1 : dir->table[walk->index].sector;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Lookup
+// 	Return the sector of the file header for the absolute path "name",
+//	or -1 if there is no such file.  The answer comes from the dentry
+//	cache when it can; otherwise the directories are searched and the
+//	result, found or not, is entered in the cache.
+//
+//	"name" -- the text name of the file to look up
+//----------------------------------------------------------------------
+
+int
+FileSystem::Lookup(char *name)
+{
+    int sector;
+    int start = kernel->stats->totalTicks;
+
+    if (strcmp(name, "/") == 0)
+        sector = DirectorySector;
+    else if (!kernel->dentryCache->Lookup(name, &sector)) {
+        PathWalk walk;
+
+        sector = WalkPath(name, &walk, FALSE) ? walk.sector : -1;
+        kernel->dentryCache->Enter(name, sector);
+    }
+    kernel->stats->AddFsOp(FsLookup, start);
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::myOpen
+// 	Open a file for the running user program, and return the id the
+//	program names it by, or -1 if there is no such file or the
+//	program has too many files open.  Each open gets its own seek
+//	position; the file's header is shared with its other openers,
+//	in this program or another (see ftable.h).
+//
+//	"name" -- the text name of the file to be opened
+//----------------------------------------------------------------------
+
 int FileSystem::myOpen(char *name) {
     OpenFile *openFile = Open(name);
-    if (openFile == NULL) return 0;
-    else {
-        this->openFile = openFile;
-        return 1;
-    }
+    OpenFileId id;
+
+    if (openFile == NULL)
+        return -1;
+    id = kernel->currentThread->space->AddFile(openFile);
+    if (id < 0)
+        delete openFile;
+    return id;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Read
+// 	Read from the running program's open file "id", at its seek
+//	position.  Return the number of bytes read, or -1 if "id" is
+//	not an open file.
+//----------------------------------------------------------------------
+
 int FileSystem::Read(char *buffer, int size, int id) {
-    return openFile->Read(buffer, size);
+    OpenFile *openFile = kernel->currentThread->space->GetFile(id);
+    int start = kernel->stats->totalTicks;
+    int n;
+
+    if (openFile == NULL)
+        return -1;
+    n = openFile->Read(buffer, size);
+    kernel->stats->numUserBytesRead += n;
+    kernel->stats->AddFsOp(FsRead, start);
+    return n;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Write
+// 	Write to the running program's open file "id", at its seek
+//	position.  Return the number of bytes written, or -1 if "id" is
+//	not an open file.
+//----------------------------------------------------------------------
+
 int FileSystem::Write(char *buffer, int size, int id) {
-    return openFile->Write(buffer, size);
+    OpenFile *openFile = kernel->currentThread->space->GetFile(id);
+    int start = kernel->stats->totalTicks;
+    int n;
+
+    if (openFile == NULL)
+        return -1;
+    n = openFile->Write(buffer, size);
+    kernel->stats->numUserBytesWritten += n;
+    kernel->stats->AddFsOp(FsWrite, start);
+    return n;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Close
+// 	Close the running program's open file "id", freeing the id.
+//	Return 1 on success, -1 if "id" is not an open file.
+//----------------------------------------------------------------------
+
 int FileSystem::Close(int id) {
+    OpenFile *openFile = kernel->currentThread->space->RemoveFile(id);
+
+    if (openFile == NULL)
+        return -1;
+    DEBUG(dbgFile, "Closing file " << id << ", read-ahead hits "
+		<< openFile->ReadAheadHits() << ", misses "
+		<< openFile->ReadAheadMisses());
     delete openFile;
     return 1;
 }
 
 //----------------------------------------------------------------------
-// FileSystem::Remove
-// 	Delete a file from the file system.  This requires:
-//	    Remove it from the directory
-//	    Delete the space for its header
-//	    Delete the space for its data blocks
-//	    Write changes to directory, bitmap back to disk
+// FileSystem::Fsync
+// 	Make the open file durable: give its data waiting for delayed
+//	allocation its sectors, write back the bitmap (so the file's
+//	sectors are recorded as in use), force the file's data out of the
+//	buffer cache, and then commit the bitmap and the file's header.
+//	Return 1 on success, -1 if "id" is not an open file.
 //
-//	Return TRUE if the file was deleted, FALSE if the file wasn't
-//	in the file system.
+//	"id" -- the open file, as returned by myOpen
+//----------------------------------------------------------------------
+
+int FileSystem::Fsync(int id) {
+    OpenFile *openFile = kernel->currentThread->space->GetFile(id);
+
+    if (openFile == NULL)
+        return -1;
+    openFile->AllocateDelayed();
+    kernel->journal->Begin(JournalSlots);	// alone, so Reserve never waits
+    freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    openFile->Sync();
+    kernel->journal->Commit();
+    kernel->synchDisk->Flush();
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Seek
+// 	Move the seek position of the running program's open file "id"
+//	to "offset" bytes from the start of the file, from the current
+//	position, or from the end of the file, as "whence" is SeekSet,
+//	SeekCurrent or SeekEnd.  The position may be past the end of the
+//	file; a write there leaves a hole.  Return the new position, or
+//	-1 if "id" is not an open file, or the position would be
+//	negative.
+//----------------------------------------------------------------------
+
+int FileSystem::Seek(int offset, int whence, int id) {
+    OpenFile *openFile = kernel->currentThread->space->GetFile(id);
+    int position;
+
+    if (openFile == NULL)
+        return -1;
+    switch (whence) {
+      case SeekSet:
+        position = offset;
+        break;
+      case SeekCurrent:
+        position = openFile->Position() + offset;
+        break;
+      case SeekEnd:
+        position = openFile->Length() + offset;
+        break;
+      default:
+        return -1;
+    }
+    if (position < 0)
+        return -1;
+    openFile->Seek(position);
+    return position;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FileSize
+// 	Return the length in bytes of the running program's open file
+//	"id", as its header has it now, or -1 if "id" is not an open file.
+//----------------------------------------------------------------------
+
+int FileSystem::FileSize(int id) {
+    OpenFile *openFile = kernel->currentThread->space->GetFile(id);
+
+    if (openFile == NULL)
+        return -1;
+    return openFile->Length();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CopyRange
+// 	Copy "size" bytes from the running program's open file "fromId",
+//	at its seek position, to its open file "toId", at that one's,
+//	without the bytes going through the program (see
+//	OpenFile::CopyFrom).  Both positions move past the bytes copied.
+//	Return how many were copied -- fewer than "size" if "fromId"
+//	ends first -- or -1 if either id is not an open file, or "size"
+//	is negative.
+//----------------------------------------------------------------------
+
+int FileSystem::CopyRange(int fromId, int toId, int size) {
+    AddrSpace *space = kernel->currentThread->space;
+    OpenFile *from = space->GetFile(fromId);
+    OpenFile *to = space->GetFile(toId);
+    int start = kernel->stats->totalTicks;
+    int n;
+
+    if (from == NULL || to == NULL || size < 0)
+        return -1;
+    n = to->CopyFrom(from, from->Position(), size, to->Position());
+    from->Seek(from->Position() + n);
+    if (to != from)
+        to->Seek(to->Position() + n);
+    kernel->stats->AddFsOp(FsWrite, start);
+    return n;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Preallocate
+// 	Give the first "size" bytes of the running program's open file
+//	"id" disk sectors before they are written, in as few runs as the
+//	free space allows (see OpenFile::Preallocate), so that a file
+//	whose final size is known is laid out in one.  The file grows to
+//	"size" bytes, unless "flags" has PreallocKeepSize.  The bitmap is
+//	written back as it is for any write, at the next Fsync or Sync.
+//	Return 1, or -1 if "id" is not an open file, "size" is negative,
+//	"flags" has an unknown bit, or the space could not all be given
+//	(what was given is kept).
+//----------------------------------------------------------------------
+
+int FileSystem::Preallocate(int id, int size, int flags) {
+    OpenFile *openFile = kernel->currentThread->space->GetFile(id);
+    int start = kernel->stats->totalTicks;
+    bool done;
+
+    if (openFile == NULL || size < 0 || (flags & ~PreallocKeepSize) != 0)
+        return -1;
+    done = openFile->Preallocate(size, (flags & PreallocKeepSize) != 0);
+    kernel->stats->AddFsOp(FsWrite, start);
+    return done ? 1 : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RecurRemove
+// 	Delete the directory "name", and everything below it, as one
+//	batch: a single traversal reads each directory and header once
+//	and notes every sector to free, the sectors are then cleared in
+//	the bitmap in one pass over it, and the parent directory and the
+//	bitmap are each written once.
 //
-//	"name" -- the text name of the file to be removed
+//	"name" -- the text name of the directory to be removed
 //----------------------------------------------------------------------
 
-void FileSystem::RecurRemove(char *name) {
-    Directory *directory;
-    PersistentBitmap *freeMap;
+void
+FileSystem::RecurRemove(char *name)
+{
+    PathWalk walk;
+    Bitmap *doomed;
+    OpenFile *dirFile;
+    Directory *dir;
     FileHeader *fileHdr;
     int sector;
+    int start = kernel->stats->totalTicks;
 
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
+    kernel->journal->Begin();
+    if (!WalkPath(name, &walk, TRUE) || walk.sector == -1) {
+        walk.Done();
+        kernel->journal->End();
+        kernel->stats->AddFsOp(FsRemove, start);
+        return;				// not found
+    }
+    sector = walk.sector;
+    doomed = new Bitmap(freeMap->NumBits());
 
-    OpenFile *dirFile = new OpenFile(sector);
-    Directory *dir = new Directory(NumDirEntries);
-    freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    // note everything below the directory, and the directory itself
+    dirFile = new OpenFile(sector);
+    dir = new Directory(NumDirEntries);
     dir->FetchFrom(dirFile);
-    dir->RecurRemove(freeMap);
+    superblock->numFiles -= 1 + dir->RecurRemove(doomed);
+    delete dir;
+    delete dirFile;
+    fileHdr = kernel->fileTable->Acquire(sector);
+    fileHdr->MarkSectors(doomed, freeMap);
+    doomed->Mark(sector);
+    kernel->fileTable->MarkRemoved(sector);
+    kernel->fileTable->Release(sector);
+
+    for (int i = 0; i < doomed->NumBits(); i++)
+        if (doomed->Test(i))
+            freeMap->Clear(i);
+    delete doomed;
+
+    // take it out of its parent, found (and held) by the walk
+    walk.dir->deactiveEntry(walk.index);
+    walk.dir->WriteBack(walk.dirFile);
+    walk.Done();
+    kernel->dentryCache->Invalidate(name);	// and every path below it
 
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-    fileHdr->Deallocate(freeMap);
-    freeMap->Clear(sector);
     freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    defrag->NoteRemove();
+    kernel->stats->AddFsOp(FsRemove, start);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Snapshot
+// 	Make "to" a snapshot of the file or directory "from": a copy that
+//	only costs its metadata.  Each file below "from" gets a new header
+//	(and index blocks) pointing at the same data sectors, which the
+//	bitmap now counts as shared, and each directory a new directory
+//	holding the snapshots of its entries.  From then on the two are
+//	independent: the first write to a shared sector, by either of
+//	them, gives the writer a copy of its own (see OpenFile::WriteAt),
+//	and removing either one only drops the counts of the sectors the
+//	other still holds.
+//
+//	So a tree can be frozen before a risky run, and rolled back after
+//	it (nachos -rr <tree> -snap <frozen> <tree>), or a test fixture
+//	cloned, by writing headers, index blocks and directories alone.
+//	The snapshot is one journal operation, with the batch to itself;
+//	a large tree fills the batch many times over, so the operation is
+//	committed in pieces as it goes (see Journal::Reserve).  Nothing
+//	names the new headers and directories until the entry for "to" is
+//	written, last, after the bitmap: a crash before then only leaves
+//	sectors marked in use, or counted as shared, that a Check gives
+//	back.  The first snapshot on a disk also makes room for the share
+//	counts in the bitmap's file, which stays made even if the snapshot
+//	fails.
+//
+//	Return FALSE, leaving the disk as it was, if "from" does not exist,
+//	"to" does, a sector has been shared MaxShares times already, or the
+//	disk is too full for the new metadata.
+//
+//	"from" -- the file or directory to take a snapshot of
+//	"to" -- the name of the snapshot
+//----------------------------------------------------------------------
+
+bool
+FileSystem::Snapshot(char *from, char *to)
+{
+    PathWalk walk;
+    ::List<int> *made;
+    int sector, copy;
+    char type;
+    bool success = FALSE;
+    int start = kernel->stats->totalTicks;
 
-    char nameWithOnlyPath[256] = {0};
-    char nameWithOnlyFile[256] = {0};
-    int len = strlen(name), slashIdx, tempIdx = 0;
-    for (int i = len - 1; i >= 0; i--) {
-        if (name[i] == '/') {
-            slashIdx = i;
-            break;
+    DEBUG(dbgFile, "Taking a snapshot of " << from << " as " << to);
+    sector = Lookup(from);
+    type = EntryType(from);
+    if (sector == -1 || type == 0) {
+        kernel->stats->AddFsOp(FsCreate, start);
+        return FALSE;			// nothing to take a snapshot of
+    }
+    kernel->journal->Begin(JournalSlots);	// alone, so Reserve never waits
+    made = new ::List<int>;
+
+    if (WalkPath(to, &walk, TRUE) && walk.sector == -1 &&
+            (freeMapFile->Length() >= freeMap->FileLength() ||
+             freeMapFile->Extend(freeMap, freeMap->FileLength()))) {
+        copy = SnapshotEntry(sector, type, walk.dirSector, made);
+        success = (copy >= 0 && walk.dir->Add(walk.leaf, copy, type) &&
+                   walk.dir->Reserve(walk.dirFile, freeMap));
+    }
+    if (!success) {
+        // give back the headers made so far, and what they hold
+        while (!made->IsEmpty()) {
+            int hdrSector = made->RemoveFront();
+            FileHeader *hdr = kernel->fileTable->Acquire(hdrSector);
+            hdr->Deallocate(freeMap);
+            freeMap->Clear(hdrSector);
+            kernel->fileTable->MarkRemoved(hdrSector);
+            kernel->fileTable->Release(hdrSector);
         }
     }
-    for (int i = 0; i < slashIdx; i++)
-        nameWithOnlyPath[i] = name[i];
-    for (int i = slashIdx + 1; i < len; i++)
-        nameWithOnlyFile[tempIdx++] = name[i];
-    if (nameWithOnlyPath[0] != 0) {
-        int upperDirSector = directory->Find(nameWithOnlyPath);
-        OpenFile *upperDirFile = new OpenFile(upperDirSector);
-        Directory *upperDir = new Directory(NumDirEntries);
-        upperDir->FetchFrom(upperDirFile);
-        int idx = upperDir->FindIndex(nameWithOnlyFile);
-        upperDir->deactiveEntry(idx);
-        upperDir->WriteBack(upperDirFile);
-        delete upperDirFile;
-        delete upperDir;
+    freeMap->WriteBack(freeMapFile);
+    kernel->fileTable->WriteBack(FreeMapSector);	// if it grew
+    if (success) {
+        walk.dir->WriteBack(walk.dirFile);	// names the snapshot
+        superblock->numFiles += made->NumInList();
+    }
+    delete made;
+    walk.Done();
+    if (success)
+        kernel->dentryCache->Invalidate(to);
+    kernel->journal->End();
+    kernel->stats->AddFsOp(FsCreate, start);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SnapshotEntry
+// 	Take a snapshot of the file or directory whose header is at
+//	"sector": a new header, near "goal", that shares a file's data
+//	sectors (see FileHeader::Share), or a new directory holding a
+//	snapshot of each entry of a directory.  The file is held while
+//	its header is copied, so no write is half done -- for writing, so
+//	that the data waiting for delayed allocation can get its sectors
+//	first.
+//	The new headers are written, and appended to "made", for the
+//	caller to give back if the snapshot fails.  Return the new
+//	header's sector, or -1 if the snapshot could not be made.
+//
+//	"type" -- 'F' for a file, 'D' for a directory
+//----------------------------------------------------------------------
+
+int
+FileSystem::SnapshotEntry(int sector, char type, int goal, ::List<int> *made)
+{
+    FileHeader *copy;
+    int copySector;
+    bool shared = TRUE;
+
+    if (type == 'D')
+        goal = freeMap->EmptiestGroup(goal);
+    copySector = freeMap->FindAndSetNear(goal);
+    if (copySector == -1)
+        return -1;			// no free block for the header
+    kernel->frameAllocator->ForgetImage(copySector);
+    copy = new FileHeader;
+    if (type == 'D') {
+        copy->Allocate(freeMap, 0, layout, copySector + 1);
     } else {
-        int idx = directory->FindIndex(nameWithOnlyFile);
-        directory->deactiveEntry(idx);
-        directory->WriteBack(directoryFile);
+        FileHeader *hdr = kernel->fileTable->Acquire(sector);
+        RWLock *rwLock = kernel->fileTable->LockOf(sector);
+        rwLock->AcquireWrite();
+        if (hdr->HasDelayed()) {
+            hdr->AllocateDelayed(freeMap, sector + 1);
+            kernel->fileTable->MarkDirty(sector);
+        }
+        shared = hdr->Share(freeMap, copy);
+        rwLock->ReleaseWrite();
+        kernel->fileTable->Release(sector);
     }
+    if (!shared) {
+        freeMap->Clear(copySector);
+        delete copy;
+        return -1;
+    }
+    copy->WriteBack(copySector);
+    made->Append(copySector);
+    delete copy;
+    if (type == 'D' && !SnapshotDirectory(sector, copySector, made))
+        return -1;
+    return copySector;
+}
 
-    delete fileHdr;
-    delete freeMap;
-    delete directory;
-    delete dirFile;
+//----------------------------------------------------------------------
+// FileSystem::SnapshotDirectory
+// 	Fill the empty directory whose header is at "copy" with a
+//	snapshot of each entry of the directory at "sector", under the
+//	same names.  Return FALSE if one of them could not be made, or
+//	the new directory could not grow to hold them.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::SnapshotDirectory(int sector, int copy, ::List<int> *made)
+{
+    OpenFile *dirFile = new OpenFile(sector);
+    OpenFile *copyFile = new OpenFile(copy);
+    Directory *dir = new Directory(NumDirEntries);
+    Directory *copyDir = new Directory(NumDirEntries);
+    bool success = TRUE;
+
+    dir->FetchFrom(dirFile);
+    for (int i = 0; i < dir->tableSize && success; i++) {
+        DirectoryEntry *entry = &dir->table[i];
+        if (!entry->inUse || entry->type == IndexType)
+            continue;			// the copy gets an index of its own
+        int child = SnapshotEntry(entry->sector, entry->type, copy, made);
+        if (child == -1)
+            success = FALSE;
+        else
+            copyDir->AddEntry(entry->name, child, entry->type);
+    }
+    if (success && copyDir->Reserve(copyFile, freeMap))
+        copyDir->WriteBack(copyFile);
+    else
+        success = FALSE;
+    delete copyDir;
     delete dir;
+    delete copyFile;
+    delete dirFile;
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StartDedup
+// 	Turn on the dedup mode: from now on, until Nachos halts, a data
+//	sector that is about to be written with the same bytes as a sector
+//	already on disk shares that sector instead, as a snapshot would
+//	(see OpenFile::WriteAt).  The sectors written are found by a hash
+//	of their contents, which the bitmap keeps for each (see pbitmap.h),
+//	so that a test fixture copied to a dozen names takes the disk
+//	space, and the writes, of one copy.
+//
+//	Only the sectors written in the mode are noted, and only whole
+//	sectors match.  The first time on a disk, this makes room for the
+//	hashes in the bitmap's file.  Return FALSE, leaving the mode off,
+//	if there is no room for them, or the disk has extent-based headers
+//	(whose files would split an extent around every shared sector), or
+//	blocks of several sectors (of which only whole ones are moved).
+//----------------------------------------------------------------------
+
+bool
+FileSystem::StartDedup()
+{
+    bool success;
+
+    if (layout != IndexLayout)
+        return FALSE;
+    kernel->journal->Begin(JournalSlots);	// alone, so Reserve never waits
+    success = (freeMapFile->Length() >= freeMap->IndexLength() ||
+               freeMapFile->Extend(freeMap, freeMap->IndexLength()));
+    freeMap->WriteBack(freeMapFile);
+    kernel->fileTable->WriteBack(FreeMapSector);	// if it grew
+    kernel->journal->End();
+    dedup = success;
+    return success;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::StartDelayedAllocation
+// 	Turn on the delayed allocation mode: from now on, until Nachos
+//	halts, what is written past the last data sector of a file is
+//	kept in its in-core header, and only the number of sectors it
+//	needs is reserved (see FileHeader::DelayWrite).  The sectors are
+//	chosen as the data is written out -- by the write-behind pass of
+//	the buffer cache, a sync of the file or of the file system, or
+//	the last close -- all of a file's at once, so that a file that
+//	grows a little at a time, while other files grow too, still gets
+//	them in one run.  Data that was never written out is not on disk
+//	if Nachos stops without halting.
+//----------------------------------------------------------------------
+
+void
+FileSystem::StartDelayedAllocation()
+{
+    delayAlloc = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::EntryType
+// 	Return 'F' if the absolute path "name" is a file, 'D' if it is a
+//	directory, or 0 if there is no such file.
+//----------------------------------------------------------------------
+
+char
+FileSystem::EntryType(char *name)
+{
+    PathWalk walk;
+
+    if (strcmp(name, "/") == 0)
+        return 'D';
+    if (!WalkPath(name, &walk, FALSE) || walk.index == -1)
+        return 0;
+    return walk.dir->table[walk.index].type;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Remove
+// 	Delete a file from the file system.  This requires:
+//	    Remove it from the directory
+//	    Delete the space for its header
+//	    Delete the space for its data blocks
+//	    Write changes to directory back to disk
+//
+//	Return TRUE if the file was deleted, FALSE if the file wasn't
+//	in the file system.
+//
+//	"name" -- the text name of the file to be removed
+//----------------------------------------------------------------------
+
 bool
 FileSystem::Remove(char *name)
 {
-    Directory *directory;
-    PersistentBitmap *freeMap;
+    PathWalk walk;
     FileHeader *fileHdr;
     int sector;
+    int start = kernel->stats->totalTicks;
 
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-    if (sector == -1) {
-       delete directory;
-       return FALSE;			 // file not found
+    kernel->journal->Begin();
+    if (!WalkPath(name, &walk, TRUE) || walk.sector == -1) {
+        walk.Done();
+        kernel->journal->End();
+        kernel->stats->AddFsOp(FsRemove, start);
+        return FALSE;			 // file not found
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-
-    freeMap = new PersistentBitmap(freeMapFile,NumSectors);
+    sector = walk.sector;
+    fileHdr = kernel->fileTable->Acquire(sector);
 
     fileHdr->Deallocate(freeMap);  		// remove data blocks
     freeMap->Clear(sector);			// remove header block
-    if (!directory->Remove(name))
-        printf("Failed to delete file %s\n", name);
+    kernel->fileTable->MarkRemoved(sector);	// never write it back
+    kernel->fileTable->Release(sector);
+    walk.dir->Remove(walk.leaf);
+    superblock->numFiles--;
 
-    freeMap->WriteBack(freeMapFile);		// flush to disk
-    directory->WriteBack(directoryFile);        // flush to disk
-    delete fileHdr;
-    delete directory;
-    delete freeMap;
+    walk.dir->WriteBack(walk.dirFile);		// flush to disk
+    walk.Done();
+    kernel->dentryCache->Invalidate(name);
+    freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    defrag->NoteRemove();
+    kernel->stats->AddFsOp(FsRemove, start);
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Rename
+// 	Give the file or directory "from" the name "to", in the same
+//	directory or another: its entry moves, and nothing else -- the
+//	header, the data, and a directory's whole tree stay where they
+//	are, and files open under the old name stay open.  Only the one
+//	or two directories changed are written (see Directory::WriteBack),
+//	as one journal operation, so after a crash the file is under one
+//	name or the other, never both or neither.
+//
+//	Both parents are held for update from when they are read until
+//	both are written.  Renames between two directories also hold
+//	"renameLock" throughout, so that two of them, each holding one
+//	parent, never wait for each other's; nothing else holds two
+//	directories for update.
+//
+//	Return FALSE, changing nothing, if "from" does not exist, "to"
+//	does, the parent of "to" does not, a directory would be moved
+//	into its own tree, or the parent of "to" is full.
+//
+//	"from" -- the text name of the file or directory to move
+//	"to" -- its new name
+//----------------------------------------------------------------------
+
+bool
+FileSystem::Rename(char *from, char *to)
+{
+    PathWalk fromWalk, toWalk;
+    PathWalk *target = &toWalk;		// the walk to the parent of "to"
+    char *leaf;				// the last component of "to"
+    char *fromSlash = strrchr(from, '/');
+    char *toSlash = strrchr(to, '/');
+    int fromLen = (fromSlash != NULL) ? fromSlash - from : 0;
+    int toLen = (toSlash != NULL) ? toSlash - to : 0;
+    bool sameParent = (fromLen == toLen && strncmp(from, to, fromLen) == 0);
+    bool success = FALSE;
+    int sector;
+    char type;
+
+    DEBUG(dbgFile, "Renaming " << from << " to " << to);
+    if (strncmp(to, from, strlen(from)) == 0 && to[strlen(from)] == '/')
+        return FALSE;			// into its own tree
+    kernel->journal->Begin();
+    if (!sameParent)
+        renameLock->Acquire();
+    if (WalkPath(from, &fromWalk, TRUE) && fromWalk.sector != -1) {
+        sector = fromWalk.sector;
+        type = fromWalk.dir->table[fromWalk.index].type;
+        if (sameParent) {
+            target = &fromWalk;
+            leaf = (toSlash != NULL) ? toSlash + 1 : to;
+            success = (leaf[0] != '\0');
+        } else {
+            success = WalkPath(to, &toWalk, TRUE);
+            leaf = toWalk.leaf;
+        }
+        // the new entry first: if it cannot be made, nothing has
+        // changed yet
+        success = (success && target->dir->Add(leaf, sector, type) &&
+                   target->dir->Reserve(target->dirFile, freeMap));
+    }
+    if (success) {
+        fromWalk.dir->Remove(fromWalk.leaf);
+        fromWalk.dir->WriteBack(fromWalk.dirFile);
+        if (target != &fromWalk)
+            toWalk.dir->WriteBack(toWalk.dirFile);
+        freeMap->WriteBack(freeMapFile);	// if a directory grew
+    }
+    toWalk.Done();
+    fromWalk.Done();
+    if (success) {
+        kernel->dentryCache->Invalidate(from);	// and every path below it
+        kernel->dentryCache->Invalidate(to);
+    }
+    if (!sameParent)
+        renameLock->Release();
+    kernel->journal->End();
+    return success;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::List
 // 	List all the files in the file system directory.
@@ -436,40 +1222,84 @@ FileSystem::List(char *listDirectoryName)
         directory->List();
         delete directory;
     } else {
-        Directory *directory = new Directory(NumDirEntries);
-        directory->FetchFrom(directoryFile);
-        int targetSector = directory->Find(listDirectoryName);
+        int targetSector = Lookup(listDirectoryName);
         OpenFile *dirFile = new OpenFile(targetSector);
         Directory *dir = new Directory(NumDirEntries);
         dir->FetchFrom(dirFile);
         dir->List();
-        delete directory;
         delete dirFile;
         delete dir;
     }
 }
 
 void FileSystem::recurList(char *listDirectoryName) {
+    WorkerPool *walkers = new WorkerPool("tree walker", NumTreeWalkers,
+					 NumDirEntries);
+
     if (strlen(listDirectoryName) == 1) {
         Directory *directory = new Directory(NumDirEntries);
         directory->FetchFrom(directoryFile);
-        directory->recurList(0);
+        directory->recurList(0, walkers);
         delete directory;
     } else {
-        Directory *directory = new Directory(NumDirEntries);
-        directory->FetchFrom(directoryFile);
-        int targetSector = directory->Find(listDirectoryName);
+        int targetSector = Lookup(listDirectoryName);
         OpenFile *dirFile = new OpenFile(targetSector);
         Directory *dir = new Directory(NumDirEntries);
         dir->FetchFrom(dirFile);
-        dir->recurList(0);
-        delete directory;
+        dir->recurList(0, walkers);
         delete dirFile;
         delete dir;
     }
+    delete walkers;
 }
 
 
+//----------------------------------------------------------------------
+// FileSystem::ReadDir
+// 	Copy up to "count" of the entries of the directory "name" into
+//	"entries", from byte "*cursor" of its records on, with the length
+//	of each one's file in "sizes", and leave "*cursor" at the record
+//	after the last one copied, for the next call to go on from.
+//	Return how many were copied -- 0 once there are no more -- or -1
+//	if "name" is not a directory.
+//
+//	Each call reads only the sectors of the records it goes through,
+//	through the buffer cache (see Directory::ReadEntries), so listing
+//	a large directory reads it once in all.  An entry that is there
+//	for the whole listing is returned once; one added or removed in
+//	between may or may not be.
+//
+//	"name" -- the absolute path of the directory
+//	"cursor" -- where to start in its records, 0 at first
+//	"entries", "sizes" -- where to put at least "count" entries
+//----------------------------------------------------------------------
+
+int
+FileSystem::ReadDir(char *name, int *cursor, DirectoryEntry *entries,
+                    int *sizes, int count)
+{
+    int sector = Lookup(name);
+    OpenFile *dirFile;
+    int n;
+
+    if (sector == -1 || EntryType(name) != 'D' || *cursor < 0 ||
+            (*cursor % RecordAlign) != 0)
+        return -1;
+    if (sector == DirectorySector)
+        dirFile = directoryFile;
+    else
+        dirFile = new OpenFile(sector);
+    n = Directory::ReadEntries(dirFile, cursor, entries, count);
+    Directory::PrefetchHeaders(entries, n);	// for the sizes
+    for (int i = 0; i < n; i++) {
+        sizes[i] = kernel->fileTable->Acquire(entries[i].sector)->FileLength();
+        kernel->fileTable->Release(entries[i].sector);
+    }
+    if (dirFile != directoryFile)
+        delete dirFile;
+    return n;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Print
 // 	Print everything about the file system:
@@ -483,28 +1313,137 @@ void FileSystem::recurList(char *listDirectoryName) {
 void
 FileSystem::Print()
 {
-    FileHeader *bitHdr = new FileHeader;
-    FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile,NumSectors);
     Directory *directory = new Directory(NumDirEntries);
 
+    superblock->numFree = freeMap->NumClear();	// as it is now
+    superblock->Print();
+
     printf("Bit map file header:\n");
-    bitHdr->FetchFrom(FreeMapSector);
-    bitHdr->Print();
+    kernel->fileTable->Acquire(FreeMapSector)->Print();
+    kernel->fileTable->Release(FreeMapSector);
 
     printf("Directory file header:\n");
-    dirHdr->FetchFrom(DirectorySector);
-    dirHdr->Print();
+    kernel->fileTable->Acquire(DirectorySector)->Print();
+    kernel->fileTable->Release(DirectorySector);
 
     freeMap->Print();
 
     directory->FetchFrom(directoryFile);
     directory->Print();
 
-    delete bitHdr;
-    delete dirHdr;
-    delete freeMap;
     delete directory;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Check that the bitmap agrees with the files that can be reached
+//	from the root directory, and report where it does not (see
+//	fsck.h).  If "repair" is set, fix the bitmap.  Return TRUE if
+//	nothing was wrong.  The files found are the superblock's count
+//	from then on.
+//----------------------------------------------------------------------
+
+bool
+FileSystem::Check(bool repair)
+{
+    Fsck *fsck = new Fsck(freeMap);
+    bool consistent;
+
+    kernel->journal->Begin(JournalSlots);	// alone, so Reserve never waits
+    consistent = fsck->Check(repair);
+    superblock->numFiles = fsck->NumEntries();
+    if (repair)
+        freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    delete fsck;
+    return consistent;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Defragment
+// 	Move each fragmented file to a single run of sectors, printing
+//	how fragmented the files were before and after.  Return the
+//	number of files moved.
+//----------------------------------------------------------------------
+
+int
+FileSystem::Defragment()
+{
+    return defrag->Pass(TRUE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StartDefragmenter
+// 	Fork a thread that defragments the files in the background, after
+//	every "removes" files removed.
+//----------------------------------------------------------------------
+
+void
+FileSystem::StartDefragmenter(int removes)
+{
+    defrag->Start(removes);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Give the data waiting for delayed allocation its sectors, then
+//	write back the parts of the in-memory bitmap that changed and the
+//	file headers -- each its own journal operation, as there may be
+//	more headers than one batch holds -- commit them and whatever
+//	else the journal holds, and then write every dirty sector in the
+//	buffer cache, so the disk holds the current state of the file
+//	system.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Sync()
+{
+    DEBUG(dbgFile, "Syncing the file system.");
+    kernel->fileTable->AllocateDelayed();
+    kernel->journal->Begin(JournalSlots);	// alone, so Reserve never waits
+    freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    kernel->fileTable->Sync();		// an operation for each header
+    kernel->journal->Commit();
+    kernel->bufferCache->Flush();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Mount
+// 	Finish mounting the disk, once the kernel can reach the file
+//	system.  If it was not unmounted cleanly, check it, repairing the
+//	bitmap, and so counting its files again.  Then mark the superblock
+//	dirty on disk, until Unmount: if Nachos stops before that, the
+//	next mount checks the disk.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Mount()
+{
+    if (!superblock->clean) {
+        printf("The disk was not unmounted cleanly\n");
+        Check(TRUE);
+    }
+    superblock->clean = FALSE;
+    superblock->WriteBack();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Unmount
+// 	Write everything back (see Sync), then the superblock, with the
+//	count of free sectors and files as they are now, marked clean, so
+//	that the next mount can trust it, and a checkpoint of the log, if
+//	the volume is kept as one.  Called as Nachos halts.
+//----------------------------------------------------------------------
+
+void
+FileSystem::Unmount()
+{
+    Sync();
+    superblock->numFree = freeMap->NumClear();
+    superblock->clean = TRUE;
+    superblock->WriteBack();
+    kernel->synchDisk->Checkpoint();
+}
+
 #endif // FILESYS_STUB
@@ -36,6 +36,8 @@
 #include "copyright.h"
 #include "sysdep.h"
 #include "openfile.h"
+#include "pbitmap.h"
+#include "list.h"
 
 #ifdef FILESYS_STUB 		// Temporarily implement file system calls as
 				// calls to UNIX, until the real file system
@@ -66,19 +68,63 @@ class FileSystem {
 };
 
 #else // FILESYS
+
+// Sectors containing the file headers for the bitmap of free sectors,
+// and the directory of files.  These file headers are placed in well-known
+// sectors, so that they can be located on boot-up.
+#define FreeMapSector 		0
+#define DirectorySector 	1
+
+class Defragmenter;
+class Superblock;
+class Directory;
+class Lock;
+class DirectoryEntry;
+
+// The following class defines the result of walking a path: the
+// directory that holds its last component, fetched into memory, and
+// where that component is in it, if it is there.  Made on the stack,
+// it gives the directory back (and ends the update on it, if it was
+// held for one) as it goes out of scope, or at Done, if sooner.
+
+class PathWalk {
+  public:
+    PathWalk();				// Nothing walked yet
+    ~PathWalk() { Done(); }
+
+    void Done();			// Give back the parent directory
+
+    OpenFile *dirFile;			// the parent directory's file
+    Directory *dir;			// and its contents
+    int dirSector;			// the sector of its header
+    char *leaf;				// the last component of the path
+    int index;				// the leaf's entry in "dir", or -1
+					// if it is not there
+    int sector;				// the leaf's header, or -1
+
+  private:
+    friend class FileSystem;
+
+    bool ownFile;			// "dirFile" is deleted by Done
+    bool updating;			// "dirFile" is held for update
+};
+
 class FileSystem {
   public:
-    FileSystem(bool format);		// Initialize the file system.
+    FileSystem(bool format, int layout);
+					// Initialize the file system.
 					// Must be called *after* "synchDisk"
 					// has been initialized.
     					// If "format", there is nothing on
 					// the disk, so initialize the directory
-    					// and the bitmap of free blocks.
+    					// and the bitmap of free blocks, and
+					// give new files "layout".
 	// MP4 mod tag
 	~FileSystem();
 
-    bool Create(char *name, int initialSize);
-					// Create a file (UNIX creat)
+    bool Create(char *name, int initialSize, bool compressed = FALSE);
+					// Create a file (UNIX creat),
+					// compressed a chunk at a time
 
     bool CreateDir(char *name);
 
@@ -92,23 +138,102 @@ class FileSystem {
 
     int Close(int id);
 
+    int Fsync(int id);			// Force an open file, and the
+					// bitmap, out to disk
+    int Seek(int offset, int whence, int id);
+					// Move an open file's position
+    int FileSize(int id);		// Length of an open file
+    int CopyRange(int fromId, int toId, int size);
+					// Copy between two open files
+    int Preallocate(int id, int size, int flags);
+					// Reserve sectors for an open file
+
     bool Remove(char *name);  		// Delete a file (UNIX unlink)
 
     void RecurRemove(char *name);
 
+    bool Rename(char *from, char *to);	// Move a file or directory to a
+					// new name, in the same directory
+					// or another, without copying it
+
+    bool Snapshot(char *from, char *to);// Make "to" a copy of the file or
+					// directory "from" that shares its
+					// data until either is written
+    bool StartDedup();			// Share each data sector written
+					// with one holding the same bytes
+    bool Deduplicating() { return dedup; }
+    void StartDelayedAllocation();	// Give appended data sectors only
+					// as it is written behind
+    bool DelayingAllocation() { return delayAlloc; }
+
     void List(char *listDirectoryName);			// List all the files in the file system
 
     void recurList(char *listDirectoryName);
 
+    int ReadDir(char *name, int *cursor, DirectoryEntry *entries,
+                int *sizes, int count);
+    					// Some of the entries of a
+					// directory, from "*cursor" on
+
     void Print();			// List all the files and their contents
 
+    bool Check(bool repair);		// Check the bitmap against the files,
+					// fixing it if "repair"
+
+    int Defragment();			// Move fragmented files to single
+					// runs; return how many were moved
+    void StartDefragmenter(int removes);// Defragment in the background,
+					// every "removes" files removed
+
+    void Sync();			// Write everything held in memory
+					// back to disk
+    void Mount();			// Check the disk if it was not
+					// unmounted cleanly, and mark it in
+					// use
+    void Unmount();			// Sync, and mark the disk clean
+
+    PersistentBitmap *FreeMap() { return freeMap; }
+    					// The in-memory bit map, for files
+					// that grow as they are written
+    int Layout() { return layout; }	// The header layout of new files
+
   private:
+   bool CreateEntry(char *name, int initialSize, char type,
+                    bool compressed);
+   					// Create a file or a directory
+   int Lookup(char *name);		// Sector of the header of "name",
+					// through the dentry cache
+   bool WalkPath(char *name, PathWalk *walk, bool update);
+   					// Find the directory that holds
+					// "name", and "name" in it
+   int FetchDirectory(int sector, Directory *dir, char *name);
+   					// Read the directory at "sector",
+					// and find "name" in it
+   char EntryType(char *name);		// 'F' or 'D', or 0 if not found
+   int SnapshotEntry(int sector, char type, int goal, ::List<int> *made);
+					// Snapshot the file or directory at
+					// "sector"; the new header's sector
+   bool SnapshotDirectory(int sector, int copy, ::List<int> *made);
+					// Fill the new directory at "copy"
+					// with snapshots of the entries of
+					// the one at "sector"
+
    OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
+   PersistentBitmap *freeMap;		// In-memory copy of the bit map,
+					// written back by Sync
    OpenFile* directoryFile;		// "Root" directory -- list of
 					// file names, represented as a file
-   OpenFile* openFile;
-                    // only need one openFile because spec says there's only a open file at the same time.
+   int layout;				// File header layout of new files,
+					// chosen when the disk was formatted,
+					// with the block size (see BlockFlag)
+   Superblock *superblock;		// How the disk is laid out, and how
+					// many files and free sectors it has
+   Defragmenter *defrag;		// Moves fragmented files to runs
+   bool dedup;				// In the dedup mode?
+   bool delayAlloc;			// In the delayed allocation mode?
+   Lock *renameLock;			// Held by each rename between two
+					// directories
 };
 
 #endif // FILESYS
@@ -0,0 +1,269 @@
+// fsck.cc
+//	Routines to check the consistency of the file system, and repair
+//	its bitmap.
+//
+//	Problems are printed as they are found; runs of consecutive
+//	sectors with the same problem are printed as one line.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fsck.h"
+#include "filehdr.h"
+#include "directory.h"
+#include "filesys.h"
+#include "journal.h"
+#include "superblock.h"
+#include "bufcache.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Fsck::Fsck
+// 	Set up a check of the disk against "freeMap", the in-memory copy
+//	of the bitmap.
+//----------------------------------------------------------------------
+
+Fsck::Fsck(PersistentBitmap *freeMap)
+{
+    this->freeMap = freeMap;
+    numSectors = freeMap->NumBits();
+    image = new char[numSectors * SectorSize];
+    owner = new int[numSectors];
+    holders = new int[numSectors];
+    path = new char *[numSectors];
+    for (int i = 0; i < numSectors; i++) {
+	owner[i] = -1;
+	holders[i] = 0;
+	path[i] = NULL;
+    }
+    data = new int[MaxFileSectors];
+    index = new int[MaxFileSectors];
+    numFiles = numDirs = numUsed = 0;
+    numLeaked = numUnmarked = numShared = numMiscounted = numBad = 0;
+}
+
+//----------------------------------------------------------------------
+// Fsck::~Fsck
+//----------------------------------------------------------------------
+
+Fsck::~Fsck()
+{
+    for (int i = 0; i < numSectors; i++)
+	delete [] path[i];
+    delete [] path;
+    delete [] owner;
+    delete [] holders;
+    delete [] image;
+    delete [] data;
+    delete [] index;
+}
+
+//----------------------------------------------------------------------
+// Fsck::Check
+// 	Read the disk, in one pass, claim the sectors of the journal, the
+//	superblock, the bitmap and every file reachable from the root directory, and
+//	compare the result with the bitmap.  Reads go through the buffer
+//	cache, so sectors not yet written back are seen as they are now.
+//
+//	"repair" -- fix the bitmap, instead of only reporting
+//----------------------------------------------------------------------
+
+bool
+Fsck::Check(bool repair)
+{
+    printf("Checking the file system\n");
+    for (int s = 0; s < numSectors; s += SectorsPerTrack)
+	kernel->bufferCache->ReadSectors(s, SectorsPerTrack,
+					 &image[s * SectorSize]);
+
+    path[JournalSector] = new char[sizeof("(journal)")];
+    strcpy(path[JournalSector], "(journal)");
+    for (int i = 0; i < JournalSectors; i++)
+	Claim(JournalSector + i, JournalSector);
+    path[SuperblockSector] = new char[sizeof("(superblock)")];
+    strcpy(path[SuperblockSector], "(superblock)");
+    Claim(SuperblockSector, SuperblockSector);
+    CheckFile(FreeMapSector, "(bitmap)", 'F');
+    CheckFile(DirectorySector, "/", 'D');
+    CheckBitmap(repair);
+
+    printf("%d files, %d directories, %d sectors in use\n",
+	   numFiles, numDirs, numUsed);
+    printf("%d leaked, %d marked free, %d held twice, %d damaged%s\n",
+	   numLeaked, numUnmarked, numShared, numBad,
+	   (repair && numLeaked + numUnmarked + numMiscounted > 0) ?
+	   "; bitmap repaired" : "");
+    if (numMiscounted > 0)
+	printf("%d share counts too high\n", numMiscounted);
+    return numLeaked + numUnmarked + numShared + numMiscounted + numBad == 0;
+}
+
+//----------------------------------------------------------------------
+// Fsck::Claim
+// 	Note that "sector" belongs to the file whose header is at
+//	"header".  Return FALSE, after reporting it, if the sector is not
+//	on the disk or already belongs to a file -- as many files as the
+//	bitmap says share it.
+//----------------------------------------------------------------------
+
+bool
+Fsck::Claim(int sector, int header)
+{
+    if (sector < 0 || sector >= numSectors) {
+	printf("%s: sector %d is not on the disk\n", path[header], sector);
+	numBad++;
+	return FALSE;
+    }
+    if (owner[sector] >= 0 && holders[sector] <= freeMap->Shares(sector)) {
+	holders[sector]++;			// shared with a snapshot
+	return TRUE;
+    }
+    if (owner[sector] >= 0) {
+	printf("Sector %d is held by both %s and %s\n", sector,
+	       path[owner[sector]], path[header]);
+	numShared++;
+	return FALSE;
+    }
+    owner[sector] = header;
+    holders[sector] = 1;
+    numUsed++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Fsck::CheckFile
+// 	Claim the header of the file "name", at "sector", and the index
+//	blocks and data sectors it lists.  A directory's entries are then
+//	checked in turn.  A header that is already held by another file,
+//	or is plainly garbage, is not looked into.
+//
+//	"sector" -- where the file's header is
+//	"name" -- the path name of the file
+//	"type" -- 'F' for a file, 'D' for a directory, IndexType for the
+//		index of one, which is neither
+//----------------------------------------------------------------------
+
+void
+Fsck::CheckFile(int sector, char *name, char type)
+{
+    FileHeader *hdr;
+    int numData, numIndex;
+
+    if (sector >= 0 && sector < numSectors && path[sector] == NULL) {
+	path[sector] = new char[strlen(name) + 1];
+	strcpy(path[sector], name);
+    }
+    if (sector < 0 || sector >= numSectors) {
+	printf("%s: header sector %d is not on the disk\n", name, sector);
+	numBad++;
+	return;
+    }
+    if (!Claim(sector, sector))
+	return;
+
+    hdr = new FileHeader;
+    hdr->Unpack(&image[sector * SectorSize]);
+    if ((hdr->Layout() != IndexLayout && hdr->Layout() != ExtentLayout) ||
+	    hdr->BlockSectors() > (1 << MaxBlockShift) ||
+	    hdr->FileLength() < 0 || hdr->FileLength() > MaxFileSize) {
+	printf("%s: header at sector %d is damaged\n", name, sector);
+	numBad++;
+	delete hdr;
+	return;
+    }
+    if (type == 'D')
+	numDirs++;
+    else if (type != IndexType)
+	numFiles++;
+
+    numData = hdr->ListSectors(image, data, index, &numIndex);
+    for (int i = 0; i < numIndex; i++)
+	Claim(index[i], sector);
+    for (int i = 0; i < numData; i++)
+	if (data[i] >= 0)
+	    Claim(data[i], sector);
+
+    if (type == 'D') {
+	int length = hdr->FileLength();
+	char *contents = new char[length + 1];	// never 0 bytes
+	char *child = new char[strlen(name) + FileNameMaxLen + 2];
+
+	// copy the directory out of "image" before "data" is reused
+	if (hdr->IsInline()) {
+	    hdr->ReadInline(contents, length, 0);
+	} else {
+	    bzero(contents, length);
+	    for (int i = 0; i < numData && i * SectorSize < length; i++)
+		if (data[i] >= 0 && data[i] < numSectors &&
+			i < hdr->HighWater())
+		    bcopy(&image[data[i] * SectorSize],
+			  &contents[i * SectorSize],
+			  min(SectorSize, length - i * SectorSize));
+	}
+	Directory *dir = new Directory(NumDirEntries);
+	if (!dir->Unpack(contents, length)) {
+	    printf("%s: directory records are damaged\n", name);
+	    numBad++;
+	}
+	delete [] contents;
+	for (int i = 0; i < dir->tableSize; i++) {
+	    DirectoryEntry *entry = &dir->table[i];
+	    if (!entry->inUse)
+		continue;
+	    sprintf(child, "%s%s%s", name, strcmp(name, "/") ? "/" : "",
+		    (entry->type == IndexType) ? "(index)" : entry->name);
+	    CheckFile(entry->sector, child, entry->type);
+	}
+	delete [] child;
+	delete dir;
+    }
+    delete hdr;
+}
+
+//----------------------------------------------------------------------
+// Fsck::CheckBitmap
+// 	Compare the sectors claimed with the ones the bitmap marks in
+//	use, reporting each run of sectors where they disagree, and, if
+//	"repair" is set, fixing the bitmap.  The share counts are checked
+//	(and fixed) first, so that a leaked sector is really freed.
+//----------------------------------------------------------------------
+
+void
+Fsck::CheckBitmap(bool repair)
+{
+    for (int s = 0; s < numSectors; s++) {
+	int extra = max(holders[s] - 1, 0);
+	if (freeMap->Shares(s) == extra)
+	    continue;
+	printf("Sector %d is counted as shared by %d more files, but %d "
+	       "hold it\n", s, freeMap->Shares(s), holders[s]);
+	numMiscounted++;
+	if (repair)
+	    freeMap->SetShares(s, extra);
+    }
+    for (int s = 0; s < numSectors; ) {
+	bool held = (owner[s] >= 0);
+	if (held == freeMap->Test(s)) {
+	    s++;
+	    continue;
+	}
+	int first = s;
+	for (; s < numSectors && (owner[s] >= 0) == held &&
+		freeMap->Test(s) != held; s++) {
+	    if (repair && held)
+		freeMap->Mark(s);
+	    else if (repair)
+		freeMap->Clear(s);
+	}
+	printf("Sectors %d-%d ", first, s - 1);
+	if (held) {
+	    printf("are held by %s, but marked free\n", path[owner[first]]);
+	    numUnmarked += s - first;
+	} else {
+	    printf("are marked in use, but no file holds them\n");
+	    numLeaked += s - first;
+	}
+    }
+}
@@ -0,0 +1,73 @@
+// fsck.h
+//	Data structures for checking the consistency of the file system,
+//	in the manner of UNIX fsck.
+//
+//	The checker reads the whole disk once, in order, with multi-sector
+//	requests, and does everything else on that copy in memory.  From
+//	the bitmap's and the root directory's headers it finds every file
+//	that can be reached, and notes which file each of its headers,
+//	index blocks and data sectors belongs to.  The result is compared
+//	with the bitmap: a sector marked in use that no file holds has
+//	leaked, and a sector some file holds but that is marked free will
+//	be handed out again.  Both can be repaired by fixing the bitmap.
+//	A sector held by two files cannot; it is only reported -- unless
+//	the bitmap counts it as shared with a snapshot.  A share count
+//	higher than the files holding the sector is repaired too.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FSCK_H
+#define FSCK_H
+
+class PersistentBitmap;
+
+// The following class defines the consistency checker.
+
+class Fsck {
+  public:
+    Fsck(PersistentBitmap *freeMap);	// Check the disk against "freeMap"
+    ~Fsck();
+
+    bool Check(bool repair);		// Check, fixing "freeMap" if
+					// "repair"; TRUE if all was well
+    int NumEntries() { return numFiles + numDirs - 2; }
+    					// Files and directories found,
+					// besides the bitmap and the root
+
+  private:
+    void CheckFile(int sector, char *name, char type);
+    					// Claim the sectors of the file whose
+					// header is at "sector", and those of
+					// its entries if it is a directory
+    bool Claim(int sector, int header);	// Note that "sector" belongs to
+					// the file whose header is "header"
+    void CheckBitmap(bool repair);	// Compare what was claimed with
+					// the bitmap
+
+    PersistentBitmap *freeMap;		// The bitmap being checked
+    int numSectors;			// Sectors on the disk it covers
+    char *image;			// A copy of the whole disk
+    int *owner;				// For each sector, the header of the
+					// file holding it, or -1
+    int *holders;			// and how many files hold it
+    char **path;			// For each header sector, the name
+					// of its file
+    int *data;				// Scratch space for the data sectors
+    int *index;				// and index blocks of one file
+
+    int numFiles;			// Files found
+    int numDirs;			// Directories found
+    int numUsed;			// Sectors held by some file
+    int numLeaked;			// Marked in use, held by no file
+    int numUnmarked;			// Held by a file, marked free
+    int numShared;			// Held by two files
+    int numMiscounted;			// Shared by fewer than counted
+    int numBad;				// Damaged headers and directory
+					// entries, and sectors off the disk
+};
+
+#endif // FSCK_H
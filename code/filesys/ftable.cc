@@ -0,0 +1,335 @@
+// ftable.cc
+//	Routines to manage the table of in-core file headers.
+//
+//	The table is a short list of entries, one per file that is open,
+//	each holding the file's shared header and the number of users
+//	of it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "ftable.h"
+#include "filehdr.h"
+#include "journal.h"
+#include "synch.h"
+#include "main.h"
+#include "slab.h"
+
+static SlabCache entryCache("file table entries", sizeof(FileTableEntry));
+
+//----------------------------------------------------------------------
+// FileTableEntry::operator new, FileTableEntry::operator delete
+// 	Allocate an entry from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+FileTableEntry::operator new(size_t size)
+{
+    ASSERT(size == sizeof(FileTableEntry));
+    return entryCache.Alloc();
+}
+
+void
+FileTableEntry::operator delete(void *object)
+{
+    entryCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// FileTable::FileTable
+// 	Initialize an empty table of file headers.
+//----------------------------------------------------------------------
+
+FileTable::FileTable()
+{
+    entries = new IntrusiveList<FileTableEntry>;
+    lock = new Lock("file table lock");
+    readDone = new Condition("file table header read");
+    numHits = numMisses = numEvictions = 0;
+}
+
+//----------------------------------------------------------------------
+// FileTable::~FileTable
+// 	De-allocate the table.  Headers still held at shutdown are
+//	simply dropped; the last sync wrote them back.
+//----------------------------------------------------------------------
+
+FileTable::~FileTable()
+{
+    while (!entries->IsEmpty()) {
+	FileTableEntry *e = entries->RemoveFront();
+	delete e->hdr;
+	delete e->rwLock;
+	delete e;
+    }
+    delete entries;
+    delete lock;
+    delete readDone;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Find
+// 	Return the entry for the header at "sector", or NULL if no one
+//	holds it.
+//----------------------------------------------------------------------
+
+FileTableEntry *
+FileTable::Find(int sector)
+{
+    for (FileTableEntry *e = entries->Front(); e != NULL; e = entries->Next(e))
+	if (e->sector == sector)
+	    return e;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Acquire
+// 	Return the in-core header for the file whose header is at
+//	"sector", shared with everyone else holding it.  The header is
+//	read from disk only if no one holds it yet.  Each Acquire must
+//	be matched by a Release.
+//
+//	The entry goes into the table before the header is read, since
+//	the read may block; anyone else who wants the header meanwhile
+//	waits for it, rather than reading a second copy.
+//----------------------------------------------------------------------
+
+FileHeader *
+FileTable::Acquire(int sector)
+{
+    FileTableEntry *e;
+
+    lock->Acquire();
+    e = Find(sector);
+    if (e == NULL) {
+	numMisses++;
+	e = new FileTableEntry;
+	e->sector = sector;
+	e->hdr = new FileHeader;
+	e->refCount = 0;
+	e->opens = 0;
+	e->dirty = FALSE;
+	e->removed = FALSE;
+	e->reading = TRUE;
+	e->releasing = FALSE;
+	e->rwLock = new RWLock("file contents");
+	entries->Append(e);
+	lock->Release();
+	e->hdr->FetchFrom(sector);
+	lock->Acquire();
+	e->reading = FALSE;
+	readDone->Broadcast(lock);
+    } else {
+	numHits++;
+	while (e->reading)
+	    readDone->Wait(lock);
+    }
+    e->refCount++;
+    e->opens++;
+    lock->Release();
+    return e->hdr;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Release
+// 	Give up a header returned by Acquire.  When its last user lets
+//	go, the data waiting for delayed allocation is given its sectors,
+//	the spare sectors allocated ahead by the file's writers are
+//	given back, the header is written back if it changed, and it is
+//	freed.
+//
+//	This is called as OpenFiles are deleted, including at shutdown,
+//	so it must not print debugging messages.
+//
+//	Writing the header back may block, and the file may be opened
+//	(and closed) again meanwhile; then it stays in the table, or it
+//	is left to this Release to free.
+//----------------------------------------------------------------------
+
+void
+FileTable::Release(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    ASSERT(e != NULL && e->refCount > 0);
+    if (--e->refCount > 0 || e->releasing)
+	return;
+    e->releasing = TRUE;
+    if (e->removed) {
+	e->hdr->DropDelayed(kernel->fileSystem->FreeMap());
+    } else if (e->hdr->HasDelayed()) {
+	e->hdr->AllocateDelayed(kernel->fileSystem->FreeMap(), sector + 1);
+	e->dirty = TRUE;
+    }
+    if (!e->removed && e->hdr->HasSpare()) {
+	e->hdr->Trim(kernel->fileSystem->FreeMap());
+	e->dirty = TRUE;
+    }
+    WriteBack(sector);
+    e->releasing = FALSE;
+    if (e->refCount > 0)			// opened again meanwhile
+	return;
+    entries->Remove(e);
+    numEvictions++;
+    delete e->hdr;
+    delete e->rwLock;
+    delete e;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Users/Opens
+// 	Return how many users hold the header at "sector" now, or how
+//	many times it has been acquired since it was read in; 0 if no one
+//	holds it.  A holder that sees Opens unchanged knows no one else
+//	opened the file in the meantime.
+//----------------------------------------------------------------------
+
+int
+FileTable::Users(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    return (e == NULL) ? 0 : e->refCount;
+}
+
+int
+FileTable::Opens(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    return (e == NULL) ? 0 : e->opens;
+}
+
+//----------------------------------------------------------------------
+// FileTable::LockOf
+// 	Return the reader-writer lock of the file whose header is at
+//	"sector", which the caller must hold.  All the openers of a file
+//	share its lock, and it lasts as long as the header is in the
+//	table.
+//----------------------------------------------------------------------
+
+RWLock *
+FileTable::LockOf(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    ASSERT(e != NULL);
+    return e->rwLock;
+}
+
+//----------------------------------------------------------------------
+// FileTable::MarkDirty
+// 	Note that the header at "sector" changed, so that it gets written
+//	back at the last Release or the next Sync.
+//----------------------------------------------------------------------
+
+void
+FileTable::MarkDirty(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    ASSERT(e != NULL);
+    e->dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileTable::MarkRemoved
+// 	Note that the file whose header is at "sector" has been removed,
+//	and its sectors given back, if anyone holds its header.  The
+//	header must never be written back, since the sector may already
+//	belong to another file.
+//----------------------------------------------------------------------
+
+void
+FileTable::MarkRemoved(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    if (e != NULL) {
+	e->removed = TRUE;
+	e->dirty = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileTable::WriteBack
+// 	Write the header at "sector" back to disk (that is, to the buffer
+//	cache, logged by the journal), if it changed since it was last
+//	written.
+//----------------------------------------------------------------------
+
+void
+FileTable::WriteBack(int sector)
+{
+    FileTableEntry *e = Find(sector);
+
+    ASSERT(e != NULL);
+    if (e->dirty && !e->removed) {
+	kernel->journal->Begin();
+	e->hdr->WriteBack(sector);
+	kernel->journal->End();
+	e->dirty = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileTable::Sync
+// 	Write back every header in the table that changed.
+//----------------------------------------------------------------------
+
+void
+FileTable::Sync()
+{
+    for (FileTableEntry *e = entries->Front(); e != NULL; e = entries->Next(e))
+	WriteBack(e->sector);
+}
+
+//----------------------------------------------------------------------
+// FileTable::AllocateDelayed
+// 	Give every file in the table that has data waiting for delayed
+//	allocation its sectors, and write the data (see
+//	FileHeader::AllocateDelayed).  Each file is held for writing
+//	meanwhile, which may block, so the files are listed first, and
+//	each is acquired as it is done, so that it stays in the table.
+//----------------------------------------------------------------------
+
+void
+FileTable::AllocateDelayed()
+{
+    List<int> *delayed = new List<int>;
+
+    for (FileTableEntry *e = entries->Front(); e != NULL; e = entries->Next(e))
+	if (!e->removed && !e->reading && e->hdr->HasDelayed())
+	    delayed->Append(e->sector);
+    while (!delayed->IsEmpty()) {
+	int sector = delayed->RemoveFront();
+	FileHeader *hdr = Acquire(sector);
+	RWLock *rwLock = LockOf(sector);
+
+	rwLock->AcquireWrite();
+	if (hdr->HasDelayed()) {
+	    hdr->AllocateDelayed(kernel->fileSystem->FreeMap(), sector + 1);
+	    MarkDirty(sector);
+	}
+	rwLock->ReleaseWrite();
+	Release(sector);
+    }
+    delete delayed;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Print
+// 	Print the headers in the table, and how many users each has.
+//----------------------------------------------------------------------
+
+void
+FileTable::Print()
+{
+    printf("File table: %d headers\n", entries->NumInList());
+    for (FileTableEntry *e = entries->Front(); e != NULL; e = entries->Next(e))
+	printf("  header sector %d, length %d, %d users%s\n",
+	       e->sector, e->hdr->FileLength(), e->refCount,
+	       e->dirty ? ", dirty" : "");
+}
@@ -0,0 +1,98 @@
+// ftable.h
+//	Data structures for the table of in-core file headers.
+//
+//	Every OpenFile -- a user program's, or one the file system opens
+//	for a moment to walk a directory -- gets its FileHeader from this
+//	table, so all the OpenFiles for the same file share one in-core
+//	header, and a file that grows is seen to grow by all its openers.
+//	The header is read from disk when the file is first opened, and
+//	freed when the last opener closes it.
+//
+//	Changes to a header are only marked in the table; the header is
+//	written back when the last opener closes the file, or at the next
+//	sync.  The table is also the place to keep anything else that
+//	belongs to a file rather than to one opener of it -- such as the
+//	reader-writer lock its openers share.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FTABLE_H
+#define FTABLE_H
+
+#include "list.h"
+
+class FileHeader;
+class Lock;
+class Condition;
+class RWLock;
+
+// The following class defines one file in the table.
+
+class FileTableEntry {
+  public:
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
+    int sector;				// Where the header lives on disk
+    FileHeader *hdr;			// The shared in-core header
+    int refCount;			// Users of "hdr"
+    int opens;				// Times Acquire has returned "hdr"
+    bool dirty;				// Has "hdr" changed since it was
+					// last written back?
+    bool removed;			// Has the file been removed?  Then
+					// "hdr" is never written back
+    bool reading;			// Is "hdr" still being read in?
+    bool releasing;			// Is the last Release writing it
+					// back?
+    RWLock *rwLock;			// Held by the openers as they read
+					// and write the file's contents
+    ListLink<FileTableEntry> listLink;	// Where it is in the table
+};
+
+// The following class defines the table of in-core file headers.
+
+class FileTable {
+  public:
+    FileTable();			// Create an empty table
+    ~FileTable();			// De-allocate the table
+
+    FileHeader *Acquire(int sector);	// The header at "sector", read in
+					// if no one holds it yet
+    void Release(int sector);		// Done with the header at "sector"
+    int Users(int sector);		// Holders of the header at "sector"
+    int Opens(int sector);		// Acquires of it since it was read
+    RWLock *LockOf(int sector);		// The reader-writer lock of the
+					// file at "sector"
+
+    void MarkDirty(int sector);		// The header at "sector" changed
+    void MarkRemoved(int sector);	// The file at "sector" is gone
+
+    void WriteBack(int sector);		// Write the header at "sector"
+					// back, if it changed
+    void Sync();			// Write back every changed header
+    void AllocateDelayed();		// Give the data waiting for delayed
+					// allocation its sectors
+
+    void Print();			// Print the headers in the table
+    int Hits() { return numHits; }
+    int Misses() { return numMisses; }
+    int Evictions() { return numEvictions; }
+
+  private:
+    FileTableEntry *Find(int sector);	// The entry for "sector", or NULL
+
+    IntrusiveList<FileTableEntry> *entries;
+					// The headers in use
+    Lock *lock;				// Protects "reading"
+    Condition *readDone;		// Signalled when a header is in
+
+    int numHits;			// Acquires of a header already in
+    int numMisses;			// Acquires that read it from disk
+    int numEvictions;			// Headers freed by their last Release
+};
+
+#endif // FTABLE_H
@@ -0,0 +1,353 @@
+// journal.cc
+//	Routines to log file system operations, commit them to the
+//	journal in batches, and replay a committed batch at mount time.
+//
+//	A batch is committed only when no operation is between Begin and
+//	End, so a batch always holds whole operations.  Begin waits while
+//	a commit is going on, so nothing is logged into a batch that is
+//	being written out, and while the batch has no room for one more
+//	operation's claim.  An operation that outgrows its claim claims
+//	more in Reserve; if the batch is full, it is committed as soon as
+//	every other operation in it has ended or is waiting in Reserve
+//	too, so that a batch never holds an operation cut anywhere but at
+//	a Reserve.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "bufcache.h"
+#include "synchdisk.h"
+#include "pbitmap.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize the journal in front of a buffer cache.  The cache
+//	pins at most one batch of logged sectors.
+//
+//	"cache" -- the buffer cache whose writes are logged
+//	"disk" -- the disk holding the journal
+//----------------------------------------------------------------------
+
+Journal::Journal(BufferCache *cache, SynchDisk *disk)
+{
+    ASSERT(sizeof(JournalDescriptor) <= SectorSize);
+    this->cache = cache;
+    this->disk = disk;
+    lock = new Lock("journal lock");
+    idle = new Condition("journal idle");
+    active = claimed = reserving = 0;
+    committing = FALSE;
+    batches = 0;
+    numCommits = numJournaled = numReplayed = 0;
+    cache->StartLogging(JournalSlots);
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  Interrupt::Halt commits the last batch
+//	before the kernel is torn down.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    delete idle;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Reserve the journal's sectors on a disk being formatted.  The
+//	disk has been erased, so the descriptor already reads as an empty
+//	one, and need not be written.
+//
+//	"freeMap" -- the bitmap of the new disk
+//----------------------------------------------------------------------
+
+void
+Journal::Format(PersistentBitmap *freeMap)
+{
+    for (int i = 0; i < JournalSectors; i++)
+	freeMap->Mark(JournalSector + i);
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	If the descriptor on disk is committed, Nachos stopped before
+//	the batch was all written home: write it home again, from the
+//	journal, then clear the descriptor.  Writing a sector home twice
+//	does no harm, since each is a copy of the whole sector.
+//
+//	Called when the disk is mounted, before anything is read through
+//	the buffer cache.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    char sector[SectorSize];
+    JournalDescriptor descriptor;
+    char *data;
+
+    disk->ReadSector(JournalSector, sector);
+    bcopy(sector, (char *) &descriptor, sizeof(JournalDescriptor));
+    if (descriptor.magic != JournalMagic || descriptor.numLogged <= 0)
+	return;
+    ASSERT(descriptor.numLogged <= JournalSlots);
+
+    DEBUG(dbgFile, "Replaying the journal, " << descriptor.numLogged
+		<< " sectors");
+    data = new char[descriptor.numLogged * SectorSize];
+    disk->ReadSectors(JournalSector + 1, descriptor.numLogged, data);
+    for (int i = 0; i < descriptor.numLogged; i++)
+	disk->WriteSector(descriptor.home[i], &data[i * SectorSize]);
+    numReplayed += descriptor.numLogged;
+    delete [] data;
+    WriteDescriptor(NULL, 0);
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start an operation whose writes must reach the disk together.
+//	Until the matching End, everything the running thread writes
+//	through the cache is logged.  Operations may overlap, and nest;
+//	a nested one is part of the one around it.
+//
+//	The operation may write up to "sectors", so it waits until the
+//	batch has that much room left, over and above what the operations
+//	already in it may still write: for them to End, if there are any,
+//	and then for the batch to be committed.  One that claims all of
+//	JournalSlots so runs alone, in a batch of its own.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin(int sectors)
+{
+    Thread *thread = kernel->currentThread;
+
+    ASSERT(sectors >= MaxOpSectors && sectors <= JournalSlots);
+    if (thread->journalDepth++ > 0)
+	return;				// nested
+    lock->Acquire();
+    for (;;) {
+	while (committing)
+	    idle->Wait(lock);
+	if (Room() >= sectors)
+	    break;
+	if (active > 0)
+	    idle->Wait(lock);
+	else {
+	    lock->Release();
+	    Commit();
+	    lock->Acquire();
+	}
+    }
+    active++;
+    claimed += sectors;
+    thread->journalClaim = sectors;
+    thread->journalUsed = 0;
+    thread->journalBatch = batches;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Reserve
+// 	The running thread is about to write up to "sectors" more as part
+//	of its operation, and the disk is good, as far as the operation
+//	goes, whether or not what it wrote so far reaches the disk without
+//	what follows.  If that would take it past its claim, claim more of
+//	the batch.  If the batch has no more, commit it here: at once, if
+//	every other operation in it is waiting here as well, or else once
+//	they have, or have ended.  Outside any operation, do nothing.
+//
+//	"sectors" is at most MaxOpSectors, so that it fits in a claim.
+//	An operation that waits here must not hold what another one in
+//	the batch needs to get here or to its end; those likely to fill
+//	the batch claim all of it instead, and never wait.
+//----------------------------------------------------------------------
+
+void
+Journal::Reserve(int sectors)
+{
+    Thread *thread = kernel->currentThread;
+    int need;
+
+    if (thread->journalDepth == 0)
+	return;
+    ASSERT(sectors > 0 && sectors <= MaxOpSectors);
+    lock->Acquire();
+    for (;;) {
+	while (committing)
+	    idle->Wait(lock);
+	if (thread->journalBatch != batches) {	// committed while it waited
+	    thread->journalUsed = 0;
+	    thread->journalBatch = batches;
+	}
+	need = thread->journalUsed + sectors - thread->journalClaim;
+	if (need <= 0)
+	    break;
+	if (Room() >= need) {
+	    claimed += need;
+	    thread->journalClaim += need;
+	    break;
+	}
+	if (reserving == active - 1) {
+	    DEBUG(dbgFile, "Splitting an operation, " << cache->NumLogged()
+		  << " sectors logged");
+	    committing = TRUE;
+	    lock->Release();
+	    WriteBatch();
+	    lock->Acquire();
+	    committing = FALSE;
+	    batches++;
+	    idle->Broadcast(lock);
+	} else {
+	    reserving++;
+	    idle->Broadcast(lock);		// it may be the last one
+	    idle->Wait(lock);
+	    reserving--;
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish an operation started by Begin.  The batch is committed
+//	once it is big enough that the next operations might not fit;
+//	until then, its sectors wait in the cache, so several operations
+//	share one commit.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    Thread *thread = kernel->currentThread;
+    bool full;
+
+    ASSERT(thread->journalDepth > 0);
+    if (--thread->journalDepth > 0)
+	return;				// nested
+    lock->Acquire();
+    ASSERT(active > 0);
+    active--;
+    claimed -= thread->journalClaim;
+    thread->journalClaim = 0;
+    idle->Broadcast(lock);
+    full = (active == 0 && cache->NumLogged() >= CommitThreshold);
+    lock->Release();
+    if (full)
+	Commit();
+}
+
+//----------------------------------------------------------------------
+// Journal::Room
+// 	Return how many slots of the batch are neither taken by logged
+//	sectors nor kept for the operations in progress.  Each of those
+//	is counted as if it had yet to write anything, which may leave
+//	less room than there is, but never more.
+//----------------------------------------------------------------------
+
+int
+Journal::Room()
+{
+    return JournalSlots - cache->NumLogged() - claimed;
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Make every operation logged so far durable: write the logged
+//	sectors to the journal with one request, commit them by writing
+//	the descriptor, write them to their homes, and clear the
+//	descriptor.  Waits for the operations in progress to End.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    lock->Acquire();
+    while (active > 0 || committing)
+	idle->Wait(lock);
+    committing = TRUE;
+    lock->Release();
+
+    WriteBatch();
+
+    lock->Acquire();
+    committing = FALSE;
+    batches++;
+    idle->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteBatch
+// 	Write the logged sectors to the journal with one request, commit
+//	them by writing the descriptor, write them to their homes, and
+//	clear the descriptor.  The caller has set "committing", and no
+//	operation in the batch writes meanwhile.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteBatch()
+{
+    int home[JournalSlots];
+    char *data;
+    int numLogged;
+
+    data = new char[JournalSlots * SectorSize];
+    numLogged = cache->CopyLogged(home, data);
+    if (numLogged > 0) {
+	DEBUG(dbgFile, "Committing " << numLogged << " sectors to the journal");
+	disk->WriteSectors(JournalSector + 1, numLogged, data);
+	WriteDescriptor(home, numLogged);	// the commit point
+	cache->WriteLogged();
+	WriteDescriptor(NULL, 0);
+	numCommits++;
+	numJournaled += numLogged;
+    }
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteDescriptor
+// 	Write the journal's descriptor straight to disk.  A descriptor
+//	with sectors in it is committed; an empty one is not.
+//
+//	"home" -- where each sector in the journal belongs
+//	"numLogged" -- the number of sectors in the journal
+//----------------------------------------------------------------------
+
+void
+Journal::WriteDescriptor(int *home, int numLogged)
+{
+    char sector[SectorSize];
+    JournalDescriptor descriptor;
+
+    bzero((char *) &descriptor, sizeof(JournalDescriptor));
+    if (numLogged > 0) {
+	descriptor.magic = JournalMagic;
+	descriptor.numLogged = numLogged;
+	for (int i = 0; i < numLogged; i++)
+	    descriptor.home[i] = home[i];
+    }
+    bzero(sector, SectorSize);
+    bcopy((char *) &descriptor, sector, sizeof(JournalDescriptor));
+    disk->WriteSector(JournalSector, sector);
+}
+
+//----------------------------------------------------------------------
+// Journal::Print
+// 	Print the journal's statistics.
+//----------------------------------------------------------------------
+
+void
+Journal::Print()
+{
+    printf("Journal: %d commits, %d sectors journaled, %d replayed\n",
+	   numCommits, numJournaled, numReplayed);
+}
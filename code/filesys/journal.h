@@ -0,0 +1,136 @@
+// journal.h
+//	Data structures for the metadata journal.
+//
+//	Creating or removing a file changes several sectors at once: the
+//	file header, a directory, the bitmap.  If Nachos stops after only
+//	some of them reached the disk, the directory and bitmap disagree.
+//	To prevent that, the sectors a file system operation writes, from
+//	Begin to End, are logged: they stay pinned in the buffer cache,
+//	and are not written to their home on disk, until the operation is
+//	committed to the journal.  Only the thread running the operation
+//	has its writes logged; those of other threads, outside any
+//	operation, go through the cache as usual.
+//
+//	Operations are committed in batches (group commit): the sectors
+//	of all the operations since the last commit are written to the
+//	journal with one request, then a descriptor naming their homes is
+//	written -- that single sector write is the commit -- and only then
+//	are the sectors written home.  Finally the descriptor is cleared.
+//	A sector changed by several operations in a batch is written once.
+//	An operation only starts if the batch has room for what it claims
+//	-- MaxOpSectors, unless it says otherwise -- besides the claims
+//	of the operations already in it; otherwise it waits for them to
+//	end, and the batch to be committed.  What one writes may still
+//	outgrow its claim: the bitmap sectors changed by data written
+//	outside any operation, the index blocks of a large file, a
+//	snapshot of a whole tree.  So the code writing such things, a
+//	sector at a time, first calls Reserve, which claims more of the
+//	batch, or, if there is none left, commits it there and then.
+//	That splits the operation into two commits, at a point where the
+//	writer knows the disk is good either way.
+//
+//	The journal lives in its own sectors, reserved when the disk is
+//	formatted, right after the headers of the bitmap and directory
+//	(and before the superblock, see superblock.h).
+//	When the disk is mounted, a batch that was committed but perhaps
+//	not entirely written home is written home again.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+#include "synch.h"
+
+#define JournalSector	2		// the descriptor of the journal
+#define JournalSlots	(SectorsPerTrack - JournalSector - 2)
+					// sectors a batch can hold; the
+					// journal fills the rest of track 0,
+					// but for the superblock at its end
+#define JournalSectors	(1 + JournalSlots)
+#define CommitThreshold	(JournalSlots / 2)
+					// logged sectors that make End
+					// commit the batch
+#define MaxOpSectors	(JournalSlots / 2)
+					// what an operation claims: enough
+					// for its file header, and a few
+					// sectors of a directory and the
+					// bitmap, without calling Reserve
+#define JournalMagic	0x4a4e4c31	// marks a committed descriptor
+
+class BufferCache;
+class SynchDisk;
+class PersistentBitmap;
+
+// The following class defines the contents of the journal's
+// descriptor sector: where each sector in the journal belongs.
+
+class JournalDescriptor {
+  public:
+    int magic;				// JournalMagic, if committed
+    int numLogged;			// Sectors in the batch
+    int home[JournalSlots];		// Where each of them belongs
+};
+
+// The following class defines the journal.
+
+class Journal {
+  public:
+    Journal(BufferCache *cache, SynchDisk *disk);
+    					// Journal the writes to "cache"
+    ~Journal();
+
+    void Format(PersistentBitmap *freeMap);
+    					// Reserve the journal on a new disk
+    void Recover();			// Finish a committed batch, when
+					// the disk is mounted
+
+    void Begin(int sectors = MaxOpSectors);
+    					// Start logging an operation that
+					// writes at most "sectors", once
+					// there is room for it
+    void Reserve(int sectors);		// The running operation is about
+					// to write "sectors" more; make
+					// room for them, splitting it if
+					// need be
+    void End();				// The operation is done; commit it
+					// if the batch is big enough
+    void Commit();			// Commit, and write home, every
+					// operation logged so far
+
+    void Print();			// Print journal statistics
+
+  private:
+    void WriteDescriptor(int *home, int numLogged);
+    					// Write the descriptor (cleared if
+					// "numLogged" is 0)
+
+    int Room();				// Slots of the batch that no
+					// operation has a claim on
+    void WriteBatch();			// Write the batch to the journal,
+					// commit it, and write it home
+
+    BufferCache *cache;			// Where the logged sectors wait
+    SynchDisk *disk;			// The disk the journal is on
+    Lock *lock;				// Protects the fields below
+    Condition *idle;			// Signalled when an operation ends,
+					// and when a commit is done
+    int active;				// Operations between Begin and End
+    int claimed;			// Slots they have kept
+    int reserving;			// Those waiting in Reserve
+    bool committing;			// A commit is writing the journal
+    int batches;			// Batches committed or begun: a
+					// thread's count of the sectors it
+					// logged is from the current one
+
+    int numCommits;			// Batches committed
+    int numJournaled;			// Sectors written to the journal
+    int numReplayed;			// Sectors written home by Recover
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,626 @@
+// logvolume.cc
+//	Routines to keep a volume as a log: to find the sectors the file
+//	system reads, append the ones it writes, checkpoint the map,
+//	roll forward after a crash, and clean segments.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "logvolume.h"
+#include "synchdisk.h"
+#include "diskmodel.h"
+#include "debug.h"
+#include "main.h"
+
+#define MapPerSector	((int) (SectorSize / sizeof(int)))
+					// map entries in a sector
+
+//----------------------------------------------------------------------
+// LogVolume::LogVolume
+// 	Lay out a log on the "physSectors" sectors of "disk": as many
+//	segments of checkpoint as it takes, and a volume of LogFill
+//	percent of what the rest can hold, in whole tracks.  The log is
+//	empty until Format or Recover fills it in.
+//----------------------------------------------------------------------
+
+LogVolume::LogVolume(SynchDisk *disk, int physSectors)
+{
+    this->disk = disk;
+    numSegments = physSectors / SegmentSectors;
+    firstSegment = 0;
+    for (int segments = 1; segments != firstSegment; ) {
+	firstSegment = segments;
+	numSectors = (numSegments - firstSegment) * (SegmentSectors - 2) *
+		     LogFill / 100 / SectorsPerTrack * SectorsPerTrack;
+	mapSectors = divRoundUp(numSectors, MapPerSector);
+	segments = divRoundUp(1 + mapSectors, SegmentSectors);
+    }
+    ASSERT(numSectors > 0 && numSegments - firstSegment > CleanHigh);
+
+    map = new int[numSectors];
+    owner = new int[numSegments * SegmentSectors];
+    live = new int[numSegments];
+    inChain = new bool[numSegments];
+    lock = new Lock("log lock");
+    wakeup = NULL;
+    cleaner = NULL;
+    cleanPending = FALSE;
+    numRecords = numRolled = numCheckpoints = numCleaned = numCopied = 0;
+}
+
+LogVolume::~LogVolume()
+{
+    delete [] map;
+    delete [] owner;
+    delete [] live;
+    delete [] inChain;
+    delete lock;
+    if (wakeup != NULL)
+	delete wakeup;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::IsLog
+// 	Return TRUE if "disk" starts with the checkpoint of a log.
+//----------------------------------------------------------------------
+
+bool
+LogVolume::IsLog(SynchDisk *disk)
+{
+    char sector[SectorSize];
+
+    disk->PhysicalRequest(0, 1, sector, FALSE);
+    return ((LogCheckpoint *) sector)->magic == LogMagic;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Format
+// 	Start an empty log on a disk that was just erased: no sector of
+//	the volume has been written, and the head is at the start of the
+//	first segment after the checkpoint.
+//----------------------------------------------------------------------
+
+void
+LogVolume::Format()
+{
+    lock->Acquire();
+    for (int i = 0; i < numSectors; i++)
+	map[i] = -1;
+    for (int i = 0; i < numSegments * SegmentSectors; i++)
+	owner[i] = -1;
+    for (int i = 0; i < numSegments; i++) {
+	live[i] = 0;
+	inChain[i] = FALSE;
+    }
+    seq = 1;
+    head = firstSegment * SegmentSectors;
+    inChain[firstSegment] = TRUE;
+    WriteCheckpoint();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Recover
+// 	Read the map and the head from the checkpoint, and roll forward
+//	through the records after it: each with the next number, at the
+//	head or a little after it (see Skip).  Once a segment has no room
+//	for another record, the next one starts some other segment, found
+//	by looking at the first sector of each.  Where the next record is
+//	not found is the end of the log.  If there were any, take a
+//	checkpoint, so they need not be rolled forward again.
+//----------------------------------------------------------------------
+
+void
+LogVolume::Recover()
+{
+    char *buffer = new char[(1 + mapSectors) * SectorSize];
+    LogCheckpoint *checkpoint = (LogCheckpoint *) buffer;
+    char sector[SectorSize];
+    LogSummary *summary = (LogSummary *) sector;
+    int at;
+
+    lock->Acquire();
+    disk->PhysicalRequest(0, 1 + mapSectors, buffer, FALSE);
+    ASSERT(checkpoint->magic == LogMagic &&
+	   checkpoint->numSectors == numSectors);
+    bcopy(buffer + SectorSize, (char *) map, numSectors * sizeof(int));
+    seq = checkpoint->seq;
+    head = checkpoint->head;
+    delete [] buffer;
+
+    for (int i = 0; i < numSegments * SegmentSectors; i++)
+	owner[i] = -1;
+    for (int i = 0; i < numSegments; i++) {
+	live[i] = 0;
+	inChain[i] = FALSE;
+    }
+    for (int i = 0; i < numSectors; i++)
+	if (map[i] >= 0) {
+	    owner[map[i]] = i;
+	    live[SegmentOf(map[i])]++;
+	}
+    inChain[SegmentOf(head)] = TRUE;
+
+    for (;;) {
+	if (Room() < 2) {
+	    int next = -1;
+
+	    for (int s = firstSegment; s < numSegments && next < 0; s++) {
+		disk->PhysicalRequest(s * SegmentSectors, 1, sector, FALSE);
+		if (summary->magic == RecordMagic && summary->seq == seq)
+		    next = s;
+	    }
+	    if (next < 0)
+		break;
+	    head = next * SegmentSectors;
+	    inChain[next] = TRUE;
+	}
+	if ((at = FindRecord(sector)) < 0)
+	    break;
+	for (int i = 0; i < summary->count; i++)
+	    SetMapping(summary->sectors[i], at + 1 + i);
+	head = at + 1 + summary->count;
+	seq++;
+	numRolled++;
+    }
+    DEBUG(dbgFile, "Log recovered, " << numRolled << " records rolled forward");
+    if (numRolled > 0)
+	WriteCheckpoint();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LogVolume::FindRecord
+// 	Look for the next record in what is left of the head's segment,
+//	reading all of it with one request.  Return where it is, with its
+//	summary in "found", or -1 if it is not there.
+//----------------------------------------------------------------------
+
+int
+LogVolume::FindRecord(char *found)
+{
+    int count = Room(), at = -1;
+    char *buffer = new char[count * SectorSize];
+
+    disk->PhysicalRequest(head, count, buffer, FALSE);
+    for (int i = 0; i + 1 < count && at < 0; i++) {
+	LogSummary *summary = (LogSummary *) &buffer[i * SectorSize];
+
+	if (summary->magic == RecordMagic && summary->seq == seq &&
+		summary->count <= count - 1 - i) {
+	    at = head + i;
+	    bcopy((char *) summary, found, SectorSize);
+	}
+    }
+    delete [] buffer;
+    return at;
+}
+
+//----------------------------------------------------------------------
+// CleanerThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the cleaner of the log.
+//----------------------------------------------------------------------
+
+static void
+CleanerThread(LogVolume *log)
+{
+    log->Cleaner();
+}
+
+//----------------------------------------------------------------------
+// LogVolume::StartCleaner
+// 	Fork the cleaner thread.  From now on, a writer that leaves fewer
+//	than CleanLow segments free wakes it.
+//----------------------------------------------------------------------
+
+void
+LogVolume::StartCleaner()
+{
+    ASSERT(cleaner == NULL);
+    wakeup = new Semaphore("log cleaner", 0);
+    cleaner = new Thread("log cleaner", -1);
+    cleaner->Fork((VoidFunctionPtr) CleanerThread, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Cleaner
+// 	Loop forever, waiting to be woken up and then freeing segments
+//	until CleanHigh are free: by a checkpoint, if segments were
+//	emptied since the last one, or else by cleaning the segment with
+//	the fewest live sectors.  A segment more than LogFill percent
+//	live is left alone: copying it would use nearly as much room as
+//	it gives back.
+//----------------------------------------------------------------------
+
+void
+LogVolume::Cleaner()
+{
+    for (;;) {
+	wakeup->P();
+	lock->Acquire();
+	while (NumFree() < CleanHigh) {
+	    if (NumEmptied() > 0)
+		WriteCheckpoint();
+	    else if (!CleanOne((SegmentSectors - 2) * LogFill / 100))
+		break;
+	}
+	lock->Release();
+	cleanPending = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Request
+// 	Read or write "count" sectors of the volume, from "sector" on, to
+//	or from "data".
+//----------------------------------------------------------------------
+
+void
+LogVolume::Request(int sector, int count, char *data, bool writing)
+{
+    ASSERT(sector >= 0 && count > 0 && sector + count <= numSectors);
+    lock->Acquire();
+    if (writing) {
+	int *sectors = new int[count];
+
+	for (int i = 0; i < count; i++)
+	    sectors[i] = sector + i;
+	Write(sectors, count, data, FALSE);
+	delete [] sectors;
+    } else {
+	Read(sector, count, data);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LogVolume::WriteGathered
+// 	Write the "count" volume sectors listed in "sectors" from "data",
+//	one after another in the log, however scattered they are.
+//----------------------------------------------------------------------
+
+void
+LogVolume::WriteGathered(int *sectors, int count, char *data)
+{
+    for (int i = 0; i < count; i++)
+	ASSERT(sectors[i] >= 0 && sectors[i] < numSectors);
+    lock->Acquire();
+    Write(sectors, count, data, FALSE);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Checkpoint
+// 	Write a checkpoint now, e.g. as the volume is unmounted, so that
+//	mounting it has nothing to roll forward.
+//----------------------------------------------------------------------
+
+void
+LogVolume::Checkpoint()
+{
+    lock->Acquire();
+    WriteCheckpoint();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Read
+// 	Read "count" sectors of the volume, from "sector" on, into "data":
+//	each run of them whose latest copies are one after the other in
+//	the log with one request.  A sector never written reads as zeros.
+//----------------------------------------------------------------------
+
+void
+LogVolume::Read(int sector, int count, char *data)
+{
+    for (int i = 0, run; i < count; i += run) {
+	int where = map[sector + i];
+
+	run = 1;
+	if (where < 0) {
+	    bzero(&data[i * SectorSize], SectorSize);
+	    continue;
+	}
+	while (i + run < count && map[sector + i + run] == where + run)
+	    run++;
+	disk->PhysicalRequest(where, run, &data[i * SectorSize], FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Write
+// 	Append "count" sectors, the volume sectors in "sectors", from
+//	"data", at the head of the log: as records of up to RecordSectors
+//	each, that fit in what is left of the segment.  The head moves on
+//	to another segment only when the one it is in has no room for a
+//	record, which is how Recover follows it.  No record takes the
+//	last sector of a segment: the head, just past it, would be at the
+//	start of the next one, without having moved there.  A writer's
+//	record may go a few sectors after the head, if those have already
+//	turned past the disk head (see Skip); the cleaner's never do, so
+//	that cleaning a segment always gains room.
+//
+//	"cleaning" -- the cleaner is writing, and may take the last free
+//		segment
+//----------------------------------------------------------------------
+
+void
+LogVolume::Write(int *sectors, int count, char *data, bool cleaning)
+{
+    while (count > 0) {
+	int room = Room();
+
+	if (room < 2) {
+	    NextSegment(cleaning);
+	    continue;
+	}
+	int skip = cleaning ? 0 : Skip();
+
+	if (skip > 0 && skip <= room - 2) {
+	    head += skip;
+	    room -= skip;
+	}
+	int n = min(count, min(room - 1, RecordSectors));
+	char *record = new char[(1 + n) * SectorSize];
+	LogSummary *summary = (LogSummary *) record;
+
+	bzero(record, SectorSize);
+	summary->magic = RecordMagic;
+	summary->seq = seq;
+	summary->count = n;
+	for (int i = 0; i < n; i++)
+	    summary->sectors[i] = sectors[i];
+	bcopy(data, record + SectorSize, n * SectorSize);
+	disk->PhysicalRequest(head, 1 + n, record, TRUE);
+	delete [] record;
+
+	for (int i = 0; i < n; i++)
+	    SetMapping(sectors[i], head + 1 + i);
+	head += 1 + n;
+	seq++;
+	numRecords++;
+	sectors += n;
+	data += n * SectorSize;
+	count -= n;
+    }
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Skip
+// 	Return how many sectors after the head the next record should go
+//	for the disk not to have to turn all the way round to it.  When
+//	the last request ended at the head, the sectors after it have been
+//	turning past since, at one every RotationTime; the first one still
+//	to come is the place.  Only a single or mirrored rotational disk
+//	turns that way (see SynchDisk::Interleave); on others, and after
+//	any other request, the head is the place.
+//----------------------------------------------------------------------
+
+int
+LogVolume::Skip()
+{
+    if (kernel->diskModel != RotationalModel ||
+	    (disk->numDisks > 1 && !disk->mirrored) || disk->lastEnd != head)
+	return 0;
+    return divRoundUp(kernel->stats->totalTicks - disk->lastDone,
+		      RotationTime) % SectorsPerTrack;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::NextSegment
+// 	Move the head to the start of a free segment, the first after the
+//	one it is in.  A writer other than the cleaner leaves one free for
+//	the cleaner, making room first if need be -- which may itself
+//	have moved the head to a segment with room.  Wake the cleaner if
+//	few are left.
+//----------------------------------------------------------------------
+
+void
+LogVolume::NextSegment(bool cleaning)
+{
+    int from = SegmentOf(head), next = -1;
+
+    if (!cleaning) {
+	MakeRoom();
+	if (Room() >= 2)
+	    return;
+	from = SegmentOf(head);
+    }
+    for (int i = 1; i < numSegments && next < 0; i++) {
+	int s = (from + i) % numSegments;
+
+	if (IsFree(s))
+	    next = s;
+    }
+    if (next < 0) {			// only a checkpoint holds it up
+	WriteCheckpoint();
+	for (int s = firstSegment; s < numSegments && next < 0; s++)
+	    if (IsFree(s))
+		next = s;
+    }
+    ASSERT(next >= 0);
+    head = next * SegmentSectors;
+    inChain[next] = TRUE;
+    if (NumFree() < CleanLow && cleaner != NULL && !cleanPending &&
+	    kernel->currentThread != cleaner) {
+	cleanPending = TRUE;
+	wakeup->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// LogVolume::MakeRoom
+// 	Free segments until there are two, one for a writer and one for
+//	the cleaner: by a checkpoint, if segments were emptied since the
+//	last one, or else by cleaning one.  A volume of LogFill percent of
+//	the log always has a segment that cleaning gains room from.
+//----------------------------------------------------------------------
+
+void
+LogVolume::MakeRoom()
+{
+    for (int tries = 0; NumFree() < 2; tries++) {
+	ASSERT(tries < 2 * numSegments);
+	if (NumEmptied() > 0) {
+	    WriteCheckpoint();
+	} else {
+	    bool cleaned = CleanOne(SegmentSectors - 3);
+
+	    ASSERT(cleaned);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// LogVolume::CleanOne
+// 	Clean the segment with the fewest live sectors, other than the
+//	one being filled, if it has at most "most": read all of it, and
+//	write its live sectors at the head again.  Return FALSE if there
+//	is no such segment.
+//----------------------------------------------------------------------
+
+bool
+LogVolume::CleanOne(int most)
+{
+    int victim = -1;
+
+    for (int s = firstSegment; s < numSegments; s++)
+	if (s != SegmentOf(head) && live[s] > 0 && live[s] <= most &&
+		(victim < 0 || live[s] < live[victim]))
+	    victim = s;
+    if (victim < 0)
+	return FALSE;
+
+    char *segment = new char[SegmentSectors * SectorSize];
+    char *copies = new char[SegmentSectors * SectorSize];
+    int sectors[SegmentSectors], n = 0;
+    int first = victim * SegmentSectors;
+
+    disk->PhysicalRequest(first, SegmentSectors, segment, FALSE);
+    for (int i = 0; i < SegmentSectors; i++)
+	if (owner[first + i] >= 0) {
+	    sectors[n] = owner[first + i];
+	    bcopy(&segment[i * SectorSize], &copies[n * SectorSize],
+		  SectorSize);
+	    n++;
+	}
+    ASSERT(n == live[victim]);
+    DEBUG(dbgFile, "Cleaning log segment " << victim << ", " << n
+		   << " live sectors");
+    Write(sectors, n, copies, TRUE);
+    ASSERT(live[victim] == 0);
+    delete [] segment;
+    delete [] copies;
+    numCleaned++;
+    numCopied += n;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::WriteCheckpoint
+// 	Write the map and the head, with one request.  The segments
+//	written since the last checkpoint, but for the head's, are no
+//	longer needed to roll forward.
+//----------------------------------------------------------------------
+
+void
+LogVolume::WriteCheckpoint()
+{
+    char *buffer = new char[(1 + mapSectors) * SectorSize];
+    LogCheckpoint *checkpoint = (LogCheckpoint *) buffer;
+
+    bzero(buffer, (1 + mapSectors) * SectorSize);
+    checkpoint->magic = LogMagic;
+    checkpoint->numSectors = numSectors;
+    checkpoint->seq = seq;
+    checkpoint->head = head;
+    bcopy((char *) map, buffer + SectorSize, numSectors * sizeof(int));
+    disk->PhysicalRequest(0, 1 + mapSectors, buffer, TRUE);
+    delete [] buffer;
+    for (int i = 0; i < numSegments; i++)
+	inChain[i] = FALSE;
+    inChain[SegmentOf(head)] = TRUE;
+    numCheckpoints++;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::SetMapping
+// 	Record that the latest copy of volume sector "sector" is at
+//	"where" in the log; the copy it had before is dead.
+//----------------------------------------------------------------------
+
+void
+LogVolume::SetMapping(int sector, int where)
+{
+    int old = map[sector];
+
+    ASSERT(sector >= 0 && sector < numSectors);
+    if (old >= 0) {
+	owner[old] = -1;
+	live[SegmentOf(old)]--;
+    }
+    map[sector] = where;
+    owner[where] = sector;
+    live[SegmentOf(where)]++;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::IsFree
+// 	Return TRUE if "segment" can be written: it is in the log, has no
+//	live sectors, is not the one being filled, and has not been
+//	written since the last checkpoint.
+//----------------------------------------------------------------------
+
+bool
+LogVolume::IsFree(int segment)
+{
+    return segment >= firstSegment && live[segment] == 0 &&
+	   !inChain[segment] && segment != SegmentOf(head);
+}
+
+//----------------------------------------------------------------------
+// LogVolume::NumFree/NumEmptied
+// 	Return how many segments can be written now, and how many more
+//	could after a checkpoint.
+//----------------------------------------------------------------------
+
+int
+LogVolume::NumFree()
+{
+    int n = 0;
+
+    for (int s = firstSegment; s < numSegments; s++)
+	if (IsFree(s))
+	    n++;
+    return n;
+}
+
+int
+LogVolume::NumEmptied()
+{
+    int n = 0;
+
+    for (int s = firstSegment; s < numSegments; s++)
+	if (live[s] == 0 && inChain[s] && s != SegmentOf(head))
+	    n++;
+    return n;
+}
+
+//----------------------------------------------------------------------
+// LogVolume::Print
+// 	Print the shape of the log, and what it did.
+//----------------------------------------------------------------------
+
+void
+LogVolume::Print()
+{
+    printf("Log: %d sectors on %d segments, %d free; records %d, "
+	   "rolled forward %d, checkpoints %d\n", numSectors,
+	   numSegments - firstSegment, NumFree(), numRecords, numRolled,
+	   numCheckpoints);
+    printf("Log cleaning: segments %d, live sectors copied %d\n",
+	   numCleaned, numCopied);
+}
@@ -0,0 +1,168 @@
+// logvolume.h
+//	Data structures for a log-structured volume: the sectors the file
+//	system sees are not where it writes them, and every write is
+//	appended to a log instead.
+//
+//	A disk formatted with -fl is split into segments of a track each.
+//	The first segments hold the checkpoint; the rest hold the log.
+//	Each write goes at the head of the log, in the segment being
+//	filled, as a record: a summary sector naming the volume sectors
+//	the record holds, and then their data, in one disk request.  So
+//	small writes scattered over the volume -- headers, directories,
+//	the bitmap -- become one stream of sequential ones; the buffer
+//	cache hands over all its dirty sectors at once, as one record.
+//	A record goes where the disk head will be soonest: at the head of
+//	the log, or a few sectors on if the disk has turned past it since
+//	the last record was written there.  A map from
+//	each volume sector to where its latest copy is in the log (the
+//	LFS inode map, one level down: it locates file headers as it
+//	does everything else) is kept in memory, and written with the
+//	checkpoint.
+//
+//	A copy that has been written again, anywhere, is dead.  When
+//	few segments are left with no live copies in them, a cleaner
+//	thread picks the segments with the fewest live copies, writes
+//	those at the head again, and the segments can be reused.  As the
+//	file system never says which sectors it has freed, a sector once
+//	written stays live until it is written again; that is why the
+//	volume only holds LogFill percent of the log.
+//
+//	A checkpoint writes the map, and where the head of the log is.
+//	It is taken when the volume is unmounted, and when segments
+//	emptied since the last one are needed.  Mounting reads it, and
+//	then rolls forward through the records written after it, in
+//	order, following the head from segment to segment: so a write is
+//	on disk, to stay, when its request is done, as the journal needs.
+//	A segment emptied since the last checkpoint is not reused until
+//	the next one: the records in it are needed to get from it to the
+//	head.
+//
+//	Requests are served one at a time, under a lock: there is only
+//	one head of the log to write at.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef LOGVOLUME_H
+#define LOGVOLUME_H
+
+#include "disk.h"
+#include "synch.h"
+
+#define SegmentSectors	SectorsPerTrack	// sectors in a segment
+#define LogFill		75		// percent of the log's data sectors
+					// the volume holds
+#define LogMagic	0x4c4f4731	// marks the checkpoint of a log
+#define RecordMagic	0x4c524331	// and the summary of each record
+#define RecordSectors	((int) (SectorSize / sizeof(int)) - 3)
+					// data sectors a record can hold
+#define CleanLow	4		// free segments that wake the cleaner
+#define CleanHigh	8		// and that it stops at
+
+class SynchDisk;
+
+// The following class defines the sector at the start of the
+// checkpoint; the map follows it, an int for each sector of the volume.
+
+class LogCheckpoint {
+  public:
+    int magic;				// LogMagic
+    int numSectors;			// Sectors of the volume
+    int seq;				// Number of the next record
+    int head;				// Where it goes
+};
+
+// The following class defines the summary sector at the start of each
+// record.
+
+class LogSummary {
+  public:
+    int magic;				// RecordMagic
+    int seq;				// Which record this is
+    int count;				// Data sectors after this one
+    int sectors[RecordSectors];		// and which volume sectors they are
+};
+
+// The following class defines a log-structured volume, on the
+// "physSectors" sectors of "disk".
+
+class LogVolume {
+  public:
+    LogVolume(SynchDisk *disk, int physSectors);
+    ~LogVolume();
+
+    static bool IsLog(SynchDisk *disk);	// Was the disk formatted with
+					// a log?
+    int NumSectors() { return numSectors; }
+    					// Sectors of the volume
+
+    void Format();			// Start an empty log
+    void Recover();			// Read the checkpoint, and roll
+					// forward from it
+    void StartCleaner();		// Fork the cleaner thread
+    void Cleaner();			// What it does, forever
+
+    void Request(int sector, int count, char *data, bool writing);
+    					// Read or write volume sectors
+    void WriteGathered(int *sectors, int count, char *data);
+    					// Write the listed ones
+    void Checkpoint();			// Write the map and the head
+
+    void Print();			// Print what the log did
+
+  private:
+    void Read(int sector, int count, char *data);
+    void Write(int *sectors, int count, char *data, bool cleaning);
+    					// Append the "count" sectors to
+					// the log, as records
+    int Skip();				// Sectors after the head that the
+					// disk has already turned past
+    int FindRecord(char *found);	// Where the next record is after
+					// the head, while rolling forward
+    void NextSegment(bool cleaning);	// Move the head to a free segment
+    void MakeRoom();			// Free segments until a writer may
+					// take one
+    bool CleanOne(int most);		// Empty the segment with the fewest
+					// live sectors, if at most "most"
+    void WriteCheckpoint();
+    void SetMapping(int sector, int where);
+    					// The latest copy of "sector" is
+					// at "where"
+    int SegmentOf(int where) { return where / SegmentSectors; }
+    int Room() { return SegmentSectors - 1 - head % SegmentSectors; }
+    					// Sectors left for records in the
+					// head's segment
+    bool IsFree(int segment);		// Can "segment" be written?
+    int NumFree();			// Segments that can
+    int NumEmptied();			// Those that will be, after the
+					// next checkpoint
+
+    SynchDisk *disk;			// Where the log is
+    Lock *lock;				// One request at a time
+    Semaphore *wakeup;			// Wakes the cleaner
+    Thread *cleaner;			// or NULL, before it is forked
+    bool cleanPending;			// Has it been woken?
+    int numSectors;			// Sectors of the volume
+    int numSegments;			// Segments of the disk
+    int firstSegment;			// the first of them in the log
+    int mapSectors;			// Sectors the map takes
+    int *map;				// Where each volume sector's latest
+					// copy is, or -1 if never written
+    int *owner;				// Which volume sector each disk
+					// sector is the latest copy of, or -1
+    int *live;				// Live copies in each segment
+    bool *inChain;			// Written since the last checkpoint?
+    int head;				// Where the next record goes
+    int seq;				// and its number
+
+    int numRecords;			// Records written
+    int numRolled;			// and rolled forward at mount
+    int numCheckpoints;			// Checkpoints written
+    int numCleaned;			// Segments cleaned
+    int numCopied;			// Live sectors they had
+};
+
+#endif // LOGVOLUME_H
@@ -16,31 +16,82 @@
 #include "main.h"
 #include "filehdr.h"
 #include "openfile.h"
-#include "synchdisk.h"
+#include "bufcache.h"
+#include "ftable.h"
+#include "synch.h"
+#include "frames.h"
+#include "compress.h"
+#include "slab.h"
+
+// where OpenFiles are allocated from: one is made and deleted for each
+// directory a path name goes through, as well as for each Open
+static SlabCache openFileCache("open files", sizeof(OpenFile));
+
+//----------------------------------------------------------------------
+// HashSector
+// 	Return the hash of a sector's worth of data, for the dedup index
+//	(see PersistentBitmap::NoteContents): FNV-1a, folded to 16 bits,
+//	and never 0.
+//----------------------------------------------------------------------
+
+static int
+HashSector(char *data)
+{
+    unsigned int hash = 2166136261u;
+
+    for (int i = 0; i < SectorSize; i++)
+	hash = (hash ^ (unsigned char) data[i]) * 16777619u;
+    return (hash ^ (hash >> 16)) % 0xffff + 1;
+}
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
-// 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+// 	Open a Nachos file for reading and writing.  The file header is
+//	kept in memory while the file is open, shared with everyone else
+//	who has the file open (see ftable.h).
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 { 
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    hdr = kernel->fileTable->Acquire(sector);
+    hdrSector = sector;
+    rwLock = kernel->fileTable->LockOf(sector);
     seekPosition = 0;
+    raNext = raWindow = raEnd = 0;
+    raHits = raMisses = 0;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	If this was the file's last opener, the sectors WriteAt allocated
+//	ahead, and did not use, are given back, and the header is written
+//	back.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    kernel->fileTable->Release(hdrSector);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::operator new, OpenFile::operator delete
+// 	Allocate an open file from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+OpenFile::operator new(size_t size)
+{
+    ASSERT(size == sizeof(OpenFile));
+    return openFileCache.Alloc();
+}
+
+void
+OpenFile::operator delete(void *object)
+{
+    openFileCache.Free(object);
 }
 
 //----------------------------------------------------------------------
@@ -97,13 +148,72 @@ OpenFile::Write(char *into, int numBytes)
 //	sector at a time.  Thus:
 //
 //	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   The whole sectors of the request are read straight into the
+//	   caller's buffer; of a partial sector, only the part we are
+//	   interested in is copied out of the buffer cache.
 //	For WriteAt:
 //	   We must first read in any sectors that will be partially written,
 //	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   in the data that will be modified, and write them back.  The
+//	   whole sectors in between are written straight from the caller's
+//	   buffer, without being read or copied first.
+//
+//	A write past the end of the file first grows it.  The file gets
+//	spare sectors beyond the new end -- as many as it has, between
+//	MinGrowth and MaxGrowth -- so a stream of small appends does not
+//	allocate (and write the header) for every sector.  A write that
+//	starts past the end leaves a hole in between.  If the disk is
+//	full, only the part that fits in the file is written.
+//
+//	A write of at least MinWriteThrough sectors goes straight through
+//	to the disk, a run of consecutive sectors with each request,
+//	rather than waiting in the buffer cache for write-behind.
+//
+//	Holes read as zeros.  Writing to one first gives it a sector (see
+//	FileHeader::FillHole); the rest of that sector starts out as zeros
+//	rather than being read.  Likewise, writing to a sector the file
+//	shares with a snapshot first moves the file's part of it to a
+//	sector of its own (see FileHeader::Unshare), so the snapshot keeps
+//	the old data.
+//
+//	A file whose data is inline in its header is simply copied to or
+//	from the header.  WriteAt only marks a header it changes dirty in
+//	the file table; it goes to disk at the last close or next sync.
+//
+//	Sectors above the file's high-water mark have never been written:
+//	ReadAt returns zeros for them without going to the disk, and
+//	WriteAt starts from zeros instead of reading them.  A write that
+//	starts above the mark zeroes the sectors it skips over, then
+//	raises the mark.
+//
+//	A compressed file is read and written a chunk at a time instead
+//	(see ReadChunks and WriteChunks).  A file whose index maps blocks
+//	of several sectors is read from the disk a whole block at a time
+//	(see ReadBlocks).
+//
+//	In the dedup mode (see FileSystem::StartDedup), a sector about to
+//	be written with bytes that another sector already holds shares
+//	that one instead (see ShareCopy), and the sectors that are written
+//	are noted in the dedup index by the hash of their contents.
+//
+//	In the delayed allocation mode (see FileSystem::StartDelayedAllocation),
+//	a write past the last data sector of the file keeps that part in
+//	the in-core header instead (see WriteDelayed), and a read of it
+//	copies it from there.  Any other write that reaches past the last
+//	data sector has the data given its sectors first.
+//
+//	The pages of a file that frames of memory hold -- as a program
+//	has it mapped, or as an executable being run -- are the file's
+//	page cache, and may be newer than its sectors (see frames.h).
+//	ReadAt copies from them whatever they hold of the request, without
+//	going to the buffer cache at all if they hold all of it; WriteAt
+//	copies what it writes into them.
+//
+//	All the openers of a file share its reader-writer lock: ReadAt
+//	holds it for reading, so reads of the file go on at the same
+//	time, and WriteAt for writing, so a write has the file to itself.
+//	The transfers themselves are ReadLocked and WriteLocked; past the
+//	page cache, reads are ReadStored.
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -114,10 +224,154 @@ OpenFile::Write(char *into, int numBytes)
 
 int
 OpenFile::ReadAt(char *into, int numBytes, int position)
+{
+    int numRead;
+
+    rwLock->AcquireRead();
+    numRead = ReadLocked(into, numBytes, position);
+    rwLock->ReleaseRead();
+    return numRead;
+}
+
+int
+OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    int numWritten;
+
+    rwLock->AcquireWrite();
+    numWritten = WriteLocked(from, numBytes, position);
+    rwLock->ReleaseWrite();
+    return numWritten;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::CopyFrom
+// 	Write "numBytes" bytes of the file "source", starting at "from",
+//	to this file at "position", as WriteAt would, and return how many
+//	were written: fewer if "source" ends first, or the disk fills up.
+//	The bytes never leave the kernel.  Where both files are at the
+//	start of a sector, whole sectors go from the source's buffers in
+//	the cache straight to the destination's (see CopySectors); any
+//	other bytes are staged through a kernel buffer, MaxCopy sectors
+//	at a time.  The staged part before the first sector boundary of
+//	the destination is kept short, so that the rest can go sector to
+//	sector if both files are at the same offset in their sectors.
+//
+//	The source is held for reading and this file for writing -- the
+//	one with the lower header sector first, so that two copies the
+//	other way round cannot deadlock.  A file copied to itself is
+//	held just for writing, and is always staged, and so is a
+//	compressed file, whose sectors do not hold its bytes as they are,
+//	the part of the source waiting for delayed allocation, and a file
+//	that frames may hold pages of, whose sectors may be out of date,
+//	or whose frames must see what is written.
+//----------------------------------------------------------------------
+
+int
+OpenFile::CopyFrom(OpenFile *source, int from, int numBytes, int position)
+{
+    Arena *scratch = kernel->currentThread->Scratch();
+    ArenaMark mark(scratch);
+    bool same = (source->hdrSector == hdrSector);
+    char *buf = scratch->Alloc(MaxCopy * SectorSize);
+    int done = 0;
+
+    if (same) {
+	rwLock->AcquireWrite();
+    } else if (source->hdrSector < hdrSector) {
+	source->rwLock->AcquireRead();
+	rwLock->AcquireWrite();
+    } else {
+	rwLock->AcquireWrite();
+	source->rwLock->AcquireRead();
+    }
+    if (from < 0 || position < 0)
+	numBytes = 0;				// check request
+    else
+	numBytes = min(numBytes, source->hdr->FileLength() - from);
+    while (done < numBytes) {
+	int n = min(numBytes - done, MaxCopy * SectorSize);
+	int at = (position + done) % SectorSize;
+	int written;
+
+	if (!same && at == 0 && (from + done) % SectorSize == 0 &&
+		n >= SectorSize && !source->hdr->IsInline() &&
+		!source->hdr->IsCompressed() && !hdr->IsCompressed() &&
+		from + done + n <= source->hdr->AllocatedLength() &&
+		!kernel->frameAllocator->HoldsFile(source->hdrSector) &&
+		!kernel->frameAllocator->HoldsFile(hdrSector)) {
+	    n -= n % SectorSize;
+	    written = WriteLocked(NULL, n, position + done, source,
+				  from + done);
+	} else {
+	    if (at != 0)
+		n = min(n, SectorSize - at);
+	    n = source->ReadLocked(buf, n, from + done);
+	    written = WriteLocked(buf, n, position + done);
+	}
+	done += written;
+	if (written < n || n == 0)
+	    break;
+    }
+    if (!same)
+	source->rwLock->ReleaseRead();
+    rwLock->ReleaseWrite();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadPage
+// 	ReadAt, for a page of the file being read into a frame of memory
+//	(see frames.h).  The frame holds the bytes from now on, so the
+//	buffer cache is told to replace the sectors read first, rather
+//	than keep them twice.
+//----------------------------------------------------------------------
+
+int
+OpenFile::ReadPage(char *into, int numBytes, int position)
+{
+    int numRead, last;
+
+    rwLock->AcquireRead();
+    numRead = ReadLocked(into, numBytes, position);
+    if (numRead > 0 && !hdr->IsInline() && !hdr->IsCompressed()) {
+	last = min(divRoundDown(position + numRead - 1, SectorSize),
+		   hdr->HighWater() - 1);
+	for (int i = divRoundDown(position, SectorSize); i <= last; i++) {
+	    int sector = hdr->ByteToSector(i * SectorSize);
+
+	    if (sector >= 0)
+		kernel->bufferCache->Demote(sector);
+	}
+    }
+    rwLock->ReleaseRead();
+    return numRead;
+}
+
+int
+OpenFile::ReadLocked(char *into, int numBytes, int position)
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    int fileLength = hdr->FileLength();
+
+    if ((numBytes <= 0) || (position >= fileLength))
+    	return 0; 				// check request
+    if ((position + numBytes) > fileLength)
+	numBytes = fileLength - position;
+    if (frames->CopyCached(hdrSector, into, numBytes, position, TRUE)) {
+	kernel->stats->numPageCacheHits++;
+	return numBytes;
+    }
+    numBytes = ReadStored(into, numBytes, position);
+    frames->CopyCached(hdrSector, into, numBytes, position, FALSE);
+    return numBytes;
+}
+
+int
+OpenFile::ReadStored(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
+    int i, run, firstSector, lastSector, lastWritten;
 
     if ((numBytes <= 0) || (position >= fileLength))
     	return 0; 				// check request
@@ -125,66 +379,670 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 	numBytes = fileLength - position;
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
+    if (hdr->HasDelayed() && position + numBytes > hdr->AllocatedLength()) {
+	int split = max(position, hdr->AllocatedLength());
+
+	if (split > position)
+	    ReadStored(into, split - position, position);
+	hdr->ReadDelayed(into + split - position, position + numBytes - split,
+			 split);
+	return numBytes;
+    }
+
+    if (hdr->IsInline()) {			// the data is in the header
+	hdr->ReadInline(into, numBytes, position);
+	return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    ReadAhead(firstSector, lastSector);
+    if (hdr->IsCompressed())
+	return ReadChunks(into, numBytes, position);
+    ReadBlocks(firstSector, lastSector);
 
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete [] buf;
+    // read the sectors we need straight into "into", a run of sectors
+    // that are consecutive on disk at a time; holes, and the sectors
+    // that were never written, are zeros
+    lastWritten = min(lastSector, hdr->HighWater() - 1);
+    for (i = firstSector; i <= lastSector; i += run) {
+	int sector = (i <= lastWritten) ? hdr->ByteToSector(i * SectorSize)
+					: -1;
+	run = 1;
+	if (sector >= 0)
+	    for (; i + run <= lastWritten; run++)
+		if (hdr->ByteToSector((i + run) * SectorSize) != sector + run)
+		    break;
+	int start = max(position, i * SectorSize);
+	int end = min(position + numBytes, (i + run) * SectorSize);
+	if (sector < 0)
+	    memset(&into[start - position], 0, end - start);
+	else
+	    ReadRun(sector, start - i * SectorSize, end - start,
+		    &into[start - position]);
+    }
     return numBytes;
 }
 
 int
-OpenFile::WriteAt(char *from, int numBytes, int position)
+OpenFile::WriteLocked(char *from, int numBytes, int position,
+		      OpenFile *source, int sourcePos)
 {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
+    int numWritten;
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    if (numBytes <= 0 || position < 0)
 	return 0;				// check request
-    if ((position + numBytes) > fileLength)
-	numBytes = fileLength - position;
+    if (from != NULL && kernel->fileSystem != NULL &&
+	    kernel->fileSystem->DelayingAllocation() &&
+	    !hdr->IsCompressed() && position <= hdr->FileLength() &&
+	    position + numBytes > hdr->AllocatedLength() &&
+	    (hdr->HasDelayed() || !hdr->IsInline() ||
+	     position + numBytes > MaxInlineSize)) {
+	numWritten = WriteDelayed(from, numBytes, position);
+    } else {
+	if (hdr->HasDelayed() && (hdr->IsInline() ||
+			position + numBytes > hdr->AllocatedLength()))
+	    AllocateLocked();
+	numWritten = WriteAllocating(from, numBytes, position, source,
+				     sourcePos);
+    }
+    // CopyFrom's whole sectors only go to files no frame holds
+    if (from != NULL)
+	kernel->frameAllocator->FileWritten(hdrSector, from, numWritten,
+					    position);
+    return numWritten;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WriteDelayed
+// 	WriteLocked, in the delayed allocation mode, for a write that
+//	goes past the last data sector of the file, and starts inside the
+//	file: the part up to the end of that sector is written as usual,
+//	and the rest is kept in the in-core header (see
+//	FileHeader::DelayWrite).  If it does not fit there, or its
+//	sectors cannot be reserved, the data already kept is given its
+//	sectors, and the rest is tried again past them; if there was none,
+//	the rest is written as usual.
+//----------------------------------------------------------------------
+
+int
+OpenFile::WriteDelayed(char *from, int numBytes, int position)
+{
+    int split = max(position, hdr->AllocatedLength());
+    int done = 0;
+
+    if (split > position) {
+	done = WriteAllocating(from, split - position, position);
+	if (done < split - position)
+	    return done;
+    }
+    if (hdr->DelayWrite(kernel->fileSystem->FreeMap(), from + done,
+			numBytes - done, split))
+	return numBytes;
+    if (!hdr->HasDelayed())
+	return done + WriteAllocating(from + done, numBytes - done, split);
+    AllocateLocked();				// and start over from there
+    return done + WriteLocked(from + done, numBytes - done, split);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::AllocateLocked
+// 	Give the data waiting for delayed allocation its sectors, with the
+//	file held for writing (see FileHeader::AllocateDelayed).
+//----------------------------------------------------------------------
+
+void
+OpenFile::AllocateLocked()
+{
+    if (hdr->HasDelayed()) {
+	hdr->AllocateDelayed(kernel->fileSystem->FreeMap(), hdrSector + 1);
+	kernel->fileTable->MarkDirty(hdrSector);
+    }
+}
+
+int
+OpenFile::WriteAllocating(char *from, int numBytes, int position,
+			  OpenFile *source, int sourcePos)
+{
+    int fileLength = hdr->FileLength();
+    int i, run, firstSector, lastSector, numSectors, highWater;
+    int firstWhole, lastWhole;
+    bool firstAligned, lastAligned, firstFresh, lastFresh, changed, dedup;
+    PersistentBitmap *freeMap;
+
+    // there is no file system yet while it formats or mounts the disk
+    freeMap = (kernel->fileSystem != NULL) ? kernel->fileSystem->FreeMap()
+					   : NULL;
+    if (hdr->IsCompressed())
+	return WriteChunks(from, numBytes, position, freeMap);
+    if ((position + numBytes) > fileLength) {	// grow the file
+	int spare = min(max(divRoundUp(fileLength, SectorSize), MinGrowth),
+			MaxGrowth);
+	if (position > fileLength &&
+		hdr->ExtendSparse(freeMap, position, hdrSector + 1))
+	    fileLength = position;		// a hole up to the write
+	if (hdr->Extend(freeMap, position + numBytes, hdrSector + 1, spare))
+	    fileLength = position + numBytes;
+	kernel->fileTable->MarkDirty(hdrSector);
+	if (position >= fileLength)
+	    return 0;
+	numBytes = min(numBytes, fileLength - position);
+    }
+    if (from == NULL) {			// whole sectors only
+	numBytes -= numBytes % SectorSize;
+	if (numBytes == 0)
+	    return 0;
+    }
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
+    if (hdr->IsInline()) {			// the data is in the header
+	ASSERT(from != NULL);		// a sector would not fit
+	hdr->WriteInline(from, numBytes, position);
+	kernel->fileTable->MarkDirty(hdrSector);
+	return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
+
+// note which of the end sectors hold no data yet, then give the holes
+// we write to a sector each, and the sectors shared with a snapshot a
+// copy of their own -- of their data too, if only part of one is
+// written; if the disk fills up, stop short of them
+    highWater = hdr->HighWater();
+    firstFresh = (firstSector >= highWater ||
+		  hdr->ByteToSector(firstSector * SectorSize) < 0);
+    lastFresh = (lastSector >= highWater ||
+		 hdr->ByteToSector(lastSector * SectorSize) < 0);
+    changed = FALSE;
+    for (i = firstSector; i <= lastSector; i++) {
+	int sector = hdr->ByteToSector(i * SectorSize);
+	bool partial = (i == firstSector && position % SectorSize != 0) ||
+		(i == lastSector && (position + numBytes) % SectorSize != 0);
+	bool done;
+
+	if (sector >= 0 && (freeMap == NULL || !freeMap->IsShared(sector)))
+	    continue;
+	if (sector < 0)
+	    done = hdr->FillHole(freeMap, i, hdrSector + 1);
+	else
+	    done = hdr->Unshare(freeMap, i, hdrSector + 1,
+				partial && i < highWater);
+	if (!done) {
+	    if (i == firstSector)
+		return 0;
+	    numBytes = i * SectorSize - position;
+	    lastSector = i - 1;
+	    break;
+	}
+	changed = TRUE;
+    }
     numSectors = 1 + lastSector - firstSector;
 
-    buf = new char[numSectors * SectorSize];
-	
-	// Mp4 mod tag
-	memset(buf, 0, sizeof(char) * numSectors * SectorSize); // dummy operation to keep valgrind happy
+// what the sectors held is about to change, so the dedup index must
+// not offer them for the data written to the others
+    if (freeMap != NULL && freeMap->HasIndex())
+	for (i = firstSector; i <= lastSector; i++)
+	    freeMap->ForgetContents(hdr->ByteToSector(i * SectorSize));
+    dedup = (from != NULL && kernel->fileSystem != NULL &&
+	     kernel->fileSystem->Deduplicating() &&
+	     hdr->Layout() == IndexLayout);
 
     firstAligned = (position == (firstSector * SectorSize));
     lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
 
-// read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
-
-// copy in the bytes we want to change 
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
-
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
-    delete [] buf;
+// the partial first and last sectors are staged through the cache,
+// starting from their old contents if they hold data
+    firstWhole = firstSector;
+    lastWhole = lastSector;
+    if (!firstAligned || (firstSector == lastSector && !lastAligned)) {
+	WritePartial(firstSector, firstFresh, from, numBytes, position, dedup);
+	firstWhole++;
+    }
+    if (!lastAligned && lastSector != firstSector) {
+	WritePartial(lastSector, lastFresh, from, numBytes, position, dedup);
+	lastWhole--;
+    }
+
+// in the dedup mode, the whole sectors that some sector on disk already
+// holds share it instead of being written (see ShareCopy)
+    if (dedup)
+	for (i = firstWhole; i <= lastWhole; i++)
+	    ShareCopy(freeMap, i, from + i * SectorSize - position);
+
+// the whole sectors in between go straight from the caller's buffer (or
+// the source's, for CopyFrom); a big write goes to disk at once, a run
+// of sectors that are consecutive on disk at a time
+    for (i = firstWhole; i <= lastWhole; i += run) {
+	int sector = hdr->ByteToSector(i * SectorSize);
+	int offset = i * SectorSize - position;
+	run = 1;
+	if (dedup && freeMap->IsShared(sector))
+	    continue;				// shared a copy
+	for (; i + run <= lastWhole; run++)
+	    if (hdr->ByteToSector((i + run) * SectorSize) != sector + run ||
+		    (dedup && freeMap->IsShared(sector + run)))
+		break;
+	if (from == NULL)
+	    CopySectors(source, sourcePos + offset, sector, run);
+	else if (numSectors >= MinWriteThrough)
+	    kernel->bufferCache->WriteSectors(sector, run, from + offset);
+	else
+	    for (int j = 0; j < run; j++)
+		kernel->bufferCache->WriteSector(sector + j,
+					from + offset + j * SectorSize);
+	if (dedup)
+	    for (int j = 0; j < run; j++)
+		freeMap->NoteContents(sector + j,
+				HashSector(from + offset + j * SectorSize));
+    }
+
+// zero the unwritten sectors we skipped (holes need not be), and raise
+// the high-water mark
+    if (lastSector >= highWater) {
+	char emptybuf[SectorSize] = {0};
+	for (i = highWater; i < firstSector; i++)
+	    if (hdr->ByteToSector(i * SectorSize) >= 0)
+		kernel->bufferCache->WriteSector(
+			hdr->ByteToSector(i * SectorSize), emptybuf);
+	hdr->SetHighWater(lastSector + 1);
+	changed = TRUE;
+    }
+    if (changed)
+	kernel->fileTable->MarkDirty(hdrSector);
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadChunks/WriteChunks
+// 	ReadLocked and WriteLocked, for a compressed file: each chunk the
+//	request touches is decompressed into a buffer (see ReadChunk).  A
+//	read copies its part out; a write copies its part in, and stores
+//	the chunk again (see StoreChunk).  A chunk that a write covers up
+//	to the end of the file is not read first.  If the disk fills up,
+//	the write stops short of the chunk that does not fit.
+//
+//	The compressed sectors are read and written through the buffer
+//	cache, and read ahead, like those of any other file; only there
+//	are fewer of them.
+//----------------------------------------------------------------------
+
+int
+OpenFile::ReadChunks(char *into, int numBytes, int position)
+{
+    char buf[ChunkSize];
+
+    for (int c = position / ChunkSize; c * ChunkSize < position + numBytes;
+	    c++) {
+	int start = max(position, c * ChunkSize);
+	int end = min(position + numBytes, (c + 1) * ChunkSize);
+
+	ReadChunk(c, buf);
+	bcopy(&buf[start - c * ChunkSize], &into[start - position],
+	      end - start);
+    }
     return numBytes;
 }
 
+int
+OpenFile::WriteChunks(char *from, int numBytes, int position,
+		      PersistentBitmap *freeMap)
+{
+    char buf[ChunkSize];
+    int done = 0;
+
+    ASSERT(from != NULL);			// CopyFrom stages it
+    for (int c = position / ChunkSize; c * ChunkSize < position + numBytes;
+	    c++) {
+	int start = max(position, c * ChunkSize);
+	int end = min(position + numBytes, (c + 1) * ChunkSize);
+	int length = max(hdr->FileLength(), end);
+
+	if (start > c * ChunkSize ||
+		end < min(hdr->FileLength(), (c + 1) * ChunkSize))
+	    ReadChunk(c, buf);			// keep the rest of it
+	else
+	    memset(buf, 0, ChunkSize);
+	bcopy(&from[start - position], &buf[start - c * ChunkSize],
+	      end - start);
+	if (!StoreChunk(freeMap, c, buf, min(length - c * ChunkSize,
+					     ChunkSize)))
+	    break;
+	done = end - position;
+    }
+    DEBUG(dbgFile, "Wrote " << done << " bytes at " << position
+		   << " to a compressed file of length " << hdr->FileLength());
+    if (done > 0)
+	kernel->fileTable->MarkDirty(hdrSector);
+    return done;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadChunk
+// 	Read chunk "chunk" of a compressed file into "buf", ChunkSize
+//	bytes, zeros past the end of the file.  The chunk's sectors up to
+//	the first hole hold it: none, for a hole; all SectorsPerChunk, for
+//	a chunk stored as it is; or else its compressed length, in two
+//	bytes, and the compressed data.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadChunk(int chunk, char *buf)
+{
+    char packedBuf[ChunkSize], *stored = packedBuf;
+    int first = chunk * SectorsPerChunk;
+    int count, run, packed, numBytes;
+
+    for (count = 0; count < SectorsPerChunk; count++)
+	if (hdr->ByteToSector((first + count) * SectorSize) < 0)
+	    break;
+    if (count == 0) {
+	memset(buf, 0, ChunkSize);
+	return;
+    }
+    if (count == SectorsPerChunk)
+	stored = buf;				// as it is
+    for (int i = 0; i < count; i += run) {
+	int sector = hdr->ByteToSector((first + i) * SectorSize);
+	for (run = 1; i + run < count; run++)
+	    if (hdr->ByteToSector((first + i + run) * SectorSize) !=
+		    sector + run)
+		break;
+	kernel->bufferCache->ReadSectors(sector, run, &stored[i * SectorSize]);
+    }
+    if (count == SectorsPerChunk)
+	return;
+    packed = (unsigned char) stored[0] | ((unsigned char) stored[1] << 8);
+    ASSERT(packed + 2 <= count * SectorSize);
+    numBytes = Decompress(&stored[2], packed, buf, ChunkSize);
+    ASSERT(numBytes >= 0);
+    memset(&buf[numBytes], 0, ChunkSize - numBytes);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::StoreChunk
+// 	Store chunk "chunk" of a compressed file, the first "numBytes"
+//	bytes of "buf" (the rest is zeroed), growing the file if it ends
+//	there.  The chunk is compressed into as few sectors as it will go,
+//	or stored as it is if that does not save one.  Its holes are given
+//	sectors, and its shared sectors copies of their own, and the
+//	sectors it no longer needs are given back.  Return FALSE, leaving
+//	the file as it was, if the disk is too full.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::StoreChunk(PersistentBitmap *freeMap, int chunk, char *buf,
+		     int numBytes)
+{
+    char stored[ChunkSize];
+    char *data = stored;
+    int first = chunk * SectorsPerChunk;
+    int count, packed, needed = 0;
+    bool done;
+
+    if (first + SectorsPerChunk > MaxFileSectors)
+	return FALSE;				// past the largest file
+    memset(&buf[numBytes], 0, ChunkSize - numBytes);
+    packed = Compress(buf, numBytes, &stored[2],
+		      (SectorsPerChunk - 1) * SectorSize - 2);
+    if (packed < 0) {				// store it as it is
+	count = SectorsPerChunk;
+	data = buf;
+    } else {
+	stored[0] = packed & 0xff;
+	stored[1] = packed >> 8;
+	count = divRoundUp(packed + 2, SectorSize);
+	memset(&stored[2 + packed], 0, count * SectorSize - 2 - packed);
+    }
+
+    // make sure all the new sectors (and the index blocks of up to two
+    // leaves of the index tree) can be had, before changing anything
+    for (int i = first; i < first + count; i++) {
+	int sector = hdr->ByteToSector(i * SectorSize);
+	if (sector < 0 || freeMap->IsShared(sector))
+	    needed++;
+    }
+    if (needed > 0 && freeMap->NumFree() < needed + 2 * NumIndirectLevels)
+	return FALSE;
+    if (chunk * ChunkSize + numBytes > hdr->FileLength()) {
+	done = hdr->ExtendSparse(freeMap, chunk * ChunkSize + numBytes,
+				 hdrSector + 1);
+	ASSERT(done);
+    }
+
+    for (int i = first; i < first + count; i++) {
+	int sector = hdr->ByteToSector(i * SectorSize);
+	if (sector < 0) {
+	    done = hdr->FillHole(freeMap, i, hdrSector + 1);
+	    ASSERT(done);
+	} else if (freeMap->IsShared(sector)) {
+	    done = hdr->Unshare(freeMap, i, hdrSector + 1, FALSE);
+	    ASSERT(done);
+	}
+	kernel->bufferCache->WriteSector(hdr->ByteToSector(i * SectorSize),
+					 &data[(i - first) * SectorSize]);
+    }
+    for (int i = first + count; i < first + SectorsPerChunk; i++)
+	hdr->PunchHole(freeMap, i);
+    hdr->SetHighWater(first + count);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::CopySectors
+// 	Write "count" whole sectors of "source", from "sourcePos" on (at
+//	the start of a sector), to the run of disk sectors from "sector"
+//	on, from buffer to buffer in the cache.  Holes in the source, and
+//	its sectors never written, are written as zeros.
+//----------------------------------------------------------------------
+
+void
+OpenFile::CopySectors(OpenFile *source, int sourcePos, int sector, int count)
+{
+    char emptybuf[SectorSize] = {0};
+    FileHeader *srcHdr = source->hdr;
+
+    for (int j = 0; j < count; j++) {
+	int offset = sourcePos + j * SectorSize;
+	int from = srcHdr->ByteToSector(offset);
+
+	if (from >= 0 && offset / SectorSize < srcHdr->HighWater())
+	    kernel->bufferCache->CopySector(from, sector + j);
+	else
+	    kernel->bufferCache->WriteSector(sector + j, emptybuf);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadRun
+// 	Read "numBytes" bytes, starting "offset" bytes into disk sector
+//	"sector", from sectors that are consecutive on disk, into "into".
+//	The whole sectors go straight into "into" with one ReadSectors;
+//	the part of a sector at either end is copied out of the cache.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadRun(int sector, int offset, int numBytes, char *into)
+{
+    if (offset > 0 || numBytes < SectorSize) {	// partial first sector
+	int n = min(numBytes, SectorSize - offset);
+	kernel->bufferCache->ReadPart(sector, offset, n, into);
+	into += n;
+	numBytes -= n;
+	sector++;
+    }
+    int whole = numBytes / SectorSize;
+    if (whole > 0)
+	kernel->bufferCache->ReadSectors(sector, whole, into);
+    if (numBytes % SectorSize > 0)		// partial last sector
+	kernel->bufferCache->ReadPart(sector + whole, 0,
+				      numBytes % SectorSize,
+				      &into[whole * SectorSize]);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WritePartial
+// 	Write the part of a WriteAt request ("numBytes" bytes from "from",
+//	at "position") that falls in file sector "sectorIdx", which it
+//	only partly covers.  The rest of the sector is kept: it is read
+//	from the cache, or is zeros if "fresh" (the sector holds no data
+//	yet).  If "dedup", the sector shares a copy of what it comes to,
+//	if there is one (see ShareCopy).
+//----------------------------------------------------------------------
+
+void
+OpenFile::WritePartial(int sectorIdx, bool fresh, char *from, int numBytes,
+		       int position, bool dedup)
+{
+    char buf[SectorSize];
+    int sector = hdr->ByteToSector(sectorIdx * SectorSize);
+    int start = max(position, sectorIdx * SectorSize);
+    int end = min(position + numBytes, (sectorIdx + 1) * SectorSize);
+
+    if (fresh)
+	memset(buf, 0, SectorSize);
+    else
+	kernel->bufferCache->ReadSector(sector, buf);
+    bcopy(from + (start - position), &buf[start - sectorIdx * SectorSize],
+	  end - start);
+    if (!dedup) {
+	kernel->bufferCache->WriteSector(sector, buf);
+    } else if (!ShareCopy(kernel->fileSystem->FreeMap(), sectorIdx, buf)) {
+	kernel->bufferCache->WriteSector(sector, buf);
+	kernel->fileSystem->FreeMap()->NoteContents(sector, HashSector(buf));
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ShareCopy
+// 	In the dedup mode, before file sector "sectorIdx" is written with
+//	the sector of data at "data": look the data up in the dedup index,
+//	and if a sector on disk holds exactly the same bytes, make the
+//	file share that one (see FileHeader::ShareSector) and return TRUE;
+//	the write can be left out.  Otherwise return FALSE, and the caller
+//	writes the sector, and notes it in the index.
+//
+//	The sectors a write is about to change have been forgotten, so
+//	the copy found is not one of them.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::ShareCopy(PersistentBitmap *freeMap, int sectorIdx, char *data)
+{
+    char buf[SectorSize];
+    int copy = freeMap->FindContents(HashSector(data));
+
+    if (copy < 0 || freeMap->Shares(copy) >= MaxShares)
+	return FALSE;
+    kernel->bufferCache->ReadSector(copy, buf);
+    if (bcmp(buf, data, SectorSize) != 0)
+	return FALSE;				// the same hash, but not data
+    hdr->ShareSector(freeMap, sectorIdx, copy);
+    kernel->fileTable->MarkDirty(hdrSector);
+    kernel->stats->numSectorsDeduplicated++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called by ReadAt before it reads file sectors "firstSector"
+//	through "lastSector".  If the read carries on where the previous
+//	one stopped, count how many of its sectors were read ahead,
+//	double the window (up to MaxReadAhead) and ask the buffer cache
+//	to prefetch the next "raWindow" sectors, so they arrive while
+//	this read and the caller's processing go on.  The window is only
+//	topped up once half of it has been consumed, so the prefetches
+//	go out in runs that the cache can read with one request.  Any
+//	other read is a seek: the window collapses, and nothing is
+//	prefetched until the file is read sequentially again.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead(int firstSector, int lastSector)
+{
+    int i, n, end;
+
+    if (firstSector == raNext || firstSector == raNext - 1) {
+	for (i = raNext; i <= lastSector; i++) {	// the new sectors
+	    if (i < raEnd) {
+		raHits++;
+		kernel->stats->numReadAheadHits++;
+	    } else {
+		raMisses++;
+		kernel->stats->numReadAheadMisses++;
+	    }
+	}
+	if (lastSector >= raNext)
+	    raWindow = (raWindow == 0) ? MinReadAhead
+				       : min(2 * raWindow, MaxReadAhead);
+    } else {
+	DEBUG(dbgFile, "Seek to sector " << firstSector
+			<< ", read-ahead window reset");
+	raWindow = 0;
+	raEnd = lastSector + 1;
+    }
+    raNext = lastSector + 1;
+    if (raEnd - raNext > raWindow / 2)
+	return;			// enough still on the way
+
+    end = min(raNext + raWindow, hdr->HighWater());
+    for (i = max(raEnd, raNext); i < end; i += n) {
+	int sector = hdr->ByteToSector(i * SectorSize);
+	if (sector < 0) {			// a hole, nothing to read
+	    n = 1;
+	    continue;
+	}
+	for (n = 1; i + n < end; n++)
+	    if (hdr->ByteToSector((i + n) * SectorSize) != sector + n)
+		break;
+	kernel->bufferCache->Prefetch(sector, n);
+    }
+    raEnd = max(raEnd, end);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadBlocks
+// 	Called by ReadAt before it reads file sectors "firstSector"
+//	through "lastSector", for a file whose index maps blocks of
+//	several sectors (see FileHeader::BlockSectors): bring the block at
+//	either end that the read only covers part of into the cache whole,
+//	with one request, so that it is read a block at a time however
+//	small the reads are.  The blocks the read covers are read straight
+//	into the caller's buffer, as before.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadBlocks(int firstSector, int lastSector)
+{
+    int blockSectors = hdr->BlockSectors();
+    int first = firstSector & ~(blockSectors - 1);
+    int last = lastSector & ~(blockSectors - 1);
+
+    if (blockSectors == 1)
+	return;
+    if (first < firstSector || first + blockSectors - 1 > lastSector)
+	ReadBlock(first);
+    if (last != first && last + blockSectors - 1 > lastSector)
+	ReadBlock(last);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadBlock
+// 	Bring the block of the file starting at sector "first" into the
+//	cache, up to the high-water mark, unless it is a hole.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadBlock(int first)
+{
+    int sector = hdr->ByteToSector(first * SectorSize);
+    int count = min(hdr->BlockSectors(), hdr->HighWater() - first);
+
+    if (sector >= 0 && count > 0)
+	kernel->bufferCache->ReadSectors(sector, count, NULL);
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -196,4 +1054,101 @@ OpenFile::Length()
     return hdr->FileLength(); 
 }
 
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Grow the file to "newLength" bytes.
+//	Return FALSE, leaving the file unchanged, if the disk is full.
+//
+//	"freeMap" -- the bit map of free disk sectors
+//	"newLength" -- the new length, at least the current one
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Extend(PersistentBitmap *freeMap, int newLength)
+{
+    bool extended;
+
+    rwLock->AcquireWrite();
+    AllocateLocked();
+    extended = hdr->Extend(freeMap, newLength, hdrSector + 1);
+    if (extended)
+	kernel->fileTable->MarkDirty(hdrSector);
+    rwLock->ReleaseWrite();
+    return extended;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::AllocateDelayed
+// 	Give the data of the file waiting for delayed allocation its
+//	sectors now, and write it (see AllocateLocked).
+//----------------------------------------------------------------------
+
+void
+OpenFile::AllocateDelayed()
+{
+    rwLock->AcquireWrite();
+    AllocateLocked();
+    rwLock->ReleaseWrite();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Preallocate
+// 	Give the first "size" bytes of the file their disk sectors now,
+//	in as few runs as the free space allows, growing the file to
+//	"size" bytes unless "keepSize" (see FileHeader::Preallocate).
+//	Return FALSE if they could not all be given.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Preallocate(int size, bool keepSize)
+{
+    bool done;
+
+    rwLock->AcquireWrite();
+    AllocateLocked();
+    done = hdr->Preallocate(kernel->fileSystem->FreeMap(), size,
+			    hdrSector + 1, keepSize);
+    kernel->fileTable->MarkDirty(hdrSector);
+    rwLock->ReleaseWrite();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::BeginUpdate/EndUpdate
+// 	Hold the file for writing from BeginUpdate to EndUpdate, so that
+//	no one else reads or writes it in between: the reads and writes
+//	of a read-modify-write of the file, such as adding an entry to a
+//	directory, then happen as one.  The file's own reads and writes
+//	may be made in between.
+//----------------------------------------------------------------------
+
+void
+OpenFile::BeginUpdate()
+{
+    rwLock->AcquireWrite();
+}
+
+void
+OpenFile::EndUpdate()
+{
+    rwLock->ReleaseWrite();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Sync
+// 	Write whatever the buffer cache holds of this file back to disk:
+//	its data, its index blocks, and then its header -- unless the
+//	journal holds the header until its next commit.  The data waiting
+//	for delayed allocation is given its sectors first.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Sync()
+{
+    AllocateDelayed();
+    kernel->fileTable->WriteBack(hdrSector);
+    hdr->Flush();
+    kernel->bufferCache->FlushSector(hdrSector);
+}
+
 #endif //FILESYS_STUB
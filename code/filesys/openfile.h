@@ -9,9 +9,9 @@
 //
 //	The other is the "real" implementation, that turns these
 //	operations into read and write disk sector requests. 
-//	In this baseline implementation of the file system, we don't 
-//	worry about concurrent accesses to the file system
-//	by different threads.
+//	The openers of a file share a reader-writer lock, so that reads
+//	of the file by different threads go on at once, while a write
+//	has the file to itself.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -52,6 +52,10 @@ class OpenFile {
 		return numWritten;
 		}
 
+    int ReadPage(char *into, int numBytes, int position) {
+		return ReadAt(into, numBytes, position);
+		}
+
     int Length() { Lseek(file, 0, 2); return Tell(file); }
     
   private:
@@ -60,7 +64,19 @@ class OpenFile {
 };
 
 #else // FILESYS
+#define MinReadAhead	2		// sectors read ahead once a file
+					// is being read sequentially
+#define MaxReadAhead	16		// largest read-ahead window
+#define MinGrowth	8		// sectors allocated ahead when a
+#define MaxGrowth	64		// write grows the file: its size,
+					// within these bounds
+#define MinWriteThrough	8		// sectors in a write that goes
+					// straight through to disk
+#define MaxCopy		16		// sectors CopyFrom moves at once
+
 class FileHeader;
+class PersistentBitmap;
+class RWLock;
 
 class OpenFile {
   public:
@@ -68,6 +84,9 @@ class OpenFile {
 					// at "sector" on the disk
     ~OpenFile();			// Close the file
 
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
     void Seek(int position); 		// Set the position from which to 
 					// start reading/writing -- UNIX lseek
 
@@ -81,15 +100,104 @@ class OpenFile {
     					// Read/write bytes from the file,
 					// bypassing the implicit position.
     int WriteAt(char *from, int numBytes, int position);
+    					// (writing past the end grows the
+					// file)
+    int CopyFrom(OpenFile *source, int from, int numBytes, int position);
+					// Write "numBytes" bytes of "source",
+					// from "from" on, at "position",
+					// without leaving the kernel
+    int ReadPage(char *into, int numBytes, int position);
+    					// ReadAt, into a frame of the page
+					// cache, leaving the sectors for
+					// the buffer cache to drop
 
     int Length(); 			// Return the number of bytes in the
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+
+    bool Extend(PersistentBitmap *freeMap, int newLength);
+    					// Grow the file to "newLength"
+					// bytes
+    bool Preallocate(int size, bool keepSize);
+    					// Give its first "size" bytes disk
+					// sectors, in runs, before they are
+					// written
+    void AllocateDelayed();		// Give the data waiting for delayed
+					// allocation its sectors
+    void Sync();			// Force the file, and its header,
+					// out to disk (UNIX fsync)
+
+    void BeginUpdate();			// Keep the file to ourselves across
+    void EndUpdate();			// several reads and writes of it
+
+    int HeaderSector() { return hdrSector; }
+    int Position() { return seekPosition; }
+
+    int ReadAheadHits() { return raHits; }
+    int ReadAheadMisses() { return raMisses; }
     
   private:
-    FileHeader *hdr;			// Header for this file 
+    int ReadLocked(char *into, int numBytes, int position);
+    int ReadStored(char *into, int numBytes, int position);
+    					// ReadLocked, from the sectors,
+					// leaving out the page cache
+    int WriteLocked(char *from, int numBytes, int position,
+		    OpenFile *source = NULL, int sourcePos = 0);
+					// ReadAt/WriteAt, with the file
+					// held for reading/writing; or
+					// CopyFrom's whole sectors, if
+					// "from" is NULL
+    int WriteDelayed(char *from, int numBytes, int position);
+    					// WriteLocked, keeping what is past
+					// the last data sector in memory
+    int WriteAllocating(char *from, int numBytes, int position,
+			OpenFile *source = NULL, int sourcePos = 0);
+					// WriteLocked, allocating sectors
+					// now
+    void AllocateLocked();		// AllocateDelayed, with the file
+					// held for writing
+    int ReadChunks(char *into, int numBytes, int position);
+    int WriteChunks(char *from, int numBytes, int position,
+		    PersistentBitmap *freeMap);
+					// ReadLocked/WriteLocked, for a
+					// compressed file
+    void ReadChunk(int chunk, char *buf);
+    					// Read a chunk, decompressed
+    bool StoreChunk(PersistentBitmap *freeMap, int chunk, char *buf,
+		    int numBytes);	// Compress a chunk and write it
+    void CopySectors(OpenFile *source, int sourcePos, int sector,
+		     int count);	// Copy whole sectors of "source"
+					// to a run on disk
+    void ReadAhead(int firstSector, int lastSector);
+    					// Prefetch past a sequential read
+    void ReadBlocks(int firstSector, int lastSector);
+    					// Cache the blocks a read only
+					// partly covers
+    void ReadBlock(int first);		// and one of them
+    void ReadRun(int sector, int offset, int numBytes, char *into);
+					// Read part of a run of consecutive
+					// disk sectors
+    void WritePartial(int sectorIdx, bool fresh, char *from, int numBytes,
+		      int position, bool dedup);
+		      			// Write the part of a request that
+					// is in a partly covered sector
+    bool ShareCopy(PersistentBitmap *freeMap, int sectorIdx, char *data);
+    					// Share a sector already holding
+					// "data", instead of writing it
+
+    FileHeader *hdr;			// Header for this file, shared with
+					// its other openers
+    int hdrSector;			// Where the header lives on disk
+    RWLock *rwLock;			// Shared with its other openers
     int seekPosition;			// Current position within the file
+
+    int raNext;				// File sector a sequential read
+					// would start with (or continue in)
+    int raWindow;			// Sectors to keep read ahead
+    int raEnd;				// First file sector not prefetched
+    int raHits;				// Sequential reads of sectors that
+    int raMisses;			// were/were not prefetched
 };
 
 #endif // FILESYS
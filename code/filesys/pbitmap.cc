@@ -8,6 +8,10 @@
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "debug.h"
+#include "disk.h"
+#include "journal.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -21,6 +25,34 @@
 
 PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems) 
 { 
+    ASSERT(numItems % SectorsPerGroup == 0);
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    numFileSectors = numMapSectors + divRoundUp(numItems, SectorSize);
+    numIndexSectors = numFileSectors +
+		      divRoundUp(numItems * sizeof(unsigned short), SectorSize);
+    dirty = new bool[numIndexSectors];
+    for (int i = 0; i < numIndexSectors; i++)
+	dirty[i] = FALSE;
+    numToWrite = 0;
+    for (int i = 0; i < numMapSectors; i++)
+	Touch(i * SectorSize);		// nothing on disk yet
+    shares = new unsigned char[numItems];
+    memset(shares, 0, numItems);
+    roomForShares = FALSE;
+    hashes = new unsigned short[numItems];
+    buckets = new int[numItems];
+    memset(hashes, 0, numItems * sizeof(unsigned short));
+    memset(buckets, 0, numItems * sizeof(int));
+    roomForIndex = FALSE;
+    numReserved = 0;
+    numClear = numItems;
+    groupClear = new int[NumGroups()];
+    for (int i = 0; i < NumGroups(); i++)
+	groupClear[i] = SectorsPerGroup;
+    for (numLeaves = 1; numLeaves < NumGroups(); numLeaves *= 2)
+	continue;
+    summary = new GroupSummary[2 * numLeaves];
+    BuildSummary();
 }
 
 //----------------------------------------------------------------------
@@ -31,16 +63,39 @@ PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems)
 //	"numItems" is the number of bits in the bitmap.
 //      "file" refers to an open file containing the bitmap (written
 //        by a previous call to PersistentBitmap::WriteBack
+//	"numClear" is how many of its bits are clear, or -1 to count them
 //
 //      This constructor initializes the bitmap from a disk file
 //----------------------------------------------------------------------
 
-PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems) 
+PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems,
+				   int numClear):Bitmap(numItems) 
 { 
+    ASSERT(numItems % SectorsPerGroup == 0);
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    numFileSectors = numMapSectors + divRoundUp(numItems, SectorSize);
+    numIndexSectors = numFileSectors +
+		      divRoundUp(numItems * sizeof(unsigned short), SectorSize);
+    dirty = new bool[numIndexSectors];
+    shares = new unsigned char[numItems];
+    hashes = new unsigned short[numItems];
+    buckets = new int[numItems];
+    groupClear = new int[NumGroups()];
+    for (numLeaves = 1; numLeaves < NumGroups(); numLeaves *= 2)
+	continue;
+    summary = new GroupSummary[2 * numLeaves];
+    numReserved = 0;
+
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    FetchFrom(file);
+    if (numClear < 0) {
+	numClear = 0;
+	for (int i = 0; i < NumGroups(); i++)
+	    numClear += groupClear[i];
+    }
+    this->numClear = numClear;
 }
 
 //----------------------------------------------------------------------
@@ -50,11 +105,407 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
 
 PersistentBitmap::~PersistentBitmap()
 { 
+    delete [] dirty;
+    delete [] shares;
+    delete [] hashes;
+    delete [] buckets;
+    delete [] groupClear;
+    delete [] summary;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark/Clear
+// 	Set or clear the "nth" bit, keeping count of the clear ones and
+//	the summary up to date, and remember that the sector of the
+//	bitmap file holding it has to be written back.
+//
+//	"which" is the number of the bit to be set or cleared.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Mark(int which)
+{
+    bool wasClear = !Test(which);
+
+    Bitmap::Mark(which);
+    Touch(which / BitsInByte);
+    if (wasClear) {
+	numClear--;
+	groupClear[which / SectorsPerGroup]--;
+	UpdateSummary(which / SectorsPerGroup);
+    }
+}
+
+void
+PersistentBitmap::Clear(int which)
+{
+    if (shares[which] > 0) {		// someone else still holds it
+	shares[which]--;
+	Touch(numMapSectors * SectorSize + which);
+	return;
+    }
+    ForgetContents(which);
+    bool wasSet = Test(which);
+
+    Bitmap::Clear(which);
+    Touch(which / BitsInByte);
+    if (wasSet) {
+	numClear++;
+	groupClear[which / SectorsPerGroup]++;
+	UpdateSummary(which / SectorsPerGroup);
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Share
+// 	Note that one more file holds sector "which", which is in use.
+//	The caller has checked that it has fewer than MaxShares extra
+//	holders already.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Share(int which)
+{
+    ASSERT(Test(which) && shares[which] < MaxShares);
+    shares[which]++;
+    Touch(numMapSectors * SectorSize + which);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetShares
+// 	Set the number of extra holders of sector "which" to "count", as
+//	the consistency checker found it.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::SetShares(int which, int count)
+{
+    ASSERT(count >= 0 && count <= MaxShares);
+    shares[which] = count;
+    Touch(numMapSectors * SectorSize + which);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::NoteContents
+// 	Note that sector "which", which is in use, now holds data whose
+//	hash is "hash", so that FindContents can find it for data that
+//	hashes the same.  The file must be long enough for the hashes.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::NoteContents(int which, int hash)
+{
+    ASSERT(roomForIndex && Test(which) && hash > 0 && hash <= 0xffff);
+    if (hashes[which] == hash)
+	return;
+    ForgetContents(which);
+    hashes[which] = hash;
+    buckets[hash % numBits] = which + 1;
+    Touch(numFileSectors * SectorSize + which * sizeof(unsigned short));
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::ForgetContents
+// 	Forget the hash of sector "which", if it was noted: it is being
+//	given back, or written with something else.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::ForgetContents(int which)
+{
+    int hash = hashes[which];
+
+    if (hash == 0)
+	return;
+    if (buckets[hash % numBits] == which + 1)
+	buckets[hash % numBits] = 0;
+    hashes[which] = 0;
+    Touch(numFileSectors * SectorSize + which * sizeof(unsigned short));
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindContents
+// 	Return the sector last noted with data hashing to "hash", or -1
+//	if there is none.  Different data can hash the same, so the
+//	caller compares the sector with its own.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindContents(int hash)
+{
+    int which = buckets[hash % numBits] - 1;
+
+    if (which < 0 || hashes[which] != hash)
+	return -1;			// a different hash in the bucket
+    return which;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::CountGroups
+// 	Count the clear bits of each group, for a map just fetched, and
+//	build the summary over them.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::CountGroups()
+{
+    for (int group = 0; group < NumGroups(); group++) {
+	groupClear[group] = 0;
+	for (int i = 0; i < SectorsPerGroup; i++)
+	    if (!Test(group * SectorsPerGroup + i))
+		groupClear[group]++;
+    }
+    BuildSummary();
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::BuildSummary
+// 	Make every node of the summary: the leaves from the bits of their
+//	groups, then each level from the one below it.  The leaves past
+//	the last group stand for groups with no clear bits, so that no
+//	search goes there.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::BuildSummary()
+{
+    for (int group = 0; group < numLeaves; group++) {
+	if (group < NumGroups()) {
+	    SummarizeGroup(group);
+	} else {
+	    GroupSummary *leaf = &summary[numLeaves + group];
+
+	    leaf->mostClear = leaf->headClear = leaf->tailClear =
+		leaf->longestClear = 0;
+	}
+    }
+    for (int level = numLeaves / 2, span = SectorsPerGroup; level >= 1;
+	 level /= 2, span *= 2)
+	for (int node = level; node < 2 * level; node++)
+	    Combine(node, span);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SummarizeGroup
+// 	Make the leaf of the summary for "group", from its bits.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::SummarizeGroup(int group)
+{
+    GroupSummary *leaf = &summary[numLeaves + group];
+    int first = group * SectorsPerGroup, run = 0;
+
+    leaf->mostClear = groupClear[group];
+    leaf->headClear = SectorsPerGroup;
+    leaf->longestClear = 0;
+    for (int i = 0; i < SectorsPerGroup; i++) {
+	if (Test(first + i)) {
+	    if (leaf->headClear == SectorsPerGroup)
+		leaf->headClear = i;
+	    run = 0;
+	} else {
+	    run++;
+	    leaf->longestClear = max(leaf->longestClear, run);
+	}
+    }
+    leaf->tailClear = run;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Combine
+// 	Make "node" of the summary from its two children, each over
+//	"span" sectors.  A run of clear bits may go on from the end of
+//	the first into the second.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Combine(int node, int span)
+{
+    GroupSummary *left = &summary[2 * node], *right = &summary[2 * node + 1];
+    GroupSummary *s = &summary[node];
+
+    s->mostClear = max(left->mostClear, right->mostClear);
+    s->headClear = (left->headClear == span) ? span + right->headClear
+					     : left->headClear;
+    s->tailClear = (right->tailClear == span) ? span + left->tailClear
+					      : right->tailClear;
+    s->longestClear = max(max(left->longestClear, right->longestClear),
+			  left->tailClear + right->headClear);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::UpdateSummary
+// 	A bit of "group" changed: make its leaf again, and each node
+//	above it.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::UpdateSummary(int group)
+{
+    int span = SectorsPerGroup;
+
+    SummarizeGroup(group);
+    for (int node = (numLeaves + group) / 2; node >= 1; node /= 2) {
+	Combine(node, span);
+	span *= 2;
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::GroupAfter, PersistentBitmap::GroupBefore
+// 	Return the first group from "group" on (or the last one up to
+//	"group") with at least "count" clear bits, or -1 if there is
+//	none.  Only the subtree at "node" is looked at: the "groups"
+//	groups from "first" on.  A subtree with no such group is passed
+//	over whole.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::GroupAfter(int node, int first, int groups, int group,
+			     int count)
+{
+    int half = groups / 2, found;
+
+    if (first + groups <= group || summary[node].mostClear < count)
+	return -1;
+    if (groups == 1)
+	return first;
+    found = GroupAfter(2 * node, first, half, group, count);
+    if (found >= 0)
+	return found;
+    return GroupAfter(2 * node + 1, first + half, half, group, count);
+}
+
+int
+PersistentBitmap::GroupBefore(int node, int first, int groups, int group,
+			      int count)
+{
+    int half = groups / 2, found;
+
+    if (first > group || summary[node].mostClear < count)
+	return -1;
+    if (groups == 1)
+	return first;
+    found = GroupBefore(2 * node + 1, first + half, half, group, count);
+    if (found >= 0)
+	return found;
+    return GroupBefore(2 * node, first, half, group, count);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::RunAfter
+// 	Return the first bit, from "from" on, that starts a run of
+//	"length" clear bits, or -1 if there is none; only the subtree at
+//	"node" is looked at, as for GroupAfter.  "carry" is how many
+//	clear bits, from "from" on, come just before the subtree; it is
+//	updated to how many come just after it.
+//
+//	A subtree that the run cannot start in, nor end in having started
+//	before it, is passed over whole; only the bits of the groups at
+//	the ends of the search are looked at.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::RunAfter(int node, int first, int groups, int from,
+			   int length, int *carry)
+{
+    GroupSummary *s = &summary[node];
+    int start = first * SectorsPerGroup, span = groups * SectorsPerGroup;
+    int half = groups / 2, found;
+
+    if (start + span <= from)
+	return -1;
+    if (start >= from) {
+	if (*carry + s->headClear >= length)
+	    return start - *carry;
+	if (s->longestClear < length) {
+	    *carry = (s->headClear == span) ? *carry + span : s->tailClear;
+	    return -1;
+	}
+    }
+    if (groups == 1) {
+	for (int i = max(from, start); i < start + span; i++) {
+	    if (Test(i))
+		*carry = 0;
+	    else if (++*carry == length)
+		return i - length + 1;
+	}
+	return -1;
+    }
+    found = RunAfter(2 * node, first, half, from, length, carry);
+    if (found >= 0)
+	return found;
+    return RunAfter(2 * node + 1, first + half, half, from, length, carry);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::RunBefore
+// 	Return the start of the last run of "length" clear bits that ends
+//	before bit "end", or -1 if there is none; as for RunAfter, but
+//	going the other way: "carry" is how many clear bits, before
+//	"end", come just after the subtree.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::RunBefore(int node, int first, int groups, int end,
+			    int length, int *carry)
+{
+    GroupSummary *s = &summary[node];
+    int start = first * SectorsPerGroup, span = groups * SectorsPerGroup;
+    int half = groups / 2, found;
+
+    if (start >= end)
+	return -1;
+    if (start + span <= end) {
+	if (*carry + s->tailClear >= length)
+	    return start + span + *carry - length;
+	if (s->longestClear < length) {
+	    *carry = (s->tailClear == span) ? *carry + span : s->headClear;
+	    return -1;
+	}
+    }
+    if (groups == 1) {
+	for (int i = min(end, start + span) - 1; i >= start; i--) {
+	    if (Test(i))
+		*carry = 0;
+	    else if (++*carry == length)
+		return i;
+	}
+	return -1;
+    }
+    found = RunBefore(2 * node + 1, first + half, half, end, length, carry);
+    if (found >= 0)
+	return found;
+    return RunBefore(2 * node, first, half, end, length, carry);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Touch
+// 	Remember that the sector of the file holding byte "offset" has to
+//	be written back, listing it if it had not changed already and
+//	the list has room.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Touch(int offset)
+{
+    int which = offset / SectorSize;
+
+    if (dirty[which])
+	return;
+    dirty[which] = TRUE;
+    if (numToWrite < MaxToWrite)
+	toWrite[numToWrite] = which;
+    numToWrite++;
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::FetchFrom
 // 	Initialize the contents of a persistent bitmap from a Nachos file.
+//	If the file is too short to hold the share counts, no sector
+//	has been shared; if it is too short for the hashes, none has
+//	been noted.
 //
 //	"file" is the place to read the bitmap from
 //----------------------------------------------------------------------
@@ -63,11 +514,225 @@ void
 PersistentBitmap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    memset(shares, 0, numBits);
+    roomForShares = (file->Length() >= FileLength());
+    if (roomForShares)
+	file->ReadAt((char *)shares, numBits, numMapSectors * SectorSize);
+    memset(hashes, 0, numBits * sizeof(unsigned short));
+    memset(buckets, 0, numBits * sizeof(int));
+    roomForIndex = (file->Length() >= IndexLength());
+    if (roomForIndex) {
+	file->ReadAt((char *)hashes, numBits * sizeof(unsigned short),
+		     numFileSectors * SectorSize);
+	for (int i = 0; i < numBits; i++)
+	    if (hashes[i] != 0)
+		buckets[hashes[i] % numBits] = i + 1;
+    }
+    hint = 0;
+    for (int i = 0; i < numIndexSectors; i++)
+	dirty[i] = FALSE;
+    numToWrite = 0;
+    CountGroups();
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::CloserGroup
+// 	The searches near a goal in "group" look at the rest of the goal's
+//	group first, then at the start of that group, then at the groups
+//	around it, closest first: group+1, group-1, group+2, ...  Of
+//	"after", the closest group after "group" that will do, and
+//	"before", the closest one before it (either -1 if there is none),
+//	return the one that comes first in that order.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::CloserGroup(int group, int after, int before)
+{
+    if (after < 0)
+	return before;
+    if (before < 0)
+	return after;
+    return (after - group <= group - before) ? after : before;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSetNear
+// 	Allocate a clear bit, preferring "goal" itself, then the rest of
+//	its group, then the closest group with a clear bit, as the
+//	summary finds it.  Return -1 if the disk is full.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindAndSetNear(int goal)
+{
+    int group = goal / SectorsPerGroup, first = group * SectorsPerGroup;
+    int which;
+
+    ASSERT(goal >= 0 && goal < numBits);
+    if (numClear == 0)
+	return -1;
+    if (groupClear[group] > 0) {
+	which = FindAndSetIn(goal, first + SectorsPerGroup);
+	if (which < 0)
+	    which = FindAndSetIn(first, goal);
+	return which;
+    }
+    group = CloserGroup(group, GroupAfter(1, 0, numLeaves, group + 1, 1),
+			GroupBefore(1, 0, numLeaves, group - 1, 1));
+    return FindAndSetIn(group * SectorsPerGroup,
+			(group + 1) * SectorsPerGroup);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSetInterleaved
+// 	Allocate the sector "interleave" sectors after "previous" on its
+//	track, wrapping round to the start of the track, if it is clear;
+//	otherwise the closest clear one after it, as FindAndSetNear does.
+//	Return -1 if the disk is full.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindAndSetInterleaved(int previous, int interleave)
+{
+    int group = previous / SectorsPerGroup;
+
+    ASSERT(previous >= 0 && previous < numBits && interleave >= 1);
+    return FindAndSetNear(group * SectorsPerGroup +
+			  (previous % SectorsPerGroup + interleave) %
+			  SectorsPerGroup);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindRunNear
+// 	Return the start of the run of "length" clear bits closest to
+//	"goal", in the order CloserGroup gives: a run starts in a group if
+//	its first bit is in the group, or it is under way at the start of
+//	the range looked at.  There must be such a run somewhere.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindRunNear(int goal, int length)
+{
+    int group = goal / SectorsPerGroup, first = group * SectorsPerGroup;
+    int start, found, carry = 0, after, before;
+
+    start = FindRun(goal, first + SectorsPerGroup, length, &found);
+    if (found == length)
+	return start;
+    if (first < goal) {
+	start = FindRun(first, goal, length, &found);
+	if (found == length)
+	    return start;
+    }
+    after = RunAfter(1, 0, numLeaves, first + SectorsPerGroup, length,
+		     &carry);
+    carry = 0;
+    before = RunBefore(1, 0, numLeaves, min(first + length - 1, numBits),
+		       length, &carry);
+    ASSERT(after >= 0 || before >= 0);
+    group = CloserGroup(group, (after < 0) ? -1 : after / SectorsPerGroup,
+			(before < 0) ? -1 : before / SectorsPerGroup);
+    if (after >= 0 && group == after / SectorsPerGroup)
+	return after;
+    start = FindRun(group * SectorsPerGroup, (group + 1) * SectorsPerGroup,
+		    length, &found);	// the first in the group, not the last
+    ASSERT(found == length);
+    return start;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSetRunNear
+// 	Allocate a run of clear bits, like FindAndSetRun, but starting as
+//	close to "goal" as possible: the first range (in the order of
+//	CloserGroup) with a run of "length" bits starting in it wins.  If
+//	there is no such run anywhere, the longest one is taken; the
+//	summary says how long that is.
+//
+//	Return the start of the run, and store its length in "found";
+//	return -1 if the disk is full.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindAndSetRunNear(int goal, int length, int *found)
+{
+    int start;
+
+    ASSERT(goal >= 0 && goal < numBits && length > 0);
+    if (numClear == 0) {
+	*found = 0;
+	return -1;
+    }
+    *found = min(length, summary[1].longestClear);
+    start = FindRunNear(goal, *found);
+    for (int i = 0; i < *found; i++)
+	Mark(start + i);
+    return start;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::EmptiestGroup
+// 	Return the first sector of the group with the most clear bits;
+//	among equally empty groups, the one closest to "goal", in the
+//	order of CloserGroup.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::EmptiestGroup(int goal)
+{
+    int group = goal / SectorsPerGroup, most = summary[1].mostClear;
+
+    ASSERT(goal >= 0 && goal < numBits);
+    if (groupClear[group] < most)
+	group = CloserGroup(group,
+			    GroupAfter(1, 0, numLeaves, group + 1, most),
+			    GroupBefore(1, 0, numLeaves, group - 1, most));
+    return group * SectorsPerGroup;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Reserve/Unreserve
+// 	Set aside "count" of the clear bits, for an allocation that is to
+//	come, or give back what was set aside.  Nothing on disk changes.
+//	Return FALSE, setting nothing aside, if there are not that many
+//	clear bits that are not set aside already.
+//----------------------------------------------------------------------
+
+bool
+PersistentBitmap::Reserve(int count)
+{
+    ASSERT(count >= 0);
+    if (NumFree() < count)
+	return FALSE;
+    numReserved += count;
+    return TRUE;
+}
+
+void
+PersistentBitmap::Unreserve(int count)
+{
+    ASSERT(count >= 0 && count <= numReserved);
+    numReserved -= count;
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
-// 	Store the contents of a persistent bitmap to a Nachos file.
+// 	Store the contents of a persistent bitmap to a Nachos file: the
+//	bits, and after them (from the next sector on) the share counts,
+//	then the hashes.  Only the sectors of the file that changed since
+//	the last FetchFrom or WriteBack are written.
+//
+//	If the file has just been made long enough for the counts or the
+//	hashes, all of them are written.
+//
+//	The sectors are written in order.  If few enough changed to be
+//	listed, the list is sorted; otherwise every sector is looked at,
+//	which takes little time next to writing that many.  Whatever
+//	changes while they are written is listed anew.  There may be more
+//	than a journal operation holds, so each sector reserves its slot
+//	(see Journal::Reserve), and a long run of them is committed in
+//	pieces.  A crash between two leaves some of the changes on disk
+//	and not the rest, as it would data written outside any operation,
+//	and a Check puts the bitmap right.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -75,5 +740,67 @@ PersistentBitmap::FetchFrom(OpenFile *file)
 void
 PersistentBitmap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int count, list[MaxToWrite];
+
+    if (!roomForShares && file->Length() >= FileLength()) {
+	for (int i = numMapSectors; i < numFileSectors; i++)
+	    Touch(i * SectorSize);
+	roomForShares = TRUE;
+    }
+    if (!roomForIndex && file->Length() >= IndexLength()) {
+	for (int i = numFileSectors; i < numIndexSectors; i++)
+	    Touch(i * SectorSize);
+	roomForIndex = TRUE;
+    }
+    count = numToWrite;
+    numToWrite = 0;
+    if (count > MaxToWrite) {
+	for (int i = 0; i < numIndexSectors; i++)
+	    if (dirty[i])
+		WriteSector(file, i);
+	return;
+    }
+    for (int i = 0; i < count; i++) {	// insertion sort
+	int j;
+
+	for (j = i; j > 0 && list[j - 1] > toWrite[i]; j--)
+	    list[j] = list[j - 1];
+	list[j] = toWrite[i];
+    }
+    for (int i = 0; i < count; i++)
+	if (dirty[list[i]])
+	    WriteSector(file, list[i]);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::WriteSector
+// 	Write sector "i" of the bitmap's file: bits, share counts or
+//	hashes, whichever it holds.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::WriteSector(OpenFile *file, int i)
+{
+    int numBytes = numWords * sizeof(unsigned);
+
+    kernel->journal->Reserve(1);
+    if (i < numMapSectors) {
+	int offset = i * SectorSize;
+	file->WriteAt((char *)map + offset,
+		      min(SectorSize, numBytes - offset), offset);
+    } else if (i < numFileSectors) {
+	int offset = (i - numMapSectors) * SectorSize;
+
+	ASSERT(roomForShares);
+	file->WriteAt((char *)shares + offset,
+		      min(SectorSize, numBits - offset), i * SectorSize);
+    } else {
+	int offset = (i - numFileSectors) * SectorSize;
+	int length = numBits * sizeof(unsigned short);
+
+	ASSERT(roomForIndex);
+	file->WriteAt((char *)hashes + offset,
+		      min(SectorSize, length - offset), i * SectorSize);
+    }
+    dirty[i] = FALSE;
 }
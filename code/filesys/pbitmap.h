@@ -6,6 +6,60 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    The bitmap remembers which sectors of its file have been changed
+//    since it was last fetched or written, and WriteBack only writes
+//    those.
+//
+//    As the map of free disk sectors, it also knows the disk is split
+//    into groups of SectorsPerGroup sectors (one per track), and can
+//    allocate near a "goal" sector: in the goal's group if possible,
+//    otherwise in the closest group with room, so that related data
+//    stays within a short seek.  New directories are started in the
+//    emptiest group, to leave room for the files that go in them.
+//    The sectors of a file can also be interleaved: each allocated a
+//    fixed number of sectors after the one before it on the track,
+//    for a disk that would otherwise have just missed it (see
+//    SynchDisk::Interleave).
+//
+//    It also counts, for each sector in use, how many files share it
+//    besides the first (see FileSystem::Snapshot).  The counts follow
+//    the bits in the same file, a byte per sector, from the sector
+//    after them on.  The file is only made long enough to hold them
+//    when a sector is first shared; until then, they are all zero.
+//    Clearing a shared sector only drops the count: the sector stays
+//    in use until the last file holding it gives it back.
+//
+//    For the dedup mode (see FileSystem::StartDedup), it also keeps a
+//    hash of the contents of each data sector written in that mode, two
+//    bytes a sector after the counts, and a table from each hash (mod
+//    the number of sectors) to the last sector noted with it, built in
+//    memory as the file is fetched.  The file is made long enough for
+//    the hashes when the mode is first turned on.  A sector given back,
+//    or about to be written, is forgotten.
+//
+//    It keeps count of its clear bits as they are set and cleared,
+//    rather than counting them each time they are asked for; when it
+//    is fetched, the count can be given, as the superblock had it
+//    (see superblock.h).  It counts those of each group as well, and
+//    above the groups keeps a summary: a binary tree with a group at
+//    each leaf, each node holding the most clear bits of any group
+//    under it, and the clear bits at the start and the end of its
+//    sectors and the longest run of them.  So the closest group with
+//    room, or the closest run of clear bits of a given length, is
+//    found by going down the tree, rather than by looking at every
+//    group on the way, and a full disk without looking at all.  The
+//    summary is only kept in memory: it is built when the map is
+//    fetched, and each node above a bit that changes is made again.
+//    And it keeps a
+//    short list of the sectors of the file that changed, so that
+//    writing it back does not look at every sector of a large disk's
+//    bitmap.
+//
+//    Sectors can also be reserved, for data that is written before it
+//    is given sectors (see FileHeader::DelayWrite): the count of them
+//    is only kept in memory, and allocation that checks for room
+//    first does not count them as free.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -16,6 +70,23 @@
 #include "copyright.h"
 #include "bitmap.h"
 #include "openfile.h"
+#include "disk.h"
+
+#define SectorsPerGroup	SectorsPerTrack	// sectors in an allocation group
+#define MaxShares	255		// extra holders a sector can have
+#define MaxToWrite	64		// changed sectors of the file listed;
+					// after that, all are looked at
+
+// The following class defines a node of the summary: what is known
+// of the groups under it, without looking at them.
+
+class GroupSummary {
+  public:
+    int mostClear;			// Clear bits of the emptiest group
+    int headClear;			// Clear bits before the first set one
+    int tailClear;			// and after the last
+    int longestClear;			// The longest run of clear bits
+};
 
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
@@ -23,13 +94,109 @@
 
 class PersistentBitmap : public Bitmap {
   public:
-    PersistentBitmap(OpenFile *file,int numItems); //initialize bitmap from disk 
+    PersistentBitmap(OpenFile *file,int numItems, int numClear = -1);
+					// initialize bitmap from disk, with
+					// "numClear" bits clear, if known
     PersistentBitmap(int numItems); // or don't...
 
     ~PersistentBitmap(); 			// deallocate bitmap
 
+    void Mark(int which);		// Set/clear a bit, remembering that
+    void Clear(int which);		// its sector of the file changed;
+					// a shared sector loses a holder
+    void Share(int which);		// One more file holds sector "which"
+    int Shares(int which) { return shares[which]; }
+    					// Holders of "which" besides the first
+    bool IsShared(int which) { return shares[which] > 0; }
+    void SetShares(int which, int count);
+    					// Fix the count, for the checker
+    int FileLength() { return numFileSectors * SectorSize; }
+					// Bytes of file to hold the counts
+    int IndexLength() { return numIndexSectors * SectorSize; }
+    					// and to hold the hashes as well
+
+    bool HasIndex() { return roomForIndex; }
+    					// Can sectors be noted by hash?
+    void NoteContents(int which, int hash);
+    					// Sector "which" holds data that
+					// hashes to "hash" (never 0)
+    void ForgetContents(int which);	// Its contents are changing
+    int FindContents(int hash);		// A sector noted with "hash",
+    					// or -1
+
+    int FindAndSetNear(int goal);	// Allocate one bit, as close to
+					// "goal" as possible
+    int FindAndSetInterleaved(int previous, int interleave);
+    					// Allocate the bit "interleave" after
+					// "previous" in its group, or close
+    int FindAndSetRunNear(int goal, int length, int *found);
+    					// Allocate a run of up to "length"
+					// bits, as close to "goal" as
+					// possible
+    int EmptiestGroup(int goal);	// First sector of the group with
+					// the most clear bits
+
+    bool Reserve(int count);		// Set aside "count" clear bits for
+    void Unreserve(int count);		// an allocation to come, or give
+					// them back
+    int NumClear() const { return numClear; }
+					// Clear bits, without counting them
+    int NumFree() { return numClear - numReserved; }
+    					// Clear bits not set aside
+
     void FetchFrom(OpenFile *file);     // read bitmap from the disk
-    void WriteBack(OpenFile *file); 	// write bitmap contents to disk 
+    void WriteBack(OpenFile *file); 	// write changed sectors of the
+					// bitmap contents to disk 
+
+  private:
+    int NumGroups() { return numBits / SectorsPerGroup; }
+    					// Groups on the disk
+    int CloserGroup(int group, int after, int before);
+    					// Which of two groups is searched
+					// first from "group"
+
+    void CountGroups();			// Count the clear bits of each group
+    void BuildSummary();		// and make the summary from them
+    void SummarizeGroup(int group);	// Make the leaf for "group"
+    void Combine(int node, int span);	// Make "node" from its children
+    void UpdateSummary(int group);	// A bit of "group" changed
+    int GroupAfter(int node, int first, int groups, int group, int count);
+    int GroupBefore(int node, int first, int groups, int group, int count);
+    					// The closest group to "group" on
+					// one side with "count" clear bits
+    int RunAfter(int node, int first, int groups, int from, int length,
+		 int *carry);
+    int RunBefore(int node, int first, int groups, int end, int length,
+		  int *carry);		// The closest run of "length" clear
+					// bits after "from", or ending by
+					// "end"
+    int FindRunNear(int goal, int length);
+    					// Where FindAndSetRunNear puts a run
+    void Touch(int offset);		// The byte at "offset" of the file
+					// changed
+    void WriteSector(OpenFile *file, int which);
+    					// Write sector "which" of the file
+
+    int numMapSectors;			// sectors of the file for the bits
+    int numFileSectors;			// and for the bits and the counts
+    int numIndexSectors;		// and for all that and the hashes
+    bool *dirty;			// which of them have changed
+    int toWrite[MaxToWrite];		// the first of those to change
+    int numToWrite;			// and how many changed
+    unsigned char *shares;		// extra holders of each sector
+    bool roomForShares;			// is the file long enough for them?
+    unsigned short *hashes;		// hash of each sector noted, or 0
+    int *buckets;			// last sector + 1 noted with each
+					// hash, or 0
+    bool roomForIndex;			// is the file long enough for them?
+    int numReserved;			// clear bits set aside
+    int numClear;			// clear bits, set aside or not
+    int *groupClear;			// and those of each group
+    int numLeaves;			// Groups, rounded up to a power of 2
+    GroupSummary *summary;		// The tree: the root is 1, the
+					// children of node n are 2n and
+					// 2n+1, and the leaf of group g
+					// is numLeaves+g
 };
 
 #endif // PBITMAP_H
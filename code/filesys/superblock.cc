@@ -0,0 +1,122 @@
+// superblock.cc
+//	Routines to read, write and print the superblock.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "superblock.h"
+#include "filesys.h"
+#include "filehdr.h"
+#include "journal.h"
+#include "synchdisk.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Superblock::Superblock
+// 	Describe a disk being formatted now, with new files given
+//	"layout".  It is dirty, with nothing counted yet; the file system
+//	fills in the summary as it unmounts the disk.
+//----------------------------------------------------------------------
+
+Superblock::Superblock(int layout)
+{
+    ASSERT(sizeof(Superblock) <= SectorSize);
+    magic = SuperblockMagic;
+    version = SuperblockVersion;
+    numSectors = kernel->synchDisk->VolumeSectors();
+    sectorsPerTrack = SectorsPerTrack;
+    sectorSize = SectorSize;
+    freeMapSector = FreeMapSector;
+    directorySector = DirectorySector;
+    journalSector = JournalSector;
+    journalSectors = JournalSectors;
+    this->layout = layout;
+    clean = FALSE;
+    numFree = 0;
+    numFiles = 0;
+}
+
+//----------------------------------------------------------------------
+// Superblock::Superblock
+// 	Make room for a superblock to be read by FetchFrom.
+//----------------------------------------------------------------------
+
+Superblock::Superblock()
+{
+    ASSERT(sizeof(Superblock) <= SectorSize);
+    magic = 0;
+}
+
+//----------------------------------------------------------------------
+// Superblock::FetchFrom
+// 	Read the superblock off the disk.  Return FALSE if the disk has
+//	none: it was formatted before there were superblocks, and their
+//	sector was the last of the journal.
+//----------------------------------------------------------------------
+
+bool
+Superblock::FetchFrom()
+{
+    char sector[SectorSize];
+
+    kernel->synchDisk->ReadSector(SuperblockSector, sector);
+    bcopy(sector, (char *) this, sizeof(Superblock));
+    return magic == SuperblockMagic;
+}
+
+//----------------------------------------------------------------------
+// Superblock::WriteBack
+// 	Write the superblock to its sector, the rest of which is zero.
+//----------------------------------------------------------------------
+
+void
+Superblock::WriteBack()
+{
+    char sector[SectorSize];
+
+    bzero(sector, SectorSize);
+    bcopy((char *) this, sector, sizeof(Superblock));
+    kernel->synchDisk->WriteSector(SuperblockSector, sector);
+}
+
+//----------------------------------------------------------------------
+// Superblock::Fits
+// 	Return TRUE if the disk is laid out the way this Nachos lays out
+//	the disks it formats -- every layout of file headers it knows is
+//	fine -- so that it can be mounted.
+//----------------------------------------------------------------------
+
+bool
+Superblock::Fits()
+{
+    return version == SuperblockVersion && numSectors == kernel->synchDisk->VolumeSectors() &&
+	   sectorsPerTrack == SectorsPerTrack && sectorSize == SectorSize &&
+	   freeMapSector == FreeMapSector &&
+	   directorySector == DirectorySector &&
+	   journalSector == JournalSector && journalSectors == JournalSectors &&
+	   ((layout & ~BlockMask) == IndexLayout ||
+	    layout == ExtentLayout) && BlockShiftOf(layout) <= MaxBlockShift;
+}
+
+//----------------------------------------------------------------------
+// Superblock::Print
+// 	Print the contents of the superblock.
+//----------------------------------------------------------------------
+
+void
+Superblock::Print()
+{
+    printf("Superblock: version %d, %d sectors of %d bytes, %d a track\n",
+	   version, numSectors, sectorSize, sectorsPerTrack);
+    printf("Bitmap header %d, root header %d, journal %d-%d, %s layout",
+	   freeMapSector, directorySector, journalSector,
+	   journalSector + journalSectors - 1,
+	   (layout == ExtentLayout) ? "extent" : "index");
+    if (BlockShiftOf(layout) > 0)
+	printf(", blocks of %d sectors", 1 << BlockShiftOf(layout));
+    printf("\n");
+    printf("%s, %d sectors free, %d files\n",
+	   clean ? "Clean" : "Mounted", numFree, numFiles);
+}
@@ -0,0 +1,75 @@
+// superblock.h
+//	Data structures for the superblock: the sector that says how the
+//	disk is laid out, and what state it was left in.
+//
+//	It is written when the disk is formatted, and records the version
+//	of the format, the geometry of the disk, where the headers of the
+//	bitmap and root directory and the journal are, and the header
+//	layout of new files -- so that a disk is mounted the way it was
+//	formatted, and disks of different layouts can be used by one
+//	Nachos.  It also keeps a summary: how many sectors are free, and
+//	how many files and directories there are.
+//
+//	While the disk is mounted, the superblock on disk is marked
+//	dirty.  A clean shutdown writes everything back, then the summary,
+//	and marks it clean.  A mount that finds it clean trusts the
+//	summary, without checking the disk or counting the bitmap; one
+//	that finds it dirty checks the disk (see fsck.h), repairing the
+//	bitmap, and counts again.
+//
+//	The superblock is read and written directly, not through the
+//	buffer cache or the journal: it is written once as the disk is
+//	mounted, before anything else, and once as it is unmounted, after
+//	everything else.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SUPERBLOCK_H
+#define SUPERBLOCK_H
+
+#include "disk.h"
+
+#define SuperblockSector	(SectorsPerTrack - 1)
+					// the last sector of track 0, after
+					// the journal
+#define SuperblockMagic	0x4e534231	// marks a disk that has one
+#define SuperblockVersion	1	// the format this Nachos writes
+
+// The following class defines the superblock, as it is on disk.
+
+class Superblock {
+  public:
+    Superblock(int layout);		// Describe a disk being formatted
+					// with "layout"
+    Superblock();			// or one about to be read
+
+    bool FetchFrom();			// Read it; FALSE if the disk has
+					// none (it predates superblocks)
+    void WriteBack();			// Write it to disk
+    bool Fits();			// Was the disk formatted like the
+					// ones this Nachos formats?
+
+    void Print();			// Print the contents
+
+    int magic;				// SuperblockMagic
+    int version;			// SuperblockVersion, when formatted
+    int numSectors;			// The geometry of the disk
+    int sectorsPerTrack;
+    int sectorSize;
+    int freeMapSector;			// Header of the bitmap's file
+    int directorySector;		// Header of the root directory
+    int journalSector;			// First sector of the journal
+    int journalSectors;			// and how many it has
+    int layout;				// File header layout of new files,
+					// with their block size
+    int clean;				// Was it unmounted cleanly?
+    int numFree;			// Sectors free, when it was
+    int numFiles;			// Files and directories, besides
+					// the root
+};
+
+#endif // SUPERBLOCK_H
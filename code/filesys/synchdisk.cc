@@ -5,10 +5,15 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Each request carries a semaphore, on which the requesting thread
+//	waits until the disk interrupt handler signals it.  The physical
+//	disk can only handle one operation at a time, so requests that
+//	arrive while it is busy are queued, and the interrupt handler
+//	sends the next one as soon as the disk is free.  The queue is
+//	shared with the interrupt handler, so it is protected by turning
+//	interrupts off rather than by a lock.  Each disk of a striped
+//	or mirrored volume has a queue, and an interrupt handler, of its
+//	own.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,20 +21,412 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "diskmodel.h"
+#include "logvolume.h"
+#include "main.h"
 
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request to transfer "count" sectors starting at
+//	"sector" to or from "data", for the thread making it.
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int sector, int count, char *data, bool writing)
+{
+    this->sector = sector;
+    this->count = count;
+    this->data = data;
+    this->writing = writing;
+    madeAt = kernel->stats->totalTicks;
+    Thread *thread = kernel->currentThread;
+    owner = (thread->space != NULL) ? (void *) thread->space : (void *) thread;
+    ioClass = thread->ioClass;
+    done = new Semaphore("disk request", 0);
+}
+
+DiskRequest::~DiskRequest()
+{
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// DiskMember::DiskMember
+// 	Initialize one disk of the volume, in turn initializing the
+//	physical disk.
+//
+//	"schedule" -- the order in which to serve queued requests
+//	"mapped" -- map the disk's UNIX file into memory
+//	"name" -- which disk (see Disk::Disk)
+//	"numTracks" -- how big it must be (see Disk::Disk)
+//----------------------------------------------------------------------
+
+DiskMember::DiskMember(DiskSchedule schedule, bool mapped, const char *name,
+		       int numTracks)
+{
+    this->schedule = schedule;
+    queue = new List<DiskRequest *>;
+    active = NULL;
+    headSector = 0;
+    movingUp = TRUE;
+    slice = 0;
+    turnOwner = NULL;
+    turnEnds = 0;
+    numRequests = numTransferred = numQueued = seekTicks = 0;
+    numTurns = 0;
+    for (int c = IoRealtime; c <= IoIdle; c++)
+	classServed[c] = classWait[c] = 0;
+    disk = new Disk(this, mapped, name, numTracks);
+}
+
+//----------------------------------------------------------------------
+// DiskMember::~DiskMember
+//----------------------------------------------------------------------
+
+DiskMember::~DiskMember()
+{
+    delete disk;
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// DiskMember::Request
+// 	Send "request" to the disk if it is idle, otherwise queue it.
+//	The caller waits on the request's semaphore, which the interrupt
+//	handler signals when it is done.
+//----------------------------------------------------------------------
+
+void
+DiskMember::Request(DiskRequest *request)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (active == NULL) {
+	Dispatch(request);
+    } else {
+	numQueued++;
+	queue->Append(request);
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// DiskMember::Dispatch
+// 	Send "request" to the disk, and account for the seek it needs.
+//	Called with interrupts off, when the disk is idle.
+//----------------------------------------------------------------------
+
+void
+DiskMember::Dispatch(DiskRequest *request)
+{
+    int waited = kernel->stats->totalTicks - request->madeAt;
+
+    ASSERT(active == NULL);
+    seekTicks += abs(request->sector / SectorsPerTrack -
+			headSector / SectorsPerTrack) * SeekTime;
+    headSector = request->sector + request->count - 1;
+    kernel->stats->AddDiskWait(waited);
+    classServed[request->ioClass]++;
+    if (waited > classWait[request->ioClass])
+	classWait[request->ioClass] = waited;
+    active = request;
+    numRequests++;
+    numTransferred += request->count;
+    if (request->writing)
+	disk->WriteRequests(request->sector, request->count, request->data);
+    else
+	disk->ReadRequests(request->sector, request->count, request->data);
+}
+
+//----------------------------------------------------------------------
+// Nearest
+// 	Return the queued request closest to "sector" that lies at or
+//	above it ("up") or at or below it, or NULL if there is none.
+//	Among equally close requests, the oldest one wins.
+//----------------------------------------------------------------------
+
+static DiskRequest *
+Nearest(List<DiskRequest *> *queue, int sector, bool up)
+{
+    ListIterator<DiskRequest *> iter(queue);
+    DiskRequest *best = NULL;
+
+    for (; !iter.IsDone(); iter.Next()) {
+	DiskRequest *r = iter.Item();
+	if (up ? (r->sector < sector) : (r->sector > sector))
+	    continue;
+	if (best == NULL || abs(r->sector - sector) < abs(best->sector - sector))
+	    best = r;
+    }
+    return best;
+}
+
+//----------------------------------------------------------------------
+// ClassOf
+// 	The class "request" is served in at "now": its own, but an idle
+//	request that has waited IdleWaitLimit ticks is best-effort.
+//----------------------------------------------------------------------
+
+static IoClass
+ClassOf(DiskRequest *request, int now)
+{
+    if (request->ioClass == IoIdle && now - request->madeAt >= IdleWaitLimit)
+	return IoBestEffort;
+    return request->ioClass;
+}
+
+//----------------------------------------------------------------------
+// DiskMember::FairCandidates
+// 	Return a new list of the queued requests that fair queueing lets
+//	the schedule choose from: those of the first class with any
+//	queued and, for best-effort ones, of the process whose turn it
+//	is.  The queue must not be empty.
+//
+//	A turn is over when its slice has run out, or the process has
+//	nothing queued.  The next goes to the process with the oldest
+//	request -- the queue is in the order of arrival -- other than
+//	the one that just had its turn, if there is one; if not, that
+//	one goes on.
+//----------------------------------------------------------------------
+
+List<DiskRequest *> *
+DiskMember::FairCandidates()
+{
+    List<DiskRequest *> *candidates = new List<DiskRequest *>;
+    ListIterator<DiskRequest *> iter(queue);
+    int now = kernel->stats->totalTicks;
+    IoClass best = IoIdle;
+    DiskRequest *oldest = NULL;		// of another process
+    bool ownerQueued = FALSE;
+
+    for (; !iter.IsDone(); iter.Next()) {
+	DiskRequest *r = iter.Item();
+	IoClass c = ClassOf(r, now);
+	if (c < best)
+	    best = c;
+	if (c != IoBestEffort)
+	    continue;
+	if (r->owner == turnOwner)
+	    ownerQueued = TRUE;
+	else if (oldest == NULL)
+	    oldest = r;
+    }
+    if (best == IoBestEffort && (!ownerQueued || now >= turnEnds) &&
+	    oldest != NULL) {
+	turnOwner = oldest->owner;
+	turnEnds = now + slice;
+	numTurns++;
+    }
+
+    ListIterator<DiskRequest *> again(queue);
+    for (; !again.IsDone(); again.Next()) {
+	DiskRequest *r = again.Item();
+	IoClass c = ClassOf(r, now);
+	if (c == best && (c != IoBestEffort || r->owner == turnOwner))
+	    candidates->Append(r);
+    }
+    ASSERT(!candidates->IsEmpty());
+    return candidates;
+}
+
+//----------------------------------------------------------------------
+// DiskMember::NextRequest
+// 	Remove from the queue, and return, the request to serve next
+//	according to the schedule, among those fair queueing lets it
+//	choose from, if it is on.  The queue must not be empty.
+//
+//	Since the head only moves to serve a request, SCAN turns around
+//	at the last request in its direction (strictly speaking, LOOK).
+//----------------------------------------------------------------------
+
+DiskRequest *
+DiskMember::NextRequest()
+{
+    List<DiskRequest *> *candidates = queue;
+    DiskRequest *next = NULL;
+
+    ASSERT(!queue->IsEmpty());
+    if (slice > 0)
+	candidates = FairCandidates();
+    switch (schedule) {
+      case FifoSchedule:
+	next = candidates->Front();
+	break;
+      case SstfSchedule:
+	next = Nearest(candidates, headSector, TRUE);
+	{
+	    DiskRequest *below = Nearest(candidates, headSector, FALSE);
+	    if (next == NULL || (below != NULL && 
+		    headSector - below->sector < next->sector - headSector))
+		next = below;
+	}
+	break;
+      case ScanSchedule:
+	next = Nearest(candidates, headSector, movingUp);
+	if (next == NULL) {
+	    movingUp = !movingUp;
+	    next = Nearest(candidates, headSector, movingUp);
+	}
+	break;
+      case CLookSchedule:
+	next = Nearest(candidates, headSector, TRUE);
+	if (next == NULL)
+	    next = Nearest(candidates, 0, TRUE);	// wrap to the lowest
+	break;
+      default:
+	ASSERTNOTREACHED();
+    }
+    ASSERT(next != NULL);
+    if (candidates != queue)
+	delete candidates;
+    queue->Remove(next);
+    return next;
+}
+
+//----------------------------------------------------------------------
+// DiskMember::CallBack
+// 	Disk interrupt handler.  Start the next queued request, if any,
+//	and wake up the thread waiting for the one that just finished.
+//----------------------------------------------------------------------
+
+void
+DiskMember::CallBack()
+{ 
+    DiskRequest *finished = active;
+
+    ASSERT(finished != NULL);
+    active = NULL;
+    if (!queue->IsEmpty())
+	Dispatch(NextRequest());
+    finished->done->V();
+}
+
+//----------------------------------------------------------------------
+// DiskMember::NumWaiting
+// 	Return how many requests are ahead of one sent to the disk now:
+//	the one in progress, and those queued.
+//----------------------------------------------------------------------
+
+int
+DiskMember::NumWaiting()
+{
+    return (active != NULL) + queue->NumInList();
+}
+
+//----------------------------------------------------------------------
+// DiskMember::Latency
+// 	Return how long "request" would take if the disk started on it
+//	now, from the sector it last transferred (see
+//	Disk::ComputeLatency).
+//----------------------------------------------------------------------
+
+int
+DiskMember::Latency(DiskRequest *request)
+{
+    return disk->ComputeLatency(request->sector, request->count,
+				request->writing);
+}
+
+//----------------------------------------------------------------------
+// DiskMember::Erase
+// 	Make every sector of the disk read as zeros (see Disk::Erase).
+//	No request may be in progress.
+//----------------------------------------------------------------------
+
+void
+DiskMember::Erase()
+{
+    ASSERT(active == NULL && queue->IsEmpty());
+    disk->Erase();
+}
+
+//----------------------------------------------------------------------
+// DiskMember::Print
+// 	Print how many requests were served, how many had to wait, and
+//	the total seek time, to compare schedules.
+//
+//	"name" -- which disk it is, for the volume
+//----------------------------------------------------------------------
+
+void
+DiskMember::Print(const char *name)
+{
+    static const char *names[] = { "FIFO", "SSTF", "SCAN", "C-LOOK" };
+
+    printf("%s schedule %s: %d requests of %d sectors, %d queued, "
+		"seek ticks %d\n", name, names[schedule], numRequests,
+		numTransferred, numQueued, seekTicks);
+    if (slice > 0)
+	printf("%s fair queueing: %d turns of up to %d ticks; realtime %d, "
+		"best-effort %d, idle %d requests, waiting at most %d, %d, "
+		"%d ticks\n", name, numTurns, slice, classServed[IoRealtime],
+		classServed[IoBestEffort], classServed[IoIdle],
+		classWait[IoRealtime], classWait[IoBestEffort],
+		classWait[IoIdle]);
+}
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
-// 	Initialize the synchronous interface to the physical disk, in turn
-//	initializing the physical disk.
+// 	Initialize the synchronous interface to the physical disks, in
+//	turn initializing the physical disks.
 //
+//	"schedule" -- the order in which each disk serves queued requests
+//	"mapped" -- map the disks' UNIX files into memory
+//	"name" -- which disk (see Disk::Disk); the disks after the first
+//		  of a striped or mirrored volume are "name"1, "name"2, ...
+//	"numDisks" -- how many disks the volume is striped across
+//	"mirrored" -- mirror the volume on the disks instead
+//	"numTracks" -- tracks each disk must have (see Disk::Disk); the
+//		disks of a volume must all be the same size
+//
+//	A mirror whose UNIX file is missing, while some other one's is
+//	there, is left out: it would start out all zeros.  If all are
+//	missing, the volume is new, and they are all made.
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(DiskSchedule schedule, bool mapped, const char *name,
+		     int numDisks, bool mirrored, int numTracks)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    char memberName[MaxStripeDisks][32];
+    char fileName[40];
+    bool there[MaxStripeDisks];
+    int numThere = 0;
+
+    ASSERT(numDisks >= 1 && numDisks <= MaxStripeDisks);
+    this->mirrored = mirrored;
+    for (int i = 0; i < numDisks; i++) {
+	if (i == 0)
+	    strcpy(memberName[i], name);
+	else
+	    sprintf(memberName[i], "%s%d", name, i);
+	sprintf(fileName, "%s_%d", memberName[i], kernel->hostName);
+	int fd = OpenForReadWrite(fileName, FALSE);
+	there[i] = (fd >= 0);
+	if (fd >= 0) {
+	    Close(fd);
+	    numThere++;
+	}
+    }
+
+    this->numDisks = 0;
+    numMissing = 0;
+    for (int i = 0; i < numDisks; i++)
+	if (!mirrored || numThere == 0 || there[i]) {
+	    disks[this->numDisks++] = new DiskMember(schedule, mapped,
+						     memberName[i], numTracks);
+	} else {
+	    printf("Mirror %s_%d is missing: running degraded\n",
+		   memberName[i], kernel->hostName);
+	    numMissing++;
+	}
+    diskSectors = disks[0]->NumDiskSectors();
+    for (int i = 1; i < this->numDisks; i++)
+	ASSERT(disks[i]->NumDiskSectors() == diskSectors);
+    interleave = 1;
+    lastEnd = -1;
+    lastDone = gapTicks = numGaps = 0;
+    tracks = NULL;
+    numTracks = useClock = numTrackHits = numTrackMisses = 0;
+    log = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -40,9 +437,10 @@ SynchDisk::SynchDisk()
 
 SynchDisk::~SynchDisk()
 {
-    delete disk;
-    delete lock;
-    delete semaphore;
+    for (int i = 0; i < numDisks; i++)
+	delete disks[i];
+    delete [] tracks;
+    delete log;
 }
 
 //----------------------------------------------------------------------
@@ -57,10 +455,7 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    Request(sectorNumber, 1, data, FALSE);
 }
 
 //----------------------------------------------------------------------
@@ -75,20 +470,497 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    Request(sectorNumber, 1, data, TRUE);
 }
 
 //----------------------------------------------------------------------
-// SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// SynchDisk::ReadSectors/WriteSectors
+// 	Read/write "numSectors" consecutive sectors, starting at
+//	"sectorNumber", as one disk request: a single seek, and then the
+//	sectors stream past the head.  Return only once the whole
+//	transfer is done.  On a striped volume, each disk holding some of
+//	the sectors gets one request, and they all work at once.
+//
+//	"data" -- the buffer of numSectors sectors to read into or
+//		  write from
 //----------------------------------------------------------------------
 
 void
-SynchDisk::CallBack()
-{ 
-    semaphore->V();
+SynchDisk::ReadSectors(int sectorNumber, int numSectors, char* data)
+{
+    Request(sectorNumber, numSectors, data, FALSE);
+}
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int numSectors, char* data)
+{
+    Request(sectorNumber, numSectors, data, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteGathered
+// 	Write the "count" sectors listed in "sectors", in that order,
+//	from "data", and wait until they are done.  A log appends them
+//	all together; otherwise each run of consecutive ones is a request.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteGathered(int *sectors, int count, char *data)
+{
+    if (log != NULL) {
+	log->WriteGathered(sectors, count, data);
+	return;
+    }
+    for (int i = 0, run; i < count; i += run) {
+	for (run = 1; i + run < count && sectors[i + run] ==
+		      sectors[i] + run; run++)
+	    ;
+	Request(sectors[i], run, &data[i * SectorSize], TRUE);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Wait until everything written to the disks so far has reached the
+//	UNIX files that simulate them (only a mapped disk can lag behind).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    for (int i = 0; i < numDisks; i++)
+	disks[i]->Flush();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Erase
+// 	Make every sector of the volume read as zeros, as it does when the
+//	disks are new (see Disk::Erase).  No request may be in progress.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Erase()
+{
+    for (int i = 0; i < numDisks; i++)
+	disks[i]->Erase();
+    DropTracks(0, PhysicalSectors());
+    if (log != NULL)
+	log->Format();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::VolumeSectors
+// 	Return how many sectors the volume has: those of the log, if it is
+//	kept as one, or else all those on the disks.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::VolumeSectors()
+{
+    return (log != NULL) ? log->NumSectors() : PhysicalSectors();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::MountLog
+// 	Keep the volume as a log, if the disks have one, or, if they are
+//	being formatted, if they are to have one; and fork its cleaner.
+//	Called before anything reads the volume.
+//
+//	"format" -- the disks are being formatted
+//	"logged" -- and are to be kept as a log
+//----------------------------------------------------------------------
+
+void
+SynchDisk::MountLog(bool format, bool logged)
+{
+    ASSERT(log == NULL);
+    if (format ? !logged : !LogVolume::IsLog(this))
+	return;
+    log = new LogVolume(this, PhysicalSectors());
+    if (format)
+	log->Format();
+    else
+	log->Recover();
+    log->StartCleaner();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Checkpoint
+// 	Write the checkpoint of the log, if the volume is kept as one, so
+//	that the next mount need not roll forward (see LogVolume).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Checkpoint()
+{
+    if (log != NULL)
+	log->Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SectorOnDisk
+// 	Return where "sector" of the volume is on its disk (see DiskOf):
+//	stripe units go to the disks in turn, so each disk holds every
+//	numDisks'th one, one after another.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::SectorOnDisk(int sector)
+{
+    return (sector / StripeSectors / numDisks) * StripeSectors +
+	   sector % StripeSectors;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Request
+// 	Transfer "count" sectors of the volume, from "sector" on, to or
+//	from "data", and wait until they are done: in the log, if the
+//	volume is kept as one, or else on the disks.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Request(int sector, int count, char *data, bool writing)
+{
+    if (log != NULL)
+	log->Request(sector, count, data, writing);
+    else
+	PhysicalRequest(sector, count, data, writing);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::PhysicalRequest
+// 	Transfer "count" sectors of the disks, from "sector" on, to or
+//	from "data", and wait until they are done.  If tracks are kept in
+//	memory, a read within one track is served from it, and a write
+//	throws away the copy of its tracks, both as it is sent, for a
+//	read of them already on its way, and once it is done, for one
+//	that the disk may have served before it.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::PhysicalRequest(int sector, int count, char *data, bool writing)
+{
+    ASSERT(sector >= 0 && count > 0 && sector + count <= PhysicalSectors());
+    if (numTracks == 0) {
+	Transfer(sector, count, data, writing);
+    } else if (writing) {
+	DropTracks(sector, count);
+	Transfer(sector, count, data, TRUE);
+	DropTracks(sector, count);
+    } else if (sector / SectorsPerTrack ==
+	       (sector + count - 1) / SectorsPerTrack) {
+	ReadTrack(sector, count, data);
+    } else {
+	Transfer(sector, count, data, FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadTrack
+// 	Read "count" sectors, from "sector" on, all on one track, into
+//	"data", from the copy of the track in memory.  If there is none,
+//	read the whole track into the least recently used slot, and then
+//	copy them; if the track is already being read, or every slot is,
+//	read just the sectors.  A track written while it was read is not
+//	kept: it may be older than what is on disk.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadTrack(int sector, int count, char *data)
+{
+    int track = sector / SectorsPerTrack;
+    int offset = (sector % SectorsPerTrack) * SectorSize;
+    CachedTrack *slot = NULL;
+
+    for (int i = 0; i < numTracks; i++)
+	if (tracks[i].track == track) {
+	    slot = &tracks[i];
+	    break;
+	}
+    if (slot != NULL && slot->valid) {
+	numTrackHits++;
+	slot->lastUsed = ++useClock;
+	bcopy(&slot->data[offset], data, count * SectorSize);
+	return;
+    }
+    if (slot == NULL)
+	for (int i = 0; i < numTracks; i++)
+	    if (!tracks[i].filling &&
+		    (slot == NULL || tracks[i].lastUsed < slot->lastUsed))
+		slot = &tracks[i];
+    if (slot == NULL || slot->filling) {
+	Transfer(sector, count, data, FALSE);
+	return;
+    }
+
+    numTrackMisses++;
+    slot->track = track;
+    slot->valid = slot->stale = FALSE;
+    slot->filling = TRUE;
+    slot->lastUsed = ++useClock;
+    Transfer(track * SectorsPerTrack, SectorsPerTrack, slot->data, FALSE);
+    slot->filling = FALSE;
+    slot->valid = !slot->stale;
+    bcopy(&slot->data[offset], data, count * SectorSize);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::DropTracks
+// 	Throw away the copy of each track holding some of the "count"
+//	sectors from "sector" on, and mark any being read as stale.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::DropTracks(int sector, int count)
+{
+    int first = sector / SectorsPerTrack;
+    int last = (sector + count - 1) / SectorsPerTrack;
+
+    for (int i = 0; i < numTracks; i++)
+	if (tracks[i].track >= first && tracks[i].track <= last) {
+	    tracks[i].valid = FALSE;
+	    tracks[i].stale = TRUE;
+	}
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SetTrackCache
+// 	Keep up to "numTracks" tracks in memory (see ReadTrack); 0 for
+//	none.  No request may be in progress.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::SetTrackCache(int numTracks)
+{
+    ASSERT(numTracks >= 0);
+    delete [] tracks;
+    tracks = (numTracks > 0) ? new CachedTrack[numTracks] : NULL;
+    this->numTracks = numTracks;
+    for (int i = 0; i < numTracks; i++) {
+	tracks[i].track = -1;
+	tracks[i].valid = tracks[i].filling = tracks[i].stale = FALSE;
+	tracks[i].lastUsed = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SetFairQueueing
+// 	Queue the requests for each disk fairly (see synchdisk.h), with
+//	turns of "slice" ticks; 0 to serve them in the order of the
+//	schedule alone.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::SetFairQueueing(int slice)
+{
+    ASSERT(slice >= 0);
+    for (int i = 0; i < numDisks; i++)
+	disks[i]->SetSlice(slice);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Transfer
+// 	Transfer "count" sectors of the volume, from "sector" on, to or
+//	from "data", on the disks, and wait until they are done.  With a
+//	single disk, that is one request to it.
+//
+//	A request for the sector after the last one done counts towards
+//	the time such requests take to come (see Interleave), unless it
+//	came a rotation or more later: no interleave would make up for
+//	that.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Transfer(int sector, int count, char *data, bool writing)
+{
+    if (sector == lastEnd) {
+	int gap = kernel->stats->totalTicks - lastDone;
+
+	if (gap < SectorsPerTrack * RotationTime) {
+	    gapTicks = (numGaps == 0) ? gap : (7 * gapTicks + gap) / 8;
+	    numGaps++;
+	}
+    }
+    if (mirrored && numDisks > 1) {
+	MirrorRequest(sector, count, data, writing);
+    } else if (numDisks == 1) {
+	DiskRequest *request = new DiskRequest(sector, count, data, writing);
+
+	disks[0]->Request(request);
+	request->done->P();			// wait for interrupt
+	delete request;
+    } else {
+	StripeRequest(sector, count, data, writing);
+    }
+    lastEnd = sector + count;
+    lastDone = kernel->stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StripeRequest
+// 	Transfer "count" sectors of a striped volume, from "sector" on, to
+//	or from "data", and wait until they are done.
+//
+//	The sectors on each disk are consecutive there (they are the
+//	disk's share of consecutive stripe units), so each disk gets one
+//	request, for a buffer of its own that the sectors are copied into
+//	or out of.  The requests are all sent, with interrupts off so that
+//	they start together, before waiting for any of them.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StripeRequest(int sector, int count, char *data, bool writing)
+{
+    DiskRequest *parts[MaxStripeDisks];
+    int first[MaxStripeDisks], numOn[MaxStripeDisks];
+    IntStatus oldLevel;
+    int d, s;
+
+
+    for (d = 0; d < numDisks; d++)
+	numOn[d] = 0;
+    for (s = sector; s < sector + count; s++) {
+	d = DiskOf(s);
+	if (numOn[d]++ == 0)
+	    first[d] = SectorOnDisk(s);
+    }
+    for (d = 0; d < numDisks; d++) {
+	parts[d] = NULL;
+	if (numOn[d] > 0)
+	    parts[d] = new DiskRequest(first[d], numOn[d],
+				       new char[numOn[d] * SectorSize], writing);
+    }
+    if (writing)
+	for (s = sector; s < sector + count; s++) {
+	    d = DiskOf(s);
+	    bcopy(&data[(s - sector) * SectorSize],
+		  &parts[d]->data[(SectorOnDisk(s) - first[d]) * SectorSize],
+		  SectorSize);
+	}
+
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    for (d = 0; d < numDisks; d++)
+	if (parts[d] != NULL)
+	    disks[d]->Request(parts[d]);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    for (d = 0; d < numDisks; d++)
+	if (parts[d] != NULL)
+	    parts[d]->done->P();		// wait for each interrupt
+
+    if (!writing)
+	for (s = sector; s < sector + count; s++) {
+	    d = DiskOf(s);
+	    bcopy(&parts[d]->data[(SectorOnDisk(s) - first[d]) * SectorSize],
+		  &data[(s - sector) * SectorSize], SectorSize);
+	}
+    for (d = 0; d < numDisks; d++)
+	if (parts[d] != NULL) {
+	    delete [] parts[d]->data;
+	    delete parts[d];
+	}
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::MirrorRequest
+// 	Transfer "count" sectors of a mirrored volume, from "sector" on,
+//	to or from "data", and wait until they are done.
+//
+//	A write goes to every disk, all sent before waiting for any, and
+//	all from "data" itself.  A read goes to one disk: of those with
+//	the fewest requests ahead of it, the one whose head would get to
+//	the sectors soonest.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::MirrorRequest(int sector, int count, char *data, bool writing)
+{
+    DiskRequest *parts[MaxStripeDisks];
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    int d;
+
+    if (!writing) {
+	DiskRequest *request = new DiskRequest(sector, count, data, FALSE);
+	int best = 0;
+
+	for (d = 1; d < numDisks; d++)
+	    if (disks[d]->NumWaiting() < disks[best]->NumWaiting() ||
+		    (disks[d]->NumWaiting() == disks[best]->NumWaiting() &&
+		     disks[d]->Latency(request) < disks[best]->Latency(request)))
+		best = d;
+	disks[best]->Request(request);
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	request->done->P();			// wait for interrupt
+	delete request;
+	return;
+    }
+
+    for (d = 0; d < numDisks; d++) {
+	parts[d] = new DiskRequest(sector, count, data, TRUE);
+	disks[d]->Request(parts[d]);
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    for (d = 0; d < numDisks; d++) {
+	parts[d]->done->P();			// wait for each interrupt
+	delete parts[d];
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Interleave
+// 	Return how many sectors apart on a track the sectors of a file
+//	should be allocated (see PersistentBitmap::FindAndSetInterleaved):
+//	1 for one after the other.
+//
+//	Unless it was set, it is measured: a request for the sector after
+//	the last finds the disk turned on by the time it took to come,
+//	and the next sector's start gone past the head.  The sector
+//	"interleave" after the last starts (interleave - 1) RotationTimes
+//	after it ends, so those that many sectors apart are the closest
+//	that need not wait a rotation.  Only a single or mirrored
+//	rotational disk has sectors that sit still on its tracks that
+//	way: a flash disk, a striped volume, or a log, always gets 1.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::Interleave()
+{
+    if (interleave > 0)
+	return interleave;
+    if (kernel->diskModel != RotationalModel || (numDisks > 1 && !mirrored) ||
+	    log != NULL || numGaps == 0)
+	return 1;
+    return min(1 + divRoundUp(gapTicks, RotationTime), MaxInterleave);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Print
+// 	Print the scheduling statistics of each disk, how many mirrors
+//	are missing, the interleave if it is not 1, how well the tracks
+//	kept in memory did, and what the log did.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Print()
+{
+    char name[16];
+
+    if (numMissing > 0)
+	printf("Mirrored volume degraded: %d of %d disks missing\n",
+	       numMissing, numDisks + numMissing);
+    if (Interleave() > 1)
+	printf("Interleave %d: %d requests for the next sector, %d ticks "
+	       "apart\n", Interleave(), numGaps, gapTicks);
+    if (numTracks > 0)
+	printf("Track cache of %d tracks: hits %d, misses %d\n", numTracks,
+	       numTrackHits, numTrackMisses);
+    if (log != NULL)
+	log->Print();
+    if (numDisks == 1) {
+	disks[0]->Print("Disk");
+	return;
+    }
+    for (int i = 0; i < numDisks; i++) {
+	sprintf(name, "Disk %d", i);
+	disks[i]->Print(name);
+    }
 }
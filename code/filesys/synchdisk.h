@@ -2,6 +2,54 @@
 // 	Data structures to export a synchronous interface to the raw 
 //	disk device.
 //
+//	The interface can also be to a volume striped across several
+//	disks (RAID-0): each is a Disk of its own, with its own UNIX file,
+//	head and queue of requests, and the volume's sectors are dealt out
+//	to them StripeSectors at a time, in turn.  A request is split into
+//	a request to each disk holding part of it, and the disks work on
+//	them at the same time, so a long transfer takes about as long as
+//	its share on one disk.  The volume holds as many sectors as all
+//	the disks together.
+//
+//	The sectors of a file read or written one at a time come to the
+//	disk a little while after each other, and a rotational disk has
+//	just turned past the next one when it is asked for.  Putting them
+//	a few sectors apart -- an interleave -- lets it get to the next in
+//	time instead of a rotation later.  How far apart can be set, or
+//	measured from how long requests for the sector after the last one
+//	take to come.
+//
+//	Whole tracks can also be kept in memory: a read that misses them
+//	reads all of the track it is on, as the disk's track buffer
+//	would have, and later reads of that track are served from memory.
+//	A write throws away the copy of the tracks it touches.
+//
+//	The volume can also be kept as a log (see logvolume.h): then the
+//	sectors the file system asks for are found, and appended, in the
+//	log, which takes a quarter of the disks to run.
+//
+//	Or the volume can be mirrored on several disks (RAID-1): each
+//	holds all of it, sector for sector.  A write goes to every disk,
+//	and a read to the one that can serve it soonest, from where its
+//	head is.  If some of the disks' UNIX files are missing, the
+//	volume runs degraded on the others; since the files are all the
+//	same, copying one that is there brings back one that is not.
+//
+//	Queued requests can also be served fairly among the processes
+//	making them (as CFQ does), so that background threads -- the
+//	write-behind, read-ahead and pageout threads, the defragmenter,
+//	the log cleaner -- cannot keep a program's reads waiting long.
+//	Each request is in the I/O class of the thread making it (see
+//	IoClass in thread.h).  Realtime requests are served first.  Then
+//	the processes with best-effort requests take turns: in its turn
+//	a process's requests are served, in the order of the schedule,
+//	for up to a slice of time or until it has none left, and the
+//	next turn goes to the process that has waited longest.  A
+//	kernel thread counts as a process of its own.  Idle requests are
+//	served when no others are waiting, or once they have waited
+//	IdleWaitLimit ticks, so that they are not put off for ever.  So
+//	a program's read waits for at most a turn of each other process.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -14,6 +62,117 @@
 #include "disk.h"
 #include "synch.h"
 #include "callback.h"
+#include "list.h"
+
+class LogVolume;
+
+#define MaxStripeDisks	8		// disks a volume can be striped
+					// across
+#define StripeSectors	8		// consecutive sectors of the volume
+					// on one disk, before the next one's
+#define MaxInterleave	(SectorsPerTrack / 2)	// most sectors apart that
+					// Interleave puts those of a file
+#define IdleWaitLimit	200000		// ticks an idle request waits before
+					// it is served as a best-effort one
+
+// The order in which queued requests are sent to the disk.
+
+enum DiskSchedule {
+    FifoSchedule,		// in order of arrival
+    SstfSchedule,		// shortest seek first: the closest sector
+    ScanSchedule,		// elevator: keep moving the head the same
+				// way while there are requests ahead,
+				// then turn around
+    CLookSchedule		// circular elevator: only serve requests
+				// while moving up, then jump back to the
+				// lowest one
+};
+
+// The following class defines one request waiting for the disk.
+
+class DiskRequest {
+  public:
+    DiskRequest(int sector, int count, char *data, bool writing);
+    ~DiskRequest();
+
+    int sector;			// First sector to transfer
+    int count;			// Number of consecutive sectors
+    char *data;			// Where the data comes from or goes to
+    bool writing;		// Write (rather than read) request?
+    int madeAt;			// When it was made, to tell how long
+				// it waited for the disk
+    void *owner;		// The process that made it (its address
+				// space), or the kernel thread
+    IoClass ioClass;		// and the class of the thread
+    Semaphore *done;		// Signalled when the transfer is over
+};
+
+// The following class defines a track of the volume kept in memory.
+
+class CachedTrack {
+  public:
+    int track;			// Which track, or -1 for none
+    bool valid;			// Does "data" hold it?
+    bool filling;		// Is it being read?
+    bool stale;			// Was it written while it was read?
+    int lastUsed;		// When it was last read, to find the
+				// least recently used
+    char data[SectorsPerTrack * SectorSize];
+};
+
+// The following class defines one disk of the volume: the raw device,
+// the requests waiting for it, and where its head is.  The sectors of
+// its requests are the disk's own.
+
+class DiskMember : public CallBackObj {
+  public:
+    DiskMember(DiskSchedule schedule, bool mapped, const char *name,
+	       int numTracks);
+    ~DiskMember();
+
+    void Request(DiskRequest *request);	// Send a request to the disk, or
+					// queue it; the caller waits for it
+    void CallBack();			// Called by the disk device interrupt
+					// handler: the request is done
+    int NumWaiting();			// Requests in progress or queued
+    void SetSlice(int slice) { this->slice = slice; }
+    					// See SynchDisk::SetFairQueueing
+    int Latency(DiskRequest *request);	// How long the request would take,
+					// sent to the disk now
+    int NumDiskSectors() { return disk->NumDiskSectors(); }
+    void Flush() { disk->Flush(); }	// See SynchDisk
+    void Erase();
+
+    void Print(const char *name);	// Print scheduling statistics
+
+  private:
+    DiskRequest *NextRequest();		// Take the next request to serve
+					// off the queue
+    List<DiskRequest *> *FairCandidates();
+    					// The queued requests fair queueing
+					// lets the schedule choose from
+    void Dispatch(DiskRequest *request);// Send a request to the disk
+
+    Disk *disk;		  		// Raw disk device
+    DiskSchedule schedule;		// How to order queued requests
+    List<DiskRequest *> *queue;		// Requests waiting for the disk
+    DiskRequest *active;		// Request the disk is working on,
+					// or NULL
+    int headSector;			// Last sector of the last request
+    bool movingUp;			// Direction of the SCAN elevator
+    int slice;				// Ticks of a process's turn, or 0
+					// for no fair queueing
+    void *turnOwner;			// The process whose turn it is
+    int turnEnds;			// and when its turn is over
+
+    int numRequests;			// Requests sent to the disk
+    int numTransferred;			// Sectors they covered
+    int numQueued;			// Requests that had to wait
+    int seekTicks;			// Total time spent seeking
+    int numTurns;			// Turns fair queueing gave out
+    int classServed[IoIdle + 1];	// Requests sent of each class
+    int classWait[IoIdle + 1];		// and the longest any waited
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -25,12 +184,40 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// Requests from different threads are not serialized by a lock:
+// while the disk is busy they wait in a queue, and whenever it
+// finishes a request the next one is chosen according to the
+// schedule, using the sector last sent to the disk as the position
+// of the head.  A striped volume does that for each of its disks.
 
-class SynchDisk : public CallBackObj {
+class SynchDisk {
   public:
-    SynchDisk();    		        // Initialize a synchronous disk,
-					// by initializing the raw Disk.
+    SynchDisk(DiskSchedule schedule = FifoSchedule, bool mapped = FALSE,
+	      const char *name = "DISK", int numDisks = 1,
+	      bool mirrored = FALSE, int numTracks = 0);
+    					// Initialize a synchronous disk,
+					// by initializing the raw Disks:
+					// "name", then "name"1, "name"2, ...
+					// striped across, or "mirrored" on,
+					// each of "numTracks" (see Disk)
     ~SynchDisk();			// De-allocate the synch disk data
+
+    int VolumeSectors();		// Sectors on all the disks, or in
+					// the log
+    int NumDisks() { return numDisks; }
+
+    void SetInterleave(int interleave) { this->interleave = interleave; }
+    					// Put the sectors of files that far
+					// apart, or 0 to find out how far
+    int Interleave();			// How far apart they go
+    void SetTrackCache(int numTracks);	// Keep that many tracks in memory
+    void SetFairQueueing(int slice);	// Give processes turns of "slice"
+					// ticks at the disks, or 0 for none
+    void MountLog(bool format, bool logged);
+    					// Start a log on the disks being
+					// formatted, if "logged", or find
+					// the one they have
     
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
@@ -39,17 +226,78 @@ class SynchDisk : public CallBackObj {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+
+    void ReadSectors(int sectorNumber, int numSectors, char* data);
+    					// Read/write "numSectors" consecutive
+					// sectors with one disk request
+    void WriteSectors(int sectorNumber, int numSectors, char* data);
+    void WriteGathered(int *sectors, int count, char *data);
+    					// Write "count" sectors, wherever
+					// they are: with one request to the
+					// log, or one for each run of them
+    bool IsLogged() { return log != NULL; }
+    					// Is the volume kept as a log?
     
-    void CallBack();			// Called by the disk device interrupt
-					// handler, to signal that the
-					// current disk operation is complete.
+    void Flush();			// Make sure what was written has
+					// reached the UNIX files
+    void Erase();			// Make every sector read as zeros,
+					// without writing them
+    void Checkpoint();			// Write the log's checkpoint, if
+					// there is a log
+
+    void Print();			// Print scheduling statistics
 
   private:
-    Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    friend class LogVolume;		// which requests physical sectors
+
+    int PhysicalSectors() { return mirrored ? diskSectors
+					    : numDisks * diskSectors; }
+    					// Sectors on all the disks
+    void Request(int sector, int count, char *data, bool writing);
+    					// Serve a request from the log,
+					// or PhysicalRequest it
+    void PhysicalRequest(int sector, int count, char *data, bool writing);
+    					// Serve a request from the cached
+					// tracks, or Transfer it
+    void ReadTrack(int sector, int count, char *data);
+    					// Serve a read from its track,
+					// reading the track if need be
+    void DropTracks(int sector, int count);
+    					// Throw away the cached tracks
+					// holding some of the sectors
+    void Transfer(int sector, int count, char *data, bool writing);
+    					// Send a request to the disks, and
+					// wait for it
+    void StripeRequest(int sector, int count, char *data, bool writing);
+    					// Send the part of a request on each
+					// disk to it, and wait for them all
+    void MirrorRequest(int sector, int count, char *data, bool writing);
+    					// Send a request to every disk of a
+					// mirror, or a read to the best one
+    int DiskOf(int sector) { return (sector / StripeSectors) % numDisks; }
+    int SectorOnDisk(int sector);	// Where a sector of the volume is
+					// on its disk
+
+    DiskMember *disks[MaxStripeDisks];	// The disks of the volume
+    int numDisks;			// those of them that are there
+    bool mirrored;			// Mirrored, rather than striped?
+    int numMissing;			// Mirrors whose UNIX files are gone
+    int diskSectors;			// Sectors on each disk
+    int interleave;			// As set, or 0 to measure it
+    int lastEnd;			// Sector after the last request done
+    int lastDone;			// and when it was done
+    int gapTicks;			// Average time from a request being
+					// done to the next one, for the
+					// sector after it, being made
+    int numGaps;			// Such requests seen
+    CachedTrack *tracks;		// The tracks kept in memory
+    int numTracks;			// how many there can be
+    int useClock;			// Reads of them so far
+    int numTrackHits;			// Reads served from them
+    int numTrackMisses;			// Reads of a track that had to be
+					// read first
+    LogVolume *log;			// The log the volume is kept as,
+					// or NULL
 };
 
 #endif // SYNCHDISK_H
@@ -27,6 +27,7 @@ Bitmap::Bitmap(int numItems)
     numBits = numItems;
     numWords = divRoundUp(numBits, BitsInWord);
     map = new unsigned int[numWords];
+    hint = 0;
     for (i = 0; i < numWords; i++) {
 	map[i] = 0;		// initialize map to keep Purify happy
     }
@@ -98,11 +99,28 @@ Bitmap::Test(int which) const
     }
 }
 
+//----------------------------------------------------------------------
+// Bitmap::WordMask
+// 	Return the bits of word "word" that stand for real items; only
+//	the last word can be partly outside the bitmap.
+//----------------------------------------------------------------------
+
+unsigned int
+Bitmap::WordMask(int word) const
+{
+    int extra = (word + 1) * BitsInWord - numBits;
+
+    if (extra <= 0)
+	return ~0u;
+    return ~0u >> extra;
+}
+
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
-// 	Return the number of the first bit which is clear.
-//	As a side effect, set the bit (mark it as in use).
-//	(In other words, find and allocate a bit.)
+// 	Return the number of the first clear bit at or after the word
+//	where the previous search succeeded, wrapping around to the
+//	start of the map.  As a side effect, set the bit (mark it as
+//	in use).  (In other words, find and allocate a bit.)
 //
 //	If no bits are clear, return -1.
 //----------------------------------------------------------------------
@@ -110,15 +128,137 @@ Bitmap::Test(int which) const
 int 
 Bitmap::FindAndSet() 
 {
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
+    for (int n = 0; n < numWords; n++) {
+	int w = (hint + n) % numWords;
+	unsigned int free = ~map[w] & WordMask(w);
+
+	if (free != 0) {
+	    int which = w * BitsInWord + __builtin_ctz(free);
+	    Mark(which);
+	    hint = w;
+	    return which;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetIn
+// 	Return the number of the first clear bit in [from, to), and set
+//	it.  If they are all set, return -1.
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindAndSetIn(int from, int to)
+{
+    ASSERT(from >= 0 && to <= numBits);
+    for (int i = from; i < to; ) {
+	if (i % BitsInWord == 0 && map[i / BitsInWord] == ~0u) {
+	    i += BitsInWord;		// skip a full word
+	} else if (!Test(i)) {
 	    Mark(i);
 	    return i;
+	} else {
+	    i++;
 	}
     }
     return -1;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::FindFirstSet
+// 	Return the number of the lowest bit that is set, or -1 if none
+//	is.  Empty words are skipped whole, and the bit within the first
+//	word that is not empty is found in one step.
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindFirstSet() const
+{
+    for (int i = 0; i < numWords; i++) {
+	unsigned int word = map[i] & WordMask(i);
+
+	if (word != 0)
+	    return i * BitsInWord + __builtin_ctz(word);
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetRun
+// 	Find a run of consecutive clear bits and set them.  The first run
+//	of at least "length" bits is used if there is one; otherwise the
+//	longest run of clear bits is taken.  Only the first "length"
+//	bits of the chosen run are set.
+//
+//	Return the number of the first bit of the run, and store how many
+//	bits were set in "found".  If no bits are clear, return -1.
+//
+//	"length" -- the number of consecutive bits wanted
+//	"found" -- the number of bits actually allocated
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindAndSetRun(int length, int *found)
+{
+    int start = FindRun(0, numBits, length, found);
+
+    for (int i = 0; i < *found; i++)
+	Mark(start + i);
+    return start;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindRun
+// 	Choose a run of clear bits the way FindAndSetRun does, but only
+//	among the runs that start in [from, to) (a run may go on past
+//	"to"); a run that is already under way at "from" counts as
+//	starting there.  Nothing is set.
+//
+//	Return the first bit of the run, and its length (at most
+//	"length") in "found"; or -1, with "found" 0, if every bit in the
+//	range is set.
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindRun(int from, int to, int length, int *found) const
+{
+    int bestStart = -1, bestLength = 0;
+    int i = from;
+
+    ASSERT(length > 0);
+    ASSERT(from >= 0 && to <= numBits);
+    while (i < to && bestLength < length) {
+	if (i % BitsInWord == 0 && map[i / BitsInWord] == ~0u) {
+	    i += BitsInWord;		// skip a full word
+	    continue;
+	}
+	if (Test(i)) {
+	    i++;
+	    continue;
+	}
+	int start = i;
+	while (i < numBits && i - start < length) {
+	    if (i % BitsInWord == 0 && map[i / BitsInWord] == 0
+				&& i + BitsInWord <= numBits) {
+		i += BitsInWord;	// a whole empty word
+	    } else if (!Test(i)) {
+		i++;
+	    } else {
+		break;
+	    }
+	}
+	if (i - start > length)
+	    i = start + length;
+	if (i - start > bestLength) {
+	    bestStart = start;
+	    bestLength = i - start;
+	}
+    }
+    *found = bestLength;
+    return bestStart;
+}
+
 //----------------------------------------------------------------------
 // Bitmap::NumClear
 // 	Return the number of clear bits in the bitmap.
@@ -130,10 +270,8 @@ Bitmap::NumClear() const
 {
     int count = 0;
 
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    count++;
-	}
+    for (int w = 0; w < numWords; w++) {
+	count += __builtin_popcount(~map[w] & WordMask(w));
     }
     return count;
 }
@@ -172,18 +310,50 @@ Bitmap::SelfTest()
     ASSERT(numBits >= BitsInWord);	// bitmap must be big enough
 
     ASSERT(NumClear() == numBits);	// bitmap must be empty
+    ASSERT(FindFirstSet() == -1);
     ASSERT(FindAndSet() == 0);
     Mark(31);
     ASSERT(Test(0) && Test(31));
 
     ASSERT(FindAndSet() == 1);
+
+    int found;
+    ASSERT(FindAndSetRun(4, &found) == 2 && found == 4);
+    ASSERT(FindAndSetRun(30, &found) == 32 && found == 30);
+    for (i = 2; i < 6; i++)
+        Clear(i);
+    for (i = 32; i < 62; i++)
+        Clear(i);
+
+    // searches limited to a range; runs may end past the range
+    ASSERT(FindRun(3, 4, 10, &found) == 3 && found == 10);
+    ASSERT(FindRun(31, 33, 10, &found) == 32 && found == 10);
+    ASSERT(FindAndSetIn(31, 33) == 32 && Test(32));
+    ASSERT(FindAndSetIn(31, 32) == -1);
+    Clear(32);
+
     Clear(0);
     Clear(1);
+    ASSERT(FindFirstSet() == 31);
     Clear(31);
 
+    // next fit: a bit freed behind the last allocation is only found
+    // once the search wraps around
+    for (i = 0; i < BitsInWord + 5; i++) {
+        Mark(i);
+    }
+    ASSERT(FindAndSet() == BitsInWord + 5);
+    Clear(3);
+    ASSERT(FindAndSet() == BitsInWord + 6);
+    ASSERT(NumClear() == numBits - BitsInWord - 7 + 1);
+    for (i = 0; i < BitsInWord + 7; i++) {
+        Clear(i);
+    }
+
     for (i = 0; i < numBits; i++) {
         Mark(i);
     }
+    ASSERT(NumClear() == 0);
     ASSERT(FindAndSet() == -1);		// bitmap should be full!
     for (i = 0; i < numBits; i++) {
         Clear(i);
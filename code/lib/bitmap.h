@@ -4,6 +4,8 @@
 //
 //	Represented as an array of unsigned integers, on which we do
 //	modulo arithmetic to find the bit we are interested in.
+//	Searches work a word at a time, skipping full (or empty) words
+//	without looking at their individual bits.
 //
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
@@ -34,15 +36,31 @@ class Bitmap {
   public:
     Bitmap(int numItems);	// Initialize a bitmap, with "numItems" bits
 				// initially, all bits are cleared.
-    ~Bitmap();			// De-allocate bitmap
+    virtual ~Bitmap();		// De-allocate bitmap
     
-    void Mark(int which);   	// Set the "nth" bit
-    void Clear(int which);  	// Clear the "nth" bit
+    virtual void Mark(int which);   	// Set the "nth" bit
+    virtual void Clear(int which);  	// Clear the "nth" bit
     bool Test(int which) const;	// Is the "nth" bit set?
     int FindAndSet();         // Return the # of a clear bit, and as a side
-				// effect, set the bit. 
+				// effect, set the bit.  The search starts
+				// where the last one left off (next fit).
 				// If no bits are clear, return -1.
+    int FindAndSetRun(int length, int *found);
+				// Allocate a run of up to "length"
+				// consecutive clear bits; return its
+				// start, and its length in "found"
+    int FindAndSetIn(int from, int to);
+				// Allocate the first clear bit in
+				// [from, to), or return -1
+    int FindRun(int from, int to, int length, int *found) const;
+				// Like FindAndSetRun, but only for runs
+				// starting in [from, to), and without
+				// setting any bits
     int NumClear() const;	// Return the number of clear bits
+    int NumBits() const { return numBits; }
+				// and the number of bits
+    int FindFirstSet() const;	// Return the # of the lowest set bit,
+				// or -1 if none is set
 
     void Print() const;		// Print contents of bitmap
     void SelfTest();		// Test whether bitmap is working
@@ -54,6 +72,11 @@ class Bitmap {
 				//  multiple of the number of bits in
 				//  a word)
     unsigned int *map;		// bit storage
+    int hint;			// word where the next FindAndSet starts
+
+  private:
+    unsigned int WordMask(int word) const;
+    				// Bits of "word" that are inside the map
 };
 
 #endif // BITMAP_H
@@ -0,0 +1,192 @@
+// compress.cc
+//	Routines to compress and decompress a buffer (see compress.h).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "compress.h"
+#include "debug.h"
+
+#define HashBits	10		// the hash table has 2^HashBits entries
+
+//----------------------------------------------------------------------
+// Hash
+//	Return the hash table entry for the 3-byte string at "p".
+//----------------------------------------------------------------------
+
+static unsigned int
+Hash(char *p)
+{
+    unsigned int key = ((unsigned char) p[0] << 16) |
+		       ((unsigned char) p[1] << 8) | (unsigned char) p[2];
+
+    return (key * 2654435761u) >> (32 - HashBits);
+}
+
+//----------------------------------------------------------------------
+// PutLiterals
+//	Add the "numBytes" bytes at "from" to the compressed data "to",
+//	which holds "*out" bytes of at most "room", as literal items.
+//	Return FALSE if they do not fit.
+//----------------------------------------------------------------------
+
+static bool
+PutLiterals(char *from, int numBytes, char *to, int *out, int room)
+{
+    while (numBytes > 0) {
+	int n = min(numBytes, MaxLiteralRun);
+
+	if (*out + 1 + n > room)
+	    return FALSE;
+	to[(*out)++] = n - 1;
+	bcopy(from, &to[*out], n);
+	*out += n;
+	from += n;
+	numBytes -= n;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Compress
+//	Compress the "numBytes" bytes at "from" into "to", and return how
+//	many bytes that took; or -1 if it takes more than "room".  Each
+//	position is looked up in a table of the last position whose next
+//	three bytes had the same hash; if those bytes match (and are not
+//	too far back), the longest match from there is coded, and the
+//	search goes on after it.
+//
+//	"from" -- the data to compress
+//	"numBytes" -- how many bytes of it
+//	"to" -- where to put the compressed data
+//	"room" -- the most it may take
+//----------------------------------------------------------------------
+
+int
+Compress(char *from, int numBytes, char *to, int room)
+{
+    unsigned short last[1 << HashBits];	// a position + 1, or 0 if none
+    int in = 0, out = 0, literals = 0;	// first byte not coded yet
+
+    bzero(last, sizeof(last));
+    while (in + MinMatch <= numBytes) {
+	unsigned int h = Hash(&from[in]);
+	int match = last[h] - 1, length;
+
+	last[h] = in + 1;
+	if (match < 0 || in - match > MaxOffset ||
+		bcmp(&from[match], &from[in], MinMatch) != 0) {
+	    in++;
+	    continue;
+	}
+	for (length = MinMatch; length < MaxMatch && in + length < numBytes;
+		length++)
+	    if (from[match + length] != from[in + length])
+		break;
+	if (!PutLiterals(&from[literals], in - literals, to, &out, room) ||
+		out + 2 > room)
+	    return -1;
+	to[out++] = 0x80 | ((length - MinMatch) << 2) |
+		    ((in - match - 1) >> 8);
+	to[out++] = (in - match - 1) & 0xff;
+	for (int i = in + 1; i < in + length && i + MinMatch <= numBytes; i++)
+	    last[Hash(&from[i])] = i + 1;
+	in += length;
+	literals = in;
+    }
+    if (!PutLiterals(&from[literals], numBytes - literals, to, &out, room))
+	return -1;
+    return out;
+}
+
+//----------------------------------------------------------------------
+// Decompress
+//	Decompress the "numBytes" bytes of compressed data at "from" into
+//	"to", and return how many bytes they came to; or -1 if that is
+//	more than "room", or the data is damaged.
+//----------------------------------------------------------------------
+
+int
+Decompress(char *from, int numBytes, char *to, int room)
+{
+    int in = 0, out = 0;
+
+    while (in < numBytes) {
+	int item = (unsigned char) from[in++];
+
+	if (item & 0x80) {			// a match
+	    if (in >= numBytes)
+		return -1;
+	    int length = ((item >> 2) & 0x1f) + MinMatch;
+	    int offset = (((item & 3) << 8) | (unsigned char) from[in++]) + 1;
+	    if (offset > out || out + length > room)
+		return -1;
+	    for (int i = 0; i < length; i++, out++)	// may overlap
+		to[out] = to[out - offset];
+	} else {				// literals
+	    int length = item + 1;
+	    if (in + length > numBytes || out + length > room)
+		return -1;
+	    bcopy(&from[in], &to[out], length);
+	    in += length;
+	    out += length;
+	}
+    }
+    return out;
+}
+
+//----------------------------------------------------------------------
+// CompressSelfTest
+//	Test that Decompress gives back what Compress was given: for text
+//	like the numbers in a data file, which must get much smaller; a
+//	run of one byte; and bytes that do not compress, which must not
+//	grow by more than a byte in MaxLiteralRun, nor fit in less room.
+//----------------------------------------------------------------------
+
+void
+CompressSelfTest()
+{
+    const int size = 1024;
+    char *data = new char[size];
+    char *packed = new char[2 * size];
+    char *unpacked = new char[size];
+    unsigned int seed = 1;
+    int n, i;
+
+    for (i = 0, n = 1; i < size; n++) {	// like test/num_1000.txt
+	char line[16];
+	sprintf(line, "%09d ", n);
+	for (char *p = line; *p != '\0' && i < size; p++)
+	    data[i++] = *p;
+    }
+    n = Compress(data, size, packed, 2 * size);
+    ASSERT(n > 0 && n < size / 2);
+    ASSERT(Decompress(packed, n, unpacked, size) == size);
+    ASSERT(bcmp(data, unpacked, size) == 0);
+
+    memset(data, 'x', size);
+    n = Compress(data, size, packed, 2 * size);
+    ASSERT(n > 0 && n < size / 8);
+    ASSERT(Decompress(packed, n, unpacked, size) == size);
+    ASSERT(bcmp(data, unpacked, size) == 0);
+
+    for (i = 0; i < size; i++) {
+	seed = seed * 1103515245 + 12345;
+	data[i] = seed >> 16;
+    }
+    n = Compress(data, size, packed, 2 * size);
+    ASSERT(n >= size && n <= size + divRoundUp(size, MaxLiteralRun));
+    ASSERT(Decompress(packed, n, unpacked, size) == size);
+    ASSERT(bcmp(data, unpacked, size) == 0);
+    ASSERT(Compress(data, size, packed, n - 1) == -1);
+    ASSERT(Decompress(packed, n, unpacked, size - 1) == -1);
+
+    ASSERT(Compress(data, 0, packed, 0) == 0);
+    ASSERT(Decompress(packed, 0, unpacked, 0) == 0);
+
+    delete [] data;
+    delete [] packed;
+    delete [] unpacked;
+}
@@ -0,0 +1,41 @@
+// compress.h
+//	Routines to compress a buffer, and to get it back, with a simple
+//	LZ77 code that is quick to compress and quicker to decompress.
+//
+//	The compressed data is a sequence of items, each starting with a
+//	byte that tells what it is:
+//		0LLLLLLL	L+1 literal bytes follow
+//		1LLLLLOO	a match: with the byte after it, OO are the
+//				high and low bits of offset-1; the L+MinMatch
+//				bytes from "offset" bytes back repeat
+//
+//	Matches are found through a hash table of the last place each
+//	3-byte string was seen, so compression takes one pass, and
+//	decompression is a loop of copies.  Incompressible data grows by
+//	a byte in MaxLiteralRun.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "copyright.h"
+
+#define MinMatch	3		// shortest match worth coding
+#define MaxMatch	(MinMatch + 31)	// longest one an item holds
+#define MaxOffset	1024		// how far back a match can reach
+#define MaxLiteralRun	128		// literal bytes an item holds
+
+extern int Compress(char *from, int numBytes, char *to, int room);
+					// Compress "numBytes" bytes into at
+					// most "room" at "to"; return the
+					// size, or -1 if it does not fit
+extern int Decompress(char *from, int numBytes, char *to, int room);
+					// Undo Compress; return the bytes
+					// at "to", or -1 if "from" is not
+					// compressed data that fits in "room"
+extern void CompressSelfTest();		// Test that the two agree
+
+#endif // COMPRESS_H
@@ -31,8 +31,10 @@ Debug::Debug(char *flagList)
 //----------------------------------------------------------------------
 // Debug::IsEnabled
 //      Return TRUE if DEBUG messages with "flag" are to be printed.
+//	(Inline, and always FALSE, with NO_DEBUG.)
 //----------------------------------------------------------------------
 
+#ifndef NO_DEBUG
 bool
 Debug::IsEnabled(char flag)
 {
@@ -43,3 +45,4 @@ Debug::IsEnabled(char flag)
     	return FALSE;
     }
 }
+#endif
@@ -29,12 +29,21 @@ const char dbgFile = 'f'; 		// file system
 const char dbgAddr = 'a'; 		// address spaces
 const char dbgNet = 'n'; 		// network emulation
 const char dbgSys = 'u';                // systemcall
+const char dbgCache = 'c';		// buffer cache
+
+// Built with NO_DEBUG (as the nachos-fast target is), no flag is ever
+// enabled, so that the compiler can drop every DEBUG message, and
+// every debugging check, from the hot paths.
 
 class Debug {
   public:
     Debug(char *flagList);
 
+#ifdef NO_DEBUG
+    bool IsEnabled(char flag) { return FALSE; }
+#else
     bool IsEnabled(char flag);
+#endif
 
   private:
     char *enableFlags;		// controls which DEBUG messages are printed
@@ -45,12 +54,20 @@ extern Debug *debug;
 
 //----------------------------------------------------------------------
 // DEBUG
-//      If flag is enabled, print a message.
+//      If flag is enabled, print a message.  (With NO_DEBUG, the message
+//	is still compiled, so it stays correct, but never printed.)
 //----------------------------------------------------------------------
+#ifdef NO_DEBUG
+#define DEBUG(flag,expr)                                                     \
+    while (FALSE) { 							\
+        cerr << expr << "\n";   				        \
+    }
+#else
 #define DEBUG(flag,expr)                                                     \
     if (!debug->IsEnabled(flag)) {} else { 				\
         cerr << expr << "\n";   				        \
     }
+#endif
 
 
 //----------------------------------------------------------------------
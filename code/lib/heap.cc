@@ -0,0 +1,498 @@
+// heap.cc
+//     	Routines to manage heaps and skip lists of "things", ordered by
+//	a comparison function.  Both are templates, like List.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+const int InitialHeapEntries = 16;	// room a heap starts with
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// Heap<T>::Heap, ~Heap
+//	Initialize a heap, empty to start with; prepare it for
+//	deallocation.  Items still in it are not touched.
+//----------------------------------------------------------------------
+
+template <class T>
+Heap<T>::Heap(int (*comp)(T x, T y))
+{
+    compare = comp;
+    maxEntries = InitialHeapEntries;
+    entries = new HeapEntry<T>[maxEntries];
+    numInList = 0;
+    nextSeq = 0;
+}
+
+template <class T>
+Heap<T>::~Heap()
+{
+    delete [] entries;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::Before
+//	Return TRUE if entry "i" must come out before entry "j": it is
+//	smaller, or equal and went in first.  Sequence numbers are
+//	compared by their difference, so that they may wrap around.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+Heap<T>::Before(int i, int j) const
+{
+    int c = compare(entries[i].item, entries[j].item);
+
+    if (c != 0)
+	return c < 0;
+    return (int) (entries[i].seq - entries[j].seq) < 0;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::SiftUp, SiftDown
+//	Swap entry "i" with its parent while it comes before it; or with
+//	the first of its children while that comes before it.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::SiftUp(int i)
+{
+    while (i > 0 && Before(i, (i - 1) / 2)) {
+	HeapEntry<T> tmp = entries[i];
+
+	entries[i] = entries[(i - 1) / 2];
+	entries[(i - 1) / 2] = tmp;
+	i = (i - 1) / 2;
+    }
+}
+
+template <class T>
+void
+Heap<T>::SiftDown(int i)
+{
+    for (;;) {
+	int child = 2 * i + 1;
+	HeapEntry<T> tmp;
+
+	if (child >= numInList)
+	    break;
+	if (child + 1 < numInList && Before(child + 1, child))
+	    child++;
+	if (!Before(child, i))
+	    break;
+	tmp = entries[i];
+	entries[i] = entries[child];
+	entries[child] = tmp;
+	i = child;
+    }
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::Insert
+//      Put "item" in the heap, doubling the array if it is full.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::Insert(T item)
+{
+    if (numInList == maxEntries) {
+	HeapEntry<T> *bigger = new HeapEntry<T>[2 * maxEntries];
+
+	for (int i = 0; i < numInList; i++)
+	    bigger[i] = entries[i];
+	delete [] entries;
+	entries = bigger;
+	maxEntries *= 2;
+    }
+    entries[numInList].item = item;
+    entries[numInList].seq = nextSeq++;
+    SiftUp(numInList++);
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::RemoveFront
+//      Remove the smallest item from the heap, which must not be empty,
+//	and return it: the last entry takes its place, and sinks.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+Heap<T>::RemoveFront()
+{
+    T item;
+
+    ASSERT(!IsEmpty());
+    item = entries[0].item;
+    entries[0] = entries[--numInList];
+    SiftDown(0);
+    return item;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::Remove
+//      Remove "item", which must be in the heap.  It is found by looking
+//	at every entry; the last entry takes its place, and moves up or
+//	down to where it belongs.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::Remove(T item)
+{
+    int i;
+
+    for (i = 0; i < numInList && entries[i].item != item; i++)
+	continue;
+    ASSERT(i < numInList);
+    entries[i] = entries[--numInList];
+    if (i < numInList) {
+	SiftUp(i);
+	SiftDown(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::Apply
+//      Apply function to every item in the heap, in no particular order.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::Apply(void (*func)(T)) const
+{
+    for (int i = 0; i < numInList; i++)
+	(*func)(entries[i].item);
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::SanityCheck
+//      Test whether this is still a legal heap.
+//
+//	Test: does any entry come before its parent?
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::SanityCheck() const
+{
+    ASSERT(numInList >= 0 && numInList <= maxEntries);
+    for (int i = 1; i < numInList; i++)
+	ASSERT(!Before(i, (i - 1) / 2));
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::SelfTest
+//      Test whether this module is working.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+    T prev, next;
+
+    SanityCheck();
+    ASSERT(IsEmpty());
+
+    // twice each, so that there are equal items to keep in order, and
+    // enough of them for the array to grow
+    for (i = 0; i < 2 * numEntries * InitialHeapEntries; i++) {
+	Insert(p[i % numEntries]);
+	ASSERT(!IsEmpty());
+    }
+    SanityCheck();
+
+    // taking one out from the middle leaves a heap
+    Remove(p[numEntries / 2]);
+    SanityCheck();
+    Insert(p[numEntries / 2]);
+
+    // should be able to get out everything we put in, in order
+    prev = RemoveFront();
+    for (i = 1; i < 2 * numEntries * InitialHeapEntries; i++) {
+	next = RemoveFront();
+	ASSERT(compare(prev, next) <= 0);
+	prev = next;
+    }
+    ASSERT(IsEmpty());
+    SanityCheck();
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::SkipList, ~SkipList
+//	Initialize a skip list, empty to start with; de-allocate the
+//	nodes of one.  The items on it are not touched.
+//----------------------------------------------------------------------
+
+template <class T>
+SkipList<T>::SkipList(int (*comp)(T x, T y))
+{
+    compare = comp;
+    head.levels = SkipMaxLevels;
+    head.next = headNext;
+    for (int l = 0; l < SkipMaxLevels; l++)
+	headNext[l] = NULL;
+    levels = 1;
+    numInList = 0;
+    randomState = 2463534242u;
+}
+
+template <class T>
+SkipList<T>::~SkipList()
+{
+    while (!IsEmpty())
+	(void) RemoveFront();
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::RandomLevels
+//	Return how many levels a new node goes on: one, and one more
+//	for each of the low bits of a random number (by xorshift) that
+//	is set.
+//----------------------------------------------------------------------
+
+template <class T>
+int
+SkipList<T>::RandomLevels()
+{
+    int n = 1;
+
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    for (unsigned r = randomState; (r & 1) && n < SkipMaxLevels; r >>= 1)
+	n++;
+    return n;
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::FindBefore
+//	Going down from the top level, set before[l] to the last node on
+//	level l that is smaller than "item" -- or, unless "equalToo", no
+//	bigger than it.  Return the node after before[0], the first that
+//	may be equal to "item", or NULL.
+//----------------------------------------------------------------------
+
+template <class T>
+SkipNode<T> *
+SkipList<T>::FindBefore(T item, SkipNode<T> **before, bool equalToo)
+{
+    SkipNode<T> *node = &head;
+
+    for (int l = levels - 1; l >= 0; l--) {
+	while (node->next[l] != NULL) {
+	    int c = compare(node->next[l]->item, item);
+
+	    if (c > 0 || (c == 0 && equalToo))
+		break;
+	    node = node->next[l];
+	}
+	before[l] = node;
+    }
+    return node->next[0];
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::Insert
+//      Put "item" on the list, after every item no bigger than it, and
+//	link it into its levels.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SkipList<T>::Insert(T item)
+{
+    SkipNode<T> *before[SkipMaxLevels];
+    SkipNode<T> *node = new SkipNode<T>;
+
+    (void) FindBefore(item, before, FALSE);
+    node->item = item;
+    node->levels = RandomLevels();
+    node->next = new SkipNode<T> *[node->levels];
+    for (; levels < node->levels; levels++)
+	before[levels] = &head;
+    for (int l = 0; l < node->levels; l++) {
+	node->next[l] = before[l]->next[l];
+	before[l]->next[l] = node;
+    }
+    numInList++;
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::RemoveFront
+//      Remove the first item from the list, which must not be empty,
+//	and return it.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+SkipList<T>::RemoveFront()
+{
+    SkipNode<T> *node = head.next[0];
+    T item;
+
+    ASSERT(!IsEmpty());
+    for (int l = 0; l < node->levels; l++)
+	head.next[l] = node->next[l];
+    while (levels > 1 && head.next[levels - 1] == NULL)
+	levels--;
+    item = node->item;
+    delete [] node->next;
+    delete node;
+    numInList--;
+    return item;
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::Remove
+//      Remove a specific item from the list.  Must be in the list!
+//	Among the items equal to it, the one that is "==" to it is
+//	found by stepping along the bottom level, keeping "before" up
+//	to date for the levels of each node stepped over.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SkipList<T>::Remove(T item)
+{
+    SkipNode<T> *before[SkipMaxLevels];
+    SkipNode<T> *node = FindBefore(item, before, TRUE);
+
+    while (node != NULL && !(node->item == item)) {
+	ASSERT(compare(node->item, item) == 0);	// must be in the list
+	for (int l = 0; l < node->levels; l++)
+	    before[l] = node;
+	node = node->next[0];
+    }
+    ASSERT(node != NULL);
+    for (int l = 0; l < node->levels; l++) {
+	ASSERT(before[l]->next[l] == node);
+	before[l]->next[l] = node->next[l];
+    }
+    while (levels > 1 && head.next[levels - 1] == NULL)
+	levels--;
+    delete [] node->next;
+    delete node;
+    numInList--;
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::IsInList
+//      Return TRUE if the item is in the list.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+SkipList<T>::IsInList(T item)
+{
+    SkipNode<T> *before[SkipMaxLevels];
+    SkipNode<T> *node = FindBefore(item, before, TRUE);
+
+    for (; node != NULL && compare(node->item, item) == 0;
+	 node = node->next[0]) {
+	if (node->item == item)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::Apply
+//      Apply function to every item on the list, in order.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SkipList<T>::Apply(void (*func)(T)) const
+{
+    for (SkipNode<T> *node = head.next[0]; node != NULL; node = node->next[0])
+	(*func)(node->item);
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::SanityCheck
+//      Test whether this is still a legal skip list.
+//
+//	Tests: is the bottom level sorted, with the right # of nodes?
+//	       are the nodes on each level above on the one below it too?
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SkipList<T>::SanityCheck() const
+{
+    SkipNode<T> *node, *below;
+    int numFound = 0;
+
+    for (node = head.next[0]; node != NULL; node = node->next[0]) {
+	numFound++;
+	ASSERT(numFound <= numInList);		// prevent infinite loop
+	ASSERT(node->levels >= 1 && node->levels <= levels);
+	if (node->next[0] != NULL) {
+	    ASSERT(compare(node->item, node->next[0]->item) <= 0);
+	}
+    }
+    ASSERT(numFound == numInList);
+    for (int l = 1; l < levels; l++) {
+	below = head.next[l - 1];
+	for (node = head.next[l]; node != NULL; node = node->next[l]) {
+	    while (below != node) {
+		ASSERT(below != NULL);
+		below = below->next[l - 1];
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// SkipList<T>::SelfTest
+//      Test whether this module is working.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SkipList<T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+    T *q = new T[numEntries];
+
+    SanityCheck();
+    ASSERT(IsEmpty());
+
+    for (i = 0; i < numEntries; i++) {
+	Insert(p[i]);
+	ASSERT(IsInList(p[i]));
+    }
+    SanityCheck();
+    for (i = 0; i < numEntries; i++) {
+	Remove(p[i]);
+	ASSERT(!IsInList(p[i]));
+	SanityCheck();
+    }
+    ASSERT(IsEmpty());
+
+    for (i = 0; i < numEntries; i++)
+	Insert(p[i]);
+    // should be able to get out everything we put in, in order
+    for (i = 0; i < numEntries; i++) {
+	q[i] = RemoveFront();
+	ASSERT(!IsInList(q[i]));
+    }
+    ASSERT(IsEmpty());
+    for (i = 0; i < (numEntries - 1); i++)
+	ASSERT(compare(q[i], q[i + 1]) <= 0);
+    SanityCheck();
+
+    delete [] q;
+}
@@ -0,0 +1,176 @@
+// heap.h
+//	Data structures to manage ordered collections faster than a
+//	SortedList, with the same comparison function:
+//	   int Compare(T x, T y)
+//		returns -1 if x < y
+//		returns 0 if x == y
+//		returns 1 if x > y
+//
+//	A "heap" gives back its smallest item first, as a SortedList does
+//	on RemoveFront, but an Insert or RemoveFront moves only log n of
+//	the items, kept in one array; it cannot be stepped through in
+//	order, and taking out any item but the smallest has to find it
+//	first.  A "skip list" is a sorted linked list with extra links
+//	that skip ahead over runs of items, so finding where an item goes
+//	takes about log n steps; it can be stepped through in order, and
+//	any item removed.
+//
+//	In both, as in a SortedList, items that compare equal come out in
+//	the order they went in.  Allocation and deallocation of the items
+//	are to be done by the caller; the heap allocates nothing, except
+//	to grow.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "copyright.h"
+#include "debug.h"
+
+// The following class defines an entry of a heap: the item, and when
+// it went in, among those of the heap, to break ties.
+
+template <class T>
+class HeapEntry {
+  public:
+    T item;
+    unsigned seq;
+};
+
+// The following class defines a "heap" -- a binary tree in an array,
+// entries[0] at the root, in which no entry comes before its parent.
+
+template <class T>
+class Heap {
+  public:
+    Heap(int (*comp)(T x, T y));	// initialize the heap
+    ~Heap();			// de-allocate the heap
+
+    void Insert(T item);	// Put an item in the heap
+    T Front() { ASSERT(!IsEmpty()); return entries[0].item; }
+				// Return its smallest item, without
+				// removing it
+    T RemoveFront();		// Take the smallest item out
+    void Remove(T item);	// Take a specific item out
+
+    unsigned int NumInList() { return numInList; }
+				// how many items in the heap?
+    bool IsEmpty() { return (numInList == 0); }
+				// is the heap empty?
+
+    void Apply(void (*f)(T)) const;
+				// apply function to all items, in no
+				// particular order
+
+    void SanityCheck() const;	// has this heap been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    HeapEntry<T> *entries;	// entries[1..numInList-1] below [0]
+    int numInList;		// number of items in the heap
+    int maxEntries;		// room in "entries"; doubled when full
+    unsigned nextSeq;		// given to the next item to go in
+    int (*compare)(T x, T y);	// function for ordering items
+
+    bool Before(int i, int j) const;	// Must entry i come before j?
+    void SiftUp(int i);		// Move entry i up to its place
+    void SiftDown(int i);	// Move entry i down to its place
+};
+
+// The following defines a node of a skip list.  Every node is on the
+// bottom level, level 0, which links them all in order; a node on
+// level l is also on level l+1 with probability 1/2.
+
+#define SkipMaxLevels	20	// enough for about a million items
+
+template <class T>
+class SkipNode {
+  public:
+    T item;
+    int levels;			// how many levels it is on
+    SkipNode<T> **next;		// the next node on each of them, or NULL
+};
+
+template <class T> class SkipListIterator;
+
+// The following class defines a "skip list".
+
+template <class T>
+class SkipList {
+  public:
+    SkipList(int (*comp)(T x, T y));	// initialize the list
+    ~SkipList();		// de-allocate the list
+
+    void Insert(T item);	// Put an item on the list in sorted order,
+				// after those equal to it
+    T Front() { ASSERT(!IsEmpty()); return head.next[0]->item; }
+				// Return the smallest item, without
+				// removing it
+    T RemoveFront();		// Take the smallest item off the list
+    void Remove(T item);	// Remove a specific item from the list
+    bool IsInList(T item);	// is the item in the list?
+
+    unsigned int NumInList() { return numInList; }
+				// how many items in the list?
+    bool IsEmpty() { return (numInList == 0); }
+				// is the list empty?
+
+    void Apply(void (*f)(T)) const;
+				// apply function to all items, in order
+
+    void SanityCheck() const;	// has this list been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    SkipNode<T> head;		// links to the first node on each level
+    SkipNode<T> *headNext[SkipMaxLevels];	// head's "next"
+    int levels;			// levels in use
+    int numInList;		// number of items in the list
+    unsigned randomState;	// for choosing the levels of new nodes,
+				// apart from RandomNumber, so that using
+				// a skip list does not change how a
+				// random run of Nachos goes
+    int (*compare)(T x, T y);	// function for ordering items
+
+    int RandomLevels();		// how many levels a new node goes on
+    SkipNode<T> *FindBefore(T item, SkipNode<T> **before, bool equalToo);
+				// Fill "before" with the last node on each
+				// level ahead of where "item" goes
+
+    friend class SkipListIterator<T>;
+};
+
+// The following class can be used to step through a skip list, in
+// order -- same interface as ListIterator.  Example code:
+//	SkipListIterator<T> iter(list);
+//
+//	for (; !iter.IsDone(); iter.Next()) {
+//	    Operation on iter.Item()
+//      }
+
+template <class T>
+class SkipListIterator {
+  public:
+    SkipListIterator(SkipList<T> *list) { current = list->head.next[0]; }
+				// initialize an iterator
+
+    bool IsDone() { return current == NULL; }
+				// return TRUE if we are at the end of the list
+    T Item() { ASSERT(!IsDone()); return current->item; }
+				// return current element on list
+    void Next() { current = current->next[0]; }
+				// update iterator to point to next
+
+  private:
+    SkipNode<T> *current;	// where we are in the list
+};
+
+#include "heap.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // HEAP_H
@@ -1,6 +1,9 @@
 // libtest.cc 
 //	Driver code to call self-test routines for standard library
-//	classes -- bitmaps, lists, sorted lists, and hash tables.
+//	classes -- bitmaps, lists, sorted lists, intrusive lists, heaps,
+//	skip lists, and chained and open addressing hash tables -- and the
+//	compression routines, slab caches and arenas; and to time the
+//	ordered containers against each other.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -11,6 +14,10 @@
 #include "bitmap.h"
 #include "list.h"
 #include "hash.h"
+#include "openhash.h"
+#include "heap.h"
+#include "compress.h"
+#include "slab.h"
 #include "sysdep.h"
 
 //----------------------------------------------------------------------
@@ -53,6 +60,13 @@ HashKey(char *str) {
 // Array of values to be inserted into a List or SortedList. 
 static int listTestVector[] = { 9, 5, 7 };
 
+// Objects to be put on an IntrusiveList.
+class LinkedInt {
+  public:
+    ListLink<LinkedInt> listLink;
+};
+static LinkedInt linkedTestVector[3];
+
 // Array of values to be inserted into the HashTable
 // There are enough here to force a ReHash().
 static char *hashTestVector[] = { "0", "1", "2", "3", "4", "5", "6",
@@ -60,8 +74,9 @@ static char *hashTestVector[] = { "0", "1", "2", "3", "4", "5", "6",
 
 //----------------------------------------------------------------------
 // LibSelfTest
-//	Run self tests on bitmaps, lists, sorted lists, and 
-//	hash tables.
+//	Run self tests on bitmaps, lists, sorted lists, intrusive
+//	lists, heaps, skip lists, both kinds of hash tables, the
+//	compression routines, and slab caches and arenas.
 //----------------------------------------------------------------------
 
 void
@@ -69,17 +84,97 @@ LibSelfTest () {
     Bitmap *map = new Bitmap(200);
     List<int> *list = new List<int>;
     SortedList<int> *sortList = new SortedList<int>(IntCompare);
+    IntrusiveList<LinkedInt> *linkedList = new IntrusiveList<LinkedInt>;
+    Heap<int> *heap = new Heap<int>(IntCompare);
+    SkipList<int> *skipList = new SkipList<int>(IntCompare);
     HashTable<int, char *> *hashTable = 
 	new HashTable<int, char *>(HashKey, HashInt);
+    OpenHashTable<int, char *> *openTable =
+	new OpenHashTable<int, char *>(HashKey, HashInt);
 	
 		
     map->SelfTest();
     list->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
     sortList->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
+    linkedList->SelfTest(linkedTestVector,
+			 sizeof(linkedTestVector)/sizeof(LinkedInt));
+    heap->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
+    skipList->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
     hashTable->SelfTest(hashTestVector, sizeof(hashTestVector)/sizeof(char *));
+    openTable->SelfTest(hashTestVector, sizeof(hashTestVector)/sizeof(char *));
+    CompressSelfTest();
+    SlabSelfTest();
 
     delete map;
     delete list;
     delete sortList;
+    delete linkedList;
+    delete heap;
+    delete skipList;
     delete hashTable;
+    delete openTable;
+}
+
+//----------------------------------------------------------------------
+// TimeOrdered
+//	Return how many microseconds it takes, on the host, to put the
+//	"n" numbers at "keys" into "list" and take them all out again,
+//	smallest first, "rounds" times over.
+//----------------------------------------------------------------------
+
+template <class L>
+static unsigned int
+TimeOrdered(L *list, int *keys, int n, int rounds)
+{
+    unsigned int start = HostMicroseconds();
+
+    for (int r = 0; r < rounds; r++) {
+	for (int i = 0; i < n; i++)
+	    list->Insert(keys[i]);
+	while (!list->IsEmpty())
+	    (void) list->RemoveFront();
+    }
+    return HostMicroseconds() - start;
+}
+
+//----------------------------------------------------------------------
+// LibBenchmark
+//	Time a SortedList, a heap and a skip list, filled with 10, 1000
+//	and 100000 numbers in random order and emptied again -- the smaller sizes
+//	many times over, so that there is something to measure.  A
+//	SortedList takes time n^2 for this, so the largest size takes
+//	it minutes.
+//----------------------------------------------------------------------
+
+void
+LibBenchmark()
+{
+    static int sizes[] = { 10, 1000, 100000 };
+    SortedList<int> *sortList = new SortedList<int>(IntCompare);
+    Heap<int> *heap = new Heap<int>(IntCompare);
+    SkipList<int> *skipList = new SkipList<int>(IntCompare);
+
+    for (unsigned s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+	int n = sizes[s];
+	int rounds = max(1, 100000 / n);
+	int *keys = new int[n];
+
+	for (int i = 0; i < n; i++)	// distinct, as a SortedList needs,
+	    keys[i] = i;		// in random order
+	for (int i = n - 1; i > 0; i--) {
+	    int j = RandomNumber() % (i + 1), k = keys[i];
+
+	    keys[i] = keys[j];
+	    keys[j] = k;
+	}
+	cout << n << " items, " << rounds << " rounds, in microseconds: "
+	     << "sorted list " << TimeOrdered(sortList, keys, n, rounds)
+	     << ", heap " << TimeOrdered(heap, keys, n, rounds)
+	     << ", skip list " << TimeOrdered(skipList, keys, n, rounds)
+	     << "\n";
+	delete [] keys;
+    }
+    delete sortList;
+    delete heap;
+    delete skipList;
 }
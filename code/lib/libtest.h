@@ -11,5 +11,6 @@
 #include "copyright.h"
 
 extern void LibSelfTest();
+extern void LibBenchmark();	// time the ordered containers
 
 #endif // LIBTEST_H
@@ -346,6 +346,188 @@ SortedList<T>::SanityCheck() const
     }
 }
 
+//----------------------------------------------------------------------
+// IntrusiveList<T>::IntrusiveList, ~IntrusiveList
+//	Initialize a list, empty to start with; prepare it for
+//	deallocation.  Items still on it are not touched -- normally
+//	there are none.
+//----------------------------------------------------------------------
+
+template <class T>
+IntrusiveList<T>::IntrusiveList()
+{
+    first = last = NULL;
+    numInList = 0;
+}
+
+template <class T>
+IntrusiveList<T>::~IntrusiveList()
+{
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::Append, Prepend
+//      Put "item", which must not be on any list, at the end or the
+//	front of the list, linking it through its own ListLink.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::Append(T *item)
+{
+    ListLink<T> *link = &item->listLink;
+
+    ASSERT(link->list == NULL);
+    link->list = this;
+    link->prev = last;
+    link->next = NULL;
+    if (IsEmpty())
+	first = item;
+    else
+	last->listLink.next = item;
+    last = item;
+    numInList++;
+}
+
+template <class T>
+void
+IntrusiveList<T>::Prepend(T *item)
+{
+    ListLink<T> *link = &item->listLink;
+
+    ASSERT(link->list == NULL);
+    link->list = this;
+    link->prev = NULL;
+    link->next = first;
+    if (IsEmpty())
+	last = item;
+    else
+	first->listLink.prev = item;
+    first = item;
+    numInList++;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::RemoveFront
+//      Remove the first item from the front of the list, which must not
+//	be empty, and return it.
+//----------------------------------------------------------------------
+
+template <class T>
+T *
+IntrusiveList<T>::RemoveFront()
+{
+    T *item = first;
+
+    ASSERT(!IsEmpty());
+    Remove(item);
+    return item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::Remove
+//      Remove a specific item from the list.  Must be in the list!
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::Remove(T *item)
+{
+    ListLink<T> *link = &item->listLink;
+
+    ASSERT(IsInList(item));
+    if (link->prev == NULL)
+	first = link->next;
+    else
+	link->prev->listLink.next = link->next;
+    if (link->next == NULL)
+	last = link->prev;
+    else
+	link->next->listLink.prev = link->prev;
+    link->prev = link->next = NULL;
+    link->list = NULL;
+    numInList--;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::Apply
+//      Apply function to every item on a list.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::Apply(void (*func)(T *)) const
+{
+    for (T *ptr = first; ptr != NULL; ptr = ptr->listLink.next)
+	(*func)(ptr);
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::SanityCheck
+//      Test whether this is still a legal list.
+//
+//	Tests: do the links agree in both directions, and do they all
+//	       say they are on this list?
+//	       does the list have the right # of elements?
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::SanityCheck() const
+{
+    T *prev = NULL, *ptr;
+    int numFound = 0;
+
+    for (ptr = first; ptr != NULL; prev = ptr, ptr = ptr->listLink.next) {
+	numFound++;
+	ASSERT(numFound <= numInList);		// prevent infinite loop
+	ASSERT(ptr->listLink.prev == prev && ptr->listLink.list == this);
+    }
+    ASSERT(numFound == numInList && last == prev);
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::SelfTest
+//      Test whether this module is working, on the "numEntries" items
+//	at "p", none of which may be on a list.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+
+    SanityCheck();
+    ASSERT(IsEmpty() && Front() == NULL);
+
+    for (i = 0; i < numEntries; i++) {
+	Append(&p[i]);
+	ASSERT(IsInList(&p[i]) && !IsEmpty());
+    }
+    SanityCheck();
+
+    // take out the middle, then put it back at the front
+    if (numEntries > 2) {
+	Remove(&p[1]);
+	ASSERT(!IsInList(&p[1]));
+	SanityCheck();
+	Prepend(&p[1]);
+	ASSERT(Front() == &p[1] && Next(&p[1]) == &p[0]);
+	SanityCheck();
+    }
+
+    // should be able to get out everything we put in
+    for (i = 0; i < numEntries; i++) {
+	Remove(&p[i]);
+	ASSERT(!IsInList(&p[i]));
+	SanityCheck();
+    }
+    ASSERT(IsEmpty() && Front() == NULL);
+}
+
 //----------------------------------------------------------------------
 // SortedList::SelfTest
 //      Test whether this module is working.
@@ -136,6 +136,71 @@ class ListIterator {
     ListElement<T> *current;	// where we are in the list
 };
 
+// The following class defines the link kept inside an object that can
+// be put on an "intrusive list".  The object must have a public member
+// "ListLink<T> listLink"; it can then be on only one such list at a
+// time, but putting it on one, and taking it off, allocates nothing.
+
+template <class T> class IntrusiveList;
+
+template <class T>
+class ListLink {
+  public:
+    ListLink() { prev = next = NULL; list = NULL; }
+    T *prev;			// neighbours on the list, NULL at the ends
+    T *next;
+    IntrusiveList<T> *list;	// the list it is on, NULL if none
+};
+
+// The following class defines an "intrusive list" -- a doubly linked
+// list of objects, through the ListLinks inside them, for queues that
+// are used too often to allocate a ListElement for each item: the ready
+// lists, and the threads waiting on a semaphore or a lock.  Items are
+// pointers, and an item can be removed from the middle without a search.
+//
+// Example code:
+//	for (t = list->Front(); t != NULL; t = list->Next(t)) {
+//	    Operation on t
+//	}
+
+template <class T>
+class IntrusiveList {
+  public:
+    IntrusiveList();		// initialize the list
+    ~IntrusiveList();		// de-allocate the list
+
+    void Prepend(T *item);	// Put item at the beginning of the list
+    void Append(T *item);	// Put item at the end of the list
+
+    T *Front() { return first; }
+				// Return first item on list without
+				// removing it, or NULL if it is empty
+    T *Next(T *item) { return item->listLink.next; }
+				// Return the item after "item", or NULL
+    T *RemoveFront();		// Take item off the front of the list
+    void Remove(T *item);	// Remove specific item from list
+
+    bool IsInList(T *item) const { return item->listLink.list == this; }
+				// is the item in the list?
+
+    unsigned int NumInList() { return numInList; }
+				// how many items in the list?
+    bool IsEmpty() { return (numInList == 0); }
+				// is the list empty?
+
+    void Apply(void (*f)(T *)) const;
+				// apply function to all elements in list
+
+    void SanityCheck() const;	// has this list been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    T *first;			// Head of the list, NULL if list is empty
+    T *last;			// Last element of list
+    int numInList;		// number of elements in list
+};
+
 #include "list.cc"		// templates are really like macros
 				// so needs to be included in every
 				// file that uses the template
@@ -0,0 +1,337 @@
+// openhash.cc
+//     	Routines to manage a self-expanding, open addressing hash table
+//	of arbitrary things.  The hashing function is supplied by the
+//	objects being put into the table; we use linear probing to
+//	resolve hash conflicts.
+//
+//	The table is implemented as one array of slots, whose size is a
+//	power of two, and we double it if it gets more than 3/4 full --
+//	so there is always a free slot to end a search.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+const int InitialSlots = 8;	// how big a table do we start with
+const int InitialShift = 29;	// 32 - log2(InitialSlots)
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::OpenHashTable
+//	Initialize a hash table, empty to start with.
+//	Elements can now be added to the table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashTable<Key,T>::OpenHashTable(Key (*get)(T x), unsigned (*hFunc)(Key x))
+{
+    numItems = 0;
+    shift = InitialShift;
+    InitSlots(InitialSlots);
+    getKey = get;
+    hash = hFunc;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::InitSlots
+//	Allocate an array of "size" empty slots.  Called by the
+//	constructor and by ReHash().
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::InitSlots(int size)
+{
+    numSlots = size;
+    slots = new OpenHashSlot<T>[numSlots];
+    for (int i = 0; i < numSlots; i++)
+	slots[i].full = FALSE;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::~OpenHashTable
+//	Prepare a hash table for deallocation.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashTable<Key,T>::~OpenHashTable()
+{
+    ASSERT(IsEmpty());		// make sure table is empty
+    delete [] slots;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::FindSlot
+//      Return the slot holding the item with "key", whose hash is "h",
+//	or -1 if it is not in the table: it is in the run of full slots
+//	that starts at its home, if anywhere.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+int
+OpenHashTable<Key,T>::FindSlot(Key key, unsigned h) const
+{
+    for (int i = Home(h); slots[i].full; i = Next(i)) {
+	if (slots[i].hash == h && key == getKey(slots[i].item))
+	    return i;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Place
+//      Put "item", whose key hashes to "h", in the first free slot from
+//	its home.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::Place(unsigned h, T item)
+{
+    int i;
+
+    for (i = Home(h); slots[i].full; i = Next(i))
+	;
+    slots[i].full = TRUE;
+    slots[i].hash = h;
+    slots[i].item = item;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Insert
+//      Put an item into the table, first doubling the table if it
+//	would become more than 3/4 full.
+//
+//	"item" is the thing to put in the table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::Insert(T item)
+{
+    Key key = getKey(item);
+
+    ASSERT(!IsInTable(key));
+
+    if ((numItems + 1) * 4 > numSlots * 3) {
+	ReHash();
+    }
+    Place((*hash)(key), item);
+    numItems++;
+
+    ASSERT(IsInTable(key));
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::ReHash
+//      Double the size of the table, moving every item into the new
+//	array by the hash kept beside it.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::ReHash()
+{
+    OpenHashSlot<T> *oldSlots = slots;
+    int oldSize = numSlots;
+
+    SanityCheck();
+    shift--;
+    InitSlots(numSlots * 2);
+    for (int i = 0; i < oldSize; i++) {
+	if (oldSlots[i].full)
+	    Place(oldSlots[i].hash, oldSlots[i].item);
+    }
+    delete [] oldSlots;
+    SanityCheck();
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Find
+//      Find an item from the hash table.
+//
+// Returns:
+//	Whether it is found, and if found, the item, else NULL.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+bool
+OpenHashTable<Key,T>::Find(Key key, T *itemPtr) const
+{
+    int i = FindSlot(key, (*hash)(key));
+
+    if (i < 0) {
+	*itemPtr = NULL;
+	return FALSE;
+    }
+    *itemPtr = slots[i].item;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Remove
+//      Remove an item from the hash table. The item must be in the table.
+//
+//	The items after it that could not go in its slot (or in one
+//	before, freed in turn) move back, until a free slot ends the
+//	run; so each item stays reachable from its home with no free
+//	slot in between, without marking the slot as once used.
+//
+// Returns:
+//	The removed item.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+T
+OpenHashTable<Key,T>::Remove(Key key)
+{
+    int hole = FindSlot(key, (*hash)(key));
+    T item;
+
+    ASSERT(hole >= 0);		// item must be in table
+    item = slots[hole].item;
+
+    for (int i = Next(hole); slots[i].full; i = Next(i)) {
+	int home = Home(slots[i].hash);
+	bool stays;		// is its home after the hole, up to i?
+
+	if (hole < i)
+	    stays = (hole < home && home <= i);
+	else			// the run wraps around the end
+	    stays = (hole < home || home <= i);
+	if (!stays) {
+	    slots[hole] = slots[i];
+	    hole = i;
+	}
+    }
+    slots[hole].full = FALSE;
+    numItems--;
+
+    ASSERT(!IsInTable(key));
+    return item;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Apply
+//      Apply function to every item in the hash table.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::Apply(void (*func)(T)) const
+{
+    for (int i = 0; i < numSlots; i++) {
+	if (slots[i].full)
+	    (*func)(slots[i].item);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::SanityCheck
+//      Test whether this is still a legal hash table.
+//
+//	Tests: does the table have the right # of elements, with room
+//	       to spare?
+//	       is every item's hash that of its key, and can it be
+//	       reached from its home without crossing a free slot?
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::SanityCheck() const
+{
+    int numFound = 0;
+
+    for (int i = 0; i < numSlots; i++) {
+	if (!slots[i].full)
+	    continue;
+	numFound++;
+	ASSERT(slots[i].hash == (*hash)(getKey(slots[i].item)));
+	for (int j = Home(slots[i].hash); j != i; j = Next(j))
+	    ASSERT(slots[j].full);
+    }
+    ASSERT(numItems == numFound && numItems < numSlots);
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::SelfTest
+//      Test whether this module is working.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::SelfTest(T *p, int numEntries)
+{
+    int i, j;
+    OpenHashIterator<Key, T> *iterator = new OpenHashIterator<Key,T>(this);
+
+    SanityCheck();
+    ASSERT(IsEmpty());	// check that table is empty in various ways
+    for (; !iterator->IsDone(); iterator->Next()) {
+	ASSERTNOTREACHED();
+    }
+    delete iterator;
+
+    for (i = 0; i < numEntries; i++) {
+        Insert(p[i]);
+        ASSERT(IsInTable(getKey(p[i])));
+        ASSERT(!IsEmpty());
+    }
+    SanityCheck();
+
+    // every item should be seen by an iterator, once
+    iterator = new OpenHashIterator<Key,T>(this);
+    for (i = 0; !iterator->IsDone(); iterator->Next())
+	i++;
+    ASSERT(i == numEntries);
+    delete iterator;
+
+    // should be able to get out everything we put in, and still find
+    // the rest after each one is moved up
+    for (i = 0; i < numEntries; i++) {
+        ASSERT(Remove(getKey(p[i])) == p[i]);
+	SanityCheck();
+	for (j = i + 1; j < numEntries; j++)
+	    ASSERT(IsInTable(getKey(p[j])));
+    }
+
+    ASSERT(IsEmpty());
+    SanityCheck();
+}
+
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::OpenHashIterator
+//      Initialize a data structure to allow us to step through
+//	every entry in a hash table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashIterator<Key,T>::OpenHashIterator(OpenHashTable<Key,T> *tbl)
+{
+    table = tbl;
+    for (slot = 0; slot < table->numSlots; slot++) {
+	if (table->slots[slot].full)
+	    break;
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::Next
+//      Update an iterator to step to the next full slot.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashIterator<Key,T>::Next()
+{
+    for (slot++; slot < table->numSlots; slot++) {
+	if (table->slots[slot].full)
+	    break;
+    }
+}
@@ -0,0 +1,130 @@
+// openhash.h
+//      Data structures to manage an "open addressing" hash table: the
+//	same interface as HashTable in hash.h, but with the items kept in
+//	one array, rather than in a list for each bucket.  An item goes
+//	in the slot its key hashes to, or if that is taken, in the next
+//	free one after it (linear probing), so a lookup reads a few
+//	neighbouring slots instead of chasing list elements, and putting
+//	an item in the table allocates nothing.
+//
+//	Removing an item moves the items after it, up to the next free
+//	slot, back toward where they hash to, if they can go there; so
+//	no "deleted" markers are left to slow down later lookups.
+//
+//	As with HashTable, the key must have "==" defined, and the caller
+//	supplies the hash function, and a function to retrieve the key
+//	from an item:
+//		unsigned Hash(Key k);
+//		Key GetKey(T x);
+//
+//	The table doubles in size when it becomes too full.  Allocation
+//	and deallocation of the items in the table are to be done by the
+//	caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef OPENHASH_H
+#define OPENHASH_H
+
+#include "copyright.h"
+#include "debug.h"
+
+// The following class defines one slot of the array.  The hash of the
+// item's key is kept beside it, so that a probe compares keys only
+// when their hashes agree, and growing the table need not hash again.
+
+template <class T>
+class OpenHashSlot {
+  public:
+    bool full;			// is there an item here?
+    unsigned hash;		// the hash of its key
+    T item;
+};
+
+// The following class defines an open addressing hash table.
+
+template <class Key, class T> class OpenHashIterator;
+
+template <class Key, class T>
+class OpenHashTable {
+  public:
+    OpenHashTable(Key (*get)(T x), unsigned (*hFunc)(Key x));
+    				// initialize a hash table
+    ~OpenHashTable();		// deallocate a hash table
+
+    void Insert(T item);	// Put item into hash table
+    T Remove(Key key);		// Remove item from hash table.
+
+    bool Find(Key key, T *itemPtr) const;
+    				// Find an item from its key
+    bool IsInTable(Key key) { T dummy; return Find(key, &dummy); }
+				// Is the item in the table?
+
+    bool IsEmpty() { return numItems == 0; }
+				// does the table have anything in it
+    int NumInTable() { return numItems; }
+				// how many items are there?
+
+    void Apply(void (*f)(T)) const;
+    				// apply function to all elements in table
+
+    void SanityCheck() const;	// is this still a legal hash table?
+    void SelfTest(T *p, int numItems);
+    				// is the module working?
+
+  private:
+    OpenHashSlot<T> *slots;	// the array of slots
+    int numSlots;		// its size, a power of two
+    int shift;			// 32 - log2(numSlots)
+    int numItems;		// the number of slots full
+
+    Key (*getKey)(T x);		// get Key from value
+    unsigned (*hash)(Key x);	// the hash function
+
+    void InitSlots(int size);	// allocate an empty array of slots
+    int Home(unsigned h) const { return (h * 2654435769u) >> shift; }
+				// the slot a key with hash "h" belongs in:
+				// the top bits of the product depend on
+				// every bit of the hash
+    int Next(int slot) const { return (slot + 1) & (numSlots - 1); }
+				// the slot probed after "slot"
+    int FindSlot(Key key, unsigned h) const;
+				// where the item with "key" is, or -1
+    void Place(unsigned h, T item);	// put an item in the first free
+					// slot from its home
+    void ReHash();		// double the size of the table
+
+    friend class OpenHashIterator<Key, T>;
+};
+
+// The following class can be used to step through an open addressing
+// hash table -- same interface as HashIterator.  Example code:
+//	OpenHashIterator<Key, T> iter(table);
+//
+//	for (; !iter.IsDone(); iter.Next()) {
+//	    Operation on iter.Item()
+//      }
+
+template <class Key, class T>
+class OpenHashIterator {
+  public:
+    OpenHashIterator(OpenHashTable<Key, T> *table);
+				// initialize an iterator
+
+    bool IsDone() { return slot == table->numSlots; }
+				// return TRUE if no more items in table
+    T Item() { ASSERT(!IsDone()); return table->slots[slot].item; }
+				// return current item in table
+    void Next();		// update iterator to point to next
+
+  private:
+    OpenHashTable<Key, T> *table;	// the table we're stepping through
+    int slot;			// the slot of the current item
+};
+
+#include "openhash.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // OPENHASH_H
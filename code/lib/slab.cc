@@ -0,0 +1,290 @@
+// slab.cc
+//	Routines to manage slab caches and arenas (see slab.h).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "slab.h"
+
+// bytes an arena chunk takes before the ones it hands out
+#define ChunkHeader	(divRoundUp(sizeof(ArenaChunk), SlabAlign) * SlabAlign)
+
+// bytes handed out of a chunk from "chunkCache"
+#define ChunkBytes	((int) (ArenaChunkSize - ChunkHeader))
+
+static SlabCache chunkCache("arena chunks", ArenaChunkSize, 8);
+static SlabCache arenaCache("arenas", sizeof(Arena));
+
+//----------------------------------------------------------------------
+// SlabCache::SlabCache
+// 	Initialize an empty cache of objects of "size" bytes, taken from
+//	the host "perSlab" at a time.  Objects are rounded up to a
+//	multiple of SlabAlign bytes, and to room for the free list link.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+SlabCache::SlabCache(const char *debugName, int size, int perSlab)
+{
+    ASSERT(size > 0 && perSlab > 0);
+    name = debugName;
+    size = max(size, (int) sizeof(FreeObject));
+    this->size = divRoundUp(size, SlabAlign) * SlabAlign;
+    this->perSlab = perSlab;
+    freeList = NULL;
+    numInUse = 0;
+    numSlabs = 0;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::~SlabCache
+// 	Nothing to do: the caches are globals, and objects of theirs may
+//	be freed still, as other globals are destroyed after them.  The
+//	slabs go back to the host as Nachos exits.
+//----------------------------------------------------------------------
+
+SlabCache::~SlabCache()
+{
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Alloc
+// 	Return an object off the free list, taking a new slab from the
+//	host, and putting all its objects on the list, if it is empty.
+//----------------------------------------------------------------------
+
+void *
+SlabCache::Alloc()
+{
+    FreeObject *object;
+
+    if (freeList == NULL) {
+	char *slab = new char[size * perSlab];
+
+	for (int i = perSlab - 1; i >= 0; i--) {
+	    object = (FreeObject *) (slab + i * size);
+	    object->next = freeList;
+	    freeList = object;
+	}
+	numSlabs++;
+    }
+    object = freeList;
+    freeList = object->next;
+    numInUse++;
+    return (void *) object;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Free
+// 	Put "object" back on the free list, to be handed out next.
+//	Freeing NULL does nothing, as deleting it does.
+//----------------------------------------------------------------------
+
+void
+SlabCache::Free(void *object)
+{
+    FreeObject *free = (FreeObject *) object;
+
+    if (free == NULL)
+	return;
+    ASSERT(numInUse > 0);
+    free->next = freeList;
+    freeList = free;
+    numInUse--;
+}
+
+//----------------------------------------------------------------------
+// ArenaChunk::Bytes
+// 	Return where the bytes the chunk hands out start, just after it.
+//----------------------------------------------------------------------
+
+char *
+ArenaChunk::Bytes()
+{
+    return (char *) this + ChunkHeader;
+}
+
+//----------------------------------------------------------------------
+// Arena::Arena
+// 	Initialize an arena with no chunks; the first Alloc takes one.
+//----------------------------------------------------------------------
+
+Arena::Arena()
+{
+    chunks = current = NULL;
+    used = 0;
+    numChunks = 0;
+}
+
+//----------------------------------------------------------------------
+// Arena::~Arena
+// 	Give back the chunks: the usual ones to their cache, and any
+//	made for a larger allocation to the host.  Nothing allocated from
+//	the arena may be used any more.
+//----------------------------------------------------------------------
+
+Arena::~Arena()
+{
+    while (chunks != NULL) {
+	ArenaChunk *chunk = chunks;
+
+	chunks = chunk->next;
+	if (chunk->size == ChunkBytes)
+	    chunkCache.Free(chunk);
+	else
+	    delete [] (char *) chunk;
+    }
+}
+
+//----------------------------------------------------------------------
+// Arena::operator new, Arena::operator delete
+// 	Allocate an arena from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+Arena::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Arena));
+    return arenaCache.Alloc();
+}
+
+void
+Arena::operator delete(void *object)
+{
+    arenaCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// Arena::Alloc
+// 	Return the next "numBytes" of the current chunk (rounded up to a
+//	multiple of SlabAlign).  If they do not fit, go on to the next
+//	chunk -- put in after the current one first, if there is none,
+//	or it is too small: a usual one, or one of just the size asked
+//	for, if that is larger.  A chunk passed over for being too small
+//	is kept, for the next time the arena is emptied back to it.
+//
+//	"numBytes" is how many bytes the caller needs
+//----------------------------------------------------------------------
+
+char *
+Arena::Alloc(int numBytes)
+{
+    char *bytes;
+
+    ASSERT(numBytes >= 0);
+    numBytes = divRoundUp(max(numBytes, 1), SlabAlign) * SlabAlign;
+    if (current == NULL || used + numBytes > current->size) {
+	ArenaChunk *next = (current == NULL) ? chunks : current->next;
+
+	if (next == NULL || next->size < numBytes) {
+	    if (numBytes <= ChunkBytes) {
+		next = (ArenaChunk *) chunkCache.Alloc();
+		next->size = ChunkBytes;
+	    } else {
+		next = (ArenaChunk *) new char[ChunkHeader + numBytes];
+		next->size = numBytes;
+	    }
+	    if (current == NULL) {
+		next->next = chunks;
+		chunks = next;
+	    } else {
+		next->next = current->next;
+		current->next = next;
+	    }
+	    numChunks++;
+	}
+	current = next;
+	used = 0;
+    }
+    bytes = current->Bytes() + used;
+    used += numBytes;
+    return bytes;
+}
+
+//----------------------------------------------------------------------
+// ArenaMark::ArenaMark
+// 	Note how much of "arena" is handed out, to go back to it.
+//----------------------------------------------------------------------
+
+ArenaMark::ArenaMark(Arena *arena)
+{
+    this->arena = arena;
+    current = arena->current;
+    used = arena->used;
+}
+
+//----------------------------------------------------------------------
+// ArenaMark::~ArenaMark
+// 	Give back everything allocated from the arena since the mark was
+//	made.  The chunks stay in the arena, for what it hands out next.
+//----------------------------------------------------------------------
+
+ArenaMark::~ArenaMark()
+{
+    arena->current = current;
+    arena->used = used;
+}
+
+//----------------------------------------------------------------------
+// SlabSelfTest
+// 	Test a slab cache: the objects it hands out are distinct, and it
+//	reuses the ones freed rather than take more slabs.  Then test an
+//	arena: what it hands out does not overlap, a large allocation
+//	gets a chunk of its own, and after a mark is deleted the same
+//	allocations take the same memory, and no new chunks.
+//----------------------------------------------------------------------
+
+void
+SlabSelfTest()
+{
+    SlabCache *cache = new SlabCache("test", 20, 8);
+    char *objects[20];
+    Arena *arena = new Arena;
+    char *first[4], *again[4];
+    static int sizes[] = { 100, 3000, 10000, 1 };
+    int i, j;
+
+    ASSERT(cache->Size() == 24);
+    for (i = 0; i < 20; i++) {
+	objects[i] = (char *) cache->Alloc();
+	memset(objects[i], i, 20);
+    }
+    for (i = 0; i < 20; i++)
+	for (j = 0; j < 20; j++)
+	    ASSERT(objects[i][j] == i);
+    ASSERT(cache->NumInUse() == 20 && cache->NumSlabs() == 3);
+    for (i = 0; i < 20; i++)
+	cache->Free(objects[i]);
+    for (i = 0; i < 20; i++)
+	objects[i] = (char *) cache->Alloc();
+    ASSERT(cache->NumInUse() == 20 && cache->NumSlabs() == 3);
+    for (i = 0; i < 20; i++)
+	cache->Free(objects[i]);
+    ASSERT(cache->NumInUse() == 0);
+    delete cache;			// its slabs are kept: leaked, here
+
+    {
+	ArenaMark mark(arena);
+
+	for (i = 0; i < 4; i++) {
+	    first[i] = arena->Alloc(sizes[i]);
+	    memset(first[i], i, sizes[i]);
+	}
+	for (i = 0; i < 4; i++)
+	    for (j = 0; j < sizes[i]; j++)
+		ASSERT(first[i][j] == i);
+    }
+    ASSERT(arena->NumChunks() == 3);
+    {
+	ArenaMark mark(arena);
+
+	for (i = 0; i < 4; i++)
+	    again[i] = arena->Alloc(sizes[i]);
+    }
+    for (i = 0; i < 4; i++)
+	ASSERT(again[i] == first[i]);
+    ASSERT(arena->NumChunks() == 3);
+    delete arena;
+}
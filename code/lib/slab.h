@@ -0,0 +1,128 @@
+// slab.h
+//	Data structures to allocate kernel memory without going to the
+//	host's allocator each time.
+//
+//	A "slab cache" hands out objects of one size, for one kind of
+//	object the kernel makes and frees over and over (file headers,
+//	open files, locks, ...).  It takes them from slabs of many objects
+//	at once, and keeps what is freed on a free list, for the next to
+//	be made; slabs are never given back to the host.  A class whose
+//	objects come from a cache says so with an operator new and delete
+//	of its own, so that its users still write "new" and "delete".
+//
+//	An "arena" hands out memory for as long as the operation that
+//	asked for it lasts -- the temporary buffers of a system call, say.
+//	Each allocation just takes the next bytes of its chunk; none is
+//	freed by itself, but an ArenaMark, made as the operation starts,
+//	gives all of them back at once as it goes out of scope.  The
+//	chunks are kept for the next operation.
+//
+//	Nachos runs one thread at a time, and none of this can block, so
+//	no locking is needed.  An arena belongs to one thread, though,
+//	since operations on different threads do not end in order.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "copyright.h"
+#include "debug.h"
+
+#define SlabObjects	32		// objects a slab holds, by default
+#define ArenaChunkSize	4096		// bytes in a chunk of an arena
+#define SlabAlign	8		// objects and allocations start on
+					// this boundary
+
+// The following class defines a free object of a slab cache: the
+// first bytes of the object link it to the next free one.
+
+class FreeObject {
+  public:
+    FreeObject *next;
+};
+
+// The following class defines a "slab cache" of objects of one size.
+
+class SlabCache {
+  public:
+    SlabCache(const char *debugName, int size, int perSlab = SlabObjects);
+					// No slabs yet: they are made as
+					// they are needed
+    ~SlabCache();			// The slabs are kept, for objects
+					// freed after the cache is gone
+
+    void *Alloc();			// Return an object of the cache's
+					// size, uninitialized
+    void Free(void *object);		// Give back one Alloc returned
+
+    int Size() { return size; }
+    int NumInUse() { return numInUse; }	// Objects handed out, not freed
+    int NumSlabs() { return numSlabs; }	// Slabs taken from the host
+
+  private:
+    const char *name;			// useful for debugging
+    int size;				// bytes in an object, rounded up
+    int perSlab;			// objects in a slab
+    FreeObject *freeList;		// objects free for Alloc
+    int numInUse;
+    int numSlabs;
+};
+
+// The following class defines a chunk of an arena; its bytes follow it.
+
+class ArenaChunk {
+  public:
+    ArenaChunk *next;			// next chunk, if any
+    int size;				// bytes that follow the chunk
+
+    char *Bytes();			// Where they start
+};
+
+// The following class defines an "arena": memory that is handed out a
+// piece at a time, and given back all at once.
+
+class Arena {
+  public:
+    Arena();				// No chunks yet
+    ~Arena();				// Give all the chunks back
+
+    void *operator new(size_t size);	// From a slab cache of arenas
+    void operator delete(void *object);
+
+    char *Alloc(int numBytes);		// Return "numBytes", uninitialized,
+					// until the ArenaMark around this
+					// goes away
+
+    int NumChunks() { return numChunks; }
+
+  private:
+    friend class ArenaMark;
+
+    ArenaChunk *chunks;			// all of them, in the order used
+    ArenaChunk *current;		// the one being handed out, or NULL
+					// if none has been yet
+    int used;				// bytes of "current" handed out
+    int numChunks;
+};
+
+// The following class defines a mark in an arena: what is allocated
+// after the mark is made is given back when it is deleted.  Marks are
+// made on the stack, so they go in the order they were made.
+
+class ArenaMark {
+  public:
+    ArenaMark(Arena *arena);		// Note where the arena is
+    ~ArenaMark();			// and go back there
+
+  private:
+    Arena *arena;
+    ArenaChunk *current;
+    int used;
+};
+
+extern void SlabSelfTest();		// Test slab caches and arenas
+
+#endif // SLAB_H
@@ -32,13 +32,11 @@
 #include <sys/file.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include <cerrno>
 
-#ifdef SOLARIS
-// KMS
-// for open()
 #include <fcntl.h>
-#endif
 
 #ifdef LINUX	 // at this point, linux doesn't support mprotect 
 #define NO_MPROT     
@@ -171,6 +169,22 @@ Exit(int exitCode)
     exit(exitCode);
 }
 
+//----------------------------------------------------------------------
+// HostMicroseconds
+// 	Return the time of day on the host, in microseconds; it wraps
+//	around every hour or so, so only differences over a shorter time
+//	mean anything.
+//----------------------------------------------------------------------
+
+unsigned int
+HostMicroseconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (unsigned int) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 //----------------------------------------------------------------------
 // RandomInit
 // 	Initialize the pseudo-random number generator.  We use the
@@ -290,6 +304,9 @@ PollFile(int fd)
     retVal = select(32, &rfd, &wfd, &xfd, &pollTime);
 #endif
 
+    if (retVal < 0 && errno == EINTR)
+	return FALSE;			// cut short by a signal (see
+					// CallOnSocketInput); poll again
     ASSERT((retVal == 0) || (retVal == 1));
     if (retVal == 0)
 	return FALSE;                 		// no char waiting to be read
@@ -420,6 +437,183 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "size" bytes of an open file into memory, shared,
+//	so that stores to the memory change the file.  Return NULL if
+//	the file cannot be mapped.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    return (p == MAP_FAILED) ? NULL : (char *) p;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+// 	Write the dirty pages of a mapped file out to the file.  Abort on
+//	error.
+//----------------------------------------------------------------------
+
+void
+SyncMappedFile(char *p, int size)
+{
+    int retVal = msync(p, size, MS_SYNC);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Undo MapFile.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *p, int size)
+{
+    int retVal = munmap(p, size);
+    ASSERT(retVal == 0);
+}
+
+// The following class defines a host thread doing file transfers, and
+// the transfer it has been given.  "pending" is set from when the
+// transfer is started until it is done, under "lock".
+
+class HostIoThread {
+  public:
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;	// signalled when "pending" or "stopping"
+				// changes
+    bool pending;		// Is a transfer to be done, or being done?
+    bool stopping;		// Should the thread end?
+    int fd;			// The transfer: what file,
+    char *buffer;		// and where its bytes come from or go
+    int nBytes;
+    int offset;			// where in the file
+    bool writing;
+};
+
+//----------------------------------------------------------------------
+// IoThreadMain
+// 	What a host I/O thread does: wait for a transfer, do it, and say
+//	it is done, until it is stopped.  Signals go to the simulation's
+//	own thread, not to this one.  Abort if a transfer fails.
+//----------------------------------------------------------------------
+
+static void *
+IoThreadMain(void *arg)
+{
+    HostIoThread *t = (HostIoThread *) arg;
+    sigset_t all;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+	while (!t->pending && !t->stopping)
+	    pthread_cond_wait(&t->changed, &t->lock);
+	if (!t->pending)
+	    break;
+	pthread_mutex_unlock(&t->lock);
+	int retVal = t->writing ? pwrite(t->fd, t->buffer, t->nBytes, t->offset)
+				: pread(t->fd, t->buffer, t->nBytes, t->offset);
+	ASSERT(retVal == t->nBytes);
+	pthread_mutex_lock(&t->lock);
+	t->pending = FALSE;
+	pthread_cond_broadcast(&t->changed);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// StartIoThread
+// 	Make a host thread to do file transfers.  Return NULL if the
+//	host cannot make one.
+//----------------------------------------------------------------------
+
+HostIoThread *
+StartIoThread()
+{
+    HostIoThread *t = new HostIoThread;
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->changed, NULL);
+    t->pending = t->stopping = FALSE;
+    if (pthread_create(&t->thread, NULL, IoThreadMain, t) != 0) {
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->changed);
+	delete t;
+	return NULL;
+    }
+    return t;
+}
+
+//----------------------------------------------------------------------
+// StartTransfer
+// 	Have "t" read or write "nBytes" bytes of "fd", at "offset", into
+//	or from "buffer", and return at once.  The buffer must be left
+//	alone until FinishTransfer returns.  "t" must not be doing
+//	another transfer.
+//----------------------------------------------------------------------
+
+void
+StartTransfer(HostIoThread *t, int fd, char *buffer, int nBytes, int offset,
+	      bool writing)
+{
+    pthread_mutex_lock(&t->lock);
+    ASSERT(!t->pending);
+    t->fd = fd;
+    t->buffer = buffer;
+    t->nBytes = nBytes;
+    t->offset = offset;
+    t->writing = writing;
+    t->pending = TRUE;
+    pthread_cond_broadcast(&t->changed);
+    pthread_mutex_unlock(&t->lock);
+}
+
+//----------------------------------------------------------------------
+// FinishTransfer
+// 	Wait until the transfer "t" was given last is done, if it is not
+//	yet.  Return TRUE if it had to wait.
+//----------------------------------------------------------------------
+
+bool
+FinishTransfer(HostIoThread *t)
+{
+    bool waited = FALSE;
+
+    pthread_mutex_lock(&t->lock);
+    while (t->pending) {
+	waited = TRUE;
+	pthread_cond_wait(&t->changed, &t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return waited;
+}
+
+//----------------------------------------------------------------------
+// StopIoThread
+// 	Wait for the transfer of "t", if any, and end the thread.
+//----------------------------------------------------------------------
+
+void
+StopIoThread(HostIoThread *t)
+{
+    pthread_mutex_lock(&t->lock);
+    t->stopping = TRUE;
+    pthread_cond_broadcast(&t->changed);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->changed);
+    delete t;
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -502,6 +696,49 @@ PollSocket(int sockID)
     return PollFile(sockID);	// on UNIX, socket ID's are just file ID's
 }
 
+//----------------------------------------------------------------------
+// CallOnSocketInput
+// 	Arrange that "func" will be called, by the SIGIO signal, when
+//	messages arrive on the IPC port, so that it need not be polled.
+//	No call is made for each message: "func" may be called once for
+//	several.  A NULL "func" stops the signals.
+//----------------------------------------------------------------------
+
+void
+CallOnSocketInput(int sockID, void (*func)(int))
+{
+    int flags = fcntl(sockID, F_GETFL);
+
+    if (func == NULL) {
+	(void) fcntl(sockID, F_SETFL, flags & ~O_ASYNC);
+	(void) signal(SIGIO, SIG_IGN);
+	return;
+    }
+    (void) signal(SIGIO, func);
+    (void) fcntl(sockID, F_SETOWN, getpid());
+    (void) fcntl(sockID, F_SETFL, flags | O_ASYNC);
+}
+
+//----------------------------------------------------------------------
+// WaitForSocket
+// 	Put the UNIX process to sleep until a message is waiting on the
+//	IPC port.
+//----------------------------------------------------------------------
+
+void
+WaitForSocket(int sockID)
+{
+    fd_set rfd;
+    int retVal;
+
+    do {			// a signal may cut the wait short
+	FD_ZERO(&rfd);
+	FD_SET(sockID, &rfd);
+	retVal = select(sockID + 1, &rfd, NULL, NULL, NULL);
+    } while (retVal < 0 && errno == EINTR);
+    ASSERT(retVal == 1);
+}
+
 //----------------------------------------------------------------------
 // ReadFromSocket
 // 	Read a fixed size packet off the IPC port.  Abort on error.
@@ -537,12 +774,18 @@ ReadFromSocket(int sockID, char *buffer, int packetSize)
 //    modified by KMS to add retry...
 // SendToSocket
 // 	Transmit a fixed size packet to another Nachos' IPC port.
+//	Return FALSE if it was dropped.
 //	Try 10 times with a one second delay between attempts.
 //      This is useful, e.g., to give the other socket a chance
 //      to get set up.
 //      Terminate if we still fail after 10 tries.
+//
+//	If the other Nachos has as many packets waiting as its socket
+//	holds, the packet is dropped at once, as a congested network
+//	would: waiting for it to make room could wait for ever, if it
+//	is itself waiting to send to us.
 //----------------------------------------------------------------------
-void
+bool
 SendToSocket(int sockID, char *buffer, int packetSize, char *toName)
 {
     struct sockaddr_un uName;
@@ -552,9 +795,11 @@ SendToSocket(int sockID, char *buffer, int packetSize, char *toName)
     InitSocketName(&uName, toName);
 
     for(retryCount=0;retryCount < 10;retryCount++) {
-      retVal = sendto(sockID, buffer, packetSize, 0, 
+      retVal = sendto(sockID, buffer, packetSize, MSG_DONTWAIT, 
 			(struct sockaddr *) &uName, sizeof(uName));
-      if (retVal == packetSize) return;
+      if (retVal == packetSize) return TRUE;
+      if (retVal < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	return FALSE;		// no room over there; drop it
       // if we did not succeed, we should see a negative
       // return value indicating complete failure.  If we
       // don't, something fishy is going on...
@@ -568,4 +813,5 @@ SendToSocket(int sockID, char *buffer, int packetSize, char *toName)
     // We simply do nothing (drop the packet).
     // This may mask other kinds of failures, but it is the
     // right thing to do in the common case.
+    return FALSE;
 }
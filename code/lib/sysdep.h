@@ -28,6 +28,10 @@ extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
 
+// The host's time, in microseconds since some moment, for measuring how
+// long real work takes
+extern unsigned int HostMicroseconds();
+
 // Initialize the pseudo random number generator
 extern void RandomInit(unsigned seed);
 extern unsigned int RandomNumber();
@@ -53,6 +57,23 @@ extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
+// Map a file into memory, for simulating the disk without a system
+// call per sector.
+extern char *MapFile(int fd, int size);
+extern void SyncMappedFile(char *p, int size);
+extern void UnmapFile(char *p, int size);
+
+// Read or write part of an open file on a host thread, so that the
+// simulation can go on while the host does the system call, and only
+// waits for it later, if it is not done by then.  A thread does one
+// transfer at a time.
+class HostIoThread;
+extern HostIoThread *StartIoThread();
+extern void StartTransfer(HostIoThread *t, int fd, char *buffer, int nBytes,
+			  int offset, bool writing);
+extern bool FinishTransfer(HostIoThread *t);
+extern void StopIoThread(HostIoThread *t);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
@@ -69,7 +90,9 @@ extern void CloseSocket(int sockID);
 extern void AssignNameToSocket(char *socketName, int sockID);
 extern void DeAssignNameToSocket(char *socketName);
 extern bool PollSocket(int sockID);
+extern void CallOnSocketInput(int sockID, void (*func)(int));
+extern void WaitForSocket(int sockID);
 extern void ReadFromSocket(int sockID, char *buffer, int packetSize);
-extern void SendToSocket(int sockID, char *buffer, int packetSize,char *toName);
+extern bool SendToSocket(int sockID, char *buffer, int packetSize,char *toName);
 
 #endif // SYSDEP_H
@@ -15,6 +15,7 @@
 #include "copyright.h"
 #include "console.h"
 #include "main.h"
+#include "replay.h"
 #include "stdio.h"
 //----------------------------------------------------------------------
 // ConsoleInput::ConsoleInput
@@ -75,12 +76,17 @@ ConsoleInput::CallBack()
 		return;
 	}
 	
-    if (!PollFile(readFileNo)) { // nothing to be read
+    if (kernel->replay != NULL)	// logged, or taken from the log
+	readCount = kernel->replay->ReadConsole(readFileNo, &c, 1, TRUE);
+    else if (!PollFile(readFileNo))
+	readCount = -1;
+    else
+	readCount = ReadPartial(readFileNo, &c, sizeof(char));
+
+    if (readCount < 0) { // nothing to be read
         // schedule the next time to poll for a packet
         kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
     } else { 
-    	// otherwise, try to read a character
-    	readCount = ReadPartial(readFileNo, &c, sizeof(char));
 	if (readCount == 0) {
 	   // this seems to happen at end of file, when the
 	   // console input is a regular file
@@ -117,6 +123,34 @@ ConsoleInput::GetChar()
    return ch;
 }
 
+//----------------------------------------------------------------------
+// ConsoleInput::GetChars()
+// 	When the keyboard is simulated by a file rather than by stdin,
+//	nothing arrives in it as it would from a person typing, so read
+//	up to "most" characters from it in one go, skipping the interrupt
+//	per character.  Return how many were read, 0 at end of file, or
+//	-1 if the keyboard is stdin, or a character has already come in
+//	by interrupt -- it is ahead of the rest, so GetChar it first.
+//----------------------------------------------------------------------
+
+int
+ConsoleInput::GetChars(char *into, int most)
+{
+    int readCount;
+
+    if (readFileNo == 0 || incoming != EOF || disabled)
+	return -1;
+    if (kernel->replay != NULL)
+	readCount = kernel->replay->ReadConsole(readFileNo, into, most,
+						FALSE);
+    else
+	readCount = ReadPartial(readFileNo, into, most);
+    if (readCount < 0)
+	return -1;
+    kernel->stats->numConsoleCharsRead += readCount;
+    return readCount;
+}
+
 
 
 //----------------------------------------------------------------------
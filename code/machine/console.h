@@ -55,6 +55,11 @@ class ConsoleInput : public CallBackObj {
     				// "callWhenAvail" is called whenever there is 
 				// a char to be gotten
 
+    int GetChars(char *into, int most);
+				// When the keyboard is a file, read up to
+				// "most" chars from it at once, without
+				// interrupts; return how many, 0 at end of
+				// file, or -1 if they must come one by one
     void CallBack();		// Invoked when a character arrives
 				// from the keyboard.
 				
@@ -15,9 +15,11 @@
 
 #include "copyright.h"
 #include "disk.h"
+#include "diskmodel.h"
 #include "debug.h"
 #include "sysdep.h"
 #include "main.h"
+#include "trace.h"
 
 // We put a magic number at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file 
@@ -25,7 +27,6 @@
 
 const int MagicNumber = 0x456789ab;
 const int MagicSize = sizeof(int);
-const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 
 
 //----------------------------------------------------------------------
@@ -35,35 +36,118 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"mapped" -- map the UNIX file into memory, if possible
+//	"name" -- the UNIX file is "name"_<host>; DISK for the file
+//		system's disk
+//	"numTracks" -- how many tracks the disk must have, or 0 for as
+//		many as its file has; a file of another size, or none, is
+//		made anew, with NumTracks if "numTracks" is 0
+//
+//	The number of tracks of a file that is there is found from its
+//	length: Create writes its last bytes.
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, bool mapped, const char *name,
+	   int numTracks)
 {
     int magicNum;
-    int tmp = 0;
 
     DEBUG(dbgDisk, "Initializing the disk.");
+    ASSERT(numTracks >= 0 && numTracks <= MaxTracks);
     callWhenDone = toCall;
-    lastSector = 0;
-    bufferInit = 0;
     
-    sprintf(diskname,"DISK_%d",kernel->hostName);
+    sprintf(diskname,"%s_%d",name,kernel->hostName);
     fileno = OpenForReadWrite(diskname, FALSE);
     if (fileno >= 0) {		 	// file exists, check magic number 
 	Read(fileno, (char *) &magicNum, MagicSize);
 	ASSERT(magicNum == MagicNumber);
-    } else {				// file doesn't exist, create it
-        fileno = OpenForWrite(diskname);
-	magicNum = MagicNumber;  
-	WriteFile(fileno, (char *) &magicNum, MagicSize); // write magic number
-
-	// need to write at end of file, so that reads will not return EOF
-        Lseek(fileno, DiskSize - sizeof(int), 0);	
-	WriteFile(fileno, (char *)&tmp, sizeof(int));  
+	Lseek(fileno, 0, SEEK_END);
+	diskSize = Tell(fileno);
+	numSectors = (diskSize - MagicSize) / SectorSize;
+	ASSERT(numSectors > 0 && numSectors % SectorsPerTrack == 0 &&
+	       diskSize == MagicSize + numSectors * SectorSize);
+	if (numTracks > 0 && numSectors != numTracks * SectorsPerTrack) {
+	    Close(fileno);		// the wrong size: make it again
+	    fileno = -1;
+	}
+    }
+    if (fileno < 0) {			// file doesn't exist, create it
+	numSectors = ((numTracks > 0) ? numTracks : NumTracks) *
+		     SectorsPerTrack;
+	diskSize = MagicSize + numSectors * SectorSize;
+	Create();
+    }
+    image = NULL;
+    if (mapped) {
+	image = MapFile(fileno, diskSize);
+	if (image == NULL) {
+	    DEBUG(dbgDisk, "Cannot map " << diskname << ", using read/write");
+	}
+    }
+    ioThread = NULL;
+    if (kernel->asyncDisk && image == NULL) {
+	ioThread = StartIoThread();
+	if (ioThread == NULL) {
+	    DEBUG(dbgDisk, "Cannot start a host thread for " << diskname);
+	}
+    }
+    switch (kernel->diskModel) {
+      case FlashModel:
+	model = new FlashDisk(numSectors);
+	break;
+      case InstantModel:
+	model = new InstantDisk;
+	break;
+      default:
+	model = new RotationalDisk;
+	break;
     }
     active = FALSE;
 }
 
+//----------------------------------------------------------------------
+// Disk::Create()
+// 	Create the UNIX file, empty, or empty the one there is: write
+//	the magic number, and just the last bytes of the disk, so that
+//	reads will not return EOF.  The sectors in between are never
+//	written, and read as zeros; the UNIX file takes no space for
+//	them, on most hosts.
+//----------------------------------------------------------------------
+
+void
+Disk::Create()
+{
+    int magicNum = MagicNumber;
+    int tmp = 0;
+
+    fileno = OpenForWrite(diskname);
+    WriteFile(fileno, (char *) &magicNum, MagicSize); // write magic number
+    Lseek(fileno, diskSize - sizeof(int), 0);	
+    WriteFile(fileno, (char *)&tmp, sizeof(int));  
+}
+
+//----------------------------------------------------------------------
+// Disk::Erase()
+// 	Make every sector of the disk read as zeros, as if it had never
+//	been written, by emptying the UNIX file (see Create).  This takes
+//	no simulated time, and hardly any real time: nothing is written
+//	but the magic number.  A mapped disk is mapped again.
+//----------------------------------------------------------------------
+
+void
+Disk::Erase()
+{
+    ASSERT(!active);
+    DEBUG(dbgDisk, "Erasing the disk.");
+    if (image != NULL)
+	UnmapFile(image, diskSize);
+    Close(fileno);
+    Create();
+    if (image != NULL)
+	image = MapFile(fileno, diskSize);
+    model->Erase();
+}
+
 //----------------------------------------------------------------------
 // Disk::~Disk()
 // 	Clean up disk simulation, by closing the UNIX file representing the
@@ -72,7 +156,14 @@ Disk::Disk(CallBackObj *toCall)
 
 Disk::~Disk()
 {
+    if (ioThread != NULL)
+	StopIoThread(ioThread);
+    if (image != NULL) {
+	SyncMappedFile(image, diskSize);
+	UnmapFile(image, diskSize);
+    }
     Close(fileno);
+    delete model;
 }
 
 //----------------------------------------------------------------------
@@ -113,156 +204,143 @@ PrintSector (bool writing, int sector, char *data)
 void
 Disk::ReadRequest(int sectorNumber, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
-
-    ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-    
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
-    
-    active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskReads++;
-    kernel->interrupt->Schedule(this, ticks, DiskInt);
+    Transfer(sectorNumber, 1, data, FALSE);
 }
 
 void
 Disk::WriteRequest(int sectorNumber, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
-
-    ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
-    
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
-    
-    active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskWrites++;
-    kernel->interrupt->Schedule(this, ticks, DiskInt);
+    Transfer(sectorNumber, 1, data, TRUE);
 }
 
 //----------------------------------------------------------------------
-// Disk::CallBack()
-// 	Called by the machine simulation when the disk interrupt occurs.
+// Disk::ReadRequests/WriteRequests
+// 	Simulate a request to read/write "numSectors" consecutive sectors
+//	starting at "sectorNumber", with one transfer to the UNIX file
+//	and a single interrupt at the end.  "data" holds numSectors
+//	sectors.
 //----------------------------------------------------------------------
 
 void
-Disk::CallBack ()
-{ 
-    active = FALSE;
-    callWhenDone->CallBack();
+Disk::ReadRequests(int sectorNumber, int numSectors, char* data)
+{
+    Transfer(sectorNumber, numSectors, data, FALSE);
 }
 
-//----------------------------------------------------------------------
-// Disk::TimeToSeek()
-//	Returns how long it will take to position the disk head over the correct
-//	track on the disk.  Since when we finish seeking, we are likely
-//	to be in the middle of a sector that is rotating past the head,
-//	we also return how long until the head is at the next sector boundary.
-//	
-//   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
-//   	and rotates at one sector per RotationTime ticks
-//----------------------------------------------------------------------
-
-int
-Disk::TimeToSeek(int newSector, int *rotation) 
+void
+Disk::WriteRequests(int sectorNumber, int numSectors, char* data)
 {
-    int newTrack = newSector / SectorsPerTrack;
-    int oldTrack = lastSector / SectorsPerTrack;
-    int seek = abs(newTrack - oldTrack) * SeekTime;
-				// how long will seek take?
-    int over = (kernel->stats->totalTicks + seek) % RotationTime; 
-				// will we be in the middle of a sector when
-				// we finish the seek?
-
-    *rotation = 0;
-    if (over > 0)	 	// if so, need to round up to next full sector
-   	*rotation = RotationTime - over;
-    return seek;
+    Transfer(sectorNumber, numSectors, data, TRUE);
 }
 
 //----------------------------------------------------------------------
-// Disk::ModuloDiff()
-// 	Return number of sectors of rotational delay between target sector
-//	"to" and current sector position "from"
+// Disk::Transfer
+// 	Do the work of a read or write request of "numSectors" sectors.
+//	With a host I/O thread, the thread is given the transfer, and
+//	CallBack waits for it to be done.
 //----------------------------------------------------------------------
 
-int 
-Disk::ModuloDiff(int to, int from)
+void
+Disk::Transfer(int sectorNumber, int numSectors, char* data, bool writing)
 {
-    int toOffset = to % SectorsPerTrack;
-    int fromOffset = from % SectorsPerTrack;
+    DiskLatency parts;
+    int ticks = ComputeLatency(sectorNumber, numSectors, writing, &parts);
+    int last = sectorNumber + numSectors - 1;
 
-    return ((toOffset - fromOffset) + SectorsPerTrack) % SectorsPerTrack;
+    ASSERT(!active);				// only one request at a time
+    ASSERT((sectorNumber >= 0) && (numSectors > 0) && (last < this->numSectors));
+    
+    DEBUG(dbgDisk, (writing ? "Writing to sector " : "Reading from sector ")
+		<< sectorNumber << ", " << numSectors << " sectors");
+    TRACE(dbgDisk, (writing ? TraceDiskWrite : TraceDiskRead, fileno,
+		    sectorNumber, numSectors));
+    if (image != NULL) {
+	char *where = &image[SectorSize * sectorNumber + MagicSize];
+	if (writing)
+	    bcopy(data, where, SectorSize * numSectors);
+	else
+	    bcopy(where, data, SectorSize * numSectors);
+    } else if (ioThread != NULL) {
+	StartTransfer(ioThread, fileno, data, SectorSize * numSectors,
+		      SectorSize * sectorNumber + MagicSize, writing);
+    } else {
+	Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+	if (writing)
+	    WriteFile(fileno, data, SectorSize * numSectors);
+	else
+	    Read(fileno, data, SectorSize * numSectors);
+    }
+    if (debug->IsEnabled('d')) {
+	if (ioThread != NULL)
+	    (void) FinishTransfer(ioThread);	// to see what was read
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(writing, sectorNumber + i, &data[i * SectorSize]);
+    }
+    
+    active = TRUE;
+    model->Start(sectorNumber, numSectors, writing);
+    if (writing)
+	kernel->stats->numDiskWrites += numSectors;
+    else
+	kernel->stats->numDiskReads += numSectors;
+    kernel->stats->AddDiskRequest(&parts, sectorNumber / SectorsPerTrack,
+				  last / SectorsPerTrack,
+				  this->numSectors / SectorsPerTrack);
+    kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
 //----------------------------------------------------------------------
-// Disk::ComputeLatency()
-// 	Return how long will it take to read/write a disk sector, from
-//	the current position of the disk head.
-//
-//   	Latency = seek time + rotational latency + transfer time
-//   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
-//   	and rotates at one sector per RotationTime ticks
-//
-//   	To find the rotational latency, we first must figure out where the 
-//   	disk head will be after the seek (if any).  We then figure out
-//   	how long it will take to rotate completely past newSector after 
-//	that point.
-//
-//   	The disk also has a "track buffer"; the disk continuously reads
-//   	the contents of the current disk track into the buffer.  This allows 
-//   	read requests to the current track to be satisfied more quickly.
-//   	The contents of the track buffer are discarded after every seek to 
-//   	a new track.
+// Disk::ComputeLatency
+// 	Return how long a request for "numSectors" sectors from
+//	"newSector" (one, if not given) would take if it were sent now,
+//	as the disk's model has it, and if "parts" is not NULL, how much
+//	of that is spent on each part.
 //----------------------------------------------------------------------
 
 int
-Disk::ComputeLatency(int newSector, bool writing)
+Disk::ComputeLatency(int newSector, bool writing, DiskLatency *parts)
 {
-    int rotation;
-    int seek = TimeToSeek(newSector, &rotation);
-    int timeAfter = kernel->stats->totalTicks + seek + rotation;
-
-#ifndef NOTRACKBUF	// turn this on if you don't want the track buffer stuff
-    // check if track buffer applies
-    if ((writing == FALSE) && (seek == 0) 
-		&& (((timeAfter - bufferInit) / RotationTime) 
-	     		> ModuloDiff(newSector, bufferInit / RotationTime))) {
-        DEBUG(dbgDisk, "Request latency = " << RotationTime);
-	return RotationTime; // time to transfer sector from the track buffer
-    }
-#endif
+    return ComputeLatency(newSector, 1, writing, parts);
+}
+
+int
+Disk::ComputeLatency(int newSector, int numSectors, bool writing,
+		     DiskLatency *parts)
+{
+    DiskLatency dummy;
 
-    rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
+    return model->Latency(newSector, numSectors, writing,
+			  (parts != NULL) ? parts : &dummy);
+}
+
+//----------------------------------------------------------------------
+// Disk::CallBack()
+// 	Called by the machine simulation when the disk interrupt occurs.
+//	The host I/O thread, if any, must be done with the request by
+//	then.
+//----------------------------------------------------------------------
 
-    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + RotationTime));
-    return(seek + rotation + RotationTime);
+void
+Disk::CallBack ()
+{ 
+    if (ioThread != NULL && FinishTransfer(ioThread)) {
+	DEBUG(dbgDisk, "Waited for the host to finish the transfer");
+    }
+    active = FALSE;
+    TRACE(dbgDisk, (TraceDiskDone, fileno));
+    callWhenDone->CallBack();
 }
 
 //----------------------------------------------------------------------
-// Disk::UpdateLast
-//   	Keep track of the most recently requested sector.  So we can know
-//	what is in the track buffer.
+// Disk::Flush()
+// 	If the UNIX file is mapped, wait until every change made through
+//	the mapping has been written to it.  Otherwise writes went
+//	straight to the file, and there is nothing to do.
 //----------------------------------------------------------------------
 
 void
-Disk::UpdateLast(int newSector)
+Disk::Flush()
 {
-    int rotate;
-    int seek = TimeToSeek(newSector, &rotate);
-    
-    if (seek != 0)
-	bufferInit = kernel->stats->totalTicks + seek + rotate;
-    lastSector = newSector;
-    DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
+    if (image != NULL)
+	SyncMappedFile(image, diskSize);
 }
@@ -46,19 +46,59 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// The UNIX file can also be mapped into memory, so that a request is a
+// memory copy rather than an lseek plus a read or write system call.
+// The simulated timing is the same either way; Flush (and deleting the
+// disk) makes sure the changes have reached the UNIX file.
+//
+// Or the reads and writes of the UNIX file can be done by a host thread
+// of the disk's own, started when the request is sent and waited for
+// only when its interrupt comes, so the simulation goes on meanwhile,
+// as the device would.  Again the simulated timing is the same.
+//
+// The size of a sector, and of a track, are the same for every disk,
+// but the number of tracks is not: it is chosen when the UNIX file is
+// made, and found from the length of the file after that.
 
 const int SectorSize = 128;		// number of bytes per disk sector
 const int SectorsPerTrack  = 32;	// number of sectors per disk track 
-const int NumTracks = 32;		// number of tracks per disk
+const int NumTracks = 32;		// number of tracks of a disk, unless
+					// it is made with some other number
 const int NumSectors = (SectorsPerTrack * NumTracks);
+const int MaxTracks = 32768;		// most tracks a disk can have
 					// total # of sectors per disk
 
+// The following class defines how the time of a request is spent.
+
+class DiskLatency {
+  public:
+    int seek;			// moving the head to the tracks
+    int rotation;		// waiting for the first sector to come round
+    int transfer;		// reading or writing the sectors
+    int stall;			// waiting for flash blocks to be cleaned
+    bool trackBuffer;		// was the first read from the track buffer?
+};
+
+class DiskModel;
+class HostIoThread;
+
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool mapped = FALSE,
+	 const char *name = "DISK", int numTracks = 0);
+    					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// If "mapped", map the UNIX file
+					// into memory.  The file is
+					// "name"_<host>, made anew unless
+					// it has "numTracks" tracks (0:
+					// any number, NumTracks if new)
     ~Disk();				// Deallocate the disk.
+
+    int NumDiskSectors() { return numSectors; }
+    					// Sectors on the disk
     
     void ReadRequest(int sectorNumber, char* data);
     					// Read/write an single disk sector.
@@ -67,26 +107,46 @@ class Disk : public CallBackObj {
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
 
+    void ReadRequests(int sectorNumber, int numSectors, char* data);
+    					// Read/write "numSectors" consecutive
+					// sectors as one request
+    void WriteRequests(int sectorNumber, int numSectors, char* data);
+
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
 
-    int ComputeLatency(int newSector, bool writing);	
+    int ComputeLatency(int newSector, bool writing,
+		       DiskLatency *parts = NULL);
     					// Return how long a request to 
-					// newSector will take: 
-					// (seek + rotational delay + transfer)
+					// newSector will take (see
+					// diskmodel.h), and if "parts" is
+					// not NULL, how much of it is spent
+					// on each part
+    int ComputeLatency(int newSector, int numSectors, bool writing,
+		       DiskLatency *parts = NULL);
+    					// The same, for a run of sectors
+
+    void Flush();			// Force a mapped disk out to the
+					// UNIX file
+    void Erase();			// Make every sector read as zeros,
+					// without writing them
 
   private:
     int fileno;				// UNIX file number for simulated disk 
     char diskname[32];			// name of simulated disk's file
+    int numSectors;			// sectors on the disk
+    int diskSize;			// bytes in its file
+    char *image;			// the file mapped into memory, or
+					// NULL to use read and write
+    HostIoThread *ioThread;		// does the reads and writes, or
+					// NULL to do them as requests come
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
-    int lastSector;			// The previous disk request 
-    int bufferInit;			// When the track buffer started 
-					// being loaded
+    DiskModel *model;			// How long requests take
 
-    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
-    int ModuloDiff(int to, int from);        // # sectors between to and from
-    void UpdateLast(int newSector);
+    void Create();			// Make the UNIX file, all zeros
+    void Transfer(int sectorNumber, int numSectors, char* data,
+		  bool writing);	// Common part of the requests
 };
 
 #endif // DISK_H
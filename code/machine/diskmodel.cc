@@ -0,0 +1,338 @@
+// diskmodel.cc
+//	Routines to compute how long disk requests take, for each model
+//	of disk (see diskmodel.h).
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "diskmodel.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// RotationalDisk::RotationalDisk
+// 	Initialize the model of a hard disk, with the head on sector 0.
+//----------------------------------------------------------------------
+
+RotationalDisk::RotationalDisk()
+{
+    lastSector = 0;
+    bufferInit = 0;
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::Start
+// 	A request for "count" sectors from "sector" is sent now: the head
+//	ends up on the last of them, and the track buffer holds its track.
+//----------------------------------------------------------------------
+
+void
+RotationalDisk::Start(int sector, int count, bool writing)
+{
+    UpdateLast(sector);
+    UpdateLast(sector + count - 1);
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::Erase
+// 	Start again as a new disk does.
+//----------------------------------------------------------------------
+
+void
+RotationalDisk::Erase()
+{
+    lastSector = 0;
+    bufferInit = 0;
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::TimeToSeek()
+//	Returns how long it will take to position the disk head over the correct
+//	track on the disk.  Since when we finish seeking, we are likely
+//	to be in the middle of a sector that is rotating past the head,
+//	we also return how long until the head is at the next sector boundary.
+//	
+//   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
+//   	and rotates at one sector per RotationTime ticks
+//----------------------------------------------------------------------
+
+int
+RotationalDisk::TimeToSeek(int newSector, int *rotation) 
+{
+    int newTrack = newSector / SectorsPerTrack;
+    int oldTrack = lastSector / SectorsPerTrack;
+    int seek = abs(newTrack - oldTrack) * SeekTime;
+				// how long will seek take?
+    int over = (kernel->stats->totalTicks + seek) % RotationTime; 
+				// will we be in the middle of a sector when
+				// we finish the seek?
+
+    *rotation = 0;
+    if (over > 0)	 	// if so, need to round up to next full sector
+   	*rotation = RotationTime - over;
+    return seek;
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::ModuloDiff()
+// 	Return number of sectors of rotational delay between target sector
+//	"to" and current sector position "from"
+//----------------------------------------------------------------------
+
+int 
+RotationalDisk::ModuloDiff(int to, int from)
+{
+    int toOffset = to % SectorsPerTrack;
+    int fromOffset = from % SectorsPerTrack;
+
+    return ((toOffset - fromOffset) + SectorsPerTrack) % SectorsPerTrack;
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::SectorLatency
+// 	Return how long will it take to read/write a disk sector, from
+//	the current position of the disk head.
+//
+//   	Latency = seek time + rotational latency + transfer time
+//   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
+//   	and rotates at one sector per RotationTime ticks
+//
+//   	To find the rotational latency, we first must figure out where the 
+//   	disk head will be after the seek (if any).  We then figure out
+//   	how long it will take to rotate completely past newSector after 
+//	that point.
+//
+//   	The disk also has a "track buffer"; the disk continuously reads
+//   	the contents of the current disk track into the buffer.  This allows 
+//   	read requests to the current track to be satisfied more quickly.
+//   	The contents of the track buffer are discarded after every seek to 
+//   	a new track.
+//----------------------------------------------------------------------
+
+int
+RotationalDisk::SectorLatency(int newSector, bool writing, DiskLatency *parts)
+{
+    int rotation;
+    int seek = TimeToSeek(newSector, &rotation);
+    int timeAfter = kernel->stats->totalTicks + seek + rotation;
+    DiskLatency dummy;
+
+    if (parts == NULL)
+	parts = &dummy;
+#ifndef NOTRACKBUF	// turn this on if you don't want the track buffer stuff
+    // check if track buffer applies
+    if ((writing == FALSE) && (seek == 0) 
+		&& (((timeAfter - bufferInit) / RotationTime) 
+	     		> ModuloDiff(newSector, bufferInit / RotationTime))) {
+        DEBUG(dbgDisk, "Request latency = " << RotationTime);
+	parts->seek = parts->rotation = parts->stall = 0;
+	parts->transfer = RotationTime;
+	parts->trackBuffer = TRUE;
+	return RotationTime; // time to transfer sector from the track buffer
+    }
+#endif
+
+    rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
+
+    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + RotationTime));
+    parts->seek = seek;
+    parts->rotation = rotation;
+    parts->transfer = RotationTime;
+    parts->stall = 0;
+    parts->trackBuffer = FALSE;
+    return(seek + rotation + RotationTime);
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::Latency
+// 	Return how long it will take to read/write "count" sectors
+//	starting at "sector".  Only the first one pays for the seek
+//	and the rotational delay; the rest stream past the head at one
+//	sector per RotationTime.  Moving on to the next track costs a
+//	one-track seek, assuming the tracks are skewed so the next
+//	sector arrives just as the seek finishes.
+//----------------------------------------------------------------------
+
+int
+RotationalDisk::Latency(int sector, int count, bool writing,
+			DiskLatency *parts)
+{
+    DiskLatency first;
+    int ticks = SectorLatency(sector, writing, &first);
+
+    for (int i = sector + 1; i < sector + count; i++) {
+	ticks += RotationTime;
+	first.transfer += RotationTime;
+	if (i % SectorsPerTrack == 0) {
+	    ticks += SeekTime;
+	    first.seek += SeekTime;
+	}
+    }
+    if (parts != NULL)
+	*parts = first;
+    return ticks;
+}
+
+//----------------------------------------------------------------------
+// RotationalDisk::UpdateLast
+//   	Keep track of the most recently requested sector.  So we can know
+//	what is in the track buffer.
+//----------------------------------------------------------------------
+
+void
+RotationalDisk::UpdateLast(int newSector)
+{
+    int rotate;
+    int seek = TimeToSeek(newSector, &rotate);
+    
+    if (seek != 0)
+	bufferInit = kernel->stats->totalTicks + seek + rotate;
+    lastSector = newSector;
+    DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::FlashDisk
+// 	Initialize the model of a solid-state disk of "numSectors"
+//	sectors, with every page clean and nothing written.
+//----------------------------------------------------------------------
+
+FlashDisk::FlashDisk(int numSectors)
+{
+    int share = divRoundUp(numSectors, FlashChannels);
+
+    this->numSectors = numSectors;
+    pagesPerChannel = share + divRoundUp(share, FlashBlockSectors) * FlashSpare;
+    written = new bool[numSectors];
+    Erase();
+}
+
+FlashDisk::~FlashDisk()
+{
+    delete [] written;
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Erase
+// 	Every page is clean again, and no sector holds anything.
+//----------------------------------------------------------------------
+
+void
+FlashDisk::Erase()
+{
+    for (int c = 0; c < FlashChannels; c++)
+	cleanPages[c] = pagesPerChannel;
+    for (int i = 0; i < numSectors; i++)
+	written[i] = FALSE;
+    numWritten = 0;
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Transfer
+// 	Return how long a request for "count" sectors from "sector" takes,
+//	and in "parts" how it is spent: each channel works on its sectors
+//	at the same time as the others, so the request takes as long as
+//	the busiest one.  A write to a channel with no clean pages left
+//	first cleans blocks until it has one: the live pages of a block
+//	are read and written again elsewhere, and then it is erased.
+//
+//	If "start", the request is being sent: use up the clean pages,
+//	and count the cleaning.
+//----------------------------------------------------------------------
+
+int
+FlashDisk::Transfer(int sector, int count, bool writing, DiskLatency *parts,
+		    bool start)
+{
+    int perChannel[FlashChannels];
+    int live = numWritten * FlashBlockSectors /
+	       (pagesPerChannel * FlashChannels);
+    int ticks = 0;
+
+    live = min(live, FlashBlockSectors - 1);	// each cleaning gains a page
+    for (int c = 0; c < FlashChannels; c++)
+	perChannel[c] = 0;
+    for (int i = sector; i < sector + count; i++)
+	perChannel[i % FlashChannels]++;
+
+    parts->seek = parts->rotation = parts->transfer = parts->stall = 0;
+    parts->trackBuffer = FALSE;
+    for (int c = 0; c < FlashChannels; c++) {
+	int transfer = perChannel[c] * (writing ? FlashWriteTime
+						: FlashReadTime);
+	int stall = 0, clean = cleanPages[c], cleanings = 0;
+
+	if (writing) {
+	    for (int i = 0; i < perChannel[c]; i++) {
+		if (clean == 0) {
+		    stall += FlashEraseTime +
+			     live * (FlashReadTime + FlashWriteTime);
+		    clean += FlashBlockSectors - live;
+		    cleanings++;
+		}
+		clean--;
+	    }
+	}
+	if (start) {
+	    cleanPages[c] = clean;
+	    kernel->stats->numFlashCleanings += cleanings;
+	    kernel->stats->numFlashCopies += cleanings * live;
+	}
+	if (transfer + stall > ticks) {
+	    ticks = transfer + stall;
+	    parts->transfer = transfer;
+	    parts->stall = stall;
+	}
+    }
+    return ticks;
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Latency
+// 	Return how long a request for "count" sectors from "sector", sent
+//	now, would take (see Transfer).
+//----------------------------------------------------------------------
+
+int
+FlashDisk::Latency(int sector, int count, bool writing, DiskLatency *parts)
+{
+    return Transfer(sector, count, writing, parts, FALSE);
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Start
+// 	A request for "count" sectors from "sector" is sent now: a write
+//	uses up clean pages, and the sectors it writes are live.
+//----------------------------------------------------------------------
+
+void
+FlashDisk::Start(int sector, int count, bool writing)
+{
+    DiskLatency parts;
+
+    (void) Transfer(sector, count, writing, &parts, TRUE);
+    if (writing)
+	for (int i = sector; i < sector + count; i++)
+	    if (!written[i]) {
+		written[i] = TRUE;
+		numWritten++;
+	    }
+}
+
+//----------------------------------------------------------------------
+// InstantDisk::Latency
+// 	Every request takes a tick: an interrupt cannot come sooner.
+//----------------------------------------------------------------------
+
+int
+InstantDisk::Latency(int sector, int count, bool writing, DiskLatency *parts)
+{
+    parts->seek = parts->rotation = parts->stall = 0;
+    parts->transfer = 1;
+    parts->trackBuffer = FALSE;
+    return 1;
+}
@@ -0,0 +1,129 @@
+// diskmodel.h
+//	Data structures for the models of how long a disk request takes.
+//
+//	A Disk asks its model how long each request will take, and tells
+//	it when one starts, so that the model can follow whatever state
+//	the timing depends on.  Which model the disks use is chosen when
+//	Nachos starts:
+//
+//	  the rotational model -- a hard disk: the head seeks to the
+//	    track, waits for the sector to come round, and keeps the
+//	    track it is on in a track buffer
+//
+//	  the flash model -- a solid-state disk: no seeks, a flat time for
+//	    reading a sector and a longer one for writing it; the sectors
+//	    are dealt out to several channels that work at once; and a
+//	    sector is never written in place, so that once the clean
+//	    erase blocks of a channel are used up, writing to it stalls
+//	    while a block is cleaned, its live sectors copied elsewhere
+//	    and the block erased
+//
+//	  the instant model -- every request takes a single tick, for
+//	    runs where only what is on the disk matters
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DISKMODEL_H
+#define DISKMODEL_H
+
+#include "copyright.h"
+#include "disk.h"
+
+#define FlashChannels	4	// channels of a solid-state disk
+#define FlashBlockSectors 64	// sectors in each of its erase blocks
+#define FlashSpare	8	// spare pages it has for each block's
+				// worth of sectors
+
+// The models a disk can have.
+
+enum DiskModelKind {
+    RotationalModel,		// a hard disk (the default)
+    FlashModel,			// a solid-state disk
+    InstantModel		// no time at all
+};
+
+// The following class defines what a model of disk timing does.
+
+class DiskModel {
+  public:
+    virtual ~DiskModel() {}
+
+    virtual int Latency(int sector, int count, bool writing,
+			DiskLatency *parts) = 0;
+    					// How long a request for "count"
+					// sectors from "sector", sent now,
+					// would take, and how much of it
+					// is spent on each part
+    virtual void Start(int sector, int count, bool writing) = 0;
+    					// Such a request is sent now
+    virtual void Erase() = 0;		// The disk is all zeros again
+};
+
+// The following class defines a hard disk: the timing Nachos has
+// always had (see Disk::ComputeLatency).
+
+class RotationalDisk : public DiskModel {
+  public:
+    RotationalDisk();
+
+    int Latency(int sector, int count, bool writing, DiskLatency *parts);
+    void Start(int sector, int count, bool writing);
+    void Erase();
+
+  private:
+    int SectorLatency(int newSector, bool writing, DiskLatency *parts);
+    					// The time of a single sector
+    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
+    int ModuloDiff(int to, int from);        // # sectors between to and from
+    void UpdateLast(int newSector);
+
+    int lastSector;			// The previous disk request
+    int bufferInit;			// When the track buffer started
+					// being loaded
+};
+
+// The following class defines a solid-state disk.  Sector "s" is on
+// channel s % FlashChannels.  Each channel has as many pages as its
+// share of the sectors, and FlashSpare more for every FlashBlockSectors
+// of them, and starts out with all of them clean.  Each sector written
+// takes a clean page; when there are none, a block is cleaned.  A
+// block chosen to be cleaned holds as many live pages as there would
+// be if the sectors ever written were spread evenly over all the pages,
+// and those are copied before it is erased; what is left of the block
+// is clean.
+
+class FlashDisk : public DiskModel {
+  public:
+    FlashDisk(int numSectors);
+    ~FlashDisk();
+
+    int Latency(int sector, int count, bool writing, DiskLatency *parts);
+    void Start(int sector, int count, bool writing);
+    void Erase();
+
+  private:
+    int Transfer(int sector, int count, bool writing, DiskLatency *parts,
+		 bool start);		// What Latency and Start share
+
+    int numSectors;			// Sectors on the disk
+    int pagesPerChannel;		// Pages each channel has
+    int cleanPages[FlashChannels];	// Pages of each channel that can be
+					// written without cleaning
+    bool *written;			// Which sectors have been written
+    int numWritten;			// since the disk was erased
+};
+
+// The following class defines a disk that takes no time.
+
+class InstantDisk : public DiskModel {
+  public:
+    int Latency(int sector, int count, bool writing, DiskLatency *parts);
+    void Start(int sector, int count, bool writing) {}
+    void Erase() {}
+};
+
+#endif // DISKMODEL_H
@@ -23,13 +23,23 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include "bufcache.h"
+#include "journal.h"
+#include "synchconsole.h"
+#include "trace.h"
+#include "lockstat.h"
+#include "frames.h"
+#include "cluster.h"
 
 // String definitions for debugging messages
 
 static char *intLevelNames[] = { "off", "on"};
 static char *intTypeNames[] = { "timer", "disk", "console write", 
 			"console read", "network send", 
-			"network recv"};
+			"network recv", "alarm"};
+
+static volatile bool hostSignalled = FALSE;	// by the host, since the
+						// last check (see WatchHost)
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -39,19 +49,22 @@ static char *intTypeNames[] = { "timer", "disk", "console write",
 //	"callOnInt" is the object to call when the interrupt occurs
 //	"time" is when (in simulated time) the interrupt is to occur
 //	"kind" is the hardware device that generated the interrupt
+//	"order" is how many interrupts were scheduled before it
 //----------------------------------------------------------------------
 
 PendingInterrupt::PendingInterrupt(CallBackObj *callOnInt, 
-					int time, IntType kind)
+					int time, IntType kind, int order)
 {
     callOnInterrupt = callOnInt;
     when = time;
     type = kind;
+    this->order = order;
 }
 
 //----------------------------------------------------------------------
 // PendingCompare
-//	Compare to interrupts based on which should occur first.
+//	Compare to interrupts based on which should occur first.  Of two
+//	due at the same time, the one scheduled first goes first.
 //----------------------------------------------------------------------
 
 static int
@@ -59,6 +72,8 @@ PendingCompare (PendingInterrupt *x, PendingInterrupt *y)
 {
     if (x->when < y->when) { return -1; }
     else if (x->when > y->when) { return 1; }
+    else if (x->order < y->order) { return -1; }
+    else if (x->order > y->order) { return 1; }
     else { return 0; }
 }
 
@@ -72,10 +87,17 @@ PendingCompare (PendingInterrupt *x, PendingInterrupt *y)
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new SortedList<PendingInterrupt *>(PendingCompare);
+    maxPending = 16;
+    pending = new PendingInterrupt[maxPending];
+    numPending = 0;
+    scheduled = 0;
+    nextDue = NeverDue;
+    horizon = NeverDue;
+    traceTicks = debug->IsEnabled(dbgInt);
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+    hostInput = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -85,10 +107,7 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty()) {
-	delete pending->RemoveFront();
-    }
-    delete pending;
+    delete [] pending;
 }
 
 //----------------------------------------------------------------------
@@ -143,6 +162,11 @@ Interrupt::SetLevel(IntStatus now)
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	Most ticks, nothing is due, and there is nothing to do but count
+//	time; the first pending interrupt's time is kept in "nextDue" so
+//	that this is quick.  In a cluster, once time reaches the horizon,
+//	the other machines run; this one goes on when they switch back.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
@@ -158,6 +182,9 @@ Interrupt::OneTick()
 	stats->totalTicks += UserTick;
 	stats->userTicks += UserTick;
     }
+    if (stats->totalTicks < nextDue && !yieldOnReturn && !traceTicks &&
+	    !hostSignalled)
+	return;
     DEBUG(dbgInt, "== Tick " << stats->totalTicks << " ==");
 
 // check any pending interrupts are now ready to fire
@@ -166,6 +193,8 @@ Interrupt::OneTick()
 				// interrupts disabled)
     CheckIfDue(FALSE);		// check for pending interrupts
     ChangeLevel(IntOff, IntOn);	// re-enable interrupts
+    if (stats->totalTicks >= horizon)	// the others must catch up
+	cluster->Switch();
     if (yieldOnReturn) {	// if the timer device handler asked 
     				// for a context switch, ok to do it now
 	yieldOnReturn = FALSE;
@@ -175,6 +204,24 @@ Interrupt::OneTick()
     }
 }
 
+//----------------------------------------------------------------------
+// Interrupt::InstructionsUntilDue
+// 	Return how many user instructions can run, counting the last one,
+//	at whose tick an interrupt may be due; the machine may run that
+//	many with no interrupt checks in between, counting their ticks
+//	itself but the last, which it leaves to OneTick.
+//----------------------------------------------------------------------
+
+int
+Interrupt::InstructionsUntilDue()
+{
+    int ticks = nextDue - kernel->stats->totalTicks;
+
+    if (yieldOnReturn || traceTicks || ticks <= UserTick)
+	return 1;
+    return divRoundUp(ticks, UserTick);
+}
+
 //----------------------------------------------------------------------
 // Interrupt::YieldOnReturn
 // 	Called from within an interrupt handler, to cause a context switch
@@ -193,32 +240,103 @@ Interrupt::YieldOnReturn()
     yieldOnReturn = TRUE; 
 }
 
+//----------------------------------------------------------------------
+// Interrupt::WatchHost, Interrupt::HostSignalled
+// 	A device whose input the host signals (see HostInput) registers
+//	here, and the signal handler calls HostSignalled, which only notes
+//	the signal: little is safe in a handler.  The next tick that
+//	checks for interrupts has the device schedule its own -- so no
+//	time is spent on the device while there is no input.
+//----------------------------------------------------------------------
+
+void
+Interrupt::WatchHost(HostInput *device)
+{
+    hostInput = device;
+}
+
+void
+Interrupt::HostSignalled()
+{
+    hostSignalled = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SetHorizon
+// 	This machine of a cluster is to run up to time "when", and then
+//	let the others run; NeverDue for no limit.  OneTick checks for it
+//	with the interrupts, by "nextDue".
+//----------------------------------------------------------------------
+
+void
+Interrupt::SetHorizon(int when)
+{
+    horizon = when;
+    nextDue = min((numPending == 0) ? NeverDue : pending[0].when, horizon);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::DevicePending
+// 	Return TRUE if an interrupt is still to come from a device that
+//	interrupts only when asked to, such as the disk, for which some
+//	thread may be waiting.  The timer, and the keyboard and network
+//	inputs, which poll, interrupt whether anyone waits or not, and so
+//	do not count.
+//----------------------------------------------------------------------
+
+bool
+Interrupt::DevicePending()
+{
+    for (int i = 0; i < numPending; i++)
+	if (pending[i].type != TimerInt && pending[i].type != ConsoleReadInt
+		&& pending[i].type != NetworkRecvInt)
+	    return TRUE;
+    return FALSE;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Idle
 // 	Routine called when there is nothing in the ready queue.
 //
 //	Since something has to be running in order to put a thread
 //	on the ready queue, the only thing to do is to advance 
-//	simulated time until the next scheduled hardware interrupt.
+//	simulated time until the next scheduled hardware interrupt --
+//	after zeroing the free frames of memory, while there is time,
+//	so that page faults need not.
 //
 //	If there are no pending interrupts, stop.  There's nothing
-//	more for us to do.
+//	more for us to do -- unless the host may yet signal input, when
+//	Nachos sleeps till it does, or the other machines of a cluster
+//	may yet send a packet, when they run till they do.  So do they
+//	when the next interrupt is past the horizon.
 //----------------------------------------------------------------------
 void
 Interrupt::Idle()
 {
     DEBUG(dbgInt, "Machine idling; checking for interrupts.");
     status = IdleMode;
+    if (kernel->frameAllocator != NULL)
+	kernel->frameAllocator->ZeroFreeFrames();
     if (CheckIfDue(TRUE)) {	// check for any pending interrupts
 		status = SystemMode;
 		return;			// return in case there's now
 					// a runnable thread
     }
+    if (hostInput != NULL) {
+	hostInput->WaitForInput();
+	status = SystemMode;
+	return;
+    }
+    if (cluster != NULL && cluster->Wait(numPending > 0)) {
+	status = SystemMode;
+	return;
+    }
 
     // if there are no pending interrupts, and nothing is on the ready
     // queue, it is time to stop.   If the console or the network is 
-    // operating, there are *always* pending interrupts, so this code
-    // is not reached.  Instead, the halt must be invoked by the user program.
+    // operating, there are *always* pending interrupts (or the host
+    // input is waited for), so this code is not reached.  Instead, the
+    // halt must be invoked by the user program.
 
     DEBUG(dbgInt, "Machine idle.  No interrupts to do.");
 	// MP4 mod tag
@@ -242,9 +360,54 @@ Interrupt::Halt()
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
+	// a thread halting because no one is left to wake it is still on
+	// the wait queue it slept on; take it off, so that it can wait for
+	// the console and the disk below
+	Thread *halting = kernel->currentThread;
+	if (halting->listLink.list != NULL)
+	    halting->listLink.list->Remove(halting);
+
+	// let the console show what programs wrote, then write back the
+	// file system, and mark it unmounted cleanly, while the debug and
+	// kernel data structures needed for disk I/O are still around
+	kernel->synchConsoleOut->Flush();
+#ifndef FILESYS_STUB
+	kernel->fileSystem->Unmount();
+#else
+	kernel->bufferCache->Flush();
+#endif
+	if (debug->IsEnabled(dbgCache)) {
+	    kernel->bufferCache->Print();
+	    kernel->journal->Print();
+	    kernel->synchDisk->Print();
+	}
+	if (debug->IsEnabled(dbgSys))
+	    PrintSyscallStats();
+	if (kernel->fsStatsFlag)
+	    kernel->PrintFsStats();
+	if (kernel->lockStats != NULL)
+	    kernel->lockStats->Print(kernel->lockStatTop);
+	if (kernel->scheduler->getPolicy() == StrideScheduling)
+	    kernel->scheduler->PrintShares();
+	if (kernel->machine != NULL && kernel->machine->profile != NULL)
+	    kernel->machine->PrintProfile();
+	if (debug->IsEnabled(dbgAddr) || kernel->statsFlag) {
+	    ThreadUsage usage = kernel->currentThread->Usage();
+
+	    kernel->stats->threadUsage.Add(&usage);	// the thread halting
+	    if (kernel->currentThread->space != NULL)	// and its program
+		kernel->stats->memoryUsage.Add(
+			kernel->currentThread->space->Usage());
+	    kernel->stats->Print();	// page faults, among others
+	}
+
+	if (cluster != NULL)
+	    cluster->Halted();	// returns only for the last machine up
+
 	delete debug;
 	
-    delete kernel;	// Never returns.
+    delete kernel;
+    Exit(0);
 }
 
 
@@ -253,6 +416,18 @@ int Interrupt::CreateFile(char *filename, int size)
     return kernel->CreateFile(filename, size);
 }
 
+int Interrupt::Exec(char *filename) {
+    return kernel->Exec(filename);
+}
+
+int Interrupt::ExecWith(char *filename, int input, int output) {
+    return kernel->Exec(filename, input, output);
+}
+
+int Interrupt::Join(int id) {
+    return kernel->Join(id);
+}
+
 int Interrupt::myOpen(char *filename) {
     return kernel->myOpen(filename);
 }
@@ -269,12 +444,55 @@ int Interrupt::Close(int id) {
     return kernel->Close(id);
 }
 
+int Interrupt::Fsync(int id) {
+    return kernel->Fsync(id);
+}
+
+int Interrupt::Seek(int offset, int whence, int id) {
+    return kernel->Seek(offset, whence, id);
+}
+
+int Interrupt::FileSize(int id) {
+    return kernel->FileSize(id);
+}
+
+int Interrupt::CopyRange(int fromId, int toId, int size) {
+    return kernel->CopyRange(fromId, toId, size);
+}
+
+int Interrupt::Preallocate(int id, int size, int flags) {
+    return kernel->Preallocate(id, size, flags);
+}
+
+int Interrupt::MakePipe(int *ids) {
+    return kernel->MakePipe(ids);
+}
+
+int Interrupt::RemoveFile(char *filename) {
+    return kernel->RemoveFile(filename);
+}
+
+int Interrupt::RenameFile(char *from, char *to) {
+    return kernel->RenameFile(from, to);
+}
+
+int Interrupt::CreateDir(char *name) {
+    return kernel->CreateDir(name);
+}
+
+int Interrupt::ReadDir(char *name, int *cursor, DirectoryEntry *entries,
+                       int *sizes, int count) {
+    return kernel->ReadDir(name, cursor, entries, sizes, count);
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Schedule
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on a heap, kept in an array that grows as
+//	need be, so that neither this nor taking the first interrupt off
+//	takes more than log(n) steps, or any allocation.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -288,12 +506,14 @@ void
 Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
 {
     int when = kernel->stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(toCall, when, type);
+    PendingInterrupt toOccur(toCall, when, type, scheduled++);
 
     DEBUG(dbgInt, "Scheduling interrupt handler the " << intTypeNames[type] << " at time = " << when);
     ASSERT(fromNow > 0);
 
-    pending->Insert(toOccur);
+    Push(&toOccur);
+    if (when < nextDue)
+	nextDue = when;
 }
 
 //----------------------------------------------------------------------
@@ -311,32 +531,35 @@ Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
 bool
 Interrupt::CheckIfDue(bool advanceClock)
 {
-    PendingInterrupt *next;
+    PendingInterrupt next;
     Statistics *stats = kernel->stats;
 
     ASSERT(level == IntOff);		// interrupts need to be disabled,
 					// to invoke an interrupt handler
+    if (hostSignalled && hostInput != NULL) {
+	hostSignalled = FALSE;
+	hostInput->InputArrived();
+    }
     if (debug->IsEnabled(dbgInt)) {
 	DumpState();
     }
-    if (pending->IsEmpty()) {   	// no pending interrupts
+    if (numPending == 0) {   	// no pending interrupts
 	return FALSE;	
     }		
-    next = pending->Front();
 
-    if (next->when > stats->totalTicks) {
-        if (!advanceClock) {		// not time yet
-            return FALSE;
-        }
+    if (pending[0].when > stats->totalTicks) {
+        if (!advanceClock || pending[0].when > horizon) {
+            return FALSE;		// not time yet, or not before the
+        }				// rest of the cluster
         else {      		// advance the clock to next interrupt
-	    stats->idleTicks += (next->when - stats->totalTicks);
-	    stats->totalTicks = next->when;
+	    stats->idleTicks += (pending[0].when - stats->totalTicks);
+	    stats->totalTicks = pending[0].when;
 	    // UDelay(1000L); // rcgood - to stop nachos from spinning.
 	}
     }
 
     DEBUG(dbgInt, "Invoking interrupt handler for the ");
-    DEBUG(dbgInt, intTypeNames[next->type] << " at time " << next->when);
+    DEBUG(dbgInt, intTypeNames[pending[0].type] << " at time " << pending[0].when);
 
     if (kernel->machine != NULL) {
     	kernel->machine->DelayedLoad(0, 0);
@@ -344,15 +567,72 @@ Interrupt::CheckIfDue(bool advanceClock)
 
     inHandler = TRUE;
     do {
-        next = pending->RemoveFront();    // pull interrupt off list
-        next->callOnInterrupt->CallBack();// call the interrupt handler
-	delete next;
-    } while (!pending->IsEmpty() 
-    		&& (pending->Front()->when <= stats->totalTicks));
+        Pop(&next);    			// pull interrupt off list
+        TRACE(dbgInt, (TraceInterrupt, next.type));
+        next.callOnInterrupt->CallBack();// call the interrupt handler
+    } while (numPending > 0 && (pending[0].when <= stats->totalTicks));
     inHandler = FALSE;
+    nextDue = min((numPending == 0) ? NeverDue : pending[0].when, horizon);
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Interrupt::Push
+// 	Add "toOccur" to the heap of pending interrupts: put it at the
+//	bottom, and move it up past those due after it.
+//----------------------------------------------------------------------
+
+void
+Interrupt::Push(PendingInterrupt *toOccur)
+{
+    int i, parent;
+
+    if (numPending == maxPending) {
+	PendingInterrupt *bigger = new PendingInterrupt[2 * maxPending];
+
+	for (i = 0; i < numPending; i++)
+	    bigger[i] = pending[i];
+	delete [] pending;
+	pending = bigger;
+	maxPending *= 2;
+    }
+    for (i = numPending++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (PendingCompare(&pending[parent], toOccur) < 0)
+	    break;
+	pending[i] = pending[parent];
+    }
+    pending[i] = *toOccur;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Pop
+// 	Take the first interrupt due off the heap, into "next": move the
+//	last one into its place, and down past those due before it.
+//----------------------------------------------------------------------
+
+void
+Interrupt::Pop(PendingInterrupt *next)
+{
+    PendingInterrupt last;
+    int i, child;
+
+    ASSERT(numPending > 0);
+    *next = pending[0];
+    last = pending[--numPending];
+    for (i = 0; 2 * i + 1 < numPending; i = child) {
+	child = 2 * i + 1;
+	if (child + 1 < numPending &&
+		PendingCompare(&pending[child + 1], &pending[child]) < 0)
+	    child++;
+	if (PendingCompare(&last, &pending[child]) < 0)
+	    break;
+	pending[i] = pending[child];
+    }
+    if (numPending > 0)
+	pending[i] = last;
+}
+
 //----------------------------------------------------------------------
 // PrintPending
 // 	Print information about an interrupt that is scheduled to occur.
@@ -377,8 +657,9 @@ Interrupt::DumpState()
 {
     cout << "Time: " << kernel->stats->totalTicks;
     cout << ", interrupts " << intLevelNames[level] << "\n";
-    cout << "Pending interrupts:\n";
-    pending->Apply(PrintPending);
+    cout << "Pending interrupts (in no particular order):\n";
+    for (int i = 0; i < numPending; i++)
+	PrintPending(&pending[i]);
     cout << "\nEnd of pending interrupts\n";
 }
 
@@ -49,15 +49,21 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 // In Nachos, we support a hardware timer device, a disk, a console
 // display and keyboard, and a network.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-			NetworkSendInt, NetworkRecvInt};
+			NetworkSendInt, NetworkRecvInt, AlarmInt};
+
+const int NeverDue = 0x7fffffff;	// a time never reached
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
 // left public to make it simpler to manipulate.
 
+class DirectoryEntry;
+
 class PendingInterrupt {
   public:
-    PendingInterrupt(CallBackObj *callOnInt, int time, IntType kind);
+    PendingInterrupt() {}	// an unused slot of the pending queue
+    PendingInterrupt(CallBackObj *callOnInt, int time, IntType kind,
+		     int order);
 				// initialize an interrupt that will
 				// occur in the future
 
@@ -66,6 +72,23 @@ class PendingInterrupt {
     
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    int order;			// Which was scheduled first, of those
+				// due at the same time
+};
+
+// The following class defines a device whose input the host signals as
+// it arrives, rather than one that polls for it (see
+// Interrupt::WatchHost): the interrupt simulation tells it when the
+// host has signalled, and when nothing else is to come.
+
+class HostInput {
+  public:
+    virtual ~HostInput() {}
+    virtual void InputArrived() = 0;	// The host has signalled: schedule
+					// the device's interrupt
+    virtual void WaitForInput() = 0;	// Nothing is pending: sleep till
+					// the host has input, and then
+					// schedule it
 };
 
 // The following class defines the data structures for the simulation
@@ -91,12 +114,28 @@ class Interrupt {
     void Idle(); 		// The ready queue is empty, roll 
 				// simulated time forward until the 
 				// next interrupt
+    void WatchHost(HostInput *device);	// Tell "device" of host signals,
+					// from now on; NULL for none
+    static void HostSignalled();	// Called by the host signal handler
+    void SetHorizon(int when);		// Let the other machines of the
+					// cluster run, once time reaches
+					// "when" (see Cluster); NeverDue
+					// if there are none
+
+    bool DevicePending();	// Is an interrupt some thread may be
+				// waiting for still to come?
 
     void Halt(); 		// quit and print out stats
 
     void PrintInt(int number);
 	
 	int CreateFile(char *filename, int size);
+
+    int Exec(char *filename);
+
+    int ExecWith(char *filename, int input, int output);
+
+    int Join(int id);
     
     int myOpen(char *filename);
     
@@ -106,8 +145,31 @@ class Interrupt {
     
     int Close(int id);
 
+    int Fsync(int id);
+
+    int Seek(int offset, int whence, int id);
+
+    int FileSize(int id);
+
+    int CopyRange(int fromId, int toId, int size);
+
+    int Preallocate(int id, int size, int flags);
+
+    int MakePipe(int *ids);
+
+    int RemoveFile(char *filename);
+
+    int RenameFile(char *from, char *to);
+
+    int CreateDir(char *name);
+
+    int ReadDir(char *name, int *cursor, DirectoryEntry *entries,
+                int *sizes, int count);
+
     void YieldOnReturn();	// cause a context switch on return 
 				// from an interrupt handler
+    bool InHandler() { return inHandler; }
+				// is an interrupt handler running?
 
     MachineStatus getStatus() { return status; } 
     void setStatus(MachineStatus st) { status = st; }
@@ -128,11 +190,24 @@ class Interrupt {
     
     void OneTick();       	// Advance simulated time
 
+    int InstructionsUntilDue();	// How many user instructions can run
+				// before an interrupt may be due
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    SortedList<PendingInterrupt *> *pending;		
-    				// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt *pending;	// the interrupts scheduled to occur in
+				// the future, as a heap: pending[0] is
+				// the first due, and each is due before
+				// the two at 2i+1 and 2i+2
+    int numPending;		// how many there are
+    int maxPending;		// room in "pending"; doubled when full
+    int scheduled;		// interrupts scheduled so far
+    int nextDue;		// when the first of them is due, or
+				// the horizon, if that is sooner
+    int horizon;		// when to let the rest of the cluster
+				// run, if this machine is in one
+    bool traceTicks;		// debugging interrupts: check on every
+				// tick, so as to dump the state
     //int writeFileNo;            //UNIX file emulating the display
     bool inHandler;		// TRUE if we are running an interrupt handler
     //bool putBusy;               // Is a PrintInt operation in progress
@@ -140,9 +215,13 @@ class Interrupt {
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
     MachineStatus status;	// idle, kernel mode, user mode
+    HostInput *hostInput;	// told of host signals; NULL if none
 
     // these functions are internal to the interrupt simulation code
 
+    void Push(PendingInterrupt *toOccur);	// add to "pending"
+    void Pop(PendingInterrupt *next);	// remove the first due into "next"
+
     bool CheckIfDue(bool advanceClock); 
     				// Check if any interrupts are supposed
 				// to occur now, and if so, do them
@@ -10,6 +10,7 @@
 #include "copyright.h"
 #include "machine.h"
 #include "main.h"
+#include "profile.h"
 
 // Textual names of the exceptions that can be generated by user program
 // execution, for debugging.
@@ -18,6 +19,11 @@ static char* exceptionNames[] = { "no exception", "syscall",
 				"bus error", "address error", "overflow",
 				"illegal instruction" };
 
+// The shape of physical memory; set once, when the Machine is made.
+int PageSize = DefaultPageSize;
+int NumPhysPages = DefaultNumPhysPages;
+int MemorySize = DefaultNumPhysPages * DefaultPageSize;
+
 //----------------------------------------------------------------------
 // CheckEndian
 // 	Check to be sure that the host really uses the format it says it 
@@ -50,28 +56,40 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"pageSize" -- bytes in a page; a power of two, and a whole
+//		number of words
+//	"numPhysPages" -- how many pages of physical memory there are
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, int pageSize, int numPhysPages)
 {
     int i;
 
+    ASSERT(pageSize >= 4 && (pageSize & (pageSize - 1)) == 0);
+    ASSERT(numPhysPages > 0);
+    PageSize = pageSize;
+    NumPhysPages = numPhysPages;
+    MemorySize = numPhysPages * pageSize;
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
-#ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-	tlb[i].valid = FALSE;
-    pageTable = NULL;
-#else	// use linear page table
     tlb = NULL;
+    tlbSize = tlbWays = 0;
+    tlbLastUsed = NULL;
+    tlbAccesses = 0;
     pageTable = NULL;
+    pageTableKind = LinearPageTable;
+    storeFault = FALSE;
+    profile = NULL;
+    linked = FALSE;
+#ifdef USE_TLB
+    UseTLB(TLBSize, TLBSize);
 #endif
 
     singleStep = debug;
+    traceAddr = ::debug->IsEnabled(dbgAddr);
     CheckEndian();
 }
 
@@ -85,6 +103,54 @@ Machine::~Machine()
     delete [] mainMemory;
     if (tlb != NULL)
         delete [] tlb;
+    delete [] tlbLastUsed;
+    delete profile;
+}
+
+//----------------------------------------------------------------------
+// Machine::UseTLB
+// 	Have the hardware translate addresses with a TLB, rather than
+//	the page table, from now on.  The TLB starts out empty, and the
+//	kernel must load it on each miss (a PageFaultException).
+//
+//	"size" -- the number of entries
+//	"ways" -- the associativity: entries are grouped in sets of
+//		"ways", and a virtual page can only be in one set; "size"
+//		ways is a fully associative TLB.  There must be at least
+//		two, since an instruction may need both its own page and
+//		the page of the data it loads or stores at once.
+//----------------------------------------------------------------------
+
+void
+Machine::UseTLB(int size, int ways)
+{
+    ASSERT(ways >= 2 && ways <= size && size % ways == 0);
+    delete [] tlb;
+    delete [] tlbLastUsed;
+    tlbSize = size;
+    tlbWays = ways;
+    tlb = new TranslationEntry[size];
+    tlbLastUsed = new int[size];
+    for (int i = 0; i < size; i++) {
+	tlb[i].valid = FALSE;
+	tlbLastUsed[i] = 0;
+    }
+    pageTable = NULL;
+}
+
+//----------------------------------------------------------------------
+// Machine::StartProfile
+// 	Count every user instruction run from now on, and sample the PC
+//	every "interval" of them, for PrintProfile; name the functions
+//	sampled from "symbolFile", the output of "nm -n" on a program's
+//	COFF file, if it is not NULL.
+//----------------------------------------------------------------------
+
+void
+Machine::StartProfile(int interval, char *symbolFile)
+{
+    ASSERT(profile == NULL);
+    profile = new Profile(interval, symbolFile);
 }
 
 //----------------------------------------------------------------------
@@ -103,6 +169,7 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
     DEBUG(dbgMach, "Exception: " << exceptionNames[which]);
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
+    linked = FALSE;			// the kernel may touch memory
     kernel->interrupt->setStatus(SystemMode);
     ExceptionHandler(which);		// interrupts are enabled at this point
     kernel->interrupt->setStatus(UserMode);
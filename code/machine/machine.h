@@ -25,19 +25,19 @@
 #include "utility.h"
 #include "translate.h"
 
-// Definitions related to the size, and format of user memory
+// Definitions related to the size, and format of user memory.
+//
+// The size of a page and the number of pages of physical memory are
+// chosen when Nachos starts (see "-pagesize" and "-mem"), and are fixed
+// once the Machine is made.  These are the defaults.
 
-const int PageSize = 128; 		// set the page size equal to
+const int DefaultPageSize = 128; 	// set the page size equal to
 					// the disk sector size, for simplicity
+const int DefaultNumPhysPages = 128;
 
-//
-// You are allowed to change this value.
-// Doing so will change the number of pages of physical memory
-// available on the simulated machine.
-//
-const int NumPhysPages = 128;
-
-const int MemorySize = (NumPhysPages * PageSize);
+extern int PageSize;			// bytes in a page, a power of two
+extern int NumPhysPages;		// pages of physical memory
+extern int MemorySize;			// NumPhysPages * PageSize
 const int TLBSize = 4;			// if there is a TLB, make it small
 
 enum ExceptionType { NoException,           // Everything ok!
@@ -90,11 +90,15 @@ enum ExceptionType { NoException,           // Everything ok!
 
 class Instruction;
 class Interrupt;
+class Profile;
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
-				// for running user programs
+    Machine(bool debug, int pageSize = DefaultPageSize,
+	    int numPhysPages = DefaultNumPhysPages);
+				// Initialize the simulation of the hardware
+				// for running user programs, with
+				// "numPhysPages" of "pageSize" bytes
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -117,11 +121,11 @@ class Machine {
 // NOTE: the hardware translation of virtual addresses in the user program
 // to physical addresses (relative to the beginning of "mainMemory")
 // can be controlled by one of:
-//	a traditional linear page table
+//	a page table -- linear, two-level or hashed (see translate.h)
 //  	a software-loaded translation lookaside buffer (tlb) -- a cache of 
 //	  mappings of virtual page #'s to physical page #'s
 //
-// If "tlb" is NULL, the linear page table is used
+// If "tlb" is NULL, the page table is used
 // If "tlb" is non-NULL, the Nachos kernel is responsible for managing
 //	the contents of the TLB.  But the kernel can use any data structure
 //	it wants (eg, segmented paging) for handling TLB cache misses.
@@ -134,9 +138,32 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
-
-    TranslationEntry *pageTable;
-    unsigned int pageTableSize;
+    int tlbSize;			// Entries in the TLB, in sets of
+    int tlbWays;			// "tlbWays"; a page can only be in
+					// set (vpn % number of sets)
+    int *tlbLastUsed;			// When each entry last translated
+					// an address, counting accesses
+
+    void UseTLB(int size, int ways);	// Translate with a TLB of "size"
+					// entries, "ways"-way associative,
+					// rather than a page table
+
+    PageTable *pageTable;		// the current address space's, or
+					// NULL with a TLB
+    PageTableKind pageTableKind;	// how page tables are laid out
+
+    bool storeFault;			// Was the last PageFaultException
+					// on a store, not a load?  (The
+					// MIPS cause register tells the
+					// two apart the same way.)
+
+    Profile *profile;			// counts the instructions run;
+					// NULL unless profiling
+    void StartProfile(int interval, char *symbolFile);
+					// Sample the PC every "interval"
+					// instructions from now on, naming
+					// functions from "symbolFile"
+    void PrintProfile();		// Print what the profile found
 
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
@@ -146,6 +173,15 @@ class Machine {
   private:
 
 // Routines internal to the machine simulation -- DO NOT call these directly
+    int tlbAccesses;			// Accesses through the TLB so far
+    bool linked;			// Has an LL begun a read-modify-
+    int linkedSwitches;			// write, and how many context
+					// switches were there then?  An
+					// SC stores only if there have
+					// been no more, and no exception
+    bool traceAddr;			// Debugging address translation?
+					// Then always go through Translate
+
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
 
@@ -154,6 +190,12 @@ class Machine {
     
 
 
+    char *HostAddress(int virtAddr, int size, bool writing);
+				// Where the host keeps virtual address
+				// "virtAddr", if it can be found quickly:
+				// a valid page table entry with its use
+				// (and, if writing, dirty) bit set
+
     ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
     				// Translate an address, and check for 
 				// alignment.  Set the use and dirty bits in 
@@ -179,12 +221,16 @@ class Machine {
 				// time reaches this value
 
     friend class Interrupt;		// calls DelayedLoad()    
+    friend class ThreadedCode;		// runs blocks of instructions
 };
 
 extern void ExceptionHandler(ExceptionType which);
 				// Entry point into Nachos for handling
 				// user system calls and exceptions
 				// Defined in exception.cc
+extern void PrintSyscallStats();
+				// Print the calls made to each system
+				// call, also in exception.cc
 
 
 // Routines for converting Words and Short Words to and from the
@@ -198,9 +244,39 @@ extern void ExceptionHandler(ExceptionType which);
 //	simulated machine byte ordering:
 //	   contents of main memory
 
-unsigned int WordToHost(unsigned int word);
-unsigned short ShortToHost(unsigned short shortword);
-unsigned int WordToMachine(unsigned int word);
-unsigned short ShortToMachine(unsigned short shortword);
+//
+// They are used on every simulated load and store, so the build picks
+// them for the host at compile time (HOST_IS_BIG_ENDIAN, which
+// CheckEndian verifies at startup): inline, and nothing at all on a
+// little endian host.
+
+#ifdef HOST_IS_BIG_ENDIAN
+inline unsigned int
+WordToHost(unsigned int word)
+{
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+    return __builtin_bswap32(word);
+#else
+    return ((word >> 24) & 0x000000ff) | ((word >> 8) & 0x0000ff00) |
+	   ((word << 8) & 0x00ff0000) | ((word << 24) & 0xff000000);
+#endif
+}
+
+inline unsigned short
+ShortToHost(unsigned short shortword)
+{
+    return (unsigned short) (((shortword << 8) & 0xff00) |
+			     ((shortword >> 8) & 0x00ff));
+}
+#else
+inline unsigned int WordToHost(unsigned int word) { return word; }
+inline unsigned short ShortToHost(unsigned short shortword)
+						{ return shortword; }
+#endif // HOST_IS_BIG_ENDIAN
+
+inline unsigned int WordToMachine(unsigned int word)
+						{ return WordToHost(word); }
+inline unsigned short ShortToMachine(unsigned short shortword)
+						{ return ShortToHost(shortword); }
 
 #endif // MACHINE_H
@@ -21,6 +21,7 @@
 #include "machine.h"
 #include "mipssim.h"
 #include "main.h"
+#include "profile.h"
 
 static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 
@@ -44,6 +45,72 @@ class Instruction {
                      // Immediates are sign-extended.
 };
 
+// Decoding is done once per word of physical memory, not once per
+// instruction executed: the instruction last decoded at each word is
+// kept, and is used again as long as the word still holds the same
+// value.  Comparing the value catches every way code can change under
+// us -- a page loaded or copied into the frame, a program writing into
+// its code -- without the kernel having to tell us.
+
+static Instruction *decodeCache = NULL;	// one per word of memory,
+static bool *decodedAt;			// and is decodeCache[i] valid?
+
+// Outside the debugger, instructions are not interpreted one at a time
+// but a basic block at a time.  A block is a run of instructions in one
+// page, up to the delay slot of the first branch or jump, translated
+// into threaded code: for each instruction, the routine that carries
+// it out is chosen once, when the block is translated, and bound to
+// its decoded operands.  The block is then run with no interrupt checks
+// in between instructions, as far as the next interrupt that may be
+// due, so interrupts still come at the same instruction they would if
+// every instruction were interpreted.
+//
+// Blocks are kept by the physical address they start at, and used
+// again as long as memory still holds the words they were translated
+// from.  A block ends early at an instruction it has no routine for
+// (a system call, say), which is left to the interpreter.
+
+class BlockStep {
+  public:
+    int pcAfter;		// where to go after the next instruction
+    int loadReg;		// delayed load to do once the
+    int loadValue;		//   instruction is done
+};
+
+typedef bool (*OpRoutine)(Machine *m, int *registers, Instruction *instr,
+			  BlockStep *step);
+				// run one instruction, on the machine's
+				// "registers"; FALSE if it raised an
+				// exception
+
+const int MaxBlockLength = 32;	// a block of a large page is cut
+				// short; the next one takes over
+
+class Block {
+  public:
+    int length;			// instructions with a routine
+    int words;			// words translated: "length", or one
+				// more if the block ends at an
+				// instruction with no routine
+    Instruction instr[MaxBlockLength];
+    OpRoutine routine[MaxBlockLength];
+};
+
+static Block **blockCache;	// by starting address
+
+class ThreadedCode {
+  public:
+    static int Run(Machine *m, int limit);
+				// run the block at the PC, up to "limit"
+				// instructions; how many ran, 0 if
+				// none could
+  private:
+    static Block *Find(Machine *m, int physicalAddress);
+    static void Translate(Machine *m, Block *block, int physicalAddress);
+    static OpRoutine RoutineFor(int opCode);
+    static bool IsBranch(int opCode);
+};
+
 //----------------------------------------------------------------------
 // Machine::Run
 // 	Simulate the execution of a user-level program on Nachos.
@@ -57,21 +124,56 @@ void
 Machine::Run()
 {
     Instruction *instr = new Instruction;  // storage for decoded instruction
+    int ran;			// instructions run by a block
 
+    if (decodeCache == NULL) {	// the first program: memory is
+	decodeCache = new Instruction[MemorySize / 4];	// sized now
+	decodedAt = new bool[MemorySize / 4];
+	blockCache = new Block *[MemorySize / 4];
+	for (int i = 0; i < MemorySize / 4; i++) {
+	    decodedAt[i] = FALSE;
+	    blockCache[i] = NULL;
+	}
+    }
     if (debug->IsEnabled('m')) {
         cout << "Starting program in thread: " << kernel->currentThread->getName();
 		cout << ", at time: " << kernel->stats->totalTicks << "\n";
     }
     kernel->interrupt->setStatus(UserMode);
     for (;;) {
-        OneInstruction(instr);
-		kernel->interrupt->OneTick();
+	if (singleStep || debug->IsEnabled('m') || profile != NULL) {
+	    OneInstruction(instr);	// trace or count each instruction
+	    ran = 1;
+	} else {
+	    ran = ThreadedCode::Run(this,
+			kernel->interrupt->InstructionsUntilDue());
+	    if (ran == 0)		// in a delay slot, or at an
+		OneInstruction(instr);	// instruction only the
+	}				// interpreter knows
+		kernel->interrupt->OneTick();	// the last one's tick
 		if (singleStep && (runUntilTime <= kernel->stats->totalTicks))
 	  		Debugger();
     }
 }
 
 
+//----------------------------------------------------------------------
+// Machine::PrintProfile
+// 	Print what the profile found, naming the opcodes as the
+//	debugger does.
+//----------------------------------------------------------------------
+
+void
+Machine::PrintProfile()
+{
+    char *opNames[MaxOpcode + 1];
+
+    ASSERT(profile != NULL && MaxOpcode + 1 == ProfileOpcodes);
+    for (int i = 0; i <= MaxOpcode; i++)
+	opNames[i] = opStrings[i].format;
+    profile->Print(opNames);
+}
+
 //----------------------------------------------------------------------
 // TypeToReg
 // 	Retrieve the register # referred to in an instruction. 
@@ -114,7 +216,8 @@ TypeToReg(RegType reg, Instruction *instr)
 //	store all data back to the machine registers and memory before
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
-//	and the register set.
+//	and the register set.  (The decoded instructions kept in
+//	decodeCache are only used if memory still holds what was decoded.)
 //----------------------------------------------------------------------
 
 void
@@ -128,12 +231,28 @@ Machine::OneInstruction(Instruction *instr)
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
+    int physicalAddress;
+    ExceptionType exception;
 
-    // Fetch instruction 
-    if (!ReadMem(registers[PCReg], 4, &raw))
+    // Fetch instruction, as ReadMem would, and decode it unless it was
+    // decoded at this physical address already
+    DEBUG(dbgAddr, "Reading VA " << registers[PCReg] << ", size 4");
+    exception = Translate(registers[PCReg], &physicalAddress, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
+    }
+    raw = WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+    DEBUG(dbgAddr, "\tvalue read = " << raw);
+    if (!decodedAt[physicalAddress / 4] ||
+	decodeCache[physicalAddress / 4].value != (unsigned int) raw) {
+	decodeCache[physicalAddress / 4].value = raw;
+	decodeCache[physicalAddress / 4].Decode();
+	decodedAt[physicalAddress / 4] = TRUE;
+    }
+    *instr = decodeCache[physicalAddress / 4];
+    if (profile != NULL)
+	profile->Count(registers[PCReg], instr->opCode);
 
     if (debug->IsEnabled('m')) {
         struct OpString *str = &opStrings[instr->opCode];
@@ -308,6 +427,20 @@ Machine::OneInstruction(Instruction *instr)
 	nextLoadReg = instr->rt;
 	nextLoadValue = value;
 	break;
+
+      case OP_LL:			// LW, and start a read-modify-write
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    return;
+	}
+	if (!ReadMem(tmp, 4, &value))
+	    return;
+	linked = TRUE;
+	linkedSwitches = kernel->stats->numContextSwitches;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	break;
     	
       case OP_LWL:	  
 	tmp = registers[instr->rs] + instr->extra;
@@ -548,6 +681,20 @@ Machine::OneInstruction(Instruction *instr)
 		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
 	    return;
 	break;
+
+      case OP_SC:			// SW, if nothing else can have run
+	if (linked &&			// since the LL; rt says if it did
+		linkedSwitches == kernel->stats->numContextSwitches) {
+	    if (!WriteMem((unsigned)
+		    (registers[instr->rs] + instr->extra), 4,
+		    registers[instr->rt]))
+		return;
+	    registers[instr->rt] = 1;
+	} else {
+	    registers[instr->rt] = 0;
+	}
+	linked = FALSE;
+	break;
 	
       case OP_SWL:	  
 	tmp = registers[instr->rs] + instr->extra;
@@ -826,3 +973,510 @@ Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr)
     *hiPtr = (int) hi;
     *loPtr = (int) lo;
 }
+
+//----------------------------------------------------------------------
+// The routines for each instruction of a block, one per opcode.  They
+// do what the cases of OneInstruction do; instructions that can
+// overflow, or that are rare (LWL, DIV and such), are left to it, as
+// are the logical right shifts, which it does (as ever) as arithmetic
+// ones.
+//----------------------------------------------------------------------
+
+static bool
+RunAddiu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] = registers[instr->rs] + instr->extra;
+    return TRUE;
+}
+
+static bool
+RunAddu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rs] + registers[instr->rt];
+    return TRUE;
+}
+
+static bool
+RunAnd(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rs] & registers[instr->rt];
+    return TRUE;
+}
+
+static bool
+RunAndi(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] = registers[instr->rs] & (instr->extra & 0xffff);
+    return TRUE;
+}
+
+static bool
+RunBeq(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (registers[instr->rs] == registers[instr->rt])
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBgez(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (!(registers[instr->rs] & SIGN_BIT))
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBgezal(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[R31] = registers[NextPCReg] + 4;
+    if (!(registers[instr->rs] & SIGN_BIT))
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBgtz(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (registers[instr->rs] > 0)
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBlez(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (registers[instr->rs] <= 0)
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBltz(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (registers[instr->rs] & SIGN_BIT)
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBltzal(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[R31] = registers[NextPCReg] + 4;
+    if (registers[instr->rs] & SIGN_BIT)
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunBne(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (registers[instr->rs] != registers[instr->rt])
+	step->pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunJ(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    step->pcAfter = (step->pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunJal(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[R31] = registers[NextPCReg] + 4;
+    step->pcAfter = (step->pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
+    return TRUE;
+}
+
+static bool
+RunJalr(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[NextPCReg] + 4;
+    step->pcAfter = registers[instr->rs];
+    return TRUE;
+}
+
+static bool
+RunJr(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    step->pcAfter = registers[instr->rs];
+    return TRUE;
+}
+
+static bool
+RunLb(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    int value;
+
+    if (!m->ReadMem(registers[instr->rs] + instr->extra, 1, &value))
+	return FALSE;
+    step->loadReg = instr->rt;
+    step->loadValue = (value & 0x80) ? (value | 0xffffff00) : (value & 0xff);
+    return TRUE;
+}
+
+static bool
+RunLbu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    int value;
+
+    if (!m->ReadMem(registers[instr->rs] + instr->extra, 1, &value))
+	return FALSE;
+    step->loadReg = instr->rt;
+    step->loadValue = value & 0xff;
+    return TRUE;
+}
+
+static bool
+RunLui(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] = instr->extra << 16;
+    return TRUE;
+}
+
+static bool
+RunLw(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    int value;				// (ReadMem checks alignment)
+
+    if (!m->ReadMem(registers[instr->rs] + instr->extra, 4, &value))
+	return FALSE;
+    step->loadReg = instr->rt;
+    step->loadValue = value;
+    return TRUE;
+}
+
+static bool
+RunMfhi(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[HiReg];
+    return TRUE;
+}
+
+static bool
+RunMflo(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[LoReg];
+    return TRUE;
+}
+
+static bool
+RunMult(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    Mult(registers[instr->rs], registers[instr->rt], TRUE,
+	 &registers[HiReg], &registers[LoReg]);
+    return TRUE;
+}
+
+static bool
+RunMultu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    Mult(registers[instr->rs], registers[instr->rt], FALSE,
+	 &registers[HiReg], &registers[LoReg]);
+    return TRUE;
+}
+
+static bool
+RunNor(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = ~(registers[instr->rs] | registers[instr->rt]);
+    return TRUE;
+}
+
+static bool
+RunOr(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rs] | registers[instr->rt];
+    return TRUE;
+}
+
+static bool
+RunOri(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] = registers[instr->rs] | (instr->extra & 0xffff);
+    return TRUE;
+}
+
+static bool
+RunSb(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (!m->WriteMem((unsigned) (registers[instr->rs] + instr->extra), 1,
+		    registers[instr->rt]))
+	return FALSE;
+    return TRUE;
+}
+
+static bool
+RunSll(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rt] << instr->extra;
+    return TRUE;
+}
+
+static bool
+RunSllv(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rt] << (registers[instr->rs] & 0x1f);
+    return TRUE;
+}
+
+static bool
+RunSlt(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = (registers[instr->rs] < registers[instr->rt]);
+    return TRUE;
+}
+
+static bool
+RunSlti(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] = (registers[instr->rs] < instr->extra);
+    return TRUE;
+}
+
+static bool
+RunSltiu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] =
+	((unsigned int) registers[instr->rs] < (unsigned int) instr->extra);
+    return TRUE;
+}
+
+static bool
+RunSltu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] =
+	((unsigned int) registers[instr->rs] < (unsigned int) registers[instr->rt]);
+    return TRUE;
+}
+
+static bool
+RunSra(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rt] >> instr->extra;
+    return TRUE;
+}
+
+static bool
+RunSrav(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rt] >> (registers[instr->rs] & 0x1f);
+    return TRUE;
+}
+
+static bool
+RunSubu(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
+    return TRUE;
+}
+
+static bool
+RunSw(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    if (!m->WriteMem((unsigned) (registers[instr->rs] + instr->extra), 4,
+		    registers[instr->rt]))
+	return FALSE;
+    return TRUE;
+}
+
+static bool
+RunXor(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
+    return TRUE;
+}
+
+static bool
+RunXori(Machine *m, int *registers, Instruction *instr, BlockStep *step)
+{
+    registers[instr->rt] = registers[instr->rs] ^ (instr->extra & 0xffff);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ThreadedCode::RoutineFor
+// 	Return the routine to run instructions of type "opCode" in a
+//	block, or NULL if they are left to the interpreter.
+//----------------------------------------------------------------------
+
+OpRoutine
+ThreadedCode::RoutineFor(int opCode)
+{
+    switch (opCode) {
+      case OP_ADDIU: return RunAddiu;
+      case OP_ADDU: return RunAddu;
+      case OP_AND: return RunAnd;
+      case OP_ANDI: return RunAndi;
+      case OP_BEQ: return RunBeq;
+      case OP_BGEZ: return RunBgez;
+      case OP_BGEZAL: return RunBgezal;
+      case OP_BGTZ: return RunBgtz;
+      case OP_BLEZ: return RunBlez;
+      case OP_BLTZ: return RunBltz;
+      case OP_BLTZAL: return RunBltzal;
+      case OP_BNE: return RunBne;
+      case OP_J: return RunJ;
+      case OP_JAL: return RunJal;
+      case OP_JALR: return RunJalr;
+      case OP_JR: return RunJr;
+      case OP_LB: return RunLb;
+      case OP_LBU: return RunLbu;
+      case OP_LUI: return RunLui;
+      case OP_LW: return RunLw;
+      case OP_MFHI: return RunMfhi;
+      case OP_MFLO: return RunMflo;
+      case OP_MULT: return RunMult;
+      case OP_MULTU: return RunMultu;
+      case OP_NOR: return RunNor;
+      case OP_OR: return RunOr;
+      case OP_ORI: return RunOri;
+      case OP_SB: return RunSb;
+      case OP_SLL: return RunSll;
+      case OP_SLLV: return RunSllv;
+      case OP_SLT: return RunSlt;
+      case OP_SLTI: return RunSlti;
+      case OP_SLTIU: return RunSltiu;
+      case OP_SLTU: return RunSltu;
+      case OP_SRA: return RunSra;
+      case OP_SRAV: return RunSrav;
+      case OP_SUBU: return RunSubu;
+      case OP_SW: return RunSw;
+      case OP_XOR: return RunXor;
+      case OP_XORI: return RunXori;
+      default: return NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadedCode::IsBranch
+// 	Return TRUE if instructions of type "opCode" have a delay slot,
+//	which ends the block.
+//----------------------------------------------------------------------
+
+bool
+ThreadedCode::IsBranch(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BGEZ: case OP_BGEZAL: case OP_BGTZ:
+      case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL: case OP_BNE:
+      case OP_J: case OP_JAL: case OP_JALR: case OP_JR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadedCode::Run
+// 	Run the basic block at the PC, translating it first if need be,
+//	but no more than "limit" instructions of it, as an interrupt may
+//	be due after that.  Return the number of instructions run,
+//	counting one that raised an exception (which the kernel has
+//	handled by now); or 0 if the interpreter must run the next
+//	instruction, because it is in a delay slot or has no routine.
+//
+//	The time each instruction takes is counted here as the next one
+//	starts, as OneTick would, since no interrupt can be due then;
+//	the caller's OneTick counts the last one.
+//----------------------------------------------------------------------
+
+int
+ThreadedCode::Run(Machine *m, int limit)
+{
+    Statistics *stats = kernel->stats;
+    int *registers = m->registers;
+    int physicalAddress;
+    ExceptionType exception;
+    Block *block;
+    BlockStep step;
+
+    if (registers[NextPCReg] != registers[PCReg] + 4)
+	return 0;
+    exception = m->Translate(registers[PCReg], &physicalAddress, 4, FALSE);
+    if (exception != NoException) {
+	m->RaiseException(exception, registers[PCReg]);
+	return 1;
+    }
+    block = Find(m, physicalAddress);
+    if (limit > block->length)
+	limit = block->length;
+    for (int i = 0; i < limit; i++) {
+	if (i > 0) {
+	    stats->totalTicks += UserTick;
+	    stats->userTicks += UserTick;
+	}
+	step.pcAfter = registers[NextPCReg] + 4;
+	step.loadReg = 0;
+	step.loadValue = 0;
+	if (!(*block->routine[i])(m, registers, &block->instr[i], &step))
+	    return i + 1;	// the block may be gone by now
+	m->DelayedLoad(step.loadReg, step.loadValue);
+	registers[PrevPCReg] = registers[PCReg];
+	registers[PCReg] = registers[NextPCReg];
+	registers[NextPCReg] = step.pcAfter;
+    }
+    return limit;
+}
+
+//----------------------------------------------------------------------
+// ThreadedCode::Find
+// 	Return the block starting at "physicalAddress", translating it
+//	again if memory no longer holds what it was translated from.
+//----------------------------------------------------------------------
+
+Block *
+ThreadedCode::Find(Machine *m, int physicalAddress)
+{
+    Block *block = blockCache[physicalAddress / 4];
+    unsigned int *word = (unsigned int *) &m->mainMemory[physicalAddress];
+
+    if (block == NULL) {
+	block = new Block;
+	blockCache[physicalAddress / 4] = block;
+	Translate(m, block, physicalAddress);
+	return block;
+    }
+    for (int i = 0; i < block->words; i++)
+	if ((unsigned int) WordToHost(word[i]) != block->instr[i].value) {
+	    Translate(m, block, physicalAddress);
+	    break;
+	}
+    return block;
+}
+
+//----------------------------------------------------------------------
+// ThreadedCode::Translate
+// 	Decode the instructions from "physicalAddress" on into "block",
+//	up to the end of the page or MaxBlockLength instructions, the delay
+//	slot of a branch, or an instruction with no routine.
+//----------------------------------------------------------------------
+
+void
+ThreadedCode::Translate(Machine *m, Block *block, int physicalAddress)
+{
+    unsigned int *word = (unsigned int *) &m->mainMemory[physicalAddress];
+    int words = min((PageSize - physicalAddress % PageSize) / 4,
+		    MaxBlockLength);
+    bool delaySlot = FALSE;
+
+    block->length = block->words = 0;
+    for (int i = 0; i < words; i++) {
+	Instruction *instr = &block->instr[i];
+
+	instr->value = WordToHost(word[i]);
+	instr->Decode();
+	block->words++;
+	block->routine[i] = RoutineFor(instr->opCode);
+	if (block->routine[i] == NULL ||
+	    (delaySlot && IsBranch(instr->opCode)))	// left to the
+	    break;					// interpreter
+	block->length++;
+	if (delaySlot)
+	    break;
+	delaySlot = IsBranch(instr->opCode);
+    }
+}
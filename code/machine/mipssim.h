@@ -51,9 +51,11 @@
 #define OP_LW		27
 #define OP_LWL		28
 #define OP_LWR		29
+#define OP_LL		30
 
 #define OP_MFHI		31
 #define OP_MFLO		32
+#define OP_SC		33
 
 #define OP_MTHI		34
 #define OP_MTLO		35
@@ -127,9 +129,9 @@ static OpInfo opTable[] = {
     {OP_LBU, IFMT}, {OP_LHU, IFMT}, {OP_LWR, IFMT}, {OP_RES, IFMT},
     {OP_SB, IFMT}, {OP_SH, IFMT}, {OP_SWL, IFMT}, {OP_SW, IFMT},
     {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_SWR, IFMT}, {OP_RES, IFMT},
-    {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
+    {OP_LL, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
     {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT},
-    {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
+    {OP_SC, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
     {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}
 };
 
@@ -190,10 +192,10 @@ static struct OpString opStrings[] = {
 	{"LW r%d,%d(r%d)", {RT, EXTRA, RS}},
 	{"LWL r%d,%d(r%d)", {RT, EXTRA, RS}},
 	{"LWR r%d,%d(r%d)", {RT, EXTRA, RS}},
-	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"LL r%d,%d(r%d)", {RT, EXTRA, RS}},
 	{"MFHI r%d", {RD, NONE, NONE}},
 	{"MFLO r%d", {RD, NONE, NONE}},
-	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"SC r%d,%d(r%d)", {RT, EXTRA, RS}},
 	{"MTHI r%d", {RS, NONE, NONE}},
 	{"MTLO r%d", {RS, NONE, NONE}},
 	{"MULT r%d,r%d", {RS, RT, NONE}},
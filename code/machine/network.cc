@@ -1,6 +1,8 @@
 // network.cc 
 //	Routines to simulate a network interface, using UNIX sockets
-//	to deliver packets between multiple invocations of nachos.
+//	to deliver packets between multiple invocations of nachos --
+//	or a wire in memory, between the machines of a cluster in one
+//	(see cluster.h).
 //
 //  DO NOT CHANGE -- part of the machine emulation
 //
@@ -11,26 +13,75 @@
 #include "copyright.h"
 #include "network.h"
 #include "main.h"
+#include "replay.h"
+#include "cluster.h"
+
+//-----------------------------------------------------------------------
+// PacketSignalled
+// 	The host's signal handler, for packets arriving when the host
+//	signals them: just note the signal (see Interrupt::WatchHost).
+//-----------------------------------------------------------------------
+
+static void
+PacketSignalled(int sig)
+{
+    Interrupt::HostSignalled();
+}
+
+//-----------------------------------------------------------------------
+// ArrivesSooner
+// 	Compare two packets on the wire, by when they arrive.
+//-----------------------------------------------------------------------
+
+static int
+ArrivesSooner(WirePacket *x, WirePacket *y)
+{
+    return x->arrives - y->arrives;
+}
 
 //-----------------------------------------------------------------------
 // NetworkInput::NetworkInput
-// 	Initialize the simulation for the network input
+// 	Initialize the simulation for the network input.  In a cluster,
+//	the network is a wire in memory, and packets are not polled for:
+//	each is read in as it arrives.
 //
 //   	"toCall" is the interrupt handler to call when packet arrives
+//	"signalled" is TRUE to have the host signal packets as they
+//		arrive, and read each in then, rather than poll the socket
+//		every NetworkTime ticks -- a host system call each time,
+//		whether anything is arriving or not
 //-----------------------------------------------------------------------
 
-NetworkInput::NetworkInput(CallBackObj *toCall)
+NetworkInput::NetworkInput(CallBackObj *toCall, bool signalled)
 {
     // set up the stuff to emulate asynchronous interrupts
     callWhenAvail = toCall;
     packetAvail = FALSE;
     inHdr.length = 0;
+    this->signalled = signalled;
+    receiveScheduled = FALSE;
+    onWire = NULL;
+
+    if (cluster != NULL) {
+	this->signalled = FALSE;
+	onWire = new SortedList<WirePacket *>(ArrivesSooner);
+	sock = -1;
+	cluster->Connect(this);
+	return;
+    }
     
     sock = OpenSocket();
     sprintf(sockName, "SOCKET_%d", kernel->hostName);
     AssignNameToSocket(sockName, sock);		 // Bind socket to a filename 
 						 // in the current directory.
 
+    if (signalled) {
+	kernel->interrupt->WatchHost(this);
+	CallOnSocketInput(sock, PacketSignalled);
+	if (PollSocket(sock))		// sent before the signals were on
+	    ScheduleReceive();
+	return;
+    }
     // start polling for incoming packets
     kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
 }
@@ -43,6 +94,14 @@ NetworkInput::NetworkInput(CallBackObj *toCall)
 
 NetworkInput::~NetworkInput()
 {
+    if (onWire != NULL) {
+	while (!onWire->IsEmpty())
+	    delete onWire->RemoveFront();
+	delete onWire;
+	return;
+    }
+    if (signalled)
+	CallOnSocketInput(sock, NULL);
     CloseSocket(sock);
     DeAssignNameToSocket(sockName);
 }
@@ -60,17 +119,34 @@ NetworkInput::~NetworkInput()
 void
 NetworkInput::CallBack()
 {
-    // schedule the next time to poll for a packet
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
+    if (signalled)		// the next is scheduled as it comes
+	receiveScheduled = FALSE;
+    else if (onWire == NULL)	// schedule the next time to poll for a packet
+	kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
 
     if (inHdr.length != 0) 	// do nothing if packet is already buffered
 	return;		
-    if (!PollSocket(sock)) 	// do nothing if no packet to be read
-	return;
-
-    // otherwise, read packet in
+    // read a packet in, if one is there (or, when replaying, was)
     char *buffer = new char[MaxWireSize];
-    ReadFromSocket(sock, buffer, MaxWireSize);
+    if (onWire != NULL) {
+	if (onWire->IsEmpty() ||
+		onWire->Front()->arrives > kernel->stats->totalTicks) {
+	    delete [] buffer;	// read in already, or still coming
+	    return;
+	}
+	WirePacket *packet = onWire->RemoveFront();
+	bcopy(packet->data, buffer, MaxWireSize);
+	delete packet;
+    } else if (kernel->replay != NULL) {
+	if (!kernel->replay->ReadPacket(sock, buffer, MaxWireSize)) {
+	    delete [] buffer;
+	    return;
+	}
+    } else if (!PollSocket(sock)) { 	// do nothing if no packet to be read
+	delete [] buffer;
+	return;
+    } else
+	ReadFromSocket(sock, buffer, MaxWireSize);
 
     // divide packet into header and data
     inHdr = *(PacketHeader *)buffer;
@@ -80,6 +156,7 @@ NetworkInput::CallBack()
 
     DEBUG(dbgNet, "Network received packet from " << inHdr.from << ", length " << inHdr.length);
     kernel->stats->numPacketsRecvd++;
+    kernel->stats->numBytesRecvd += inHdr.length;
 
     // tell post office that the packet has arrived
     callWhenAvail->CallBack();
@@ -87,7 +164,9 @@ NetworkInput::CallBack()
 
 //-----------------------------------------------------------------------
 // NetworkInput::Receive
-// 	Read a packet, if one is buffered
+// 	Read a packet, if one is buffered.  When the host signals packets,
+//	any that came while it was buffered are now to be read in; so are
+//	those that came over the wire of a cluster, each as it arrives.
 //-----------------------------------------------------------------------
 
 PacketHeader
@@ -98,10 +177,84 @@ NetworkInput::Receive(char* data)
     inHdr.length = 0;
     if (hdr.length != 0) {
     	bcopy(inbox, data, hdr.length);
+	if (signalled && PollSocket(sock))
+	    ScheduleReceive();
+	else if (onWire != NULL && !onWire->IsEmpty())
+	    kernel->interrupt->Schedule(this, max(onWire->Front()->arrives -
+				kernel->stats->totalTicks, 1), NetworkRecvInt);
     }
     return hdr;
 }
 
+//-----------------------------------------------------------------------
+// NetworkInput::Arrive
+// 	Called by the cluster, as this machine, when another machine has
+//	sent us "packet" over the wire: keep it till "when", and have it
+//	read in then, unless one is still buffered (see Receive).  "when"
+//	may have just gone by; no machine gets far ahead of the others.
+//
+//	"packet" is the packet, header and all, MaxWireSize bytes
+//	"when" is when it arrives
+//-----------------------------------------------------------------------
+
+void
+NetworkInput::Arrive(char *packet, int when)
+{
+    WirePacket *coming = new WirePacket;
+
+    ASSERT(onWire != NULL);
+    coming->arrives = when;
+    bcopy(packet, coming->data, MaxWireSize);
+    onWire->Insert(coming);
+    kernel->interrupt->Schedule(this, max(when - kernel->stats->totalTicks, 1),
+				NetworkRecvInt);
+}
+
+//-----------------------------------------------------------------------
+// NetworkInput::InputArrived
+// 	Called when the host has signalled, as the simulation next checks
+//	for interrupts: schedule the packets to be read in, NetworkTime
+//	from now, as a poll would have found them.  If a packet is still
+//	buffered, the rest wait till it is taken (see Receive).
+//-----------------------------------------------------------------------
+
+void
+NetworkInput::InputArrived()
+{
+    if (inHdr.length == 0)
+	ScheduleReceive();
+}
+
+//-----------------------------------------------------------------------
+// NetworkInput::WaitForInput
+// 	Nothing at all is pending, so no thread can run till a packet
+//	arrives: sleep in the host till one does, instead of idling
+//	through poll after poll.
+//-----------------------------------------------------------------------
+
+void
+NetworkInput::WaitForInput()
+{
+    DEBUG(dbgNet, "Waiting for a packet");
+    WaitForSocket(sock);
+    InputArrived();
+}
+
+//-----------------------------------------------------------------------
+// NetworkInput::ScheduleReceive
+// 	Have CallBack read in a packet, NetworkTime from now, unless it
+//	is to already.
+//-----------------------------------------------------------------------
+
+void
+NetworkInput::ScheduleReceive()
+{
+    if (receiveScheduled)
+	return;
+    receiveScheduled = TRUE;
+    kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
+}
+
 //-----------------------------------------------------------------------
 // NetworkOutput::NetworkOutput
 // 	Initialize the simulation for sending network packets
@@ -119,7 +272,9 @@ NetworkOutput::NetworkOutput(double reliability, CallBackObj *toCall)
     // set up the stuff to emulate asynchronous interrupts
     callWhenDone = toCall;
     sendBusy = FALSE;
-    sock = OpenSocket();
+    sock = -1;
+    if (cluster == NULL)	// in a cluster, the wire is in memory
+	sock = OpenSocket();
 }
 
 //-----------------------------------------------------------------------
@@ -129,7 +284,8 @@ NetworkOutput::NetworkOutput(double reliability, CallBackObj *toCall)
 
 NetworkOutput::~NetworkOutput()
 {
-    CloseSocket(sock);
+    if (sock >= 0)
+	CloseSocket(sock);
 }
 
 //-----------------------------------------------------------------------
@@ -159,6 +315,7 @@ void
 NetworkOutput::Send(PacketHeader hdr, char* data)
 {
     char toName[32];
+    bool sent;
 
     sprintf(toName, "SOCKET_%d", (int)hdr.to);
     
@@ -167,9 +324,11 @@ NetworkOutput::Send(PacketHeader hdr, char* data)
     DEBUG(dbgNet, "Sending to addr " << hdr.to << ", length " << hdr.length);
 
     kernel->interrupt->Schedule(this, NetworkTime, NetworkSendInt);
+    kernel->stats->numBytesSent += hdr.length;
 
     if (RandomNumber() % 100 >= chanceToWork * 100) { // emulate a lost packet
 	DEBUG(dbgNet, "oops, lost it!");
+	kernel->stats->numPacketsDropped++;
 	return;
     }
 
@@ -177,6 +336,15 @@ NetworkOutput::Send(PacketHeader hdr, char* data)
     char *buffer = new char[MaxWireSize];
     *(PacketHeader *)buffer = hdr;
     bcopy(data, buffer + sizeof(PacketHeader), hdr.length);
-    SendToSocket(sock, buffer, MaxWireSize, toName);
+    if (cluster != NULL)
+	sent = cluster->Send(buffer, hdr.to);
+    else if (kernel->replay != NULL)
+	sent = kernel->replay->SendPacket(sock, buffer, MaxWireSize, toName);
+    else
+	sent = SendToSocket(sock, buffer, MaxWireSize, toName);
+    if (!sent) {
+	DEBUG(dbgNet, "no room at addr " << hdr.to << ", lost it!");
+	kernel->stats->numPacketsRefused++;
+    }
     delete [] buffer;
 }
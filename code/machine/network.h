@@ -18,6 +18,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "callback.h"
+#include "interrupt.h"
 
 // Network address -- uniquely identifies a machine.  This machine's ID 
 //  is given on the command line.
@@ -43,6 +44,15 @@ class PacketHeader {
 				// data "payload" of the largest packet
 
 
+// The following class defines a packet on its way over the wire between
+// the machines of a cluster (see Cluster), which is in memory.
+
+class WirePacket {
+  public:
+    int arrives;		// When it gets to the other end
+    char data[MaxWireSize];	// The packet, header and all
+};
+
 // The following two classes defines a physical network device.  The network
 // is capable of delivering fixed sized packets, in order but unreliably, 
 // to other machines connected to the network.
@@ -53,10 +63,13 @@ class PacketHeader {
 // generator, by changing the arguments to RandomInit() in Initialize().
 // The random number generator is used to choose which packets to drop.
 
-class NetworkInput : public CallBackObj{
+class NetworkInput : public CallBackObj, public HostInput {
   public:
-    NetworkInput(CallBackObj *toCall);
-				// Allocate and initialize network input driver
+    NetworkInput(CallBackObj *toCall, bool signalled = FALSE);
+				// Allocate and initialize network input
+				// driver; if "signalled", the host
+				// signals packets, instead of their
+				// being polled for
     ~NetworkInput();		// De-allocate the network input driver data
     
     PacketHeader Receive(char* data);
@@ -68,7 +81,15 @@ class NetworkInput : public CallBackObj{
 
     void CallBack();		// A packet may have arrived.
 
+    void InputArrived();	// The host signalled packets
+    void WaitForInput();	// Sleep till it has one
+
+    void Arrive(char *packet, int when);
+				// Another machine of the cluster has
+				// sent "packet", to arrive at "when"
+
   private:
+    void ScheduleReceive();	// Have CallBack read a packet in
     int sock;                   // UNIX socket number for incoming packets
     char sockName[32];          // File name corresponding to UNIX socket
 
@@ -78,6 +99,12 @@ class NetworkInput : public CallBackObj{
 				//   network
     PacketHeader inHdr;		// Information about arrived packet
     char inbox[MaxPacketSize];  // Data for arrived packet
+    bool signalled;		// Does the host signal packets?
+    bool receiveScheduled;	// If so, is a read in pending?
+    SortedList<WirePacket *> *onWire;
+				// Packets coming over the wire of a
+				// cluster, by when they arrive; NULL
+				// unless in one
 };
 
 class NetworkOutput : public CallBackObj {
@@ -0,0 +1,276 @@
+// profile.cc
+//	Routines of the sampling profiler of user programs.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "profile.h"
+#include "heap.h"
+
+//----------------------------------------------------------------------
+// SampleKey, SampleHash
+//	The key of a sample in the table, and its hash.
+//----------------------------------------------------------------------
+
+static int
+SampleKey(ProfileSample *sample)
+{
+    return sample->pc;
+}
+
+static unsigned
+SampleHash(int pc)
+{
+    return (unsigned) pc >> 2;	// instructions are word aligned
+}
+
+//----------------------------------------------------------------------
+// MoreSamples, MoreSymbolSamples
+//	Compare two samples, or two functions, so that those sampled
+//	most come first; then those at the lowest address.
+//----------------------------------------------------------------------
+
+static int
+MoreSamples(ProfileSample *x, ProfileSample *y)
+{
+    if (x->count != y->count)
+	return (x->count > y->count) ? -1 : 1;
+    return (x->pc < y->pc) ? -1 : (x->pc > y->pc);
+}
+
+static int
+MoreSymbolSamples(ProfileSymbol *x, ProfileSymbol *y)
+{
+    if (x->count != y->count)
+	return (x->count > y->count) ? -1 : 1;
+    return (x->address < y->address) ? -1 : (x->address > y->address);
+}
+
+//----------------------------------------------------------------------
+// Profile::Profile
+// 	Start counting, with no samples yet.
+//
+//	"interval" -- how many instructions run between samples
+//	"symbolFile" -- UNIX file of the output of "nm -n" on the COFF
+//		file the program was made from, or NULL
+//----------------------------------------------------------------------
+
+Profile::Profile(int interval, char *symbolFile)
+{
+    ASSERT(interval > 0);
+    this->interval = untilSample = interval;
+    numSamples = 0;
+    samples = new OpenHashTable<int, ProfileSample *>(SampleKey, SampleHash);
+    for (int i = 0; i < ProfileOpcodes; i++)
+	opCounts[i] = 0;
+    symbols = NULL;
+    numSymbols = 0;
+    if (symbolFile != NULL)
+	ReadSymbols(symbolFile);
+}
+
+//----------------------------------------------------------------------
+// Profile::~Profile
+// 	De-allocate the samples and the symbol table.
+//----------------------------------------------------------------------
+
+Profile::~Profile()
+{
+    int n = samples->NumInTable();
+    ProfileSample **all = new ProfileSample *[n];
+    OpenHashIterator<int, ProfileSample *> iter(samples);
+
+    for (int i = 0; !iter.IsDone(); iter.Next())
+	all[i++] = iter.Item();
+    for (int i = 0; i < n; i++) {
+	samples->Remove(all[i]->pc);
+	delete all[i];
+    }
+    delete [] all;
+    delete samples;
+    for (int i = 0; i < numSymbols; i++)
+	delete [] symbols[i].name;
+    delete [] symbols;
+}
+
+//----------------------------------------------------------------------
+// Profile::Sample
+// 	Count a sample at "pc", and start waiting for the next.
+//----------------------------------------------------------------------
+
+void
+Profile::Sample(int pc)
+{
+    ProfileSample *sample;
+
+    if (!samples->Find(pc, &sample)) {
+	sample = new ProfileSample;
+	sample->pc = pc;
+	sample->count = 0;
+	samples->Insert(sample);
+    }
+    sample->count++;
+    numSamples++;
+    untilSample = interval;
+}
+
+//----------------------------------------------------------------------
+// Profile::ReadSymbols
+// 	Read the functions -- the symbols of type "t" or "T" -- out of
+//	the lines "<hex address> <type> <name>" of "symbolFile", and
+//	sort them by address.  Other lines are skipped.
+//----------------------------------------------------------------------
+
+void
+Profile::ReadSymbols(char *symbolFile)
+{
+    int fd = OpenForReadWrite(symbolFile, TRUE);
+    int size = 0, room = 1024, n;
+    char *text = new char[room];
+
+    while ((n = ReadPartial(fd, text + size, room - size - 1)) > 0) {
+	size += n;
+	if (size == room - 1) {
+	    char *bigger = new char[2 * room];
+
+	    bcopy(text, bigger, size);
+	    delete [] text;
+	    text = bigger;
+	    room *= 2;
+	}
+    }
+    Close(fd);
+    text[size] = '\0';
+
+    int lines = 1;
+    for (int i = 0; i < size; i++)
+	if (text[i] == '\n')
+	    lines++;
+    symbols = new ProfileSymbol[lines];
+
+    for (char *line = text; line != NULL; ) {
+	char *end = strchr(line, '\n');
+	char *after;
+	unsigned address;
+
+	if (end != NULL)
+	    *end = '\0';
+	address = strtoul(line, &after, 16);
+	if (after != line && after[0] == ' ' &&
+	    (after[1] == 't' || after[1] == 'T') && after[2] == ' ') {
+	    ProfileSymbol *symbol = &symbols[numSymbols++];
+
+	    symbol->address = address;
+	    symbol->name = new char[strlen(after + 3) + 1];
+	    strcpy(symbol->name, after + 3);
+	    symbol->count = 0;
+	}
+	line = (end != NULL) ? end + 1 : NULL;
+    }
+    delete [] text;
+
+    for (int i = 1; i < numSymbols; i++) {	// "nm -n" sorts them
+	ProfileSymbol symbol = symbols[i];	// already, mostly
+	int j;
+
+	for (j = i; j > 0 && symbols[j - 1].address > symbol.address; j--)
+	    symbols[j] = symbols[j - 1];
+	symbols[j] = symbol;
+    }
+}
+
+//----------------------------------------------------------------------
+// Profile::SymbolAt
+// 	Return the function "pc" is in: the last to start at or before
+//	it; NULL if none does.
+//----------------------------------------------------------------------
+
+ProfileSymbol *
+Profile::SymbolAt(int pc)
+{
+    int low = 0, high = numSymbols;	// symbols[low..high-1] are left
+
+    while (low < high) {
+	int mid = (low + high) / 2;
+
+	if (symbols[mid].address <= pc)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+    return (low > 0) ? &symbols[low - 1] : NULL;
+}
+
+//----------------------------------------------------------------------
+// Profile::Print
+// 	Print the samples by function, if there is a symbol table, and
+//	the most sampled addresses; then how often each opcode was run.
+//----------------------------------------------------------------------
+
+void
+Profile::Print(char **opNames)
+{
+    Heap<ProfileSample *> bySamples(MoreSamples);
+    OpenHashIterator<int, ProfileSample *> iter(samples);
+    int total = max(numSamples, 1);
+
+    printf("Profile: %d samples, one every %d instructions\n", numSamples,
+	   interval);
+    for (; !iter.IsDone(); iter.Next()) {
+	ProfileSample *sample = iter.Item();
+	ProfileSymbol *symbol = SymbolAt(sample->pc);
+
+	if (symbol != NULL)
+	    symbol->count += sample->count;
+	bySamples.Insert(sample);
+    }
+
+    if (numSymbols > 0) {
+	Heap<ProfileSymbol *> byFunction(MoreSymbolSamples);
+
+	printf("Samples by function:\n");
+	for (int i = 0; i < numSymbols; i++)
+	    if (symbols[i].count > 0)
+		byFunction.Insert(&symbols[i]);
+	while (!byFunction.IsEmpty()) {
+	    ProfileSymbol *symbol = byFunction.RemoveFront();
+
+	    printf("  %8d %3d%%  %s\n", symbol->count,
+		   symbol->count * 100 / total, symbol->name);
+	}
+    }
+
+    printf("Samples by address:\n");
+    for (int i = 0; i < ProfileTop && !bySamples.IsEmpty(); i++) {
+	ProfileSample *sample = bySamples.RemoveFront();
+	ProfileSymbol *symbol = SymbolAt(sample->pc);
+
+	printf("  0x%08x %8d %3d%%", sample->pc, sample->count,
+	       sample->count * 100 / total);
+	if (symbol != NULL)
+	    printf("  %s+0x%x", symbol->name, sample->pc - symbol->address);
+	printf("\n");
+    }
+
+    int order[ProfileOpcodes];		// opcodes, most run first
+    int run = 0;
+
+    for (int i = 0; i < ProfileOpcodes; i++) {
+	int j;
+
+	for (j = i; j > 0 && opCounts[order[j - 1]] < opCounts[i]; j--)
+	    order[j] = order[j - 1];
+	order[j] = i;
+	run += opCounts[i];
+    }
+    printf("Opcodes run: %d instructions\n", run);
+    for (int i = 0; i < ProfileOpcodes && opCounts[order[i]] > 0; i++) {
+	int op = order[i];
+	int length = strcspn(opNames[op], " ");
+
+	printf("  %-8.*s %10d %3d%%\n", length, opNames[op], opCounts[op],
+	       (int) (opCounts[op] * 100.0 / max(run, 1)));
+    }
+}
@@ -0,0 +1,80 @@
+// profile.h
+//	Data structures for a sampling profiler of user programs.
+//
+//	Every user instruction run is counted by its opcode; and every
+//	"interval" instructions, the address of the one being run is
+//	counted too, as a sample.  At halt, the samples are printed
+//	by the function they fell in -- found from a symbol table in the
+//	format of "nm -n", made from a program's COFF file -- and by
+//	address, most first; then the opcodes, most run first.
+//
+//	Addresses are virtual, so the samples of several programs (or
+//	of a program and the code of Start) land on top of each other;
+//	profile one program at a time.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "copyright.h"
+#include "openhash.h"
+
+#define ProfileOpcodes	64	// one more than MaxOpcode in mipssim.h
+#define ProfileTop	20	// addresses printed, most sampled first
+
+// The following class defines the samples taken at one address.
+
+class ProfileSample {
+  public:
+    int pc;
+    int count;
+};
+
+// The following class defines a function of the symbol table.
+
+class ProfileSymbol {
+  public:
+    int address;		// where it starts
+    char *name;
+    int count;			// samples that fell in it
+};
+
+// The following class defines the profiler.
+
+class Profile {
+  public:
+    Profile(int interval, char *symbolFile);
+				// sample every "interval" instructions;
+				// name functions from "symbolFile", if
+				// not NULL
+    ~Profile();
+
+    void Count(int pc, int opCode) {	// the instruction at "pc" is
+	opCounts[opCode]++;		// being run
+	if (--untilSample == 0)
+	    Sample(pc);
+    }
+
+    void Print(char **opNames);	// print the results, with the name of
+				// each opcode at the start of its
+				// "opNames" entry
+
+  private:
+    int interval;		// instructions between samples
+    int untilSample;		// instructions until the next one
+    int numSamples;		// samples taken so far
+    OpenHashTable<int, ProfileSample *> *samples;	// by address
+    int opCounts[ProfileOpcodes];	// instructions run, by opcode
+
+    ProfileSymbol *symbols;	// the functions, by address
+    int numSymbols;
+
+    void Sample(int pc);	// take a sample
+    void ReadSymbols(char *symbolFile);	// fill in "symbols"
+    ProfileSymbol *SymbolAt(int pc);	// the function "pc" is in, or NULL
+};
+
+#endif // PROFILE_H
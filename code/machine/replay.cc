@@ -0,0 +1,488 @@
+// replay.cc
+//	Routines to record the inputs of a run to a log, and to replay
+//	them from it.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "replay.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ToHex, FromHex
+//	Write "n" bytes of "data" as 2n hex digits into "hex", with a
+//	'\0' after them; and read them back.  Return where "hex" ends.
+//----------------------------------------------------------------------
+
+static char *
+ToHex(char *data, int n, char *hex)
+{
+    for (int i = 0; i < n; i++, hex += 2)
+	sprintf(hex, "%02x", (unsigned char) data[i]);
+    *hex = '\0';
+    return hex;
+}
+
+static char *
+FromHex(char *hex, int n, char *data)
+{
+    for (int i = 0; i < n; i++, hex += 2) {
+	char digits[3] = { hex[0], hex[1], '\0' };
+
+	ASSERT(hex[0] != '\0' && hex[1] != '\0');
+	data[i] = (char) strtol(digits, NULL, 16);
+    }
+    return hex;
+}
+
+//----------------------------------------------------------------------
+// ReplayEvent::ReplayEvent
+// 	An event read from the log; "data", if not NULL, is now its own.
+//----------------------------------------------------------------------
+
+ReplayEvent::ReplayEvent(char kind, int tick, int value, int result,
+			 char *data)
+{
+    this->kind = kind;
+    this->tick = tick;
+    this->value = value;
+    this->result = result;
+    this->data = data;
+}
+
+ReplayEvent::~ReplayEvent()
+{
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// Replay::Replay
+// 	Start a log, or read one in to be replayed.
+//
+//	"fileName" -- the UNIX file of the log
+//	"replaying" -- replay the log, rather than record it?
+//	"argc", "argv" -- the command line, logged without the -record
+//		or -replay option, to be checked against when replaying
+//	"seed" -- the -rs seed, or -1 if there was none; when replaying,
+//		the logged one is used instead
+//----------------------------------------------------------------------
+
+Replay::Replay(char *fileName, bool replaying, int argc, char **argv,
+	       int seed)
+{
+    int length = 1;
+
+    for (int i = 1; i < argc; i++)
+	length += strlen(argv[i]) + 1;
+    args = new char[length];
+    args[0] = '\0';
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-record") == 0 ||
+	    strcmp(argv[i], "-replay") == 0) {
+	    i++;
+	    continue;
+	}
+	if (args[0] != '\0')
+	    strcat(args, " ");
+	strcat(args, argv[i]);
+    }
+
+    this->replaying = replaying;
+    pending = NULL;
+    numPending = 0;
+    console = new List<ReplayEvent *>;
+    consoleReads = new List<ReplayEvent *>;
+    packets = new List<ReplayEvent *>;
+    sends = new List<ReplayEvent *>;
+    syscalls = new List<ReplayEvent *>;
+    haltTick = -1;
+    numReplayed = numDiverged = 0;
+
+    if (replaying) {
+	fd = -1;
+	Load(fileName);
+    } else {
+	char line[40];
+
+	fd = OpenForWrite(fileName);
+	pending = new char[ReplayBufferSize];
+	Log("A ");
+	Log(args);
+	Log("\n");
+	if (seed >= 0) {
+	    sprintf(line, "S %d\n", seed);
+	    Log(line);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Replay::~Replay
+// 	Write out the rest of the log, and de-allocate the events not
+//	replayed.
+//----------------------------------------------------------------------
+
+Replay::~Replay()
+{
+    List<ReplayEvent *> *queues[] =
+	{ console, consoleReads, packets, sends, syscalls };
+
+    if (fd >= 0) {
+	Flush();
+	Close(fd);
+    }
+    for (int i = 0; i < 5; i++) {
+	while (!queues[i]->IsEmpty())
+	    delete queues[i]->RemoveFront();
+	delete queues[i];
+    }
+    delete [] pending;
+    delete [] args;
+}
+
+//----------------------------------------------------------------------
+// Replay::Log
+// 	Add "line" (or a piece of one) to the log, writing out the lines
+//	held so far when there is no room for it.
+//----------------------------------------------------------------------
+
+void
+Replay::Log(char *line)
+{
+    int length = strlen(line);
+
+    if (numPending + length > ReplayBufferSize)
+	Flush();
+    if (length > ReplayBufferSize) {
+	WriteFile(fd, line, length);
+	return;
+    }
+    bcopy(line, pending + numPending, length);
+    numPending += length;
+}
+
+//----------------------------------------------------------------------
+// Replay::Flush
+// 	Write out the lines held in "pending".
+//----------------------------------------------------------------------
+
+void
+Replay::Flush()
+{
+    if (numPending > 0)
+	WriteFile(fd, pending, numPending);
+    numPending = 0;
+}
+
+//----------------------------------------------------------------------
+// Replay::Load
+// 	Read the log to be replayed from "fileName" into the queues of
+//	events, in order.  Use the seed it holds, and warn if it was
+//	recorded with other arguments.
+//----------------------------------------------------------------------
+
+void
+Replay::Load(char *fileName)
+{
+    int logFd = OpenForReadWrite(fileName, TRUE);
+    int size = 0, room = ReplayBufferSize, n;
+    char *text = new char[room];
+
+    while ((n = ReadPartial(logFd, text + size, room - size - 1)) > 0) {
+	size += n;
+	if (size == room - 1) {
+	    char *bigger = new char[2 * room];
+
+	    bcopy(text, bigger, size);
+	    delete [] text;
+	    text = bigger;
+	    room *= 2;
+	}
+    }
+    Close(logFd);
+    text[size] = '\0';
+
+    for (char *line = text; line != NULL; ) {
+	char *end = strchr(line, '\n');
+	char *at = line + 1;
+	int tick, value = 0, result = 0;
+	char *data = NULL;
+
+	if (end != NULL)
+	    *end = '\0';
+	switch (line[0]) {
+	  case 'A':
+	    if (strcmp(line + min((int) strlen(line), 2), args) != 0)
+		printf("Replay: warning, recorded with arguments \"%s\"\n",
+		       line + 2);
+	    break;
+	  case 'S':
+	    RandomInit(atoi(line + 2));
+	    break;
+	  case 'C':
+	  case 'R':
+	    tick = strtol(at, &at, 10);
+	    value = strtol(at, &at, 10);
+	    (line[0] == 'C' ? console : sends)->Append(
+		new ReplayEvent(line[0], tick, value, 0, NULL));
+	    break;
+	  case 'K':
+	  case 'N':
+	    tick = strtol(at, &at, 10);
+	    value = strtol(at, &at, 10);
+	    data = new char[value];
+	    FromHex(at + 1, value, data);
+	    (line[0] == 'K' ? consoleReads : packets)->Append(
+		new ReplayEvent(line[0], tick, value, 0, data));
+	    break;
+	  case 'Y':
+	    tick = strtol(at, &at, 10);
+	    value = strtol(at, &at, 10);
+	    result = strtol(at, &at, 10);
+	    syscalls->Append(new ReplayEvent('Y', tick, value, result, NULL));
+	    break;
+	  case 'H':
+	    haltTick = atoi(at);
+	    break;
+	  case '\0':
+	    break;
+	  default:
+	    printf("Replay: skipping \"%s\" in %s\n", line, fileName);
+	}
+	line = (end != NULL) ? end + 1 : NULL;
+    }
+    delete [] text;
+}
+
+//----------------------------------------------------------------------
+// Replay::Next
+// 	Take the next event of "queue" off it, if it is due -- it was
+//	recorded at this tick, or (if the replay has gone its own way)
+//	before it.  Return NULL if it is not due yet.
+//----------------------------------------------------------------------
+
+ReplayEvent *
+Replay::Next(List<ReplayEvent *> *queue)
+{
+    ReplayEvent *e;
+
+    if (queue->IsEmpty() || queue->Front()->tick > kernel->stats->totalTicks)
+	return NULL;
+    e = queue->RemoveFront();
+    numReplayed++;
+    if (e->tick < kernel->stats->totalTicks)
+	Diverged("input came in late", e->tick);
+    return e;
+}
+
+//----------------------------------------------------------------------
+// Replay::Diverged
+// 	Count an event of the replay that is not as recorded -- the one
+//	recorded at "tick", or -1 if none was -- and describe the first.
+//----------------------------------------------------------------------
+
+void
+Replay::Diverged(char *what, int tick)
+{
+    if (numDiverged++ == 0)
+	printf("Replay: diverged at tick %d: %s (recorded at tick %d)\n",
+	       kernel->stats->totalTicks, what, tick);
+}
+
+//----------------------------------------------------------------------
+// Replay::ReadConsole
+// 	Read console input from "fd", as ReadPartial does: return how
+//	many characters were read into "into", at most "most", or 0 at
+//	the end of the input.  If "poll", only one is read, and only if
+//	it has come in; -1 if it has not.
+//
+//	When replaying, the input is the logged one instead, as it came
+//	in at this tick.
+//----------------------------------------------------------------------
+
+int
+Replay::ReadConsole(int fd, char *into, int most, bool poll)
+{
+    char line[40 + 2 * ReplayBufferSize];
+    ReplayEvent *e;
+    int n;
+
+    if (replaying) {
+	if (poll) {
+	    if ((e = Next(console)) == NULL)
+		return -1;
+	    n = (e->value >= 0);
+	    if (n > 0)
+		into[0] = (char) e->value;
+	} else {
+	    if (consoleReads->IsEmpty())
+		return 0;		// the end of the logged input
+	    e = consoleReads->RemoveFront();
+	    numReplayed++;
+	    if (e->tick != kernel->stats->totalTicks || e->value > most)
+		Diverged("console read", e->tick);
+	    n = min(e->value, most);
+	    bcopy(e->data, into, n);
+	}
+	delete e;
+	return n;
+    }
+
+    if (poll) {
+	ASSERT(most == 1);
+	if (!PollFile(fd))
+	    return -1;
+	n = ReadPartial(fd, into, 1);
+	sprintf(line, "C %d %d\n", kernel->stats->totalTicks,
+		(n > 0) ? (unsigned char) into[0] : -1);
+    } else {
+	n = ReadPartial(fd, into, min(most, ReplayBufferSize));
+	if (n < 0)
+	    return n;
+	ToHex(into, n, line + sprintf(line, "K %d %d ",
+				      kernel->stats->totalTicks, n));
+	strcat(line, "\n");
+    }
+    Log(line);
+    return n;
+}
+
+//----------------------------------------------------------------------
+// Replay::ReadPacket
+// 	Read a packet of "size" bytes from the socket "sock" into
+//	"buffer", if one has come in, as ReadFromSocket does.  Return
+//	TRUE if one was read.
+//
+//	When replaying, the packet is the logged one, if it came in at
+//	this tick; the socket is not looked at.
+//----------------------------------------------------------------------
+
+bool
+Replay::ReadPacket(int sock, char *buffer, int size)
+{
+    char *line;
+    ReplayEvent *e;
+
+    if (replaying) {
+	if ((e = Next(packets)) == NULL)
+	    return FALSE;
+	if (e->value != size)
+	    Diverged("packet of another size", e->tick);
+	bzero(buffer, size);
+	bcopy(e->data, buffer, min(e->value, size));
+	delete e;
+	return TRUE;
+    }
+
+    if (!PollSocket(sock))
+	return FALSE;
+    ReadFromSocket(sock, buffer, size);
+    line = new char[40 + 2 * size];
+    ToHex(buffer, size, line + sprintf(line, "N %d %d ",
+				       kernel->stats->totalTicks, size));
+    strcat(line, "\n");
+    Log(line);
+    delete [] line;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Replay::SendPacket
+// 	Send a packet to the socket named "toName", as SendToSocket
+//	does.  Return FALSE if it had no room for it.
+//
+//	When replaying, nothing is sent; whether it had room is as
+//	logged.
+//----------------------------------------------------------------------
+
+bool
+Replay::SendPacket(int sock, char *buffer, int size, char *toName)
+{
+    char line[40];
+    bool sent;
+
+    if (replaying) {
+	if (sends->IsEmpty()) {
+	    Diverged("packet sent", -1);
+	    return TRUE;
+	}
+	ReplayEvent *e = sends->RemoveFront();
+
+	numReplayed++;
+	if (e->tick != kernel->stats->totalTicks)
+	    Diverged("packet sent", e->tick);
+	sent = (e->value != 0);
+	delete e;
+	return sent;
+    }
+
+    sent = SendToSocket(sock, buffer, size, toName);
+    sprintf(line, "R %d %d\n", kernel->stats->totalTicks, sent ? 1 : 0);
+    Log(line);
+    return sent;
+}
+
+//----------------------------------------------------------------------
+// Replay::Syscall
+// 	System call "code" returned "result": log it, or, when replaying,
+//	check it against the log.
+//----------------------------------------------------------------------
+
+void
+Replay::Syscall(int code, int result)
+{
+    char line[80];
+
+    if (replaying) {
+	if (syscalls->IsEmpty()) {
+	    sprintf(line, "system call %d returned %d", code, result);
+	    Diverged(line, -1);
+	    return;
+	}
+	ReplayEvent *e = syscalls->RemoveFront();
+
+	numReplayed++;
+	if (e->tick != kernel->stats->totalTicks || e->value != code ||
+	    e->result != result) {
+	    sprintf(line, "system call %d returned %d, not %d %d", code,
+		    result, e->value, e->result);
+	    Diverged(line, e->tick);
+	}
+	delete e;
+	return;
+    }
+
+    sprintf(line, "Y %d %d %d\n", kernel->stats->totalTicks, code, result);
+    Log(line);
+}
+
+//----------------------------------------------------------------------
+// Replay::Halt
+// 	Nachos is halting.  End the log; or, when replaying, count the
+//	events that never came, and print how the replay went.
+//----------------------------------------------------------------------
+
+void
+Replay::Halt()
+{
+    char line[40];
+
+    if (!replaying) {
+	sprintf(line, "H %d\n", kernel->stats->totalTicks);
+	Log(line);
+	Flush();
+	return;
+    }
+    int left = console->NumInList() + consoleReads->NumInList() +
+	packets->NumInList() + sends->NumInList() + syscalls->NumInList();
+
+    if (left > 0)
+	Diverged("events never replayed", -1);
+    if (haltTick != kernel->stats->totalTicks)
+	Diverged("halted", haltTick);
+    printf("Replay: %d events replayed, %d left over, %d diverged; "
+	   "halted at tick %d, recorded %d\n", numReplayed, left,
+	   numDiverged, kernel->stats->totalTicks, haltTick);
+}
@@ -0,0 +1,110 @@
+// replay.h
+//	Data structures to record what a run of Nachos takes from outside
+//	the simulation, and to replay it.
+//
+//	Everything Nachos simulates is driven by the simulated clock, so
+//	a run goes the same way every time, except for its inputs from
+//	the host: the seed of the random number generator (-rs), when
+//	characters typed at the console come in, when packets come in
+//	from the other machines, and whether those had room for the
+//	packets sent to them.  Recording (-record) logs each of these,
+//	stamped with the tick it happened at.  Replaying (-replay) takes
+//	them from the log instead, at the same ticks, so that the run
+//	repeats the recorded one tick for tick -- with no one at the
+//	keyboard, and no other machines.
+//
+//	The result of every system call is logged too, and checked when
+//	replaying; the first one that differs, and the tick the two runs
+//	halted at, tell whether and where the replay went its own way.
+//	A replay has to start from a copy of the disks the recording
+//	started from, and be given the same arguments; they are logged as
+//	well, and a warning is printed if they differ.
+//
+//	The log is a text file of a line per event:
+//		A <arguments>		the command line, less -record
+//		S <seed>		the -rs seed, if there was one
+//		C <tick> <char>		a character typed; -1 for the end
+//		K <tick> <n> <hex>	"n" characters read from a console
+//					file at once (see GetChars)
+//		N <tick> <n> <hex>	a packet received, as it came in
+//		R <tick> <sent>		whether a packet sent had room (1)
+//		Y <tick> <code> <result>	a system call returned
+//		H <tick>		Nachos halted
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "copyright.h"
+#include "list.h"
+
+#define ReplayBufferSize 4096	// bytes of the log written at once
+
+// The following class defines one event taken from the log.
+
+class ReplayEvent {
+  public:
+    ReplayEvent(char kind, int tick, int value, int result, char *data);
+    ~ReplayEvent();
+
+    char kind;			// the letter of its line, as above
+    int tick;			// when it happened
+    int value;			// the character, count of bytes, "sent"
+				// or system call code
+    int result;			// the result of a system call
+    char *data;			// the bytes of a K or N line, or NULL
+};
+
+// The following class defines the log, being written or replayed.
+
+class Replay {
+  public:
+    Replay(char *fileName, bool replaying, int argc, char **argv,
+	   int seed);		// record to, or replay from, "fileName" a
+				// run started with "argv" and -rs "seed"
+				// (-1 for none)
+    ~Replay();			// flush whatever is left to the log
+
+    bool IsReplaying() { return replaying; }
+
+    int ReadConsole(int fd, char *into, int most, bool poll);
+				// read console input from "fd" -- only if
+				// there is some to be had, if "poll" --
+				// like ReadPartial; -1 if there is none
+    bool ReadPacket(int sock, char *buffer, int size);
+				// read a packet from "sock", if one came in
+    bool SendPacket(int sock, char *buffer, int size, char *toName);
+				// send a packet, like SendToSocket
+    void Syscall(int code, int result);	// a system call returned
+    void Halt();		// Nachos is halting; end the log, or say
+				// how the replay went
+
+  private:
+    void Log(char *line);	// add a line to the log
+    void Flush();		// write out the lines held in "pending"
+    void Load(char *fileName);	// read the log into the queues
+    ReplayEvent *Next(List<ReplayEvent *> *queue);
+				// the next event of "queue" due by now,
+				// or NULL
+    void Diverged(char *what, int tick);	// the replay went its own way
+
+    bool replaying;		// replaying, rather than recording?
+    int fd;			// the log being written
+    char *pending;		// lines not written yet
+    int numPending;		// bytes of them
+
+    char *args;			// the command line, as logged
+    List<ReplayEvent *> *console;	// C events yet to come
+    List<ReplayEvent *> *consoleReads;	// K events
+    List<ReplayEvent *> *packets;	// N events
+    List<ReplayEvent *> *sends;		// R events
+    List<ReplayEvent *> *syscalls;	// Y events
+    int haltTick;		// the tick of the H event, -1 if none
+    int numReplayed;		// events taken from the log
+    int numDiverged;		// and those that did not match
+};
+
+#endif // REPLAY_H
@@ -11,6 +11,95 @@
 #include "debug.h"
 #include "stats.h"
 
+//----------------------------------------------------------------------
+// ThreadUsage::ThreadUsage
+// 	A thread has used nothing yet.
+//----------------------------------------------------------------------
+
+ThreadUsage::ThreadUsage()
+{
+    userTicks = systemTicks = readyTicks = blockedTicks = 0;
+    voluntarySwitches = involuntarySwitches = 0;
+}
+
+//----------------------------------------------------------------------
+// ThreadUsage::Add
+// 	Add the usage of "other" into this one.
+//----------------------------------------------------------------------
+
+void
+ThreadUsage::Add(ThreadUsage *other)
+{
+    userTicks += other->userTicks;
+    systemTicks += other->systemTicks;
+    readyTicks += other->readyTicks;
+    blockedTicks += other->blockedTicks;
+    voluntarySwitches += other->voluntarySwitches;
+    involuntarySwitches += other->involuntarySwitches;
+}
+
+//----------------------------------------------------------------------
+// MemoryUsage::MemoryUsage
+// 	An address space has done nothing yet.
+//----------------------------------------------------------------------
+
+MemoryUsage::MemoryUsage()
+{
+    for (int i = 0; i < NumFaultKinds; i++)
+	faults[i] = 0;
+    copyOnWrites = tlbMisses = evictions = writeBacks = 0;
+    workingSetSamples = workingSetPages = maxWorkingSet = 0;
+    maxPageTable = 0;
+}
+
+//----------------------------------------------------------------------
+// MemoryUsage::Add
+// 	Add the usage of "other" into this one.  The biggest working set,
+//	and page table, is the bigger of the two.
+//----------------------------------------------------------------------
+
+void
+MemoryUsage::Add(MemoryUsage *other)
+{
+    for (int i = 0; i < NumFaultKinds; i++)
+	faults[i] += other->faults[i];
+    copyOnWrites += other->copyOnWrites;
+    tlbMisses += other->tlbMisses;
+    evictions += other->evictions;
+    writeBacks += other->writeBacks;
+    workingSetSamples += other->workingSetSamples;
+    workingSetPages += other->workingSetPages;
+    maxWorkingSet = max(maxWorkingSet, other->maxWorkingSet);
+    maxPageTable = max(maxPageTable, other->maxPageTable);
+}
+
+//----------------------------------------------------------------------
+// MemoryUsage::Print
+// 	Print the page faults by kind, the other paging counts, and the
+//	mean and biggest working set, and the biggest page table, on two
+//	lines headed "title".
+//----------------------------------------------------------------------
+
+void
+MemoryUsage::Print(char *title)
+{
+    cout << title << " faults: code " << faults[CodeFault];
+    cout << ", data " << faults[DataFault];
+    cout << ", stack " << faults[StackFault];
+    cout << ", zero-fill " << faults[ZeroFault];
+    cout << ", swap-in " << faults[SwapFault];
+    cout << ", mapped " << faults[MappedFault];
+    cout << ", copy-on-write " << copyOnWrites << "\n";
+    cout << title << " paging: TLB misses " << tlbMisses;
+    cout << ", evictions " << evictions;
+    cout << ", writebacks " << writeBacks;
+    cout << "; working set mean "
+	 << workingSetPages / max(workingSetSamples, 1);
+    cout << ", max " << maxWorkingSet << " pages, samples "
+	 << workingSetSamples;
+    cout << "; page table max " << maxPageTable << " bytes\n";
+}
+
 //----------------------------------------------------------------------
 // Statistics::Statistics
 // 	Initialize performance metrics to zero, at system startup.
@@ -22,6 +111,175 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numBytesSent = numBytesRecvd = 0;
+    numPacketsDropped = numPacketsRefused = numRetransmits = 0;
+    for (int i = 0; i < NumAckLatencies; i++)
+	ackLatencies[i] = 0;
+    for (int i = 0; i < NumMailBoxStats; i++)
+	mailBoxDepths[i] = 0;
+    numPageEvictions = numPageOuts = 0;
+    numFileWriteBacks = numPageCacheHits = 0;
+    numSwapOuts = numSwapIns = numSwapInPages = 0;
+    numTLBHits = numTLBMisses = 0;
+    numReadAheadHits = numReadAheadMisses = 0;
+    numContextSwitches = 0;
+    for (int i = 0; i < NumReadyLengths; i++)
+	readyLengths[i] = 0;
+    hostStartTime = HostMicroseconds();
+    diskSeekTicks = diskRotationTicks = diskTransferTicks = 0;
+    numTrackBufferHits = diskQueueTicks = 0;
+    diskStallTicks = numFlashCleanings = numFlashCopies = 0;
+    for (int i = 0; i < NumDiskLatencies; i++)
+	diskLatencies[i] = diskQueueWaits[i] = 0;
+    for (int i = 0; i < NumTracks; i++)
+	trackAccesses[i] = 0;
+    for (int i = 0; i < NumFsOps; i++)
+	fsOps[i] = fsOpTicks[i] = 0;
+    numLookupComponents = numUserBytesRead = numUserBytesWritten = 0;
+    numSectorsDeduplicated = 0;
+}
+
+//----------------------------------------------------------------------
+// Bucket
+// 	Return the bucket of a histogram of "n" buckets that "ticks"
+//	goes in: the first for under "unit", the next for under 4 times
+//	that, under 16 times, and so on; the last for the rest.
+//----------------------------------------------------------------------
+
+static int
+Bucket(int ticks, int unit, int n)
+{
+    int i = 0;
+
+    for (int limit = unit; ticks >= limit && i < n - 1; limit *= 4)
+	i++;
+    return i;
+}
+
+//----------------------------------------------------------------------
+// PrintBuckets
+// 	Print the "n" buckets of a histogram filled by Bucket, after
+//	"title".
+//----------------------------------------------------------------------
+
+static void
+PrintBuckets(const char *title, int *buckets, int n)
+{
+    cout << title;
+    for (int i = 0, limit = 1; i < n; i++, limit *= 4) {
+	if (i < n - 1)
+	    cout << " <" << limit;
+	else
+	    cout << " " << limit / 4 << "+";
+	cout << " " << buckets[i];
+    }
+    cout << "\n";
+}
+
+//----------------------------------------------------------------------
+// Statistics::AddAckLatency
+// 	Count a segment acknowledged "ticks" after it was sent, in the
+//	bucket for under NetworkTime, under 4 times that, under 16 times,
+//	and so on.
+//----------------------------------------------------------------------
+
+void
+Statistics::AddAckLatency(int ticks)
+{
+    ackLatencies[Bucket(ticks, NetworkTime, NumAckLatencies)]++;
+}
+
+//----------------------------------------------------------------------
+// Statistics::AddDiskRequest
+// 	Count a disk request that spent "parts" seeking, rotating,
+//	transferring and stalling, and touched tracks "firstTrack" to "lastTrack".
+//	The tracks of a disk with more than NumTracks of them are counted
+//	in NumTracks equal parts of it.
+//----------------------------------------------------------------------
+
+void
+Statistics::AddDiskRequest(DiskLatency *parts, int firstTrack, int lastTrack,
+			   int numTracks)
+{
+    int last = -1;
+
+    diskSeekTicks += parts->seek;
+    diskRotationTicks += parts->rotation;
+    diskTransferTicks += parts->transfer;
+    diskStallTicks += parts->stall;
+    if (parts->trackBuffer)
+	numTrackBufferHits++;
+    diskLatencies[Bucket(parts->seek + parts->rotation + parts->transfer +
+			 parts->stall,
+			 RotationTime, NumDiskLatencies)]++;
+    for (int t = firstTrack; t <= lastTrack; t++) {
+	int part = (numTracks <= NumTracks) ? t : t * NumTracks / numTracks;
+
+	if (part != last)
+	    trackAccesses[part]++;
+	last = part;
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::AddDiskWait
+// 	Count a disk request that waited "ticks" in the queue before it
+//	was sent to the disk.
+//----------------------------------------------------------------------
+
+void
+Statistics::AddDiskWait(int ticks)
+{
+    diskQueueTicks += ticks;
+    diskQueueWaits[Bucket(ticks, RotationTime, NumDiskLatencies)]++;
+}
+
+//----------------------------------------------------------------------
+// Statistics::AddFsOp
+// 	Count a file system operation "op", which started at "startTicks"
+//	and has just finished.
+//----------------------------------------------------------------------
+
+void
+Statistics::AddFsOp(FsOp op, int startTicks)
+{
+    fsOps[op]++;
+    fsOpTicks[op] += totalTicks - startTicks;
+}
+
+//----------------------------------------------------------------------
+// Statistics::Snapshot
+// 	Copy the counts a program may watch as it runs, with GetStats (or
+//	the kernel, with -statlog), into "into".
+//----------------------------------------------------------------------
+
+void
+Statistics::Snapshot(StatsSnapshot *into)
+{
+    into->version = StatsVersion;
+    into->size = sizeof(StatsSnapshot);
+    into->totalTicks = totalTicks;
+    into->idleTicks = idleTicks;
+    into->systemTicks = systemTicks;
+    into->userTicks = userTicks;
+    into->diskReads = numDiskReads;
+    into->diskWrites = numDiskWrites;
+    into->consoleCharsRead = numConsoleCharsRead;
+    into->consoleCharsWritten = numConsoleCharsWritten;
+    into->pageFaults = numPageFaults;
+    into->pageEvictions = numPageEvictions;
+    into->pageOuts = numPageOuts;
+    into->tlbHits = numTLBHits;
+    into->tlbMisses = numTLBMisses;
+    into->packetsSent = numPacketsSent;
+    into->packetsRecvd = numPacketsRecvd;
+    into->contextSwitches = numContextSwitches;
+    into->fsOps = 0;
+    for (int i = 0; i < NumFsOps; i++)
+	if (i != FsLookup)
+	    into->fsOps += fsOps[i];
+    into->userBytesRead = numUserBytesRead;
+    into->userBytesWritten = numUserBytesWritten;
 }
 
 //----------------------------------------------------------------------
@@ -35,11 +293,76 @@ Statistics::Print()
 {
     cout << "Ticks: total " << totalTicks << ", idle " << idleTicks;
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
+    cout << "Host time: " << (HostMicroseconds() - hostStartTime) / 1000
+	 << " ms\n";
     cout << "Disk I/O: reads " << numDiskReads;
 		cout << ", writes " << numDiskWrites << "\n";
+    if (numDiskReads > 0 || numDiskWrites > 0) {
+	cout << "Disk time: seek " << diskSeekTicks;
+	cout << ", rotation " << diskRotationTicks;
+	cout << ", transfer " << diskTransferTicks;
+	cout << ", queued " << diskQueueTicks << "\n";
+	cout << "Disk track buffer: hits " << numTrackBufferHits << "\n";
+	if (numFlashCleanings > 0) {
+	    cout << "Disk cleaning: blocks " << numFlashCleanings;
+	    cout << ", pages copied " << numFlashCopies;
+	    cout << ", stall ticks " << diskStallTicks << "\n";
+	}
+	PrintBuckets("Disk latency, in RotationTimes:", diskLatencies,
+		     NumDiskLatencies);
+	PrintBuckets("Disk queue wait, in RotationTimes:", diskQueueWaits,
+		     NumDiskLatencies);
+	cout << "Disk track accesses:";
+	for (int i = 0; i < NumTracks; i++)
+	    cout << " " << trackAccesses[i];
+	cout << "\n";
+    }
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
-    cout << "Paging: faults " << numPageFaults << "\n";
+    cout << "Paging: faults " << numPageFaults;
+		cout << ", evictions " << numPageEvictions;
+		cout << ", writebacks " << numPageOuts << "\n";
+    if (numPageCacheHits > 0 || numFileWriteBacks > 0) {
+	cout << "Page cache: reads hit " << numPageCacheHits;
+	cout << ", pages written back " << numFileWriteBacks << "\n";
+    }
+    if (numSwapOuts > 0) {
+	cout << "Swapping: programs out " << numSwapOuts;
+	cout << ", in " << numSwapIns;
+	cout << ", pages read back " << numSwapInPages << "\n";
+    }
+    memoryUsage.Print("Memory");
+    cout << "TLB: hits " << numTLBHits;
+		cout << ", misses " << numTLBMisses << "\n";
     cout << "Network I/O: packets received " << numPacketsRecvd;
 		cout << ", sent " << numPacketsSent << "\n";
+    if (numPacketsRecvd > 0 || numPacketsSent > 0) {
+	cout << "Network bytes: received " << numBytesRecvd;
+	cout << ", sent " << numBytesSent << "\n";
+	cout << "Network losses: dropped " << numPacketsDropped;
+	cout << ", refused " << numPacketsRefused;
+	cout << ", retransmitted " << numRetransmits << "\n";
+	PrintBuckets("Ack latency, in NetworkTimes:", ackLatencies,
+		     NumAckLatencies);
+	cout << "Mailbox depth:";
+	for (int i = 0; i < NumMailBoxStats; i++)
+	    if (mailBoxDepths[i] > 0)
+		cout << " " << i << " " << mailBoxDepths[i];
+	cout << "\n";
+    }
+    cout << "Read-ahead: hits " << numReadAheadHits;
+		cout << ", misses " << numReadAheadMisses << "\n";
+    cout << "Threads: context switches " << numContextSwitches << "\n";
+    cout << "Thread usage: user " << threadUsage.userTicks;
+		cout << ", system " << threadUsage.systemTicks;
+		cout << ", ready " << threadUsage.readyTicks;
+		cout << ", blocked " << threadUsage.blockedTicks << "\n";
+    cout << "Thread switches: voluntary " << threadUsage.voluntarySwitches;
+		cout << ", involuntary " << threadUsage.involuntarySwitches << "\n";
+    cout << "Ready list length:";
+    for (int i = 0; i < NumReadyLengths; i++) {
+	cout << " " << i << (i == NumReadyLengths - 1 ? "+" : "");
+	cout << " " << readyLengths[i];
+    }
+    cout << "\n";
 }
@@ -12,6 +12,81 @@
 #define STATS_H
 
 #include "copyright.h"
+#include "disk.h"
+#include "syscall.h"
+
+// What one thread has had of the CPU, and how long it has waited for
+// it -- kept by the thread (see Thread::setStatus and Scheduler::Run),
+// and summed over the threads that have gone.
+
+class ThreadUsage {
+  public:
+    int userTicks;		// time running user code
+    int systemTicks;		// time running kernel code
+    int readyTicks;		// time on the ready list
+    int blockedTicks;		// time waiting for something else
+    int voluntarySwitches;	// times it gave up the CPU to wait
+    int involuntarySwitches;	// times it was switched out while it
+				// could still run (time slices,
+				// preemption, Yield)
+
+    ThreadUsage();		// initialize everything to zero
+
+    void Add(ThreadUsage *other);	// add in another's usage
+};
+
+// The kinds of page fault, by what the page is filled with.
+
+enum FaultKind {
+    CodeFault,			// code or read-only data, from the executable
+    DataFault,			// initialized data, from the executable
+    StackFault,			// the stack, zeroed
+    ZeroFault,			// uninitialized data, zeroed
+    SwapFault,			// anything, read back from swap
+    MappedFault,		// a page of a mapped file, from the file
+    NumFaultKinds
+};
+
+// What one address space has done in memory -- kept by the address
+// space (see addrspace.h), and summed over those that have gone.
+
+class MemoryUsage {
+  public:
+    int faults[NumFaultKinds];	// page faults, by kind
+    int copyOnWrites;		// writes to shared pages, copied
+    int tlbMisses;		// TLB misses, page faults included
+    int evictions;		// its pages whose frames were taken back
+    int writeBacks;		// and that were written to swap (or to
+				// their mapped file) then
+    int workingSetSamples;	// working sets taken (see AddrSpace::
+				// SampleWorkingSet)
+    int workingSetPages;	// their pages, summed
+    int maxWorkingSet;		// pages in the biggest
+    int maxPageTable;		// most bytes its page table took
+
+    MemoryUsage();		// initialize everything to zero
+
+    void Add(MemoryUsage *other);	// add in another's usage
+    void Print(char *title);	// print it, on a line headed "title"
+};
+
+#define NumReadyLengths	8	// buckets of the ready list length
+				// histogram; the last is "or more"
+#define NumAckLatencies	8	// buckets of the send-to-ack latency
+				// histogram: under 1, 4, 16, ... times
+				// NetworkTime; the last is "or more"
+#define NumMailBoxStats	16	// mailboxes whose depth is kept
+#define NumDiskLatencies 8	// buckets of the disk request latency and
+				// queue wait histograms: under 1, 4, 16,
+				// ... times RotationTime; the last is
+				// "or more"
+
+// The file system operations counted, and timed, by Statistics.  The
+// time of an operation includes that of the others it does (an Open
+// does a lookup), and its waits for the disk.
+
+enum FsOp { FsCreate, FsOpen, FsRead, FsWrite, FsRemove, FsLookup,
+	    NumFsOps };
 
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
@@ -33,11 +108,79 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPageEvictions;	// number of frames taken back from pages
+    int numPageOuts;		// number of pages written to swap
+    int numFileWriteBacks;	// pages of mapped files written back
+    int numPageCacheHits;	// file reads copied wholly from frames
+    int numSwapOuts;		// programs swapped out whole (-ms)
+    int numSwapIns;		// and back in
+    int numSwapInPages;		// pages read back in with them
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numBytesSent;		// bytes in the packets sent
+    int numBytesRecvd;		// and received
+    int numPacketsDropped;	// sent packets lost, by the reliability
+				// setting
+    int numPacketsRefused;	// sent packets lost, as the receiver had
+				// no room for them
+    int numRetransmits;		// segments the transport sent again
+    int ackLatencies[NumAckLatencies];	// segments acked, by the time
+				// since they first went out
+    int mailBoxDepths[NumMailBoxStats];	// most mails waiting in each
+				// mailbox at once
+    int numTLBHits;		// number of translations found in the TLB
+    int numTLBMisses;		// and not found there
+    int numReadAheadHits;	// sequential file reads of a sector that
+				// was already being read ahead
+    int numReadAheadMisses;	// sequential file reads of a sector that
+				// was not
+    int numContextSwitches;	// times the CPU went to another thread
+    int readyLengths[NumReadyLengths];	// context switches that left
+				// this many threads on the ready list
+    ThreadUsage threadUsage;	// summed over the threads deleted
+    MemoryUsage memoryUsage;	// summed over the address spaces deleted
+    unsigned int hostStartTime;	// HostMicroseconds() at startup, to
+				// tell the wall-clock time taken
+    int diskSeekTicks;		// time disk requests spent seeking,
+    int diskRotationTicks;	// waiting for the sector to come round,
+    int diskTransferTicks;	// and moving the data
+    int numTrackBufferHits;	// requests started from the track buffer
+    int diskStallTicks;		// time writes waited for flash blocks
+				// to be cleaned (see diskmodel.h)
+    int numFlashCleanings;	// flash blocks cleaned
+    int numFlashCopies;		// and the live pages copied to do it
+    int diskLatencies[NumDiskLatencies];	// disk requests, by the
+				// time they took
+    int diskQueueTicks;		// time requests waited for the disk
+    int diskQueueWaits[NumDiskLatencies];	// requests, by the time
+				// they waited
+    int trackAccesses[NumTracks];	// requests touching each track, or
+				// each NumTracks'th of a larger disk
+    int fsOps[NumFsOps];	// file system operations, by FsOp
+    int fsOpTicks[NumFsOps];	// and the time they took
+    int numLookupComponents;	// path names searched for in directories
+    int numUserBytesRead;	// bytes user programs read from files
+    int numUserBytesWritten;	// and wrote to them
+    int numSectorsDeduplicated;	// sectors written by sharing a copy
+				// already on disk (see FileSystem::
+				// StartDedup)
 
     Statistics(); 		// initialize everything to zero
 
+    void AddAckLatency(int ticks);	// a segment acked "ticks" after
+				// it was sent
+    void AddDiskRequest(DiskLatency *parts, int firstTrack, int lastTrack,
+			int numTracks);
+				// a disk request, spending "parts", on
+				// tracks "firstTrack" to "lastTrack" of
+				// a disk with "numTracks"
+    void AddDiskWait(int ticks);	// a request sent to the disk
+				// "ticks" after it was made
+    void AddFsOp(FsOp op, int startTicks);	// an "op" that started
+				// at "startTicks", and is done
+
+    void Snapshot(StatsSnapshot *into);	// copy the main counts, as
+				// GetStats returns them
     void Print();		// print collected statistics
 };
 
@@ -53,6 +196,9 @@ const int UserTick = 	   1;	// advance for each user-level instruction
 const int SystemTick =	  10; 	// advance each time interrupts are enabled
 const int RotationTime = 500; 	// time disk takes to rotate one sector
 const int SeekTime =	 500;  	// time disk takes to seek past one track
+const int FlashReadTime = 250;	// time a flash disk takes to read a sector
+const int FlashWriteTime = 1000; // to write one to a clean page
+const int FlashEraseTime = 10000; // and to erase a block of them
 const int ConsoleTime =	 100;	// time to read or write one character
 const int NetworkTime =	 100;  	// time to send or receive one packet
 const int TimerTicks = 	 100;  	// (average) time between timer interrupts
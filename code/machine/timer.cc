@@ -40,6 +40,8 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
     randomize = doRandom;
     callPeriodically = toCall;
     disable = FALSE;
+    stopped = FALSE;
+    scheduled = FALSE;
     SetInterrupt();
 }
 
@@ -52,6 +54,8 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
 void 
 Timer::CallBack() 
 {
+    scheduled = FALSE;
+
     // invoke the Nachos interrupt handler for this device
     callPeriodically->CallBack();
     
@@ -59,17 +63,33 @@ Timer::CallBack()
     			// decide if it wants to disable future interrupts
 }
 
+//----------------------------------------------------------------------
+// Timer::Start
+//      Have a stopped timer generate interrupts again -- unless one it
+//	generated before it stopped is still to come, which goes on as the
+//	first.  An interrupt cannot be taken back, so a timer stopped and
+//	started again before its last interrupt comes just goes on.
+//----------------------------------------------------------------------
+
+void
+Timer::Start()
+{
+    stopped = FALSE;
+    if (!scheduled)
+	SetInterrupt();
+}
+
 //----------------------------------------------------------------------
 // Timer::SetInterrupt
 //      Cause a timer interrupt to occur in the future, unless
-//	future interrupts have been disabled.  The delay is either
-//	fixed or random.
+//	future interrupts have been disabled, or the timer is stopped.
+//	The delay is either fixed or random.
 //----------------------------------------------------------------------
 
 void
 Timer::SetInterrupt() 
 {
-    if (!disable) {
+    if (!disable && !stopped) {
        int delay = TimerTicks;
     
        if (randomize) {
@@ -77,5 +97,6 @@ Timer::SetInterrupt()
         }
        // schedule the next timer device interrupt
        kernel->interrupt->Schedule(this, delay, TimerInt);
+       scheduled = TRUE;
     }
 }
@@ -35,12 +35,19 @@ class Timer : public CallBackObj {
     void Disable() { disable = TRUE; }
     				// Turn timer device off, so it doesn't
 				// generate any more interrupts.
+    void Stop() { stopped = TRUE; }
+				// Generate no interrupt after the next,
+				// till started again
+    void Start();		// Start generating interrupts again, the
+				// next TimerTicks from now
 
   private:
     bool randomize;		// set if we need to use a random timeout delay
     CallBackObj *callPeriodically; // call this every TimerTicks time units 
     bool disable;		// turn off the timer device after next
     				// interrupt.
+    bool stopped;		// stopped after the next, till Start?
+    bool scheduled;		// is an interrupt still to come?
     
     void CallBack();		// called internally when the hardware
 				// timer generates an interrupt
@@ -6,8 +6,10 @@
 //
 // Two types of translation are supported here.
 //
-//	Linear page table -- the virtual page # is used as an index
-//	into the table, to find the physical page #.
+//	Page table -- the virtual page # is used to find the entry, and
+//	so the physical page #, in the table: as an index into it, if it
+//	is linear; or into a directory, then into an array of entries, if
+//	it is two-level; or by hashing it, if it is hashed.
 //
 //	Translation lookaside buffer -- associative lookup in the table
 //	to find an entry with the same virtual page #.  If found,
@@ -32,42 +34,8 @@
 #include "copyright.h"
 #include "main.h"
 
-// Routines for converting Words and Short Words to and from the
-// simulated machine's format of little endian.  These end up
-// being NOPs when the host machine is also little endian (DEC and Intel).
-
-unsigned int
-WordToHost(unsigned int word) {
-#ifdef HOST_IS_BIG_ENDIAN
-	 register unsigned long result;
-	 result = (word >> 24) & 0x000000ff;
-	 result |= (word >> 8) & 0x0000ff00;
-	 result |= (word << 8) & 0x00ff0000;
-	 result |= (word << 24) & 0xff000000;
-	 return result;
-#else 
-	 return word;
-#endif /* HOST_IS_BIG_ENDIAN */
-}
-
-unsigned short
-ShortToHost(unsigned short shortword) {
-#ifdef HOST_IS_BIG_ENDIAN
-	 register unsigned short result;
-	 result = (shortword << 8) & 0xff00;
-	 result |= (shortword >> 8) & 0x00ff;
-	 return result;
-#else 
-	 return shortword;
-#endif /* HOST_IS_BIG_ENDIAN */
-}
-
-unsigned int
-WordToMachine(unsigned int word) { return WordToHost(word); }
-
-unsigned short
-ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
-
+// The routines for converting Words and Short Words to and from the
+// simulated machine's format of little endian are inline, in machine.h.
 
 //----------------------------------------------------------------------
 // Machine::ReadMem
@@ -88,7 +56,17 @@ Machine::ReadMem(int addr, int size, int *value)
     int data;
     ExceptionType exception;
     int physicalAddress;
-    
+    char *host = HostAddress(addr, size, FALSE);
+
+    if (host != NULL) {
+	switch (size) {
+	  case 1: *value = *host; break;
+	  case 2: *value = ShortToHost(*(unsigned short *) host); break;
+	  case 4: *value = WordToHost(*(unsigned int *) host); break;
+	  default: ASSERT(FALSE);
+	}
+	return TRUE;
+    }
     DEBUG(dbgAddr, "Reading VA " << addr << ", size " << size);
     
     exception = Translate(addr, &physicalAddress, size, FALSE);
@@ -137,7 +115,19 @@ Machine::WriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
-     
+    char *host = HostAddress(addr, size, TRUE);
+
+    if (host != NULL) {
+	switch (size) {
+	  case 1: *host = (unsigned char) (value & 0xff); break;
+	  case 2: *(unsigned short *) host =
+			ShortToMachine((unsigned short) (value & 0xffff)); break;
+	  case 4: *(unsigned int *) host = WordToMachine((unsigned int) value);
+		  break;
+	  default: ASSERT(FALSE);
+	}
+	return TRUE;
+    }
     DEBUG(dbgAddr, "Writing VA " << addr << ", size " << size << ", value " << value);
 
     exception = Translate(addr, &physicalAddress, size, TRUE);
@@ -166,6 +156,37 @@ Machine::WriteMem(int addr, int size, int value)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::HostAddress
+// 	Return where in "mainMemory" virtual address "virtAddr" is, if
+//	the page table has a translation for it that Translate would
+//	only use as it is -- valid, aligned, already marked used, and for
+//	a write, writable and already dirty; otherwise NULL, and the
+//	caller goes through Translate.
+//
+//	The page table entry itself is what is checked, so whatever the
+//	kernel changes in it (paging, copy on write, clearing use bits)
+//	is seen at once, and nothing needs to be flushed.  With a TLB
+//	(and so no page table), or when debugging translation, every
+//	access goes through Translate, to be counted and traced.
+//----------------------------------------------------------------------
+
+char *
+Machine::HostAddress(int virtAddr, int size, bool writing)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    TranslationEntry *entry;
+
+    if (pageTable == NULL || traceAddr || (virtAddr & (size - 1)) != 0)
+	return NULL;
+    entry = pageTable->Lookup(vpn);
+    if (entry == NULL || !entry->valid || !entry->use || !entry->referenced ||
+	    (writing && (entry->readOnly || !entry->dirty)))
+	return NULL;
+    return &mainMemory[entry->physicalPage * PageSize +
+		       (unsigned) virtAddr % PageSize];
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -205,27 +226,34 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     vpn = (unsigned) virtAddr / PageSize;
     offset = (unsigned) virtAddr % PageSize;
     
-    if (tlb == NULL) {		// => page table => vpn is index into table
-	if (vpn >= pageTableSize) {
+    if (tlb == NULL) {		// => page table => vpn finds the entry
+	entry = pageTable->Lookup(vpn);
+	if (vpn >= (unsigned) pageTable->NumPages()) {
 	    DEBUG(dbgAddr, "Illegal virtual page # " << virtAddr);
 	    return AddressErrorException;
-	} else if (!pageTable[vpn].valid) {
+	} else if (entry == NULL || !entry->valid) {
 	    DEBUG(dbgAddr, "Invalid virtual page # " << virtAddr);
+	    storeFault = writing;
 	    return PageFaultException;
 	}
-	entry = &pageTable[vpn];
-    } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
+    } else {			// => only the set "vpn" maps to is searched
+	int first = (vpn % (tlbSize / tlbWays)) * tlbWays;
+
+        for (entry = NULL, i = first; i < first + tlbWays; i++)
     	    if (tlb[i].valid && (tlb[i].virtualPage == ((int)vpn))) {
 		entry = &tlb[i];			// FOUND!
+		tlbLastUsed[i] = ++tlbAccesses;
 		break;
 	    }
 	if (entry == NULL) {				// not found
     	    DEBUG(dbgAddr, "Invalid TLB entry for this virtual page!");
+	    kernel->stats->numTLBMisses++;
+	    storeFault = writing;
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
 	}
+	kernel->stats->numTLBHits++;
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
@@ -236,11 +264,12 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 
     // if the pageFrame is too big, there is something really wrong! 
     // An invalid translation was loaded into the page table or TLB. 
-    if (pageFrame >= NumPhysPages) { 
+    if (pageFrame >= (unsigned) NumPhysPages) { 
 	DEBUG(dbgAddr, "Illegal pageframe " << pageFrame);
 	return BusErrorException;
     }
     entry->use = TRUE;		// set the use, dirty bits
+    entry->referenced = TRUE;
     if (writing)
 	entry->dirty = TRUE;
     *physAddr = pageFrame * PageSize + offset;
@@ -248,3 +277,285 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     DEBUG(dbgAddr, "phys addr = " << *physAddr);
     return NoException;
 }
+
+// The following class defines an entry of a hashed page table, in the
+// chain of its bucket.
+
+class HashedEntry {
+  public:
+    TranslationEntry entry;
+    int table;			// the id of the table it is in
+    HashedEntry *next;		// the next in the bucket
+};
+
+HashedEntry **PageTable::buckets = NULL;
+int PageTable::numBuckets = 0;
+int PageTable::numHashed = 0;
+int PageTable::nextId = 0;
+
+//----------------------------------------------------------------------
+// PageTable::PageTable
+// 	Make a table for "numPages" pages, laid out as "kind" says.  A
+//	linear one has an entry, invalid, for every page; the others have
+//	none yet.  The first hashed table makes the buckets, one for each
+//	frame of physical memory, as a hashed table has entries for about
+//	as many pages as are in memory -- the tables of all programs
+//	together.
+//----------------------------------------------------------------------
+
+PageTable::PageTable(PageTableKind kind, int numPages)
+{
+    this->kind = kind;
+    this->numPages = numPages;
+    entries = NULL;
+    directory = NULL;
+    id = -1;
+    switch (kind) {
+      case LinearPageTable:
+	entries = new TranslationEntry[numPages];
+	for (int i = 0; i < numPages; i++)
+	    Clear(&entries[i], i);
+	bytes = numPages * sizeof(TranslationEntry);
+	break;
+      case TwoLevelPageTable:
+	directory = new TranslationEntry *[divRoundUp(numPages,
+						      SecondLevelSize)];
+	for (int i = 0; i < divRoundUp(numPages, SecondLevelSize); i++)
+	    directory[i] = NULL;
+	bytes = divRoundUp(numPages, SecondLevelSize) *
+		sizeof(TranslationEntry *);
+	break;
+      case HashedPageTable:
+	if (numHashed++ == 0) {
+	    numBuckets = NumPhysPages;
+	    buckets = new HashedEntry *[numBuckets];
+	    for (int i = 0; i < numBuckets; i++)
+		buckets[i] = NULL;
+	}
+	id = nextId++;
+	bytes = 0;
+	break;
+      default:
+	ASSERT(FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// PageTable::~PageTable
+// 	De-allocate the table, and its entries.
+//----------------------------------------------------------------------
+
+PageTable::~PageTable()
+{
+    switch (kind) {
+      case LinearPageTable:
+	delete [] entries;
+	break;
+      case TwoLevelPageTable:
+	for (int i = 0; i < divRoundUp(numPages, SecondLevelSize); i++)
+	    delete [] directory[i];
+	delete [] directory;
+	break;
+      case HashedPageTable:
+	for (int i = 0; i < numBuckets; i++)
+	    for (HashedEntry **link = &buckets[i]; *link != NULL; ) {
+		HashedEntry *h = *link;
+
+		if (h->table == id) {
+		    *link = h->next;
+		    delete h;
+		} else {
+		    link = &h->next;
+		}
+	    }
+	if (--numHashed == 0) {
+	    delete [] buckets;
+	    buckets = NULL;
+	}
+	break;
+      default:
+	ASSERT(FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// PageTable::Clear
+// 	Make "entry" the entry, not valid, of page "vpn".
+//----------------------------------------------------------------------
+
+void
+PageTable::Clear(TranslationEntry *entry, int vpn)
+{
+    entry->virtualPage = vpn;
+    entry->physicalPage = -1;
+    entry->valid = FALSE;
+    entry->readOnly = FALSE;
+    entry->use = FALSE;
+    entry->referenced = FALSE;
+    entry->dirty = FALSE;
+}
+
+//----------------------------------------------------------------------
+// PageTable::Lookup
+// 	Return the entry for virtual page "vpn" -- as the machine finds
+//	it, translating an address -- or NULL if the table has none, or
+//	"vpn" is past its end.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+PageTable::Lookup(unsigned int vpn)
+{
+    TranslationEntry *second;
+
+    if (vpn >= (unsigned int) numPages)
+	return NULL;
+    switch (kind) {
+      case LinearPageTable:
+	return &entries[vpn];
+      case TwoLevelPageTable:
+	second = directory[vpn / SecondLevelSize];
+	return second == NULL ? NULL : &second[vpn % SecondLevelSize];
+      case HashedPageTable:
+	for (HashedEntry *h = buckets[Bucket(vpn)]; h != NULL; h = h->next)
+	    if (h->table == id && h->entry.virtualPage == (int) vpn)
+		return &h->entry;
+	return NULL;
+      default:
+	ASSERT(FALSE);
+	return NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// PageTable::Entry
+// 	Return the entry for virtual page "vpn", making it, invalid, if
+//	the table has none yet: in a two-level table, with the rest of
+//	its array.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+PageTable::Entry(int vpn)
+{
+    TranslationEntry *entry = Lookup(vpn);
+    TranslationEntry *second;
+    HashedEntry *h;
+
+    ASSERT(vpn >= 0 && vpn < numPages);
+    if (entry != NULL)
+	return entry;
+    switch (kind) {
+      case TwoLevelPageTable:
+	second = new TranslationEntry[SecondLevelSize];
+	for (int i = 0; i < SecondLevelSize; i++)
+	    Clear(&second[i], vpn - vpn % SecondLevelSize + i);
+	directory[vpn / SecondLevelSize] = second;
+	bytes += SecondLevelSize * sizeof(TranslationEntry);
+	return &second[vpn % SecondLevelSize];
+      case HashedPageTable:
+	h = new HashedEntry;
+	Clear(&h->entry, vpn);
+	h->table = id;
+	h->next = buckets[Bucket(vpn)];
+	buckets[Bucket(vpn)] = h;
+	bytes += sizeof(HashedEntry);
+	return &h->entry;
+      default:
+	ASSERT(FALSE);
+	return NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// PageTable::Trim
+// 	Drop the entries of pages that are not valid, and not referenced
+//	since the working set was last sampled: in a two-level table, an
+//	array all of whose entries are such; in a hashed one, each entry.
+//	A linear table keeps every entry.
+//
+//	The caller must be sure that no one holds on to an entry that may
+//	go -- of a page being loaded, say.
+//----------------------------------------------------------------------
+
+void
+PageTable::Trim()
+{
+    switch (kind) {
+      case LinearPageTable:
+	break;
+      case TwoLevelPageTable:
+	for (int i = 0; i < divRoundUp(numPages, SecondLevelSize); i++) {
+	    TranslationEntry *second = directory[i];
+	    bool used = FALSE;
+
+	    if (second == NULL)
+		continue;
+	    for (int j = 0; j < SecondLevelSize; j++)
+		used = used || second[j].valid || second[j].referenced;
+	    if (!used) {
+		delete [] second;
+		directory[i] = NULL;
+		bytes -= SecondLevelSize * sizeof(TranslationEntry);
+	    }
+	}
+	break;
+      case HashedPageTable:
+	for (int i = 0; i < numBuckets; i++)
+	    for (HashedEntry **link = &buckets[i]; *link != NULL; ) {
+		HashedEntry *h = *link;
+
+		if (h->table == id && !h->entry.valid &&
+			!h->entry.referenced) {
+		    *link = h->next;
+		    delete h;
+		    bytes -= sizeof(HashedEntry);
+		} else {
+		    link = &h->next;
+		}
+	    }
+	break;
+      default:
+	ASSERT(FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// PageTable::SelfTest
+// 	Check that each kind of table finds the entries it made, and no
+//	others; that two hashed tables keep apart; and that Trim drops
+//	only unused entries, and their memory.
+//----------------------------------------------------------------------
+
+void
+PageTable::SelfTest()
+{
+    for (int k = LinearPageTable; k <= HashedPageTable; k++) {
+	PageTable *table = new PageTable((PageTableKind) k, 100);
+	PageTable *other = new PageTable((PageTableKind) k, 100);
+	int empty = table->Bytes();
+	TranslationEntry *entry;
+
+	ASSERT(table->Lookup(100) == NULL);
+	ASSERT(k == LinearPageTable || table->Lookup(40) == NULL);
+	entry = table->Entry(40);
+	ASSERT(entry->virtualPage == 40 && !entry->valid);
+	ASSERT(table->Lookup(40) == entry && table->Entry(40) == entry);
+	entry->valid = TRUE;
+	entry->physicalPage = 3;
+	table->Entry(99)->referenced = TRUE;
+	table->Entry(70);
+	ASSERT(k == LinearPageTable || other->Lookup(40) == NULL);
+	other->Entry(40)->physicalPage = 5;
+	ASSERT(table->Lookup(40)->physicalPage == 3);
+	ASSERT(k == LinearPageTable || table->Bytes() > empty);
+	table->Trim();
+	ASSERT(table->Lookup(40) == entry && table->Lookup(99) != NULL);
+	ASSERT(k == LinearPageTable || table->Lookup(70) == NULL);
+	entry->valid = FALSE;
+	table->Lookup(99)->referenced = FALSE;
+	table->Trim();
+	ASSERT(table->Bytes() == empty);
+	delete table;
+	ASSERT(other->Lookup(40)->physicalPage == 5);
+	delete other;
+    }
+}
@@ -9,6 +9,8 @@
 //	Either way, each entry is of the form:
 //	<virtual page #, physical page #>.
 //
+//	Page tables may be linear, two-level, or hashed (see PageTable).
+//
 // DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -40,6 +42,81 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    bool referenced;	// Set along with "use", but cleared only by the
+			// working set sampling (AddrSpace::SampleWorkingSet),
+			// not by the page replacement.
+};
+
+// How a page table is laid out.  The machine must know, as it walks the
+// table to translate an address (see PageTable below).
+
+enum PageTableKind {
+    LinearPageTable,		// an entry for every page, in one array
+    TwoLevelPageTable,		// a directory of arrays of entries, each
+				// made when a page in it is first used
+    HashedPageTable		// entries only for the pages in use,
+				// chained from buckets -- one per frame --
+				// that all such tables share
+};
+
+#define SecondLevelSize	16	// entries in one array of a two-level
+				// table
+
+class HashedEntry;
+
+// The following class defines the page table of one address space: an
+// entry for each of its "numPages" pages that the kernel has set up,
+// laid out as "kind" says.
+//
+// Only a linear table has an entry for every page from the start.  The
+// others make one when the kernel first asks for it (by Entry), and
+// drop those of pages that are neither in memory nor referenced when
+// Trim is called, so that the table takes memory for about as many
+// pages as are resident, however big the address space.  A page with
+// no entry is simply invalid: Lookup returns NULL for it.
+//
+// An entry the kernel holds on to may only go in Trim; and as no entry
+// of a valid page ever goes, pointers to those (as the frame allocator
+// keeps) stay good.
+
+class PageTable {
+  public:
+    PageTable(PageTableKind kind, int numPages);
+    				// An empty table for "numPages" pages
+    ~PageTable();
+
+    int NumPages() { return numPages; }
+    TranslationEntry *Lookup(unsigned int vpn);
+    				// The entry for "vpn", or NULL if there
+				// is none
+    TranslationEntry *Entry(int vpn);
+    				// The entry for "vpn", made (invalid) if
+				// there was none
+    void Trim();		// Drop the entries of pages neither
+				// valid nor referenced
+    int Bytes() { return bytes; }
+    				// The memory the table takes now
+
+    static void SelfTest();	// Test each kind
+
+  private:
+    PageTableKind kind;
+    int numPages;
+    int bytes;
+    TranslationEntry *entries;	// linear: one for each page
+    TranslationEntry **directory;	// two-level: an array for each
+				// SecondLevelSize pages, NULL till used
+    int id;			// hashed: tells its entries from those
+				// of other tables
+
+    static HashedEntry **buckets;	// of all hashed tables; made with
+    static int numBuckets;	// the first of them, and deleted with
+    static int numHashed;	// the last
+    static int nextId;
+
+    void Clear(TranslationEntry *entry, int vpn);
+    				// Make "entry" an invalid one for "vpn"
+    int Bucket(unsigned int vpn) { return (id * 31 + vpn) % numBuckets; }
 };
 
 #endif
@@ -38,6 +38,85 @@ Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
     bcopy(msgData, data, mailHdr.length);
 }
 
+//----------------------------------------------------------------------
+// MailPool::MailPool
+//      Make a pool of "size" mail buffers, all free.
+//----------------------------------------------------------------------
+
+MailPool::MailPool(int size)
+{
+    mails = new Mail[size];
+    ASSERT(mails[0].data == mails[0].Wire() + sizeof(MailHeader));
+    free = new List<Mail *>;
+    for (int i = 0; i < size; i++)
+	free->Append(&mails[i]);
+    lock = new Lock("mail pool");
+    freed = new Condition("mail pool freed");
+}
+
+//----------------------------------------------------------------------
+// MailPool::~MailPool
+//      De-allocate the pool, and its buffers.
+//----------------------------------------------------------------------
+
+MailPool::~MailPool()
+{
+    delete freed;
+    delete lock;
+    delete free;
+    delete [] mails;
+}
+
+//----------------------------------------------------------------------
+// MailPool::Get
+//      Take a free buffer, waiting until one is given back if they are
+//	all in use.
+//----------------------------------------------------------------------
+
+Mail *
+MailPool::Get()
+{
+    Mail *mail;
+
+    lock->Acquire();
+    while (free->IsEmpty())
+	freed->Wait(lock);
+    mail = free->RemoveFront();
+    lock->Release();
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// MailPool::TryGet
+//      Take a free buffer, or return NULL if they are all in use.
+//----------------------------------------------------------------------
+
+Mail *
+MailPool::TryGet()
+{
+    Mail *mail = NULL;
+
+    lock->Acquire();
+    if (!free->IsEmpty())
+	mail = free->RemoveFront();
+    lock->Release();
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// MailPool::Put
+//      Give back "mail", a buffer taken from the pool.
+//----------------------------------------------------------------------
+
+void
+MailPool::Put(Mail *mail)
+{
+    lock->Acquire();
+    free->Append(mail);
+    freed->Signal(lock);
+    lock->Release();
+}
+
 //----------------------------------------------------------------------
 // MailBox::MailBox
 //      Initialize a single mail box within the post office, so that it
@@ -50,6 +129,7 @@ Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
 MailBox::MailBox()
 { 
     messages = new SynchList<Mail *>(); 
+    depth = 0;
 }
 
 //----------------------------------------------------------------------
@@ -57,7 +137,7 @@ MailBox::MailBox()
 //      De-allocate a single mail box within the post office.
 //
 //	Just delete the mailbox, and throw away all the queued messages 
-//	in the mailbox.
+//	in the mailbox -- their buffers belong to the post office's pool.
 //----------------------------------------------------------------------
 
 MailBox::~MailBox()
@@ -86,54 +166,39 @@ PrintHeader(PacketHeader pktHdr, MailHeader mailHdr)
 // 	Add a message to the mailbox.  If anyone is waiting for message
 //	arrival, wake them up!
 //
-//	We need to reconstruct the Mail message (by concatenating the headers
-//	to the data), to simplify queueing the message on the SynchList.
-//
-//	"pktHdr" -- source, destination machine ID's
-//	"mailHdr" -- source, destination mailbox ID's
-//	"data" -- payload message data
+//	"mail" -- the message, in a buffer of the post office's pool
 //----------------------------------------------------------------------
 
 void 
-MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data)
+MailBox::Put(Mail *mail)
 { 
-    Mail *mail = new Mail(pktHdr, mailHdr, data); 
-
     messages->Append(mail);		// put on the end of the list of 
 					// arrived messages, and wake up 
 					// any waiters
+    depth++;
 }
 
 //----------------------------------------------------------------------
 // MailBox::Get
-// 	Get a message from a mailbox, parsing it into the packet header,
-//	mailbox header, and data. 
+// 	Get a message from a mailbox.  The caller gives its buffer back
+//	to the post office once it is done with it.
 //
 //	The calling thread waits if there are no messages in the mailbox.
-//
-//	"pktHdr" -- address to put: source, destination machine ID's
-//	"mailHdr" -- address to put: source, destination mailbox ID's
-//	"data" -- address to put: payload message data
 //----------------------------------------------------------------------
 
-void 
-MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data) 
+Mail *
+MailBox::Get() 
 { 
     DEBUG(dbgNet, "Waiting for mail in mailbox");
     Mail *mail = messages->RemoveFront();	// remove message from list;
 						// will wait if list is empty
+    depth--;
 
-    *pktHdr = mail->pktHdr;
-    *mailHdr = mail->mailHdr;
     if (debug->IsEnabled('n')) {
 	cout << "Got mail from mailbox: ";
-	PrintHeader(*pktHdr, *mailHdr);
+	PrintHeader(mail->pktHdr, mail->mailHdr);
     }
-    bcopy(mail->data, data, mail->mailHdr.length);
-					// copy the message data into
-					// the caller's buffer
-    delete mail;			// we've copied out the stuff we
-					// need, we can now discard the message
+    return mail;
 }
 
 //----------------------------------------------------------------------
@@ -148,16 +213,19 @@ MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data)
 //	by the interrupt handlers, because it requires a Lock.
 //
 //	"nBoxes" is the number of mail boxes in this Post Office
+//	"signalled" says how the network device learns of packets (see
+//		NetworkInput::NetworkInput)
 //----------------------------------------------------------------------
 
-PostOfficeInput::PostOfficeInput(int nBoxes)
+PostOfficeInput::PostOfficeInput(int nBoxes, bool signalled)
 {
     messageAvailable = new Semaphore("message available", 0);
 
     numBoxes = nBoxes;
     boxes = new MailBox[nBoxes];
+    pool = new MailPool(MailPoolSize);
 
-    network = new NetworkInput(this);
+    network = new NetworkInput(this, signalled);
 
     Thread *t = new Thread("postal worker", 1);
 
@@ -177,6 +245,67 @@ PostOfficeInput::~PostOfficeInput()
 {
     delete network;
     delete [] boxes;
+    delete pool;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Deliver
+// 	Put "mail", received in a buffer of the pool, in its mailbox.
+//----------------------------------------------------------------------
+
+void
+PostOfficeInput::Deliver(Mail *mail)
+{
+    int box;
+
+    if (debug->IsEnabled('n')) {
+	cout << "Putting mail into mailbox: ";
+	PrintHeader(mail->pktHdr, mail->mailHdr);
+    }
+
+    // check that arriving message is legal!
+    ASSERT(0 <= mail->mailHdr.to && mail->mailHdr.to < numBoxes);
+    ASSERT(mail->mailHdr.length <= MaxMailSize);
+
+    // put into mailbox, noting how deep it gets
+    box = mail->mailHdr.to;
+    boxes[box].Put(mail);
+    if (box < NumMailBoxStats)
+	kernel->stats->mailBoxDepths[box] =
+	    max(kernel->stats->mailBoxDepths[box], boxes[box].Depth());
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Unbatch
+// 	Deliver each of the small mails packed one after another into
+//	"batch", in a buffer of its own, and give back the batch's.  A
+//	mail with no buffer left for it is dropped.
+//----------------------------------------------------------------------
+
+void
+PostOfficeInput::Unbatch(Mail *batch)
+{
+    unsigned done = 0;
+    MailHeader item;
+
+    while (done < batch->mailHdr.length) {
+	Mail *mail = pool->TryGet();
+	int size;
+
+	bcopy(batch->data + done, (char *) &item, sizeof(MailHeader));
+	size = sizeof(MailHeader) + item.length;
+	ASSERT(done + size <= batch->mailHdr.length);
+	if (mail != NULL) {
+	    mail->pktHdr = batch->pktHdr;
+	    mail->pktHdr.length = size;
+	    bcopy(batch->data + done, mail->Wire(), size);
+	    Deliver(mail);
+	} else {
+	    DEBUG(dbgNet, "No buffer for batched mail; dropped");
+	}
+	done += size;
+    }
+    pool->Put(batch);
 }
 
 //----------------------------------------------------------------------
@@ -184,34 +313,34 @@ PostOfficeInput::~PostOfficeInput()
 // 	Wait for incoming messages, and put them in the right mailbox.
 //
 //      Incoming messages have had the PacketHeader stripped off,
-//	but the MailHeader is still tacked on the front of the data.
+//	but the MailHeader is still tacked on the front of the data --
+//	just as a Mail holds them, so they are received straight into a
+//	buffer of the pool.  If every buffer is waiting to be received,
+//	the message is dropped, as the network might have dropped it.
+//	A batch of mails is taken apart, into a buffer for each.
 //----------------------------------------------------------------------
 
 void
 PostOfficeInput::PostalDelivery(void* data)
 {
     PostOfficeInput* _this = (PostOfficeInput*)data;
-    PacketHeader pktHdr;
-    MailHeader mailHdr;
-    char *buffer = new char[MaxPacketSize];
+    char *scratch = new char[MaxPacketSize];
+    Mail *mail;
 
     for (;;) {
         // first, wait for a message
         _this->messageAvailable->P();	
-        pktHdr = _this->network->Receive(buffer);
-
-        mailHdr = *(MailHeader *)buffer;
-        if (debug->IsEnabled('n')) {
-	    cout << "Putting mail into mailbox: ";
-	    PrintHeader(pktHdr, mailHdr);
-        }
-
-	// check that arriving message is legal!
-	ASSERT(0 <= mailHdr.to && mailHdr.to < _this->numBoxes);
-	ASSERT(mailHdr.length <= MaxMailSize);
-
-	// put into mailbox
-        _this->boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader));
+	mail = _this->pool->TryGet();
+	if (mail == NULL) {
+	    (void) _this->network->Receive(scratch);
+	    DEBUG(dbgNet, "No buffer for incoming mail; dropped");
+	    continue;
+	}
+        mail->pktHdr = _this->network->Receive(mail->Wire());
+	if (mail->mailHdr.to == BatchBox)
+	    _this->Unbatch(mail);
+	else
+	    _this->Deliver(mail);
     }
 }
 
@@ -234,10 +363,44 @@ void
 PostOfficeInput::Receive(int box, PacketHeader *pktHdr, 
 				MailHeader *mailHdr, char* data)
 {
+    Mail *mail = Receive(box);
+
+    *pktHdr = mail->pktHdr;
+    *mailHdr = mail->mailHdr;
+    bcopy(mail->data, data, mail->mailHdr.length);
+					// copy the message data into
+					// the caller's buffer
+    Release(mail);
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Receive
+// 	Retrieve a message from "box" as above, but without copying it:
+//	return the buffer it arrived in, to be given back by Release.
+//----------------------------------------------------------------------
+
+Mail *
+PostOfficeInput::Receive(int box)
+{
+    Mail *mail;
+
     ASSERT((box >= 0) && (box < numBoxes));
 
-    boxes[box].Get(pktHdr, mailHdr, data);
-    ASSERT(mailHdr->length <= MaxMailSize);
+    mail = boxes[box].Get();
+    ASSERT(mail->mailHdr.length <= MaxMailSize);
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Release
+// 	Give back "mail", a buffer returned by Receive, once its message
+//	has been read.
+//----------------------------------------------------------------------
+
+void
+PostOfficeInput::Release(Mail *mail)
+{
+    pool->Put(mail);
 }
 
 //----------------------------------------------------------------------
@@ -261,14 +424,30 @@ PostOfficeInput::CallBack()
 //	  be delivered (e.g., reliability = 1 means the network never
 //	  drops any packets; reliability = 0 means the network never
 //	  delivers any packets)
+//	"coalesce" is whether small mails to the same machine are packed
+//	  into one packet, by a thread that sends each batch once it
+//	  has waited long enough for others to join it
 //----------------------------------------------------------------------
 
-PostOfficeOutput::PostOfficeOutput(double reliability)
+static void
+BatchFlusher(void *arg)
+{
+    ((PostOfficeOutput *) arg)->FlushBatches();
+}
+
+PostOfficeOutput::PostOfficeOutput(double reliability, bool coalesce)
 {
     messageSent = new Semaphore("message sent", 0);
     sendLock = new Lock("message send lock");
+    pool = new MailPool(MailPoolSize);
+    this->coalesce = coalesce;
+    batch = NULL;
+    batchLock = new Lock("mail batch lock");
+    batchStarted = new Condition("mail batch started");
 
     network = new NetworkOutput(reliability, this);
+    if (coalesce)
+	(new Thread("batch flusher", -1))->Fork(BatchFlusher, this);
 }
 
 //----------------------------------------------------------------------
@@ -281,6 +460,9 @@ PostOfficeOutput::~PostOfficeOutput()
     delete network;
     delete messageSent;
     delete sendLock;
+    delete pool;
+    delete batchLock;
+    delete batchStarted;
 }
 
 //----------------------------------------------------------------------
@@ -299,33 +481,166 @@ PostOfficeOutput::~PostOfficeOutput()
 void
 PostOfficeOutput::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 {
-    char* buffer = new char[MaxPacketSize];	// space to hold concatenated
-						// mailHdr + data
+    Mail *mail = NewMail();
+
+    ASSERT(mailHdr.length <= MaxMailSize);
+    mail->pktHdr = pktHdr;
+    mail->mailHdr = mailHdr;
+    bcopy(data, mail->data, mailHdr.length);
+    Send(mail);
+}
+
+//----------------------------------------------------------------------
+// PostOfficeOutput::NewMail
+// 	Return a buffer to build an outgoing message in, headers and data,
+//	for Send(Mail *).
+//----------------------------------------------------------------------
+
+Mail *
+PostOfficeOutput::NewMail()
+{
+    return pool->Get();
+}
+
+//----------------------------------------------------------------------
+// PostOfficeOutput::Send
+// 	Pass "mail", built in a buffer from NewMail, to the Network as it
+//	is -- the mail header and data are already together -- and give
+//	the buffer back once the Network is done with it.
+//
+//	When coalescing, a small mail is put in the batch instead, and
+//	we return at once; a batch that it does not fit in goes out
+//	first.  The send lock is taken before the batch lock is let go,
+//	so that mails go out in the order they were sent.
+//----------------------------------------------------------------------
+
+void
+PostOfficeOutput::Send(Mail *mail)
+{
+    Mail *full = NULL;
+    bool batched = FALSE;
 
     if (debug->IsEnabled('n')) {
 	cout << "Post send: ";
-	PrintHeader(pktHdr, mailHdr);
+	PrintHeader(mail->pktHdr, mail->mailHdr);
     }
-    ASSERT(mailHdr.length <= MaxMailSize);
-    ASSERT(0 <= mailHdr.to);
+    ASSERT(mail->mailHdr.length <= MaxMailSize);
+    ASSERT(0 <= mail->mailHdr.to);
     
     // fill in pktHdr, for the Network layer
-    pktHdr.from = kernel->hostName;
-    pktHdr.length = mailHdr.length + sizeof(MailHeader);
+    mail->pktHdr.from = kernel->hostName;
+    mail->pktHdr.length = mail->mailHdr.length + sizeof(MailHeader);
+
+    if (coalesce) {
+	batchLock->Acquire();
+	batched = AddToBatch(mail, &full);
+	if (full != NULL || !batched)
+	    sendLock->Acquire();
+	batchLock->Release();
+    } else {
+	sendLock->Acquire();   		// only one message can be sent
+					// to the network at any one time
+    }
+    if (full != NULL)
+	Transmit(full);
+    if (!batched)
+	Transmit(mail);
+    if (full != NULL || !batched)
+	sendLock->Release();
+}
 
-    // concatenate MailHeader and data
-    bcopy((char *)&mailHdr, buffer, sizeof(MailHeader));
-    bcopy(data, buffer + sizeof(MailHeader), mailHdr.length);
+//----------------------------------------------------------------------
+// PostOfficeOutput::Transmit
+// 	Put "mail" on the network, wait until the next packet may go,
+//	and give the buffer back.  Called with the send lock held.
+//----------------------------------------------------------------------
 
-    sendLock->Acquire();   		// only one message can be sent
-					// to the network at any one time
-    network->Send(pktHdr, buffer);
+void
+PostOfficeOutput::Transmit(Mail *mail)
+{
+    ASSERT(sendLock->IsHeldByCurrentThread());
+    network->Send(mail->pktHdr, mail->Wire());
     messageSent->P();			// wait for interrupt to tell us
 					// ok to send the next message
-    sendLock->Release();
+    pool->Put(mail);			// we've sent the message, so
+					// the buffer can be used again
+}
+
+//----------------------------------------------------------------------
+// PostOfficeOutput::AddToBatch
+// 	Put "mail" at the end of the batch, if it is small enough to
+//	share a packet, and return TRUE; its buffer becomes the batch's
+//	if there is none, else it is given back.  A batch that is bound
+//	for another machine, or that "mail" does not fit in, or that no
+//	other mail would fit in, is returned in "full", to be sent --
+//	before "mail", if that is not batched.  Called with the batch
+//	lock held.
+//----------------------------------------------------------------------
+
+bool
+PostOfficeOutput::AddToBatch(Mail *mail, Mail **full)
+{
+    unsigned size = sizeof(MailHeader) + mail->mailHdr.length;
+
+    if (batch != NULL && (batch->pktHdr.to != mail->pktHdr.to ||
+			  batch->mailHdr.length + size > MaxMailSize)) {
+	*full = batch;
+	batch = NULL;
+    }
+    if (size > MaxMailSize)
+	return FALSE;
+    if (batch == NULL) {		// the mail becomes a batch of one
+	bcopy(mail->data, mail->data + sizeof(MailHeader),
+	      mail->mailHdr.length);
+	bcopy((char *) &mail->mailHdr, mail->data, sizeof(MailHeader));
+	mail->mailHdr.to = BatchBox;
+	mail->mailHdr.from = 0;
+	mail->mailHdr.length = size;
+	batch = mail;
+	batchStarted->Signal(batchLock);
+    } else {
+	bcopy(mail->Wire(), batch->data + batch->mailHdr.length, size);
+	batch->mailHdr.length += size;
+	pool->Put(mail);
+    }
+    batch->pktHdr.length = batch->mailHdr.length + sizeof(MailHeader);
+    if (batch->mailHdr.length + sizeof(MailHeader) >= MaxMailSize) {
+	*full = batch;			// nothing more would fit
+	batch = NULL;
+    }
+    return TRUE;
+}
 
-    delete [] buffer;			// we've sent the message, so
-					// we can delete our buffer
+//----------------------------------------------------------------------
+// PostOfficeOutput::FlushBatches
+// 	For ever: wait for a batch to be begun, give other mails
+//	CoalesceTicks to join it, and send it.
+//----------------------------------------------------------------------
+
+void
+PostOfficeOutput::FlushBatches()
+{
+    Mail *full;
+
+    for (;;) {
+	batchLock->Acquire();
+	while (batch == NULL)
+	    batchStarted->Wait(batchLock);
+	batchLock->Release();
+
+	kernel->alarm->WaitUntil(CoalesceTicks);
+
+	batchLock->Acquire();
+	full = batch;
+	batch = NULL;
+	if (full != NULL)
+	    sendLock->Acquire();
+	batchLock->Release();
+	if (full != NULL) {
+	    Transmit(full);
+	    sendLock->Release();
+	}
+    }
 }
 
 //----------------------------------------------------------------------
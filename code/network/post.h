@@ -55,6 +55,16 @@ class MailHeader {
 
 #define MaxMailSize 	(MaxPacketSize - sizeof(MailHeader))
 
+// A packet may carry, instead of one mail, a batch of small mails to the
+// same machine, one after the other, each with its MailHeader.  The
+// batch itself has a MailHeader addressed to BatchBox, whose length
+// covers all of them.
+
+#define BatchBox	-1
+#define CoalesceTicks	(2 * NetworkTime)
+				// longest a small mail waits for others
+				// to share its packet
+
 
 // The following class defines the format of an incoming/outgoing 
 // "Mail" message.  The message format is layered: 
@@ -62,17 +72,50 @@ class MailHeader {
 //	post office header (MailHeader) 
 //	data
 
+//
+//	The mail header and data are laid out just as they go on the wire,
+//	so that a packet can be received into a Mail, or sent from one,
+//	without copying it.
+
 class Mail {
   public:
+     Mail() {}			// An empty buffer, for a MailPool
      Mail(PacketHeader pktH, MailHeader mailH, char *msgData);
 				// Initialize a mail message by
 				// concatenating the headers to the data
 
+     char *Wire() { return (char *) &mailHdr; }
+				// The packet data: mail header, then
+				// message data
+
      PacketHeader pktHdr;	// Header appended by Network
      MailHeader mailHdr;	// Header appended by PostOffice
      char data[MaxMailSize];	// Payload -- message data
 };
 
+// The following class defines a pool of Mail buffers, made once, so
+// that mail need not be allocated as it comes and goes.
+
+#define MailPoolSize	16	// buffers in each post office's pool
+
+class MailPool {
+  public:
+    MailPool(int size);		// Make "size" buffers
+    ~MailPool();
+
+    Mail *Get();		// Take a buffer, waiting for one if
+				// they are all in use
+    Mail *TryGet();		// Take a buffer, or return NULL if they
+				// are all in use
+    void Put(Mail *mail);	// Give a buffer back
+
+  private:
+    Mail *mails;		// The buffers
+    List<Mail *> *free;		// Those not in use
+    Lock *lock;			// Protects "free"
+    Condition *freed;		// Signalled when a buffer is given back
+};
+
 // The following class defines a single mailbox, or temporary storage
 // for messages.   Incoming messages are put by the PostOffice into the 
 // appropriate mailbox, and these messages can then be retrieved by
@@ -83,14 +126,15 @@ class MailBox {
     MailBox();			// Allocate and initialize mail box
     ~MailBox();			// De-allocate mail box
 
-    void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data);
-   				// Atomically put a message into the mailbox
-    void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data); 
-   				// Atomically get a message out of the 
+    void Put(Mail *mail);	// Atomically put a message into the mailbox
+    Mail *Get();		// Atomically get a message out of the 
 				// mailbox (and wait if there is no message 
 				// to get!)
+    int Depth() { return depth; }	// Messages waiting in it
+
   private:
     SynchList<Mail *> *messages; // A mailbox is just a list of arrived messages
+    int depth;			// how many are on it
 };
 
 // The following two classes defines a "Post Office", or a collection of 
@@ -104,13 +148,19 @@ class MailBox {
 
 class PostOfficeInput : public CallBackObj {
   public:
-    PostOfficeInput(int nBoxes); // Allocate and initialize Post Office
+    PostOfficeInput(int nBoxes, bool signalled);
+				// Allocate and initialize Post Office;
+				// the host signals packets if
+				// "signalled", else they are polled for
     ~PostOfficeInput();		// De-allocate Post Office data
     
     void Receive(int box, PacketHeader *pktHdr, 
 		MailHeader *mailHdr, char *data);
     				// Retrieve a message from "box".  Wait if
 				// there is no message in the box.
+    Mail *Receive(int box);	// The same, but return the message in
+				// place, in one of our buffers
+    void Release(Mail *mail);	// Give back a buffer Receive returned
 
     static void PostalDelivery(void* data);
 				// Wait for incoming messages, 
@@ -124,28 +174,52 @@ class PostOfficeInput : public CallBackObj {
     NetworkInput *network;	// Physical network connection
     MailBox *boxes;		// Table of mail boxes to hold incoming mail
     int numBoxes;		// Number of mail boxes
+    MailPool *pool;		// Buffers for incoming mail
     Semaphore *messageAvailable;// V'ed when message has arrived from network
+
+    void Deliver(Mail *mail);	// Put "mail" in its mailbox
+    void Unbatch(Mail *batch);	// Deliver each of the mails in "batch"
 };
 
 class PostOfficeOutput : public CallBackObj {
   public:
-    PostOfficeOutput(double reliability);
+    PostOfficeOutput(double reliability, bool coalesce = FALSE);
 				// Allocate and initialize output
 				//   "reliability" is how many packets
 				//   get dropped by the underlying network
+				//   "coalesce" is whether small mails
+				//   share packets
     ~PostOfficeOutput();	// De-allocate Post Office data
 
     void Send(PacketHeader pktHdr, MailHeader mailHdr, char *data);
     				// Send a message to a mailbox on a remote 
 				// machine.  The fromBox in the MailHeader is 
 				// the return box for ack's.
+    Mail *NewMail();		// A buffer to build a message in
+    void Send(Mail *mail);	// Send a message built in a buffer from
+				// NewMail, and give the buffer back
 
     void CallBack();		// Called when outgoing packet has been 
 				// put on network; next packet can now be sent
+
+    void FlushBatches();	// Body of the thread that sends batches
+				// that have waited CoalesceTicks
     
   private:
     NetworkOutput *network;	// Physical network connection
     Semaphore *messageSent;	// V'ed when next message can be sent to network
     Lock *sendLock;		// Only one outgoing message at a time
+    MailPool *pool;		// Buffers for outgoing mail
+
+    bool coalesce;		// Small mails share packets
+    Mail *batch;		// The packet they are put in, until it
+				// is full or has waited; NULL if none
+    Lock *batchLock;		// Protects "batch"
+    Condition *batchStarted;	// Signalled when a batch is begun
+
+    void Transmit(Mail *mail);	// Put "mail" on the network, and give
+				// its buffer back
+    bool AddToBatch(Mail *mail, Mail **full);
+				// Put "mail" in the batch, if it is small
 };
 #endif
@@ -0,0 +1,638 @@
+// remotefs.cc
+//	Routines for the file server, which carries out other machines'
+//	requests against our FileSystem, and for the client, which sends
+//	them requests and keeps the blocks they send back under a lease.
+//
+//	The server has a thread for each machine that may be a client;
+//	it takes one request at a time off the connection with that
+//	machine, and answers it.  A client sends one request at a time to
+//	each server, so a reply always belongs to the last request.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "remotefs.h"
+#include "syscall.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ServeThread
+//	Dummy function, since a thread cannot be forked on a member
+//	function.
+//----------------------------------------------------------------------
+
+static void
+ServeThread(void *arg)
+{
+    ServedClient *client = (ServedClient *) arg;
+
+    client->server->Serve(client);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::RemoteFileServer
+// 	Set up a connection with every machine that may send us requests,
+//	and fork a thread to serve each.
+//----------------------------------------------------------------------
+
+RemoteFileServer::RemoteFileServer()
+{
+    ASSERT(0 <= kernel->hostName && kernel->hostName < MaxRemoteHosts);
+    lock = new Lock("file server");
+    leases = new List<Lease *>;
+    for (int m = 0; m < MaxRemoteHosts; m++) {
+	clients[m].server = this;
+	clients[m].host = m;
+	clients[m].conn = new Connection(m, FirstClientBox + kernel->hostName,
+					 FirstServerBox + m);
+	for (int i = 0; i < MaxRemoteFiles; i++)
+	    clients[m].files[i] = NULL;
+	(new Thread("file server", -1))->Fork(ServeThread, &clients[m]);
+    }
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::Serve
+// 	For ever: take a request from "client", carry it out, and send
+//	back the reply.  A request that is short, or whose length does
+//	not match what came with it, is answered with -1, like one the
+//	server cannot carry out.
+//----------------------------------------------------------------------
+
+void
+RemoteFileServer::Serve(ServedClient *client)
+{
+    char request[MaxRemoteMessage], reply[MaxRemoteMessage];
+    char *data = request + sizeof(RemoteRequest);
+    RemoteRequest req;
+    RemoteReply rep;
+    int n, replyLength;
+
+    for (;;) {
+	n = client->conn->Receive(request, MaxRemoteMessage);
+	if (n < (int) sizeof(RemoteRequest)) {
+	    DEBUG(dbgNet, "Short file request from " << client->host);
+	    bzero((char *) &req, sizeof(RemoteRequest));
+	    req.op = -1;		// answered with an error, below
+	} else
+	    bcopy(request, (char *) &req, sizeof(RemoteRequest));
+	DEBUG(dbgNet, "File request " << req.op << " from " << client->host
+	      << ", handle " << req.handle << ", offset " << req.offset
+	      << ", length " << req.length);
+
+	rep.result = -1;
+	rep.file = -1;
+	replyLength = sizeof(RemoteReply);
+	lock->Acquire();
+	switch (req.op) {
+	  case RemoteOpen:
+	    if (req.length <= 0 || n != (int) sizeof(RemoteRequest) + req.length)
+		break;
+	    data[req.length - 1] = '\0';
+	    rep.result = Open(client, data, &rep.file);
+	    break;
+	  case RemoteRead:
+	    if (req.length < 0)
+		break;
+	    rep.result = Read(client, req.handle, reply + sizeof(RemoteReply),
+			      min(req.length, (int) RemoteBlockSize),
+			      req.offset);
+	    if (rep.result > 0)
+		replyLength += rep.result;
+	    break;
+	  case RemoteWrite:
+	    if (req.length < 0 || n != (int) sizeof(RemoteRequest) + req.length)
+		break;
+	    rep.result = Write(client, req.handle, data, req.length,
+			       req.offset);
+	    break;
+	  case RemoteClose:
+	    rep.result = Close(client, req.handle);
+	    break;
+	}
+	lock->Release();
+
+	bcopy((char *) &rep, reply, sizeof(RemoteReply));
+	client->conn->Send(reply, replyLength);
+    }
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::Open
+// 	Open the file "name" for "client"; return its handle, and its
+//	header sector in "file", or -1 if there is no such file or the
+//	client has too many open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileServer::Open(ServedClient *client, char *name, int *file)
+{
+    OpenFile *openFile;
+
+    for (int i = 0; i < MaxRemoteFiles; i++)
+	if (client->files[i] == NULL) {
+	    if ((openFile = kernel->fileSystem->Open(name)) == NULL)
+		return -1;
+	    client->files[i] = openFile;
+	    *file = openFile->HeaderSector();
+	    return i;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::Read
+// 	Read "length" bytes at "offset" of the client's file "handle"
+//	into "into", and lease the file to the client.  Return the
+//	number of bytes read, or -1 if "handle" is not open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileServer::Read(ServedClient *client, int handle, char *into,
+		       int length, int offset)
+{
+    OpenFile *openFile;
+
+    if (handle < 0 || handle >= MaxRemoteFiles ||
+	(openFile = client->files[handle]) == NULL || offset < 0)
+	return -1;
+    Grant(openFile->HeaderSector(), client->host);
+    return openFile->ReadAt(into, length, offset);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::Write
+// 	Write "length" bytes from "from" at "offset" of the client's file
+//	"handle", once no other machine holds a lease on it.  Return the
+//	number of bytes written, or -1 if "handle" is not open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileServer::Write(ServedClient *client, int handle, char *from,
+			int length, int offset)
+{
+    OpenFile *openFile;
+
+    if (handle < 0 || handle >= MaxRemoteFiles ||
+	(openFile = client->files[handle]) == NULL || offset < 0)
+	return -1;
+    WaitForLeases(openFile->HeaderSector(), client->host);
+    return openFile->WriteAt(from, length, offset);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::Close
+// 	Close the client's file "handle".  Return 1, or -1 if it is not
+//	open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileServer::Close(ServedClient *client, int handle)
+{
+    if (handle < 0 || handle >= MaxRemoteFiles ||
+	client->files[handle] == NULL)
+	return -1;
+    delete client->files[handle];
+    client->files[handle] = NULL;
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::Grant
+// 	Lease the file at "sector" to "host" for LeaseTicks from now.
+//----------------------------------------------------------------------
+
+void
+RemoteFileServer::Grant(int sector, int host)
+{
+    ListIterator<Lease *> it(leases);
+    Lease *lease;
+
+    for (; !it.IsDone(); it.Next())
+	if (it.Item()->sector == sector && it.Item()->host == host) {
+	    it.Item()->expires = kernel->stats->totalTicks + LeaseTicks;
+	    return;
+	}
+    lease = new Lease;
+    lease->sector = sector;
+    lease->host = host;
+    lease->expires = kernel->stats->totalTicks + LeaseTicks;
+    leases->Append(lease);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileServer::WaitForLeases
+// 	Wait until every lease on the file at "sector" held by a machine
+//	other than "host" has run out, so that none of them can still be
+//	reading blocks of it that a write is about to change.
+//----------------------------------------------------------------------
+
+void
+RemoteFileServer::WaitForLeases(int sector, int host)
+{
+    ListIterator<Lease *> it(leases);
+    int last = kernel->stats->totalTicks;
+
+    for (; !it.IsDone(); it.Next())
+	if (it.Item()->sector == sector && it.Item()->host != host)
+	    last = max(last, it.Item()->expires);
+    if (last > kernel->stats->totalTicks) {
+	DEBUG(dbgNet, "Write to file " << sector << " waits for leases");
+	kernel->alarm->WaitUntil(last - kernel->stats->totalTicks);
+    }
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::RemoteFileClient
+// 	Nothing is open, and nothing cached.  A connection to a server is
+//	made when a file there is first opened.
+//----------------------------------------------------------------------
+
+RemoteFileClient::RemoteFileClient()
+{
+    lock = new Lock("remote files");
+    for (int m = 0; m < MaxRemoteHosts; m++) {
+	servers[m] = NULL;
+	callLock[m] = new Lock("remote call");
+    }
+    for (int i = 0; i < MaxRemoteFiles; i++)
+	files[i].inUse = FALSE;
+    for (int i = 0; i < RemoteCacheBlocks; i++)
+	cache[i].host = -1;
+    hits = misses = 0;
+}
+
+RemoteFileClient::~RemoteFileClient()
+{
+    delete lock;
+    for (int m = 0; m < MaxRemoteHosts; m++)
+	delete callLock[m];
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::IsRemote, RemoteFileClient::Owns
+// 	Whether a file name, or an OpenFileId, is one of ours.
+//----------------------------------------------------------------------
+
+bool
+RemoteFileClient::IsRemote(char *name)
+{
+    return strncmp(name, RemotePrefix, strlen(RemotePrefix)) == 0;
+}
+
+bool
+RemoteFileClient::Owns(int id)
+{
+    return RemoteIdBase <= id && id < RemoteIdBase + MaxRemoteFiles;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Call
+// 	Send the request "req" -- followed by "data", for an Open or a
+//	Write -- to machine "host", and wait for the reply.  Put its
+//	header in "reply" and the data after it, if any, in
+//	"replyData"; return how many bytes of data there were.
+//----------------------------------------------------------------------
+
+int
+RemoteFileClient::Call(int host, RemoteRequest *req, char *data,
+		       RemoteReply *reply, char *replyData)
+{
+    char message[MaxRemoteMessage];
+    int length = 0, n;
+
+    if (req->op == RemoteOpen || req->op == RemoteWrite)
+	length = req->length;
+    ASSERT(sizeof(RemoteRequest) + length <= MaxRemoteMessage);
+    bcopy((char *) req, message, sizeof(RemoteRequest));
+    bcopy(data, message + sizeof(RemoteRequest), length);
+
+    callLock[host]->Acquire();
+    if (servers[host] == NULL)
+	servers[host] = new Connection(host, FirstServerBox + kernel->hostName,
+				       FirstClientBox + host);
+    servers[host]->Send(message, sizeof(RemoteRequest) + length);
+    n = servers[host]->Receive(message, MaxRemoteMessage);
+    callLock[host]->Release();
+
+    ASSERT(n >= (int) sizeof(RemoteReply));
+    bcopy(message, (char *) reply, sizeof(RemoteReply));
+    n -= sizeof(RemoteReply);
+    if (replyData != NULL)
+	bcopy(message + sizeof(RemoteReply), replyData, n);
+    return n;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Open
+// 	Open "/net/<machine>/<name>" for the running program.  Return
+//	its id, or -1 if the name or the machine is not good, or the
+//	server has no such file, or we have too many files open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileClient::Open(char *name)
+{
+    char *rest = name + strlen(RemotePrefix), *path;
+    RemoteRequest req;
+    RemoteReply reply;
+    int host = 0, i;
+
+    for (path = rest; *path >= '0' && *path <= '9'; path++)
+	host = host * 10 + *path - '0';
+    if (path == rest || *path != '/' || host >= MaxRemoteHosts ||
+	strlen(path) + 1 > RemoteBlockSize)
+	return -1;
+
+    lock->Acquire();
+    for (i = 0; i < MaxRemoteFiles && files[i].inUse; i++)
+	;
+    if (i < MaxRemoteFiles) {
+	files[i].inUse = TRUE;		// kept for us while we ask
+	files[i].handle = -1;
+    }
+    lock->Release();
+    if (i == MaxRemoteFiles)
+	return -1;
+
+    req.op = RemoteOpen;
+    req.handle = -1;
+    req.offset = 0;
+    req.length = strlen(path) + 1;
+    Call(host, &req, path, &reply, NULL);
+    if (reply.result < 0) {
+	files[i].inUse = FALSE;
+	return -1;
+    }
+    files[i].owner = kernel->currentThread->space;
+    files[i].host = host;
+    files[i].file = reply.file;
+    files[i].position = 0;
+    files[i].handle = reply.result;
+    DEBUG(dbgNet, "Opened " << path << " on " << host << " as "
+	  << RemoteIdBase + i);
+    return RemoteIdBase + i;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::FileOf
+// 	The running program's remote file "id", or NULL if it has no
+//	such file open.
+//----------------------------------------------------------------------
+
+RemoteFile *
+RemoteFileClient::FileOf(int id)
+{
+    RemoteFile *f;
+
+    if (!Owns(id))
+	return NULL;
+    f = &files[id - RemoteIdBase];
+    if (!f->inUse || f->handle < 0 ||
+	f->owner != kernel->currentThread->space)
+	return NULL;
+    return f;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Lookup
+// 	The cached "block" of "file" on "host", if we hold it and its
+//	lease has not run out; else NULL.  Called with the lock held.
+//----------------------------------------------------------------------
+
+RemoteBlock *
+RemoteFileClient::Lookup(int host, int file, int block)
+{
+    for (int i = 0; i < RemoteCacheBlocks; i++) {
+	RemoteBlock *b = &cache[i];
+
+	if (b->host == host && b->file == file && b->block == block) {
+	    if (kernel->stats->totalTicks >= b->expires) {
+		b->host = -1;		// the lease is over
+		return NULL;
+	    }
+	    b->lastUse = kernel->stats->totalTicks;
+	    return b;
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Keep
+// 	Cache "length" bytes of "block" of "file" on "host", leased until
+//	"expires", in place of the least recently used block if there is
+//	no room.  Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+RemoteFileClient::Keep(int host, int file, int block, char *data,
+		       int length, int expires)
+{
+    RemoteBlock *b = &cache[0];
+
+    for (int i = 0; i < RemoteCacheBlocks; i++) {
+	RemoteBlock *c = &cache[i];
+
+	if (c->host == host && c->file == file && c->block == block) {
+	    b = c;
+	    break;
+	}
+	if (c->host == -1)
+	    b = c;
+	else if (b->host != -1 && c->lastUse < b->lastUse)
+	    b = c;
+    }
+    b->host = host;
+    b->file = file;
+    b->block = block;
+    b->length = length;
+    b->expires = expires;
+    b->lastUse = kernel->stats->totalTicks;
+    bcopy(data, b->data, length);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Forget
+// 	Drop blocks "first" to "last" of "file" on "host", which we have
+//	just written.  Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+RemoteFileClient::Forget(int host, int file, int first, int last)
+{
+    for (int i = 0; i < RemoteCacheBlocks; i++)
+	if (cache[i].host == host && cache[i].file == file &&
+	    cache[i].block >= first && cache[i].block <= last)
+	    cache[i].host = -1;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Read
+// 	Read up to "size" bytes at the seek position of the running
+//	program's remote file "id", a block at a time, from the cache if
+//	the block is there.  Return the number of bytes read, or -1 if
+//	"id" is not open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileClient::Read(char *buffer, int size, int id)
+{
+    RemoteFile *f = FileOf(id);
+    char data[RemoteBlockSize];
+    RemoteRequest req;
+    RemoteReply reply;
+    int done = 0;
+
+    if (f == NULL)
+	return -1;
+    while (done < size) {
+	int block = f->position / RemoteBlockSize;
+	int at = f->position % RemoteBlockSize;
+	int length, asked, n;
+	RemoteBlock *b;
+
+	lock->Acquire();
+	if ((b = Lookup(f->host, f->file, block)) != NULL) {
+	    hits++;
+	    length = b->length;
+	    bcopy(b->data, data, length);
+	}
+	lock->Release();
+
+	if (b == NULL) {
+	    req.op = RemoteRead;
+	    req.handle = f->handle;
+	    req.offset = block * RemoteBlockSize;
+	    req.length = RemoteBlockSize;
+	    asked = kernel->stats->totalTicks;	// the lease runs from here
+	    length = Call(f->host, &req, NULL, &reply, data);
+	    if (reply.result < 0)
+		return done > 0 ? done : -1;
+	    lock->Acquire();
+	    misses++;
+	    Keep(f->host, f->file, block, data, length, asked + LeaseTicks);
+	    lock->Release();
+	}
+
+	if (at >= length)		// the end of the file
+	    break;
+	n = min(length - at, size - done);
+	bcopy(data + at, buffer + done, n);
+	done += n;
+	f->position += n;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Write
+// 	Write "size" bytes at the seek position of the running program's
+//	remote file "id", through to the server, a block's worth at a
+//	time; drop what we had cached of the blocks written.  Return the
+//	number of bytes written, or -1 if "id" is not open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileClient::Write(char *buffer, int size, int id)
+{
+    RemoteFile *f = FileOf(id);
+    RemoteRequest req;
+    RemoteReply reply;
+    int done = 0;
+
+    if (f == NULL)
+	return -1;
+    while (done < size) {
+	req.op = RemoteWrite;
+	req.handle = f->handle;
+	req.offset = f->position;
+	req.length = min(size - done, (int) RemoteBlockSize);
+	Call(f->host, &req, buffer + done, &reply, NULL);
+
+	lock->Acquire();
+	Forget(f->host, f->file, req.offset / RemoteBlockSize,
+	       (req.offset + req.length - 1) / RemoteBlockSize);
+	lock->Release();
+	if (reply.result <= 0)
+	    return done > 0 ? done : -1;
+	done += reply.result;
+	f->position += reply.result;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Seek
+// 	Move the seek position of the running program's remote file
+//	"id", as FileSystem::Seek does.  We do not know how long the
+//	file is, so SeekEnd is not allowed.  Return the new position, or
+//	-1.
+//----------------------------------------------------------------------
+
+int
+RemoteFileClient::Seek(int offset, int whence, int id)
+{
+    RemoteFile *f = FileOf(id);
+    int position;
+
+    if (f == NULL)
+	return -1;
+    if (whence == SeekSet)
+	position = offset;
+    else if (whence == SeekCurrent)
+	position = f->position + offset;
+    else
+	return -1;
+    if (position < 0)
+	return -1;
+    f->position = position;
+    return position;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::Close
+// 	Close the running program's remote file "id".  Return 1, or -1
+//	if it is not open.
+//----------------------------------------------------------------------
+
+int
+RemoteFileClient::Close(int id)
+{
+    RemoteFile *f = FileOf(id);
+    RemoteRequest req;
+    RemoteReply reply;
+
+    if (f == NULL)
+	return -1;
+    req.op = RemoteClose;
+    req.handle = f->handle;
+    req.offset = req.length = 0;
+    Call(f->host, &req, NULL, &reply, NULL);
+    f->inUse = FALSE;
+    return reply.result;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileClient::CloseAll
+// 	Close every remote file that the program with "owner" left open.
+//----------------------------------------------------------------------
+
+void
+RemoteFileClient::CloseAll(AddrSpace *owner)
+{
+    RemoteRequest req;
+    RemoteReply reply;
+
+    for (int i = 0; i < MaxRemoteFiles; i++)
+	if (files[i].inUse && files[i].handle >= 0 &&
+	    files[i].owner == owner) {
+	    req.op = RemoteClose;
+	    req.handle = files[i].handle;
+	    req.offset = req.length = 0;
+	    Call(files[i].host, &req, NULL, &reply, NULL);
+	    files[i].inUse = FALSE;
+	}
+}
@@ -0,0 +1,203 @@
+// remotefs.h
+//	Data structures for reaching the files of another Nachos machine:
+//	a file server, which serves Open, Read, Write and Close requests
+//	from other machines against our own FileSystem, and a client,
+//	which sends them for the names under RemotePrefix.  The file
+//	"/big" on machine 1 is named "/net/1/big" on every machine.
+//
+//	Requests and replies go over a reliable Connection between the
+//	client machine and the server, one for each pair of machines, so
+//	they are neither lost nor reordered.  The files a client has open
+//	are numbered from RemoteIdBase, above the ids of local files, so
+//	the kernel can tell which a user program means.
+//
+//	The client keeps the file blocks it reads, so that reading them
+//	again does not cross the network.  Each block is lent under a
+//	lease: the client uses it only until LeaseTicks after it asked
+//	for it, and the server holds back a write to the file from any
+//	other machine until every lease on the file has run out.  So a
+//	client never reads data older than the last write it could have
+//	seen -- as long as the machines' clocks run at about the same
+//	rate, since each side times the lease by its own.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef REMOTEFS_H
+#define REMOTEFS_H
+
+#include "copyright.h"
+#include "transport.h"
+#include "openfile.h"
+#include "disk.h"
+#include "list.h"
+
+class AddrSpace;
+
+#define RemotePrefix	"/net/"	// "/net/<machine>/<name>" is the file
+				// "/<name>" on machine <machine>
+#define MaxRemoteHosts	4	// machines 0 .. MaxRemoteHosts-1 may
+				// share their files
+#define FirstServerBox	8	// the server takes requests from machine
+				// m at mailbox FirstServerBox + m
+#define FirstClientBox	(FirstServerBox + MaxRemoteHosts)
+				// and the client on m is answered by
+				// server s at FirstClientBox + s
+#define NumMailBoxes	(FirstClientBox + MaxRemoteHosts)
+
+#define RemoteIdBase	64	// OpenFileIds of remote files start here
+#define MaxRemoteFiles	16	// remote files open at once, on one client
+				// or from one client on a server
+#define RemoteBlockSize	SectorSize	// unit of reading and caching
+#define RemoteCacheBlocks 32	// blocks the client keeps
+#define LeaseTicks	(200000 * NetworkTime)
+				// how long a client may use a block:
+				// long beside a request, which takes
+				// thousands of NetworkTimes, as a
+				// machine waiting on the network idles
+				// ahead to its next poll
+
+// The requests a client sends, and the header put in front of them.
+// An Open request is followed by the file's name, its '\0' included;
+// a Write, by the bytes to write.
+
+enum RemoteOp { RemoteOpen, RemoteRead, RemoteWrite, RemoteClose };
+
+class RemoteRequest {
+  public:
+    int op;			// a RemoteOp
+    int handle;			// the open file, as Open returned it
+    int offset;			// Read, Write: where in the file
+    int length;			// bytes that follow, or to be read
+};
+
+// The header of a reply.  A Read reply is followed by the bytes read.
+
+class RemoteReply {
+  public:
+    int result;			// Open: the handle; Read, Write: bytes
+				// moved; Close: 1; or -1 on an error
+    int file;			// Open: the file's header sector, which
+				// blocks are cached under
+};
+
+#define MaxRemoteMessage (sizeof(RemoteRequest) + RemoteBlockSize)
+				// the largest request or reply
+
+// A lease the server has granted a machine on a file.
+
+class Lease {
+  public:
+    int sector;			// the file's header sector
+    int host;			// who holds it
+    int expires;		// in the server's totalTicks
+};
+
+// The server's end of the connection with one client machine.
+
+class RemoteFileServer;
+
+class ServedClient {
+  public:
+    RemoteFileServer *server;
+    int host;			// the client machine
+    Connection *conn;
+    OpenFile *files[MaxRemoteFiles];	// what it has open, by handle
+};
+
+// The following class defines the file server.
+
+class RemoteFileServer {
+  public:
+    RemoteFileServer();		// Start serving every other machine
+
+    void Serve(ServedClient *client);	// Body of the thread serving
+					// "client"
+
+  private:
+    ServedClient clients[MaxRemoteHosts];
+    Lock *lock;			// held while a request is carried out,
+				// so a lease cannot be granted while a
+				// write waits for the others to end
+    List<Lease *> *leases;
+
+    int Open(ServedClient *client, char *name, int *file);
+    int Read(ServedClient *client, int handle, char *into, int length,
+	     int offset);
+    int Write(ServedClient *client, int handle, char *from, int length,
+	      int offset);
+    int Close(ServedClient *client, int handle);
+
+    void Grant(int sector, int host);	// Lease the file to "host"
+    void WaitForLeases(int sector, int host);
+					// Until no other machine holds a
+					// lease on the file
+};
+
+// A block of a remote file, as the client keeps it.
+
+class RemoteBlock {
+  public:
+    int host;			// the server; -1 if the slot is free
+    int file;			// the file's header sector there
+    int block;			// which block of the file
+    int length;			// bytes in it; fewer than RemoteBlockSize
+				// at the end of the file
+    int expires;		// when its lease ends, in our totalTicks
+    int lastUse;		// for putting out the least recently used
+    char data[RemoteBlockSize];
+};
+
+// A remote file a program on the client has open.
+
+class RemoteFile {
+  public:
+    bool inUse;
+    AddrSpace *owner;		// the program that opened it
+    int host;			// the server
+    int handle;			// the server's id for it
+    int file;			// its header sector there
+    int position;		// the seek position
+};
+
+// The following class defines the client.
+
+class RemoteFileClient {
+  public:
+    RemoteFileClient();
+    ~RemoteFileClient();
+
+    static bool IsRemote(char *name);	// Is "name" under RemotePrefix?
+    bool Owns(int id);			// Is "id" one of our files?
+
+    int Open(char *name);		// The same as FileSystem::myOpen,
+    int Read(char *buffer, int size, int id);	// ::Read, and so on,
+    int Write(char *buffer, int size, int id);	// for remote files
+    int Seek(int offset, int whence, int id);
+    int Close(int id);
+    void CloseAll(AddrSpace *owner);	// Close what "owner" left open
+
+    int Hits() { return hits; }		// Block reads kept local
+    int Misses() { return misses; }	// and sent to the server
+
+  private:
+    Connection *servers[MaxRemoteHosts];	// made when first used
+    Lock *callLock[MaxRemoteHosts];	// one request at a time to each
+    RemoteFile files[MaxRemoteFiles];	// by id - RemoteIdBase
+    RemoteBlock cache[RemoteCacheBlocks];
+    Lock *lock;				// protects "files" and "cache"
+    int hits, misses;
+
+    int Call(int host, RemoteRequest *req, char *data, RemoteReply *reply,
+	     char *replyData);		// Send a request, wait for its reply
+    RemoteFile *FileOf(int id);		// The running program's file "id"
+    RemoteBlock *Lookup(int host, int file, int block);
+					// A block we hold a lease on, or NULL
+    void Keep(int host, int file, int block, char *data, int length,
+	      int expires);		// Put a block in the cache
+    void Forget(int host, int file, int first, int last);
+					// Drop cached blocks of a file
+};
+
+#endif // REMOTEFS_H
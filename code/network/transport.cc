@@ -0,0 +1,310 @@
+// transport.cc
+//	Routines for reliable, ordered delivery of messages over the
+//	post office: a sliding window of numbered segments, cumulative
+//	acks, and retransmission of what is still unacknowledged once no
+//	ack has come for RetransmitTicks.
+//
+//	Each connection has two threads of its own: one that takes
+//	segments out of the local mailbox, and one that waits on the
+//	alarm clock to put unacknowledged segments out again.  The latter
+//	waits on the alarm only while some segment is out, so that an
+//	idle connection does not keep Nachos from halting.  Each time it
+//	has to put the same segments out again it waits twice as long,
+//	so that a far end slow to answer is not flooded with copies.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "transport.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ReceiveThread, RetransmitThread
+//	Dummy functions, since a thread cannot be forked on a member
+//	function.
+//----------------------------------------------------------------------
+
+static void
+ReceiveThread(void *arg)
+{
+    ((Connection *) arg)->ReceiveSegments();
+}
+
+static void
+RetransmitThread(void *arg)
+{
+    ((Connection *) arg)->Retransmit();
+}
+
+//----------------------------------------------------------------------
+// Connection::Connection
+// 	Set up our end of a connection to mailbox "farBox" on machine
+//	"farHost", which sends to our mailbox "localBox"; and fork the
+//	threads that receive and retransmit its segments.
+//----------------------------------------------------------------------
+
+Connection::Connection(NetworkAddress farHost, MailBoxAddress farBox,
+		       MailBoxAddress localBox)
+{
+    ASSERT(kernel->postOfficeIn != NULL && kernel->postOfficeOut != NULL);
+    this->farHost = farHost;
+    this->farBox = farBox;
+    this->localBox = localBox;
+    lock = new Lock("connection");
+    windowOpen = new Condition("connection window open");
+    outstanding = new Condition("connection outstanding");
+    arrived = new Condition("connection arrived");
+    sendBase = nextSeq = expected = 0;
+    lastProgress = 0;
+    timeout = RetransmitTicks;
+    for (int i = 0; i < WindowSize; i++)
+	recvWindow[i].present = FALSE;
+    partialSize = MaxSegmentData;
+    partial = new char[partialSize];
+    partialLength = 0;
+    messages = new List<Message *>;
+
+    (new Thread("connection receiver", -1))->Fork(ReceiveThread, this);
+    (new Thread("connection retransmitter", -1))->Fork(RetransmitThread,
+						       this);
+}
+
+//----------------------------------------------------------------------
+// Connection::Transmit
+// 	Put the segment with header "hdr" and data "data" out as mail to
+//	the far end, building it in the post office's buffer.  Waits
+//	until the network has taken it.
+//----------------------------------------------------------------------
+
+void
+Connection::Transmit(SegmentHeader *hdr, char *data)
+{
+    Mail *mail = kernel->postOfficeOut->NewMail();
+
+    mail->pktHdr.to = farHost;
+    mail->mailHdr.to = farBox;
+    mail->mailHdr.from = localBox;
+    mail->mailHdr.length = sizeof(SegmentHeader) + hdr->length;
+    bcopy((char *) hdr, mail->data, sizeof(SegmentHeader));
+    bcopy(data, mail->data + sizeof(SegmentHeader), hdr->length);
+    DEBUG(dbgNet, "Segment " << hdr->seq << " out, ack " << hdr->ack
+	  << ", " << hdr->length << " bytes");
+    kernel->postOfficeOut->Send(mail);
+}
+
+//----------------------------------------------------------------------
+// Connection::Send
+// 	Cut "length" bytes at "data" into segments and send them, waiting
+//	while the window is full.  Returns once the last segment has gone
+//	out; call Flush to know it has arrived.
+//----------------------------------------------------------------------
+
+void
+Connection::Send(char *data, int length)
+{
+    int done = 0;
+
+    do {
+	int n = min(length - done, (int) MaxSegmentData);
+	WindowSlot seg;
+
+	lock->Acquire();
+	while (nextSeq - sendBase >= WindowSize)
+	    windowOpen->Wait(lock);
+	seg.hdr.seq = nextSeq;
+	seg.hdr.ack = expected;
+	seg.hdr.flags = SegData | (done + n == length ? SegLast : 0);
+	seg.hdr.length = n;
+	bcopy(data + done, seg.data, n);
+	seg.sentAt = kernel->stats->totalTicks;
+	sendWindow[nextSeq % WindowSize] = seg;
+	if (nextSeq++ == sendBase) {	// the retransmitter starts timing
+	    lastProgress = kernel->stats->totalTicks;
+	    outstanding->Signal(lock);
+	}
+	lock->Release();
+
+	Transmit(&seg.hdr, seg.data);
+	done += n;
+    } while (done < length);
+}
+
+//----------------------------------------------------------------------
+// Connection::Flush
+// 	Wait until every segment sent has been acknowledged.
+//----------------------------------------------------------------------
+
+void
+Connection::Flush()
+{
+    lock->Acquire();
+    while (sendBase != nextSeq)
+	windowOpen->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Connection::Receive
+// 	Wait for the next whole message from the far end, and copy up to
+//	"maxLength" bytes of it into "data" -- the rest, if any, is lost.
+//	Return the number of bytes copied.
+//----------------------------------------------------------------------
+
+int
+Connection::Receive(char *data, int maxLength)
+{
+    Message *msg;
+    int n;
+
+    lock->Acquire();
+    while (messages->IsEmpty())
+	arrived->Wait(lock);
+    msg = messages->RemoveFront();
+    lock->Release();
+
+    n = min(msg->length, maxLength);
+    bcopy(msg->data, data, n);
+    delete [] msg->data;
+    delete msg;
+    return n;
+}
+
+//----------------------------------------------------------------------
+// Connection::Accept
+// 	Add segment "seg", the next in order, to the message being put
+//	together; if it is the message's last, the message is complete.
+//	Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+Connection::Accept(WindowSlot *seg)
+{
+    if (partialLength + seg->hdr.length > partialSize) {
+	char *bigger = new char[2 * partialSize];
+
+	bcopy(partial, bigger, partialLength);
+	delete [] partial;
+	partial = bigger;
+	partialSize *= 2;
+    }
+    bcopy(seg->data, partial + partialLength, seg->hdr.length);
+    partialLength += seg->hdr.length;
+    if (seg->hdr.flags & SegLast) {
+	Message *msg = new Message;
+
+	msg->data = partial;
+	msg->length = partialLength;
+	messages->Append(msg);
+	arrived->Signal(lock);
+	partialSize = MaxSegmentData;
+	partial = new char[partialSize];
+	partialLength = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::ReceiveSegments
+// 	Take segments out of our mailbox, for ever.  The ack each carries
+//	lets go of the segments we sent that it covers.  A data segment
+//	within the window is kept, and handed on once those before it
+//	have been; each one, even a duplicate, is answered with an ack,
+//	in case the ack before was lost.
+//----------------------------------------------------------------------
+
+void
+Connection::ReceiveSegments()
+{
+    Mail *mail;
+    SegmentHeader hdr, ack;
+
+    for (;;) {
+	mail = kernel->postOfficeIn->Receive(localBox);
+	bcopy(mail->data, (char *) &hdr, sizeof(SegmentHeader));
+	ASSERT(mail->mailHdr.length == sizeof(SegmentHeader) + hdr.length);
+
+	lock->Acquire();
+	if (hdr.ack > sendBase && hdr.ack <= nextSeq) {
+	    for (; sendBase < hdr.ack; sendBase++)
+		kernel->stats->AddAckLatency(kernel->stats->totalTicks -
+			sendWindow[sendBase % WindowSize].sentAt);
+	    lastProgress = kernel->stats->totalTicks;
+	    timeout = RetransmitTicks;
+	    windowOpen->Broadcast(lock);
+	}
+	if (!(hdr.flags & SegData)) {
+	    lock->Release();
+	    kernel->postOfficeIn->Release(mail);
+	    continue;
+	}
+	if (hdr.seq >= expected && hdr.seq < expected + WindowSize) {
+	    WindowSlot *seg = &recvWindow[hdr.seq % WindowSize];
+
+	    if (!seg->present) {
+		seg->hdr = hdr;
+		bcopy(mail->data + sizeof(SegmentHeader), seg->data,
+		      hdr.length);
+		seg->present = TRUE;
+	    }
+	    while (recvWindow[expected % WindowSize].present) {
+		seg = &recvWindow[expected % WindowSize];
+		Accept(seg);
+		seg->present = FALSE;
+		expected++;
+	    }
+	}
+	ack.seq = nextSeq;
+	ack.ack = expected;
+	ack.flags = 0;
+	ack.length = 0;
+	lock->Release();
+	kernel->postOfficeIn->Release(mail);
+
+	Transmit(&ack, NULL);
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::Retransmit
+// 	For ever: wait for segments to be out, then check on them every
+//	"timeout" ticks; if no ack has come in that long, put every one
+//	still unacknowledged out again, and double "timeout".
+//----------------------------------------------------------------------
+
+void
+Connection::Retransmit()
+{
+    WindowSlot seg[WindowSize];
+    int count;
+
+    for (;;) {
+	lock->Acquire();
+	while (sendBase == nextSeq)
+	    outstanding->Wait(lock);
+	lock->Release();
+
+	kernel->alarm->WaitUntil(timeout);
+
+	lock->Acquire();
+	count = 0;
+	if (sendBase != nextSeq &&
+	    kernel->stats->totalTicks - lastProgress >= timeout) {
+	    for (int s = sendBase; s < nextSeq; s++) {
+		seg[count] = sendWindow[s % WindowSize];
+		seg[count++].hdr.ack = expected;
+	    }
+	    kernel->stats->numRetransmits += count;
+	    lastProgress = kernel->stats->totalTicks;
+	    timeout = min(2 * timeout, MaxRetransmitTicks);
+	}
+	lock->Release();
+
+	if (count > 0) {
+	    DEBUG(dbgNet, "Retransmitting " << count << " segments from "
+		  << seg[0].hdr.seq);
+	}
+	for (int i = 0; i < count; i++)
+	    Transmit(&seg[i].hdr, seg[i].data);
+    }
+}
@@ -0,0 +1,126 @@
+// transport.h
+//	Data structures for reliable, ordered delivery of messages of any
+//	length between two mailboxes on different machines, on top of the
+//	post office -- which may drop packets, and carries at most
+//	MaxMailSize bytes in each.
+//
+//	A message is cut into segments, each numbered, which go out as
+//	mail.  Up to WindowSize segments may be out at once, without
+//	waiting for them to be acknowledged; the receiver acknowledges
+//	every segment with the number of the next one it is missing (a
+//	cumulative ack), and the sender puts out again whatever is still
+//	unacknowledged when no ack has come for a while.  So the sender
+//	is held back by the time it takes to put packets on the network,
+//	rather than by the round trip for each one.
+//
+//	Both machines make a Connection naming the other's mailbox; each
+//	then may send to, and receive from, the other.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "copyright.h"
+#include "post.h"
+#include "synch.h"
+#include "list.h"
+
+#define WindowSize	8	// segments out at once, in each direction
+#define RetransmitTicks	(4 * WindowSize * NetworkTime)
+				// time without an ack after which the
+				// unacknowledged segments go out again
+#define MaxRetransmitTicks (64 * RetransmitTicks)
+				// what that time may double up to, while
+				// the far end does not answer
+
+// The following class defines the header put in front of the data of
+// each segment, inside the mail.
+
+#define SegData		0x1	// carries data (else it is only an ack)
+#define SegLast		0x2	// the last segment of a message
+
+class SegmentHeader {
+  public:
+    int seq;			// number of this segment
+    int ack;			// number of the next segment the sender
+				// of this one has yet to receive
+    unsigned short flags;	// SegData, SegLast
+    unsigned short length;	// bytes of data that follow
+};
+
+#define MaxSegmentData	(MaxMailSize - sizeof(SegmentHeader))
+
+// A segment, as kept by the sender until it is acknowledged, or by the
+// receiver until the ones before it have come.
+
+class WindowSlot {
+  public:
+    SegmentHeader hdr;
+    char data[MaxSegmentData];
+    bool present;		// receiver: it has arrived
+    int sentAt;			// sender: when it first went out
+};
+
+// A whole message, received but not yet asked for.
+
+class Message {
+  public:
+    char *data;
+    int length;
+};
+
+// The following class defines one end of a reliable connection.
+
+class Connection {
+  public:
+    Connection(NetworkAddress farHost, MailBoxAddress farBox,
+	       MailBoxAddress localBox);
+				// Talk to "farBox" on "farHost", taking
+				// what it sends from our "localBox"
+
+    void Send(char *data, int length);
+				// Send a message; returns once it is all
+				// in the send window
+    int Receive(char *data, int maxLength);
+				// Wait for the next message; copy up to
+				// "maxLength" bytes of it, returning how
+				// many
+    void Flush();		// Wait until all sent is acknowledged
+
+    void ReceiveSegments();	// Body of the receiving thread
+    void Retransmit();		// Body of the retransmitting thread
+
+  private:
+    NetworkAddress farHost;
+    MailBoxAddress farBox, localBox;
+
+    Lock *lock;			// protects all below
+    Condition *windowOpen;	// signalled when segments are acked
+    Condition *outstanding;	// signalled when segments go out into
+				// an empty window
+    Condition *arrived;		// signalled when a message is complete
+
+    WindowSlot sendWindow[WindowSize];	// by seq % WindowSize
+    int sendBase;		// oldest segment not acknowledged
+    int nextSeq;		// next segment to send
+    int lastProgress;		// when an ack last moved sendBase, or
+				// the window last became busy
+    int timeout;		// wait for an ack this long, from
+				// RetransmitTicks to MaxRetransmitTicks
+
+    WindowSlot recvWindow[WindowSize];	// by seq % WindowSize
+    int expected;		// next segment to hand on, in order
+    char *partial;		// the message being put together
+    int partialLength, partialSize;
+    List<Message *> *messages;	// complete, not yet received
+
+    void Transmit(SegmentHeader *hdr, char *data);
+				// Put a segment out as mail
+    void Accept(WindowSlot *seg);	// Add a segment, in order, to the
+				// message being put together
+};
+
+#endif // TRANSPORT_H
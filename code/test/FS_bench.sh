@@ -0,0 +1,51 @@
+# Time the file system: each benchmark runs against a freshly formatted
+# disk, and its simulated ticks, disk reads and writes, and host time
+# are reported.  Run "make" first to build the benchmark programs.
+NACHOS=../build.linux/nachos
+BENCH=/tmp/fsbench.$$
+head -c 16384 num_1000000.txt > $BENCH.16k
+head -c 65536 num_1000000.txt > $BENCH.64k
+
+report() {
+	echo "== $1"
+	shift
+	$NACHOS -st "$@" | grep "^Ticks\|^Host time\|^Disk I/O"
+}
+
+for chunk in 16 128 1024; do
+	$NACHOS -f
+	$NACHOS -cp fsbench_write$chunk /fsbench_write$chunk
+	report "sequential write, $chunk-byte chunks" -e /fsbench_write$chunk
+done
+
+for chunk in 16 128 1024; do
+	$NACHOS -f
+	$NACHOS -cp fsbench_read$chunk /fsbench_read$chunk
+	$NACHOS -cp $BENCH.16k /bench
+	report "sequential read, $chunk-byte chunks" -e /fsbench_read$chunk
+done
+
+$NACHOS -f
+$NACHOS -cp fsbench_random /fsbench_random
+$NACHOS -cp $BENCH.16k /bench
+report "random 4-sector reads" -e /fsbench_random
+
+$NACHOS -f
+$NACHOS -cp fsbench_storm /fsbench_storm
+$NACHOS -mkdir /storm
+report "create/delete storm" -e /fsbench_storm
+
+$NACHOS -f
+$NACHOS -cp fsbench_lookup /fsbench_lookup
+dir=
+for d in d1 d2 d3 d4 d5 d6 d7 d8; do
+	dir=$dir/$d
+	$NACHOS -mkdir $dir
+done
+$NACHOS -cp num_100.txt $dir/leaf
+report "deep path lookups" -e /fsbench_lookup
+
+$NACHOS -f
+report "large file import" -cp $BENCH.64k /large
+
+rm -f $BENCH.16k $BENCH.64k
@@ -1,22 +1,21 @@
 #include "syscall.h"
+#include "stdio.h"
 
 int main(void)
 {
 	// you should run FS_test1 first before running this one
-	char test[26];
+	char test[27];
 	char check[] = "abcdefghijklmnopqrstuvwxyz\n";
-	OpenFileId fid;
-	int count, success, i;
-	fid = Open("/file1");
-	if (fid <= 0) MSG("Failed on opening file");
-	count = Read(test, 27, fid);
-	if (count != 27) MSG("Failed on reading file");
-	success = Close(fid);
-	if (success != 1) MSG("Failed on closing file");
+	FILE *f;
+	int count, i;
+	f = fopen("/file1", "r");
+	if (f == 0) MSG("Failed on opening file");
+	count = fread(test, 1, 27, f);
+	if (count != 27 || fgetc(f) != EOF) MSG("Failed on reading file");
+	if (fclose(f) != 0) MSG("Failed on closing file");
 	for (i = 0; i < 27; ++i) {
 		if (test[i] != check[i]) MSG("Failed: reading wrong result");
 	}
 	MSG("Passed! ^_^");
 	Halt();
 }
-
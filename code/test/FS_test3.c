@@ -0,0 +1,36 @@
+#include "syscall.h"
+
+int main(void)
+{
+	char head[] = "abcdefghij";
+	char tail[] = "klmnopqrstuvwxyz\n";
+	char check[] = "abcdefghijklmnopqrstuvwxyz\n";
+	char first[5], rest[22];
+	IoVec out[2], in[2];
+	OpenFileId fid;
+	int count, success, i;
+	success = Create("/file3", 27);
+	if (success != 1) MSG("Failed on creating file");
+	fid = Open("/file3");
+	if (fid <= 0) MSG("Failed on opening file");
+	out[0].buffer = head; out[0].length = 10;
+	out[1].buffer = tail; out[1].length = 17;
+	count = WriteV(out, 2, fid);
+	if (count != 27) MSG("Failed on writing file");
+	success = Close(fid);
+	if (success != 1) MSG("Failed on closing file");
+	fid = Open("/file3");
+	if (fid <= 0) MSG("Failed on opening file");
+	in[0].buffer = first; in[0].length = 5;
+	in[1].buffer = rest; in[1].length = 22;
+	count = ReadV(in, 2, fid);
+	if (count != 27) MSG("Failed on reading file");
+	success = Close(fid);
+	if (success != 1) MSG("Failed on closing file");
+	for (i = 0; i < 27; ++i) {
+		if ((i < 5 ? first[i] : rest[i - 5]) != check[i])
+			MSG("Failed: reading wrong result");
+	}
+	MSG("Passed! ^_^");
+	Halt();
+}
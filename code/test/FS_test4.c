@@ -0,0 +1,49 @@
+#include "syscall.h"
+
+Ring ring;
+
+void Queue(int op, int arg0, int arg1, int arg2, int tag)
+{
+	RingRequest *req = &ring.sq[ring.sqTail % RingSize];
+	req->op = op;
+	req->arg[0] = arg0;
+	req->arg[1] = arg1;
+	req->arg[2] = arg2;
+	req->tag = tag;
+	ring.sqTail++;
+}
+
+int main(void)
+{
+	char test[] = "abcdefghijklmnopqrstuvwxyz\n";
+	char check[27];
+	OpenFileId fid;
+	int i;
+	if (RingSetup(&ring, 0) != 1) MSG("Failed on setting up ring");
+	Queue(SC_Create, (int) "/file4", 27, 0, 0);
+	Queue(SC_Open, (int) "/file4", 0, 0, 1);
+	if (RingSubmit() != 2) MSG("Failed on submitting");
+	if (ring.cq[0].result != 1) MSG("Failed on creating file");
+	fid = ring.cq[1].result;
+	if (fid <= 0) MSG("Failed on opening file");
+	ring.cqHead = 2;
+	// the rest, a few bytes per call, all with one submit
+	for (i = 0; i < 27; i += 9)
+		Queue(SC_Write, (int) (test + i), 9, fid, i);
+	Queue(SC_Close, fid, 0, 0, 27);
+	if (RingSubmit() != 4) MSG("Failed on submitting");
+	for (; ring.cqHead < ring.cqTail; ring.cqHead++) {
+		RingCompletion *done = &ring.cq[ring.cqHead % RingSize];
+		if (done->result != (done->tag < 27 ? 9 : 1))
+			MSG("Failed on writing file");
+	}
+	fid = Open("/file4");
+	if (fid <= 0) MSG("Failed on opening file");
+	if (Read(check, 27, fid) != 27) MSG("Failed on reading file");
+	Close(fid);
+	for (i = 0; i < 27; ++i) {
+		if (test[i] != check[i]) MSG("Failed: reading wrong result");
+	}
+	MSG("Passed! ^_^");
+	Halt();
+}
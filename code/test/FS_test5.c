@@ -0,0 +1,35 @@
+#include "syscall.h"
+
+int main(void)
+{
+	char data[] = "abcdefghijklmnopqrstuvwxyz";
+	char ch[2];
+	OpenFileId fid;
+	int count, success;
+	success = Create("/file5", 0);
+	if (success != 1) MSG("Failed on creating file");
+	fid = Open("/file5");
+	if (fid <= 0) MSG("Failed on opening file");
+	count = Write(data, 26, fid);
+	if (count != 26) MSG("Failed on writing file");
+	if (FileSize(fid) != 26) MSG("Failed: wrong file size");
+	if (Seek(3, SeekSet, fid) != 3) MSG("Failed on seeking file");
+	count = Read(ch, 2, fid);
+	if (count != 2 || ch[0] != 'd' || ch[1] != 'e')
+		MSG("Failed: reading wrong result");
+	if (Seek(10, SeekCurrent, fid) != 15) MSG("Failed on seeking file");
+	count = Read(ch, 1, fid);
+	if (count != 1 || ch[0] != 'p') MSG("Failed: reading wrong result");
+	if (Seek(-1, SeekEnd, fid) != 25) MSG("Failed on seeking file");
+	count = Read(ch, 1, fid);
+	if (count != 1 || ch[0] != 'z') MSG("Failed: reading wrong result");
+	if (Seek(-30, SeekEnd, fid) >= 0) MSG("Failed: seeking before start");
+	success = Remove("/file5");
+	if (success != 1) MSG("Failed on removing file");
+	if (FileSize(fid) != 26) MSG("Failed: removed file lost its data");
+	success = Close(fid);
+	if (success != 1) MSG("Failed on closing file");
+	if (Open("/file5") >= 0) MSG("Failed: removed file still opens");
+	MSG("Passed! ^_^");
+	Halt();
+}
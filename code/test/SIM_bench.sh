@@ -0,0 +1,61 @@
+# Time the simulator itself: how many guest instructions it runs a host
+# second on compute-bound programs, and the host time a system call and
+# a context switch take; and how the page table layouts compare.  Run
+# "make bench" first to build the programs.
+#
+# The system call and switch times are what those benchmarks took over
+# a run of "halt" -- booting and halting -- divided by how many they
+# made; the switch time also leaves out the sleeps' system calls.
+NACHOS=../build.linux/nachos
+
+# run <program>...: run them at once, and print the user instructions,
+# host milliseconds and context switches that took, and the most bytes
+# a page table took (with the layout $PT gives, if any)
+run() {
+	args=
+	for p in "$@"; do
+		args="$args -e /$p"
+	done
+	$NACHOS $PT -st $args | awk '
+		/^Ticks:/ { user = $NF }
+		/^Host time:/ { ms = $3 }
+		/^Threads: context switches/ { switches = $NF }
+		/^Memory paging:/ { table = $(NF - 1) }
+		END { print user + 0, ms + 0, switches + 0, table + 0 }'
+}
+
+$NACHOS -f
+for p in halt matmult sort simbench_int simbench_mem simbench_syscall \
+	simbench_switch simbench_sparse; do
+	$NACHOS -cp $p /$p
+done
+
+set -- $(run halt)
+base=$2
+echo "== boot and halt: $base ms"
+
+for p in matmult sort simbench_int simbench_mem; do
+	set -- $(run $p)
+	echo "== $p: $1 instructions in $2 ms," \
+	    $(awk "BEGIN { printf \"%.2f\", $1 / ($2 > 0 ? $2 : 1) / 1000 }") \
+	    "guest MIPS"
+done
+
+calls=10000		# NumCalls of simbench_syscall.c
+set -- $(run simbench_syscall)
+perCall=$(awk "BEGIN { printf \"%.2f\", ($2 - $base) * 1000 / $calls }")
+echo "== system call: $perCall us ($2 ms for $calls)"
+
+sleeps=4000		# two copies, NumSleeps each, of simbench_switch.c
+set -- $(run simbench_switch simbench_switch)
+echo "== context switch:" \
+    $(awk "BEGIN { printf \"%.2f\", (($2 - $base) * 1000 - $sleeps * $perCall) / ($3 > 0 ? $3 : 1) }") \
+    "us ($3 switches in $2 ms)"
+
+# a program using its address space densely, and one using it sparsely
+for pt in linear twolevel hashed; do
+	for p in simbench_mem simbench_sparse; do
+		set -- $(PT="-pt $pt" run $p)
+		echo "== $pt page table, $p: $2 ms, page table $4 bytes"
+	done
+done
@@ -0,0 +1,70 @@
+/* Two files appended to in turn, a little at a time, as two writers
+ * would; run with -delalloc, each should still be laid out in a run
+ * or two (see nachos -D), and read back as written, before and after
+ * the data is given its sectors.
+ */
+
+#include "syscall.h"
+
+#define Piece		100		/* bytes appended at a time */
+#define Rounds		150		/* pieces appended to each file */
+
+char piece[Piece], back[Piece];
+
+/* Return 1 if piece "n" of "fd" holds what was appended there. */
+int holdsPiece(OpenFileId fd, int n)
+{
+	int i;
+
+	if (Seek(n * Piece, SeekSet, fd) != n * Piece ||
+	    Read(back, Piece, fd) != Piece)
+		return 0;
+	for (i = 0; i < Piece; i++)
+		if (back[i] != (char) ('a' + (n + i) % 26))
+			return 0;
+	return 1;
+}
+
+/* Append piece "n" to "fd". */
+int append(OpenFileId fd, int n)
+{
+	int i;
+
+	for (i = 0; i < Piece; i++)
+		piece[i] = 'a' + (n + i) % 26;
+	return Seek(n * Piece, SeekSet, fd) == n * Piece &&
+	       Write(piece, Piece, fd) == Piece;
+}
+
+int main(void)
+{
+	OpenFileId a, b;
+	int n;
+
+	if (Create("/append_a", 0) != 1 || Create("/append_b", 0) != 1 ||
+	    (a = Open("/append_a")) < 0 || (b = Open("/append_b")) < 0)
+		MSG("Failed: could not make the files");
+	for (n = 0; n < Rounds; n++) {
+		if (!append(a, n) || !append(b, n))
+			MSG("Failed: could not append");
+		if (n % 50 == 49 && (!holdsPiece(a, n) || !holdsPiece(b, 0)))
+			MSG("Failed: what was appended did not read back");
+	}
+	if (FileSize(a) != Rounds * Piece || FileSize(b) != Rounds * Piece)
+		MSG("Failed: wrong size");
+
+	/* one is given its sectors now, the other as it is closed */
+	if (Fsync(a) != 1)
+		MSG("Failed: fsync");
+	Close(b);
+	b = Open("/append_b");
+	for (n = 0; n < Rounds; n++)
+		if (!holdsPiece(a, n) || !holdsPiece(b, n))
+			MSG("Failed: the files differ from what was written");
+	Close(a);
+	Close(b);
+	Remove("/append_a");
+	Remove("/append_b");
+	MSG("Passed! ^_^");
+	Halt();
+}
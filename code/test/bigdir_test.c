@@ -0,0 +1,107 @@
+#include "syscall.h"
+
+#define NumFiles	200		/* enough for the directory's index */
+#define Batch		16
+
+DirEntry entries[MaxReadDir];
+char seen[NumFiles];
+
+/* Put the name of file "i" in "name": /bd/f000 to /bd/f199. */
+void fileName(char *name, int i)
+{
+	char *p = "/bd/f";
+
+	while (*p != '\0')
+		*name++ = *p++;
+	*name++ = '0' + i / 100;
+	*name++ = '0' + i / 10 % 10;
+	*name++ = '0' + i % 10;
+	*name = '\0';
+}
+
+/* Return 1 if file "i" can be opened. */
+int exists(int i)
+{
+	char name[16];
+	OpenFileId fd;
+
+	fileName(name, i);
+	fd = Open(name);
+	if (fd < 0)
+		return 0;
+	Close(fd);
+	return 1;
+}
+
+/* List /bd, marking each file in "seen"; return how many are listed. */
+int listAll(void)
+{
+	int cursor = 0, n, i, k, total = 0;
+
+	for (i = 0; i < NumFiles; i++)
+		seen[i] = 0;
+	while ((n = ReadDir("/bd", entries, Batch, &cursor)) > 0) {
+		for (i = 0; i < n; i++) {
+			k = (entries[i].name[1] - '0') * 100 +
+			    (entries[i].name[2] - '0') * 10 +
+			    entries[i].name[3] - '0';
+			if (entries[i].name[0] != 'f' || k < 0 ||
+			    k >= NumFiles || seen[k])
+				MSG("Failed: wrong or repeated entry");
+			seen[k] = 1;
+			total++;
+		}
+	}
+	if (n < 0)
+		MSG("Failed: ReadDir");
+	return total;
+}
+
+int main(void)
+{
+	char name[16], other[16];
+	int i;
+
+	if (Mkdir("/bd") != 1)
+		MSG("Failed: Mkdir");
+	for (i = 0; i < NumFiles; i++) {
+		fileName(name, i);
+		if (Create(name, 0) != 1)
+			MSG("Failed: could not create the files");
+	}
+	fileName(name, 7);
+	if (Create(name, 0) >= 0)
+		MSG("Failed: created a name that is there");
+	for (i = 0; i < NumFiles; i++)
+		if (!exists(i))
+			MSG("Failed: a file is not found");
+	if (listAll() != NumFiles)
+		MSG("Failed: the listing is incomplete");
+
+	/* remove every other file, and move one to a free name */
+	for (i = 0; i < NumFiles; i += 2) {
+		fileName(name, i);
+		if (Remove(name) != 1)
+			MSG("Failed: could not remove a file");
+	}
+	fileName(name, 1);
+	fileName(other, 0);
+	if (Rename(name, other) != 1)
+		MSG("Failed: rename in a large directory");
+	for (i = 0; i < NumFiles; i++)
+		if (exists(i) != (i == 0 || (i % 2 == 1 && i != 1)))
+			MSG("Failed: wrong files left");
+	if (listAll() != NumFiles / 2)
+		MSG("Failed: the listing after removing is wrong");
+
+	/* and the names removed can be used again */
+	for (i = 2; i < NumFiles; i += 2) {
+		fileName(name, i);
+		if (Create(name, 0) != 1)
+			MSG("Failed: could not create a removed name");
+	}
+	if (listAll() != NumFiles - 1 || seen[1])
+		MSG("Failed: the last listing is wrong");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,51 @@
+#include "syscall.h"
+#include "malloc.h"
+
+#define Entries		1000	/* ints in each table, several pages */
+
+/* Run as "-e checkpoint_test", this builds its tables and saves itself
+ * in "checkpoint"; run again as "-restore checkpoint", it goes on from
+ * there, and finds the tables built without building them again.
+ */
+
+int table[Entries];		/* in the data */
+int sum;
+
+int main(void)
+{
+	int *heap, i, step, restored;
+	OpenFileId fd;
+
+	/* nothing but memory can be saved */
+	Create("ckptfile", 0);
+	fd = Open("ckptfile");
+	if (fd < 0 || Checkpoint("checkpoint") >= 0)
+		MSG("Failed: a program with a file open was saved");
+	Close(fd);
+	Remove("ckptfile");
+
+	/* the slow start-up */
+	if ((heap = (int *) malloc(Entries * sizeof(int))) == 0)
+		MSG("Failed: malloc");
+	for (i = 0; i < Entries; i++) {
+		for (step = 0; step < 20; step++)
+			table[i] += i % 7 + step;
+		heap[i] = table[i] * 2;
+		sum += table[i];
+	}
+	step = 12345;		/* on the stack */
+
+	if ((restored = Checkpoint("checkpoint")) < 0)
+		MSG("Failed: could not save");
+	for (i = 0; i < Entries; i++) {
+		if (heap[i] != table[i] * 2)
+			MSG("Failed: the heap was not kept");
+		sum -= table[i];
+	}
+	if (sum != 0 || step != 12345)
+		MSG("Failed: the data or the stack was not kept");
+	if (restored)
+		MSG("Passed! ^_^ (restored)");
+	MSG("Passed! ^_^ (saved)");
+	Halt();
+}
@@ -0,0 +1,16 @@
+#include "syscall.h"
+
+int main(void)
+{
+	char line[] = "written to the console\n";
+	int i;
+
+	for (i = 0; i < 20; i++)
+		if (PutString("put to the console\n") != 19)
+			MSG("Failed: PutString lost characters");
+	if (Write(line, sizeof(line) - 1, SysConsoleOutput) != sizeof(line) - 1)
+		MSG("Failed: console Write lost characters");
+	if (PutString((char *) -4) >= 0) MSG("Failed: bad address taken");
+	MSG("Passed! ^_^");
+	Halt();
+}
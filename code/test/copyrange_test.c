@@ -0,0 +1,54 @@
+#include "syscall.h"
+
+#define FileBytes	3000		/* many sectors, the last part full */
+
+char data[FileBytes];
+char back[FileBytes];
+
+/* Copy FileBytes bytes of "src", from "from" on, to a new file at "to",
+ * and check what lands there. */
+void check(OpenFileId src, char *name, int from, int to)
+{
+	OpenFileId dst;
+	int n = FileBytes - from;
+	int i;
+
+	Create(name, 0);
+	dst = Open(name);
+	if (dst < 0 || Seek(from, SeekSet, src) != from ||
+	    Seek(to, SeekSet, dst) != to)
+		MSG("Failed: could not set up the copy");
+	if (CopyRange(src, dst, FileBytes) != n)
+		MSG("Failed: wrong number of bytes copied");
+	if (Seek(0, SeekCurrent, src) != FileBytes ||
+	    Seek(0, SeekCurrent, dst) != to + n)
+		MSG("Failed: positions did not move");
+	Seek(to, SeekSet, dst);
+	if (Read(back, n, dst) != n)
+		MSG("Failed: copy is short");
+	for (i = 0; i < n; i++)
+		if (back[i] != data[from + i])
+			MSG("Failed: copy differs");
+	Close(dst);
+}
+
+int main(void)
+{
+	OpenFileId src;
+	int i;
+
+	for (i = 0; i < FileBytes; i++)
+		data[i] = 'a' + i % 26 + i / 256;
+	Create("crsource", 0);
+	src = Open("crsource");
+	if (src < 0 || Write(data, FileBytes, src) != FileBytes)
+		MSG("Failed: could not write the source");
+
+	check(src, "craligned", 0, 0);		/* sector to sector */
+	check(src, "crphase", 300, 44);		/* same offset in the sector */
+	check(src, "crskewed", 100, 0);		/* staged throughout */
+	if (CopyRange(src, src + 1, 10) >= 0)
+		MSG("Failed: copied to a file not open");
+	MSG("Passed! ^_^");
+	Halt();
+}
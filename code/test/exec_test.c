@@ -0,0 +1,19 @@
+#include "syscall.h"
+
+int main(void)
+{
+	SpaceId kids[4];
+	int i, status;
+	for (i = 0; i < 4; ++i) {
+		kids[i] = Exec("/exit_test");
+		if (kids[i] < 0) MSG("Failed on executing program");
+	}
+	for (i = 3; i >= 0; --i) {
+		status = Join(kids[i]);
+		if (status != 7) MSG("Failed: wrong exit status");
+	}
+	if (Join(kids[0]) >= 0) MSG("Failed: joined a program twice");
+	if (Exec("/no_such_program") >= 0) MSG("Failed: executed a missing program");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,6 @@
+#include "syscall.h"
+
+int main(void)
+{
+	Exit(7);
+}
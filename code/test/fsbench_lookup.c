@@ -0,0 +1,20 @@
+/* Open and close a file eight directories down, NumLookups times, as
+ * FS_bench.sh times it; the script makes the directories.
+ */
+
+#include "syscall.h"
+
+#define NumLookups	256
+
+int main(void)
+{
+	OpenFileId fid;
+	int i;
+
+	for (i = 0; i < NumLookups; i++) {
+		fid = Open("/d1/d2/d3/d4/d5/d6/d7/d8/leaf");
+		if (fid <= 0) MSG("Failed on opening file");
+		if (Close(fid) != 1) MSG("Failed on closing file");
+	}
+	Halt();
+}
@@ -0,0 +1,33 @@
+/* Read 4 sectors at a time from sectors of the file /bench chosen at
+ * random, as FS_bench.sh times it.
+ */
+
+#include "syscall.h"
+
+#define SectorBytes	128
+#define ReadSectors	4
+#define NumReads	256
+
+char buffer[ReadSectors * SectorBytes];
+
+int main(void)
+{
+	OpenFileId fid;
+	unsigned seed = 1;
+	int sectors, sector, i;
+
+	fid = Open("/bench");
+	if (fid <= 0) MSG("Failed on opening file");
+	sectors = FileSize(fid) / SectorBytes - ReadSectors + 1;
+	if (sectors <= 0) MSG("Failed: file too small");
+	for (i = 0; i < NumReads; i++) {
+		seed = seed * 1103515245 + 12345;
+		sector = (seed >> 16) % sectors;
+		if (Seek(sector * SectorBytes, SeekSet, fid) != sector * SectorBytes)
+			MSG("Failed on seeking file");
+		if (Read(buffer, sizeof(buffer), fid) != sizeof(buffer))
+			MSG("Failed on reading file");
+	}
+	if (Close(fid) != 1) MSG("Failed on closing file");
+	Halt();
+}
@@ -0,0 +1,27 @@
+/* Read the file /bench from the start to its end, Chunk bytes at a
+ * time, as FS_bench.sh times it.  Build with -DChunk=n for each size
+ * timed.
+ */
+
+#include "syscall.h"
+
+#ifndef Chunk
+#define Chunk		128
+#endif
+
+char buffer[Chunk];
+
+int main(void)
+{
+	OpenFileId fid;
+	int size, done, n;
+
+	fid = Open("/bench");
+	if (fid <= 0) MSG("Failed on opening file");
+	size = FileSize(fid);
+	for (done = 0; (n = Read(buffer, Chunk, fid)) > 0; done += n)
+		;
+	if (n < 0 || done != size) MSG("Failed on reading file");
+	if (Close(fid) != 1) MSG("Failed on closing file");
+	Halt();
+}
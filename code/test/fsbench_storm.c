@@ -0,0 +1,39 @@
+/* Fill the directory /storm with NumFiles small files, then remove
+ * them all, NumRounds times over, as FS_bench.sh times it.
+ */
+
+#include "syscall.h"
+
+#define NumFiles	32
+#define NumRounds	8
+
+char name[] = "/storm/f00";
+char data[] = "storm";
+
+void Name(int i)
+{
+	name[8] = '0' + i / 10;
+	name[9] = '0' + i % 10;
+}
+
+int main(void)
+{
+	OpenFileId fid;
+	int round, i;
+
+	for (round = 0; round < NumRounds; round++) {
+		for (i = 0; i < NumFiles; i++) {
+			Name(i);
+			if (Create(name, 0) != 1) MSG("Failed on creating file");
+			fid = Open(name);
+			if (fid <= 0) MSG("Failed on opening file");
+			if (Write(data, 5, fid) != 5) MSG("Failed on writing file");
+			if (Close(fid) != 1) MSG("Failed on closing file");
+		}
+		for (i = 0; i < NumFiles; i++) {
+			Name(i);
+			if (Remove(name) != 1) MSG("Failed on removing file");
+		}
+	}
+	Halt();
+}
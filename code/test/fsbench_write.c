@@ -0,0 +1,29 @@
+/* Write a BenchBytes file from the start, Chunk bytes at a time, as
+ * FS_bench.sh times it.  Build with -DChunk=n for each size timed.
+ */
+
+#include "syscall.h"
+
+#ifndef Chunk
+#define Chunk		128
+#endif
+#define BenchBytes	16384
+
+char buffer[Chunk];
+
+int main(void)
+{
+	OpenFileId fid;
+	int done, i;
+
+	for (i = 0; i < Chunk; i++)
+		buffer[i] = 'a' + i % 26;
+	if (Create("/bench", 0) != 1) MSG("Failed on creating file");
+	fid = Open("/bench");
+	if (fid <= 0) MSG("Failed on opening file");
+	for (done = 0; done < BenchBytes; done += Chunk)
+		if (Write(buffer, Chunk, fid) != Chunk)
+			MSG("Failed on writing file");
+	if (Close(fid) != 1) MSG("Failed on closing file");
+	Halt();
+}
@@ -0,0 +1,43 @@
+#include "syscall.h"
+
+int main(void)
+{
+	FsStats before, after;
+	char buf[64];
+	OpenFileId fid;
+	int i;
+
+	if (GetFsStats(&before) != 0) MSG("Failed: no file system statistics");
+	if (Create("/fsstats", 0) != 1) MSG("Failed on creating file");
+	fid = Open("/fsstats");
+	if (fid < 0) MSG("Failed on opening file");
+	for (i = 0; i < 64; i++)
+		buf[i] = 'a' + i % 26;
+	if (Write(buf, 64, fid) != 64) MSG("Failed on writing file");
+	if (Seek(0, SeekSet, fid) != 0) MSG("Failed on seeking file");
+	if (Read(buf, 64, fid) != 64) MSG("Failed on reading file");
+	if (Close(fid) != 1) MSG("Failed on closing file");
+	if (Remove("/fsstats") != 1) MSG("Failed on removing file");
+	if (GetFsStats(&after) != 0) MSG("Failed: no file system statistics");
+
+	if (after.ops[FsCreateOp] != before.ops[FsCreateOp] + 1 ||
+	    after.ops[FsOpenOp] != before.ops[FsOpenOp] + 1 ||
+	    after.ops[FsReadOp] != before.ops[FsReadOp] + 1 ||
+	    after.ops[FsWriteOp] != before.ops[FsWriteOp] + 1 ||
+	    after.ops[FsRemoveOp] != before.ops[FsRemoveOp] + 1)
+		MSG("Failed: operations miscounted");
+	if (after.ops[FsLookupOp] <= before.ops[FsLookupOp])
+		MSG("Failed: no lookups counted");
+	if (after.userBytesRead != before.userBytesRead + 64 ||
+	    after.userBytesWritten != before.userBytesWritten + 64)
+		MSG("Failed: user bytes miscounted");
+	for (i = 0; i < FsNumOps; i++)
+		if (after.opTicks[i] < before.opTicks[i])
+			MSG("Failed: bad operation ticks");
+	if (after.bufferHits + after.bufferMisses <=
+	    before.bufferHits + before.bufferMisses)
+		MSG("Failed: no buffer cache use counted");
+	if (GetFsStats((FsStats *) -4) >= 0) MSG("Failed: bad address taken");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,36 @@
+#include "syscall.h"
+#include "mutex.h"
+
+/* One of futex_test's children: attach the segment whose id comes in
+ * on the console input, count up in it under its lock as futex_test
+ * does, and exit with how many times that was.
+ */
+
+#define Rounds		300
+
+typedef struct {
+	Mutex lock;
+	int count;
+} Shared;
+
+char id;
+
+int main(void)
+{
+	Shared *shared;
+	int i, j, n;
+
+	if (Read(&id, 1, SysConsoleInput) != 1)
+		MSG("Failed: no segment id");
+	if ((shared = (Shared *) ShmAttach(id, 0)) == (Shared *) -1)
+		MSG("Failed: ShmAttach");
+	for (i = 0; i < Rounds; i++) {
+		MutexLock(&shared->lock);
+		n = shared->count;
+		for (j = 0; j < 20; j++)
+			;
+		shared->count = n + 1;
+		MutexUnlock(&shared->lock);
+	}
+	Exit(Rounds);
+}
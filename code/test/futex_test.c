@@ -0,0 +1,69 @@
+#include "syscall.h"
+#include "mutex.h"
+
+#define Workers		2	/* children, besides us */
+#define Rounds		300	/* times each counts under the lock */
+
+/* What futex_child and we share: the lock, and what it guards. */
+typedef struct {
+	Mutex lock;
+	int count;
+} Shared;
+
+Shared *shared;
+
+/* Count up "Rounds" times, each time slowly enough that others often
+ * find the lock held, and have to wait for it.
+ */
+void Work(void)
+{
+	int i, j, n;
+
+	for (i = 0; i < Rounds; i++) {
+		MutexLock(&shared->lock);
+		n = shared->count;
+		for (j = 0; j < 20; j++)
+			;
+		shared->count = n + 1;
+		MutexUnlock(&shared->lock);
+	}
+}
+
+int main(void)
+{
+	OpenFileId ends[2];
+	SpaceId kids[Workers];
+	int id, i;
+	char c;
+
+	if ((id = ShmCreate(sizeof(Shared))) < 0)
+		MSG("Failed: ShmCreate");
+	if ((shared = (Shared *) ShmAttach(id, 0)) == (Shared *) -1)
+		MSG("Failed: ShmAttach");
+	c = id;
+	for (i = 0; i < Workers; i++) {
+		if (Pipe(ends) != 1)
+			MSG("Failed: Pipe");
+		if ((kids[i] = ExecWith("/futex_child", ends[0], -1)) < 0)
+			MSG("Failed: ExecWith");
+		Close(ends[0]);
+		Write(&c, 1, ends[1]);
+		Close(ends[1]);
+	}
+	Work();
+	for (i = 0; i < Workers; i++)
+		if (Join(kids[i]) != Rounds)
+			MSG("Failed: a child did not finish its rounds");
+	if (shared->count != (Workers + 1) * Rounds || shared->lock != 0)
+		MSG("Failed: the lock let two count at once");
+
+	/* the word must hold what is expected, and be one we may write */
+	if (FutexWait(&shared->count, 0) != 0)
+		MSG("Failed: waited on a word that had changed");
+	if (FutexWake(&shared->count, 1) != 0)
+		MSG("Failed: woke someone who was not waiting");
+	if (FutexWait((int *) 2, 0) >= 0 || FutexWake((int *) main, 1) >= 0)
+		MSG("Failed: waited on a word not ours to write");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,34 @@
+#include "syscall.h"
+
+int main(void)
+{
+	StatsSnapshot before, after;
+	int old[4];
+	int i;
+
+	if (GetStats(&before, sizeof(before)) != sizeof(before))
+		MSG("Failed: no statistics");
+	if (before.version != StatsVersion || before.size != sizeof(before))
+		MSG("Failed: wrong version or size");
+	for (i = 0; i < 10; i++)
+		Sleep(100);
+	if (GetStats(&after, sizeof(after)) != sizeof(after))
+		MSG("Failed: no statistics");
+	if (after.totalTicks < before.totalTicks + 1000 ||
+	    after.userTicks <= before.userTicks ||
+	    after.systemTicks <= before.systemTicks)
+		MSG("Failed: ticks did not go up");
+	if (after.contextSwitches <= before.contextSwitches)
+		MSG("Failed: no context switches counted");
+
+	old[3] = -1;			/* a program with a shorter struct */
+	if (GetStats((StatsSnapshot *) old, 3 * sizeof(int)) != 3 * sizeof(int))
+		MSG("Failed: short snapshot");
+	if (old[0] != StatsVersion || old[2] < after.totalTicks ||
+	    old[3] != -1)
+		MSG("Failed: short snapshot overran");
+	if (GetStats((StatsSnapshot *) -4, sizeof(after)) >= 0)
+		MSG("Failed: bad address taken");
+	MSG("Passed! ^_^");
+	Halt();
+}
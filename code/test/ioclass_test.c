@@ -0,0 +1,27 @@
+#include "syscall.h"
+
+char buffer[1024];
+
+int main(void)
+{
+	OpenFileId fd;
+
+	if (SetIoClass(IoClassIdle) != IoClassBestEffort)
+		MSG("Failed: wrong starting class");
+	if (SetIoClass(-1) >= 0 || SetIoClass(3) >= 0)
+		MSG("Failed: set a class that is not one");
+	if (SetIoClass(IoClassRealtime) != IoClassIdle)
+		MSG("Failed: class not kept");
+
+	/* the disk still works, whatever the class */
+	if (Create("/ioclass", 0) != 1)
+		MSG("Failed: Create");
+	fd = Open("/ioclass");
+	if (fd < 0 || Write(buffer, 1024, fd) != 1024)
+		MSG("Failed: Write");
+	Close(fd);
+	if (SetIoClass(IoClassBestEffort) != IoClassRealtime)
+		MSG("Failed: class not kept");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,74 @@
+/* malloc.c
+ *	Memory a user program allocates as it runs (see malloc.h).
+ */
+
+#include "syscall.h"
+#include "malloc.h"
+
+/* Each block starts with a header; a free one is on the free list,
+ * kept in address order, so that neighbours can be merged.
+ */
+typedef struct Block {
+	int size;			/* bytes, the header's included */
+	struct Block *next;		/* the next free block, if free */
+} Block;
+
+static Block *freeList = 0;
+
+/* Take the first free block big enough, splitting off what is left of
+ * it if that is worth keeping; or grow the heap by just what is needed.
+ */
+void *malloc(int size)
+{
+	Block **prev, *b, *rest;
+	int need;
+
+	if (size <= 0)
+		return 0;
+	need = (size + sizeof(Block) + 7) & ~7;
+	for (prev = &freeList; (b = *prev) != 0; prev = &b->next)
+		if (b->size >= need) {
+			if (b->size - need >= 2 * (int) sizeof(Block)) {
+				rest = (Block *) ((char *) b + need);
+				rest->size = b->size - need;
+				rest->next = b->next;
+				*prev = rest;
+				b->size = need;
+			} else
+				*prev = b->next;
+			return b + 1;
+		}
+	b = (Block *) Sbrk(need);
+	if (b == (Block *) -1)
+		return 0;
+	b->size = need;
+	return b + 1;
+}
+
+/* Put the block back on the free list, in its place, merging it with
+ * the free blocks just before and after it.
+ */
+void free(void *p)
+{
+	Block *b = (Block *) p - 1;
+	Block *before = 0, *after = freeList;
+
+	if (p == 0)
+		return;
+	while (after != 0 && after < b) {
+		before = after;
+		after = after->next;
+	}
+	if (after != 0 && (char *) b + b->size == (char *) after) {
+		b->size += after->size;
+		after = after->next;
+	}
+	b->next = after;
+	if (before == 0)
+		freeList = b;
+	else if ((char *) before + before->size == (char *) b) {
+		before->size += b->size;
+		before->next = b->next;
+	} else
+		before->next = b;
+}
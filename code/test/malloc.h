@@ -0,0 +1,15 @@
+/* malloc.h
+ *	Memory a user program allocates as it runs, out of its heap (see
+ *	Sbrk), rather than sized in at compile time.  Blocks given back
+ *	are kept, merged with their free neighbours, for the next malloc;
+ *	the heap only grows when none is big enough.
+ */
+
+#ifndef MALLOC_H
+#define MALLOC_H
+
+void *malloc(int size);		/* "size" bytes, 8-byte aligned; 0 if
+				 * the heap cannot grow enough */
+void free(void *p);		/* give back what malloc returned */
+
+#endif /* MALLOC_H */
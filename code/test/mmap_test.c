@@ -0,0 +1,48 @@
+#include "syscall.h"
+
+#define FileBytes	1000		/* several pages, the last one part full */
+
+char data[FileBytes];
+char back[FileBytes];
+
+int main(void)
+{
+	OpenFileId fd;
+	char *map;
+	int i;
+
+	for (i = 0; i < FileBytes; i++)
+		data[i] = 'a' + i % 26;
+	Create("mmapfile", 0);
+	fd = Open("mmapfile");
+	if (fd < 0 || Write(data, FileBytes, fd) != FileBytes)
+		MSG("Failed: could not write the file");
+
+	map = (char *) Mmap(fd);
+	if ((int) map < 0)
+		MSG("Failed: could not map the file");
+	Close(fd);			/* the mapping keeps it open */
+	for (i = 0; i < FileBytes; i++)
+		if (map[i] != data[i])
+			MSG("Failed: mapped bytes differ from the file");
+	if (map[FileBytes] != 0)
+		MSG("Failed: past the end is not zero");
+	for (i = 0; i < FileBytes; i += 7)
+		map[i] = data[i] = 'A' + i % 26;
+	map[FileBytes] = 'x';		/* lost: past the end */
+	if (Munmap(map) != 0)
+		MSG("Failed: could not unmap the file");
+	if (Munmap(map) >= 0)
+		MSG("Failed: unmapped twice");
+
+	fd = Open("mmapfile");
+	if (Read(back, FileBytes, fd) != FileBytes || Read(back, 1, fd) != 0)
+		MSG("Failed: the file changed length");
+	for (i = 0; i < FileBytes; i++)
+		if (back[i] != data[i])
+			MSG("Failed: writes were not written back");
+	if (Mmap(fd + 1) >= 0)
+		MSG("Failed: mapped a file not open");
+	MSG("Passed! ^_^");
+	Halt();
+}
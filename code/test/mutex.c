@@ -0,0 +1,32 @@
+/* mutex.c
+ *	A lock kept in user memory (see mutex.h).
+ */
+
+#include "syscall.h"
+#include "mutex.h"
+
+/* Take the lock, waiting while someone else holds it.  A program that
+ * has to wait marks the lock 2 first, so that whoever lets it go
+ * knows to wake someone; and, woken, it takes the lock as 2 again,
+ * since it cannot know whether others still wait.
+ */
+void MutexLock(Mutex *m)
+{
+	int c;
+
+	if ((c = CompareAndSwap(m, 0, 1)) == 0)
+		return;
+	do {
+		if (c == 2 || CompareAndSwap(m, 1, 2) != 0)
+			FutexWait(m, 2);
+	} while ((c = CompareAndSwap(m, 0, 2)) != 0);
+}
+
+/* Let the lock go, and wake a waiter if there may be one. */
+void MutexUnlock(Mutex *m)
+{
+	if (CompareAndSwap(m, 1, 0) == 1)
+		return;
+	*m = 0;
+	FutexWake(m, 1);
+}
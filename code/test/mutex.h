@@ -0,0 +1,19 @@
+/* mutex.h
+ *	A lock kept in user memory, for programs sharing a segment (see
+ *	ShmCreate).  Taking it when it is free, and letting it go when no
+ *	one waits for it, is one CompareAndSwap, with no system call; only
+ *	a program that finds it held goes into the kernel, to FutexWait.
+ *
+ *	The word is 0 when the lock is free, 1 when it is held, and 2
+ *	when it is held and others may be waiting for it.
+ */
+
+#ifndef MUTEX_H
+#define MUTEX_H
+
+typedef int Mutex;		/* 0, free, to start with */
+
+void MutexLock(Mutex *m);
+void MutexUnlock(Mutex *m);
+
+#endif /* MUTEX_H */
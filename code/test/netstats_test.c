@@ -0,0 +1,18 @@
+#include "syscall.h"
+
+int main(void)
+{
+	NetStats stats;
+	int i;
+
+	if (GetNetStats(&stats) != 0) MSG("Failed: no network statistics");
+	if (stats.packetsSent < 0 || stats.packetsRecvd < 0)
+		MSG("Failed: bad packet counts");
+	if (stats.packetsDropped + stats.packetsRefused > stats.packetsSent)
+		MSG("Failed: more packets lost than sent");
+	for (i = 0; i < NetLatencyBuckets; i++)
+		if (stats.ackLatency[i] < 0) MSG("Failed: bad latency count");
+	if (GetNetStats((NetStats *) -4) >= 0) MSG("Failed: bad address taken");
+	MSG("Passed! ^_^");
+	Halt();
+}
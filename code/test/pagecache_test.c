@@ -0,0 +1,61 @@
+#include "syscall.h"
+
+#define FileBytes	1000		/* several pages, the last one part full */
+
+char data[FileBytes];
+char back[FileBytes];
+
+int main(void)
+{
+	OpenFileId fd;
+	char *map, *again;
+	int i;
+
+	for (i = 0; i < FileBytes; i++)
+		data[i] = 'a' + i % 26;
+	Create("cachefile", 0);
+	fd = Open("cachefile");
+	if (fd < 0 || Write(data, FileBytes, fd) != FileBytes)
+		MSG("Failed: could not write the file");
+
+	map = (char *) Mmap(fd);
+	again = (char *) Mmap(fd);	/* the same frames, twice */
+	if ((int) map < 0 || (int) again < 0 || map == again)
+		MSG("Failed: could not map the file twice");
+	for (i = 0; i < FileBytes; i += 7)
+		map[i] = data[i] = 'A' + i % 26;
+	for (i = 0; i < FileBytes; i++)
+		if (again[i] != data[i])
+			MSG("Failed: one mapping does not see the other's writes");
+
+	/* a read sees the mapped writes before they are written back */
+	if (Seek(0, SeekSet, fd) < 0 || Read(back, FileBytes, fd) != FileBytes)
+		MSG("Failed: could not read the file");
+	for (i = 0; i < FileBytes; i++)
+		if (back[i] != data[i])
+			MSG("Failed: a read does not see the mapped writes");
+
+	/* and the mappings see a write */
+	for (i = 0; i < FileBytes; i += 5)
+		data[i] = '0' + i % 10;
+	if (Seek(0, SeekSet, fd) < 0 || Write(data, FileBytes, fd) != FileBytes)
+		MSG("Failed: could not write the file again");
+	for (i = 0; i < FileBytes; i++)
+		if (map[i] != data[i] || again[i] != data[i])
+			MSG("Failed: a mapping does not see a write");
+
+	map[FileBytes] = 'x';		/* lost: past the end */
+	if (Munmap(map) != 0 || Munmap(again) != 0)
+		MSG("Failed: could not unmap the file");
+	map = (char *) Mmap(fd);
+	if ((int) map < 0 || map[FileBytes] != 0)
+		MSG("Failed: past the end is not zero when mapped again");
+	Munmap(map);
+	Close(fd);
+
+	fd = Open("cachefile");
+	if (Read(back, FileBytes, fd) != FileBytes || Read(back, 1, fd) != 0)
+		MSG("Failed: the file changed length");
+	MSG("Passed! ^_^");
+	Halt();
+}
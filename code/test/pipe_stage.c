@@ -0,0 +1,20 @@
+#include "syscall.h"
+
+/* One stage of pipe_test's pipeline: copy the console input to the
+ * console output, until end of file, and exit with how many bytes
+ * that was.
+ */
+
+char buffer[100];
+
+int main(void)
+{
+	int n, total = 0;
+
+	while ((n = Read(buffer, sizeof(buffer), SysConsoleInput)) > 0) {
+		if (Write(buffer, n, SysConsoleOutput) != n)
+			MSG("Failed: a stage lost bytes");
+		total += n;
+	}
+	Exit(total);
+}
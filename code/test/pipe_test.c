@@ -0,0 +1,61 @@
+#include "syscall.h"
+
+#define Stages		2
+#define NumBytes	2000	/* less than the pipes hold between them */
+
+char data[NumBytes], back[NumBytes + 1];
+
+int main(void)
+{
+	OpenFileId ends[2], head, from;
+	SpaceId kids[Stages];
+	int i, n, got;
+
+	/* a pipeline: us | pipe_stage | pipe_stage | us */
+	if (Pipe(ends) != 1)
+		MSG("Failed: Pipe");
+	head = ends[1];
+	for (i = 0; i < Stages; i++) {
+		from = ends[0];
+		if (Pipe(ends) != 1)
+			MSG("Failed: Pipe");
+		kids[i] = ExecWith("/pipe_stage", from, ends[1]);
+		if (kids[i] < 0)
+			MSG("Failed: ExecWith");
+		Close(from);		/* the stage holds them now */
+		Close(ends[1]);
+	}
+	for (i = 0; i < NumBytes; i++)
+		data[i] = 'a' + i % 26;
+	if (Write(data, NumBytes, head) != NumBytes)
+		MSG("Failed: could not write into the pipeline");
+	Close(head);
+	got = 0;
+	while ((n = Read(&back[got], NumBytes + 1 - got, ends[0])) > 0)
+		got += n;
+	if (n < 0 || got != NumBytes)
+		MSG("Failed: the pipeline lost or made up bytes");
+	for (i = 0; i < NumBytes; i++)
+		if (back[i] != data[i])
+			MSG("Failed: the pipeline changed the bytes");
+	for (i = 0; i < Stages; i++)
+		if (Join(kids[i]) != NumBytes)
+			MSG("Failed: a stage did not copy everything");
+	Close(ends[0]);
+
+	/* the wrong end, and ends that are gone */
+	if (Pipe(ends) != 1)
+		MSG("Failed: Pipe");
+	if (Read(back, 1, ends[1]) >= 0 || Write(data, 1, ends[0]) >= 0)
+		MSG("Failed: used an end the wrong way");
+	if (ExecWith("/pipe_stage", ends[1], -1) >= 0)
+		MSG("Failed: passed a write end as input");
+	Close(ends[0]);
+	if (Write(data, 1, ends[1]) >= 0)
+		MSG("Failed: wrote to a pipe no one reads");
+	Close(ends[1]);
+	if (Write(data, 1, ends[1]) >= 0 || Close(ends[1]) >= 0)
+		MSG("Failed: used a closed end");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,58 @@
+#include "syscall.h"
+
+#define Size		20000		/* bytes given to the file */
+#define Chunk		500		/* bytes read and written at once */
+
+char buf[Chunk];
+
+/* Return 1 if the next "Chunk" bytes of "fd" are all "c". */
+int readsAs(OpenFileId fd, char c)
+{
+	int i;
+
+	if (Read(buf, Chunk, fd) != Chunk)
+		return 0;
+	for (i = 0; i < Chunk; i++)
+		if (buf[i] != c)
+			return 0;
+	return 1;
+}
+
+int main(void)
+{
+	OpenFileId fd;
+	int i;
+
+	if (Create("/prealloc", 0) != 1 || (fd = Open("/prealloc")) < 0)
+		MSG("Failed: could not make the file");
+
+	/* keeping the size, the space is there but the file is empty */
+	if (Preallocate(fd, Size, PreallocKeepSize) != 1 ||
+	    FileSize(fd) != 0)
+		MSG("Failed: preallocate keeping the size");
+
+	/* otherwise the file grows, and reads as zeros */
+	if (Preallocate(fd, Size, 0) != 1 || FileSize(fd) != Size)
+		MSG("Failed: preallocate growing the file");
+	for (i = 0; i < Size / Chunk; i++)
+		if (!readsAs(fd, 0))
+			MSG("Failed: preallocated space did not read as zeros");
+
+	/* writes into it keep the size it has */
+	for (i = 0; i < Chunk; i++)
+		buf[i] = 'x';
+	if (Seek(Size - Chunk, SeekSet, fd) != Size - Chunk ||
+	    Write(buf, Chunk, fd) != Chunk || FileSize(fd) != Size ||
+	    Seek(Size - Chunk, SeekSet, fd) != Size - Chunk ||
+	    !readsAs(fd, 'x'))
+		MSG("Failed: writing into preallocated space");
+
+	/* what must fail */
+	if (Preallocate(fd, -1, 0) >= 0 || Preallocate(fd, Size, 2) >= 0 ||
+	    Preallocate(fd + 100, Size, 0) >= 0)
+		MSG("Failed: a bad preallocate did not fail");
+	Close(fd);
+	Remove("/prealloc");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,11 @@
+#include "syscall.h"
+
+int main(void)
+{
+	if (SetPriority(20) != 16) MSG("Failed: wrong starting priority");
+	if (SetPriority(32) >= 0 || SetPriority(-1) >= 0)
+		MSG("Failed: set a priority out of range");
+	if (SetPriority(0) != 20) MSG("Failed: priority not kept");
+	MSG("Passed! ^_^");
+	Halt();
+}
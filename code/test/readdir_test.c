@@ -0,0 +1,75 @@
+#include "syscall.h"
+
+#define NumFiles	40		/* more than one ReadDir returns */
+#define Batch		8
+
+DirEntry entries[MaxReadDir];
+char seen[NumFiles];
+
+/* Put the name of file "i" in "name": /rd/f00 to /rd/f39. */
+void fileName(char *name, int i)
+{
+	char *p = "/rd/f";
+
+	while (*p != '\0')
+		*name++ = *p++;
+	*name++ = '0' + i / 10;
+	*name++ = '0' + i % 10;
+	*name = '\0';
+}
+
+int main(void)
+{
+	char name[16];
+	int cursor, n, i, k, files, dirs, bytes;
+
+	if (Mkdir("/rd") != 1 || Mkdir("/rd") >= 0)
+		MSG("Failed: Mkdir");
+	for (i = 0; i < NumFiles; i++) {
+		fileName(name, i);
+		if (Create(name, 10 * i) != 1)
+			MSG("Failed: could not create the files");
+	}
+	if (Mkdir("/rd/sub") != 1)
+		MSG("Failed: Mkdir of a subdirectory");
+
+	/* read the directory a batch at a time */
+	cursor = files = dirs = bytes = 0;
+	while ((n = ReadDir("/rd", entries, Batch, &cursor)) > 0) {
+		if (n > Batch)
+			MSG("Failed: too many entries returned");
+		for (i = 0; i < n; i++) {
+			if (entries[i].type == 'D') {
+				if (entries[i].name[0] != 's')
+					MSG("Failed: wrong directory");
+				dirs++;
+				continue;
+			}
+			k = (entries[i].name[1] - '0') * 10 +
+				entries[i].name[2] - '0';
+			if (entries[i].type != 'F' || entries[i].name[0] != 'f' ||
+			    k < 0 || k >= NumFiles || seen[k])
+				MSG("Failed: wrong or repeated file");
+			if (entries[i].size != 10 * k || entries[i].sector <= 1)
+				MSG("Failed: wrong size or sector");
+			seen[k] = 1;
+			files++;
+			bytes += entries[i].size;
+		}
+	}
+	if (n < 0 || files != NumFiles || dirs != 1 ||
+	    bytes != 10 * NumFiles * (NumFiles - 1) / 2)
+		MSG("Failed: the listing is incomplete");
+	if (ReadDir("/rd", entries, Batch, &cursor) != 0)
+		MSG("Failed: the end did not stay the end");
+
+	cursor = 0;
+	if (ReadDir("/rd", entries, 1000, &cursor) != MaxReadDir)
+		MSG("Failed: a large count is not cut to MaxReadDir");
+	cursor = 0;
+	if (ReadDir("/rd/f01", entries, Batch, &cursor) >= 0 ||
+	    ReadDir("/nothing", entries, Batch, &cursor) >= 0)
+		MSG("Failed: listed something that is not a directory");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,18 @@
+#include "syscall.h"
+
+int main(void)
+{
+	char line[16];
+	int n, lines = 0;
+
+	if (ReadLine((char *) -4, 16) >= 0) MSG("Failed: bad address taken");
+	while ((n = ReadLine(line, sizeof(line))) > 0) {
+		if (n >= sizeof(line) || line[n] != '\0')
+			MSG("Failed: line not terminated");
+		if (line[n - 1] == '\n')
+			lines++;
+		PutString(line);
+	}
+	if (n < 0) MSG("Failed: read from the console");
+	Exit(lines);
+}
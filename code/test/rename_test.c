@@ -0,0 +1,66 @@
+#include "syscall.h"
+
+#define Size		300		/* bytes in the file moved about */
+
+char data[Size], back[Size];
+
+/* Return 1 if the file "name" holds the bytes of "data". */
+int holdsData(char *name)
+{
+	OpenFileId fd = Open(name);
+	int i, n;
+
+	if (fd < 0)
+		return 0;
+	n = Read(back, Size, fd);
+	Close(fd);
+	if (n != Size)
+		return 0;
+	for (i = 0; i < Size; i++)
+		if (back[i] != data[i])
+			return 0;
+	return 1;
+}
+
+int main(void)
+{
+	OpenFileId fd;
+	int i;
+
+	for (i = 0; i < Size; i++)
+		data[i] = 'a' + i % 26;
+	if (Mkdir("/mv") != 1 || Mkdir("/mv/d1") != 1 ||
+	    Mkdir("/mv/d2") != 1 || Create("/mv/d1/f", 0) != 1)
+		MSG("Failed: could not make the tree");
+	fd = Open("/mv/d1/f");
+	if (fd < 0 || Write(data, Size, fd) != Size)
+		MSG("Failed: could not write the file");
+
+	/* in one directory, then to another, with the file open */
+	if (Rename("/mv/d1/f", "/mv/d1/g") != 1 || Open("/mv/d1/f") >= 0 ||
+	    !holdsData("/mv/d1/g"))
+		MSG("Failed: rename in a directory");
+	if (Rename("/mv/d1/g", "/mv/d2/h") != 1 || Open("/mv/d1/g") >= 0 ||
+	    !holdsData("/mv/d2/h"))
+		MSG("Failed: rename to another directory");
+	if (Seek(0, SeekSet, fd) != 0 || Read(back, Size, fd) != Size ||
+	    back[Size - 1] != data[Size - 1])
+		MSG("Failed: the open file did not stay open");
+	Close(fd);
+
+	/* a directory takes its tree with it */
+	if (Rename("/mv/d2", "/mv/d1/d3") != 1 || Open("/mv/d2/h") >= 0 ||
+	    !holdsData("/mv/d1/d3/h"))
+		MSG("Failed: rename of a directory");
+
+	/* what must fail, and leave everything where it was */
+	if (Create("/mv/x", 0) != 1 ||
+	    Rename("/mv/x", "/mv/d1/d3/h") >= 0 ||
+	    Rename("/mv/nothing", "/mv/y") >= 0 ||
+	    Rename("/mv/x", "/mv/nowhere/x") >= 0 ||
+	    Rename("/mv/d1", "/mv/d1/d3/d4") >= 0 ||
+	    !holdsData("/mv/d1/d3/h") || Remove("/mv/x") != 1)
+		MSG("Failed: a bad rename did something");
+	MSG("Passed! ^_^");
+	Halt();
+}
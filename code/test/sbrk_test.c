@@ -0,0 +1,54 @@
+#include "syscall.h"
+#include "malloc.h"
+
+#define Nodes	200
+
+typedef struct Node {
+	int value;
+	struct Node *next;
+} Node;
+
+int main(void)
+{
+	char *start, *p;
+	Node *list = 0, *n;
+	int i, sum;
+
+	/* the heap grows, zeroed, and shrinks back */
+	start = (char *) Sbrk(0);
+	if (Sbrk(-1) != (void *) -1)
+		MSG("Failed: the heap shrank below its start");
+	if ((p = (char *) Sbrk(1000)) != start || Sbrk(0) != start + 1000)
+		MSG("Failed: Sbrk did not grow the heap");
+	for (i = 0; i < 1000; i++)
+		if (p[i] != 0)
+			MSG("Failed: a new heap page was not zeroed");
+	p[999] = 1;
+	if (Sbrk(-1000) != start + 1000 || Sbrk(0) != start)
+		MSG("Failed: Sbrk did not shrink the heap");
+	if (Sbrk(0x40000000) != (void *) -1)
+		MSG("Failed: the heap grew past the address space");
+
+	/* malloc sits on top of it */
+	for (i = 1; i <= Nodes; i++) {
+		if ((n = (Node *) malloc(sizeof(Node))) == 0)
+			MSG("Failed: malloc");
+		n->value = i;
+		n->next = list;
+		list = n;
+	}
+	for (sum = 0, n = list; n != 0; n = n->next)
+		sum += n->value;
+	if (sum != Nodes * (Nodes + 1) / 2)
+		MSG("Failed: the list was not kept");
+	p = (char *) Sbrk(0);
+	while (list != 0) {
+		n = list->next;
+		free(list);
+		list = n;
+	}
+	if (malloc(Nodes * sizeof(Node)) == 0 || Sbrk(0) != p)
+		MSG("Failed: the freed blocks were not used again");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -16,15 +16,11 @@ main()
     {
 	Write(prompt, 2, output);
 
-	i = 0;
-	
-	do {
-	
-	    Read(&buffer[i], 1, input); 
-
-	} while( buffer[i++] != '\n' );
-
-	buffer[--i] = '\0';
+	i = ReadLine(buffer, sizeof(buffer));
+	if( i <= 0 )
+		Exit(0);
+	if( buffer[i - 1] == '\n' )
+		buffer[--i] = '\0';
 
 	if( i > 0 ) {
 		newProc = Exec(buffer);
@@ -0,0 +1,21 @@
+#include "syscall.h"
+
+/* shm_test's child: attach the segment whose id comes in on the
+ * console input, mark it, count up its first word, and exit with that.
+ * Exiting detaches it.
+ */
+
+char id;
+
+int main(void)
+{
+	int *at;
+
+	if (Read(&id, 1, SysConsoleInput) != 1)
+		MSG("Failed: no segment id");
+	if ((at = (int *) ShmAttach(id, 0)) == (int *) -1)
+		MSG("Failed: ShmAttach");
+	at[1] = 77;
+	at[0]++;
+	Exit(at[0]);
+}
@@ -0,0 +1,43 @@
+#include "syscall.h"
+
+#define Size	200		/* bytes in the segment */
+
+int main(void)
+{
+	OpenFileId ends[2];
+	SpaceId kid;
+	int id, *at;
+	char c;
+
+	if ((id = ShmCreate(Size)) < 0)
+		MSG("Failed: ShmCreate");
+	if ((at = (int *) ShmAttach(id, 0)) == (int *) -1)
+		MSG("Failed: ShmAttach");
+	at[0] = 1234;
+
+	/* a child attaches it too, by the id we pipe it, and writes it */
+	if (Pipe(ends) != 1)
+		MSG("Failed: Pipe");
+	if ((kid = ExecWith("/shm_child", ends[0], -1)) < 0)
+		MSG("Failed: ExecWith");
+	Close(ends[0]);
+	c = id;
+	Write(&c, 1, ends[1]);
+	Close(ends[1]);
+	if (Join(kid) != 1235 || at[0] != 1235 || at[1] != 77)
+		MSG("Failed: did not see the child's writes");
+
+	/* detached, it lasts while we hold it; attached again, there */
+	if (ShmDetach(at) != 0 || ShmDetach(at) >= 0)
+		MSG("Failed: ShmDetach");
+	if (ShmAttach(id, at) != (int) at || at[0] != 1235)
+		MSG("Failed: did not attach it again where asked");
+	if (ShmAttach(id, at) >= 0 || ShmAttach(id, (char *) at + 1) >= 0)
+		MSG("Failed: attached over it, or in the middle of a page");
+	if (ShmAttach(id + 1, 0) >= 0)
+		MSG("Failed: attached a segment there is not");
+	if (ShmCreate(0) >= 0 || ShmCreate(1 << 20) >= 0)
+		MSG("Failed: made a segment of no size, or too big");
+	MSG("Passed! ^_^");
+	Halt();
+}
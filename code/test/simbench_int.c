@@ -0,0 +1,24 @@
+/* Integer arithmetic, and nothing else: NumRounds rounds of a
+ * xorshift generator, with a multiply, a divide and a compare each,
+ * for SIM_bench.sh to time the simulator on.
+ */
+
+#include "syscall.h"
+
+#define NumRounds	200000
+
+int main(void)
+{
+	unsigned x = 2463534242u;
+	int sum = 0, i;
+
+	for (i = 0; i < NumRounds; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		sum += (int) (x * 7) / 3;
+		if (sum < 0)
+			sum = -sum;
+	}
+	Exit(sum & 0xff);
+}
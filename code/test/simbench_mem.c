@@ -0,0 +1,23 @@
+/* Stream through an array that fits in memory, NumPasses times,
+ * reading each word and writing it back, for SIM_bench.sh to time the
+ * simulator's loads and stores on.
+ */
+
+#include "syscall.h"
+
+#define Words		1024	/* 4 KB: no paging once it is in */
+#define NumPasses	128
+
+int A[Words];
+
+int main(void)
+{
+	int i, pass, sum = 0;
+
+	for (pass = 0; pass < NumPasses; pass++)
+		for (i = 0; i < Words; i++) {
+			sum += A[i];
+			A[i] = sum;
+		}
+	Exit(sum & 0xff);
+}
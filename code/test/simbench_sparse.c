@@ -0,0 +1,26 @@
+/* Grow the heap across most of the map window, and touch one word on
+ * every Stride bytes of it, NumPasses times, for SIM_bench.sh to
+ * compare the page table layouts on: what each takes to translate, and
+ * how much memory each needs for an address space used this sparsely.
+ */
+
+#include "syscall.h"
+
+#define HeapBytes	(24 * 1024)	/* most of the 32 KB window */
+#define Stride		2048		/* 16 pages of 128 bytes */
+#define NumPasses	16384
+
+int main(void)
+{
+	char *heap = (char *) Sbrk(HeapBytes);
+	int i, pass, sum = 0;
+
+	if (heap == (char *) -1)
+		Exit(-1);
+	for (pass = 0; pass < NumPasses; pass++)
+		for (i = 0; i < HeapBytes; i += Stride) {
+			sum += *(int *) &heap[i];
+			*(int *) &heap[i] = sum;
+		}
+	Exit(sum & 0xff);
+}
@@ -0,0 +1,16 @@
+/* Sleep for a tick, NumSleeps times.  Two of these run at once by
+ * SIM_bench.sh switch to each other at every sleep.
+ */
+
+#include "syscall.h"
+
+#define NumSleeps	2000
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < NumSleeps; i++)
+		Sleep(1);
+	Exit(0);
+}
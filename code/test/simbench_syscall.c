@@ -0,0 +1,17 @@
+/* Make NumCalls system calls that do next to nothing in the kernel,
+ * for SIM_bench.sh to time the trap into it and back.
+ */
+
+#include "syscall.h"
+
+#define NumCalls	10000
+
+int main(void)
+{
+	CpuUsage usage;
+	int i;
+
+	for (i = 0; i < NumCalls; i++)
+		GetUsage(&usage);
+	Halt();
+}
@@ -0,0 +1,339 @@
+/* stdio.c
+ *	Buffered file I/O for user programs (see stdio.h).
+ */
+
+#include <stdarg.h>
+#include "syscall.h"
+#include "malloc.h"
+#include "string.h"
+#include "stdio.h"
+
+#define Reading		0x1
+#define Writing		0x2
+#define LineBuffered	0x4
+#define AtEnd		0x8
+#define Failed		0x10
+
+static char consoleBuf[BUFSIZ];
+static FILE console = { SysConsoleOutput, Writing | LineBuffered,
+			consoleBuf, 0, 0 };
+FILE *stdout = &console;
+
+FILE *fopen(char *name, char *mode)
+{
+	FILE *f;
+	OpenFileId id;
+	int flags;
+
+	if (mode[0] == '\0' || mode[1] != '\0')
+		return 0;
+	switch (mode[0]) {
+	case 'r':
+		id = Open(name);
+		flags = Reading;
+		break;
+	case 'w':
+		Remove(name);
+		if (Create(name, 0) != 1)
+			return 0;
+		id = Open(name);
+		flags = Writing;
+		break;
+	case 'a':
+		id = Open(name);
+		if (id < 0 && Create(name, 0) == 1)
+			id = Open(name);
+		if (id >= 0 && Seek(0, SeekEnd, id) < 0) {
+			Close(id);
+			return 0;
+		}
+		flags = Writing;
+		break;
+	default:
+		return 0;
+	}
+	if (id < 0)
+		return 0;
+	f = (FILE *) malloc(sizeof(FILE) + BUFSIZ);
+	if (f == 0) {
+		Close(id);
+		return 0;
+	}
+	f->id = id;
+	f->flags = flags;
+	f->buf = (char *) (f + 1);
+	f->pos = f->count = 0;
+	return f;
+}
+
+int fclose(FILE *f)
+{
+	int result = fflush(f);
+
+	if (f == stdout)
+		return result;
+	if (Close(f->id) != 1)
+		result = EOF;
+	free(f);
+	return result;
+}
+
+/* Write out what has been put in the buffer.  A file being read has
+ * nothing to write out, so just forget what was read ahead, moving
+ * back to the first byte not yet taken from the buffer.
+ */
+int fflush(FILE *f)
+{
+	int result = 0;
+
+	if (f->flags & Writing) {
+		if (f->pos > 0 && Write(f->buf, f->pos, f->id) != f->pos) {
+			f->flags |= Failed;
+			result = EOF;
+		}
+	} else if (f->pos < f->count)
+		Seek(f->pos - f->count, SeekCurrent, f->id);
+	f->pos = f->count = 0;
+	return result;
+}
+
+/* Refill the buffer, once all that was read ahead has been taken.
+ * Return FALSE at the end of the file, or on an error.
+ */
+static int Fill(FILE *f)
+{
+	int n;
+
+	if (!(f->flags & Reading) || (f->flags & (AtEnd | Failed)))
+		return 0;
+	n = Read(f->buf, BUFSIZ, f->id);
+	if (n <= 0) {
+		f->flags |= n < 0 ? Failed : AtEnd;
+		return 0;
+	}
+	f->pos = 0;
+	f->count = n;
+	return 1;
+}
+
+int fgetc(FILE *f)
+{
+	if (f->pos == f->count && !Fill(f))
+		return EOF;
+	return (unsigned char) f->buf[f->pos++];
+}
+
+int fputc(int c, FILE *f)
+{
+	if (!(f->flags & Writing) || (f->flags & Failed))
+		return EOF;
+	f->buf[f->pos++] = c;
+	if (f->pos == BUFSIZ || (c == '\n' && (f->flags & LineBuffered)))
+		if (fflush(f) == EOF)
+			return EOF;
+	return (unsigned char) c;
+}
+
+/* Take what was read ahead first; then read whole buffers' worth
+ * straight into "p", and only buffer the tail.
+ */
+int fread(void *p, int size, int n, FILE *f)
+{
+	char *to = (char *) p;
+	int want = size * n, got = 0, m;
+
+	if (want <= 0)
+		return 0;
+	while (got < want) {
+		if (f->pos == f->count) {
+			if (want - got >= BUFSIZ && (f->flags & Reading) &&
+			    !(f->flags & (AtEnd | Failed))) {
+				m = Read(to + got, (want - got) / BUFSIZ * BUFSIZ,
+					 f->id);
+				if (m <= 0) {
+					f->flags |= m < 0 ? Failed : AtEnd;
+					break;
+				}
+				got += m;
+				continue;
+			}
+			if (!Fill(f))
+				break;
+		}
+		m = f->count - f->pos;
+		if (m > want - got)
+			m = want - got;
+		memcpy(to + got, f->buf + f->pos, m);
+		f->pos += m;
+		got += m;
+	}
+	return got / size;
+}
+
+/* Add to the buffer, writing out what was there first if that would
+ * fill it; but write what would fill it on its own straight from "p",
+ * without copying.
+ */
+int fwrite(void *p, int size, int n, FILE *f)
+{
+	char *from = (char *) p;
+	int want = size * n, m, i;
+
+	if (want <= 0 || !(f->flags & Writing) || (f->flags & Failed))
+		return 0;
+	if (f->pos + want >= BUFSIZ) {
+		if (fflush(f) == EOF)
+			return 0;
+		if (want >= BUFSIZ) {
+			m = Write(from, want, f->id);
+			if (m != want) {
+				f->flags |= Failed;
+				return m > 0 ? m / size : 0;
+			}
+			return n;
+		}
+	}
+	memcpy(f->buf + f->pos, from, want);
+	f->pos += want;
+	if (f->flags & LineBuffered)
+		for (i = 0; i < want; i++)
+			if (from[i] == '\n')
+				return fflush(f) == EOF ? 0 : n;
+	return n;
+}
+
+char *fgets(char *s, int size, FILE *f)
+{
+	int i = 0, c;
+
+	while (i < size - 1 && (c = fgetc(f)) != EOF) {
+		s[i++] = c;
+		if (c == '\n')
+			break;
+	}
+	if (i == 0)
+		return 0;
+	s[i] = '\0';
+	return s;
+}
+
+int fputs(char *s, FILE *f)
+{
+	int n = strlen(s);
+
+	return fwrite(s, 1, n, f) == n ? 0 : EOF;
+}
+
+int feof(FILE *f)
+{
+	return (f->flags & AtEnd) != 0 && f->pos == f->count;
+}
+
+int ferror(FILE *f)
+{
+	return (f->flags & Failed) != 0;
+}
+
+/* Put "value" in base "base" into the end of "digits", and return
+ * where it starts.
+ */
+static char *Convert(unsigned int value, int base, char *end)
+{
+	*end = '\0';
+	do {
+		*--end = "0123456789abcdef"[value % base];
+		value /= base;
+	} while (value != 0);
+	return end;
+}
+
+static int Format(FILE *f, char *format, va_list args)
+{
+	char digits[12], one[2], *s;
+	int written = 0, width, len, value;
+	char pad;
+
+	for (; *format != '\0'; format++) {
+		if (*format != '%') {
+			if (fputc(*format, f) == EOF)
+				return EOF;
+			written++;
+			continue;
+		}
+		format++;
+		pad = ' ';
+		if (*format == '0') {
+			pad = '0';
+			format++;
+		}
+		for (width = 0; *format >= '0' && *format <= '9'; format++)
+			width = width * 10 + *format - '0';
+		switch (*format) {
+		case 'd':
+			value = va_arg(args, int);
+			if (value >= 0)
+				s = Convert(value, 10, digits + 11);
+			else {
+				s = Convert(-(unsigned int) value, 10,
+					    digits + 11);
+				if (pad == '0') {
+					if (fputc('-', f) == EOF)
+						return EOF;
+					written++;
+					width--;
+				} else
+					*--s = '-';
+			}
+			break;
+		case 'u':
+			s = Convert(va_arg(args, unsigned int), 10, digits + 11);
+			break;
+		case 'x':
+			s = Convert(va_arg(args, unsigned int), 16, digits + 11);
+			break;
+		case 'c':
+			one[0] = va_arg(args, int);
+			one[1] = '\0';
+			s = one;
+			break;
+		case 's':
+			s = va_arg(args, char *);
+			break;
+		case '%':
+			s = "%";
+			break;
+		default:
+			return EOF;
+		}
+		len = *format == 'c' ? 1 : strlen(s);
+		for (; width > len; width--, written++)
+			if (fputc(pad, f) == EOF)
+				return EOF;
+		if (fwrite(s, 1, len, f) != len)
+			return EOF;
+		written += len;
+	}
+	return written;
+}
+
+int fprintf(FILE *f, char *format, ...)
+{
+	va_list args;
+	int result;
+
+	va_start(args, format);
+	result = Format(f, format, args);
+	va_end(args);
+	return result;
+}
+
+int printf(char *format, ...)
+{
+	va_list args;
+	int result;
+
+	va_start(args, format);
+	result = Format(stdout, format, args);
+	va_end(args);
+	return result;
+}
@@ -0,0 +1,54 @@
+/* stdio.h
+ *	Buffered file I/O for user programs.  A FILE gathers what is
+ *	written to it, and reads ahead of what is read from it, BUFSIZ
+ *	bytes at a time, so that a program putting or getting a byte at
+ *	a time does not cross into the kernel for each one.
+ *
+ *	A file is opened to read ("r"), or to write, from its start
+ *	("w", which empties it) or from its end ("a"); not both.  What
+ *	is written is only sure to reach the file after fflush or
+ *	fclose, so flush before Halt, which does not.  stdout is the
+ *	console, flushed at the end of every line.
+ */
+
+#ifndef STDIO_H
+#define STDIO_H
+
+#include "syscall.h"
+
+#define BUFSIZ	512
+#define EOF	(-1)
+
+typedef struct FILE {
+	OpenFileId id;
+	int flags;			/* how it was opened, and what
+					 * has gone wrong with it */
+	char *buf;			/* BUFSIZ bytes */
+	int pos;			/* the next byte of buf to read or
+					 * write */
+	int count;			/* bytes of buf read ahead */
+} FILE;
+
+extern FILE *stdout;
+
+FILE *fopen(char *name, char *mode);	/* 0 if it cannot be opened */
+int fclose(FILE *f);			/* flush, then close; 0 or EOF */
+int fflush(FILE *f);			/* write out what is buffered */
+
+int fread(void *p, int size, int n, FILE *f);	/* items read */
+int fwrite(void *p, int size, int n, FILE *f);	/* items written */
+int fgetc(FILE *f);			/* the byte read, or EOF */
+int fputc(int c, FILE *f);		/* the byte written, or EOF */
+char *fgets(char *s, int size, FILE *f); /* a line, 0 at its end */
+int fputs(char *s, FILE *f);		/* 0, or EOF */
+int feof(FILE *f);
+int ferror(FILE *f);
+
+/* Formatted output, with %d, %u, %x, %c, %s and %%, each with an
+ * optional width, padded with spaces, or zeroes if it starts with 0.
+ * Return the bytes written, or EOF.
+ */
+int fprintf(FILE *f, char *format, ...);
+int printf(char *format, ...);
+
+#endif /* STDIO_H */
@@ -0,0 +1,60 @@
+#include "syscall.h"
+#include "stdio.h"
+#include "string.h"
+
+#define Bytes	2000
+
+int main(void)
+{
+	FsStats before, after;
+	static char all[2 * Bytes + 25 + 1];
+	char line[64], big[Bytes];
+	FILE *f;
+	int i;
+
+	/* a byte at a time, but a buffer at a time into the kernel */
+	if (GetFsStats(&before) != 0) MSG("Failed: no file system statistics");
+	if ((f = fopen("/stdio", "w")) == 0) MSG("Failed on creating file");
+	for (i = 0; i < Bytes; i++)
+		if (fputc('a' + i % 26, f) == EOF)
+			MSG("Failed on writing file");
+	if (fprintf(f, "%d|%4d|%04d|%x|%c|%s|%%\n", -42, 7, -3, 255, 'q',
+		    "str") != 25)
+		MSG("Failed: wrong fprintf length");
+	if (fclose(f) != 0) MSG("Failed on closing file");
+	if (GetFsStats(&after) != 0) MSG("Failed: no file system statistics");
+	if (after.ops[FsWriteOp] - before.ops[FsWriteOp] > Bytes / BUFSIZ + 1)
+		MSG("Failed: writes were not buffered");
+
+	/* and a byte at a time back out */
+	if ((f = fopen("/stdio", "r")) == 0) MSG("Failed on opening file");
+	for (i = 0; i < Bytes; i++)
+		if (fgetc(f) != 'a' + i % 26)
+			MSG("Failed: reading wrong result");
+	if (fgets(line, sizeof(line), f) == 0 ||
+	    memcmp(line, "-42|   7|-003|ff|q|str|%\n", 25) != 0)
+		MSG("Failed: wrong fprintf output");
+	if (fgetc(f) != EOF || !feof(f)) MSG("Failed: read past the end");
+	if (fclose(f) != 0) MSG("Failed on closing file");
+	GetFsStats(&before);
+	if (before.ops[FsReadOp] - after.ops[FsReadOp] > Bytes / BUFSIZ + 2)
+		MSG("Failed: reads were not buffered");
+
+	/* appended, and read back in one go */
+	if ((f = fopen("/stdio", "a")) == 0) MSG("Failed on opening file");
+	memset(big, 'z', Bytes);
+	if (fwrite(big, 1, Bytes, f) != Bytes) MSG("Failed on appending");
+	if (fclose(f) != 0) MSG("Failed on closing file");
+	if ((f = fopen("/stdio", "r")) == 0) MSG("Failed on opening file");
+	if (fread(all, 1, sizeof(all), f) != 2 * Bytes + 25 ||
+	    all[Bytes - 1] != 'a' + (Bytes - 1) % 26 ||
+	    memcmp(all + Bytes + 25, big, Bytes) != 0)
+		MSG("Failed: reading wrong result");
+	if (fclose(f) != 0) MSG("Failed on closing file");
+
+	if (fopen("/stdio", "rw") != 0) MSG("Failed: bad mode taken");
+	if (fopen("/nosuch", "r") != 0) MSG("Failed: missing file opened");
+	if (Remove("/stdio") != 1) MSG("Failed on removing file");
+	printf("Passed! ^_^\n");
+	Halt();
+}
@@ -0,0 +1,80 @@
+/* string.c
+ *	Copying and filling memory (see string.h).
+ */
+
+#include "string.h"
+
+/* Copy a byte at a time until "to" is word aligned, then a word at a
+ * time, if "from" lines up with it; otherwise, and for the bytes left
+ * over, a byte at a time.  The areas must not overlap.
+ */
+void *memcpy(void *to, const void *from, unsigned int n)
+{
+	char *d = (char *) to;
+	const char *s = (const char *) from;
+
+	if ((((int) d ^ (int) s) & 3) == 0) {
+		while (n > 0 && ((int) d & 3) != 0) {
+			*d++ = *s++;
+			n--;
+		}
+		while (n >= 4) {
+			*(int *) d = *(const int *) s;
+			d += 4;
+			s += 4;
+			n -= 4;
+		}
+	}
+	while (n > 0) {
+		*d++ = *s++;
+		n--;
+	}
+	return to;
+}
+
+/* Fill the unaligned bytes at either end one at a time, and the words
+ * in between with "c" copied into each of their bytes.
+ */
+void *memset(void *p, int c, unsigned int n)
+{
+	char *d = (char *) p;
+	unsigned int word;
+
+	c &= 0xff;
+	while (n > 0 && ((int) d & 3) != 0) {
+		*d++ = c;
+		n--;
+	}
+	word = c | c << 8;
+	word |= word << 16;
+	while (n >= 4) {
+		*(unsigned int *) d = word;
+		d += 4;
+		n -= 4;
+	}
+	while (n > 0) {
+		*d++ = c;
+		n--;
+	}
+	return p;
+}
+
+int memcmp(const void *a, const void *b, unsigned int n)
+{
+	const unsigned char *x = (const unsigned char *) a;
+	const unsigned char *y = (const unsigned char *) b;
+
+	for (; n > 0; n--, x++, y++)
+		if (*x != *y)
+			return *x - *y;
+	return 0;
+}
+
+int strlen(const char *s)
+{
+	const char *e = s;
+
+	while (*e != '\0')
+		e++;
+	return e - s;
+}
@@ -0,0 +1,16 @@
+/* string.h
+ *	Copying and filling memory, for user programs, which have no C
+ *	library of their own.  Both go a word at a time where they can,
+ *	rather than a byte at a time, since every load and store is an
+ *	instruction the simulator has to run.
+ */
+
+#ifndef STRING_H
+#define STRING_H
+
+void *memcpy(void *to, const void *from, unsigned int n);
+void *memset(void *p, int c, unsigned int n);
+int memcmp(const void *a, const void *b, unsigned int n);
+int strlen(const char *s);
+
+#endif /* STRING_H */
@@ -0,0 +1,65 @@
+/* thread_matmult.c
+ *    Matrix multiplication, as matmult does it, by several threads of
+ *    one program: each works out its own rows of C, in the arrays they
+ *    all share, on a stack of its own.
+ */
+
+#include "syscall.h"
+
+#define Dim 	20
+#define Workers	4	/* threads, besides us */
+
+int A[Dim][Dim];
+int B[Dim][Dim];
+int C[Dim][Dim];
+
+/* Work out the rows of C from "first", every Workers'th one; return
+ * how many that was.
+ */
+int
+Rows(int first)
+{
+    int i, j, k, sum, n = 0;
+
+    for (i = first; i < Dim; i += Workers) {
+	for (j = 0; j < Dim; j++) {
+	    sum = 0;			/* on this thread's stack */
+	    for (k = 0; k < Dim; k++)
+		sum += A[i][k] * B[k][j];
+	    C[i][j] = sum;
+	}
+	n++;
+	ThreadYield();			/* let the others interleave */
+    }
+    return n;
+}
+
+int
+main()
+{
+    ThreadId workers[Workers];
+    int i, j, rows = 0;
+
+    for (i = 0; i < Dim; i++)
+	for (j = 0; j < Dim; j++) {
+	     A[i][j] = i;
+	     B[i][j] = j;
+	     C[i][j] = 0;
+	}
+
+    for (i = 0; i < Workers; i++)
+	if ((workers[i] = ThreadFork(Rows, i)) <= 0)
+	    MSG("Failed: ThreadFork");
+    for (i = 0; i < Workers; i++)
+	rows += ThreadJoin(workers[i]);
+    if (rows != Dim)
+	MSG("Failed: the threads did not do every row");
+    if (ThreadJoin(workers[0]) >= 0 || ThreadJoin(0) >= 0)
+	MSG("Failed: joined a thread that could not be joined");
+
+    for (i = 0; i < Dim; i++)
+	for (j = 0; j < Dim; j++)
+	    if (C[i][j] != i * j * Dim)
+		MSG("Failed: wrong product");
+    Exit(C[Dim-1][Dim-1]);		/* as matmult does */
+}
@@ -0,0 +1,11 @@
+#include "syscall.h"
+
+int main(void)
+{
+	if (SetTickets(300) != 100) MSG("Failed: wrong starting tickets");
+	if (SetTickets(0) >= 0 || SetTickets(1001) >= 0)
+		MSG("Failed: set tickets out of range");
+	if (SetTickets(1) != 300) MSG("Failed: tickets not kept");
+	MSG("Passed! ^_^");
+	Halt();
+}
@@ -0,0 +1,23 @@
+#include "syscall.h"
+
+int main(void)
+{
+	CpuUsage before, after;
+	int i, sum = 0;
+
+	if (GetUsage(&before) != 0) MSG("Failed: no usage");
+	if (before.userTicks <= 0) MSG("Failed: no user ticks");
+	for (i = 0; i < 1000; i++)
+		sum += i;
+	if (Sleep(500) != 0) MSG("Failed: could not sleep");
+	if (GetUsage(&after) != 0) MSG("Failed: no usage");
+	if (after.userTicks < before.userTicks + 1000)
+		MSG("Failed: the loop was not charged");
+	if (after.blockedTicks < before.blockedTicks + 500)
+		MSG("Failed: the sleep was not charged");
+	if (after.voluntarySwitches <= before.voluntarySwitches)
+		MSG("Failed: sleeping was not a voluntary switch");
+	if (GetUsage((CpuUsage *) -4) >= 0) MSG("Failed: bad address taken");
+	MSG("Passed! ^_^");
+	Halt();
+}
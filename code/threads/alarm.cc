@@ -1,8 +1,7 @@
 // alarm.cc
 //	Routines to use a hardware timer device to provide a
-//	software alarm clock.  For now, we just provide time-slicing.
-//
-//	Not completely implemented.
+//	software alarm clock: time-slicing, and threads waiting until
+//	some time has passed.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -11,6 +10,8 @@
 #include "copyright.h"
 #include "alarm.h"
 #include "main.h"
+#include "statlog.h"
+#include "swapper.h"
 
 //----------------------------------------------------------------------
 // Alarm::Alarm
@@ -18,11 +19,16 @@
 //
 //      "doRandom" -- if true, arrange for the hardware interrupts to 
 //		occur at random, instead of fixed, intervals.
+//	"tickless" -- if true, stop the timer while no thread is ready
+//	"slack" -- how late a waiting thread may be woken, to be woken
+//		along with others
 //----------------------------------------------------------------------
 
-Alarm::Alarm(bool doRandom)
+Alarm::Alarm(bool doRandom, bool tickless, int slack)
 {
     timer = new Timer(doRandom, this);
+    sleepQueue = new SleepQueue(slack);
+    this->tickless = tickless;
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +46,14 @@ Alarm::Alarm(bool doRandom)
 //	was interrupted.
 //
 //	For now, just provide time-slicing.  Only need to time slice 
-//      if we're currently running something (in other words, not idle).
+//      if we're currently running something (in other words, not idle),
+//	and then only if the scheduler says its time slice is up.
+//	A user program running has its working set sampled, too, and
+//	the -statlog thread and the swapper are woken if they are due.
+//
+//	When tickless, once no thread is ready there is no one to time
+//	slice for, and the timer stops, till the scheduler has one ready
+//	again (see TimerNeeded).
 //----------------------------------------------------------------------
 
 void 
@@ -49,7 +62,184 @@ Alarm::CallBack()
     Interrupt *interrupt = kernel->interrupt;
     MachineStatus status = interrupt->getStatus();
     
-    if (status != IdleMode) {
+    sleepQueue->WakeDue();
+    if (status == UserMode && kernel->currentThread->space != NULL)
+	kernel->currentThread->space->SampleWorkingSet();
+    if (kernel->statsLog != NULL)
+	kernel->statsLog->Tick();
+    if (kernel->swapper != NULL)
+	kernel->swapper->Tick();
+    if (status != IdleMode &&
+	kernel->scheduler->TimerTick(kernel->currentThread)) {
 	interrupt->YieldOnReturn();
     }
+    if (tickless && kernel->scheduler->NumReady() == 0 &&
+	    kernel->statsLog == NULL && kernel->swapper == NULL)
+	timer->Stop();
+}
+
+//----------------------------------------------------------------------
+// Alarm::WaitUntil
+// 	Suspend the current thread until at least "x" ticks from now.
+//	It uses no CPU in the meantime.
+//----------------------------------------------------------------------
+
+void
+Alarm::WaitUntil(int x)
+{
+    if (x > 0)
+	sleepQueue->Sleep(kernel->stats->totalTicks + x);
+}
+
+//----------------------------------------------------------------------
+// AlarmTestSleeper, Alarm::SelfTest
+// 	Have two threads wait, the one that waits longer first, and check
+//	that each wakes up when it should and in order -- with no time
+//	slices or other interrupts needed to get there.
+//----------------------------------------------------------------------
+
+static int alarmTestWoken;		// how many of the threads are up
+
+static void
+AlarmTestSleeper(int ticks)
+{
+    int start = kernel->stats->totalTicks;
+
+    kernel->alarm->WaitUntil(ticks);
+    ASSERT(kernel->stats->totalTicks >= start + ticks);
+    ASSERT(alarmTestWoken == (ticks < 1000 ? 0 : 1));
+    alarmTestWoken++;
+}
+
+void
+Alarm::SelfTest()
+{
+    int start = kernel->stats->totalTicks;
+
+    alarmTestWoken = 0;
+    (new Thread("long sleeper", -1))->Fork(
+			(VoidFunctionPtr) AlarmTestSleeper, (void *) 1000);
+    (new Thread("short sleeper", -1))->Fork(
+			(VoidFunctionPtr) AlarmTestSleeper, (void *) 300);
+    WaitUntil(1500);
+    ASSERT(alarmTestWoken == 2);
+    ASSERT(kernel->stats->totalTicks < start + 1500 + TimerTicks);
+}
+
+//----------------------------------------------------------------------
+// CompareWakeTimes
+// 	Order sleepers by when they are to wake up; those that are to
+//	wake at the same time stay in the order they went to sleep.
+//----------------------------------------------------------------------
+
+static int
+CompareWakeTimes(Sleeper *x, Sleeper *y)
+{
+    return x->wakeTime - y->wakeTime;
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::SleepQueue
+// 	Initialize an empty queue, with no interrupt asked for.
+//
+//	"slack" is how late a thread may be woken, so that one interrupt
+//		wakes it and any due soon after
+//----------------------------------------------------------------------
+
+SleepQueue::SleepQueue(int slack)
+{
+    ASSERT(slack >= 0);
+    sleepers = new Heap<Sleeper *>(CompareWakeTimes);
+    nextWakeup = 0;
+    this->slack = slack;
+}
+
+SleepQueue::~SleepQueue()
+{
+    delete sleepers;
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::Sleep
+// 	Queue the current thread to be woken at "wakeTime", and put it to
+//	sleep until then.  The Sleeper lives on the thread's stack, which
+//	is not used again until the thread is woken.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::Sleep(int wakeTime)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    Sleeper sleeper;
+
+    sleeper.thread = kernel->currentThread;
+    sleeper.wakeTime = wakeTime;
+    DEBUG(dbgThread, "Sleeping until " << wakeTime << ": "
+	  << sleeper.thread->getName());
+    sleepers->Insert(&sleeper);
+    ScheduleWakeup();
+    sleeper.thread->Sleep(FALSE);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::WakeDue
+// 	Take off the queue, and make ready, every thread that is due to
+//	wake up by now.  Called with interrupts off, from an interrupt
+//	handler.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::WakeDue()
+{
+    int now = kernel->stats->totalTicks;
+
+    while (!sleepers->IsEmpty() && sleepers->Front()->wakeTime <= now) {
+	Sleeper *sleeper = sleepers->RemoveFront();
+
+	DEBUG(dbgThread, "Waking up: " << sleeper->thread->getName());
+	kernel->scheduler->ReadyToRun(sleeper->thread);
+    }
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::ScheduleWakeup
+// 	Make sure an interrupt is due no later than the first sleeper's
+//	wake time -- or, with slack, the next multiple of the slack from
+//	it, so that all the sleepers due in that window are woken by the
+//	one interrupt, none more than the slack late.  An interrupt that
+//	was asked for a later time cannot be taken back; it just finds no
+//	one to wake, when it comes.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::ScheduleWakeup()
+{
+    int first, now = kernel->stats->totalTicks;
+
+    if (sleepers->IsEmpty())
+	return;
+    first = sleepers->Front()->wakeTime;
+    if (slack > 0)
+	first = divRoundUp(first, slack) * slack;
+    first = max(first, now + 1);
+    if (nextWakeup == 0 || first < nextWakeup) {
+	kernel->interrupt->Schedule(this, first - now, AlarmInt);
+	nextWakeup = first;
+    }
+}
+
+//----------------------------------------------------------------------
+// SleepQueue::CallBack
+// 	Our interrupt has come: wake up the threads that are due, and ask
+//	for another interrupt for the rest.
+//----------------------------------------------------------------------
+
+void
+SleepQueue::CallBack()
+{
+    if (kernel->stats->totalTicks >= nextWakeup)
+	nextWakeup = 0;
+    WakeDue();
+    ScheduleWakeup();
 }
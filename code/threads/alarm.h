@@ -8,7 +8,23 @@
 //	From this, we provide the ability for a thread to be
 //	woken up after a delay; we also provide time-slicing.
 //
-//	NOTE: this abstraction is not completely implemented.
+//	A thread that waits is taken off the CPU altogether, and kept on
+//	a queue in the order in which the threads are to wake up.  On its
+//	own, the periodic timer would wake a thread up to TimerTicks
+//	late, and it stops once nothing but sleeping threads are left;
+//	so the queue also has the timer interrupt once, exactly when the
+//	first thread is due -- which lets Interrupt::Idle skip straight
+//	to then.  Given some slack (-slack), its interrupts come only at
+//	multiples of it: the threads due in the same window are woken by
+//	one interrupt, at its end, none more than the slack late.
+//
+//	The timer goes on interrupting whether there is a thread to time
+//	slice or not.  A tickless alarm clock (-tickless) stops it once no
+//	thread is ready to take the CPU from the one running, and starts
+//	it again once one is -- unless the -statlog thread or the swapper
+//	count on the ticks.  With no ticks, Idle goes from one disk or
+//	other interrupt to the next, and a lone thread is not stopped
+//	every TimerTicks for nothing.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -21,21 +37,65 @@
 #include "utility.h"
 #include "callback.h"
 #include "timer.h"
+#include "heap.h"
+
+class Thread;
+
+// A thread waiting on the alarm clock, and when it is to wake up.
+
+class Sleeper {
+  public:
+    Thread *thread;
+    int wakeTime;		// in totalTicks
+};
+
+// The threads waiting on the alarm clock, the first to wake first.
+
+class SleepQueue : public CallBackObj {
+  public:
+    SleepQueue(int slack);	// No one is waiting; wake threads up to
+				// "slack" ticks late, to wake several
+				// at once
+    ~SleepQueue();
+
+    void Sleep(int wakeTime);	// Put the current thread to sleep until
+				// "wakeTime"
+    void WakeDue();		// Make ready every thread whose time has
+				// come
+
+  private:
+    Heap<Sleeper *> *sleepers;		// the soonest first
+    int nextWakeup;		// when our next interrupt is due, or
+				// 0 if none is
+    int slack;			// how late a thread may be woken
+
+    void CallBack();		// Called when our interrupt comes
+    void ScheduleWakeup();	// Interrupt when the first sleeper is due
+};
 
 // The following class defines a software alarm clock. 
 class Alarm : public CallBackObj {
   public:
-    Alarm(bool doRandomYield);	// Initialize the timer, and callback 
-				// to "toCall" every time slice.
-    ~Alarm() { delete timer; }
+    Alarm(bool doRandomYield, bool tickless = FALSE, int slack = 0);
+				// Initialize the timer, and callback 
+				// to "toCall" every time slice; if
+				// "tickless", only while some thread
+				// is ready to run
+    ~Alarm() { delete timer; delete sleepQueue; }
     
-    void WaitUntil(int x);	// suspend execution until time > now + x
-                                // this method is not yet implemented
+    void WaitUntil(int x);	// suspend execution until time >= now + x
+    void SelfTest();		// test that waiting threads wake on time
 	
 	void Disable() { timer->Disable(); } //2015.11.25
+    void TimerNeeded() { if (tickless) timer->Start(); }
+				// A thread is ready to run, and may
+				// need the running one time sliced
 
   private:
     Timer *timer;		// the hardware timer device
+    SleepQueue *sleepQueue;	// threads waiting in WaitUntil
+    bool tickless;		// stop the timer while no thread is
+				// ready?
 
     void CallBack();		// called when the hardware
 				// timer generates an interrupt
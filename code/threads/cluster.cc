@@ -0,0 +1,243 @@
+// cluster.cc
+//	Routines to run several Nachos machines in one process, taking
+//	turns so that none gets more than NetworkTime ahead of the rest,
+//	and to carry packets between them (see cluster.h).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "cluster.h"
+#include "network.h"
+
+//----------------------------------------------------------------------
+// Cluster::Cluster
+// 	Make room for "numMachines" machines; Boot makes them.
+//----------------------------------------------------------------------
+
+Cluster::Cluster(int numMachines)
+{
+    ASSERT(numMachines > 0);
+    this->numMachines = numMachines;
+    machines = new Kernel *[numMachines];
+    inputs = new NetworkInput *[numMachines];
+    up = new bool[numMachines];
+    stalled = new bool[numMachines];
+    for (int i = 0; i < numMachines; i++) {
+	machines[i] = NULL;
+	inputs[i] = NULL;
+	up[i] = FALSE;
+	stalled[i] = FALSE;
+    }
+    running = 0;
+}
+
+//----------------------------------------------------------------------
+// Cluster::~Cluster
+// 	The machines are deleted as the last of them halts.
+//----------------------------------------------------------------------
+
+Cluster::~Cluster()
+{
+    delete [] machines;
+    delete [] inputs;
+    delete [] up;
+    delete [] stalled;
+}
+
+//----------------------------------------------------------------------
+// Cluster::Boot
+// 	Make the kernel of each machine from the command line, and
+//	initialize it, one after another; none waits for another yet.
+//	Each machine's main thread ran on the host's stack to boot it;
+//	all but the first are given stacks of their own, to start over
+//	on, running (*run)(NULL) -- the rest of what main does -- when
+//	first switched to.  The first goes on, on the host's stack.
+//
+//	"argc" and "argv" are the command line
+//	"run" is what each machine does once booted
+//----------------------------------------------------------------------
+
+void
+Cluster::Boot(int argc, char **argv, VoidFunctionPtr run)
+{
+    for (int i = 0; i < numMachines; i++) {
+	running = i;
+	kernel = new Kernel(argc, argv);
+	kernel->hostName = i;
+	machines[i] = kernel;
+	up[i] = TRUE;
+	kernel->Initialize();
+	if (i > 0)
+	    kernel->currentThread->Restart(run, NULL);
+    }
+    running = 0;
+    kernel = machines[0];
+    kernel->interrupt->SetHorizon(Horizon(0));
+}
+
+//----------------------------------------------------------------------
+// Cluster::Connect
+// 	Attach the network input of the running machine to the wire, for
+//	packets sent to it to go to.
+//----------------------------------------------------------------------
+
+void
+Cluster::Connect(NetworkInput *input)
+{
+    inputs[running] = input;
+}
+
+//----------------------------------------------------------------------
+// Cluster::Send
+// 	Put a packet from the running machine on the wire, to arrive at
+//	machine "to" NetworkTime ticks from now, by this machine's clock.
+//	No machine can be past then: none runs that far ahead of another.
+//	The packet is handed to the other machine as if it were running,
+//	so that the interrupt for it goes on that machine's clock.
+//
+//	Returns FALSE if there is no machine "to", or it has halted, or
+//	its network is not on.
+//
+//	"packet" is the packet, header and all, MaxWireSize bytes
+//	"to" is the machine it is for
+//----------------------------------------------------------------------
+
+bool
+Cluster::Send(char *packet, int to)
+{
+    Kernel *sender = kernel;
+    int when = kernel->stats->totalTicks + NetworkTime;
+
+    if (to < 0 || to >= numMachines || !up[to] || inputs[to] == NULL)
+	return FALSE;
+    kernel = machines[to];
+    inputs[to]->Arrive(packet, when);
+    kernel = sender;
+    stalled[to] = FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Cluster::Horizon
+// 	Return the time machine "m" may run up to: NetworkTime past the
+//	clock of the machine furthest behind of the others that are up,
+//	since nothing those send can arrive before then.  What it sends
+//	itself arrives at them later than that, so they may run on later.
+//----------------------------------------------------------------------
+
+int
+Cluster::Horizon(int m)
+{
+    int horizon = NeverDue;
+
+    for (int i = 0; i < numMachines; i++)
+	if (i != m && up[i])
+	    horizon = min(horizon,
+			  machines[i]->stats->totalTicks + NetworkTime);
+    return horizon;
+}
+
+//----------------------------------------------------------------------
+// Cluster::Switch
+// 	Switch to the machine furthest behind, of the others that are
+//	up -- the first such, on a tie, so that every run goes the same
+//	way -- if any other is.  The running machine's current thread is
+//	left where it is, to go on when a machine switches back to it.
+//
+//	Called when the running machine reaches its horizon, or has
+//	nothing to do before it.
+//----------------------------------------------------------------------
+
+void
+Cluster::Switch()
+{
+    Kernel *from = kernel;
+    int next = -1;
+
+    for (int i = 0; i < numMachines; i++)
+	if (i != running && up[i] && (next < 0 ||
+		machines[i]->stats->totalTicks <
+		machines[next]->stats->totalTicks))
+	    next = i;
+    if (next < 0)
+	return;
+    DEBUG(dbgNet, "Machine " << running << " at " <<
+	  from->stats->totalTicks << ", switching to machine " << next <<
+	  " at " << machines[next]->stats->totalTicks);
+    running = next;
+    kernel = machines[next];
+    kernel->interrupt->SetHorizon(Horizon(next));
+    SWITCH(from->currentThread, kernel->currentThread);
+
+    // we're back, the running machine again: whoever switched to us has
+    // set "kernel" and our horizon
+}
+
+//----------------------------------------------------------------------
+// Cluster::Wait
+// 	The running machine has no thread to run, and no interrupt due
+//	before its horizon: move its clock up to the horizon, idle, and
+//	let the others run.
+//
+//	If it has no interrupt pending at all, only a packet can give it
+//	something to do.  Once no machine up has one pending, none may
+//	ever send a packet again; return FALSE, for the running machine
+//	to halt (the others do as they run again).
+//
+//	"pending" is TRUE if the running machine has interrupts pending
+//----------------------------------------------------------------------
+
+bool
+Cluster::Wait(bool pending)
+{
+    Statistics *stats = kernel->stats;
+    int horizon = Horizon(running);
+
+    stalled[running] = !pending;
+    if (!pending) {
+	int i;
+
+	for (i = 0; i < numMachines; i++)
+	    if (up[i] && !stalled[i])
+		break;
+	if (i == numMachines)
+	    return FALSE;
+    }
+    if (stats->totalTicks < horizon) {
+	stats->idleTicks += horizon - stats->totalTicks;
+	stats->totalTicks = horizon;
+    }
+    Switch();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Cluster::Halted
+// 	The running machine has halted (see Interrupt::Halt): leave the
+//	others to run on without it, never to return.  Once the last is
+//	down, delete the kernels of the others -- each as the running
+//	machine, as its destructor expects -- and return, for Halt to
+//	delete the last and exit.
+//----------------------------------------------------------------------
+
+void
+Cluster::Halted()
+{
+    Kernel *last = kernel;
+
+    DEBUG(dbgNet, "Machine " << running << " halted at " <<
+	  kernel->stats->totalTicks);
+    up[running] = FALSE;
+    inputs[running] = NULL;
+    Switch();			// returns only if no other machine is up
+
+    for (int i = 0; i < numMachines; i++)
+	if (machines[i] != last) {
+	    kernel = machines[i];
+	    delete machines[i];
+	}
+    kernel = last;
+}
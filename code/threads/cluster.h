@@ -0,0 +1,79 @@
+// cluster.h
+//	Data structures for running several Nachos machines in one host
+//	process (-cluster), each with a kernel, CPU, disk and machine id of
+//	its own, joined by a simulated wire in memory instead of by UNIX
+//	sockets.  No packet costs a host system call, and a run is the
+//	same from one time to the next.
+//
+//	The global "kernel" is always the machine running; switching to
+//	another is switching to its current thread, as a thread switch
+//	does, and setting "kernel" to it.  Every machine keeps its own
+//	clock, and a packet takes NetworkTime ticks to cross the wire, so a
+//	machine may run ahead of all the others by up to that much: nothing
+//	they send can arrive before then.  Once it is that far ahead (its
+//	"horizon", see Interrupt::SetHorizon), the machine furthest behind
+//	runs instead.  A machine with nothing to do but wait for packets
+//	just moves its clock up to its horizon; once all of them are
+//	waiting, no packet can ever come, and they halt.
+//
+//	Each machine takes the whole command line, as if it were a Nachos
+//	process of its own, but for its machine id (-m), which is its
+//	place in the cluster: 0 to one less than the number of machines.
+//	The files a machine names after its id (DISK_0, SWAP_0, ...) are
+//	its own; any other file on the command line is shared by them all.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "copyright.h"
+#include "utility.h"
+
+class Kernel;
+class NetworkInput;
+
+// The following class defines the machines of a cluster, and the wire
+// between them.
+
+class Cluster {
+  public:
+    Cluster(int numMachines);		// No machines booted yet
+    ~Cluster();
+
+    void Boot(int argc, char **argv, VoidFunctionPtr run);
+					// Make and initialize the kernel of
+					// each machine; each but the first
+					// starts (*run)(NULL) when it first
+					// runs, and the first goes on as
+					// "kernel"
+
+    void Connect(NetworkInput *input);	// "input" is the running machine's
+					// end of the wire
+    bool Send(char *packet, int to);	// Put a packet on the wire, to
+					// arrive at machine "to" NetworkTime
+					// from now; FALSE if it is not up
+
+    void Switch();			// Run the machine furthest behind,
+					// if it is another
+    bool Wait(bool pending);		// The running one has nothing to
+					// do: let the others catch up; FALSE
+					// if nothing ever can be done again
+    void Halted();			// The running one has halted; returns
+					// only for the last one up
+
+  private:
+    int Horizon(int m);			// How far machine "m" may run
+
+    int numMachines;
+    Kernel **machines;			// the kernel of each
+    NetworkInput **inputs;		// and its end of the wire, if any
+    bool *up;				// Not halted yet?
+    bool *stalled;			// Waiting for packets, with no
+					// interrupt pending?
+    int running;			// the one that is "kernel"
+};
+
+#endif // CLUSTER_H
@@ -12,11 +12,31 @@
 #include "sysdep.h"
 #include "synch.h"
 #include "synchlist.h"
+#include "workpool.h"
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "diskmodel.h"
+#include "bufcache.h"
+#include "dcache.h"
+#include "ftable.h"
+#include "journal.h"
+#include "ptable.h"
+#include "frames.h"
+#include "swap.h"
+#include "swapper.h"
+#include "shm.h"
+#include "futex.h"
+#include "tlb.h"
+#include "filehdr.h"
 #include "post.h"
+#include "transport.h"
+#include "remotefs.h"
 #include "synchconsole.h"
+#include "trace.h"
+#include "replay.h"
+#include "statlog.h"
+#include "lockstat.h"
 
 //----------------------------------------------------------------------
 // Kernel::Kernel
@@ -27,31 +47,98 @@
 Kernel::Kernel(int argc, char **argv)
 {
     randomSlice = FALSE; 
+    ticklessFlag = FALSE;
+    alarmSlack = 0;
     debugUserProg = FALSE;
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
+    statsFlag = FALSE;
+    fsStatsFlag = FALSE;
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    extentFlag = FALSE;
+    blockShift = 0;
+    logFlag = FALSE;
+    defragRemoves = 0;
+    dedupFlag = FALSE;
+    delallocFlag = FALSE;
 #endif
+    flushInterval = FlushInterval;
+    flushThreshold = FlushThreshold;
+    diskSchedule = FifoSchedule;
+    mapDisk = FALSE;
+    asyncDisk = FALSE;
+    stripeDisks = 1;
+    mirrorDisks = 1;
+    diskTracks = 0;
+    diskInterleave = 1;
+    trackCacheSize = 0;
+    diskSlice = 0;
+    diskModel = RotationalModel;
+    replacePolicy = ClockReplace;
+    pageOutLow = PageOutLow;
+    pageOutHigh = PageOutHigh;
+    swapInterval = 0;
+    stacksPreallocated = 4;
+    stacksKept = 16;
+    pageSize = DefaultPageSize;
+    memorySize = DefaultNumPhysPages * DefaultPageSize;
+    schedulerPolicy = FifoScheduling;
+    for (int i = 0; i < NumFeedbackLevels; i++)
+	quanta[i] = 1 << i;
+    tlbSize = tlbWays = 0;
+    tlbPolicy = LruTLB;
+    pageTableKind = LinearPageTable;
+    profileInterval = 0;
+    profileSymbols = NULL;
+    trace = NULL;
+    traceCategories = NULL;
+    traceFile = NULL;
+    randomSeed = -1;
+    replayFile = NULL;
+    replaying = FALSE;
+    statLogFile = NULL;
+    statLogInterval = 0;
+    lockStats = NULL;
+    lockStatTop = 0;
     reliability = 1;            // network reliability, default is 1.0
     hostName = 0;               // machine id, also UNIX socket name
                                 // 0 is the default machine id
+    networkFlag = FALSE;
+    coalesceFlag = FALSE;
+    netSignalFlag = FALSE;
+    remoteFlag = FALSE;
 								
 	// MP4 mod tag
 	execfileNum = 0; // dummy operation to keep valgrind happy
+	restorefileNum = 0;
 								
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-rs") == 0) {
  	    	ASSERT(i + 1 < argc);
-	    	RandomInit(atoi(argv[i + 1]));// initialize pseudo-random
+	    	randomSeed = atoi(argv[i + 1]);
+	    	RandomInit(randomSeed);// initialize pseudo-random
 			// number generator
 	    	randomSlice = TRUE;
 	    	i++;
+        } else if (strcmp(argv[i], "-tickless") == 0) {
+	    	ticklessFlag = TRUE;
+        } else if (strcmp(argv[i], "-slack") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	alarmSlack = atoi(argv[++i]);
+	    	ASSERT(alarmSlack >= 0);
         } else if (strcmp(argv[i], "-s") == 0) {
             debugUserProg = TRUE;
+        } else if (strcmp(argv[i], "-st") == 0) {
+            statsFlag = TRUE;
+        } else if (strcmp(argv[i], "-fsstat") == 0) {
+            fsStatsFlag = TRUE;
 		} else if (strcmp(argv[i], "-e") == 0) {
         	execfile[++execfileNum]= argv[++i];
 			cout << execfile[execfileNum] << "\n";
+		} else if (strcmp(argv[i], "-restore") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	restorefile[++restorefileNum] = argv[++i];
 		} else if (strcmp(argv[i], "-ci") == 0) {
 	    	ASSERT(i + 1 < argc);
 	    	consoleIn = argv[i + 1];
@@ -63,25 +150,241 @@ Kernel::Kernel(int argc, char **argv)
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
+		} else if (strcmp(argv[i], "-fe") == 0) {
+	    	formatFlag = TRUE;
+	    	extentFlag = TRUE;
+		} else if (strcmp(argv[i], "-bs") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	formatFlag = TRUE;
+	    	for (blockShift = 0; (1 << blockShift) < atoi(argv[i + 1]);
+	    	     blockShift++)
+	    	    continue;
+	    	ASSERT((1 << blockShift) == atoi(argv[i + 1]) &&
+	    	       blockShift <= MaxBlockShift);
+	    	i++;
+		} else if (strcmp(argv[i], "-fl") == 0) {
+	    	formatFlag = TRUE;
+	    	logFlag = TRUE;
+		} else if (strcmp(argv[i], "-dg") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	defragRemoves = atoi(argv[i + 1]);
+	    	i++;
+		} else if (strcmp(argv[i], "-dedup") == 0) {
+	    	dedupFlag = TRUE;
+		} else if (strcmp(argv[i], "-delalloc") == 0) {
+	    	delallocFlag = TRUE;
 #endif
+		} else if (strcmp(argv[i], "-wb") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	flushInterval = atoi(argv[i + 1]);
+	    	flushThreshold = atoi(argv[i + 2]);
+	    	i += 2;
+		} else if (strcmp(argv[i], "-ds") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "fifo") == 0)
+	    	    diskSchedule = FifoSchedule;
+	    	else if (strcmp(argv[i], "sstf") == 0)
+	    	    diskSchedule = SstfSchedule;
+	    	else if (strcmp(argv[i], "scan") == 0)
+	    	    diskSchedule = ScanSchedule;
+	    	else if (strcmp(argv[i], "clook") == 0)
+	    	    diskSchedule = CLookSchedule;
+	    	else
+	    	    cout << "Unknown disk schedule " << argv[i] << "\n";
+		} else if (strcmp(argv[i], "-dm") == 0) {
+	    	mapDisk = TRUE;
+		} else if (strcmp(argv[i], "-da") == 0) {
+	    	asyncDisk = TRUE;
+		} else if (strcmp(argv[i], "-dq") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskSlice = atoi(argv[i + 1]);
+	    	ASSERT(diskSlice >= 0);
+	    	i++;
+		} else if (strcmp(argv[i], "-stripe") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	stripeDisks = atoi(argv[i + 1]);
+	    	ASSERT(stripeDisks >= 1 && stripeDisks <= MaxStripeDisks);
+	    	i++;
+		} else if (strcmp(argv[i], "-mirror") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	mirrorDisks = atoi(argv[i + 1]);
+	    	ASSERT(mirrorDisks >= 1 && mirrorDisks <= MaxStripeDisks);
+	    	i++;
+		} else if (strcmp(argv[i], "-tracks") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskTracks = atoi(argv[i + 1]);
+	    	ASSERT(diskTracks >= 1 && diskTracks <= MaxTracks);
+	    	i++;
+		} else if (strcmp(argv[i], "-il") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "auto") == 0)
+	    	    diskInterleave = 0;
+	    	else
+	    	    diskInterleave = atoi(argv[i]);
+	    	ASSERT(diskInterleave >= 0 && diskInterleave <= MaxInterleave);
+		} else if (strcmp(argv[i], "-tc") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	trackCacheSize = atoi(argv[i + 1]);
+	    	ASSERT(trackCacheSize >= 0);
+	    	i++;
+		} else if (strcmp(argv[i], "-dmodel") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "hdd") == 0)
+	    	    diskModel = RotationalModel;
+	    	else if (strcmp(argv[i], "ssd") == 0)
+	    	    diskModel = FlashModel;
+	    	else if (strcmp(argv[i], "zero") == 0)
+	    	    diskModel = InstantModel;
+	    	else
+	    	    cout << "Unknown disk model " << argv[i] << "\n";
+		} else if (strcmp(argv[i], "-pr") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "fifo") == 0)
+	    	    replacePolicy = FifoReplace;
+	    	else if (strcmp(argv[i], "clock") == 0)
+	    	    replacePolicy = ClockReplace;
+	    	else if (strcmp(argv[i], "eclock") == 0)
+	    	    replacePolicy = EnhancedClockReplace;
+	    	else
+	    	    cout << "Unknown replacement policy " << argv[i] << "\n";
+		} else if (strcmp(argv[i], "-po") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	pageOutLow = atoi(argv[i + 1]);
+	    	pageOutHigh = atoi(argv[i + 2]);
+	    	i += 2;
+		} else if (strcmp(argv[i], "-ms") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	swapInterval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-sched") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "fifo") == 0)
+	    	    schedulerPolicy = FifoScheduling;
+	    	else if (strcmp(argv[i], "priority") == 0)
+	    	    schedulerPolicy = PriorityScheduling;
+	    	else if (strcmp(argv[i], "mlfq") == 0)
+	    	    schedulerPolicy = FeedbackScheduling;
+	    	else if (strcmp(argv[i], "stride") == 0)
+	    	    schedulerPolicy = StrideScheduling;
+	    	else
+	    	    cout << "Unknown scheduling policy " << argv[i] << "\n";
+		} else if (strcmp(argv[i], "-quanta") == 0) {
+	    	ASSERT(i + NumFeedbackLevels < argc);
+	    	for (int j = 0; j < NumFeedbackLevels; j++)
+	    	    quanta[j] = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-stacks") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	stacksPreallocated = atoi(argv[i + 1]);
+	    	stacksKept = atoi(argv[i + 2]);
+	    	i += 2;
+		} else if (strcmp(argv[i], "-pagesize") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	pageSize = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-mem") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	memorySize = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-tlb") == 0) {
+	    	ASSERT(i + 3 < argc);
+	    	tlbSize = atoi(argv[i + 1]);
+	    	tlbWays = atoi(argv[i + 2]);
+	    	i += 3;
+	    	if (strcmp(argv[i], "random") == 0)
+	    	    tlbPolicy = RandomTLB;
+	    	else if (strcmp(argv[i], "fifo") == 0)
+	    	    tlbPolicy = FifoTLB;
+	    	else if (strcmp(argv[i], "lru") == 0)
+	    	    tlbPolicy = LruTLB;
+	    	else
+	    	    cout << "Unknown TLB policy " << argv[i] << "\n";
+		} else if (strcmp(argv[i], "-pt") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	i++;
+	    	if (strcmp(argv[i], "linear") == 0)
+	    	    pageTableKind = LinearPageTable;
+	    	else if (strcmp(argv[i], "twolevel") == 0)
+	    	    pageTableKind = TwoLevelPageTable;
+	    	else if (strcmp(argv[i], "hashed") == 0)
+	    	    pageTableKind = HashedPageTable;
+	    	else
+	    	    cout << "Unknown page table " << argv[i] << "\n";
+		} else if (strcmp(argv[i], "-trace") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	traceCategories = argv[++i];
+	    	traceFile = argv[++i];
+		} else if (strcmp(argv[i], "-record") == 0 ||
+			   strcmp(argv[i], "-replay") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	replaying = (strcmp(argv[i], "-replay") == 0);
+	    	replayFile = argv[++i];
+		} else if (strcmp(argv[i], "-statlog") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	statLogFile = argv[++i];
+	    	statLogInterval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-lockstat") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	lockStatTop = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-prof") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	profileInterval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-profsym") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	profileSymbols = argv[++i];
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
             reliability = atof(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "-N") == 0) {
+            networkFlag = TRUE;
+        } else if (strcmp(argv[i], "-nc") == 0) {
+            coalesceFlag = TRUE;
+        } else if (strcmp(argv[i], "-ne") == 0) {
+            netSignalFlag = TRUE;
+        } else if (strcmp(argv[i], "-rf") == 0) {
+            networkFlag = TRUE;
+            remoteFlag = TRUE;
         } else if (strcmp(argv[i], "-m") == 0) {
             ASSERT(i + 1 < argc);   // next argument is int
             hostName = atoi(argv[i + 1]);
             i++;
         } else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-rs randomSeed]\n";
-	   		cout << "Partial usage: nachos [-s]\n";
+	    	cout << "Partial usage: nachos [-tickless] [-slack ticks]\n";
+	   		cout << "Partial usage: nachos [-s] [-st]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
+	    	cout << "Partial usage: nachos [-f | -fe | -bs sectors] [-fl]\n";
+	    	cout << "Partial usage: nachos [-dg removes] [-dedup] [-delalloc]\n";
 #endif
-            cout << "Partial usage: nachos [-n #] [-m #]\n";
+	    	cout << "Partial usage: nachos [-wb ticks dirty]\n";
+	    	cout << "Partial usage: nachos [-ds fifo|sstf|scan|clook] [-dm] [-da] [-dq ticks]\n";
+	    	cout << "Partial usage: nachos [-stripe disks] [-mirror disks]\n";
+	    	cout << "Partial usage: nachos [-tracks tracks] [-dmodel hdd|ssd|zero]\n";
+	    	cout << "Partial usage: nachos [-il interleave|auto] [-tc tracks]\n";
+	    	cout << "Partial usage: nachos [-pr fifo|clock|eclock]\n";
+	    	cout << "Partial usage: nachos [-po low high] [-ms ticks]\n";
+	    	cout << "Partial usage: nachos [-sched fifo|priority|mlfq|stride]\n";
+	    	cout << "Partial usage: nachos [-quanta q0 q1 q2 q3]\n";
+	    	cout << "Partial usage: nachos [-stacks preallocated kept]\n";
+	    	cout << "Partial usage: nachos [-pagesize bytes] [-mem bytes]\n";
+	    	cout << "Partial usage: nachos [-tlb size ways random|fifo|lru]\n";
+	    	cout << "Partial usage: nachos [-pt linear|twolevel|hashed]\n";
+	    	cout << "Partial usage: nachos [-prof interval] [-profsym symbols]\n";
+	    	cout << "Partial usage: nachos [-trace categories file]\n";
+	    	cout << "Partial usage: nachos [-record file | -replay file]\n";
+	    	cout << "Partial usage: nachos [-restore checkpoint]\n";
+	    	cout << "Partial usage: nachos [-statlog file ticks]\n";
+	    	cout << "Partial usage: nachos [-lockstat top]\n";
+            cout << "Partial usage: nachos [-n #] [-nc] [-ne] [-m #]\n";
 		}
     }
+    replay = NULL;
+    if (replayFile != NULL)	// before the devices that read the host
+	replay = new Replay(replayFile, replaying, argc, argv, randomSeed);
 }
 
 //----------------------------------------------------------------------
@@ -99,28 +402,103 @@ Kernel::Initialize()
     // object to save its state. 
 
 	
+    stats = new Statistics();		// collect statistics
+    if (lockStatTop > 0)		// before any lock to profile
+	lockStats = new LockStats();
+    stackPool = new StackPool(stacksPreallocated, stacksKept);
     currentThread = new Thread("main", threadNum++);		
     currentThread->setStatus(RUNNING);
+    if (traceFile != NULL)
+	trace = new Trace(traceCategories);
 
-    stats = new Statistics();		// collect statistics
     interrupt = new Interrupt;		// start up interrupt handling
-    scheduler = new Scheduler();	// initialize the ready queue
-    alarm = new Alarm(randomSlice);	// start up time slicing
-    machine = new Machine(debugUserProg);
+    scheduler = new Scheduler((SchedulerPolicy) schedulerPolicy, quanta);
+					// initialize the ready queue
+    alarm = new Alarm(randomSlice, ticklessFlag, alarmSlack);
+					// start up time slicing
+    ASSERT(memorySize % pageSize == 0);
+    machine = new Machine(debugUserProg, pageSize, memorySize / pageSize);
+    if (tlbSize > 0)
+	machine->UseTLB(tlbSize, tlbWays);
+    machine->pageTableKind = (PageTableKind) pageTableKind;
+    if (profileInterval > 0)
+	machine->StartProfile(profileInterval, profileSymbols);
+    tlbManager = NULL;
+    if (machine->tlb != NULL)
+	tlbManager = new TLBManager((TLBPolicy) tlbPolicy);
+    frameAllocator = new FrameAllocator(NumPhysPages,
+					(ReplacePolicy) replacePolicy);
+    processTable = new ProcessTable();
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+    ASSERT(stripeDisks == 1 || mirrorDisks == 1);
+    if (mirrorDisks > 1)
+	synchDisk = new SynchDisk((DiskSchedule) diskSchedule, mapDisk,
+				  "DISK", mirrorDisks, TRUE,
+				  formatFlag ? diskTracks : 0);
+    else
+	synchDisk = new SynchDisk((DiskSchedule) diskSchedule, mapDisk,
+				  "DISK", stripeDisks, FALSE,
+				  formatFlag ? diskTracks : 0);
+					// the disks are made the new size
+					// before the bitmap and the cache
+					// are, if it is being formatted
+    synchDisk->SetInterleave(diskInterleave);
+    synchDisk->SetTrackCache(trackCacheSize);
+    synchDisk->SetFairQueueing(diskSlice);
+#ifndef FILESYS_STUB
+    synchDisk->MountLog(formatFlag, logFlag);
+#endif
+    swapSpace = new SwapSpace();
+    if (pageOutHigh > 0)
+	frameAllocator->StartPageOut(pageOutLow, pageOutHigh);
+    swapper = NULL;
+    if (swapInterval > 0)
+	swapper = new Swapper(swapInterval);
+    sharedMemory = new SharedMemory();
+    futexes = new FutexTable();
+    bufferCache = new BufferCache(synchDisk, NumCacheBuffers);
+    if (flushInterval > 0 || flushThreshold > 0)
+        bufferCache->StartFlusher(flushInterval, flushThreshold);
+    bufferCache->StartReadAhead();
+    journal = new Journal(bufferCache, synchDisk);
+    dentryCache = new DentryCache();
+    fileTable = new FileTable();
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem();
 #else
-    fileSystem = new FileSystem(formatFlag);
+    fileSystem = NULL;		// while it formats or mounts the disk,
+				// its files are written without it
+    fileSystem = new FileSystem(formatFlag, extentFlag ? ExtentLayout :
+                                IndexLayout | BlockFlag(blockShift));
+    fileSystem->Mount();
+    if (defragRemoves > 0)
+        fileSystem->StartDefragmenter(defragRemoves);
+    if (dedupFlag && !fileSystem->StartDedup())
+        cout << "Dedup: not on this disk\n";
+    if (delallocFlag)
+        fileSystem->StartDelayedAllocation();
 #endif // FILESYS_STUB
 
-	// MP4 mod tag
-    /*
-	postOfficeIn = new PostOfficeInput(10);
-    postOfficeOut = new PostOfficeOutput(reliability);
-	*/
+    if (networkFlag) {		// only a network test needs one
+	postOfficeIn = new PostOfficeInput(NumMailBoxes,
+		netSignalFlag && replay == NULL);
+					// -record and -replay poll, so that
+					// packets come at the same ticks
+	postOfficeOut = new PostOfficeOutput(reliability, coalesceFlag);
+    } else {
+	postOfficeIn = NULL;
+	postOfficeOut = NULL;
+    }
+    fileServer = NULL;
+    remoteFiles = NULL;
+    if (remoteFlag) {		// share files with the other machines
+	fileServer = new RemoteFileServer();
+	remoteFiles = new RemoteFileClient();
+    }
+    statsLog = NULL;
+    if (statLogFile != NULL)
+	statsLog = new StatsLog(statLogFile, statLogInterval);
 
     interrupt->Enable();
 }
@@ -146,23 +524,45 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
-    delete stats;
+    if (replay != NULL) {
+	replay->Halt();
+	delete replay;
+	replay = NULL;
+    }
+    if (trace != NULL) {
+	trace->Write(traceFile);
+	delete trace;
+	trace = NULL;
+    }
+    delete statsLog;		// its last line, before the counts go
     delete interrupt;
     delete scheduler;
     delete alarm;
+    delete tlbManager;
     delete machine;
+    delete frameAllocator;
+    delete processTable;
     delete synchConsoleIn;
     delete synchConsoleOut;
+    delete bufferCache;
     delete synchDisk;
+    delete swapper;
+    delete swapSpace;
+    delete sharedMemory;
+    delete futexes;
     delete fileSystem;
+    delete fileTable;
+    delete journal;
+    delete dentryCache;
+    delete stackPool;
+    delete stats;		// last, as the others may still count,
+    delete lockStats;		// and take locks, as they go
 	
 	// Mp4 mod tag
 	/*
     delete postOfficeIn;
     delete postOfficeOut;
     */
-	
-    Exit(0);
 }
 
 //----------------------------------------------------------------------
@@ -174,10 +574,22 @@ void
 Kernel::ThreadSelfTest() {
    Semaphore *semaphore;
    SynchList<int> *synchList;
+   Lock *lock;
+   Condition *condition;
+   RWLock *rwLock;
+   WorkerPool *workerPool;
    
    LibSelfTest();		// test library routines
    
    currentThread->SelfTest();	// test thread switching
+
+   scheduler->SelfTest();	// test the order of the run queues
+
+   alarm->SelfTest();		// test waiting on the alarm clock
+
+   frameAllocator->SelfTest();	// test physical page allocation
+
+   PageTable::SelfTest();	// test each layout of page table
    
    				// test semaphore operation
    semaphore = new Semaphore("test", 0);
@@ -190,6 +602,26 @@ Kernel::ThreadSelfTest() {
    synchList->SelfTest(9);
    delete synchList;
 
+   				// test waking condition waiters
+   condition = new Condition("test");
+   condition->SelfTest();
+   delete condition;
+
+   				// test priority donation by a lock
+   lock = new Lock("test");
+   lock->SelfTest();
+   delete lock;
+
+   				// test reader-writer locks
+   rwLock = new RWLock("test");
+   rwLock->SelfTest();
+   delete rwLock;
+
+   				// test the worker threads
+   workerPool = new WorkerPool("test worker", 2, 2);
+   workerPool->SelfTest();
+   delete workerPool;
+
 }
 
 //----------------------------------------------------------------------
@@ -224,10 +656,14 @@ Kernel::ConsoleTest() {
 //      3. send an acknowledgment for the other machine's message
 //      4. wait for an acknowledgement from the other machine to our 
 //          original message
+//      5. send the other machine a message far bigger than a packet,
+//          over a reliable Connection, and check the one it sends us
 //
 //  This test works best if each Nachos machine has its own window
 //----------------------------------------------------------------------
 
+static const int TransportTestSize = 2000;	// bytes in the big message
+
 void
 Kernel::NetworkTest() {
 
@@ -269,19 +705,39 @@ Kernel::NetworkTest() {
         cout << "Got: " << buffer << " : from " << inPktHdr.from << ", box " 
                                                 << inMailHdr.from << "\n";
         cout.flush();
+
+        // Exchange a big message between our mailboxes #2
+        Connection *connection = new Connection(farHost, 2, 2);
+        char *big = new char[TransportTestSize];
+        int n, bad = 0;
+
+        for (int i = 0; i < TransportTestSize; i++)
+            big[i] = 'a' + (i + hostName) % 26;
+        connection->Send(big, TransportTestSize);
+        n = connection->Receive(big, TransportTestSize);
+        for (int i = 0; i < n; i++)
+            if (big[i] != 'a' + (i + farHost) % 26)
+                bad++;
+        cout << "Got " << n << " bytes reliably from " << farHost << ", "
+             << bad << " wrong\n";
+        cout.flush();
+        connection->Flush();
+        delete [] big;
     }
 
     // Then we're done!
 }
 
+//----------------------------------------------------------------------
+// ForkExecute
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the program already loaded into the thread's
+//	address space.
+//----------------------------------------------------------------------
+
 void ForkExecute(Thread *t)
 {
-	if ( !t->space->Load(t->getName()) ) {
-    	return;             // executable not found
-    }
-	
     t->space->Execute(t->getName());
-
 }
 
 void Kernel::ExecAll()
@@ -289,44 +745,134 @@ void Kernel::ExecAll()
 	for (int i=1;i<=execfileNum;i++) {
 		int a = Exec(execfile[i]);
 	}
+	for (int i = 1; i <= restorefileNum; i++)
+		Restore(restorefile[i]);
 	currentThread->Finish();
     //Kernel::Exec();	
 }
 
+//----------------------------------------------------------------------
+// Kernel::Exec
+// 	Load the program in the file "name" into a new address space,
+//	and fork a thread to run it, concurrently with the caller.  The
+//	program is loaded before this returns, so a program that is not
+//	there, or does not fit in the free memory, is caught here.
+//	Return the program's SpaceId, for Join, or -1.
+//
+//	If "input" is not -1, it is a read end of one of the caller's
+//	pipes, and the program's console input reads from it instead;
+//	likewise "output", a write end, for its console output.  The
+//	program holds the ends for itself: the caller may close its own.
+//----------------------------------------------------------------------
 
-int Kernel::Exec(char* name)
+int Kernel::Exec(char* name, int input, int output)
 {
-	t[threadNum] = new Thread(name, threadNum);
-	t[threadNum]->space = new AddrSpace();
-	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
-	threadNum++;
-
-	return threadNum-1;
-/*
-    cout << "Total threads number is " << execfileNum << endl;
-    for (int n=1;n<=execfileNum;n++) {
-		t[n] = new Thread(execfile[n]);
-		t[n]->space = new AddrSpace();
-		t[n]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[n]);
-		cout << "Thread " << execfile[n] << " is executing." << endl;
+	AddrSpace *parent = currentThread->space;
+	AddrSpace *space;
+	PipeEnd *in = NULL, *out = NULL;
+	Thread *thread;
+	char *copy;
+	int id;
+
+	if (input != -1 && (parent == NULL ||
+	    (in = parent->GetPipeEnd(input)) == NULL || in->IsWriteEnd()))
+		return -1;
+	if (output != -1 && (parent == NULL ||
+	    (out = parent->GetPipeEnd(output)) == NULL || !out->IsWriteEnd()))
+		return -1;
+	space = new AddrSpace();
+	if (!space->Load(name)) {
+		delete space;
+		return -1;
 	}
-	cout << "debug Kernel::Run finished.\n";	
-*/
-//  Thread *t1 = new Thread(execfile[1]);
-//  Thread *t1 = new Thread("../test/test1");
-//  Thread *t2 = new Thread("../test/test2");
-
-//    AddrSpace *halt = new AddrSpace();
-//  t1->space = new AddrSpace();
-//  t2->space = new AddrSpace();
-
-//    halt->Execute("../test/halt");
-//  t1->Fork((VoidFunctionPtr) &ForkExecute, (void *)t1);
-//  t2->Fork((VoidFunctionPtr) &ForkExecute, (void *)t2);
-
-//	currentThread->Finish();
-//    Kernel::Run();
-//  cout << "after ThreadedKernel:Run();" << endl;  // unreachable
+	if (in != NULL)
+		space->Redirect(SysConsoleInput, in->Copy());
+	if (out != NULL)
+		space->Redirect(SysConsoleOutput, out->Copy());
+	copy = new char[strlen(name) + 1];	// the caller's may not last
+	strcpy(copy, name);
+	thread = new Thread(copy, threadNum++);
+	id = processTable->Add(copy);
+	space->SetId(id);
+	thread->space = space;
+	thread->Fork((VoidFunctionPtr) &ForkExecute, (void *)thread);
+	return id;
+}
+
+//----------------------------------------------------------------------
+// Kernel::Restore
+// 	Start the program saved by Checkpoint in the file "name" again, in
+//	a new address space, from where it was saved (see
+//	AddrSpace::Restore); otherwise as Exec starts a program.  Return
+//	its SpaceId, or -1 if it cannot be restored.
+//----------------------------------------------------------------------
+
+int Kernel::Restore(char *name)
+{
+	AddrSpace *space = new AddrSpace();
+	Thread *thread;
+	char *copy;
+	int id;
+
+	if (!space->Restore(name)) {
+		delete space;
+		return -1;
+	}
+	copy = new char[strlen(name) + 1];
+	strcpy(copy, name);
+	thread = new Thread(copy, threadNum++);
+	id = processTable->Add(copy);
+	space->SetId(id);
+	thread->space = space;
+	thread->Fork((VoidFunctionPtr) &ForkExecute, (void *)thread);
+	return id;
+}
+
+//----------------------------------------------------------------------
+// Kernel::Join
+// 	Wait for the running program's child "id" to exit, and return
+//	its exit status; -1 if "id" is not a child still to be joined.
+//----------------------------------------------------------------------
+
+int Kernel::Join(int id)
+{
+	return processTable->Join(id);
+}
+
+//----------------------------------------------------------------------
+// ForkThreadExecute
+// 	Dummy function, as ForkExecute is, for a thread forked by a user
+//	program: runs it from where it was given to start.
+//----------------------------------------------------------------------
+
+static void ForkThreadExecute(Thread *t)
+{
+    t->space->ExecuteThread();
+}
+
+//----------------------------------------------------------------------
+// Kernel::ThreadFork
+// 	Fork a thread of the running program, in its address space, to
+//	run "root" in user mode with "func" and "arg" as its arguments,
+//	on a stack of its own.  The thread goes by the program's name.
+//	Return its ThreadId, for ThreadJoin, or -1 if the program cannot
+//	have another.
+//----------------------------------------------------------------------
+
+int Kernel::ThreadFork(int func, int arg, int root)
+{
+	AddrSpace *space = currentThread->space;
+	Thread *thread = new Thread(currentThread->getName(), threadNum++);
+	int id = space->AddThread(thread, func, arg, root);
+
+	if (id < 0) {
+		delete thread;
+		return -1;
+	}
+	thread->space = space;
+	thread->ioClass = currentThread->ioClass;
+	thread->Fork((VoidFunctionPtr) &ForkThreadExecute, (void *)thread);
+	return id;
 }
 
 
@@ -335,18 +881,167 @@ int Kernel::CreateFile(char *filename, int size)
 	return fileSystem->Create(filename, size);
 }
 
+//----------------------------------------------------------------------
+// Kernel::myOpen, Kernel::Read, ...
+// 	The file calls of user programs.  A name under RemotePrefix, and
+//	the id it is opened as, are for the remote file client; the ids
+//	of the running program's pipe ends, its console's included once
+//	redirected, are for the pipe; the rest are for our own file
+//	system.
+//----------------------------------------------------------------------
+
+static PipeEnd *
+PipeEndOf(int id)
+{
+    AddrSpace *space = kernel->currentThread->space;
+
+    return (space == NULL) ? NULL : space->GetPipeEnd(id);
+}
+
 int Kernel::myOpen(char *filename) {
+    if (remoteFiles != NULL && RemoteFileClient::IsRemote(filename))
+        return remoteFiles->Open(filename);
     return fileSystem->myOpen(filename);
 }
 
 int Kernel::Read(char *buffer, int size, int id) {
+    PipeEnd *end = PipeEndOf(id);
+
+    if (end != NULL)
+        return end->Read(buffer, size);
+    if (id == SysConsoleInput)
+        return synchConsoleIn->GetLine(buffer, size);
+    if (remoteFiles != NULL && remoteFiles->Owns(id))
+        return remoteFiles->Read(buffer, size, id);
     return fileSystem->Read(buffer, size, id);
 }
 
 int Kernel::Write(char *buffer, int size, int id) {
+    PipeEnd *end = PipeEndOf(id);
+
+    if (end != NULL)
+        return end->Write(buffer, size);
+    if (id == SysConsoleOutput) {
+        synchConsoleOut->PutString(buffer, size);
+        return size;
+    }
+    if (remoteFiles != NULL && remoteFiles->Owns(id))
+        return remoteFiles->Write(buffer, size, id);
     return fileSystem->Write(buffer, size, id);
 }
 
 int Kernel::Close(int id) {
+    if (PipeEndOf(id) != NULL) {
+        delete currentThread->space->RemovePipeEnd(id);
+        return 1;
+    }
+    if (remoteFiles != NULL && remoteFiles->Owns(id))
+        return remoteFiles->Close(id);
     return fileSystem->Close(id);
 }
+
+int Kernel::Fsync(int id) {
+    return fileSystem->Fsync(id);
+}
+
+int Kernel::Seek(int offset, int whence, int id) {
+    if (remoteFiles != NULL && remoteFiles->Owns(id))
+        return remoteFiles->Seek(offset, whence, id);
+    return fileSystem->Seek(offset, whence, id);
+}
+
+int Kernel::FileSize(int id) {
+    return fileSystem->FileSize(id);
+}
+
+int Kernel::CopyRange(int fromId, int toId, int size) {
+    if (remoteFiles != NULL &&
+            (remoteFiles->Owns(fromId) || remoteFiles->Owns(toId)))
+        return -1;
+    return fileSystem->CopyRange(fromId, toId, size);
+}
+
+int Kernel::Preallocate(int id, int size, int flags) {
+    if (remoteFiles != NULL && remoteFiles->Owns(id))
+        return -1;
+    return fileSystem->Preallocate(id, size, flags);
+}
+
+//----------------------------------------------------------------------
+// Kernel::MakePipe
+// 	Make a pipe for the running program, and put the ids of its read
+//	and write ends in "ids".  Return 1, or -1 if the program holds
+//	too many pipe ends already.
+//----------------------------------------------------------------------
+
+int Kernel::MakePipe(int *ids) {
+    AddrSpace *space = currentThread->space;
+    PipeBuffer *pipe = new PipeBuffer();
+    PipeEnd *readEnd = new PipeEnd(pipe, FALSE);
+    PipeEnd *writeEnd = new PipeEnd(pipe, TRUE);
+
+    ids[0] = space->AddPipeEnd(readEnd);
+    ids[1] = (ids[0] < 0) ? -1 : space->AddPipeEnd(writeEnd);
+    if (ids[1] < 0) {
+        if (ids[0] >= 0)
+            (void) space->RemovePipeEnd(ids[0]);
+        delete readEnd;
+        delete writeEnd;			// and the pipe with it
+        return -1;
+    }
+    return 1;
+}
+
+int Kernel::RemoveFile(char *filename) {
+    return fileSystem->Remove(filename) ? 1 : -1;
+}
+
+int Kernel::RenameFile(char *from, char *to) {
+    return fileSystem->Rename(from, to) ? 1 : -1;
+}
+
+int Kernel::CreateDir(char *name) {
+    return fileSystem->CreateDir(name) ? 1 : -1;
+}
+
+int Kernel::ReadDir(char *name, int *cursor, DirectoryEntry *entries,
+                    int *sizes, int count) {
+    return fileSystem->ReadDir(name, cursor, entries, sizes, count);
+}
+
+//----------------------------------------------------------------------
+// Kernel::PrintFsStats
+// 	Print what the file system has done: how often each operation
+//	was called, and the ticks it took; the bytes user programs moved
+//	through it, against those the disk moved; and how well its
+//	caches did.
+//----------------------------------------------------------------------
+
+void
+Kernel::PrintFsStats()
+{
+    static const char *opNames[NumFsOps] =
+	{ "create", "open", "read", "write", "remove", "lookup" };
+
+    cout << "File system operations:";
+    for (int i = 0; i < NumFsOps; i++)
+	cout << (i > 0 ? "," : "") << " " << opNames[i] << " "
+	     << stats->fsOps[i] << " (" << stats->fsOpTicks[i] << " ticks)";
+    cout << "\n";
+    cout << "File system lookups: path names searched "
+	 << stats->numLookupComponents << "\n";
+    cout << "File system bytes: user read " << stats->numUserBytesRead
+	 << ", written " << stats->numUserBytesWritten << "; disk read "
+	 << stats->numDiskReads * SectorSize << ", written "
+	 << stats->numDiskWrites * SectorSize << "\n";
+    if (stats->numSectorsDeduplicated > 0)
+	cout << "File system dedup: sectors shared "
+	     << stats->numSectorsDeduplicated << "\n";
+    cout << "File system caches: buffers hits " << bufferCache->Hits()
+	 << ", misses " << bufferCache->Misses() << ", evictions "
+	 << bufferCache->Evictions() << "; dentries hits "
+	 << dentryCache->Hits() << ", misses " << dentryCache->Misses()
+	 << ", evictions " << dentryCache->Evictions() << "; headers hits "
+	 << fileTable->Hits() << ", misses " << fileTable->Misses()
+	 << ", evictions " << fileTable->Evictions() << "\n";
+}
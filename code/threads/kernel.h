@@ -24,6 +24,23 @@ class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class BufferCache;
+class DentryCache;
+class FileTable;
+class Journal;
+class ProcessTable;
+class FrameAllocator;
+class SwapSpace;
+class Swapper;
+class SharedMemory;
+class FutexTable;
+class TLBManager;
+class RemoteFileServer;
+class RemoteFileClient;
+class Trace;
+class Replay;
+class StatsLog;
+class LockStats;
 
 
 
@@ -41,12 +58,24 @@ class Kernel {
 	void PrepareToEnd(); // called before all running programs end
 	
 	void ExecAll();
-	int Exec(char* name);
+	int Exec(char* name, int input = -1, int output = -1);
+				// start a user program, its console
+				// input or output redirected to the
+				// caller's pipe ends "input" and
+				// "output", if given; its SpaceId,
+				// or -1 if it cannot be loaded
+	int Restore(char *name);
+				// start a program again from the
+				// checkpoint "name"; its SpaceId,
+				// or -1 if it cannot be restored
+	int Join(int id);	// wait for a child program to exit
+	int ThreadFork(int func, int arg, int root);
+				// start another thread of the running
+				// program; its ThreadId, or -1
     void ThreadSelfTest();	// self test of threads and synchronization
 	
     void ConsoleTest();         // interactive console self test
     void NetworkTest();         // interactive 2-machine network test
-	Thread* getThread(int threadID){return t[threadID];}    
 
 
 	int CreateFile(char* filename, int size); // fileSystem call
@@ -59,6 +88,29 @@ class Kernel {
     
     int Close(int id);
 
+    int Fsync(int id);
+
+    int Seek(int offset, int whence, int id);
+
+    int FileSize(int id);
+
+    int CopyRange(int fromId, int toId, int size);
+
+    int Preallocate(int id, int size, int flags);
+
+    int MakePipe(int *ids);
+
+    int RemoveFile(char *filename);
+
+    int RenameFile(char *from, char *to);
+
+    int CreateDir(char *name);
+
+    int ReadDir(char *name, int *cursor, DirectoryEntry *entries,
+                int *sizes, int count);
+
+    void PrintFsStats();	// print the file system statistics
+
 // These are public for notational convenience; really, 
 // they're global variables used everywhere.
 
@@ -71,26 +123,125 @@ class Kernel {
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+    BufferCache *bufferCache;	// sector cache in front of synchDisk
+    Journal *journal;		// log of file system metadata writes
+    DentryCache *dentryCache;	// cache of path name lookups
+    FileTable *fileTable;	// in-core headers of the open files
+    ProcessTable *processTable;	// the user programs started by Exec
+    FrameAllocator *frameAllocator;	// physical pages given to programs
+    SwapSpace *swapSpace;	// where their pages go when memory is full
+    Swapper *swapper;		// swaps whole programs out when they do
+				// not fit; NULL unless -ms
+    SharedMemory *sharedMemory;	// the segments they share memory by
+    FutexTable *futexes;	// who waits on which words of it
+    TLBManager *tlbManager;	// loads the TLB on a miss; NULL if the
+				// machine has no TLB
+    StackPool *stackPool;	// stacks for threads to be forked
     FileSystem *fileSystem;     
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
+    RemoteFileServer *fileServer;	// serves our files to other machines
+    RemoteFileClient *remoteFiles;	// reaches theirs; NULL unless -rf
 
     int hostName;               // machine identifier
+    int diskModel;              // how long disk requests take (a
+                                // DiskModelKind, see diskmodel.h)
+    bool asyncDisk;             // do the disks' host I/O on host threads
+    bool statsFlag;             // print the statistics at halt (-st)
+    bool fsStatsFlag;           // print the file system's at halt
+                                // (-fsstat)
+    Trace *trace;               // recent kernel events; NULL unless -trace
+    Replay *replay;             // log of the run's inputs, recorded or
+                                // replayed; NULL unless -record/-replay
+    StatsLog *statsLog;         // the statistics as they go; NULL unless
+                                // -statlog
+    LockStats *lockStats;       // contention for the synchronization
+                                // objects; NULL unless -lockstat
+    int lockStatTop;            // how many names to print at halt
 
   private:
 
-	Thread* t[10];
 	char*   execfile[10];
 	int execfileNum;
+	char*   restorefile[10];	// checkpoints to start, after them
+	int restorefileNum;
 	int threadNum;
     bool randomSlice;		// enable pseudo-random time slicing
+    bool ticklessFlag;		// stop the timer while no thread is
+				// ready (-tickless)
+    int alarmSlack;		// how late the alarm clock may wake a
+				// thread, to wake several at once
     bool debugUserProg;         // single step user program
     double reliability;         // likelihood messages are dropped
+    bool networkFlag;           // set up the post office (-N)
+    bool coalesceFlag;          // pack small mails into one packet
+    bool netSignalFlag;         // have the host signal packets as they
+                                // arrive, instead of polling (-ne)
+    bool remoteFlag;            // share files with other machines (-rf)
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
+    bool extentFlag;          // format with extent-based file headers
+    int blockShift;           // or with index blocks mapping 2^this
+                              // sectors each
+    bool logFlag;             // format the disk as a log
+    int defragRemoves;        // removals between background defrag
+                              // passes, 0 for none
+    bool dedupFlag;           // share sectors written with copies
+                              // already on disk
+    bool delallocFlag;        // give appended data sectors as it is
+                              // written behind
 #endif
+    int flushInterval;        // ticks between write-behind passes
+    int flushThreshold;       // dirty buffers that start a pass
+    int diskSchedule;         // order of queued disk requests (a
+                              // DiskSchedule, see synchdisk.h)
+    bool mapDisk;             // map DISK_0 into memory
+    int stripeDisks;          // disks the file system's volume is
+                              // striped across
+    int mirrorDisks;          // or mirrored on
+    int diskTracks;           // tracks of each disk formatted, or 0
+                              // to keep its size
+    int diskInterleave;       // sectors apart files are put on a
+                              // track, or 0 to measure it
+    int trackCacheSize;       // tracks the volume keeps in memory
+    int diskSlice;            // ticks of a process's turn at the disk,
+                              // or 0 for no fair queueing
+    int replacePolicy;        // how frames are taken back from pages (a
+                              // ReplacePolicy, see frames.h)
+    int pageOutLow;           // free frames that wake the pageout
+    int pageOutHigh;          // thread, and that it stops at; 0 for
+                              // no pageout thread
+    int swapInterval;         // ticks between passes of the swapper,
+                              // 0 for none
+    int schedulerPolicy;      // order of ready threads (a
+                              // SchedulerPolicy, see scheduler.h)
+    int quanta[NumFeedbackLevels];	// time slice of each feedback
+				// level, in timer interrupts
+    int stacksPreallocated;   // thread stacks made at boot
+    int stacksKept;           // most stacks kept for reuse
+    int pageSize;             // bytes in a page
+    int memorySize;           // bytes of physical memory
+    int tlbSize;              // entries in the TLB, 0 for none
+    int tlbWays;              // its associativity
+    int tlbPolicy;            // which entry a miss puts out (a
+                              // TLBPolicy, see tlb.h)
+    int pageTableKind;        // how page tables are laid out (a
+                              // PageTableKind, see translate.h)
+    int profileInterval;      // instructions between samples of the
+                              // user PC, 0 for no profile
+    char *profileSymbols;     // "nm -n" output naming the functions
+    char *traceCategories;    // events to trace (see trace.h)
+    char *traceFile;          // UNIX file the trace goes to at halt,
+                              // NULL for no trace
+    int randomSeed;           // the -rs seed, -1 for none
+    char *replayFile;         // UNIX file of the log of inputs, NULL
+                              // for none
+    bool replaying;           // replay it, rather than record it?
+    char *statLogFile;        // UNIX file the -statlog lines go to, NULL
+                              // for none
+    int statLogInterval;      // ticks between them
 };
 
 
@@ -0,0 +1,156 @@
+// lockstat.cc
+//	Routines to profile the contention for synchronization objects.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "lockstat.h"
+#include "main.h"
+
+static char *kindNames[] = { "lock", "semaphore", "condition" };
+
+//----------------------------------------------------------------------
+// SynchProfile::SynchProfile, ~SynchProfile
+// 	Start the counts for objects of "kind" named "name"; de-allocate
+//	them.
+//----------------------------------------------------------------------
+
+SynchProfile::SynchProfile(char *name, SynchKind kind)
+{
+    this->name = new char[strlen(name) + 1];
+    strcpy(this->name, name);
+    this->kind = kind;
+    numObjects = numTaken = numContended = 0;
+    waitTicks = maxWait = holdTicks = maxHold = 0;
+}
+
+SynchProfile::~SynchProfile()
+{
+    delete [] name;
+}
+
+//----------------------------------------------------------------------
+// SynchProfile::Taken
+// 	Count an Acquire, P or Wait that began at "startTicks" and has
+//	now returned, having had to wait if "waited".
+//----------------------------------------------------------------------
+
+void
+SynchProfile::Taken(int startTicks, bool waited)
+{
+    int wait = kernel->stats->totalTicks - startTicks;
+
+    numTaken++;
+    if (waited) {
+	numContended++;
+	waitTicks += wait;
+	maxWait = max(maxWait, wait);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchProfile::Released
+// 	Count the time a lock was held, from "takenTicks" until now.
+//----------------------------------------------------------------------
+
+void
+SynchProfile::Released(int takenTicks)
+{
+    int hold = kernel->stats->totalTicks - takenTicks;
+
+    holdTicks += hold;
+    maxHold = max(maxHold, hold);
+}
+
+//----------------------------------------------------------------------
+// LockStats::LockStats, ~LockStats
+// 	Start with no profiles; de-allocate them.
+//----------------------------------------------------------------------
+
+LockStats::LockStats()
+{
+    profiles = new List<SynchProfile *>;
+}
+
+LockStats::~LockStats()
+{
+    while (!profiles->IsEmpty())
+	delete profiles->RemoveFront();
+    delete profiles;
+}
+
+//----------------------------------------------------------------------
+// LockStats::Find
+// 	Return the profile an object of "kind" named "name" is to count
+//	into, making it if it is the first of them.  A NULL name counts
+//	as "(unnamed)".
+//----------------------------------------------------------------------
+
+SynchProfile *
+LockStats::Find(char *name, SynchKind kind)
+{
+    ListIterator<SynchProfile *> it(profiles);
+    SynchProfile *profile;
+
+    if (name == NULL)
+	name = "(unnamed)";
+    for (; !it.IsDone(); it.Next()) {
+	profile = it.Item();
+	if (profile->kind == kind && strcmp(profile->name, name) == 0) {
+	    profile->numObjects++;
+	    return profile;
+	}
+    }
+    profile = new SynchProfile(name, kind);
+    profile->numObjects++;
+    profiles->Append(profile);
+    return profile;
+}
+
+//----------------------------------------------------------------------
+// LongerWait
+// 	Order profiles by the time spent waiting, longest first, for
+//	SortedList; ties go to the one taken more often.
+//----------------------------------------------------------------------
+
+static int
+LongerWait(SynchProfile *x, SynchProfile *y)
+{
+    if (x->waitTicks != y->waitTicks)
+	return (x->waitTicks > y->waitTicks) ? -1 : 1;
+    if (x->numTaken != y->numTaken)
+	return (x->numTaken > y->numTaken) ? -1 : 1;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// LockStats::Print
+// 	Print the "most" names whose objects waited longest, one to a
+//	line; those never taken are left out.
+//----------------------------------------------------------------------
+
+void
+LockStats::Print(int most)
+{
+    SortedList<SynchProfile *> sorted(LongerWait);
+    ListIterator<SynchProfile *> it(profiles);
+    SynchProfile *p;
+
+    for (; !it.IsDone(); it.Next())
+	if (it.Item()->numTaken > 0)
+	    sorted.Insert(it.Item());
+    cout << "Contention: top " << min(most, (int) sorted.NumInList())
+	 << " of " << profiles->NumInList() << " names, by ticks waited\n";
+    for (int i = 0; i < most && !sorted.IsEmpty(); i++) {
+	p = sorted.RemoveFront();
+	cout << "  " << kindNames[p->kind] << " \"" << p->name << "\" (x"
+	     << p->numObjects << "): taken " << p->numTaken;
+	cout << ", contended " << p->numContended;
+	cout << ", waited " << p->waitTicks << " (max " << p->maxWait << ")";
+	if (p->kind == LockSynch)
+	    cout << ", held " << p->holdTicks << " (max " << p->maxHold << ")";
+	cout << "\n";
+    }
+}
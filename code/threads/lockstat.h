@@ -0,0 +1,71 @@
+// lockstat.h
+//	Data structures to profile the contention for locks, semaphores
+//	and condition variables (-lockstat), to find where finer-grained
+//	locking would pay off.
+//
+//	Synchronization objects are counted by name (the debugName they
+//	are made with), so the locks of all the open files, say, which
+//	share one name, add up to one line.  For each name is counted how
+//	many times it was taken (Acquire, P or Wait), how many of those
+//	had to wait, and how long they waited, in all and at most; and
+//	for locks, how long they were held.  A condition's waits are for
+//	a Signal, not for another thread to let go, but show where threads
+//	sit as well.
+//
+//	Only objects made after the kernel's Statistics are profiled;
+//	reading the clock takes no simulated time, so profiling does not
+//	change how a run goes.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include "copyright.h"
+#include "list.h"
+
+enum SynchKind { LockSynch, SemaphoreSynch, ConditionSynch };
+
+// The following class defines the counts kept for one name.
+
+class SynchProfile {
+  public:
+    SynchProfile(char *name, SynchKind kind);
+    ~SynchProfile();
+
+    void Taken(int startTicks, bool waited);
+				// Taken after trying at "startTicks";
+				// "waited" if it had to
+    void Released(int takenTicks);	// A lock, taken at "takenTicks",
+				// is let go
+
+    char *name;			// a copy of the objects' name
+    SynchKind kind;
+    int numObjects;		// objects made with the name
+    int numTaken;		// Acquires, Ps or Waits done
+    int numContended;		// those that had to wait
+    int waitTicks;		// time they waited, in all
+    int maxWait;		// and at most
+    int holdTicks;		// time a lock was held, in all
+    int maxHold;		// and at most
+};
+
+// The following class defines the profiles of all the names.
+
+class LockStats {
+  public:
+    LockStats();		// no names yet
+    ~LockStats();
+
+    SynchProfile *Find(char *name, SynchKind kind);
+				// The profile for a new object of "kind"
+				// named "name", made if need be
+    void Print(int most);	// Print the "most" that waited longest
+
+  private:
+    List<SynchProfile *> *profiles;	// in the order first made
+};
+
+#endif // LOCKSTAT_H
@@ -2,33 +2,170 @@
 //	Driver code to initialize, selftest, and run the
 //	operating system kernel.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
-//              -p <nachos file> -r <nachos file> -l -D
-//              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+// Usage: nachos -d <debugflags> -rs <random seed #> -tickless -slack <ticks>
+//              -s -st -x <nachos file> -ci <consoleIn> -co <consoleOut>
+//              -f -fe -bs <sectors> -fl -wb <ticks> <dirty>
+//              -ds <schedule> -dm -da -dq <ticks>
+//              -stripe <disks> -mirror <disks> -tracks <tracks>
+//              -dmodel <model> -il <interleave> -tc <tracks>
+//              -cp <unix file> <nachos file> -cpz <unix file> <nachos file>
+//              -cpn <nachos file> <nachos file>
+//              -snap <nachos file> <nachos file>
+//              -mv <nachos file> <nachos file>
+//              -p <nachos file> -r <nachos file> -l -D -fsck -fsckr
+//              -defrag -dg <removes> -dedup -delalloc -fsstat
+//              -n <network reliability> -nc -ne -m <machine id> -rf
+//              -sched <policy> -quanta <q0> <q1> <q2> <q3>
+//              -stacks <preallocated> <kept> -pagesize <bytes> -mem <bytes>
+//              -prof <instructions> -profsym <symbol file>
+//              -trace <categories> <trace file>
+//              -record <log file> -replay <log file>
+//              -statlog <log file> <ticks> -lockstat <top>
+//              -cluster <machines>
+//              -z -K -B -C -N
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -tickless stops the timer while no thread is ready to be switched
+//        to, instead of interrupting every TimerTicks regardless
+//    -slack lets the alarm clock wake a thread up to so many ticks late
+//        (see Alarm::WaitUntil), so that one interrupt wakes several
 //    -z prints the copyright message
 //    -s causes user programs to be executed in single-step mode
+//    -st prints the statistics when Nachos halts, as "-d a" does,
+//        without the debugging messages -- and each program's faults,
+//        evictions and working set as it exits
 //    -x runs a user program
 //    -ci specify file for console input (stdin is the default)
 //    -co specify file for console output (stdout is the default)
 //    -n sets the network reliability
+//    -nc lets small mails to one machine share a packet
+//    -ne has the host signal packets as they arrive, rather than
+//        polling for them every NetworkTime ticks
+//    -rf shares files with the other machines: this one's are served
+//        to them, and theirs are named /net/<machine id>/<name>
 //    -m sets this machine's host id (needed for the network)
+//    -cluster runs so many machines in this one process, each with its
+//        own kernel, disk and host id (0, 1, ...), and a network between
+//        them in memory instead of UNIX sockets; they halt once none
+//        has anything left to do (see cluster.h)
+//    -sched chooses the order in which ready threads run: fifo (the
+//        default), priority, highest first (see SetPriority), mlfq,
+//        a multi-level feedback queue, or stride, a share of the CPU
+//        in proportion to each thread's tickets (see SetTickets), with
+//        a report at halt of what each had and was due
+//    -quanta sets the time slice of each mlfq level, in timer
+//        interrupts (1 2 4 8 by default)
+//    -stacks sets how many thread stacks are made at boot (4), and
+//        how many stacks of finished threads are kept for reuse (16)
+//    -pagesize sets the size of a page of user memory: a power of two,
+//        and a whole number of disk sectors (128 bytes, the default)
+//    -mem sets the size of physical memory, a whole number of pages
+//        (16 KB by default)
+//    -prof counts the user instructions run by opcode, and samples the
+//        PC every so many of them; both are printed at halt
+//    -profsym names the functions the samples fell in, from the output
+//        of "nm -n" on the program's COFF file ("make <program>.sym"
+//        in test)
+//    -trace records kernel events of the categories given (see trace.h)
+//        in a ring, written to the trace file at halt; trace2json turns
+//        it into JSON for Chrome's trace viewer
+//    -record logs what the run takes from outside the simulation --
+//        the -rs seed, console input and network packets, as they come
+//        in -- and the result of every system call (see replay.h)
+//    -replay runs again from such a log, tick for tick, and says where
+//        it went its own way, if it did; give it the same arguments,
+//        and a copy of the disk the recording started with
+//    -statlog writes a line to the log file every so many ticks, of how
+//        much the statistics went up since the last (see statlog.h)
+//    -lockstat prints, at halt, the locks, semaphores and conditions
+//        (by name) whose threads waited longest for them, so many of
+//        them (see lockstat.h)
 //    -K run a simple self test of kernel threads and synchronization
+//    -B time the sorted list, heap and skip list of lib against each
+//        other
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
 //
 //    Filesystem-related flags:
-//    -f forces the Nachos disk to be formatted
+//    -f forces the Nachos disk to be formatted: it is erased, leaving
+//        the UNIX file sparse, and only the superblock, the bitmap and
+//        the root directory are written
+//    -fe formats the disk with extent-based file headers
+//    -bs formats the disk with index lists that map blocks of the given
+//        number of sectors (a power of two, up to 16) rather than
+//        single sectors (see filehdr.h); the tails of files still take
+//        single sectors
+//    -fl formats the disk as a log (see logvolume.h), with either kind
+//        of file header; later runs find the log and mount it
+//    -wb sets how often (in ticks) and at how many dirty buffers the
+//        write-behind thread cleans the buffer cache; "-wb 0 0" turns
+//        it off
+//    -ds chooses the order in which queued disk requests are served:
+//        fifo (the default), sstf, scan or clook
+//    -dm maps the disk's UNIX file into memory, instead of doing a
+//        system call for every disk request
+//    -da does the disk's reads and writes of its UNIX file on a host
+//        thread, while the simulation goes on until the request's
+//        interrupt, instead of waiting for each system call
+//    -dq queues disk requests fairly: those of realtime threads first,
+//        then each process's in turn, for up to that many ticks a
+//        turn, and those of idle threads (the defragmenter) only when
+//        nothing else is waiting; SetIoClass sets a thread's class
+//    -stripe stripes the file system across that many disks (DISK_0,
+//        DISK1_0, DISK2_0, ...), which work on their parts of a request
+//        at the same time; a disk must be used with the number of disks
+//        it was formatted on
+//    -mirror mirrors the file system on that many disks instead, each
+//        holding all of it: reads go to the disk that can serve them
+//        soonest, and if some of the disks are missing, the others
+//        are used
+//    -tracks makes the disks formatted with -f that many tracks long
+//        (up to MaxTracks, 128 MB of them); without it, they keep their
+//        size, and a new disk has NumTracks
+//    -dmodel chooses how long disk requests take: hdd, a hard disk
+//        that seeks and rotates (the default); ssd, a solid-state disk
+//        with several channels, whose writes stall while erase blocks
+//        are cleaned; or zero, a disk that takes a tick for anything
+//    -il allocates the sectors of files that many apart on a track
+//        (1, one after the other, is the default), or with "auto", as
+//        far apart as requests for the next sector are found to need;
+//        only for files of the index layout, whose sectors need not be
+//        in runs
+//    -tc keeps that many whole tracks in memory, below the buffer
+//        cache: a read that misses them reads its whole track
 //    -cp copies a file from UNIX to Nachos
+//    -cpz copies a file from UNIX to a compressed Nachos file (see
+//        FileSystem::Create); not on a disk formatted with -fe
+//    -cpn copies a Nachos file to another, without it leaving the
+//        kernel (see OpenFile::CopyFrom)
+//    -snap takes a snapshot of a Nachos file or directory tree: a copy
+//        sharing its data until either is written (see
+//        FileSystem::Snapshot); "-rr <tree> -snap <snapshot> <tree>"
+//        rolls a tree back to a snapshot
+//    -mv moves a Nachos file or directory tree to a new name, in the
+//        same directory or another, without copying it (see
+//        FileSystem::Rename)
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system
+//    -fsck checks that the bitmap agrees with the files on disk
+//    -fsckr checks the file system, and repairs the bitmap
+//    -defrag moves each fragmented file to one run of sectors
+//    -dg defragments in the background, after every <removes> files
+//        removed
+//    -dedup shares each data sector written with any sector already
+//        holding the same bytes (see FileSystem::StartDedup); not on a
+//        disk formatted with -fe
+//    -delalloc keeps what is written past the end of a file in memory,
+//        and only gives it sectors as it is written behind, synced or
+//        closed, so that an appended file gets one run of them (see
+//        FileSystem::StartDelayedAllocation)
+//    -fsstat prints, at halt, how often each file system operation
+//        was called and the ticks it took, the bytes read and written
+//        by user programs and by the disk, and the hits, misses and
+//        evictions of the buffer cache, dentry cache and header table
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -45,10 +182,14 @@
 #include "filesys.h"
 #include "openfile.h"
 #include "sysdep.h"
+#include "remotefs.h"
+#include "libtest.h"
+#include "cluster.h"
 
 // global variables
 Kernel *kernel;
 Debug *debug;
+Cluster *cluster;		// NULL unless -cluster
 
 
 //----------------------------------------------------------------------
@@ -61,28 +202,41 @@ Cleanup(int x)
 {
     cerr << "\nCleaning up after signal " << x << "\n";
     delete kernel;
+    Exit(0);
 }
 
 //-------------------------------------------------------------------
 // Constant used by "Copy" and "Print"
 //   It is the number of bytes read from the Unix file (for Copy)
-//   or the Nachos file (for Print) by each read operation
+//   or the Nachos file (for Print) by each read operation: a track's
+//   worth, so the data moves to and from the disk in multi-sector
+//   requests
 //-------------------------------------------------------------------
-static const int TransferSize = 128;
+static const int TransferSize = SectorsPerTrack * SectorSize;
 
 
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
-//      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//      Copy the contents of the UNIX file "from" to the Nachos file "to",
+//	compressed if "compressed"
+//
+//	All of the space the file needs is allocated before any data is
+//	written, so it goes in as few contiguous runs as the free space
+//	allows.  The data is then written a track at a time: every write
+//	covers whole sectors and is big enough to go straight to the disk
+//	in multi-sector requests, so nothing is read back, and nothing
+//	waits in the buffer cache.  (A compressed file only gets its
+//	sectors as each chunk is written, and each write covers whole
+//	chunks.)
 //----------------------------------------------------------------------
 
 static void
-Copy(char *from, char *to)
+Copy(char *from, char *to, bool compressed)
 {
-    int fd;
+    int fd, fileLength;
     OpenFile* openFile;
-    int amountRead, fileLength;
+    int amountRead;
     char *buffer;
 
 // Open UNIX file
@@ -91,14 +245,9 @@ Copy(char *from, char *to)
         return;
     }
 
-// Figure out length of UNIX file
-    Lseek(fd, 0, 2);
-    fileLength = Tell(fd);
-    Lseek(fd, 0, 0);
-
-// Create a Nachos file of the same length
-    DEBUG('f', "Copying file " << from << " of size " << fileLength <<  " to file " << to);
-    if (!kernel->fileSystem->Create(to, fileLength)) {   // Create Nachos file
+// Create an empty Nachos file; it grows as the data is written
+    DEBUG('f', "Copying file " << from << " to file " << to);
+    if (!kernel->fileSystem->Create(to, 0, compressed)) {
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
         return;
@@ -107,10 +256,22 @@ Copy(char *from, char *to)
     openFile = kernel->fileSystem->Open(to);
     ASSERT(openFile != NULL);
 
+// Allocate the whole file at once, if there is room; if not, it grows
+// as it is written, until the disk is full
+    Lseek(fd, 0, 2);
+    fileLength = Tell(fd);
+    Lseek(fd, 0, 0);
+    if (!openFile->Extend(kernel->fileSystem->FreeMap(), fileLength)) {
+        DEBUG('f', "Copy: no room to allocate " << fileLength << " bytes");
+    }
+
 // Copy the data in TransferSize chunks
     buffer = new char[TransferSize];
     while ((amountRead=ReadPartial(fd, buffer, sizeof(char)*TransferSize)) > 0)
-        openFile->Write(buffer, amountRead);
+        if (openFile->Write(buffer, amountRead) < amountRead) {
+            printf("Copy: out of space writing %s\n", to);
+            break;
+        }
     delete [] buffer;
 
 // Close the UNIX and the Nachos files
@@ -118,20 +279,91 @@ Copy(char *from, char *to)
     Close(fd);
 }
 
+//----------------------------------------------------------------------
+// CopyNachos
+//      Copy the contents of the Nachos file "from" to a new Nachos file
+//	"to", in the kernel, as the CopyRange system call does.  The
+//	whole file is allocated first, as for Copy.
+//----------------------------------------------------------------------
+
+static void
+CopyNachos(char *from, char *to)
+{
+    OpenFile *source, *openFile;
+    int fileLength;
+
+    if ((source = kernel->fileSystem->Open(from)) == NULL) {
+        printf("Copy: couldn't open input file %s\n", from);
+        return;
+    }
+    DEBUG('f', "Copying file " << from << " to file " << to);
+    if (!kernel->fileSystem->Create(to, 0)) {
+        printf("Copy: couldn't create output file %s\n", to);
+        delete source;
+        return;
+    }
+    openFile = kernel->fileSystem->Open(to);
+    ASSERT(openFile != NULL);
+
+    fileLength = source->Length();
+    if (!openFile->Extend(kernel->fileSystem->FreeMap(), fileLength)) {
+        DEBUG('f', "Copy: no room to allocate " << fileLength << " bytes");
+    }
+    if (openFile->CopyFrom(source, 0, fileLength, 0) < fileLength)
+        printf("Copy: out of space writing %s\n", to);
+
+    delete openFile;
+    delete source;
+}
+
 #endif // FILESYS_STUB
 
+//----------------------------------------------------------------------
+// PrintRemote
+//      Print the contents of the file "name" on another machine,
+//	reading it through the kernel as a user program would.
+//----------------------------------------------------------------------
+
+static void
+PrintRemote(char *name)
+{
+    int id, amountRead;
+    char *buffer;
+
+    if ((id = kernel->myOpen(name)) < 0) {
+        printf("Print: unable to open file %s\n", name);
+        return;
+    }
+
+    buffer = new char[TransferSize];
+    while ((amountRead = kernel->Read(buffer, TransferSize, id)) > 0)
+        fwrite(buffer, 1, amountRead, stdout);
+    delete [] buffer;
+
+    kernel->Close(id);
+    DEBUG(dbgNet, "Remote block reads: cached " << kernel->remoteFiles->Hits()
+	  << ", from the server " << kernel->remoteFiles->Misses());
+}
+
 //----------------------------------------------------------------------
 // Print
-//      Print the contents of the Nachos file "name".
+//      Print the contents of the Nachos file "name", as it is, a
+//	TransferSize chunk at a time with one fwrite each.  A file on
+//	another machine (see remotefs.h) is printed by PrintRemote.
 //----------------------------------------------------------------------
 
 void
 Print(char *name)
 {
     OpenFile *openFile;
-    int i, amountRead;
+    int amountRead;
     char *buffer;
 
+    if (kernel->remoteFiles != NULL && RemoteFileClient::IsRemote(name)) {
+        PrintRemote(name);
+        return;
+    }
+
     if ((openFile = kernel->fileSystem->Open(name)) == NULL) {
         printf("Print: unable to open file %s\n", name);
         return;
@@ -139,8 +371,7 @@ Print(char *name)
 
     buffer = new char[TransferSize];
     while ((amountRead = openFile->Read(buffer, TransferSize)) > 0)
-        for (i = 0; i < amountRead; i++)
-            printf("%c", buffer[i]);
+        fwrite(buffer, 1, amountRead, stdout);
     delete [] buffer;
 
     delete openFile;            // close the Nachos file
@@ -159,6 +390,119 @@ CreateDirectory(char *name)
        printf("CreateDirectory: couldn't create directory %s\n", name);
 }
 
+// What the command line asks for, once the kernel is up; every machine
+// of a cluster does it all
+static bool threadTestFlag = false;
+static bool benchmarkFlag = false;
+static bool consoleTestFlag = false;
+static bool networkTestFlag = false;
+#ifndef FILESYS_STUB
+static char *copyUnixFileName = NULL;    // UNIX file to be copied into Nachos
+static char *copyNachosFileName = NULL;  // name of copied file in Nachos
+static bool copyCompressed = FALSE;      // compress it (-cpz)?
+static char *copyFromName = NULL;        // Nachos file copied by -cpn
+static char *copyToName = NULL;          // and its copy
+static char *snapFromName = NULL;        // Nachos file or tree for -snap
+static char *snapToName = NULL;          // and its snapshot
+static char *moveFromName = NULL;        // Nachos file or tree for -mv
+static char *moveToName = NULL;          // and its new name
+static char *printFileName = NULL;
+static char *removeFileName = NULL;
+static bool dirListFlag = false;
+static bool dumpFlag = false;
+static bool checkFlag = false;
+static bool repairFlag = false;
+static bool defragFlag = false;
+// MP4 mod tag
+static char *createDirectoryName = NULL;
+static char *listDirectoryName = NULL;
+static bool mkdirFlag = false;
+static bool recursiveListFlag = false;
+static bool recursiveRemoveFlag = false;
+#endif //FILESYS_STUB
+
+//----------------------------------------------------------------------
+// RunCommands
+// 	Run the tests and file system commands the command line gave,
+//	then the user programs; never returns.  Each machine of a cluster
+//	runs them (see Cluster::Boot).
+//----------------------------------------------------------------------
+
+static void
+RunCommands(void *unused)
+{
+    // run some tests, if requested
+    if (threadTestFlag) {
+      kernel->ThreadSelfTest();  // test threads and synchronization
+    }
+    if (benchmarkFlag) {
+      LibBenchmark();		// time the ordered containers
+    }
+    if (consoleTestFlag) {
+      kernel->ConsoleTest();   // interactive test of the synchronized console
+    }
+    if (networkTestFlag) {
+      kernel->NetworkTest();   // two-machine test of the network
+    }
+
+#ifndef FILESYS_STUB
+    if (checkFlag) {
+        kernel->fileSystem->Check(repairFlag);
+    }
+    if (removeFileName != NULL) {
+        if (recursiveRemoveFlag)
+            kernel->fileSystem->RecurRemove(removeFileName);
+        else
+            kernel->fileSystem->Remove(removeFileName);
+    }
+    if (copyUnixFileName != NULL && copyNachosFileName != NULL) {
+		Copy(copyUnixFileName, copyNachosFileName, copyCompressed);
+    }
+    if (copyFromName != NULL) {
+        CopyNachos(copyFromName, copyToName);
+    }
+    if (snapFromName != NULL &&
+            !kernel->fileSystem->Snapshot(snapFromName, snapToName)) {
+        printf("Snapshot: couldn't take a snapshot of %s as %s\n",
+               snapFromName, snapToName);
+    }
+    if (moveFromName != NULL &&
+            !kernel->fileSystem->Rename(moveFromName, moveToName)) {
+        printf("Rename: couldn't move %s to %s\n", moveFromName, moveToName);
+    }
+    if (defragFlag) {
+        kernel->fileSystem->Defragment();
+    }
+    if (dumpFlag) {
+		kernel->fileSystem->Print();
+    }
+    if (dirListFlag) {
+        if (recursiveListFlag)
+            kernel->fileSystem->recurList(listDirectoryName);
+		else
+            kernel->fileSystem->List(listDirectoryName);
+    }
+	if (mkdirFlag) {
+		// MP4 mod tag
+		CreateDirectory(createDirectoryName);
+	}
+    if (printFileName != NULL) {
+      Print(printFileName);
+    }
+#endif // FILESYS_STUB
+
+    // finally, run an initial user program if requested to do so
+
+		kernel->ExecAll();
+    // If we don't run a user program, we may get here.
+    // Calling "return" would terminate the program.
+    // Instead, call Halt, which will first clean up, then
+    //  terminate.
+//    kernel->interrupt->Halt();
+
+    ASSERTNOTREACHED();
+}
+
 //----------------------------------------------------------------------
 // main
 // 	Bootstrap the operating system kernel.
@@ -179,23 +523,7 @@ main(int argc, char **argv)
     int i;
     char *debugArg = "";
     char *userProgName = NULL;        // default is not to execute a user prog
-    bool threadTestFlag = false;
-    bool consoleTestFlag = false;
-    bool networkTestFlag = false;
-#ifndef FILESYS_STUB
-    char *copyUnixFileName = NULL;    // UNIX file to be copied into Nachos
-    char *copyNachosFileName = NULL;  // name of copied file in Nachos
-    char *printFileName = NULL;
-    char *removeFileName = NULL;
-    bool dirListFlag = false;
-    bool dumpFlag = false;
-	// MP4 mod tag
-	char *createDirectoryName = NULL;
-	char *listDirectoryName = NULL;
-	bool mkdirFlag = false;
-	bool recursiveListFlag = false;
-	bool recursiveRemoveFlag = false;
-#endif //FILESYS_STUB
+    int clusterSize = 0;              // machines to run, if -cluster
 
     // some command line arguments are handled here.
     // those that set kernel parameters are handled in
@@ -217,12 +545,21 @@ main(int argc, char **argv)
 	else if (strcmp(argv[i], "-K") == 0) {
 	    threadTestFlag = TRUE;
 	}
+	else if (strcmp(argv[i], "-B") == 0) {
+	    benchmarkFlag = TRUE;
+	}
 	else if (strcmp(argv[i], "-C") == 0) {
 	    consoleTestFlag = TRUE;
 	}
 	else if (strcmp(argv[i], "-N") == 0) {
 	    networkTestFlag = TRUE;
 	}
+	else if (strcmp(argv[i], "-cluster") == 0) {
+	    ASSERT(i + 1 < argc);
+	    clusterSize = atoi(argv[i + 1]);
+	    ASSERT(clusterSize > 0);
+	    i++;
+	}
 #ifndef FILESYS_STUB
 	else if (strcmp(argv[i], "-cp") == 0) {
 	    ASSERT(i + 2 < argc);
@@ -230,6 +567,31 @@ main(int argc, char **argv)
 	    copyNachosFileName = argv[i + 2];
 	    i += 2;
 	}
+	else if (strcmp(argv[i], "-cpz") == 0) {
+	    ASSERT(i + 2 < argc);
+	    copyUnixFileName = argv[i + 1];
+	    copyNachosFileName = argv[i + 2];
+	    copyCompressed = TRUE;
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "-cpn") == 0) {
+	    ASSERT(i + 2 < argc);
+	    copyFromName = argv[i + 1];
+	    copyToName = argv[i + 2];
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "-snap") == 0) {
+	    ASSERT(i + 2 < argc);
+	    snapFromName = argv[i + 1];
+	    snapToName = argv[i + 2];
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "-mv") == 0) {
+	    ASSERT(i + 2 < argc);
+	    moveFromName = argv[i + 1];
+	    moveToName = argv[i + 2];
+	    i += 2;
+	}
 	else if (strcmp(argv[i], "-p") == 0) {
 	    ASSERT(i + 1 < argc);
 	    printFileName = argv[i + 1];
@@ -273,15 +635,31 @@ main(int argc, char **argv)
 	else if (strcmp(argv[i], "-D") == 0) {
 	    dumpFlag = true;
 	}
+	else if (strcmp(argv[i], "-fsck") == 0) {
+	    checkFlag = true;
+	}
+	else if (strcmp(argv[i], "-fsckr") == 0) {
+	    checkFlag = true;
+	    repairFlag = true;
+	}
+	else if (strcmp(argv[i], "-defrag") == 0) {
+	    defragFlag = true;
+	}
 #endif //FILESYS_STUB
 	else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-z -d debugFlags]\n";
             cout << "Partial usage: nachos [-x programName]\n";
-	    cout << "Partial usage: nachos [-K] [-C] [-N]\n";
+	    cout << "Partial usage: nachos [-K] [-B] [-C] [-N]\n";
+	    cout << "Partial usage: nachos [-cluster #]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpz UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cpn NachosFile NachosFile]\n";
+            cout << "Partial usage: nachos [-snap NachosFile NachosFile]\n";
+            cout << "Partial usage: nachos [-mv NachosFile NachosFile]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
             cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-fsck] [-fsckr] [-defrag]\n";
 #endif //FILESYS_STUB
 	}
 
@@ -290,60 +668,18 @@ main(int argc, char **argv)
 
     DEBUG(dbgThread, "Entering main");
 
-    kernel = new Kernel(argc, argv);
-
-    kernel->Initialize();
+    if (clusterSize > 0) {		// several machines in this process
+	cluster = new Cluster(clusterSize);
+	cluster->Boot(argc, argv, RunCommands);
+    } else {
+	kernel = new Kernel(argc, argv);
+	kernel->Initialize();
+    }
 
     CallOnUserAbort(Cleanup);		// if user hits ctl-C
 
     // at this point, the kernel is ready to do something
-    // run some tests, if requested
-    if (threadTestFlag) {
-      kernel->ThreadSelfTest();  // test threads and synchronization
-    }
-    if (consoleTestFlag) {
-      kernel->ConsoleTest();   // interactive test of the synchronized console
-    }
-    if (networkTestFlag) {
-      kernel->NetworkTest();   // two-machine test of the network
-    }
-
-#ifndef FILESYS_STUB
-    if (removeFileName != NULL) {
-        if (recursiveRemoveFlag)
-            kernel->fileSystem->RecurRemove(removeFileName);
-        else
-            kernel->fileSystem->Remove(removeFileName);
-    }
-    if (copyUnixFileName != NULL && copyNachosFileName != NULL) {
-		Copy(copyUnixFileName,copyNachosFileName);
-    }
-    if (dumpFlag) {
-		kernel->fileSystem->Print();
-    }
-    if (dirListFlag) {
-        if (recursiveListFlag)
-            kernel->fileSystem->recurList(listDirectoryName);
-		else
-            kernel->fileSystem->List(listDirectoryName);
-    }
-	if (mkdirFlag) {
-		// MP4 mod tag
-		CreateDirectory(createDirectoryName);
-	}
-    if (printFileName != NULL) {
-      Print(printFileName);
-    }
-#endif // FILESYS_STUB
-
-    // finally, run an initial user program if requested to do so
-
-		kernel->ExecAll();
-    // If we don't run a user program, we may get here.
-    // Calling "return" would terminate the program.
-    // Instead, call Halt, which will first clean up, then
-    //  terminate.
-//    kernel->interrupt->Halt();
+    RunCommands(NULL);
 
     ASSERTNOTREACHED();
 }
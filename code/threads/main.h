@@ -12,8 +12,11 @@
 #include "debug.h"
 #include "kernel.h"
 
+class Cluster;
+
 extern Kernel *kernel;
 extern Debug *debug;
+extern Cluster *cluster;
 
 #endif // MAIN_H
 
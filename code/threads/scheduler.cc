@@ -11,8 +11,9 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Straight FIFO, strict priorities with FIFO among the threads of
+//	one priority, a multi-level feedback queue, or stride scheduling,
+//	as chosen when the kernel starts.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,17 +23,52 @@
 #include "debug.h"
 #include "scheduler.h"
 #include "main.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------
+// ComparePass
+// 	Order threads for the stride scheduler's heap: the smallest pass
+//	first.
+//----------------------------------------------------------------------
+
+static int
+ComparePass(Thread *x, Thread *y)
+{
+    if (x->pass < y->pass)
+	return -1;
+    return (x->pass > y->pass) ? 1 : 0;
+}
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads.
 //	Initially, no ready threads.
+//
+//	"policy" -- in which order ready threads are run
+//	"quanta" -- for FeedbackScheduling, the length of the time slice
+//		of each level, in timer interrupts; NULL for the default
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedulerPolicy policy, int *quanta)
 { 
-    readyList = new List<Thread *>; 
+    this->policy = policy;
+    for (int i = 0; i < NumFeedbackLevels; i++) {
+	quantum[i] = (quanta != NULL) ? quanta[i] : 1 << i;
+	ASSERT(quantum[i] > 0);
+    }
+    timerTicks = boosts = 0;
+    for (int i = 0; i < NumPriorities; i++)
+	readyList[i] = new IntrusiveList<Thread>;
+    nonEmpty = new Bitmap(NumPriorities);
+    passQueue = new Heap<Thread *>(ComparePass);
+    totalTickets = 0;
+    globalPass = 0;
+    lastCharge = kernel->stats->userTicks + kernel->stats->systemTicks;
+    shares = new List<ShareRecord *>;
+    numReady = 0;
     toBeDestroyed = NULL;
+    userStateOwner = NULL;
+    spaceLoaded = NULL;
 } 
 
 //----------------------------------------------------------------------
@@ -42,13 +78,255 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < NumPriorities; i++)
+	delete readyList[i];
+    delete nonEmpty;
+    delete passQueue;
+    while (!shares->IsEmpty()) {
+	ShareRecord *share = shares->RemoveFront();
+
+	if (share->thread != NULL)
+	    share->thread->share = NULL;
+	delete [] share->name;
+	delete share;
+    }
+    delete shares;
 } 
 
+//----------------------------------------------------------------------
+// Scheduler::LevelOf
+// 	Return the run queue "thread" belongs on: queue 0 holds the
+//	highest priority, so that the first queue with a thread in it is
+//	the one to take from.  With no priorities, all threads share
+//	queue 0 (under StrideScheduling, they are not on the queues at
+//	all).  Under FeedbackScheduling, a thread that has missed a
+//	boost (by being blocked at the time) is moved back to the top here.
+//----------------------------------------------------------------------
+
+int
+Scheduler::LevelOf(Thread *thread)
+{
+    if (policy == FifoScheduling || policy == StrideScheduling)
+	return 0;
+    if (policy == PriorityScheduling)
+	return MaxPriority - thread->getPriority();
+    if (thread->boostsSeen != boosts) {
+	thread->feedbackLevel = 0;
+	thread->ticksUsed = 0;
+	thread->boostsSeen = boosts;
+    }
+    return thread->feedbackLevel;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Boost
+// 	Move every ready thread back to the top level, with a fresh time
+//	slice.  Threads that are running or blocked follow when they are
+//	next looked at, since they will not have seen this boost.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Boost()
+{
+    boosts++;
+    for (int level = 1; level < NumFeedbackLevels; level++) {
+	while (!readyList[level]->IsEmpty()) {
+	    Thread *thread = readyList[level]->RemoveFront();
+
+	    (void) LevelOf(thread);	// which moves it to the top
+	    readyList[0]->Append(thread);
+	    nonEmpty->Mark(0);
+	}
+	nonEmpty->Clear(level);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::TimerTick
+// 	Called on each timer interrupt that comes while "running" runs.
+//	Return TRUE if its time slice is over, so that it should yield.
+//	Without feedback, every interrupt ends a time slice; with it, a
+//	thread that uses up the time slice of its level moves down one.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::TimerTick(Thread *running)
+{
+    int level;
+
+    if (policy != FeedbackScheduling)
+	return TRUE;
+    if (++timerTicks % BoostInterval == 0)
+	Boost();
+    level = LevelOf(running);
+    if (++running->ticksUsed < quantum[level])
+	return FALSE;
+    running->ticksUsed = 0;
+    if (level < NumFeedbackLevels - 1)
+	running->feedbackLevel++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Blocking
+// 	Called as "thread" goes to sleep, waiting for a device or another
+//	thread.  Under FeedbackScheduling, a thread that waits before its
+//	time slice is over moves up a level, so that threads bound by the
+//	disk or the console are run first when they are woken.  Under
+//	StrideScheduling, it stops counting, keeping its lag.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Blocking(Thread *thread)
+{
+    if (policy == StrideScheduling) {
+	Charge();
+	if (thread->inShare)
+	    Leave(thread);
+	return;
+    }
+    if (policy != FeedbackScheduling)
+	return;
+    if (LevelOf(thread) > 0)
+	thread->feedbackLevel--;
+    thread->ticksUsed = 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Under StrideScheduling, charge the CPU ticks since the last charge
+//	to the running thread.  Called whenever which thread runs, or
+//	which are counted, is about to change.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Charge()
+{
+    int now = kernel->stats->userTicks + kernel->stats->systemTicks;
+
+    ChargeTicks(kernel->currentThread, now - lastCharge);
+    lastCharge = now;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ChargeTicks
+// 	Charge "ran" CPU ticks to "running", if it is counted, and to the
+//	scheduler's pass: a tick moves a thread's pass on by one over its
+//	tickets, and the scheduler's by one over the tickets of all the
+//	threads counted.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ChargeTicks(Thread *running, int ran)
+{
+    if (ran == 0 || totalTickets == 0)
+	return;
+    globalPass += (double) ran / totalTickets;
+    if (running->inShare)
+	running->pass += (double) ran / running->tickets;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Join, Scheduler::Leave
+// 	"thread" has become ready, or stopped being ready or running:
+//	count its tickets, with its pass as far ahead of the scheduler's
+//	as it was when it last stopped, or stop counting them.  A thread
+//	joining for the first time gets its line of the skew report.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Join(Thread *thread)
+{
+    ShareRecord *share = thread->share;
+
+    if (share == NULL) {
+	share = thread->share = new ShareRecord;
+	share->name = new char[strlen(thread->getName()) + 1];
+	strcpy(share->name, thread->getName());
+	share->thread = thread;
+	share->tickets = thread->tickets;
+	share->received = 0;
+	share->due = 0;
+	shares->Append(share);
+    }
+    thread->pass = globalPass + thread->lag;
+    thread->inShare = TRUE;
+    totalTickets += thread->tickets;
+    share->dueSince = globalPass;
+}
+
+void
+Scheduler::Leave(Thread *thread)
+{
+    ASSERT(thread->inShare);
+    Settle(thread);
+    thread->lag = thread->pass - globalPass;
+    thread->inShare = FALSE;
+    totalTickets -= thread->tickets;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Settle
+// 	Add to what "thread" was due of the CPU the share of its tickets
+//	since that was last done, if they were counted: the scheduler's
+//	pass has gone up by the CPU ticks due to each ticket.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Settle(Thread *thread)
+{
+    ShareRecord *share = thread->share;
+
+    if (share == NULL || !thread->inShare)
+	return;
+    share->due += thread->tickets * (globalPass - share->dueSince);
+    share->dueSince = globalPass;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SetTickets
+// 	Give "thread" "tickets" tickets.  Under StrideScheduling what it
+//	has run ahead of (or behind) the scheduler's pass is scaled to
+//	the new tickets, as it would have been had it had them all along,
+//	and a ready thread is moved to its new place in the heap.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SetTickets(Thread *thread, int tickets)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    ASSERT(tickets >= MinTickets && tickets <= MaxTickets);
+    if (policy != StrideScheduling) {
+	thread->tickets = tickets;
+	return;
+    }
+    Charge();
+    if (thread->inShare) {
+	Settle(thread);
+	if (thread->getStatus() == READY)
+	    passQueue->Remove(thread);
+	thread->pass = globalPass +
+		       (thread->pass - globalPass) * thread->tickets / tickets;
+	totalTickets += tickets - thread->tickets;
+	thread->tickets = tickets;
+	if (thread->getStatus() == READY)
+	    passQueue->Insert(thread);
+    } else {
+	thread->lag = thread->lag * thread->tickets / tickets;
+	thread->tickets = tickets;
+    }
+}
+
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
+//	The first to be ready has the alarm clock time slice again, if
+//	it had stopped the timer (see Alarm::CallBack).
+//
+//	A thread woken by an interrupt handler, that has a higher
+//	priority (or feedback level) than the one that was interrupted,
+//	takes the CPU as soon as the handler returns.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
@@ -56,11 +334,27 @@ Scheduler::~Scheduler()
 void
 Scheduler::ReadyToRun (Thread *thread)
 {
+    Thread *current = kernel->currentThread;
+    int level = LevelOf(thread);
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
     DEBUG(dbgThread, "Putting thread on ready list: " << thread->getName());
 	//cout << "Putting thread on ready list: " << thread->getName() << endl ;
     thread->setStatus(READY);
-    readyList->Append(thread);
+    if (policy == StrideScheduling) {
+	Charge();			// a thread yielding, for its run
+	if (!thread->inShare)
+	    Join(thread);
+	passQueue->Insert(thread);
+    } else {
+	readyList[level]->Append(thread);
+	nonEmpty->Mark(level);
+    }
+    if (numReady++ == 0 && kernel->alarm != NULL)
+	kernel->alarm->TimerNeeded();
+    if (policy != FifoScheduling && kernel->interrupt->InHandler() &&
+	current->getStatus() == RUNNING && level < LevelOf(current))
+	kernel->interrupt->YieldOnReturn();
 }
 
 //----------------------------------------------------------------------
@@ -74,13 +368,48 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
+    int level = nonEmpty->FindFirstSet();
+    Thread *thread;
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
-    if (readyList->IsEmpty()) {
+    if (policy == StrideScheduling) {
+	if (passQueue->IsEmpty())
+	    return NULL;
+	numReady--;
+	return passQueue->RemoveFront();
+    }
+    if (level == -1) {
 		return NULL;
+    }
+    thread = readyList[level]->RemoveFront();
+    if (readyList[level]->IsEmpty())
+	nonEmpty->Clear(level);
+    numReady--;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Remove
+// 	Take "thread", which is ready, off its run queue -- so that it can
+//	be put back on the queue of a new priority.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Remove(Thread *thread)
+{
+    int level = LevelOf(thread);
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    ASSERT(thread->getStatus() == READY);
+    if (policy == StrideScheduling) {
+	passQueue->Remove(thread);
     } else {
-    	return readyList->RemoveFront();
+	readyList[level]->Remove(thread);
+	if (readyList[level]->IsEmpty())
+	    nonEmpty->Clear(level);
     }
+    numReady--;
 }
 
 //----------------------------------------------------------------------
@@ -111,19 +440,24 @@ Scheduler::Run (Thread *nextThread, bool finishing)
          ASSERT(toBeDestroyed == NULL);
 	 toBeDestroyed = oldThread;
     }
-    
-    if (oldThread->space != NULL) {	// if this thread is a user program,
-        oldThread->SaveUserState(); 	// save the user's CPU registers
-	oldThread->space->SaveState();
+    if (policy == StrideScheduling) {
+	Charge();			// for the run that ends here
+	if (finishing && oldThread->inShare)
+	    Leave(oldThread);
     }
     
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
+    oldThread->SwitchedOut();		    // charge it for its run
 
     kernel->currentThread = nextThread;  // switch to the next thread
     nextThread->setStatus(RUNNING);      // nextThread is now running
+    nextThread->SwitchedIn();
+    kernel->stats->numContextSwitches++;
+    kernel->stats->readyLengths[min(numReady, NumReadyLengths - 1)]++;
     
     DEBUG(dbgThread, "Switching from: " << oldThread->getName() << " to: " << nextThread->getName());
+    TRACE(dbgThread, (TraceSwitch, oldThread->getID(), nextThread->getID()));
     
     // This is a machine-dependent assembly language routine defined 
     // in switch.s.  You may have to think
@@ -143,12 +477,69 @@ Scheduler::Run (Thread *nextThread, bool finishing)
 					// before this one has finished
 					// and needs to be cleaned up
     
-    if (oldThread->space != NULL) {	    // if there is an address space
-        oldThread->RestoreUserState();     // to restore, do it.
-	oldThread->space->RestoreState();
+    if (oldThread->space != NULL)	    // if there is an address space
+	LoadUserState(oldThread);	    // to restore, do it.
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LoadUserState
+// 	Give the machine the user registers and address space of
+//	"thread", a user program going back to running.
+//
+//	The machine's user registers are not saved as a thread gives up
+//	the CPU, but only once another user thread needs them; kernel
+//	threads in between never touch them, and a thread that is
+//	switched back to finds them as it left them.  The same goes for
+//	the address space the machine translates with.
+//----------------------------------------------------------------------
+
+void
+Scheduler::LoadUserState(Thread *thread)
+{
+    if (userStateOwner != thread) {
+	if (userStateOwner != NULL)
+	    userStateOwner->SaveUserState();
+	thread->RestoreUserState();
+	userStateOwner = thread;
+    }
+    if (spaceLoaded != thread->space) {
+	if (spaceLoaded != NULL)
+	    spaceLoaded->SaveState();
+	thread->space->RestoreState();
+	spaceLoaded = thread->space;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Forget
+// 	"thread", or "space", is about to be deleted; the machine's
+//	registers, or its translations, are no longer anyone's to save,
+//	and the thread's line of the skew report is done.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Forget(Thread *thread)
+{
+    ShareRecord *share = thread->share;
+
+    if (userStateOwner == thread)
+	userStateOwner = NULL;
+    if (share != NULL) {		// its line of the report, as it ends
+	Settle(thread);
+	share->tickets = thread->tickets;
+	share->received = thread->Usage().userTicks +
+			  thread->Usage().systemTicks;
+	share->thread = NULL;
     }
 }
 
+void
+Scheduler::Forget(AddrSpace *space)
+{
+    if (spaceLoaded == space)
+	spaceLoaded = NULL;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::CheckToBeDestroyed
 // 	If the old thread gave up the processor because it was finishing,
@@ -175,5 +566,140 @@ void
 Scheduler::Print()
 {
     cout << "Ready list contents:\n";
-    readyList->Apply(ThreadPrint);
+    if (policy == StrideScheduling)
+	passQueue->Apply(ThreadPrint);
+    for (int i = 0; i < NumPriorities; i++)
+	readyList[i]->Apply(ThreadPrint);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PrintShares
+// 	Print, for each thread that has run under StrideScheduling, its
+//	tickets, the CPU ticks it had, those it was due -- its tickets'
+//	share of the CPU ticks while it was ready or running -- and how
+//	far apart the two are.
+//----------------------------------------------------------------------
+
+void
+Scheduler::PrintShares()
+{
+    ListIterator<ShareRecord *> it(shares);
+
+    Charge();
+    printf("Stride shares, in CPU ticks:\n");
+    for (; !it.IsDone(); it.Next()) {
+	ShareRecord *share = it.Item();
+	int tickets = share->tickets, received = share->received;
+
+	if (share->thread != NULL) {
+	    ThreadUsage usage = share->thread->Usage();
+
+	    Settle(share->thread);
+	    tickets = share->thread->tickets;
+	    received = usage.userTicks + usage.systemTicks;
+	}
+	printf("  %s: tickets %d, had %d, due %.0f", share->name, tickets,
+	       received, share->due);
+	if (share->due > 0)
+	    printf(", skew %+.1f%%", 100 * (received - share->due) /
+					share->due);
+	printf("\n");
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SelfTest
+// 	Check, on schedulers of its own, that ready threads are taken
+//	the highest priority first, and in order within a priority; that
+//	feedback moves threads between levels as it should; and that
+//	stride scheduling runs threads in proportion to their tickets,
+//	with no credit for the time a thread waits.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SelfTest()
+{
+    Scheduler *test = new Scheduler(PriorityScheduling);
+    int quanta[NumFeedbackLevels] = { 1, 2, 1, 1 };
+    Scheduler *feedback = new Scheduler(FeedbackScheduling, quanta);
+    Thread *low = new Thread("low", -1);
+    Thread *middle = new Thread("middle", -1);
+    Thread *high = new Thread("high", -1);
+    Thread *high2 = new Thread("high2", -1);
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    low->setPriority(MinPriority);
+    high->setPriority(MaxPriority);
+    high2->setPriority(MaxPriority);
+    test->ReadyToRun(low);
+    test->ReadyToRun(high);
+    test->ReadyToRun(middle);
+    test->ReadyToRun(high2);
+    ASSERT(test->FindNextToRun() == high);
+    ASSERT(test->FindNextToRun() == high2);
+    ASSERT(test->FindNextToRun() == middle);
+    test->ReadyToRun(high);
+    ASSERT(test->FindNextToRun() == high);
+    ASSERT(test->FindNextToRun() == low);
+    ASSERT(test->FindNextToRun() == NULL);
+
+    ASSERT(feedback->TimerTick(low) && low->feedbackLevel == 1);
+    ASSERT(!feedback->TimerTick(low) && feedback->TimerTick(low));
+    ASSERT(low->feedbackLevel == 2);
+    feedback->Blocking(low);		// waiting moves it up
+    ASSERT(low->feedbackLevel == 1);
+    feedback->ReadyToRun(low);
+    feedback->ReadyToRun(middle);
+    ASSERT(feedback->FindNextToRun() == middle);
+    for (int i = 3; i < BoostInterval; i++)	// the last one boosts
+	(void) feedback->TimerTick(high);
+    ASSERT(low->feedbackLevel == 0 && feedback->FindNextToRun() == low);
+    ASSERT(feedback->FindNextToRun() == NULL);
+
+    // made with interrupts off, so that no CPU ticks go by: the test
+    // charges its own
+    Scheduler *stride = new Scheduler(StrideScheduling);
+    int runs = 0;
+    Thread *t;
+
+    high->tickets = 3 * DefaultTickets;
+    stride->ReadyToRun(high);
+    stride->ReadyToRun(low);
+    for (int i = 0; i < 400; i++) {
+	t = stride->FindNextToRun();
+	stride->ChargeTicks(t, 10);
+	if (t == high)
+	    runs++;
+	stride->ReadyToRun(t);
+    }
+    ASSERT(runs >= 299 && runs <= 301);
+    ASSERT(stride->FindNextToRun() != NULL && stride->FindNextToRun() != NULL);
+    stride->Blocking(low);				// "low" waits,
+    stride->ReadyToRun(high);
+    for (int i = 0; i < 100; i++) {			// "high" runs alone,
+	ASSERT(stride->FindNextToRun() == high);
+	stride->ChargeTicks(high, 10);
+	stride->ReadyToRun(high);
+    }
+    stride->ReadyToRun(low);				// and "low" gets no
+    runs = 0;						// more than its share
+    for (int i = 0; i < 40; i++) {
+	t = stride->FindNextToRun();
+	stride->ChargeTicks(t, 10);
+	if (t == low)
+	    runs++;
+	stride->ReadyToRun(t);
+    }
+    ASSERT(runs >= 9 && runs <= 11);
+    ASSERT(stride->FindNextToRun() != NULL && stride->FindNextToRun() != NULL);
+    ASSERT(stride->FindNextToRun() == NULL);
+    delete stride;
+    (void) kernel->interrupt->SetLevel(oldLevel);
+
+    delete low;
+    delete middle;
+    delete high;
+    delete high2;
+    delete test;
+    delete feedback;
 }
@@ -11,34 +11,135 @@
 
 #include "copyright.h"
 #include "list.h"
+#include "heap.h"
+#include "bitmap.h"
 #include "thread.h"
 
+// The order in which ready threads are run: first come, first served;
+// the highest priority first (first come, first served within a
+// priority); or by a multi-level feedback queue, where a thread moves
+// down a level each time it runs through the time slice of its level,
+// up one each time it blocks, and every thread goes back to the top
+// every BoostInterval timer interrupts, so that none starves; or by
+// stride scheduling, where each thread gets a share of the CPU in
+// proportion to its tickets.
+
+enum SchedulerPolicy { FifoScheduling, PriorityScheduling,
+		       FeedbackScheduling, StrideScheduling };
+
+const int NumPriorities = MaxPriority - MinPriority + 1;
+const int NumFeedbackLevels = 4;
+const int BoostInterval = 50;		// in timer interrupts
+
+// The following class records, for the skew report, what a thread has
+// had of the CPU under StrideScheduling, and what it was due.
+
+class ShareRecord {
+  public:
+    char *name;			// a copy of the thread's name
+    Thread *thread;		// the thread, or NULL once it is deleted
+    int tickets;		// and its tickets and CPU ticks then
+    int received;
+    double due;			// CPU ticks it was due, up to when its
+				// tickets were last counted
+    double dueSince;		// the scheduler's pass then
+};
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
+//
+// Ready threads are kept in one run queue per priority, with a bitmap
+// of the queues that are not empty, so that choosing the next thread
+// takes a find-first-set whatever the number of threads.  Under
+// FifoScheduling every thread goes on the same queue.
+//
+// Under StrideScheduling, the ready threads are kept in a heap instead,
+// by their pass: the CPU ticks each has run, divided by its tickets.
+// The one with the smallest pass runs next, so over time each runs in
+// proportion to its tickets.  The scheduler's own pass goes up by each
+// CPU tick divided by the tickets of all the threads ready or running;
+// it is where a thread starts, and keeps the lag of a thread that
+// blocks, so that waiting earns it no credit, and running ahead is not
+// forgotten.  It is also what each ticket was due of the CPU meanwhile.
+//
+// There is one set of queues because there is one simulated CPU: a
+// thread is added or taken with interrupts off, and no lock is ever
+// waited for, so no queue is contended.
 
 class Scheduler {
   public:
-    Scheduler();		// Initialize list of ready threads 
+    Scheduler(SchedulerPolicy policy = FifoScheduling,
+	      int *quanta = NULL);
+				// Initialize list of ready threads; under
+				// FeedbackScheduling, "quanta" are the
+				// timer interrupts in each level's time
+				// slice (by default, 1, 2, 4 and 8)
     ~Scheduler();		// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	
     				// Thread can be dispatched.
     Thread* FindNextToRun();	// Dequeue first thread on the ready 
 				// list, if any, and return thread.
+    void Remove(Thread *thread);	// Take a ready thread off its queue
     void Run(Thread* nextThread, bool finishing);
     				// Cause nextThread to start running
     void CheckToBeDestroyed();// Check if thread that had been
     				// running needs to be deleted
+    void LoadUserState(Thread *thread);
+				// Give the machine the registers and
+				// address space of a user program
+    void Forget(Thread *thread);	// "thread" is being deleted
+    void Forget(AddrSpace *space);	// "space" is being deleted
+    bool TimerTick(Thread *running);
+				// A timer interrupt came while "running"
+				// ran; is its time slice up?
+    void Blocking(Thread *thread);
+				// "thread" is about to wait for something
+    void SetTickets(Thread *thread, int tickets);
+				// Change its share of the CPU
+    void PrintShares();		// Print the skew report
     void Print();		// Print contents of ready list
+    SchedulerPolicy getPolicy() { return policy; }
+    int NumReady() { return numReady; }	// threads ready to run
     
-    // SelfTest for scheduler is implemented in class Thread
+    // SelfTest for thread switching is implemented in class Thread
+    void SelfTest();		// Test the order of the run queues
     
   private:
-    List<Thread *> *readyList;  // queue of threads that are ready to run,
-				// but not running
+    int LevelOf(Thread *thread);	// the run queue "thread" goes on
+    void Boost();		// put every thread back at the top
+    void Charge();		// charge the running thread, and the
+				// scheduler's pass, for the CPU ticks
+				// since the last charge
+    void ChargeTicks(Thread *running, int ran);
+				// or for "ran" ticks
+    void Join(Thread *thread);	// "thread" can run; count its tickets
+    void Leave(Thread *thread);	// and it can not anymore
+    void Settle(Thread *thread);	// add what it was due up to now
+
+    SchedulerPolicy policy;	// how threads are ordered
+    int quantum[NumFeedbackLevels];	// time slice of each level
+    int timerTicks;		// timer interrupts so far
+    int boosts;			// times every thread went back to the top
+    IntrusiveList<Thread> *readyList[NumPriorities];
+				// queues of threads that are ready to
+				// run, but not running; the highest
+				// priority first
+    Bitmap *nonEmpty;		// which queues have threads on them
+    Heap<Thread *> *passQueue;	// under StrideScheduling, the ready
+				// threads, the smallest pass first
+    int totalTickets;		// of the threads ready or running
+    double globalPass;		// the scheduler's pass
+    int lastCharge;		// CPU ticks at the last charge
+    List<ShareRecord *> *shares;	// the skew report, a line per thread
+    int numReady;		// threads on all the queues
     Thread *toBeDestroyed;	// finishing thread to be destroyed
     				// by the next thread that runs
+    Thread *userStateOwner;	// thread whose user registers are in
+				// the machine, or NULL
+    AddrSpace *spaceLoaded;	// address space the machine translates
+				// with, or NULL
 };
 
 #endif // SCHEDULER_H
@@ -0,0 +1,132 @@
+// statlog.cc
+//	Routines to log how the statistics go up as Nachos runs.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "statlog.h"
+#include "main.h"
+#include "synch.h"
+
+// The columns of a line, after the tick: the counts of a StatsSnapshot,
+// in order, after its version and size.
+
+static char *columns[] = {
+    "ticks", "idle", "system", "user", "diskReads", "diskWrites",
+    "consoleRead", "consoleWritten", "pageFaults", "evictions",
+    "pageOuts", "tlbHits", "tlbMisses", "packetsSent", "packetsRecvd",
+    "switches", "fsOps", "bytesRead", "bytesWritten"
+};
+
+#define NumColumns	((int) (sizeof(columns) / sizeof(columns[0])))
+
+//----------------------------------------------------------------------
+// StatsLogThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the loop of the log.
+//----------------------------------------------------------------------
+
+static void
+StatsLogThread(StatsLog *log)
+{
+    log->Run();
+}
+
+//----------------------------------------------------------------------
+// StatsLog::StatsLog
+// 	Open the UNIX file "fileName", write the names of the columns,
+//	and fork the thread that adds a line every "interval" ticks.
+//----------------------------------------------------------------------
+
+StatsLog::StatsLog(char *fileName, int interval)
+{
+    char line[512];
+
+    ASSERT(interval > 0);
+    ASSERT(NumColumns == (int) (sizeof(StatsSnapshot) / sizeof(int)) - 2);
+    this->interval = interval;
+    fd = OpenForWrite(fileName);
+    strcpy(line, "# tick");
+    for (int i = 0; i < NumColumns; i++) {
+	strcat(line, " ");
+	strcat(line, columns[i]);
+    }
+    strcat(line, "\n");
+    WriteFile(fd, line, strlen(line));
+    kernel->stats->Snapshot(&last);
+    nextLine = last.totalTicks + interval;
+    due = new Semaphore("stats log", 0);
+    (new Thread("stats log", -1))->Fork((VoidFunctionPtr) StatsLogThread,
+					(void *) this);
+}
+
+//----------------------------------------------------------------------
+// StatsLog::~StatsLog
+// 	Nachos is halting: write a line for the last part of an interval,
+//	if there is one, and close the file.
+//----------------------------------------------------------------------
+
+StatsLog::~StatsLog()
+{
+    if (kernel->stats->totalTicks > last.totalTicks)
+	WriteLine();
+    Close(fd);
+    delete due;
+}
+
+//----------------------------------------------------------------------
+// StatsLog::Run
+// 	Wait for a line to be due, and write it, over and over.
+//----------------------------------------------------------------------
+
+void
+StatsLog::Run()
+{
+    for (;;) {
+	due->P();
+	WriteLine();
+    }
+}
+
+//----------------------------------------------------------------------
+// StatsLog::Tick
+// 	Called on each timer interrupt: once the next line is due, wake
+//	the thread to write it.  Intervals that went by with no timer
+//	interrupt at all are skipped, rather than owed.
+//----------------------------------------------------------------------
+
+void
+StatsLog::Tick()
+{
+    if (kernel->stats->totalTicks < nextLine)
+	return;
+    nextLine += interval;
+    if (nextLine <= kernel->stats->totalTicks)
+	nextLine = kernel->stats->totalTicks + interval;
+    due->V();
+}
+
+//----------------------------------------------------------------------
+// StatsLog::WriteLine
+// 	Write the tick, and how much each count went up since the last
+//	line; then remember the counts, for the next.
+//----------------------------------------------------------------------
+
+void
+StatsLog::WriteLine()
+{
+    StatsSnapshot now;
+    int *newer = &now.totalTicks, *older = &last.totalTicks;
+    char line[512];
+    int length;
+
+    kernel->stats->Snapshot(&now);
+    length = sprintf(line, "%d", now.totalTicks);
+    for (int i = 0; i < NumColumns; i++)
+	length += sprintf(&line[length], " %d", newer[i] - older[i]);
+    line[length++] = '\n';
+    WriteFile(fd, line, length);
+    last = now;
+}
@@ -0,0 +1,54 @@
+// statlog.h
+//	Data structures for logging the statistics as a run goes (-statlog):
+//	a kernel thread wakes up every so many ticks, and writes a line to
+//	a UNIX file of how much each of the counts of a StatsSnapshot (see
+//	syscall.h) went up since the last line.  Plotted, the lines show
+//	the phases of a long run -- a cache warming up, a storm of paging.
+//
+//	The file starts with a line naming the columns, after a '#'.  The
+//	first column is the tick of the line; the ticks column is then
+//	the time it covers.  A last line, for whatever part of an
+//	interval there was, is written as Nachos halts.
+//
+//	The thread is woken by the timer interrupt (see Alarm::CallBack),
+//	not the alarm clock, so lines come on the first timer interrupt
+//	of each interval; and so it does not keep Nachos from halting
+//	once everything else is done, as a sleeping thread would.  Its
+//	wake-ups are counted in the statistics like any other thread's,
+//	so the context switches logged include its own.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef STATLOG_H
+#define STATLOG_H
+
+#include "copyright.h"
+#include "syscall.h"
+
+class Semaphore;
+
+// The following class defines the log, and the thread that writes it.
+
+class StatsLog {
+  public:
+    StatsLog(char *fileName, int interval);
+				// Log to "fileName" every "interval" ticks
+    ~StatsLog();		// Write the last line, and close the file
+
+    void Run();			// The thread's loop; never returns
+    void Tick();		// On a timer interrupt, wake the thread
+				// if a line is due
+
+  private:
+    void WriteLine();		// Write the counts since "last"
+
+    int fd;			// the UNIX file being written
+    int interval;		// ticks between lines
+    int nextLine;		// when the next one is due
+    Semaphore *due;		// what the thread waits for it on
+    StatsSnapshot last;		// the counts as of the last line
+};
+
+#endif // STATLOG_H
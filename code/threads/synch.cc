@@ -1,7 +1,7 @@
 // synch.cc 
-//	Routines for synchronizing threads.  Three kinds of
-//	synchronization routines are defined here: semaphores, locks 
-//   	and condition variables.
+//	Routines for synchronizing threads.  Four kinds of
+//	synchronization routines are defined here: semaphores, locks,
+//   	condition variables, and reader-writer locks.
 //
 // Any implementation of a synchronization routine needs some
 // primitive atomic operation.  We assume Nachos is running on
@@ -16,17 +16,15 @@
 // re-set the interrupt state back to its original value (whether
 // that be disabled or enabled).
 //
-// Once we'e implemented one set of higher level atomic operations,
-// we can implement others using that implementation.  We illustrate
-// this by implementing locks and condition variables on top of 
-// semaphores, instead of directly enabling and disabling interrupts.
+// Semaphores, locks and condition variables all keep their waiting
+// threads on a wait queue, with interrupts disabled.  A thread woken
+// from a semaphore is handed the increment it waited for, so it never
+// has to check again, and go back to sleep.  A condition variable's
+// waiters, once signalled, are moved onto the lock's queue without
+// being woken, since they cannot go on until they have the lock.
 //
-// Locks are implemented using a semaphore to keep track of
-// whether the lock is held or not -- a semaphore value of 0 means
-// the lock is busy; a semaphore value of 1 means the lock is free.
-//
-// The implementation of condition variables using semaphores is
-// a bit trickier, as explained below under Condition::Wait.
+// Reader-writer locks are built, in turn, from a lock and two
+// condition variables.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -35,6 +33,151 @@
 #include "copyright.h"
 #include "synch.h"
 #include "main.h"
+#include "slab.h"
+
+// Where the synchronization objects are allocated from; locks and
+// condition variables come and go with open files, disk requests, ...
+static SlabCache waitQueueCache("wait queues", sizeof(WaitQueue));
+static SlabCache semaphoreCache("semaphores", sizeof(Semaphore));
+static SlabCache lockCache("locks", sizeof(Lock));
+static SlabCache conditionCache("condition variables", sizeof(Condition));
+static SlabCache rwLockCache("reader-writer locks", sizeof(RWLock));
+
+//----------------------------------------------------------------------
+// WaitQueue::WaitQueue, ~WaitQueue
+// 	Initialize an empty wait queue; de-allocate it.  Threads still
+//	waiting on it (at shutdown) are simply forgotten.
+//----------------------------------------------------------------------
+
+WaitQueue::WaitQueue()
+{
+}
+
+WaitQueue::~WaitQueue()
+{
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::operator new, WaitQueue::operator delete
+// 	Allocate a wait queue from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+WaitQueue::operator new(size_t size)
+{
+    ASSERT(size == sizeof(WaitQueue));
+    return waitQueueCache.Alloc();
+}
+
+void
+WaitQueue::operator delete(void *object)
+{
+    waitQueueCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Sleep
+// 	Put the current thread on the queue, and relinquish the CPU until
+//	something wakes it.  Interrupts must be disabled, so that the
+//	wakeup cannot come between the two.
+//----------------------------------------------------------------------
+
+void
+WaitQueue::Sleep()
+{
+    Append(kernel->currentThread);
+    kernel->currentThread->Sleep(FALSE);
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Append
+// 	Put "thread", which is asleep, on the queue -- the current thread
+//	about to sleep, or one moved here from another queue.
+//----------------------------------------------------------------------
+
+void
+WaitQueue::Append(Thread *thread)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    threads.Append(thread);
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::RemoveNext
+// 	Take the waiter to be woken next off the queue, without waking
+//	it: the first of the highest priority.  Return NULL if no one is
+//	waiting.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::RemoveNext()
+{
+    Thread *next = NULL;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    for (Thread *t = threads.Front(); t != NULL; t = threads.Next(t))
+	if (next == NULL || t->getPriority() > next->getPriority())
+	    next = t;
+    if (next != NULL)
+	threads.Remove(next);
+    return next;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::WakeOne, Wake
+// 	Wake the next waiter, returning it, or NULL if there was none;
+//	or wake up to "howMany" of them, returning how many were woken.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::WakeOne()
+{
+    Thread *thread = RemoveNext();
+
+    if (thread != NULL)
+	kernel->scheduler->ReadyToRun(thread);
+    return thread;
+}
+
+int
+WaitQueue::Wake(int howMany)
+{
+    int woken = 0;
+
+    while (woken < howMany && WakeOne() != NULL)
+	woken++;
+    return woken;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::HighestPriority
+// 	Return the highest priority of the waiters, or MinPriority if
+//	there are none.
+//----------------------------------------------------------------------
+
+int
+WaitQueue::HighestPriority()
+{
+    int p = MinPriority;
+
+    for (Thread *t = threads.Front(); t != NULL; t = threads.Next(t))
+	p = max(p, t->getPriority());
+    return p;
+}
+
+//----------------------------------------------------------------------
+// ProfileOf
+// 	The profile a new synchronization object of "kind" named "name"
+//	counts into, or NULL if there is no -lockstat (or no kernel yet).
+//----------------------------------------------------------------------
+
+static SynchProfile *
+ProfileOf(char *name, SynchKind kind)
+{
+    if (kernel == NULL || kernel->lockStats == NULL)
+	return NULL;
+    return kernel->lockStats->Find(name, kind);
+}
 
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
@@ -48,7 +191,8 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List<Thread *>;
+    queue = new WaitQueue;
+    profile = ProfileOf(debugName, SemaphoreSynch);
 }
 
 //----------------------------------------------------------------------
@@ -62,11 +206,31 @@ Semaphore::~Semaphore()
     delete queue;
 }
 
+//----------------------------------------------------------------------
+// Semaphore::operator new, Semaphore::operator delete
+// 	Allocate a semaphore from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+Semaphore::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Semaphore));
+    return semaphoreCache.Alloc();
+}
+
+void
+Semaphore::operator delete(void *object)
+{
+    semaphoreCache.Free(object);
+}
+
 //----------------------------------------------------------------------
 // Semaphore::P
 // 	Wait until semaphore value > 0, then decrement.  Checking the
 //	value and decrementing must be done atomically, so we
 //	need to disable interrupts before checking the value.
+//	A thread that has to wait is woken by the V that it waited for,
+//	which hands it the increment, so it need not check again.
 //
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
@@ -76,16 +240,20 @@ void
 Semaphore::P()
 {
     Interrupt *interrupt = kernel->interrupt;
-    Thread *currentThread = kernel->currentThread;
+    int start = (profile != NULL) ? kernel->stats->totalTicks : 0;
+    bool waited = FALSE;
     
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
     
-    while (value == 0) { 		// semaphore not available
-	queue->Append(currentThread);	// so go to sleep
-	currentThread->Sleep(FALSE);
-    } 
-    value--; 			// semaphore available, consume its value
+    if (value > 0)
+	value--; 		// semaphore available, consume its value
+    else {
+	waited = TRUE;
+	queue->Sleep();		// go to sleep, until V hands us one
+    }
+    if (profile != NULL)
+	profile->Taken(start, waited);
    
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);	
@@ -93,7 +261,9 @@ Semaphore::P()
 
 //----------------------------------------------------------------------
 // Semaphore::V
-// 	Increment semaphore value, waking up a waiter if necessary.
+// 	Increment semaphore value, waking up a waiter if necessary --
+//	in which case the increment goes straight to the waiter, and the
+//	value stays as it was.
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that interrupts
 //	are disabled when it is called.
@@ -107,10 +277,8 @@ Semaphore::V()
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
     
-    if (!queue->IsEmpty()) {  // make thread ready.
-	kernel->scheduler->ReadyToRun(queue->RemoveFront());
-    }
-    value++;
+    if (queue->WakeOne() == NULL)	// no one to hand it to
+	value++;
     
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);
@@ -158,8 +326,10 @@ Semaphore::SelfTest()
 Lock::Lock(char* debugName)
 {
     name = debugName;
-    semaphore = new Semaphore("lock", 1);  // initially, unlocked
-    lockHolder = NULL;
+    lockHolder = NULL;		// initially, unlocked
+    queue = new WaitQueue;
+    profile = ProfileOf(debugName, LockSynch);
+    acquiredAt = 0;
 }
 
 //----------------------------------------------------------------------
@@ -168,38 +338,246 @@ Lock::Lock(char* debugName)
 //----------------------------------------------------------------------
 Lock::~Lock()
 {
-    delete semaphore;
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// Lock::operator new, Lock::operator delete
+// 	Allocate a lock from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+Lock::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Lock));
+    return lockCache.Alloc();
+}
+
+void
+Lock::operator delete(void *object)
+{
+    lockCache.Free(object);
 }
 
 //----------------------------------------------------------------------
 // Lock::Acquire
 //	Atomically wait until the lock is free, then set it to busy.
-//	Equivalent to Semaphore::P(), with the semaphore value of 0
-//	equal to busy, and semaphore value of 1 equal to free.
+//	A waiter is woken by the Release it waited for, with the lock
+//	free; unlike a semaphore's increment, the lock is not handed to
+//	it, since a thread that releases and re-acquires the lock in a
+//	loop (a program taking one page fault after another, say) would
+//	otherwise have to wait for every other waiter each time around.
+//	If another thread got in first, the waiter waits again.
+//
+//	A thread that has to wait lends its priority to the holder while
+//	it waits; once it has the lock, the threads still waiting lend
+//	theirs to it.
 //----------------------------------------------------------------------
 
 void Lock::Acquire()
 {
-    semaphore->P();
-    lockHolder = kernel->currentThread;
+    Thread *thread = kernel->currentThread;
+    int start = (profile != NULL) ? kernel->stats->totalTicks : 0;
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    bool waited = (lockHolder != NULL);
+
+    while (lockHolder != NULL) {
+	Enqueue(thread);
+	thread->Sleep(FALSE);
+    }
+    if (profile != NULL) {
+	profile->Taken(start, waited);
+	acquiredAt = kernel->stats->totalTicks;
+    }
+    lockHolder = thread;
+    thread->locksHeld->Append(this);
+    thread->UpdatePriority();
+    (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
 // Lock::Release
 //	Atomically set lock to be free, waking up a thread waiting
 //	for the lock, if any.
-//	Equivalent to Semaphore::V(), with the semaphore value of 0
-//	equal to busy, and semaphore value of 1 equal to free.
 //
 //	By convention, only the thread that acquired the lock
 // 	may release it.
+//
+//	A holder that ran at a waiter's priority goes back to its own,
+//	and gives up the CPU to the threads that now come before it.
 //---------------------------------------------------------------------
 
 void Lock::Release()
 {
+    Thread *thread = kernel->currentThread;
+    int priority = thread->getPriority();
+
+    Unlock();
+    if (thread->getPriority() < priority)
+	thread->Yield();		// let the waiter we held up run
+}
+
+//----------------------------------------------------------------------
+// Lock::Unlock
+//	Release the lock, waking the next waiter, if any, but do not give
+//	up the CPU -- for Condition::Wait, which must go to sleep on the
+//	condition before anyone else runs.
+//---------------------------------------------------------------------
+
+void Lock::Unlock()
+{
+    Thread *thread = kernel->currentThread;
+    Thread *next;
+    IntStatus oldLevel;
+
     ASSERT(IsHeldByCurrentThread());
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    if (profile != NULL)
+	profile->Released(acquiredAt);
+    thread->locksHeld->Remove(this);
     lockHolder = NULL;
-    semaphore->V();
+    next = queue->RemoveNext();
+    if (next != NULL) {
+	next->waitingFor = NULL;
+	kernel->scheduler->ReadyToRun(next);
+    }
+    thread->UpdatePriority();		// give back what was lent for it
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::Enqueue
+//	Make "thread" (the current thread, about to sleep, or one asleep
+//	on a condition) wait for the lock, lending its priority to the
+//	holder.  If the lock is free, "thread" is woken at once to take
+//	it.  Interrupts must be disabled.
+//---------------------------------------------------------------------
+
+void Lock::Enqueue(Thread *thread)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (lockHolder == NULL) {
+	kernel->scheduler->ReadyToRun(thread);
+	return;
+    }
+    thread->waitingFor = this;
+    queue->Append(thread);
+    lockHolder->UpdatePriority();
+}
+
+//----------------------------------------------------------------------
+// Lock::Donation
+//	Return the highest priority of the threads waiting for the lock,
+//	or MinPriority if there are none.
+//----------------------------------------------------------------------
+
+int
+Lock::Donation()
+{
+    return queue->HighestPriority();
+}
+
+//----------------------------------------------------------------------
+// Lock::SelfTest, DonationTestLow, DonationTestMid, DonationTestHigh
+// 	Test priority donation on a priority inversion: "low" holds this
+//	lock, "mid" holds a second lock and waits for this one, and
+//	"high" waits for the second.  Both holders must run at high's
+//	priority until they let go -- "low" through "mid", by nested
+//	donation -- and then drop back to their own.  The test itself
+//	runs at a priority between low's and high's, and must not get
+//	ahead of "low" once it can go on (unless the feedback queue
+//	orders the threads, rather than their priorities).
+//----------------------------------------------------------------------
+
+static Lock *innerLock;			// the lock under test
+static Lock *outerLock;			// held by "mid", wanted by "high"
+static Semaphore *donationStep;		// a test thread has gone on
+static Semaphore *donationGo;		// "low" may let go
+static char donationLog[8];
+static int donationLogLength;
+
+static void
+DonationTestNote(char tag)
+{
+    donationLog[donationLogLength++] = tag;
+    donationLog[donationLogLength] = '\0';
+}
+
+static void
+DonationTestLow(void *dummy)
+{
+    innerLock->Acquire();
+    donationStep->V();
+    donationGo->P();
+    DonationTestNote('l');
+    innerLock->Release();
+    ASSERT(kernel->currentThread->getPriority() == MinPriority);
+    donationStep->V();
+}
+
+static void
+DonationTestMid(void *dummy)
+{
+    outerLock->Acquire();
+    donationStep->V();
+    innerLock->Acquire();
+    DonationTestNote('m');
+    innerLock->Release();
+    ASSERT(kernel->currentThread->getPriority() == MaxPriority);
+    outerLock->Release();
+    ASSERT(kernel->currentThread->getPriority() == DefaultPriority - 1);
+    donationStep->V();
+}
+
+static void
+DonationTestHigh(void *dummy)
+{
+    outerLock->Acquire();
+    DonationTestNote('h');
+    outerLock->Release();
+    donationStep->V();
+}
+
+void
+Lock::SelfTest()
+{
+    Thread *low = new Thread("donation low", 1);
+    Thread *mid = new Thread("donation mid", 1);
+    Thread *high = new Thread("donation high", 1);
+
+    ASSERT(lockHolder == NULL);
+    innerLock = this;
+    outerLock = new Lock("donation outer");
+    donationStep = new Semaphore("donation step", 0);
+    donationGo = new Semaphore("donation go", 0);
+    donationLogLength = 0;
+    low->setPriority(MinPriority);
+    mid->setPriority(DefaultPriority - 1);
+    high->setPriority(MaxPriority);
+
+    low->Fork(DonationTestLow, NULL);
+    donationStep->P();			// "low" holds this lock
+    mid->Fork(DonationTestMid, NULL);
+    donationStep->P();			// "mid" holds the other, and waits
+    ASSERT(low->getPriority() == DefaultPriority - 1);
+    high->Fork(DonationTestHigh, NULL);
+    kernel->currentThread->Yield();	// "high" waits for "mid"
+    ASSERT(mid->getPriority() == MaxPriority);
+    ASSERT(low->getPriority() == MaxPriority);
+
+    donationGo->V();
+    kernel->currentThread->Yield();
+    DonationTestNote('t');
+    for (int i = 0; i < 3; i++)
+	donationStep->P();
+    if (kernel->scheduler->getPolicy() == FifoScheduling ||
+	kernel->scheduler->getPolicy() == PriorityScheduling) {
+	ASSERT(strchr(donationLog, 'l') < strchr(donationLog, 't'));
+    }
+    ASSERT(strchr(donationLog, 'm') < strchr(donationLog, 'h'));
+    delete outerLock;
+    delete donationStep;
+    delete donationGo;
 }
 
 //----------------------------------------------------------------------
@@ -213,7 +591,8 @@ void Lock::Release()
 Condition::Condition(char* debugName)
 {
     name = debugName;
-    waitQueue = new List<Semaphore *>;
+    waitQueue = new WaitQueue;
+    profile = ProfileOf(debugName, ConditionSynch);
 }
 
 //----------------------------------------------------------------------
@@ -226,72 +605,406 @@ Condition::~Condition()
     delete waitQueue;
 }
 
+//----------------------------------------------------------------------
+// Condition::operator new, Condition::operator delete
+// 	Allocate a condition variable from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+Condition::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Condition));
+    return conditionCache.Alloc();
+}
+
+void
+Condition::operator delete(void *object)
+{
+    conditionCache.Free(object);
+}
+
 //----------------------------------------------------------------------
 // Condition::Wait
-// 	Atomically release monitor lock and go to sleep.
-//	Our implementation uses semaphores to implement this, by
-//	allocating a semaphore for each waiting thread.  The signaller
-//	will V() this semaphore, so there is no chance the waiter
-//	will miss the signal, even though the lock is released before
-//	calling P().
+// 	Atomically release monitor lock and go to sleep.  Interrupts
+//	stay disabled from releasing the lock until we are on the
+//	condition's queue, so there is no chance the waiter will miss
+//	the signal.
 //
 //	Note: we assume Mesa-style semantics, which means that the
-//	waiter must re-acquire the monitor lock when waking up.
+//	waiter must re-acquire the monitor lock when waking up.  Here,
+//	it is woken only once the lock has been released to it.
 //
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
 void Condition::Wait(Lock* conditionLock) 
 {
-     Semaphore *waiter;
-    
-     ASSERT(conditionLock->IsHeldByCurrentThread());
+    int start = (profile != NULL) ? kernel->stats->totalTicks : 0;
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
 
-     waiter = new Semaphore("condition", 0);
-     waitQueue->Append(waiter);
-     conditionLock->Release();
-     waiter->P();
-     conditionLock->Acquire();
-     delete waiter;
+    ASSERT(conditionLock->IsHeldByCurrentThread());
+    conditionLock->Unlock();
+    waitQueue->Sleep();			// until Signal, then the lock
+    conditionLock->Acquire();		// free, unless someone got in
+    if (profile != NULL)
+	profile->Taken(start, TRUE);	// a wait always waits
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::WaitUntil
+// 	Wait on the condition until "satisfied(arg)" holds, checking it
+//	each time we wake with the lock.  Return at once if it already
+//	holds.
+//
+//	"conditionLock" -- lock protecting the use of this condition
+//----------------------------------------------------------------------
+
+void
+Condition::WaitUntil(Lock *conditionLock, WaitPredicate satisfied, void *arg)
+{
+    while (!(*satisfied)(arg))
+	Wait(conditionLock);
 }
 
 //----------------------------------------------------------------------
 // Condition::Signal
-// 	Wake up a thread waiting on this condition, if any.
+// 	Wake up "howMany" of the threads waiting on this condition (or
+//	all of them, if there are fewer).  Each is moved, still asleep,
+//	to the queue of the lock (which we hold), to be woken when the
+//	lock is released to it.
 //
 //	Note: we assume Mesa-style semantics, which means that the
 //	signaller doesn't give up control immediately to the thread
 //	being woken up (unlike Hoare-style).
 //
 //	Also note: we assume the caller holds the monitor lock
-//	(unlike what is described in Birrell's paper).  This allows
-//	us to access waitQueue without disabling interrupts.
+//	(unlike what is described in Birrell's paper).
 //
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
-void Condition::Signal(Lock* conditionLock)
+void Condition::Signal(Lock* conditionLock, int howMany)
 {
-    Semaphore *waiter;
-    
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    Thread *waiter;
+
     ASSERT(conditionLock->IsHeldByCurrentThread());
-    
-    if (!waitQueue->IsEmpty()) {
-        waiter = waitQueue->RemoveFront();
-	waiter->V();
-    }
+    for (; howMany > 0 && (waiter = waitQueue->RemoveNext()) != NULL;
+	    howMany--)
+	conditionLock->Enqueue(waiter);
+    (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
 // Condition::Broadcast
-// 	Wake up all threads waiting on this condition, if any.
+// 	Wake up all threads waiting on this condition, if any.  They get
+//	the lock one after another, each waking only once it has it.
 //
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
 void Condition::Broadcast(Lock* conditionLock) 
 {
-    while (!waitQueue->IsEmpty()) {
-        Signal(conditionLock);
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    while (!waitQueue->IsEmpty())
+	Signal(conditionLock);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Condition::SelfTest, ConditionTestWaiter
+// 	Test waking the waiters: three threads wait on the condition, and
+//	are woken two, then one.  A waiter that has been signalled must
+//	stay asleep while we hold the lock, and the waiters must get it
+//	in the order they waited.
+//----------------------------------------------------------------------
+
+static Lock *conditionTestLock;
+static Condition *conditionTest;
+static Semaphore *conditionTestDone;
+static int conditionTestGo;		// waiters that may go on
+static char conditionTestLog[8];
+static int conditionTestLength;
+
+static bool
+ConditionTestMayGo(void *dummy)
+{
+    return conditionTestGo > 0;
+}
+
+static void
+ConditionTestWaiter(void *tag)
+{
+    conditionTestLock->Acquire();
+    conditionTestDone->V();
+    conditionTest->WaitUntil(conditionTestLock, ConditionTestMayGo, NULL);
+    conditionTestGo--;
+    conditionTestLog[conditionTestLength++] = (char) (long) tag;
+    conditionTestLog[conditionTestLength] = '\0';
+    conditionTestLock->Release();
+    conditionTestDone->V();
+}
+
+void
+Condition::SelfTest()
+{
+    Lock *lock = new Lock("condition test");
+    Thread *waiters[3];
+
+    conditionTestLock = lock;
+    conditionTest = this;
+    conditionTestDone = new Semaphore("condition test", 0);
+    conditionTestGo = 0;
+    conditionTestLength = 0;
+    for (int i = 0; i < 3; i++) {
+	waiters[i] = new Thread("condition waiter", 1);
+	waiters[i]->Fork(ConditionTestWaiter, (void *) (long) ('a' + i));
+	conditionTestDone->P();
+    }
+
+    lock->Acquire();			// all three wait on the condition
+    conditionTestGo = 2;
+    Signal(lock, 2);
+    for (int i = 0; i < 3; i++)
+	kernel->currentThread->Yield();
+    ASSERT(waiters[0]->getStatus() == BLOCKED);
+    ASSERT(conditionTestLength == 0);	// they need the lock first
+    lock->Release();
+    for (int i = 0; i < 2; i++)
+	conditionTestDone->P();
+    ASSERT(strcmp(conditionTestLog, "ab") == 0);
+
+    lock->Acquire();
+    conditionTestGo = 1;
+    Broadcast(lock);
+    lock->Release();
+    conditionTestDone->P();
+    ASSERT(strcmp(conditionTestLog, "abc") == 0);
+    delete conditionTestDone;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock.  Initially, no one holds it.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    name = debugName;
+    lock = new Lock("rwlock");
+    readOk = new Condition("rwlock read");
+    writeOk = new Condition("rwlock write");
+    readers = waitingReaders = waitingWriters = 0;
+    readersAdmitted = 0;
+    writer = NULL;
+    writeDepth = 0;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	Deallocate a reader-writer lock.  No one may hold it, or wait for
+//	it.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers == 0 && writer == NULL);
+    ASSERT(waitingReaders == 0 && waitingWriters == 0);
+    delete lock;
+    delete readOk;
+    delete writeOk;
+}
+
+//----------------------------------------------------------------------
+// RWLock::operator new, RWLock::operator delete
+// 	Allocate a reader-writer lock from the cache of them, or give one back.
+//----------------------------------------------------------------------
+
+void *
+RWLock::operator new(size_t size)
+{
+    ASSERT(size == sizeof(RWLock));
+    return rwLockCache.Alloc();
+}
+
+void
+RWLock::operator delete(void *object)
+{
+    rwLockCache.Free(object);
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+// 	Wait until the lock may be held for reading, then hold it.  A
+//	reader waits while a writer holds the lock, and also while one
+//	waits for it -- unless it is one of the readers the last writer
+//	let in on its way out.
+//----------------------------------------------------------------------
+
+void
+RWLock::AcquireRead()
+{
+    lock->Acquire();
+    if (IsHeldForWriting()) {		// the writer, reading
+	writeDepth++;
+	lock->Release();
+	return;
     }
+    waitingReaders++;
+    while (writer != NULL || (waitingWriters > 0 && readersAdmitted == 0))
+	readOk->Wait(lock);
+    waitingReaders--;
+    if (readersAdmitted > 0)
+	readersAdmitted--;
+    readers++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseRead
+// 	Give up the lock, held for reading.  The last reader out lets a
+//	waiting writer in.
+//----------------------------------------------------------------------
+
+void
+RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    if (IsHeldForWriting()) {
+	ASSERT(writeDepth > 1);
+	writeDepth--;
+    } else {
+	ASSERT(readers > 0);
+	if (--readers == 0)
+	    writeOk->Signal(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+// 	Wait until no one else holds the lock, and the readers let in
+//	ahead of the writers are in, then hold it alone.
+//----------------------------------------------------------------------
+
+void
+RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    if (IsHeldForWriting()) {
+	writeDepth++;
+	lock->Release();
+	return;
+    }
+    waitingWriters++;
+    while (writer != NULL || readers > 0 || readersAdmitted > 0)
+	writeOk->Wait(lock);
+    waitingWriters--;
+    writer = kernel->currentThread;
+    writeDepth = 1;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+// 	Give up the lock, held for writing.  When the writer lets go for
+//	the last time, the readers waiting for it are let in, all of
+//	them, ahead of the other writers; if there are none, the next
+//	writer is.
+//----------------------------------------------------------------------
+
+void
+RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(IsHeldForWriting());
+    if (--writeDepth == 0) {
+	writer = NULL;
+	if (waitingReaders > 0) {
+	    readersAdmitted = waitingReaders;
+	    readOk->Broadcast(lock);
+	} else {
+	    writeOk->Signal(lock);
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::SelfTest, RWTestReader, RWTestWriter
+// 	Test the reader-writer lock: a second reader gets in alongside
+//	the first; a reader that comes while a writer waits must wait for
+//	it; a writer keeps everyone out; and a reader that waited for one
+//	writer goes ahead of the next.  Each thread notes when it gets in
+//	(and the writers when they leave), and the order is checked.
+//----------------------------------------------------------------------
+
+static RWLock *testLock;
+static Semaphore *testDone;
+static char testLog[8];
+static int testLogLength;
+
+static void
+RWTestNote(char tag)
+{
+    testLog[testLogLength++] = tag;
+    testLog[testLogLength] = '\0';
+}
+
+static void
+RWTestReader(void *tag)
+{
+    testLock->AcquireRead();
+    RWTestNote((char) (long) tag);
+    kernel->currentThread->Yield();
+    testLock->ReleaseRead();
+    testDone->V();
+}
+
+static void
+RWTestWriter(void *tag)
+{
+    testLock->AcquireWrite();
+    RWTestNote((char) (long) tag);
+    for (int i = 0; i < 3; i++)
+	kernel->currentThread->Yield();	// no one else gets in
+    testLock->AcquireRead();		// the writer may read, too
+    testLock->ReleaseRead();
+    RWTestNote((char) (long) tag);
+    testLock->ReleaseWrite();
+    testDone->V();
+}
+
+void
+RWLock::SelfTest()
+{
+    testLock = this;
+    testDone = new Semaphore("rwlock test", 0);
+    testLogLength = 0;
+
+    AcquireRead();
+    (new Thread("rwlock reader", 1))->Fork(RWTestReader,
+					   (void *) (long) 'a');
+    testDone->P();			// "a" came and went meanwhile
+    ASSERT(strcmp(testLog, "a") == 0);
+
+    (new Thread("rwlock writer", 1))->Fork(RWTestWriter,
+					   (void *) (long) 'W');
+    (new Thread("rwlock reader", 1))->Fork(RWTestReader,
+					   (void *) (long) 'b');
+    for (int i = 0; i < 3; i++)
+	kernel->currentThread->Yield();
+    ASSERT(testLogLength == 1);		// "W" waits for us, "b" for "W"
+    ReleaseRead();
+    (new Thread("rwlock writer", 1))->Fork(RWTestWriter,
+					   (void *) (long) 'X');
+    for (int i = 0; i < 3; i++)
+	testDone->P();
+    ASSERT(strcmp(testLog, "aWWbXX") == 0);
+    delete testDone;
 }
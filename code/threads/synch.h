@@ -1,8 +1,8 @@
 // synch.h 
 //	Data structures for synchronizing threads.
 //
-//	Three kinds of synchronization are defined here: semaphores,
-//	locks, and condition variables.  The implementation for
+//	Four kinds of synchronization are defined here: semaphores,
+//	locks, condition variables, and reader-writer locks.  The implementation for
 //	semaphores is given; for the latter two, only the procedure
 //	interface is given -- they are to be implemented as part of 
 //	the first assignment.
@@ -21,6 +21,36 @@
 #include "thread.h"
 #include "list.h"
 #include "main.h"
+#include "lockstat.h"
+
+// The following class defines a "wait queue": the threads waiting for
+// something, in the order they are to be woken -- the highest priority
+// first, and among those of the same priority, the one that has waited
+// longest.  A waiter can be woken (put on the ready list), or moved to
+// another queue still asleep.  All operations must be made with
+// interrupts disabled.
+
+class WaitQueue {
+  public:
+    WaitQueue();			// initialize to empty
+    ~WaitQueue();			// deallocate the queue
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
+    bool IsEmpty() { return threads.IsEmpty(); }
+    void Sleep();			// the current thread waits here
+    void Append(Thread *thread);	// "thread", asleep, waits here
+    Thread *RemoveNext();		// take the next to be woken off the
+					// queue, still asleep; NULL if none
+    Thread *WakeOne();			// wake the next waiter, if any
+    int Wake(int howMany);		// wake up to "howMany"; return how
+					// many there were
+    int HighestPriority();		// of the waiters, or MinPriority
+
+  private:
+    IntrusiveList<Thread> threads;	// in the order they came
+};
 
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
@@ -36,11 +66,19 @@
 // into a register, a context switch might have occurred,
 // and some other thread might have called P or V, so the true value might
 // now be different.
+//
+// A V() that finds a thread waiting hands the increment straight to it,
+// so the waiter returns from P() without looking at the value again,
+// and no thread that calls P() in the meantime can take it away.
 
 class Semaphore {
   public:
     Semaphore(char* debugName, int initialValue);	// set initial value
     ~Semaphore();   					// de-allocate semaphore
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
     char* getName() { return name;}			// debugging assist
     
     void P();	 	// these are the only operations on a semaphore
@@ -50,8 +88,9 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List<Thread *> *queue;     
+    WaitQueue *queue;     
 		  	// threads waiting in P() for the value to be > 0
+    SynchProfile *profile;	// its counts, if -lockstat; else NULL
    };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -64,12 +103,22 @@ class Semaphore {
 //
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
-// (because the value might change immediately after you read it).  
+// (because the value might change immediately after you read it).
+//
+// A thread waiting in Acquire lends its priority to the holder (and,
+// if the holder is itself waiting for a lock, to that lock's holder,
+// and so on), until the holder releases the lock; see
+// Thread::UpdatePriority.
+  
 
 class Lock {
   public:
     Lock(char* debugName);  	// initialize lock to be FREE
     ~Lock();			// deallocate lock
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
     char* getName() { return name; }	// debugging assist
 
     void Acquire(); 		// these are the only operations on a lock
@@ -79,13 +128,27 @@ class Lock {
     		return lockHolder == kernel->currentThread; }
     				// return true if the current thread 
 				// holds this lock.
+    Thread *getHolder() { return lockHolder; }
+    int Donation();		// the highest priority of the threads
+				// waiting for the lock
     
-    // Note: SelfTest routine provided by SynchList
+    void SelfTest();		// test priority donation; the locking
+				// itself is tested by SynchList
     
   private:
+    friend class Condition;
+    void Unlock();		// Release, without giving up the CPU
+    void Enqueue(Thread *thread);	// "thread", asleep, waits for the
+				// lock (or is woken, if it is free)
+
     char *name;			// debugging assist
     Thread *lockHolder;		// thread currently holding lock
-    Semaphore *semaphore;	// we use a semaphore to implement lock
+    WaitQueue *queue;		// threads waiting in Acquire
+    SynchProfile *profile;	// its counts, if -lockstat; else NULL
+    int acquiredAt;		// when the holder took it, for them
+
+  public:
+    ListLink<Lock> listLink;	// on its holder's locksHeld
 };
 
 // The following class defines a "condition variable".  A condition
@@ -120,25 +183,93 @@ class Lock {
 // can acquire the lock, and change data structures, before the woken
 // thread gets a chance to run.  The advantage to Mesa-style semantics
 // is that it is a lot easier to implement than Hoare-style.
+//
+// A signalled thread is not woken at once, only to find the lock held
+// (by the signaller, at least) and go back to sleep for it: it is moved,
+// still asleep, to the lock's queue, and woken when the lock is
+// released to it.  So a Broadcast wakes the waiters one at a time, as
+// each can have the lock.
+// Signal can also wake a given number of waiters.
+
+typedef bool (*WaitPredicate)(void *arg);	// see Condition::WaitUntil
 
 class Condition {
   public:
     Condition(char* debugName);	// initialize condition to 
 					// "no one waiting"
     ~Condition();			// deallocate the condition
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
     char* getName() { return (name); }
     
     void Wait(Lock *conditionLock); 	// these are the 3 operations on 
 					// condition variables; releasing the 
 					// lock and going to sleep are 
 					// *atomic* in Wait()
-    void Signal(Lock *conditionLock);   // conditionLock must be held by
+    void Signal(Lock *conditionLock, int howMany = 1);
+                                        // conditionLock must be held by
     void Broadcast(Lock *conditionLock);// the currentThread for all of 
 					// these operations
-    // SelfTest routine provided by SyncLists
+    void WaitUntil(Lock *conditionLock, WaitPredicate satisfied,
+		   void *arg);		// Wait until satisfied(arg)
+
+    void SelfTest();			// test waking waiters
 
   private:
     char* name;
-    List<Semaphore *> *waitQueue;	// list of waiting threads
+    WaitQueue *waitQueue;		// list of waiting threads
+    SynchProfile *profile;		// its counts, if -lockstat; else NULL
+};
+
+// The following class defines a "reader-writer lock".  Any number of
+// threads may hold it for reading at once, or one thread may hold it
+// for writing, alone.
+//
+// Writers are preferred: once a writer is waiting, a thread that
+// comes to read waits behind it, so a stream of readers cannot keep
+// a writer out.  But the readers that waited while a writer held the
+// lock all get in when it lets go, ahead of the next writer, so a
+// stream of writers cannot keep them out either.
+//
+// The writer may take the lock again, for reading or for writing, as
+// long as each Acquire is matched by a Release; so one can hold a
+// file for writing across several reads and writes of it.  A reader
+// must not take the lock again, since a writer may be waiting.
+
+class RWLock {
+  public:
+    RWLock(char* debugName);		// initialize to free
+    ~RWLock();				// deallocate the lock
+
+    void *operator new(size_t size);	// From a slab cache of them
+    void operator delete(void *object);
+
+    char* getName() { return name; }	// debugging assist
+
+    void AcquireRead();			// wait until no writer holds it (or
+    void ReleaseRead();			// waits for it), then hold it
+    void AcquireWrite();		// wait until no one holds it, then
+    void ReleaseWrite();		// hold it alone
+
+    bool IsHeldForWriting() { return writer == kernel->currentThread; }
+    					// does the current thread hold it
+					// for writing?
+
+    void SelfTest();			// test the reader-writer lock
+
+  private:
+    char *name;				// debugging assist
+    Lock *lock;				// protects the fields below
+    Condition *readOk;			// signalled when readers may enter
+    Condition *writeOk;			// signalled when a writer may enter
+    int readers;			// threads holding it for reading
+    int waitingReaders;			// threads waiting to read
+    int waitingWriters;			// threads waiting to write
+    int readersAdmitted;		// waiting readers let in ahead of
+					// the waiting writers
+    Thread *writer;			// thread holding it for writing
+    int writeDepth;			// times it took the lock, still held
 };
 #endif // SYNCH_H
@@ -20,7 +20,10 @@
 #include "thread.h"
 #include "switch.h"
 #include "synch.h"
+#include "slab.h"
 #include "sysdep.h"
+#include "synchconsole.h"
+#include "swapper.h"
 
 // this is put at the top of the execution stack, for detecting stack overflows
 const int STACK_FENCEPOST = 0xdedbeef;
@@ -40,6 +43,19 @@ Thread::Thread(char* threadName, int threadID)
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;
+    priority = effectivePriority = DefaultPriority;
+    locksHeld = new IntrusiveList<Lock>;
+    waitingFor = NULL;
+    feedbackLevel = ticksUsed = boostsSeen = 0;
+    tickets = DefaultTickets;
+    pass = lag = 0;
+    inShare = FALSE;
+    share = NULL;
+    ioClass = IoBestEffort;
+    journalDepth = journalClaim = journalUsed = journalBatch = 0;
+    statusSince = kernel->stats->totalTicks;
+    userSince = systemSince = 0;
+    scratch = NULL;
     for (int i = 0; i < MachineStateSize; i++) {
 	machineState[i] = NULL;		// not strictly necessary, since
 					// new thread ignores contents 
@@ -64,8 +80,104 @@ Thread::~Thread()
 {
     DEBUG(dbgThread, "Deleting thread: " << name);
     ASSERT(this != kernel->currentThread);
+    ASSERT(locksHeld->IsEmpty());
+    kernel->scheduler->Forget(this);
     if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+	kernel->stackPool->Put(stack);
+    delete locksHeld;
+    delete scratch;
+    DEBUG(dbgThread, "Usage of " << name << ": user " << usage.userTicks
+	  << ", system " << usage.systemTicks << ", ready "
+	  << usage.readyTicks << ", blocked " << usage.blockedTicks
+	  << ", switches " << usage.voluntarySwitches << " voluntary, "
+	  << usage.involuntarySwitches << " involuntary");
+    kernel->stats->threadUsage.Add(&usage);
+}
+
+//----------------------------------------------------------------------
+// Thread::setStatus
+// 	Change the thread's status, charging the time since the last
+//	change to it if it was waiting, ready or blocked.
+//----------------------------------------------------------------------
+
+void
+Thread::setStatus(ThreadStatus st)
+{
+    int now = kernel->stats->totalTicks;
+
+    if (status == READY)
+	usage.readyTicks += now - statusSince;
+    else if (status == BLOCKED)
+	usage.blockedTicks += now - statusSince;
+    statusSince = now;
+    status = st;
+}
+
+//----------------------------------------------------------------------
+// Thread::Usage
+// 	Return what the thread has used so far -- including, if it has
+//	the CPU, the user and system ticks since it was given it.
+//----------------------------------------------------------------------
+
+ThreadUsage
+Thread::Usage()
+{
+    ThreadUsage u = usage;
+
+    if (this == kernel->currentThread) {
+	u.userTicks += kernel->stats->userTicks - userSince;
+	u.systemTicks += kernel->stats->systemTicks - systemSince;
+    }
+    return u;
+}
+
+//----------------------------------------------------------------------
+// Thread::Scratch
+// 	Return the arena the kernel code the thread runs allocates its
+//	temporary buffers from, making it the first time.  An operation
+//	wanting some makes an ArenaMark on it first, to give them back
+//	as it returns.  Only the thread itself may use it.
+//----------------------------------------------------------------------
+
+Arena *
+Thread::Scratch()
+{
+    ASSERT(this == kernel->currentThread);
+    if (scratch == NULL)
+	scratch = new Arena;
+    return scratch;
+}
+
+//----------------------------------------------------------------------
+// Thread::SwitchedIn
+// 	Note the machine's user and system ticks, as the thread is given
+//	the CPU, so that what it runs for can be charged to it.
+//----------------------------------------------------------------------
+
+void
+Thread::SwitchedIn()
+{
+    userSince = kernel->stats->userTicks;
+    systemSince = kernel->stats->systemTicks;
+}
+
+//----------------------------------------------------------------------
+// Thread::SwitchedOut
+// 	Charge the thread for the ticks it has run since it was given the
+//	CPU, as it gives it up.  A thread that is still ready -- time
+//	sliced, preempted or yielding -- was switched out involuntarily;
+//	one that blocks or finishes, voluntarily.
+//----------------------------------------------------------------------
+
+void
+Thread::SwitchedOut()
+{
+    usage.userTicks += kernel->stats->userTicks - userSince;
+    usage.systemTicks += kernel->stats->systemTicks - systemSince;
+    if (status == READY)
+	usage.involuntarySwitches++;
+    else
+	usage.voluntarySwitches++;
 }
 
 //----------------------------------------------------------------------
@@ -104,6 +216,26 @@ Thread::Fork(VoidFunctionPtr func, void *arg)
     (void) interrupt->SetLevel(oldLevel);
 }    
 
+//----------------------------------------------------------------------
+// Thread::Restart
+// 	Give the main thread, running on the host's stack, a stack of its
+//	own, set up to call (*func)(arg) the next time it is switched to;
+//	where it is on the host's stack is forgotten.  A machine of a
+//	cluster but the first is booted on the host's stack, and then
+//	left to start over on its own (see Cluster::Boot).
+//
+//	"func" is the procedure to run when the thread is switched to
+//	"arg" is a single argument to be passed to the procedure
+//----------------------------------------------------------------------
+
+void
+Thread::Restart(VoidFunctionPtr func, void *arg)
+{
+    ASSERT(this == kernel->currentThread && stack == NULL);
+    DEBUG(dbgThread, "Restarting thread: " << name);
+    StackAllocate(func, arg);
+}
+
 //----------------------------------------------------------------------
 // Thread::CheckOverflow
 // 	Check a thread's stack to see if it has overrun the space
@@ -179,13 +311,81 @@ Thread::Finish ()
 }
 
 
+//----------------------------------------------------------------------
+// Thread::setPriority
+// 	Change the thread's own priority.  What it runs at may stay
+//	higher, for as long as it holds a lock a higher-priority thread
+//	waits for.
+//----------------------------------------------------------------------
+
+void
+Thread::setPriority(int p)
+{
+    IntStatus oldLevel;
+
+    ASSERT(p >= MinPriority && p <= MaxPriority);
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    priority = p;
+    UpdatePriority();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Thread::setTickets
+// 	Set the thread's tickets, its share of the CPU under the stride
+//	scheduler.
+//----------------------------------------------------------------------
+
+void
+Thread::setTickets(int t)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    kernel->scheduler->SetTickets(this, t);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Thread::UpdatePriority
+// 	Recompute the priority the thread runs at: the highest of its own
+//	and those of the threads waiting for the locks it holds.  A ready
+//	thread is moved to the run queue of its new priority.  If the
+//	thread itself waits for a lock, the change is passed on to the
+//	holder of that lock, and so on down the chain, so that a donation
+//	reaches the thread that must run for the donor to go on.
+//
+//	Interrupts must be disabled, so the chain cannot change meanwhile.
+//----------------------------------------------------------------------
+
+void
+Thread::UpdatePriority()
+{
+    int p = priority;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    for (Lock *l = locksHeld->Front(); l != NULL; l = locksHeld->Next(l))
+	p = max(p, l->Donation());
+    if (p == effectivePriority)
+	return;
+    if (status == READY) {
+	kernel->scheduler->Remove(this);
+	effectivePriority = p;
+	kernel->scheduler->ReadyToRun(this);
+    } else {
+	effectivePriority = p;
+    }
+    if (waitingFor != NULL && waitingFor->getHolder() != NULL)
+	waitingFor->getHolder()->UpdatePriority();
+}
+
 //----------------------------------------------------------------------
 // Thread::Yield
 // 	Relinquish the CPU if any other thread is ready to run.
 //	If so, put the thread on the end of the ready list, so that
 //	it will eventually be re-scheduled.
 //
-//	NOTE: returns immediately if no other thread on the ready queue.
+//	NOTE: returns immediately if no other thread on the ready queue
+//	(or, with priorities, none of at least this thread's priority).
 //	Otherwise returns when the thread eventually works its way
 //	to the front of the ready list and gets re-scheduled.
 //
@@ -207,11 +407,12 @@ Thread::Yield ()
     
     DEBUG(dbgThread, "Yielding thread: " << name);
     
+    kernel->scheduler->ReadyToRun(this);
     nextThread = kernel->scheduler->FindNextToRun();
-    if (nextThread != NULL) {
-	kernel->scheduler->ReadyToRun(this);
+    if (nextThread != this)
 	kernel->scheduler->Run(nextThread, FALSE);
-    }
+    else
+	setStatus(RUNNING);
     (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
@@ -227,7 +428,10 @@ Thread::Yield ()
 //	we have no thread to run.  "Interrupt::Idle" is called
 //	to signify that we should idle the CPU until the next I/O interrupt
 //	occurs (the only thing that could cause a thread to become
-//	ready to run).
+//	ready to run).  The timer and console input are turned off, so
+//	that Nachos can halt, only once no disk (or other) interrupt a
+//	thread could be waiting for is still to come; until then time
+//	slicing goes on.
 //
 //	NOTE: we assume interrupts are already disabled, because it
 //	is called from the synchronization routines which must
@@ -245,10 +449,16 @@ Thread::Sleep (bool finishing)
     
     DEBUG(dbgThread, "Sleeping thread: " << name);
 
-    status = BLOCKED;
+    setStatus(BLOCKED);
+    if (!finishing)
+	kernel->scheduler->Blocking(this);
 	//cout << "debug Thread::Sleep " << name << "wait for Idle\n";
     while ((nextThread = kernel->scheduler->FindNextToRun()) == NULL) {
-		kernel->PrepareToEnd();
+		if (!kernel->interrupt->DevicePending() &&
+		    !kernel->synchConsoleIn->Waiting() &&
+		    (kernel->swapper == NULL || !kernel->swapper->Waiting()))
+			kernel->PrepareToEnd();	// no one will wake up
+
 		kernel->interrupt->Idle();	// no one to run, wait for an interrupt
 	}    
     // returns when it's time for us to run
@@ -306,7 +516,7 @@ PLabelToAddr(void *plabel)
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    stack = kernel->stackPool->Get();
 
 #ifdef PARISC
     // HP stack works from low addresses to high addresses
@@ -397,6 +607,65 @@ Thread::RestoreUserState()
 }
 
 
+//----------------------------------------------------------------------
+// StackPool::StackPool
+// 	Make a pool of thread stacks, with "preallocate" of them ready
+//	to be handed out, that keeps up to "highWater" stacks given back.
+//----------------------------------------------------------------------
+
+StackPool::StackPool(int preallocate, int highWater)
+{
+    ASSERT(highWater >= 0 && preallocate <= highWater);
+    this->highWater = highWater;
+    kept = new int *[highWater + 1];	// never 0 long
+    for (numKept = 0; numKept < preallocate; numKept++)
+	kept[numKept] = (int *) AllocBoundedArray(StackSize * sizeof(int));
+}
+
+//----------------------------------------------------------------------
+// StackPool::~StackPool
+// 	Free the stacks that are kept.  (Those still in use go with
+//	Nachos.)
+//----------------------------------------------------------------------
+
+StackPool::~StackPool()
+{
+    while (numKept > 0)
+	DeallocBoundedArray((char *) kept[--numKept],
+			    StackSize * sizeof(int));
+    delete [] kept;
+}
+
+//----------------------------------------------------------------------
+// StackPool::Get
+// 	Return a stack for a new thread: the one given back last, which
+//	is the likeliest to still be in the host's cache, or a new one
+//	if none is kept.
+//----------------------------------------------------------------------
+
+int *
+StackPool::Get()
+{
+    if (numKept > 0)
+	return kept[--numKept];
+    return (int *) AllocBoundedArray(StackSize * sizeof(int));
+}
+
+//----------------------------------------------------------------------
+// StackPool::Put
+// 	Take back the stack of a thread that is done, keeping it if
+//	there is room, and freeing it otherwise.
+//----------------------------------------------------------------------
+
+void
+StackPool::Put(int *stack)
+{
+    if (numKept < highWater)
+	kept[numKept++] = stack;
+    else
+	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+}
+
 //----------------------------------------------------------------------
 // SimpleThread
 // 	Loop 5 times, yielding the CPU to another ready thread 
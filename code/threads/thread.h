@@ -39,9 +39,11 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "list.h"
 #include "sysdep.h"
 #include "machine.h"
 #include "addrspace.h"
+#include "stats.h"
 
 // CPU register state to be saved on context switch.  
 // The x86 needs to save only a few registers, 
@@ -61,6 +63,29 @@ const int StackSize = (8 * 1024);	// in words
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, ZOMBIE };
 
+// Thread priorities, for the priority scheduler: a ready thread of a
+// higher priority always runs before one of a lower priority.  A thread
+// runs at the highest of its own priority and those of the threads
+// waiting for the locks it holds, so that a high-priority thread is
+// never kept waiting for a lock by threads of a priority between.
+const int MinPriority = 0;
+const int MaxPriority = 31;
+const int DefaultPriority = 16;
+
+// Thread tickets, for the stride scheduler: the threads that can run
+// share the CPU in proportion to their tickets.
+const int MinTickets = 1;
+const int MaxTickets = 1000;
+const int DefaultTickets = 100;
+
+// I/O classes, for the disk's fair queueing (see synchdisk.h): a queued
+// request of a realtime thread is served before any other, and one of
+// an idle thread only when nothing else is waiting.
+enum IoClass { IoRealtime, IoBestEffort, IoIdle };
+
+class Lock;
+class Arena;
+class ShareRecord;
 
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
@@ -91,6 +116,10 @@ class Thread {
 
     void Fork(VoidFunctionPtr func, void *arg); 
     				// Make thread run (*func)(arg)
+    void Restart(VoidFunctionPtr func, void *arg);
+				// Start the running main thread over on
+				// a stack of its own, running (*func)(arg)
+				// when next switched to (see Cluster)
     void Yield();  		// Relinquish the CPU if any 
 				// other thread is runnable
     void Sleep(bool finishing); // Put the thread to sleep and 
@@ -99,12 +128,24 @@ class Thread {
     void Finish();  		// The thread is done executing
     
     void CheckOverflow();   	// Check if thread stack has overflowed
-    void setStatus(ThreadStatus st) { status = st; }
+    void setStatus(ThreadStatus st);	// charges the time spent in
+				// the old status to it
     ThreadStatus getStatus() { return (status); }
 	char* getName() { return (name); }
     
 	int getID() { return (ID); }
+    int getPriority() { return (effectivePriority); }
+				// with what its lock waiters donate
+    int getBasePriority() { return (priority); }
+    void setPriority(int p);	// see MinPriority...MaxPriority
+    void UpdatePriority();	// recompute the donations to it
+    void setTickets(int t);	// see MinTickets...MaxTickets
     void Print() { cout << name; }
+    ThreadUsage Usage();	// what it has used so far
+    void SwitchedIn();		// it has been given the CPU
+    void SwitchedOut();		// it is giving the CPU up
+    Arena *Scratch();		// where the kernel code it runs gets
+				// its temporary buffers
     void SelfTest();		// test whether thread impl is working
 
   private:
@@ -116,6 +157,15 @@ class Thread {
     ThreadStatus status;	// ready, running or blocked
     char* name;
 	int   ID;
+    int priority;		// see MinPriority...MaxPriority
+    int effectivePriority;	// at least "priority", and that of any
+				// thread waiting for a lock it holds
+    ThreadUsage usage;		// its ticks and switches, up to its
+				// last change of status
+    int statusSince;		// when its status last changed
+    int userSince, systemSince;	// user and system ticks when it was
+				// last given the CPU
+    Arena *scratch;		// made by the first Scratch(), if any
     void StackAllocate(VoidFunctionPtr func, void *arg);
     				// Allocate a stack for thread.
 				// Used internally by Fork()
@@ -131,11 +181,75 @@ class Thread {
     void RestoreUserState();		// restore user-level register state
 
     AddrSpace *space;			// User code this thread is running.
+
+// What the multi-level feedback queue scheduler knows of the thread.
+
+    int feedbackLevel;			// Its queue; 0 is the top
+    int ticksUsed;			// Timer interrupts it has run
+					// through at that level
+    int boostsSeen;			// Scheduler boosts it has had
+
+// What the stride scheduler knows of the thread.
+
+    int tickets;			// Its share of the CPU
+    double pass;			// How far it has run: CPU ticks per
+					// ticket, on the scheduler's clock
+    double lag;				// Its pass less the scheduler's, as
+					// it last stopped being ready
+    bool inShare;			// Ready or running, its tickets
+					// counted in the scheduler's total?
+    ShareRecord *share;			// Its line of the skew report, or
+					// NULL before it first runs
+
+// What the disk's fair queueing knows of the thread.
+
+    IoClass ioClass;			// Which class its requests are in
+
+// What the metadata journal knows of the thread.
+
+    int journalDepth;			// File system operations it is in,
+					// nested ones included; the sectors
+					// it writes are logged while > 0
+    int journalClaim;			// Slots of the batch kept for the
+					// outermost one
+    int journalUsed;			// Of those, the ones it has logged
+    int journalBatch;			// The batch journalUsed counts in
+
+// The locks it holds, and the one it waits for, so that a thread waiting
+// for a lock can lend its priority to the holder (see Lock::Acquire).
+
+    IntrusiveList<Lock> *locksHeld;	// Locks it holds
+    Lock *waitingFor;			// Lock it waits to acquire, or NULL
+
+// Where it is linked on the ready list or the wait queue it is on, if any.
+
+    ListLink<Thread> listLink;
 };
 
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(Thread *thread);	 
 
+// The stacks of threads that are done are kept, rather than freed, to
+// be handed to the next threads forked -- guard pages and all, so that
+// forking a thread needs no allocation or mprotect.  Up to "highWater"
+// are kept; any more are freed.
+
+class StackPool {
+  public:
+    StackPool(int preallocate, int highWater);
+				// Make "preallocate" stacks up front
+    ~StackPool();		// Free the stacks kept
+
+    int *Get();			// A stack of StackSize words: a kept one,
+				// if there is one
+    void Put(int *stack);	// Take back a stack no longer in use
+
+  private:
+    int **kept;			// The stacks not in use
+    int numKept;
+    int highWater;		// Most stacks that are kept
+};
+
 // Magical machine-dependent routines, defined in switch.s
 
 extern "C" {
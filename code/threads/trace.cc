@@ -0,0 +1,91 @@
+// trace.cc
+//	Routines to record kernel events in a ring, and write it out.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "trace.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Trace::Trace
+// 	Make an empty ring, for the events of the categories named in
+//	"categories" (see trace.h).
+//----------------------------------------------------------------------
+
+Trace::Trace(char *categories)
+{
+    ring = new TraceRecord[TraceRecords];
+    next = 0;
+    numRecorded = 0;
+    for (int i = 0; i < 128; i++)
+	enabled[i] = (strchr(categories, i) != NULL ||
+		      strchr(categories, dbgAll) != NULL) && i != 0;
+}
+
+//----------------------------------------------------------------------
+// Trace::~Trace
+// 	De-allocate the ring.
+//----------------------------------------------------------------------
+
+Trace::~Trace()
+{
+    delete [] ring;
+}
+
+//----------------------------------------------------------------------
+// Trace::Record
+// 	Put an event in the ring, over the oldest one if it is full,
+//	stamped with the time and the thread running.
+//
+//	"event" -- a TraceEvent
+//	"arg0", "arg1", "arg2" -- what the event holds (see trace.h)
+//----------------------------------------------------------------------
+
+void
+Trace::Record(int event, int arg0, int arg1, int arg2)
+{
+    TraceRecord *record = &ring[next];
+
+    record->tick = kernel->stats->totalTicks;
+    record->event = event;
+    record->thread = kernel->currentThread->getID();
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    next = (next + 1) % TraceRecords;
+    numRecorded++;
+}
+
+//----------------------------------------------------------------------
+// Trace::Write
+// 	Write the events kept to the UNIX file "fileName", oldest first,
+//	after a TraceHeader.
+//----------------------------------------------------------------------
+
+void
+Trace::Write(char *fileName)
+{
+    int fd = OpenForWrite(fileName);
+    TraceHeader header;
+    int first;
+
+    header.magic = TraceMagic;
+    header.recordSize = sizeof(TraceRecord);
+    header.numRecords = min(numRecorded, (unsigned int) TraceRecords);
+    header.numLost = numRecorded - header.numRecords;
+    WriteFile(fd, (char *) &header, sizeof(header));
+
+    first = (header.numLost > 0) ? next : 0;	// the oldest
+    if (first + header.numRecords > TraceRecords) {
+	WriteFile(fd, (char *) &ring[first],
+		  (TraceRecords - first) * sizeof(TraceRecord));
+	WriteFile(fd, (char *) ring, next * sizeof(TraceRecord));
+    } else {
+	WriteFile(fd, (char *) &ring[first],
+		  header.numRecords * sizeof(TraceRecord));
+    }
+    Close(fd);
+}
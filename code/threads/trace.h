@@ -0,0 +1,98 @@
+// trace.h
+//	Data structures for tracing kernel events cheaply enough to leave
+//	on: each event is a fixed-size binary record, put in a ring of
+//	the most recent TraceRecords of them, and written out to a UNIX
+//	file when Nachos halts (-trace).  Recording one takes no
+//	simulated time, so a trace does not change how a run goes.
+//
+//	Events are recorded by category, named by the debugging flags
+//	of debug.h:
+//		t -- context switches
+//		u -- system calls, as they start and finish
+//		d -- disk requests, and their completion
+//		a -- page faults and copy-on-write faults
+//		i -- interrupts, as their handlers are called
+//		+ -- all of the above
+//
+//	The file is a TraceHeader, followed by the records kept, oldest
+//	first, as laid out in memory (the host's byte order).  The
+//	trace2json program turns it into the JSON of Chrome's trace
+//	viewer; it has its own copy of the layout, to be kept in step.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+#define TraceRecords	65536	// events kept; older ones are lost
+#define TraceMagic	0x4e545243	// "NTRC", at the start of the file
+
+// The kinds of event, and what each record's "args" hold.
+
+enum TraceEvent {
+    TraceSwitch = 1,		// old thread's ID, new thread's ID
+    TraceSyscall,		// system call code
+    TraceSyscallDone,		// system call code, result
+    TraceDiskRead,		// disk, first sector, number of sectors
+    TraceDiskWrite,		// disk, first sector, number of sectors
+    TraceDiskDone,		// disk
+    TracePageFault,		// virtual address, 1 if a copy-on-write
+    TraceInterrupt		// IntType of the handler called
+};
+
+// The following class defines one event recorded.
+
+class TraceRecord {
+  public:
+    int tick;			// the simulated time of the event
+    int event;			// a TraceEvent
+    int thread;			// ID of the thread running at the time
+    int args[3];		// as above for each event; unused ones are 0
+};
+
+// The following class defines the start of a trace file.
+
+class TraceHeader {
+  public:
+    int magic;			// TraceMagic
+    int recordSize;		// sizeof(TraceRecord)
+    int numRecords;		// records that follow
+    int numLost;		// older records that did not fit
+};
+
+// The following class defines the ring of events.
+
+class Trace {
+  public:
+    Trace(char *categories);	// record the events of "categories"
+    ~Trace();
+
+    bool IsEnabled(char category) { return enabled[category & 0x7f]; }
+				// are events of "category" recorded?
+    void Record(int event, int arg0 = 0, int arg1 = 0, int arg2 = 0);
+				// record an event, of a category that is
+				// enabled
+
+    void Write(char *fileName);	// write the ring to a UNIX file
+
+  private:
+    TraceRecord *ring;		// the events, TraceRecords of them
+    int next;			// where the next one goes
+    unsigned int numRecorded;	// events recorded so far
+    bool enabled[128];		// by category
+};
+
+// Record an event, if its category is being traced; "args" are those
+// of Record, in parentheses -- ex: TRACE(dbgDisk, (TraceDiskDone, d)).
+// When nothing is traced, a tracepoint costs a test of kernel->trace.
+
+#define TRACE(category, args)						\
+    if (kernel->trace == NULL || !kernel->trace->IsEnabled(category)) {} \
+    else kernel->trace->Record args
+
+#endif // TRACE_H
@@ -0,0 +1,187 @@
+// workpool.cc
+//	Routines for a pool of kernel worker threads, and for the
+//	completions that tell when their work is done.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "workpool.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Completion::Completion
+// 	Initialize a completion, for work that is not done yet.
+//----------------------------------------------------------------------
+
+Completion::Completion()
+{
+    signal = new Semaphore("completion", 0);
+    result = 0;
+    done = FALSE;
+}
+
+Completion::~Completion()
+{
+    delete signal;
+}
+
+//----------------------------------------------------------------------
+// Completion::Finish
+// 	Record that the work is done, with "result", and let whoever
+//	waits for it go on.
+//----------------------------------------------------------------------
+
+void
+Completion::Finish(int result)
+{
+    ASSERT(!done);
+    this->result = result;
+    done = TRUE;
+    signal->V();
+}
+
+//----------------------------------------------------------------------
+// Completion::Wait
+// 	Return the result of the work, once it is done.  Any number of
+//	threads may wait, any number of times: each passes the signal on.
+//----------------------------------------------------------------------
+
+int
+Completion::Wait()
+{
+    signal->P();
+    signal->V();
+    return result;
+}
+
+//----------------------------------------------------------------------
+// WorkerThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the work loop of the pool.
+//----------------------------------------------------------------------
+
+static void
+WorkerThread(WorkerPool *pool)
+{
+    pool->Work();
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::WorkerPool
+// 	Make an empty queue, and fork the workers that take from it.
+//
+//	"debugName" -- names the pool and its threads, for debugging
+//	"numWorkers" -- how many threads do the work
+//	"queueSize" -- how many pieces of work may wait for them
+//----------------------------------------------------------------------
+
+WorkerPool::WorkerPool(char *debugName, int numWorkers, int queueSize)
+{
+    ASSERT(numWorkers > 0 && queueSize > 0);
+    name = debugName;
+    this->numWorkers = numWorkers;
+    queue = new SynchList<WorkItem *>;
+    slots = new Semaphore(debugName, queueSize);
+    stopped = new Semaphore(debugName, 0);
+    for (int i = 0; i < numWorkers; i++) {
+	Thread *worker = new Thread(debugName, -1);
+
+	worker->Fork((VoidFunctionPtr) WorkerThread, (void *) this);
+    }
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::~WorkerPool
+// 	Queue a stop for each worker, behind the work already queued,
+//	and wait for all of them to stop before freeing the queue.
+//----------------------------------------------------------------------
+
+WorkerPool::~WorkerPool()
+{
+    for (int i = 0; i < numWorkers; i++)
+	Submit(NULL, NULL);
+    for (int i = 0; i < numWorkers; i++)
+	stopped->P();
+    delete queue;
+    delete slots;
+    delete stopped;
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::Submit
+// 	Queue "func" to be called with "arg" by the next free worker, and
+//	return, waiting only if the queue is full.  If "completion" is
+//	not NULL, it is finished with the value "func" returns.
+//----------------------------------------------------------------------
+
+void
+WorkerPool::Submit(WorkFunction func, void *arg, Completion *completion)
+{
+    WorkItem *item = new WorkItem;
+
+    item->func = func;
+    item->arg = arg;
+    item->completion = completion;
+    slots->P();
+    queue->Append(item);
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::Work
+// 	Loop, doing the work queued in order, until told to stop.
+//----------------------------------------------------------------------
+
+void
+WorkerPool::Work()
+{
+    for (;;) {
+	WorkItem *item = queue->RemoveFront();
+	int result;
+
+	slots->V();
+	if (item->func == NULL) {
+	    delete item;
+	    stopped->V();
+	    return;
+	}
+	DEBUG(dbgThread, "Worker " << name << " starting work");
+	result = (*item->func)(item->arg);
+	if (item->completion != NULL)
+	    item->completion->Finish(result);
+	delete item;
+    }
+}
+
+//----------------------------------------------------------------------
+// WorkTestSquare, WorkerPool::SelfTest
+// 	Queue more work than the queue holds, from work that yields in
+//	the middle, and check that each piece gets its own result.
+//----------------------------------------------------------------------
+
+static int
+WorkTestSquare(void *arg)
+{
+    int n = (int) (long) arg;
+
+    kernel->currentThread->Yield();	// let the other worker run
+    return n * n;
+}
+
+void
+WorkerPool::SelfTest()
+{
+    const int NumTests = 6;
+    Completion *completions[NumTests];
+
+    for (int i = 0; i < NumTests; i++) {
+	completions[i] = new Completion();
+	Submit(WorkTestSquare, (void *) (long) i, completions[i]);
+    }
+    for (int i = NumTests - 1; i >= 0; i--) {
+	ASSERT(completions[i]->Wait() == i * i);
+	ASSERT(completions[i]->IsDone() && completions[i]->Wait() == i * i);
+	delete completions[i];
+    }
+}
@@ -0,0 +1,82 @@
+// workpool.h
+//	Data structures for a pool of kernel worker threads.
+//
+//	Kernel services that want work done in the background -- without
+//	the caller waiting, or with the caller waiting only later -- can
+//	hand it to a pool instead of forking a thread of their own for
+//	it.  The pool's threads are forked once, when it is made, and
+//	take work from a bounded queue, in order, for as long as the pool
+//	lasts.
+//
+//	Whoever submits work may give a Completion with it, to learn when
+//	the work is done and what it returned.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include "copyright.h"
+#include "synch.h"
+#include "synchlist.h"
+
+typedef int (*WorkFunction)(void *arg);
+				// a piece of work, and its result
+
+// The following class defines a completion: the promise of a result,
+// once some piece of work is done.
+
+class Completion {
+  public:
+    Completion();		// The work is not done yet
+    ~Completion();
+
+    void Finish(int result);	// The work is done, and gave "result"
+    int Wait();			// Wait until the work is done; its result
+    bool IsDone() { return done; }
+
+  private:
+    Semaphore *signal;		// Up once the work is done
+    int result;
+    bool done;
+};
+
+// A piece of work waiting for a worker.
+
+class WorkItem {
+  public:
+    WorkFunction func;		// NULL tells a worker to stop
+    void *arg;
+    Completion *completion;	// NULL if no one waits for it
+};
+
+// The following class defines a pool of worker threads.
+
+class WorkerPool {
+  public:
+    WorkerPool(char *debugName, int numWorkers, int queueSize);
+				// Fork "numWorkers" threads, taking work
+				// from a queue of up to "queueSize"
+    ~WorkerPool();		// Stop the workers, once the work queued
+				// is done
+    
+    void Submit(WorkFunction func, void *arg,
+		Completion *completion = NULL);
+				// Queue (*func)(arg), and return without
+				// waiting for it -- unless the queue is
+				// full, until there is room
+    void Work();		// Body of a worker thread
+
+    void SelfTest();		// Test the pool
+
+  private:
+    char *name;			// For debugging
+    int numWorkers;
+    SynchList<WorkItem *> *queue;	// Work not yet taken
+    Semaphore *slots;		// Room left in the queue
+    Semaphore *stopped;		// Up once for each worker that stopped
+};
+
+#endif // WORKPOOL_H
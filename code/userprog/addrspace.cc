@@ -20,6 +20,13 @@
 #include "addrspace.h"
 #include "machine.h"
 #include "noff.h"
+#include "ring.h"
+#include "frames.h"
+#include "swap.h"
+#include "swapper.h"
+#include "tlb.h"
+#include "synch.h"
+#include "remotefs.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -59,45 +66,1466 @@ SwapHeader (NoffHeader *noffH)
 
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
-// 	Create an address space to run a user program.
-//	Set up the translation from program memory to physical 
-//	memory.  For now, this is really simple (1:1), since we are
-//	only uniprogramming, and we have a single unsegmented page table
+// 	Create an empty address space to run a user program.  It gets
+//	its memory when the program is loaded into it.
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace()
 {
-    pageTable = new TranslationEntry[NumPhysPages];
-    for (int i = 0; i < NumPhysPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virt page # = phys page #
-	pageTable[i].physicalPage = i;
-	pageTable[i].valid = TRUE;
-	pageTable[i].use = FALSE;
-	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  
-    }
-    
-    // zero out the entire address space
-    bzero(kernel->machine->mainMemory, MemorySize);
+    pageTable = NULL;
+    numPages = 0;
+    tableSize = 0;
+    swapSlot = NULL;
+    onSwap = NULL;
+    executable = NULL;
+    programName = NULL;
+    sharedFile = -1;
+    imageOffset = -1;
+    for (int i = 0; i < MaxOpenFiles; i++)
+	openFiles[i] = NULL;
+    for (int i = 0; i < MaxPipeEnds; i++)
+	pipeEnds[i] = NULL;
+    console[SysConsoleInput] = console[SysConsoleOutput] = NULL;
+    for (int i = 0; i < MaxMappings; i++)
+	maps[i].file = NULL;
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	holds[i].segment = -1;
+    for (int i = 0; i < MaxUserThreads; i++)
+	threads[i].exited = NULL;
+    numThreads = 0;
+    breakAddr = 0;
+    heapPages = 0;
+    id = 0;
+    ring = NULL;
+    lastSample = 0;
+    userTicks = 0;
+    userSeen = kernel->stats->userTicks;
+    workingSet = 0;
+    swappedOut = FALSE;
+    swappedAt = kernel->stats->totalTicks;
+    swappedPages = new List<int>;
+    swappedIn = new Condition("swapped in");
+    restoredRegisters = NULL;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.
+// 	Dealloate an address space, closing the files and pipe ends the
+//	program left open, dropping its system call ring, and giving back its
+//	physical pages.  Must be called by a thread, since freeing the
+//	pages waits for any paging going on to end.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
+   for (int i = 0; i < MaxOpenFiles; i++)
+	if (openFiles[i] != NULL)
+	    delete openFiles[i];
+   for (int i = 0; i < MaxPipeEnds; i++)
+	delete pipeEnds[i];
+   delete console[SysConsoleInput];
+   delete console[SysConsoleOutput];
+   if (kernel->remoteFiles != NULL)
+	kernel->remoteFiles->CloseAll(this);
+   delete ring;
+   if (kernel->swapper != NULL)
+	kernel->swapper->Forget(this);
+   FreePages();
+   delete swappedPages;
+   delete swappedIn;
+   for (int i = 0; i < MaxUserThreads; i++)
+	delete threads[i].exited;
+   delete executable;
+   delete [] programName;
+   delete [] restoredRegisters;
+   kernel->scheduler->Forget(this);
+   kernel->stats->memoryUsage.Add(&usage);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReservePages
+// 	Give the address space "count" pages, each with its slot in the
+//	swap area, but with none of them loaded: each is loaded, into a
+//	zeroed frame, the first time it is touched.  The page table also
+//	has the map window after them, which needs no swap: mapped pages
+//	are written back to their files.  (Thread stacks put there get
+//	slots of their own as they are.)  Return FALSE, having reserved
+//	nothing, if the swap area is too full.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::ReservePages(int count)
+{
+    int size = count + divRoundUp(MapWindowSize, PageSize);
+    int *slots = new int[size];
+
+    if (!kernel->swapSpace->Allocate(count, slots)) {
+	delete [] slots;
+	return FALSE;
+    }
+    numPages = count;
+    tableSize = size;
+    breakAddr = count * PageSize;
+    pageTable = new PageTable(kernel->machine->pageTableKind, tableSize);
+    swapSlot = slots;
+    onSwap = new bool[tableSize];
+    for (unsigned int i = count; i < tableSize; i++)
+	swapSlot[i] = -1;
+    for (unsigned int i = 0; i < tableSize; i++)
+	onSwap[i] = FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FreePages
+// 	Let go of the shared memory segments the program holds, and
+//	write back and unmap the files still mapped, and free the heap and
+//	any thread stacks left; then give back the frames of the pages that are
+//	loaded -- last first, so that the next program takes them in
+//	order -- and the swap slots of all of them.  Some other program may be paging one of them out just now,
+//	so wait for that to end.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FreePages()
+{
+    Lock *pagingLock = kernel->frameAllocator->PagingLock();
+
+    if (pageTable == NULL)
+	return;
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	if (holds[i].segment >= 0)
+	    DropSegment(&holds[i]);
+    pagingLock->Acquire();
+    for (int i = 0; i < MaxMappings; i++)
+	if (maps[i].file != NULL)
+	    UnmapPages(&maps[i]);
+    FreeWindowPages(numPages, heapPages);
+    heapPages = 0;
+    for (int i = 0; i < MaxUserThreads; i++)
+	if (threads[i].exited != NULL && threads[i].firstPage >= 0) {
+	    FreeWindowPages(threads[i].firstPage,
+			    divRoundUp(UserStackSize, PageSize));
+	    threads[i].firstPage = -1;
+	}
+    for (int i = (int) numPages - 1; i >= 0; i--) {
+	TranslationEntry *pte = pageTable->Lookup(i);
+
+	if (pte != NULL && pte->valid &&
+		kernel->frameAllocator->IsShared(pte->physicalPage))
+	    kernel->frameAllocator->Unshare(pte->physicalPage, pte);
+	else if (pte != NULL && pte->valid)
+	    kernel->frameAllocator->Free(pte->physicalPage);
+	kernel->swapSpace->Free(swapSlot[i]);
+    }
+    pagingLock->Release();
+    for (int i = 0; i < MaxMappings; i++) {
+	delete maps[i].file;
+	maps[i].file = NULL;
+    }
+    if (kernel->tlbManager != NULL)
+	kernel->tlbManager->Forget(pageTable);
+    delete pageTable;
+    delete [] swapSlot;
+    delete [] onSwap;
+    pageTable = NULL;
+    swapSlot = NULL;
+    onSwap = NULL;
+    numPages = 0;
+    tableSize = 0;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddFile
+// 	Enter an open file in the program's table of open files, and
+//	return the id the program names it by: the lowest one free,
+//	past the console's.  Return -1 if the table is full.
+//
+//	"file" -- the file the program opened
+//----------------------------------------------------------------------
+
+OpenFileId
+AddrSpace::AddFile(OpenFile *file)
+{
+    for (int i = SysConsoleOutput + 1; i < MaxOpenFiles; i++)
+	if (openFiles[i] == NULL) {
+	    openFiles[i] = file;
+	    return i;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::GetFile
+// 	Return the open file the program names by "id", or NULL if "id"
+//	is not one of its open files.
+//----------------------------------------------------------------------
+
+OpenFile *
+AddrSpace::GetFile(OpenFileId id)
+{
+    if (id <= SysConsoleOutput || id >= MaxOpenFiles)
+	return NULL;
+    return openFiles[id];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RemoveFile
+// 	Take "id" out of the program's table of open files, so that it
+//	can be given out again, and return the file it named (NULL if
+//	it named none).  Closing the file is up to the caller.
+//----------------------------------------------------------------------
+
+OpenFile *
+AddrSpace::RemoveFile(OpenFileId id)
+{
+    OpenFile *file = GetFile(id);
+
+    if (file != NULL)
+	openFiles[id] = NULL;
+    return file;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddPipeEnd
+// 	Enter a pipe end in the program's table of them, and return the
+//	id the program names it by: the lowest one free, from PipeIdBase.
+//	Return -1 if the table is full.
+//----------------------------------------------------------------------
+
+OpenFileId
+AddrSpace::AddPipeEnd(PipeEnd *end)
+{
+    for (int i = 0; i < MaxPipeEnds; i++)
+	if (pipeEnds[i] == NULL) {
+	    pipeEnds[i] = end;
+	    return PipeIdBase + i;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::GetPipeEnd
+// 	Return the pipe end the program names by "id" -- one of its pipe
+//	ids, or the console's, once redirected -- or NULL if none.
+//----------------------------------------------------------------------
+
+PipeEnd *
+AddrSpace::GetPipeEnd(OpenFileId id)
+{
+    if (id == SysConsoleInput || id == SysConsoleOutput)
+	return console[id];
+    if (id < PipeIdBase || id >= PipeIdBase + MaxPipeEnds)
+	return NULL;
+    return pipeEnds[id - PipeIdBase];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RemovePipeEnd
+// 	Free "id", and return the pipe end it named (NULL if none).  A
+//	redirected console id goes back to the console.  Closing the end
+//	is up to the caller.
+//----------------------------------------------------------------------
+
+PipeEnd *
+AddrSpace::RemovePipeEnd(OpenFileId id)
+{
+    PipeEnd *end = GetPipeEnd(id);
+
+    if (end == NULL)
+	return NULL;
+    if (id == SysConsoleInput || id == SysConsoleOutput)
+	console[id] = NULL;
+    else
+	pipeEnds[id - PipeIdBase] = NULL;
+    return end;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Redirect
+// 	Have the console's input or output id, "id", name the pipe end
+//	"end" from now on; ExecWith does this before the program starts.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Redirect(OpenFileId id, PipeEnd *end)
+{
+    ASSERT((id == SysConsoleInput || id == SysConsoleOutput) &&
+	   console[id] == NULL);
+    console[id] = end;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Map
+// 	Map the open file "file" into the map window, at the highest pages
+//	free for the whole of it, and return the address of its first
+//	byte.  Nothing is read yet: each page is read from the file the
+//	first time it is touched, unless some frame of the page cache
+//	holds it already.  The mapping opens the file again for itself,
+//	so the program may close "file" meanwhile.
+//
+//	Return -1 if the file is empty, or the program has MaxMappings
+//	files mapped already, or there are not enough free pages left in
+//	the window.  With the stub file system, files cannot be mapped.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Map(OpenFile *file)
+{
+#ifdef FILESYS_STUB
+    return -1;
+#else
+    MappedFile *map = NULL;
+    int length = file->Length();
+    int count = divRoundUp(length, PageSize);
+    int first;
+
+    for (int i = 0; i < MaxMappings; i++)
+	if (maps[i].file == NULL) {
+	    map = &maps[i];
+	    break;
+	}
+    if (map == NULL || count == 0)
+	return -1;
+    first = FindRoom(count);
+    if (first < 0)
+	return -1;
+    map->file = new OpenFile(file->HeaderSector());
+    map->sector = file->HeaderSector();
+    map->firstPage = first;
+    map->numPages = count;
+    map->length = length;
+    DEBUG(dbgAddr, "Mapping " << length << " bytes at virtual page "
+	  << first);
+    return first * PageSize;
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unmap
+// 	Write back the pages written to of the file mapped at "vaddr",
+//	and unmap it.  Return FALSE if no file is mapped at "vaddr".
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Unmap(int vaddr)
+{
+    Lock *pagingLock = kernel->frameAllocator->PagingLock();
+    MappedFile *map = NULL;
+
+    for (int i = 0; i < MaxMappings; i++)
+	if (maps[i].file != NULL && maps[i].firstPage * PageSize == vaddr)
+	    map = &maps[i];
+    if (map == NULL)
+	return FALSE;
+    pagingLock->Acquire();
+    UnmapPages(map);
+    pagingLock->Release();
+    delete map->file;
+    map->file = NULL;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UnmapPages
+// 	Write back the pages of "map" that are loaded and were written
+//	to, and unshare the frames of all that are loaded, with the
+//	paging lock held; the frames stay in the page cache for the other
+//	programs mapping the file, and the file's readers.  The TLB is
+//	flushed first, as it may have the dirty bits, and should not keep
+//	the translations.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::UnmapPages(MappedFile *map)
+{
+    char *mem = kernel->machine->mainMemory;
+
+    if (kernel->tlbManager != NULL)
+	kernel->tlbManager->Flush();
+    for (int vpn = map->firstPage + map->numPages - 1;
+	    vpn >= map->firstPage; vpn--) {
+	TranslationEntry *pte = pageTable->Lookup(vpn);
+
+	if (pte == NULL || !pte->valid)
+	    continue;
+	if (pte->dirty) {
+	    usage.writeBacks++;
+	    MapIO(vpn, &mem[pte->physicalPage * PageSize], TRUE);
+	    pte->dirty = FALSE;
+	}
+	kernel->frameAllocator->Unshare(pte->physicalPage, pte);
+	pte->valid = FALSE;
+	pte->physicalPage = -1;
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MappingOf
+// 	Return the mapped file that virtual page "vpn" is in, or NULL if
+//	it is in none.
+//----------------------------------------------------------------------
+
+MappedFile *
+AddrSpace::MappingOf(int vpn)
+{
+    for (int i = 0; i < MaxMappings; i++)
+	if (maps[i].file != NULL && vpn >= maps[i].firstPage &&
+		vpn < maps[i].firstPage + maps[i].numPages)
+	    return &maps[i];
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::InTheWay
+// 	Return the page just past the heap, mapped file, attached segment,
+//	or thread stack that has any of the "count" pages from "first" --
+//	the first one found -- or -1 if none of them is mapped.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::InTheWay(int first, int count)
+{
+    if (heapPages > 0 && first < (int) numPages + heapPages &&
+	    (int) numPages < first + count)
+	return numPages + heapPages;
+    for (int i = 0; i < MaxMappings; i++)
+	if (maps[i].file != NULL && first < maps[i].firstPage +
+		maps[i].numPages && maps[i].firstPage < first + count)
+	    return maps[i].firstPage + maps[i].numPages;
+    for (int i = 0; i < MaxSegmentHolds; i++) {
+	int pages = kernel->sharedMemory->NumPages(holds[i].segment);
+
+	if (holds[i].segment >= 0 && holds[i].firstPage >= 0 &&
+		first < holds[i].firstPage + pages &&
+		holds[i].firstPage < first + count)
+	    return holds[i].firstPage + pages;
+    }
+    for (int i = 0; i < MaxUserThreads; i++) {
+	int pages = divRoundUp(UserStackSize, PageSize);
+
+	if (threads[i].exited != NULL && threads[i].firstPage >= 0 &&
+		first < threads[i].firstPage + pages &&
+		threads[i].firstPage < first + count)
+	    return threads[i].firstPage + pages;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FindRoom
+// 	Return the first of the highest "count" pages of the map window
+//	that nothing is mapped at, or -1 if there is no such run.  The
+//	top is taken first, to leave the heap room to grow.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::FindRoom(int count)
+{
+    for (int first = tableSize - count; first >= (int) numPages; first--)
+	if (InTheWay(first, count) < 0)
+	    return first;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::HoldSegment
+// 	Keep the hold the creator of the new shared memory segment "id"
+//	has on it, till the program lets it go by exiting.  Return FALSE
+//	if the program holds too many segments already.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::HoldSegment(int id)
+{
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	if (holds[i].segment < 0) {
+	    holds[i].segment = id;
+	    holds[i].firstPage = -1;
+	    return TRUE;
+	}
+    return FALSE;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::Attach
+// 	Map the pages of shared memory segment "id" to its frames, in the
+//	map window: at "vaddr", which must be the start of a page there,
+//	or at the highest pages free for the whole of it if "vaddr" is 0.
+//	They are loaded from the start, and never taken back, so the
+//	program never faults on them.  Return the address of the
+//	segment's first byte.
+//
+//	Return -1 if there is no segment "id", or the program holds too
+//	many segments already, or the segment does not fit at "vaddr",
+//	or anywhere, if "vaddr" is 0.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Attach(int id, int vaddr)
+{
+    SharedMemory *shm = kernel->sharedMemory;
+    int count = shm->NumPages(id);
+    int first = vaddr / PageSize;
+    SegmentHold *hold = NULL;
+
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	if (holds[i].segment < 0) {
+	    hold = &holds[i];
+	    break;
+	}
+    if (hold == NULL || count == 0 || vaddr < 0 || vaddr % PageSize != 0)
+	return -1;
+    if (vaddr == 0)
+	first = FindRoom(count);
+    else if (first < (int) numPages || first + count > (int) tableSize ||
+	    InTheWay(first, count) >= 0)
+	first = -1;
+    if (first < 0)
+	return -1;
+    shm->Hold(id);
+    hold->segment = id;
+    hold->firstPage = first;
+    for (int i = 0; i < count; i++) {
+	TranslationEntry *pte = pageTable->Entry(first + i);
+
+	pte->physicalPage = shm->Frame(id, i);
+	pte->readOnly = FALSE;
+	pte->use = FALSE;
+	pte->referenced = FALSE;
+	pte->dirty = FALSE;
+	pte->valid = TRUE;
+    }
+    DEBUG(dbgAddr, "Attaching shared segment " << id << " at virtual page "
+	  << first);
+    return first * PageSize;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Detach
+// 	Unmap the shared memory segment attached at "vaddr", as Attach
+//	returned it.  Return FALSE if no segment is attached there.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Detach(int vaddr)
+{
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	if (holds[i].segment >= 0 && holds[i].firstPage >= 0 &&
+		holds[i].firstPage * PageSize == vaddr) {
+	    DropSegment(&holds[i]);
+	    return TRUE;
+	}
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AttachmentOf
+// 	Return the attachment of the shared memory segment that virtual
+//	page "vpn" is in, or NULL if it is in none.
+//----------------------------------------------------------------------
+
+SegmentHold *
+AddrSpace::AttachmentOf(int vpn)
+{
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	if (holds[i].segment >= 0 && holds[i].firstPage >= 0 &&
+		vpn >= holds[i].firstPage && vpn < holds[i].firstPage +
+		kernel->sharedMemory->NumPages(holds[i].segment))
+	    return &holds[i];
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::DropSegment
+// 	Let go of "hold": unmap the segment's pages, if it is attached,
+//	and give up the hold, which frees the segment if it was the last.
+//	The TLB is flushed first, so it keeps no translation to the
+//	segment's frames.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::DropSegment(SegmentHold *hold)
+{
+    SharedMemory *shm = kernel->sharedMemory;
+
+    if (hold->firstPage >= 0) {
+	if (kernel->tlbManager != NULL)
+	    kernel->tlbManager->Flush();
+	for (int i = 0; i < shm->NumPages(hold->segment); i++) {
+	    TranslationEntry *pte = pageTable->Entry(hold->firstPage + i);
+
+	    pte->valid = FALSE;
+	    pte->physicalPage = -1;
+	}
+    }
+    DEBUG(dbgAddr, "Letting go of shared segment " << hold->segment);
+    shm->Release(hold->segment);
+    hold->segment = -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddThread
+// 	Give "thread", a new thread of the program, the lowest free slot
+//	after the first, and a stack of UserStackSize bytes at the highest
+//	pages free for it in the map window, with swap slots for them.
+//	It is to start at "root", which calls "func" with "arg" (see
+//	ThreadFork in start.S).  Return its ThreadId.
+//
+//	Return -1 if the program has too many threads already, or there
+//	is no room for the stack in the window, or in swap.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::AddThread(Thread *thread, int func, int arg, int root)
+{
+    int count = divRoundUp(UserStackSize, PageSize);
+    UserThread *t = NULL;
+    int tid, first;
+
+    for (tid = 1; tid < MaxUserThreads; tid++)
+	if (threads[tid].exited == NULL) {
+	    t = &threads[tid];
+	    break;
+	}
+    if (t == NULL || (first = FindRoom(count)) < 0 ||
+	    !kernel->swapSpace->Allocate(count, &swapSlot[first]))
+	return -1;
+    t->thread = thread;
+    t->firstPage = first;
+    t->root = root;
+    t->func = func;
+    t->arg = arg;
+    t->status = 0;
+    t->joining = FALSE;
+    t->exited = new Semaphore("thread exit", 0);
+    numThreads++;
+    DEBUG(dbgAddr, "Thread " << tid << " gets its stack at virtual page "
+	  << first);
+    return tid;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ExecuteThread
+// 	Run the running thread, added by AddThread, in user mode: from
+//	its root, with "func" and "arg" as its arguments, and the stack
+//	pointer at the top of its own stack.  Never returns; the thread
+//	ends by ThreadExit, or Exit.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ExecuteThread()
+{
+    Machine *machine = kernel->machine;
+    UserThread *t = NULL;
+    int top;
+
+    for (int i = 1; i < MaxUserThreads; i++)
+	if (threads[i].exited != NULL &&
+		threads[i].thread == kernel->currentThread)
+	    t = &threads[i];
+    ASSERT(t != NULL);
+    top = (t->firstPage + divRoundUp(UserStackSize, PageSize)) * PageSize;
+
+    kernel->scheduler->LoadUserState(kernel->currentThread);
+    for (int i = 0; i < NumTotalRegs; i++)
+	machine->WriteRegister(i, 0);
+    machine->WriteRegister(PCReg, t->root);
+    machine->WriteRegister(NextPCReg, t->root + 4);
+    machine->WriteRegister(4, t->func);
+    machine->WriteRegister(5, t->arg);
+    machine->WriteRegister(StackReg, top - 16);
+
+    machine->Run();
+    ASSERTNOTREACHED();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::JoinThread
+// 	Wait until the program's thread "id" has exited, and return the
+//	status it passed to ThreadExit; its slot is then free.  Return -1
+//	if there is no such thread, or it is the running thread, or some
+//	other thread is joining it already.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::JoinThread(ThreadId id)
+{
+    UserThread *t;
+    int status;
+
+    if (id < 0 || id >= MaxUserThreads)
+	return -1;
+    t = &threads[id];
+    if (t->exited == NULL || t->joining ||
+	    t->thread == kernel->currentThread)
+	return -1;
+    t->joining = TRUE;
+    if (t->thread != NULL)		// not exited yet
+	t->exited->P();
+    status = t->status;
+    delete t->exited;
+    t->exited = NULL;
+    return status;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::EndThread
+// 	The running thread of the program is exiting with "status": give
+//	back its stack, if it is in the window, and wake whoever is
+//	joining it (one that joins later finds it gone).  Return how many of the program's threads are left;
+//	once none is, the program itself is done.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::EndThread(int status)
+{
+    Lock *pagingLock = kernel->frameAllocator->PagingLock();
+    UserThread *t = NULL;
+
+    for (int i = 0; i < MaxUserThreads; i++)
+	if (threads[i].exited != NULL &&
+		threads[i].thread == kernel->currentThread)
+	    t = &threads[i];
+    ASSERT(t != NULL);
+    if (t->firstPage >= 0) {
+	pagingLock->Acquire();
+	FreeWindowPages(t->firstPage, divRoundUp(UserStackSize, PageSize));
+	pagingLock->Release();
+	t->firstPage = -1;
+    }
+    t->thread = NULL;
+    t->status = status;
+    if (t->joining)
+	t->exited->V();
+    return --numThreads;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Sbrk
+// 	Move the end of the program's heap by "increment" bytes, up or
+//	down, and return where it was.  The heap starts, empty, at the
+//	bottom of the map window; the pages it grows over get swap slots,
+//	but no frames till they are touched, when they are zero-filled as
+//	the uninitialized data is.  Those it shrinks off are given back.
+//
+//	Return -1, moving nothing, if it would end below its start, or
+//	past the window, or something mapped is in the way, or there is
+//	no room in swap.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Sbrk(int increment)
+{
+    Lock *pagingLock = kernel->frameAllocator->PagingLock();
+    int start = numPages * PageSize;
+    int old = breakAddr;
+    int pages, more;
+
+    if (increment < start - breakAddr ||
+	    increment > (int) tableSize * PageSize - breakAddr)
+	return -1;
+    pages = divRoundUp(breakAddr + increment - start, PageSize);
+    more = pages - heapPages;
+    if (more > 0 && (InTheWay(numPages + heapPages, more) >= 0 ||
+	    !kernel->swapSpace->Allocate(more, &swapSlot[numPages + heapPages])))
+	return -1;
+    if (more < 0) {
+	pagingLock->Acquire();
+	FreeWindowPages(numPages + pages, -more);
+	pagingLock->Release();
+    }
+    heapPages = pages;
+    breakAddr += increment;
+    DEBUG(dbgAddr, "Heap ends at " << breakAddr << ", " << heapPages
+	  << " pages");
+    return old;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FreeWindowPages
+// 	Give back the frames of the "count" pages of the window from
+//	"first" that are loaded -- the pages of a thread's stack, or of the
+//	heap -- and the swap slots of all of them, with the paging lock
+//	held.  The TLB may have some of them, so it goes first.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FreeWindowPages(int first, int count)
+{
+    if (count > 0 && kernel->tlbManager != NULL)
+	kernel->tlbManager->Flush();
+    for (int vpn = first + count - 1; vpn >= first; vpn--) {
+	TranslationEntry *pte = pageTable->Lookup(vpn);
+
+	kernel->swapSpace->Free(swapSlot[vpn]);
+	swapSlot[vpn] = -1;
+	onSwap[vpn] = FALSE;
+	if (pte == NULL)		// never touched
+	    continue;
+	if (pte->valid &&			// the frame of zeroes
+		kernel->frameAllocator->IsShared(pte->physicalPage))
+	    kernel->frameAllocator->Unshare(pte->physicalPage, pte);
+	else if (pte->valid)
+	    kernel->frameAllocator->Free(pte->physicalPage);
+	pte->valid = FALSE;
+	pte->dirty = FALSE;
+	pte->physicalPage = -1;
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MapIO
+// 	Read mapped page "vpn" from its file into "frame" (zeroed) --
+//	as much of the page as is in the file now, since the frame is
+//	the file's, shared with anyone mapping it -- or write it back from
+//	there, only the bytes that were in the file when it was mapped.
+//	What was written past the end of the file is then zeroed, as the
+//	page cache keeps it for the next to map the file.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::MapIO(int vpn, char *frame, bool writing)
+{
+    MappedFile *map = MappingOf(vpn);
+    int offset = (vpn - map->firstPage) * PageSize;
+    int end;
+
+    if (writing) {
+	DEBUG(dbgAddr, "Writing virtual page " << vpn << " to its file");
+	map->file->WriteAt(frame, min(PageSize, map->length - offset),
+			   offset);
+	end = max(0, map->file->Length() - offset);
+	if (end < PageSize)
+	    bzero(&frame[end], PageSize - end);
+    } else {
+	map->file->ReadPage(frame, PageSize, offset);
+    }
+}
+
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadSegment
+// 	Read the part of "segment" that falls in virtual page "vpn" from
+//	the executable, to the same place in the page's frame, "into".
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadSegment(Segment *segment, int vpn, char *into)
+{
+    int from = max(segment->virtualAddr, vpn * PageSize);
+    int to = min(segment->virtualAddr + segment->size, (vpn + 1) * PageSize);
+
+    if (from < to)
+	executable->ReadPage(&into[from - vpn * PageSize], to - from,
+			     segment->inFileAddr + from - segment->virtualAddr);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadSegments
+// 	Read the parts of the code and data segments that fall in virtual
+//	page "vpn" into its frame, "into".  An executable laid out as
+//	memory is has the whole page in one place, aligned to the page
+//	(and so to the sectors, if the page is a sector or more), which
+//	is read at once; the end of the file, if that is in the page, is
+//	left zero.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadSegments(int vpn, char *into)
+{
+    if (imageOffset >= 0) {
+	if (FileBytes(vpn, FALSE) > 0)
+	    executable->ReadPage(into, PageSize,
+				 imageOffset + vpn * PageSize);
+	return;
+    }
+    LoadSegment(&noffH.code, vpn, into);
+    LoadSegment(&noffH.initData, vpn, into);
+#ifdef RDATA
+    LoadSegment(&noffH.readonlyData, vpn, into);
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FilePage
+// 	Return the page of the executable that virtual page "vpn" is
+//	shared as: the page of the file it is, if the file is laid out as
+//	memory is, so that programs running it and those mapping it
+//	share the same frames; or else a number no page of a file has.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::FilePage(int vpn)
+{
+    if (imageOffset >= 0)
+	return imageOffset / PageSize + vpn;
+    return -1 - vpn;
+}
+
+//----------------------------------------------------------------------
+// SegmentBytes
+// 	How many bytes of "segment" fall in virtual page "vpn"?
+//----------------------------------------------------------------------
+
+static int
+SegmentBytes(Segment *segment, int vpn)
+{
+    int from = max(segment->virtualAddr, vpn * PageSize);
+    int to = min(segment->virtualAddr + segment->size, (vpn + 1) * PageSize);
+
+    return max(to - from, 0);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FileBytes
+// 	Return how many bytes of virtual page "vpn" are read in from the
+//	executable: of any segment, or only of those the program may
+//	write (initialized data), if "writable".
+//----------------------------------------------------------------------
+
+int
+AddrSpace::FileBytes(int vpn, bool writable)
+{
+    int bytes = SegmentBytes(&noffH.initData, vpn);
+
+    if (!writable) {
+	bytes += SegmentBytes(&noffH.code, vpn);
+#ifdef RDATA
+	bytes += SegmentBytes(&noffH.readonlyData, vpn);
+#endif
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Load virtual page "vpn", which the program (or the kernel, on its
+//	behalf) has just touched while it is not in memory -- or, with a
+//	TLB, just has no translation there.  Return FALSE if "vpn" is past
+//	the end of the address space, or is in the map window but nothing
+//	is mapped there, nor is a stack.  A page of an attached segment is
+//	always loaded.  "writing" says if the program is storing to it.
+//
+//	Taking a frame may page out some other page, and reading may
+//	block, so one lock is held around all paging: no one else loads
+//	the same page, or takes back the frame, meanwhile.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn(int vpn, bool writing)
+{
+    Lock *pagingLock = kernel->frameAllocator->PagingLock();
+    TranslationEntry *pte;
+
+    if (vpn < 0 || vpn >= (int) tableSize ||
+	    (vpn >= (int) numPages && swapSlot[vpn] < 0 &&
+	     MappingOf(vpn) == NULL && AttachmentOf(vpn) == NULL))
+	return FALSE;
+    pagingLock->Acquire();
+    while (swappedOut)
+	swappedIn->Wait(pagingLock);
+    pte = pageTable->Lookup(vpn);
+    if (pte == NULL || !pte->valid)
+	LoadPage(vpn, writing);
+    pagingLock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPage
+// 	Load virtual page "vpn", with the paging lock held.  A page that
+//	is read from the executable, and was never written, is shared with
+//	the other programs running the same executable, read-only; if none
+//	holds it yet, it is read into a new shared frame.  Any other page
+//	gets a zeroed frame of its own, and is read back from swap if it
+//	was written there, or else has whatever part of the segments is in
+//	it read in.  Pages of the uninitialized data and the stack are just
+//	left zero.  A page in the map window is mapped, writable, to the
+//	frame of the page cache that holds that page of its file, read in
+//	if none does yet -- or, on the heap or a thread's stack there, is
+//	read from swap or zeroed, as any other.
+//
+//	A page that would just be left zero, and is being read rather
+//	than written ("writing"), is mapped read-only to the frame of
+//	zeroes all such pages share instead, and gets a frame of its own
+//	only once it is written to (see CopyOnWrite).
+//
+//	The fault is counted by what fills the page: swap, code, data, or
+//	zeroes for a stack (the last pages, or in the window) or the
+//	uninitialized data and the heap -- or its file, for a mapped
+//	page.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadPage(int vpn, bool writing)
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    TranslationEntry *pte = pageTable->Entry(vpn);
+    char *mem = kernel->machine->mainMemory;
+    int frame;
+
+    DEBUG(dbgAddr, "Page fault on virtual page " << vpn);
+    usage.maxPageTable = max(usage.maxPageTable, pageTable->Bytes());
+    kernel->stats->numPageFaults++;
+    if (swapSlot[vpn] < 0)
+	usage.faults[MappedFault]++;
+    else if (onSwap[vpn])
+	usage.faults[SwapFault]++;
+    else if (vpn >= (int) numPages + heapPages)
+	usage.faults[StackFault]++;
+    else if (vpn >= (int) numPages)
+	usage.faults[ZeroFault]++;
+    else if (FileBytes(vpn, FALSE) > FileBytes(vpn, TRUE))
+	usage.faults[CodeFault]++;
+    else if (FileBytes(vpn, TRUE) > 0)
+	usage.faults[DataFault]++;
+    else if (vpn >= (int) numPages - divRoundUp(UserStackSize, PageSize))
+	usage.faults[StackFault]++;
+    else
+	usage.faults[ZeroFault]++;
+    if (!writing && swapSlot[vpn] >= 0 && !onSwap[vpn] &&
+	    (vpn >= (int) numPages || FileBytes(vpn, FALSE) == 0)) {
+	frames->Share(frames->ZeroFrame(), pte);
+	return;
+    }
+    if (vpn < (int) numPages && sharedFile >= 0 && !onSwap[vpn] &&
+	    FileBytes(vpn, FALSE) > 0) {
+	frame = frames->FindShared(sharedFile, FilePage(vpn));
+	if (frame < 0) {
+	    frame = frames->AllocateShared(sharedFile, FilePage(vpn));
+	    LoadSegments(vpn, &mem[frame * PageSize]);
+	} else {
+	    DEBUG(dbgAddr, "Sharing frame " << frame);
+	}
+	frames->Share(frame, pte);
+	return;
+    }
+    if (swapSlot[vpn] < 0) {
+	MappedFile *map = MappingOf(vpn);
+
+	frame = frames->FindShared(map->sector, vpn - map->firstPage);
+	if (frame < 0) {
+	    frame = frames->AllocateShared(map->sector, vpn - map->firstPage);
+	    MapIO(vpn, &mem[frame * PageSize], FALSE);
+	} else {
+	    DEBUG(dbgAddr, "Sharing frame " << frame);
+	}
+	frames->Share(frame, pte, TRUE);
+	return;
+    }
+    frame = frames->Allocate(this, pte);
+    if (onSwap[vpn])
+	kernel->swapSpace->ReadPage(swapSlot[vpn], &mem[frame * PageSize]);
+    else if (vpn < (int) numPages)
+	LoadSegments(vpn, &mem[frame * PageSize]);
+    pte->physicalPage = frame;
+    pte->readOnly = FALSE;
+    pte->use = FALSE;
+    pte->referenced = FALSE;
+    pte->dirty = FALSE;
+    pte->valid = TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+// 	The program is writing to virtual page "vpn", which it shares with
+//	others: give it a frame of its own, copied from the shared one, or
+//	just the shared frame if no one else maps it any more.  The page
+//	is then dirty, since the executable no longer has it as it is.  A
+//	page sharing the frame of zeroes needs no copy, as a new frame is
+//	zero already.
+//	Return FALSE if "vpn" is past the end of the address space, or is
+//	wholly code (or read-only data), which the program must not write,
+//	or is in the map window but on no stack or heap.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyOnWrite(int vpn)
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    Lock *pagingLock = frames->PagingLock();
+    char *mem = kernel->machine->mainMemory;
+    TranslationEntry *pte;
+    int shared, frame;
+
+    if (vpn < 0 || vpn >= (int) tableSize ||
+	    (vpn >= (int) numPages && swapSlot[vpn] < 0) ||
+	    FileBytes(vpn, FALSE) - FileBytes(vpn, TRUE) == PageSize)
+	return FALSE;
+    pagingLock->Acquire();
+    pte = pageTable->Entry(vpn);
+    if (!pte->valid)			// taken back meanwhile
+	LoadPage(vpn, TRUE);
+    if (pte->readOnly) {
+	usage.copyOnWrites++;
+	shared = pte->physicalPage;
+	if (frames->NumSharers(shared) == 1) {
+	    frames->MakePrivate(shared, this);
+	} else {
+	    DEBUG(dbgAddr, "Copying shared virtual page " << vpn);
+	    frames->Pin(shared);
+	    frame = frames->Allocate(this, pte);
+	    if (!frames->HoldsZeroes(shared))
+		bcopy(&mem[shared * PageSize], &mem[frame * PageSize],
+		      PageSize);
+	    frames->Unpin(shared);
+	    frames->Unshare(shared, pte);
+	    pte->physicalPage = frame;
+	}
+	pte->readOnly = FALSE;
+	pte->dirty = TRUE;
+	if (kernel->tlbManager != NULL)	// it has the old translation
+	    kernel->tlbManager->Flush();
+    }
+    pagingLock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RefillTLB
+// 	Load the translation of virtual page "vpn", just paged in, into
+//	the TLB, since it was not there when the program touched the page.
+//	Another thread may have run since, as the paging lock was let go,
+//	and taken the page back again; then the program just faults on it
+//	once more.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::RefillTLB(int vpn)
+{
+    usage.tlbMisses++;
+    TranslationEntry *pte = pageTable->Lookup(vpn);
+
+    if (pte != NULL && pte->valid)
+	kernel->tlbManager->Refill(pageTable, vpn);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SampleWorkingSet
+// 	Called on each timer interrupt while the program runs.  Once
+//	it has run WorkingSetWindow user ticks since the last sample, count
+//	its working set -- the pages it touched since then, by their
+//	referenced bits (those in the TLB gathered first), whether they are
+//	still loaded or not -- and clear the bits for the next window.  The
+//	use bits, which the page replacement clears as it likes, are left
+//	alone.  The swapper goes by the samples averaged, the latest
+//	counting most.
+//
+//	The page table then drops the entries of pages neither loaded nor
+//	touched in the window, so its memory follows the resident set --
+//	unless some thread is paging, which may hold an entry that is
+//	being filled in.
+//
+//	The window is of the program's own time, not the machine's, so
+//	that the working set is what the program needs to run, however
+//	long it waits: thrashing, it touches few pages in a window of the
+//	machine's ticks, as it waits for each, but as many as ever in one
+//	of its own.  Its time is the user ticks taken while its address
+//	space is loaded, counted from when it was last (see RestoreState).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SampleWorkingSet()
+{
+    int pages = 0;
+
+    userTicks += kernel->stats->userTicks - userSeen;
+    userSeen = kernel->stats->userTicks;
+    if (userTicks - lastSample < WorkingSetWindow || pageTable == NULL)
+	return;
+    lastSample = userTicks;
+    if (kernel->tlbManager != NULL)
+	kernel->tlbManager->GatherReferenced(pageTable);
+    for (unsigned int i = 0; i < tableSize; i++) {
+	TranslationEntry *pte = pageTable->Lookup(i);
+
+	if (pte != NULL && pte->referenced) {
+	    pages++;
+	    pte->referenced = FALSE;
+	}
+    }
+    if (kernel->frameAllocator->PagingLock()->getHolder() == NULL)
+	pageTable->Trim();		// no one is loading a page
+    usage.workingSetSamples++;
+    usage.workingSetPages += pages;
+    usage.maxWorkingSet = max(usage.maxWorkingSet, pages);
+    if (usage.workingSetSamples == 1)
+	workingSet = pages;
+    else
+	workingSet = (workingSet + pages + 1) / 2;
+    DEBUG(dbgAddr, "Working set of " << pages << " pages");
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Priority
+// 	Return the highest base priority of the program's threads, by
+//	which the swapper ranks it.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Priority()
+{
+    int priority = MinPriority;
+
+    for (int i = 0; i < MaxUserThreads; i++)
+	if (threads[i].exited != NULL && threads[i].thread != NULL)
+	    priority = max(priority, threads[i].thread->getBasePriority());
+    return priority;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SwapOut
+// 	Take the whole program out of memory, for the swapper: its
+//	private pages are paged out, as if each were chosen to replace,
+//	and its shared ones just let go (see FrameAllocator::Unshare).
+//	Pinned pages -- its attached segments, and any buffer the kernel
+//	is moving -- stay.  The pages that go to swap are noted, to be
+//	read back in by SwapIn.
+//
+//	The program is marked swapped out first, so that its threads,
+//	even if they run while the pages are being written, wait at their
+//	next fault.  The paging lock is let go between pages, and the TLB
+//	flushed before each, since a thread may have loaded it meanwhile.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SwapOut()
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    Lock *pagingLock = frames->PagingLock();
+    TranslationEntry *pte;
+    int frame;
+
+    ASSERT(!swappedOut && swappedPages->IsEmpty());
+    pagingLock->Acquire();
+    swappedOut = TRUE;
+    swappedAt = kernel->stats->totalTicks;
+    pagingLock->Release();
+    for (unsigned int vpn = 0; vpn < tableSize; vpn++) {
+	pagingLock->Acquire();
+	pte = pageTable->Lookup(vpn);
+	if (pte != NULL && pte->valid && !frames->Pinned(pte->physicalPage)) {
+	    frame = pte->physicalPage;
+	    if (kernel->tlbManager != NULL)
+		kernel->tlbManager->Flush();
+	    if (frames->IsShared(frame)) {
+		frames->Unshare(frame, pte);
+		pte->valid = FALSE;
+		pte->physicalPage = -1;
+	    } else {
+		frames->Evict(frame);
+		frames->Free(frame);
+		if (onSwap[vpn])
+		    swappedPages->Append(vpn);
+	    }
+	}
+	pagingLock->Release();
+    }
+    DEBUG(dbgAddr, "Swapped out, " << swappedPages->NumInList()
+	  << " pages to read back");
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SwapIn
+// 	Bring the program back into memory, for the swapper: read the
+//	pages it had in memory from swap, before any thread faults on
+//	them, then let its threads run again.  The pages were noted in
+//	order, so pages with consecutive slots are read together, into
+//	frames pinned till they have been read.  Its pages of code, and
+//	the rest, are loaded as they are touched, as before; they may
+//	still be cached.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SwapIn()
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    Lock *pagingLock = frames->PagingLock();
+    char *mem = kernel->machine->mainMemory;
+    int cluster = max(1, min(MaxPageCluster, NumPhysPages / 4));
+    char *into[MaxPageCluster];
+    int pages[MaxPageCluster];
+    int count, vpn, frame;
+    TranslationEntry *pte;
+
+    ASSERT(swappedOut);
+    while (!swappedPages->IsEmpty()) {
+	pagingLock->Acquire();
+	count = 0;
+	while (count < cluster && !swappedPages->IsEmpty()) {
+	    vpn = swappedPages->RemoveFront();
+	    pte = pageTable->Entry(vpn);
+	    if (pte->valid || !onSwap[vpn])
+		continue;		// faulted in by the kernel, or
+					// given up since
+	    if (count > 0 && swapSlot[vpn] != swapSlot[pages[0]] + count) {
+		swappedPages->Prepend(vpn);
+		break;
+	    }
+	    frame = frames->Allocate(this, pte);
+	    frames->Pin(frame);
+	    pages[count] = vpn;
+	    into[count++] = &mem[frame * PageSize];
+	}
+	if (count > 0)
+	    kernel->swapSpace->ReadPages(swapSlot[pages[0]], count, into);
+	for (int i = 0; i < count; i++) {
+	    pte = pageTable->Lookup(pages[i]);
+	    frame = (into[i] - mem) / PageSize;
+	    frames->Unpin(frame);
+	    pte->physicalPage = frame;
+	    pte->readOnly = FALSE;
+	    pte->use = FALSE;
+	    pte->referenced = FALSE;
+	    pte->dirty = FALSE;
+	    pte->valid = TRUE;
+	}
+	kernel->stats->numSwapInPages += count;
+	pagingLock->Release();
+    }
+    pagingLock->Acquire();
+    swappedOut = FALSE;
+    swappedAt = kernel->stats->totalTicks;
+    swappedIn->Broadcast(pagingLock);
+    pagingLock->Release();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageOut
+// 	Take virtual page "vpn" out of memory, its frame being taken back
+//	by the frame allocator (which holds the paging lock).  Only a page
+//	changed since it was loaded is written to its swap slot; any other
+//	can be loaded again as it was before, from swap or the executable.
+//	(A thread's stack in the map window has swap slots, as said; the
+//	pages of mapped files are shared, and go back to their files.)
+//
+//	The page is made invalid first, so that the program faults on it,
+//	and waits, if it runs while the page is being written.  Dirty
+//	neighbours with the next slots go out with it (see WriteCluster).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageOut(int vpn)
+{
+    TranslationEntry *pte = pageTable->Lookup(vpn);
+
+    ASSERT(pte != NULL && pte->valid);
+    usage.evictions++;
+    pte->valid = FALSE;
+    if (pte->dirty)
+	WriteCluster(vpn);
+    pte->physicalPage = -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Clusters
+// 	Can dirty page "vpn", going to swap, take page "next" along with
+//	it?  It can if "next" is in memory, dirty, and not shared or
+//	pinned, and its slot is as far from that of "vpn" as the pages are
+//	apart; so the pages are written in one request.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Clusters(int vpn, int next)
+{
+    TranslationEntry *pte;
+
+    if (next < 0 || next >= (int) tableSize || swapSlot[next] < 0 ||
+	    swapSlot[next] - swapSlot[vpn] != next - vpn)
+	return FALSE;
+    pte = pageTable->Lookup(next);
+    return pte != NULL && pte->valid && pte->dirty && !pte->readOnly &&
+	   !kernel->frameAllocator->Pinned(pte->physicalPage);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WriteCluster
+// 	Write dirty page "vpn" to its swap slot, along with as many of its
+//	dirty neighbours as the slots allow, up to MaxPageCluster pages
+//	in all.  The neighbours stay in memory, and are clean now, so if
+//	they are taken later they need not be written.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::WriteCluster(int vpn)
+{
+    char *pages[MaxPageCluster];
+    int first = vpn, last = vpn;
+    TranslationEntry *pte;
+
+    while (last - first + 1 < MaxPageCluster && Clusters(vpn, last + 1))
+	last++;
+    while (last - first + 1 < MaxPageCluster && Clusters(vpn, first - 1))
+	first--;
+    DEBUG(dbgAddr, "Writing virtual pages " << first << " to " << last
+	  << " to swap");
+    for (int i = first; i <= last; i++) {
+	pte = pageTable->Lookup(i);
+	pages[i - first] =
+		&kernel->machine->mainMemory[pte->physicalPage * PageSize];
+	pte->dirty = FALSE;
+	onSwap[i] = TRUE;
+    }
+    usage.writeBacks += last - first + 1;
+    kernel->swapSpace->WritePages(swapSlot[first], last - first + 1, pages);
+}
+
+//----------------------------------------------------------------------
+// ImageOffset
+// 	If "noffH" says its file is laid out as memory is (NOFFALIGNED),
+//	return where page 0 is in the file: the one offset of every
+//	segment's bytes from their place in memory.  Return -1 if it does
+//	not say so, or if the offset is not the same for every segment, or
+//	is not a multiple of the page size (coff2noff was given a smaller
+//	one), or would have page 0 overlap the header; then each segment
+//	is read on its own.
+//----------------------------------------------------------------------
+
+static int
+ImageOffset(NoffHeader *noffH)
+{
+    int offset = noffH->code.inFileAddr - noffH->code.virtualAddr;
+
+    if ((noffH->noffMagic & NOFFALIGNED) == 0 || noffH->code.size <= 0 ||
+	    offset % PageSize != 0 || offset < (int) sizeof(NoffHeader))
+	return -1;
+    if (noffH->initData.size > 0 &&
+	    noffH->initData.inFileAddr - noffH->initData.virtualAddr != offset)
+	return -1;
+#ifdef RDATA
+    if (noffH->readonlyData.size > 0 &&
+	    noffH->readonlyData.inFileAddr -
+		noffH->readonlyData.virtualAddr != offset)
+	return -1;
+#endif
+    return offset;
+}
+
+//----------------------------------------------------------------------
+// SegmentFits
+// 	Is the segment "segment" all within the first "size" bytes of the
+//	address space?
+//----------------------------------------------------------------------
+
+static bool
+SegmentFits(Segment *segment, unsigned int size)
+{
+    return segment->size <= 0 ||
+	   (segment->virtualAddr >= 0 &&
+	    (unsigned int) (segment->virtualAddr + segment->size) <= size);
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::Load
-// 	Load a user program into memory from a file.
+// 	Get ready to run a user program from a file: size the address
+//	space for it, and reserve physical memory for every page.
+//	Nothing is read in yet, but the header; each page is read from
+//	the file the first time it is touched (see PageIn), so the file
+//	stays open while the program runs.
 //
-//	Assumes that the page table has been initialized, and that
-//	the object code file is in NOFF format.
+//	Return FALSE if the file is not there or is not a NOFF program,
+//	or if there is not enough free memory for it.
 //
 //	"fileName" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
@@ -105,20 +1533,25 @@ AddrSpace::~AddrSpace()
 bool 
 AddrSpace::Load(char *fileName) 
 {
-    OpenFile *executable = kernel->fileSystem->Open(fileName);
-    NoffHeader noffH;
     unsigned int size;
 
+    ASSERT(pageTable == NULL);			// load only once
+    executable = kernel->fileSystem->Open(fileName);
     if (executable == NULL) {
 	cerr << "Unable to open file " << fileName << "\n";
 	return FALSE;
     }
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
-    if ((noffH.noffMagic != NOFFMAGIC) && 
-		(WordToHost(noffH.noffMagic) == NOFFMAGIC))
+    if (((noffH.noffMagic & ~NOFFALIGNED) != NOFFMAGIC) && 
+		((WordToHost(noffH.noffMagic) & ~NOFFALIGNED) == NOFFMAGIC))
     	SwapHeader(&noffH);
-    ASSERT(noffH.noffMagic == NOFFMAGIC);
+    if ((noffH.noffMagic & ~NOFFALIGNED) != NOFFMAGIC) {
+	cerr << fileName << " is not a Nachos program\n";
+	delete executable;
+	executable = NULL;
+	return FALSE;
+    }
 
 #ifdef RDATA
 // how big is address space?
@@ -132,44 +1565,32 @@ AddrSpace::Load(char *fileName)
 			+ UserStackSize;	// we need to increase the size
 						// to leave room for the stack
 #endif
-    numPages = divRoundUp(size, PageSize);
-    size = numPages * PageSize;
+    size = divRoundUp(size, PageSize) * PageSize;
 
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
-						// to run anything too big --
-						// at least until we have
-						// virtual memory
-
-    DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
-
-// then, copy in the code and data segments into memory
-// Note: this code assumes that virtual address = physical address
-    if (noffH.code.size > 0) {
-        DEBUG(dbgAddr, "Initializing code segment.");
-	DEBUG(dbgAddr, noffH.code.virtualAddr << ", " << noffH.code.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.code.virtualAddr]), 
-			noffH.code.size, noffH.code.inFileAddr);
+    if (!SegmentFits(&noffH.code, size) ||
+#ifdef RDATA
+	    !SegmentFits(&noffH.readonlyData, size) ||
+#endif
+	    !SegmentFits(&noffH.initData, size)) {
+	cerr << "Bad segment in " << fileName << "\n";
+	delete executable;
+	executable = NULL;
+	return FALSE;
     }
-    if (noffH.initData.size > 0) {
-        DEBUG(dbgAddr, "Initializing data segment.");
-	DEBUG(dbgAddr, noffH.initData.virtualAddr << ", " << noffH.initData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.initData.virtualAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
+    if (!ReservePages(size / PageSize)) {
+	cerr << "Not enough memory to load " << fileName << "\n";
+	delete executable;
+	executable = NULL;
+	return FALSE;
     }
 
-#ifdef RDATA
-    if (noffH.readonlyData.size > 0) {
-        DEBUG(dbgAddr, "Initializing read only data segment.");
-	DEBUG(dbgAddr, noffH.readonlyData.virtualAddr << ", " << noffH.readonlyData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.readonlyData.virtualAddr]),
-			noffH.readonlyData.size, noffH.readonlyData.inFileAddr);
-    }
+#ifndef FILESYS_STUB
+    sharedFile = executable->HeaderSector();
 #endif
-
-    delete executable;			// close file
+    imageOffset = ImageOffset(&noffH);
+    programName = new char[strlen(fileName) + 1];
+    strcpy(programName, fileName);
+    DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
     return TRUE;			// success
 }
 
@@ -187,9 +1608,18 @@ AddrSpace::Execute(char* fileName)
 {
 
     kernel->currentThread->space = this;
+    threads[0].thread = kernel->currentThread;
+    threads[0].firstPage = -1;
+    threads[0].joining = FALSE;
+    threads[0].exited = new Semaphore("thread exit", 0);
+    numThreads = 1;
+    if (kernel->swapper != NULL)
+	kernel->swapper->Add(this);
 
+    kernel->scheduler->LoadUserState(kernel->currentThread);
+					// take the machine's registers,
+					// and load page table register
     this->InitRegisters();		// set the initial register values
-    this->RestoreState();		// load page table register
 
     kernel->machine->Run();		// jump to the user progam
 
@@ -199,6 +1629,238 @@ AddrSpace::Execute(char* fileName)
 }
 
 
+// The following class defines the start of a checkpoint file (see
+// AddrSpace::Checkpoint).  The name of the program's executable
+// follows it, then the numbers of the virtual pages saved, in order,
+// then the pages themselves.  The words are as the host has them.
+
+#define CheckpointMagic	0x4b504b43	// marks a checkpoint file
+
+class CheckpointHeader {
+  public:
+    int magic;				// CheckpointMagic
+    int numPages;			// Of the program, as loaded
+    int breakAddr;			// The end of its heap
+    int nameLength;			// Of the name, its '\0' included
+    int numSaved;			// Pages saved
+    int registers[NumTotalRegs];	// Its thread's, to go on with
+};
+
+//----------------------------------------------------------------------
+// AddrSpace::HoldsOnlyMemory
+// 	Can the program be saved by Checkpoint?  It can if it is running
+//	only its first thread, and it has no open files, pipe ends, mapped
+//	files, shared memory segments or system call ring: none of these
+//	can be saved with its memory.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::HoldsOnlyMemory()
+{
+    if (numThreads != 1 || threads[0].thread != kernel->currentThread ||
+	    ring != NULL || console[SysConsoleInput] != NULL ||
+	    console[SysConsoleOutput] != NULL)
+	return FALSE;
+    for (int i = 0; i < MaxOpenFiles; i++)
+	if (openFiles[i] != NULL)
+	    return FALSE;
+    for (int i = 0; i < MaxPipeEnds; i++)
+	if (pipeEnds[i] != NULL)
+	    return FALSE;
+    for (int i = 0; i < MaxMappings; i++)
+	if (maps[i].file != NULL)
+	    return FALSE;
+    for (int i = 0; i < MaxSegmentHolds; i++)
+	if (holds[i].segment >= 0)
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Checkpoint
+// 	Save the running program in the file "fileName", replacing any
+//	file of that name, so that -restore can start it again from here
+//	(see Restore).  Saved are the registers of its thread, as it
+//	returns from the Checkpoint call, the end of its heap, and the
+//	pages it has changed: those written to, in memory or in swap.
+//	The rest are as the executable has them, or zero, and are loaded
+//	again as they are touched; so the file holds no more than the
+//	program made of its memory.
+//
+//	Return FALSE if the program holds more than its memory (see
+//	HoldsOnlyMemory), or the file cannot be written.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Checkpoint(char *fileName)
+{
+    Lock *pagingLock = kernel->frameAllocator->PagingLock();
+    Machine *machine = kernel->machine;
+    int pages = numPages + heapPages;
+    int *saved = new int[pages];
+    char *page = new char[PageSize];
+    CheckpointHeader header;
+    TranslationEntry *pte;
+    OpenFile *file;
+    int offset, size;
+    bool ok;
+
+    if (!HoldsOnlyMemory()) {
+	delete [] saved;
+	delete [] page;
+	return FALSE;
+    }
+    header.magic = CheckpointMagic;
+    header.numPages = numPages;
+    header.breakAddr = breakAddr;
+    header.nameLength = strlen(programName) + 1;
+    header.numSaved = 0;
+    pagingLock->Acquire();
+    if (kernel->tlbManager != NULL)
+	kernel->tlbManager->Flush();	// for its dirty bits
+    for (int vpn = 0; vpn < pages; vpn++) {
+	pte = pageTable->Lookup(vpn);
+	if (onSwap[vpn] ||
+		(pte != NULL && pte->valid && !pte->readOnly && pte->dirty))
+	    saved[header.numSaved++] = vpn;
+    }
+    pagingLock->Release();
+    for (int i = 0; i < NumTotalRegs; i++)
+	header.registers[i] = machine->ReadRegister(i);
+    header.registers[2] = 1;		// what Checkpoint returns, restored;
+    header.registers[PrevPCReg] = header.registers[PCReg];
+    header.registers[PCReg] += 4;	// past the syscall, as
+    header.registers[NextPCReg] = header.registers[PCReg] + 4;
+					// ExceptionHandler moves it
+
+    offset = sizeof(header) + header.nameLength +
+	     header.numSaved * sizeof(int);
+    size = offset + header.numSaved * PageSize;
+    kernel->fileSystem->Remove(fileName);
+    if (!kernel->fileSystem->Create(fileName, size) ||
+	    (file = kernel->fileSystem->Open(fileName)) == NULL) {
+	delete [] saved;
+	delete [] page;
+	return FALSE;
+    }
+    ok = file->WriteAt((char *) &header, sizeof(header), 0) ==
+	     (int) sizeof(header) &&
+	 file->WriteAt(programName, header.nameLength, sizeof(header)) ==
+	     header.nameLength &&
+	 file->WriteAt((char *) saved, header.numSaved * sizeof(int),
+		       sizeof(header) + header.nameLength) ==
+	     (int) (header.numSaved * sizeof(int));
+    for (int i = 0; ok && i < header.numSaved; i++) {
+	pagingLock->Acquire();		// so that it stays where it is
+	pte = pageTable->Lookup(saved[i]);
+	if (pte != NULL && pte->valid) {
+	    ASSERT(!pte->readOnly);
+	    bcopy(&machine->mainMemory[pte->physicalPage * PageSize], page,
+		  PageSize);
+	} else {
+	    kernel->swapSpace->ReadPage(swapSlot[saved[i]], page);
+	}
+	pagingLock->Release();
+	ok = file->WriteAt(page, PageSize, offset + i * PageSize) == PageSize;
+    }
+    DEBUG(dbgAddr, "Checkpointed " << header.numSaved << " of " << pages
+	  << " pages to " << fileName);
+    delete file;
+    delete [] saved;
+    delete [] page;
+    return ok;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Restore
+// 	Get ready to run the program saved by Checkpoint in the file
+//	"fileName", from where it was saved: load its executable as Load
+//	does, give it back its heap, and read each page saved straight
+//	into a frame of its own -- dirty, as it was changed.  No other
+//	page is read, and the program's start-up is not run again; so
+//	restoring costs the pages saved, and no more.  Execute then starts
+//	it with the registers it was saved with.
+//
+//	Return FALSE if the file is not there or is not a checkpoint, or
+//	the executable cannot be loaded or is not the size it was, or
+//	there is not enough room in swap for the program.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Restore(char *fileName)
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    Lock *pagingLock = frames->PagingLock();
+    char *mem = kernel->machine->mainMemory;
+    OpenFile *file = kernel->fileSystem->Open(fileName);
+    CheckpointHeader header;
+    TranslationEntry *pte;
+    int *saved = NULL;
+    char *name;
+    int offset, frame;
+    bool ok;
+
+    if (file == NULL) {
+	cerr << "Unable to open file " << fileName << "\n";
+	return FALSE;
+    }
+    if (file->ReadAt((char *) &header, sizeof(header), 0) !=
+	    (int) sizeof(header) || header.magic != CheckpointMagic ||
+	    header.nameLength <= 1 || header.numSaved < 0) {
+	cerr << fileName << " is not a Nachos checkpoint\n";
+	delete file;
+	return FALSE;
+    }
+    name = new char[header.nameLength];
+    ok = file->ReadAt(name, header.nameLength, sizeof(header)) ==
+	     header.nameLength;
+    name[header.nameLength - 1] = '\0';
+    ok = ok && Load(name);
+    if (ok && (int) numPages != header.numPages) {
+	cerr << name << " has changed since " << fileName << " was saved\n";
+	ok = FALSE;
+    }
+    if (ok && Sbrk(header.breakAddr - breakAddr) < 0) {
+	cerr << "Not enough memory to restore " << fileName << "\n";
+	ok = FALSE;
+    }
+    delete [] name;
+    if (ok) {
+	saved = new int[header.numSaved];
+	ok = file->ReadAt((char *) saved, header.numSaved * sizeof(int),
+			  sizeof(header) + header.nameLength) ==
+		 (int) (header.numSaved * sizeof(int));
+	for (int i = 0; ok && i < header.numSaved; i++)
+	    ok = saved[i] >= 0 && saved[i] < (int) numPages + heapPages;
+    }
+    offset = sizeof(header) + header.nameLength +
+	     header.numSaved * sizeof(int);
+    for (int i = 0; ok && i < header.numSaved; i++) {
+	pagingLock->Acquire();
+	pte = pageTable->Entry(saved[i]);
+	frame = frames->Allocate(this, pte);
+	ok = file->ReadAt(&mem[frame * PageSize], PageSize,
+			  offset + i * PageSize) == PageSize;
+	pte->physicalPage = frame;
+	pte->readOnly = FALSE;
+	pte->use = FALSE;
+	pte->referenced = FALSE;
+	pte->dirty = TRUE;
+	pte->valid = TRUE;
+	pagingLock->Release();
+    }
+    delete [] saved;
+    delete file;
+    if (!ok)
+	return FALSE;
+    restoredRegisters = new int[NumTotalRegs];
+    for (int i = 0; i < NumTotalRegs; i++)
+	restoredRegisters[i] = header.registers[i];
+    DEBUG(dbgAddr, "Restored " << header.numSaved << " pages from "
+	  << fileName);
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::InitRegisters
 // 	Set the initial values for the user-level register set.
@@ -207,6 +1869,9 @@ AddrSpace::Execute(char* fileName)
 //	that we can immediately jump to user code.  Note that these
 //	will be saved/restored into the currentThread->userRegisters
 //	when this thread is context switched out.
+//
+//	A program restored from a checkpoint gets the registers it was
+//	saved with instead.
 //----------------------------------------------------------------------
 
 void
@@ -215,6 +1880,12 @@ AddrSpace::InitRegisters()
     Machine *machine = kernel->machine;
     int i;
 
+    if (restoredRegisters != NULL) {
+	for (i = 0; i < NumTotalRegs; i++)
+	    machine->WriteRegister(i, restoredRegisters[i]);
+	DEBUG(dbgAddr, "Restored at PC " << restoredRegisters[PCReg]);
+	return;
+    }
     for (i = 0; i < NumTotalRegs; i++)
 	machine->WriteRegister(i, 0);
 
@@ -240,24 +1911,40 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, don't need to save anything!
+//	If there is a TLB, its entries are this address space's, so
+//	they are written back to the page table and thrown away.  The
+//	user ticks it ran for count towards its own time.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
-{}
+{
+    userTicks += kernel->stats->userTicks - userSeen;
+    userSeen = kernel->stats->userTicks;
+    if (kernel->tlbManager != NULL)
+	kernel->tlbManager->Flush();
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::RestoreState
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//	Its own time (see SampleWorkingSet) is counted from here on.
+//      For now, tell the machine where to find the page table --
+//	unless it translates with a TLB, which is loaded as the
+//	program misses in it.  The TLB may still hold the entries of a
+//	program that exited, as no SaveState is done for a thread that
+//	no longer has an address space; they must go.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
+    userSeen = kernel->stats->userTicks;
+    if (kernel->tlbManager != NULL) {
+	kernel->tlbManager->Flush();
+	return;
+    }
     kernel->machine->pageTable = pageTable;
-    kernel->machine->pageTableSize = numPages;
 }
 
 
@@ -268,6 +1955,11 @@ void AddrSpace::RestoreState()
 //  The flag _isReadWrite_ is false (0) for read-only access; true (1)
 //  for read-write access.
 //  Return any exceptions caused by the address translation.
+//  A page that is not loaded yet is loaded first, and a shared page
+//  written to is copied first, so the kernel can use this on any of
+//  the program's addresses.  Letting go of the paging lock may switch
+//  to another thread, which could take the page back again, so this
+//  goes on until the page is there.
 //----------------------------------------------------------------------
 ExceptionType
 AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
@@ -277,11 +1969,19 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     unsigned int      vpn    = vaddr / PageSize;
     unsigned int      offset = vaddr % PageSize;
 
-    if(vpn >= numPages) {
+    if(vpn >= tableSize) {
         return AddressErrorException;
     }
 
-    pte = &pageTable[vpn];
+    pte = pageTable->Lookup(vpn);
+    while (pte == NULL || !pte->valid || (isReadWrite && pte->readOnly)) {
+	if (pte == NULL || !pte->valid) {	// the kernel touched it first
+	    if (!PageIn(vpn, isReadWrite))
+		return AddressErrorException;	// in the window, unmapped
+	} else if (!CopyOnWrite(vpn))	// or wrote to it first
+	    break;			// code
+	pte = pageTable->Lookup(vpn);	// (again, if taken back meanwhile)
+    }
 
     if(isReadWrite && pte->readOnly) {
         return ReadOnlyException;
@@ -297,13 +1997,14 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     }
 
     pte->use = TRUE;          // set the use, dirty bits
+    pte->referenced = TRUE;
 
     if(isReadWrite)
         pte->dirty = TRUE;
 
     *paddr = pfn*PageSize + offset;
 
-    ASSERT((*paddr < MemorySize));
+    ASSERT((*paddr < (unsigned) MemorySize));
 
     //cerr << " -- AddrSpace::Translate(): vaddr: " << vaddr <<
     //  ", paddr: " << *paddr << "\n";
@@ -311,6 +2012,135 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::UserRun
+// 	Find the user bytes from "vaddr" on in physical memory.  Set
+//	"at" to where the first is, and return how many of them, up to
+//	"numBytes", are contiguous there: the rest of the page, and the
+//	pages after it as long as their frames follow on.  Return -1 if
+//	"vaddr" is not a valid address (or is read-only, if "writing").
+//
+//	System calls move user buffers with this, a run at a time,
+//	rather than a byte at a time through Machine::ReadMem.  Only the
+//	first page is loaded (or copied, if shared) if need be: loading
+//	another could take back the frames of the pages before it.
+//----------------------------------------------------------------------
 
+int
+AddrSpace::UserRun(int vaddr, int numBytes, bool writing, char **at)
+{
+    unsigned int paddr, next;
+    int run;
 
+    if (vaddr < 0 || Translate(vaddr, &paddr, writing) != NoException)
+	return -1;
+    run = min(numBytes, PageSize - vaddr % PageSize);
+    while (run < numBytes && Resident(vaddr + run, writing) &&
+	    Translate(vaddr + run, &next, writing) == NoException &&
+	    next == paddr + run)
+	run += min(numBytes - run, PageSize);
+    *at = &kernel->machine->mainMemory[paddr];
+    return run;
+}
 
+//----------------------------------------------------------------------
+// AddrSpace::CopyIn, CopyOut
+// 	Copy "numBytes" bytes from user address "vaddr" into the kernel
+//	buffer "into", or from "from" out to "vaddr", a contiguous run
+//	at a time.  Return FALSE, having copied only part, if the user
+//	buffer is not all valid.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyIn(int vaddr, char *into, int numBytes)
+{
+    for (int done = 0, run; done < numBytes; done += run) {
+	char *at;
+	run = UserRun(vaddr + done, numBytes - done, FALSE, &at);
+	if (run < 0)
+	    return FALSE;
+	bcopy(at, &into[done], run);
+    }
+    return TRUE;
+}
+
+bool
+AddrSpace::CopyOut(char *from, int vaddr, int numBytes)
+{
+    for (int done = 0, run; done < numBytes; done += run) {
+	char *at;
+	run = UserRun(vaddr + done, numBytes - done, TRUE, &at);
+	if (run < 0)
+	    return FALSE;
+	bcopy(&from[done], at, run);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyInString
+// 	Copy the '\0'-terminated string at user address "vaddr" into
+//	"into", which has room for "size" bytes.  Return FALSE if the
+//	string runs into a bad address, or does not fit.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyInString(int vaddr, char *into, int size)
+{
+    for (int done = 0, run; done < size; done += run) {
+	char *at, *end;
+	run = UserRun(vaddr + done, size - done, FALSE, &at);
+	if (run < 0)
+	    return FALSE;
+	end = (char *) memchr(at, '\0', run);
+	if (end != NULL) {
+	    bcopy(at, &into[done], end - at + 1);
+	    return TRUE;
+	}
+	bcopy(at, &into[done], run);
+    }
+    return FALSE;			// too long
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Resident
+// 	Is "vaddr" in the address space, and its page in memory -- and
+//	the program's own, if "writing"?
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Resident(int vaddr, bool writing)
+{
+    unsigned int vpn = (unsigned int) vaddr / PageSize;
+    TranslationEntry *pte;
+
+    if (vaddr < 0 || vpn >= tableSize)
+	return FALSE;
+    pte = pageTable->Lookup(vpn);
+    return pte != NULL && pte->valid && !(writing && pte->readOnly);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Pin, Unpin
+// 	Keep the frames of the "numBytes" bytes at "vaddr", a run just
+//	returned by UserRun, from being taken back, while reading or
+//	writing them in place may block; and let them go again.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Pin(int vaddr, int numBytes)
+{
+    for (int vpn = vaddr / PageSize; vpn <= (vaddr + numBytes - 1) / PageSize;
+	    vpn++) {
+	ASSERT(Resident(vpn * PageSize, FALSE));
+	kernel->frameAllocator->Pin(pageTable->Lookup(vpn)->physicalPage);
+    }
+}
+
+void
+AddrSpace::Unpin(int vaddr, int numBytes)
+{
+    for (int vpn = vaddr / PageSize; vpn <= (vaddr + numBytes - 1) / PageSize;
+	    vpn++)
+	kernel->frameAllocator->Unpin(pageTable->Lookup(vpn)->physicalPage);
+}
@@ -2,9 +2,27 @@
 //	Data structures to keep track of executing user programs 
 //	(address spaces).
 //
-//	For now, we don't keep any information about address spaces.
-//	The user level CPU state is saved and restored in the thread
-//	executing the user program (see thread.h).
+//	Besides its page table, an address space holds the program's
+//	table of open files, the pipe ends it holds, the files it has
+//	mapped, the shared memory segments it holds, and its threads.
+//	Files and segments are
+//	mapped in a window of the address space just past the stack, of
+//	MapWindowSize bytes, which has page table entries but no pages
+//	till something is mapped there; so are the stacks of the threads
+//	after the first, and the program's heap, each with slots in swap
+//	of its own.  The heap grows up from the bottom of the window (see
+//	Sbrk in syscall.h); the rest is mapped from the top down, out of
+//	its way.  The user
+//	level CPU state is saved and restored in each thread executing
+//	the user program (see thread.h).
+//
+//	When memory is overcommitted, the whole program may be swapped
+//	out (see swapper.h): its pages go to swap, and its threads wait
+//	at their next page fault until it is swapped back in.
+//
+//	A program may also save itself to a file, and be started again
+//	from there by -restore, in a new address space (see Checkpoint
+//	in syscall.h).
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -14,9 +32,75 @@
 #define ADDRSPACE_H
 
 #include "copyright.h"
+#include "list.h"
 #include "filesys.h"
+#include "syscall.h"
+#include "noff.h"
+#include "stats.h"
+#include "pipe.h"
+#include "shm.h"
+
+class SyscallRing;
+class Thread;
+class Semaphore;
+class Condition;
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxOpenFiles		16	// open files per address space,
+					// counting the console's two ids
+#define WorkingSetWindow	1000	// user ticks of a program between
+					// working set samples
+#define MapWindowSize		(32 * 1024)	// bytes files are mapped in
+#define MaxMappings		4	// files mapped at once
+#define MaxUserThreads		8	// threads of one program at once,
+					// the first included
+
+// The following class defines a file mapped into an address space:
+// its pages are read from the file as they are touched, into frames
+// of the page cache that every program mapping the file shares (see
+// frames.h), and those written to are written back to it.
+
+class MappedFile {
+  public:
+    OpenFile *file;			// The mapping's own opener of the
+					// file; NULL if the slot is free
+    int sector;				// Its header's, which its frames
+					// are found by
+    int firstPage;			// The pages it is mapped at
+    int numPages;
+    int length;				// The file's bytes, when mapped
+};
+
+// The following class defines an address space's hold on a shared
+// memory segment: as its creator, or as an attachment of it at some
+// pages of the map window.
+
+class SegmentHold {
+  public:
+    int segment;			// The segment's id; -1 if the slot
+					// is free
+    int firstPage;			// Where it is attached; -1 for the
+					// creator's hold
+};
+
+// The following class defines one of the threads of a user program
+// (see ThreadFork in syscall.h).  Its slot, and its ThreadId, are
+// free again once it has been joined.
+
+class UserThread {
+  public:
+    Thread *thread;			// The thread; NULL once it has
+					// exited
+    int firstPage;			// Its stack, in the map window; -1
+					// for the first thread's, or once
+					// it has exited
+    int root, func, arg;		// Where it starts: root is to call
+					// func(arg)
+    int status;				// What it passed to ThreadExit
+    bool joining;			// Is a thread waiting to join it?
+    Semaphore *exited;			// Signalled as it exits; NULL if
+					// the slot is free
+};
 
 class AddrSpace {
   public:
@@ -25,7 +109,28 @@ class AddrSpace {
 
     bool Load(char *fileName);		// Load a program into addr space from
                                         // a file
-					// return false if not found
+					// return false if not found, or
+					// if memory is short
+
+    bool PageIn(int vpn, bool writing);	// Load virtual page "vpn", on a
+					// page fault (on a store, if
+					// "writing"); FALSE if it is not
+					// in the address space
+    void PageOut(int vpn);		// Give up the frame of "vpn",
+					// saving the page in swap
+    bool CopyOnWrite(int vpn);		// Give the program its own copy
+					// of shared page "vpn", on a write
+					// to it; FALSE if it is code
+    void RefillTLB(int vpn);		// Load the translation of "vpn"
+					// into the TLB, on a miss
+
+    bool Checkpoint(char *fileName);	// Save the running program in
+					// "fileName"; FALSE if it holds
+					// more than memory, or the file
+					// cannot be written
+    bool Restore(char *fileName);	// Load a program saved so, to go
+					// on from where it was; FALSE if
+					// it cannot be
 
     void Execute(char *fileName);             	// Run a program
 					// assumes the program has already
@@ -39,14 +144,190 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    int UserRun(int vaddr, int numBytes, bool writing, char **at);
+    					// Where the bytes at "vaddr" are in
+					// memory, and how many are
+					// contiguous there; -1 if unmapped
+    bool CopyIn(int vaddr, char *into, int numBytes);
+    bool CopyOut(char *from, int vaddr, int numBytes);
+					// Copy between kernel and user
+					// memory; FALSE on a bad address
+    bool CopyInString(int vaddr, char *into, int size);
+    					// Copy a string of at most "size"
+					// bytes, its '\0' included
+    void Pin(int vaddr, int numBytes);	// Keep the frames of a run
+    void Unpin(int vaddr, int numBytes);// returned by UserRun, while
+					// I/O uses them in place
+
+    OpenFileId AddFile(OpenFile *file);	// Give "file" the lowest free id;
+					// return -1 if the table is full
+    OpenFile *GetFile(OpenFileId id);	// The file with "id", or NULL
+    OpenFile *RemoveFile(OpenFileId id); // Free "id", returning its file
+					// (NULL if it was not in use)
+
+    OpenFileId AddPipeEnd(PipeEnd *end);// Give "end" the lowest free pipe
+					// id; return -1 if none is left
+    PipeEnd *GetPipeEnd(OpenFileId id);	// The pipe end with "id", or NULL
+    PipeEnd *RemovePipeEnd(OpenFileId id);
+    					// Free "id", returning its end
+    void Redirect(OpenFileId id, PipeEnd *end);
+    					// Have the console's id "id" name
+					// "end" instead
+
+    int Map(OpenFile *file);		// Map "file" into the window, and
+					// return its address; -1 if it
+					// does not fit
+    bool Unmap(int vaddr);		// Write back and unmap the file
+					// mapped at "vaddr"; FALSE if none
+
+    bool HoldSegment(int id);		// Keep the creator's hold on new
+					// segment "id"; FALSE if no room
+    int Attach(int id, int vaddr);	// Map segment "id" at "vaddr" in the
+					// window, or where it fits if 0,
+					// and return its address; -1 if
+					// there is no room there
+    bool Detach(int vaddr);		// Unmap the segment attached at
+					// "vaddr"; FALSE if none
+
+    int AddThread(Thread *thread, int func, int arg, int root);
+    					// Give "thread" a slot and a stack,
+					// to start at "root"; return its
+					// ThreadId, or -1 if there is no
+					// room
+    int JoinThread(ThreadId id);	// Wait for the thread "id" to exit,
+					// and return its status; -1 if it
+					// cannot be joined
+    void ExecuteThread();		// Run the running thread, from its
+					// root, on its stack
+    int EndThread(int status);		// The running thread is done;
+					// return how many are left
+
+    int Sbrk(int increment);		// Move the end of the heap; return
+					// where it was, or -1
+
+    SpaceId GetId() { return id; }
+    void SetId(SpaceId i) { id = i; }	// What Exec returned for the
+					// program, or 0
+
+    SyscallRing *GetRing() { return ring; }
+    void SetRing(SyscallRing *r) { ring = r; }
+					// The program's system call ring,
+					// or NULL
+
+    void SampleWorkingSet();		// Count the pages touched since
+					// the last sample, if it is time
+    int WorkingSet() { return workingSet; }
+					// Pages it is expected to touch,
+					// from the samples
+    int Priority();			// The highest of its threads'
+
+    void SwapOut();			// Give up all its frames, and keep
+					// its threads from running
+    void SwapIn();			// Read back the pages it had, and
+					// let its threads run again
+    bool SwappedOut() { return swappedOut; }
+    int SwappedAt() { return swappedAt; }
+					// When it was last swapped in or
+					// out, or started
+    MemoryUsage *Usage() { return &usage; }
+					// Its faults, evictions and working
+					// sets so far
+
   private:
-    TranslationEntry *pageTable;	// Assume linear page table translation
+    PageTable *pageTable;		// Laid out as -pt says
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    unsigned int tableSize;		// And in the page table: those and
+					// the map window
+    OpenFile *openFiles[MaxOpenFiles];	// The program's open files, by
+					// OpenFileId; ids 0 and 1 are the
+					// console's, and never used here
+    PipeEnd *pipeEnds[MaxPipeEnds];	// Its pipe ends, from PipeIdBase
+    PipeEnd *console[2];		// The ends its console input and
+					// output are redirected to, or NULL
+    SyscallRing *ring;			// Registered by RingSetup
+    MappedFile maps[MaxMappings];	// The files mapped in the window
+    SegmentHold holds[MaxSegmentHolds];	// And the segments it holds
+    UserThread threads[MaxUserThreads];	// Its threads, by ThreadId; the
+					// first is 0
+    int numThreads;			// How many have not exited yet
+    int breakAddr;			// The end of the heap
+    int heapPages;			// Pages up to it, from numPages
+    SpaceId id;
+
+    OpenFile *executable;		// The program's NOFF file, which
+    NoffHeader noffH;			// pages are loaded from as they
+					// are touched
+    char *programName;			// And its name, for Checkpoint
+    int sharedFile;			// The sector of its header, which
+					// programs running it share its
+					// pages by; -1 to share none
+    int imageOffset;			// Where page 0 is in the file, if
+					// it is laid out as memory is
+					// (NOFFALIGNED); -1 if not
+    int *swapSlot;			// Each page's slot in the swap area;
+					// -1 in the window, but for stacks
+    bool *onSwap;			// Has the page been written there?
+    MemoryUsage usage;			// What it has done in memory
+    int userTicks;			// User ticks it has run, as of
+    int userSeen;			// the machine's "userSeen"
+    int lastSample;			// Its own, when its working set
+					// was last sampled
+    int workingSet;			// The samples, each older one
+					// counting half as much
+    bool swappedOut;			// Is it now?
+    int swappedAt;
+    List<int> *swappedPages;		// The pages to read back in, of
+					// those it had when swapped out
+    Condition *swappedIn;		// Signalled when it is, with the
+					// paging lock
+    int *restoredRegisters;		// The registers it starts with, if
+					// it was restored; else NULL
+
+    bool ReservePages(int count);	// Set up "count" pages, none of
+					// them loaded yet
+    void FreePages();			// Give back their frames and slots
+    MappedFile *MappingOf(int vpn);	// The mapped file "vpn" is in
+    SegmentHold *AttachmentOf(int vpn);	// The segment attached at "vpn"
+    int InTheWay(int first, int count);	// The end of what is mapped over
+					// any of those pages; -1 if none
+    int FindRoom(int count);		// The highest "count" pages free in
+					// the window; -1 if there are none
+    void DropSegment(SegmentHold *hold);// Unmap it, if it is attached,
+					// and let the segment go
+    void FreeWindowPages(int first, int count);
+    					// Give back the frames and slots of
+					// those pages of a stack, or the
+					// heap, with the paging lock held
+    void MapIO(int vpn, char *frame, bool writing);
+					// Read or write mapped page "vpn"
+    void UnmapPages(MappedFile *map);	// Write back and unshare its
+					// pages, with the paging lock held
+    bool Resident(int vaddr, bool writing);
+					// Is the page of "vaddr" loaded
+					// (and writable, if "writing")?
+    void LoadPage(int vpn, bool writing);
+    					// PageIn, with the paging lock held
+    bool Clusters(int vpn, int next);	// Can "next" go to swap with "vpn"?
+    void WriteCluster(int vpn);		// Write "vpn" and its dirty
+					// neighbours to swap, at once
+    void LoadSegment(Segment *segment, int vpn, char *into);
+					// Read the part of "segment" in
+					// page "vpn"
+    void LoadSegments(int vpn, char *into);
+					// Read all the parts in "vpn"
+    int FilePage(int vpn);		// Which page of the executable
+					// "vpn" is shared as
+    int FileBytes(int vpn, bool writable);
+					// How much of "vpn" is read from
+					// the executable (the data only,
+					// if "writable")
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
+    bool HoldsOnlyMemory();		// Has it no files, pipes, segments,
+					// ring or other threads?
 
 };
 
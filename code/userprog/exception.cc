@@ -14,8 +14,11 @@
 //	Interrupts (which can also cause control to transfer from user
 //	code into the Nachos kernel) are handled elsewhere.
 //
-// For now, this only handles the Halt() system call.
-// Everything else core dumps.
+//	Each system call is handled by a function in the table below,
+//	indexed by its SC_* code; the handlers return the result, and
+//	ExceptionHandler stores it and moves the PC past the syscall in
+//	one place.  The table also counts the calls to each, and the
+//	ticks they take.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -23,8 +26,613 @@
 
 #include "copyright.h"
 #include "main.h"
+#include "trace.h"
+#include "replay.h"
 #include "syscall.h"
 #include "ksyscall.h"
+#include "ring.h"
+#include "slab.h"
+
+#define NumSyscallCodes	(SC_MSG + 1)	// size of the dispatch table
+#define MaxUserString	1024		// longest string a program can
+					// pass, its '\0' included
+#define FaultStatus	-1		// exit status of a thread killed
+					// for a fault
+
+// The following class defines a system call in the dispatch table.
+// A handler is passed the arguments from r4 through r7, and returns
+// the value to put back in r2.  Halt, MSG, ThreadExit and Exit never
+// return.
+
+typedef int (*SyscallHandler)(int *args);
+
+class SyscallEntry {
+  public:
+    int code;				// SC_* number
+    const char *name;			// For statistics and debugging
+    SyscallHandler handler;		// Carries out the call
+    bool ringed;			// Can it be queued in a ring?
+    int count;				// Calls so far
+    int ticks;				// Total ticks they took, from entry
+					// to return (including the ticks
+					// of any thread that ran while
+					// the caller was blocked)
+};
+
+//----------------------------------------------------------------------
+// UserString
+// 	Return a copy, in a kernel buffer, of the string at user address
+//	"addr", or NULL if it is not all at valid addresses or is too
+//	long.  The buffer is the thread's scratch; it goes away as the
+//	system call returns (see RunSyscall).
+//----------------------------------------------------------------------
+
+static char *
+UserString(int addr)
+{
+    char *str = kernel->currentThread->Scratch()->Alloc(MaxUserString);
+
+    if (!kernel->currentThread->space->CopyInString(addr, str,
+						     MaxUserString))
+	return NULL;
+    return str;
+}
+
+//----------------------------------------------------------------------
+// Halt, MSG, Exec, Join, Create, Remove, Rename, Mkdir, ReadDir, Open, Read,
+// Write, ReadV, WriteV, Seek, FileSize, CopyRange, Preallocate, RingSetup,
+// RingSubmit, Close, Fsync, SetPriority, SetTickets, SetIoClass, Sleep, GetUsage,
+// GetNetStats, PutString, ReadLine, GetFsStats, GetStats, Mmap, Munmap, Sbrk, Checkpoint, ShmCreate,
+// ShmAttach, ShmDetach, FutexWait, FutexWake, ThreadFork, ThreadYield,
+// ThreadJoin, Add, ThreadExit, Exit
+// 	The handlers of the system calls.  "args" holds r4 through r7,
+//	in order.
+//----------------------------------------------------------------------
+
+static int
+DoHalt(int *args)
+{
+    DEBUG(dbgSys, "Shutdown, initiated by user program.\n");
+    SysHalt();
+    cout<<"in exception\n";
+    ASSERTNOTREACHED();
+    return 0;
+}
+
+static int
+DoMSG(int *args)
+{
+    DEBUG(dbgSys, "Message received.\n");
+    char *msg = UserString(args[0]);
+    kernel->synchConsoleOut->Flush();	// keep the program's output first
+    if (msg != NULL)
+	cout << msg << endl;
+    SysHalt();
+    ASSERTNOTREACHED();
+    return 0;
+}
+
+static int
+DoExec(int *args)
+{
+    char *name = UserString(args[0]);
+    int id = -1;
+
+    if (name != NULL)
+	id = SysExec(name);
+    return id;
+}
+
+static int
+DoExecWith(int *args)
+{
+    char *name = UserString(args[0]);
+    int id = -1;
+
+    if (name != NULL)
+	id = SysExecWith(name, args[1], args[2]);
+    return id;
+}
+
+static int
+DoJoin(int *args)
+{
+    return SysJoin(args[0]);
+}
+
+static int
+DoCreate(int *args)
+{
+    char *name = UserString(args[0]);
+    int status = 0;
+
+    if (name != NULL)
+	status = SysCreate(name, args[1]);
+    return status;
+}
+
+static int
+DoRemove(int *args)
+{
+    char *name = UserString(args[0]);
+    int status = -1;
+
+    if (name != NULL)
+	status = SysRemove(name);
+    return status;
+}
+
+static int
+DoRename(int *args)
+{
+    char *from = UserString(args[0]);
+    char *to = UserString(args[1]);
+    int status = -1;
+
+    if (from != NULL && to != NULL)
+	status = SysRename(from, to);
+    return status;
+}
+
+static int
+DoMkdir(int *args)
+{
+    char *name = UserString(args[0]);
+    int status = -1;
+
+    if (name != NULL)
+	status = SysMkdir(name);
+    return status;
+}
+
+static int
+DoReadDir(int *args)
+{
+    char *name = UserString(args[0]);
+    int n = -1;
+
+    if (name != NULL)
+	n = SysReadDir(name, args[1], args[2], args[3]);
+    return n;
+}
+
+static int
+DoOpen(int *args)
+{
+    char *name = UserString(args[0]);
+    int id = -1;
+
+    if (name != NULL)
+	id = SysOpen(name);
+    return id;
+}
+
+static int
+DoRead(int *args)
+{
+    return SysRead(args[0], args[1], args[2]);
+}
+
+static int
+DoWrite(int *args)
+{
+    return SysWrite(args[0], args[1], args[2]);
+}
+
+static int
+DoReadV(int *args)
+{
+    return SysReadV(args[0], args[1], args[2]);
+}
+
+static int
+DoWriteV(int *args)
+{
+    return SysWriteV(args[0], args[1], args[2]);
+}
+
+static int
+DoSeek(int *args)
+{
+    return SysSeek(args[0], args[1], args[2]);
+}
+
+static int
+DoFileSize(int *args)
+{
+    return SysFileSize(args[0]);
+}
+
+static int
+DoCopyRange(int *args)
+{
+    return SysCopyRange(args[0], args[1], args[2]);
+}
+
+static int
+DoPreallocate(int *args)
+{
+    return SysPreallocate(args[0], args[1], args[2]);
+}
+
+static int
+DoPipe(int *args)
+{
+    return SysPipe(args[0]);
+}
+
+static int
+DoRingSetup(int *args)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    SyscallRing *ring;
+
+    if (space->GetRing() != NULL)
+	return -1;
+    ring = new SyscallRing(space, args[0]);
+    if (!ring->Attach()) {
+	delete ring;
+	return -1;
+    }
+    space->SetRing(ring);
+    if (args[1] & RingPoll)
+	ring->StartPoller();
+    return 1;
+}
+
+static int
+DoRingSubmit(int *args)
+{
+    SyscallRing *ring = kernel->currentThread->space->GetRing();
+
+    return (ring == NULL) ? -1 : ring->Process();
+}
+
+static int
+DoClose(int *args)
+{
+    return SysClose(args[0]);
+}
+
+static int
+DoFsync(int *args)
+{
+    return SysFsync(args[0]);
+}
+
+static int
+DoSetPriority(int *args)
+{
+    return SysSetPriority(args[0]);
+}
+
+static int
+DoSetTickets(int *args)
+{
+    return SysSetTickets(args[0]);
+}
+
+static int
+DoSetIoClass(int *args)
+{
+    return SysSetIoClass(args[0]);
+}
+
+static int
+DoSleep(int *args)
+{
+    return SysSleep(args[0]);
+}
+
+static int
+DoGetUsage(int *args)
+{
+    return SysGetUsage(args[0]);
+}
+
+static int
+DoGetNetStats(int *args)
+{
+    return SysGetNetStats(args[0]);
+}
+
+static int
+DoPutString(int *args)
+{
+    char *str = UserString(args[0]);
+    int n = -1;
+
+    if (str != NULL)
+	n = SysPutString(str);
+    return n;
+}
+
+static int
+DoReadLine(int *args)
+{
+    return SysReadLine(args[0], args[1]);
+}
+
+static int
+DoGetFsStats(int *args)
+{
+    return SysGetFsStats(args[0]);
+}
+
+static int
+DoGetStats(int *args)
+{
+    return SysGetStats(args[0], args[1]);
+}
+
+static int
+DoMmap(int *args)
+{
+    return SysMmap(args[0]);
+}
+
+static int
+DoMunmap(int *args)
+{
+    return SysMunmap(args[0]);
+}
+
+static int
+DoSbrk(int *args)
+{
+    return SysSbrk(args[0]);
+}
+
+static int
+DoCheckpoint(int *args)
+{
+    char *name = UserString(args[0]);
+    int result = -1;
+
+    if (name != NULL)
+	result = SysCheckpoint(name);
+    return result;
+}
+
+static int
+DoShmCreate(int *args)
+{
+    return SysShmCreate(args[0]);
+}
+
+static int
+DoShmAttach(int *args)
+{
+    return SysShmAttach(args[0], args[1]);
+}
+
+static int
+DoShmDetach(int *args)
+{
+    return SysShmDetach(args[0]);
+}
+
+static int
+DoFutexWait(int *args)
+{
+    return SysFutexWait(args[0], args[1]);
+}
+
+static int
+DoFutexWake(int *args)
+{
+    return SysFutexWake(args[0], args[1]);
+}
+
+static int
+DoThreadFork(int *args)
+{
+    return SysThreadFork(args[0], args[1], args[2]);
+}
+
+static int
+DoThreadYield(int *args)
+{
+    SysThreadYield();
+    return 0;
+}
+
+static int
+DoThreadJoin(int *args)
+{
+    return SysThreadJoin(args[0]);
+}
+
+static int
+DoAdd(int *args)
+{
+    int result = SysAdd(/* int op1 */args[0],
+			/* int op2 */args[1]);
+    cout << "result is " << result << "\n";
+    return result;
+}
+
+static int
+DoThreadExit(int *args)
+{
+    SysExit(args[0]);
+    ASSERTNOTREACHED();
+    return 0;
+}
+
+static int
+DoExit(int *args)
+{
+    DEBUG(dbgAddr, "Program exit\n");
+    kernel->synchConsoleOut->Flush();
+    cout << "return value:" << args[0] << endl;
+    SysExit(args[0]);
+    ASSERTNOTREACHED();
+    return 0;
+}
+
+static SyscallEntry syscalls[] = {
+    { SC_Halt,		"Halt",		DoHalt,		FALSE, 0, 0 },
+    { SC_Exit,		"Exit",		DoExit,		FALSE, 0, 0 },
+    { SC_Exec,		"Exec",		DoExec,		FALSE, 0, 0 },
+    { SC_ExecWith,	"ExecWith",	DoExecWith,	FALSE, 0, 0 },
+    { SC_Join,		"Join",		DoJoin,		FALSE, 0, 0 },
+    { SC_Create,	"Create",	DoCreate,	TRUE,  0, 0 },
+    { SC_Remove,	"Remove",	DoRemove,	TRUE,  0, 0 },
+    { SC_Rename,	"Rename",	DoRename,	TRUE,  0, 0 },
+    { SC_Mkdir,		"Mkdir",	DoMkdir,	TRUE,  0, 0 },
+    { SC_ReadDir,	"ReadDir",	DoReadDir,	TRUE,  0, 0 },
+    { SC_Open,		"Open",		DoOpen,		TRUE,  0, 0 },
+    { SC_Read,		"Read",		DoRead,		TRUE,  0, 0 },
+    { SC_Write,		"Write",	DoWrite,	TRUE,  0, 0 },
+    { SC_ReadV,		"ReadV",	DoReadV,	TRUE,  0, 0 },
+    { SC_WriteV,	"WriteV",	DoWriteV,	TRUE,  0, 0 },
+    { SC_Seek,		"Seek",		DoSeek,		TRUE,  0, 0 },
+    { SC_FileSize,	"FileSize",	DoFileSize,	TRUE,  0, 0 },
+    { SC_CopyRange,	"CopyRange",	DoCopyRange,	TRUE,  0, 0 },
+    { SC_Preallocate,	"Preallocate",	DoPreallocate,	TRUE,  0, 0 },
+    { SC_Pipe,		"Pipe",		DoPipe,		FALSE, 0, 0 },
+    { SC_RingSetup,	"RingSetup",	DoRingSetup,	FALSE, 0, 0 },
+    { SC_RingSubmit,	"RingSubmit",	DoRingSubmit,	FALSE, 0, 0 },
+    { SC_Close,		"Close",	DoClose,	TRUE,  0, 0 },
+    { SC_Fsync,		"Fsync",	DoFsync,	TRUE,  0, 0 },
+    { SC_SetPriority,	"SetPriority",	DoSetPriority,	FALSE, 0, 0 },
+    { SC_SetTickets,	"SetTickets",	DoSetTickets,	FALSE, 0, 0 },
+    { SC_SetIoClass,	"SetIoClass",	DoSetIoClass,	FALSE, 0, 0 },
+    { SC_Sleep,		"Sleep",	DoSleep,	FALSE, 0, 0 },
+    { SC_GetUsage,	"GetUsage",	DoGetUsage,	FALSE, 0, 0 },
+    { SC_GetNetStats,	"GetNetStats",	DoGetNetStats,	FALSE, 0, 0 },
+    { SC_PutString,	"PutString",	DoPutString,	FALSE, 0, 0 },
+    { SC_ReadLine,	"ReadLine",	DoReadLine,	FALSE, 0, 0 },
+    { SC_GetFsStats,	"GetFsStats",	DoGetFsStats,	FALSE, 0, 0 },
+    { SC_GetStats,	"GetStats",	DoGetStats,	FALSE, 0, 0 },
+    { SC_Mmap,		"Mmap",		DoMmap,		FALSE, 0, 0 },
+    { SC_Munmap,	"Munmap",	DoMunmap,	FALSE, 0, 0 },
+    { SC_Sbrk,		"Sbrk",		DoSbrk,		FALSE, 0, 0 },
+    { SC_Checkpoint,	"Checkpoint",	DoCheckpoint,	FALSE, 0, 0 },
+    { SC_ShmCreate,	"ShmCreate",	DoShmCreate,	FALSE, 0, 0 },
+    { SC_ShmAttach,	"ShmAttach",	DoShmAttach,	FALSE, 0, 0 },
+    { SC_ShmDetach,	"ShmDetach",	DoShmDetach,	FALSE, 0, 0 },
+    { SC_FutexWait,	"FutexWait",	DoFutexWait,	FALSE, 0, 0 },
+    { SC_FutexWake,	"FutexWake",	DoFutexWake,	FALSE, 0, 0 },
+    { SC_ThreadFork,	"ThreadFork",	DoThreadFork,	FALSE, 0, 0 },
+    { SC_ThreadYield,	"ThreadYield",	DoThreadYield,	FALSE, 0, 0 },
+    { SC_ThreadJoin,	"ThreadJoin",	DoThreadJoin,	FALSE, 0, 0 },
+    { SC_ThreadExit,	"ThreadExit",	DoThreadExit,	FALSE, 0, 0 },
+    { SC_Add,		"Add",		DoAdd,		FALSE, 0, 0 },
+    { SC_MSG,		"MSG",		DoMSG,		FALSE, 0, 0 },
+};
+
+#define NumSyscalls	((int) (sizeof(syscalls) / sizeof(syscalls[0])))
+
+static SyscallEntry *syscallTable[NumSyscallCodes];	// by SC_* code
+static bool tableBuilt = FALSE;
+
+//----------------------------------------------------------------------
+// BuildSyscallTable
+// 	Index the entries of "syscalls" by code, the first time a system
+//	call is made.
+//----------------------------------------------------------------------
+
+static void
+BuildSyscallTable()
+{
+    for (int i = 0; i < NumSyscalls; i++) {
+	ASSERT(syscalls[i].code >= 0 && syscalls[i].code < NumSyscallCodes);
+	syscallTable[syscalls[i].code] = &syscalls[i];
+    }
+    tableBuilt = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FindSyscall
+// 	Return the table entry for system call "code", or NULL if there
+//	is no such call.
+//----------------------------------------------------------------------
+
+static SyscallEntry *
+FindSyscall(int code)
+{
+    if (!tableBuilt)
+	BuildSyscallTable();
+    return (code >= 0 && code < NumSyscallCodes) ? syscallTable[code] : NULL;
+}
+
+//----------------------------------------------------------------------
+// RunSyscall
+// 	Call the handler of "entry" with "args", and count the call and
+//	the ticks it took.  Whatever the call takes from the thread's
+//	scratch arena is given back as it returns.
+//----------------------------------------------------------------------
+
+static int
+RunSyscall(SyscallEntry *entry, int *args)
+{
+    ArenaMark mark(kernel->currentThread->Scratch());
+    int start = kernel->stats->totalTicks;
+    int result;
+
+    entry->count++;
+    TRACE(dbgSys, (TraceSyscall, entry->code));
+    result = (*entry->handler)(args);
+    TRACE(dbgSys, (TraceSyscallDone, entry->code, result));
+    if (kernel->replay != NULL)
+	kernel->replay->Syscall(entry->code, result);
+    entry->ticks += kernel->stats->totalTicks - start;
+    return result;
+}
+
+//----------------------------------------------------------------------
+// RingSyscall
+// 	Carry out system call "code", taken from a program's system call
+//	ring, with "args".  Return its result, or -1 if it cannot be made
+//	through a ring.
+//----------------------------------------------------------------------
+
+int
+RingSyscall(int code, int *args)
+{
+    SyscallEntry *entry = FindSyscall(code);
+
+    if (entry == NULL || !entry->ringed)
+	return -1;
+    DEBUG(dbgSys, "Ring call " << entry->name);
+    return RunSyscall(entry, args);
+}
+
+//----------------------------------------------------------------------
+// PrintSyscallStats
+// 	Print how many times each system call was made, and the ticks
+//	the calls took on average.
+//----------------------------------------------------------------------
+
+void
+PrintSyscallStats()
+{
+    printf("System calls:\n");
+    for (int i = 0; i < NumSyscalls; i++)
+	if (syscalls[i].count > 0)
+	    printf("  %-10s %d calls, %d ticks each\n", syscalls[i].name,
+		   syscalls[i].count, syscalls[i].ticks / syscalls[i].count);
+}
+
+//----------------------------------------------------------------------
+// Fault
+// 	The running thread did something no program may: say what, and
+//	end it through Exit with FaultStatus, as if it had called Exit
+//	itself.  The kernel, and every other program, run on.
+//----------------------------------------------------------------------
+
+static void
+Fault(const char *what, int value)
+{
+    kernel->synchConsoleOut->Flush();	// keep the program's output first
+    cerr << what << " " << value << " in " << kernel->currentThread->getName()
+	 << ", killed\n";
+    SysExit(FaultStatus);
+    ASSERTNOTREACHED();
+}
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 // 	Entry point into the Nachos kernel.  Called when a user program
@@ -45,139 +653,52 @@
 // before returning. (Or else you'll loop making the same system call forever!)
 //
 //	"which" is the kind of exception.  The list of possible exceptions 
-//	is in machine.h.
+//	is in machine.h.  A fault the program cannot recover from ends the
+//	thread that made it (see Fault).
 //----------------------------------------------------------------------
 
 void
 ExceptionHandler(ExceptionType which)
 {
     int type = kernel->machine->ReadRegister(2);
-	int val;
-    int status, exit, threadID, programID;
-	DEBUG(dbgSys, "Received Exception " << which << " type: " << type << "\n");
-    switch (which) {
-    case SyscallException:
-      	switch(type) {
-      	case SC_Halt:
-			DEBUG(dbgSys, "Shutdown, initiated by user program.\n");
-			SysHalt();
-                        cout<<"in exception\n";
-			ASSERTNOTREACHED();
-			break;
-		case SC_MSG:
-			DEBUG(dbgSys, "Message received.\n");
-			val = kernel->machine->ReadRegister(4);
-			{
-			char *msg = &(kernel->machine->mainMemory[val]);
-			cout << msg << endl;
-			}
-			SysHalt();
-			ASSERTNOTREACHED();
-			break;
-		case SC_Create:
-			val = kernel->machine->ReadRegister(4);
-			{
-			char *filename = &(kernel->machine->mainMemory[val]);
-			//cout << filename << endl;
-			status = SysCreate(filename, kernel->machine->ReadRegister(5));
-			kernel->machine->WriteRegister(2, (int) status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
-			return;
-			ASSERTNOTREACHED();
-            break;
-        case SC_Open:
-            val = kernel->machine->ReadRegister(4);
-            {
-            char *filename = &(kernel->machine->mainMemory[val]);
-            status = SysOpen(filename);
-            kernel->machine->WriteRegister(2, (int) status);
-            }
-            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
-			return;
-			ASSERTNOTREACHED();
-            break;
-        case SC_Read:
-            val = kernel->machine->ReadRegister(4);
-            {
-            char *buf = &(kernel->machine->mainMemory[val]);
-            status = SysRead(buf, kernel->machine->ReadRegister(5), kernel->machine->ReadRegister(6));
-            kernel->machine->WriteRegister(2, (int) status);
-            }
-            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
-			return;
-			ASSERTNOTREACHED();
-            break;
-        case SC_Write:
-            val = kernel->machine->ReadRegister(4);
-            {
-            char *buf = &(kernel->machine->mainMemory[val]);
-            status = SysWrite(buf, kernel->machine->ReadRegister(5), kernel->machine->ReadRegister(6));
-            kernel->machine->WriteRegister(2, (int) status);
-            }
-            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
-			return;
-			ASSERTNOTREACHED();
-            break;
-        case SC_Close:
-            val = kernel->machine->ReadRegister(4);
-            {
-            status = SysClose(val);
-            kernel->machine->WriteRegister(2, (int) status);
-            }
-            kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
-			return;
-			ASSERTNOTREACHED();
-            break;
-      	case SC_Add:
-			DEBUG(dbgSys, "Add " << kernel->machine->ReadRegister(4) << " + " << kernel->machine->ReadRegister(5) << "\n");
-			/* Process SysAdd Systemcall*/
-			int result;
-			result = SysAdd(/* int op1 */(int)kernel->machine->ReadRegister(4),
-			/* int op2 */(int)kernel->machine->ReadRegister(5));
-			DEBUG(dbgSys, "Add returning with " << result << "\n");
-			/* Prepare Result */
-			kernel->machine->WriteRegister(2, (int)result);	
-			/* Modify return point */
-			{
-	  		/* set previous programm counter (debugging only)*/
-	  		kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-	  			
-			/* set programm counter to next instruction (all Instructions are 4 byte wide)*/
-	  		kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-	  
-	 		/* set next programm counter for brach execution */
-	 		kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
-			}
-			cout << "result is " << result << "\n";	
-			return;	
-			ASSERTNOTREACHED();
-            break;
-		case SC_Exit:
-			DEBUG(dbgAddr, "Program exit\n");
-            val=kernel->machine->ReadRegister(4);
-            cout << "return value:" << val << endl;
-			kernel->currentThread->Finish();
-            break;
-      	default:
-			cerr << "Unexpected system call " << type << "\n";
-			break;
-		}
-		break;
-	default:
-		cerr << "Unexpected user mode exception " << (int)which << "\n";
-		break;
+    SyscallEntry *entry;
+
+    if (which == PageFaultException) {	// the instruction is retried
+	int vaddr = kernel->machine->ReadRegister(BadVAddrReg);
+	TRACE(dbgAddr, (TracePageFault, vaddr, 0));
+	if (!kernel->currentThread->space->PageIn(vaddr / PageSize,
+						  kernel->machine->storeFault)) {
+	    Fault("Page fault outside the address space at", vaddr);
+	}
+	if (kernel->machine->tlb != NULL)	// or it was a TLB miss
+	    kernel->currentThread->space->RefillTLB(vaddr / PageSize);
+	return;
     }
-    ASSERTNOTREACHED();
-}
+    if (which == ReadOnlyException) {	// likewise, once it has a copy
+	int vaddr = kernel->machine->ReadRegister(BadVAddrReg);
+	TRACE(dbgAddr, (TracePageFault, vaddr, 1));
+	if (!kernel->currentThread->space->CopyOnWrite(vaddr / PageSize)) {
+	    Fault("Write to a read-only page at", vaddr);
+	}
+	return;
+    }
+    if (which != SyscallException) {
+	Fault("Unexpected user mode exception", (int) which);
+    }
+    entry = FindSyscall(type);
+    if (entry == NULL) {
+	Fault("Unexpected system call", type);
+    }
+
+    int args[4];
+    for (int i = 0; i < 4; i++)
+	args[i] = kernel->machine->ReadRegister(4 + i);
+    kernel->machine->WriteRegister(2, RunSyscall(entry, args));
 
+    /* set previous programm counter (debugging only)*/
+    kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+    /* set programm counter to next instruction (all Instructions are 4 byte wide)*/
+    kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+    /* set next programm counter for brach execution */
+    kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg)+4);
+}
@@ -0,0 +1,906 @@
+// frames.cc
+//	Routines to allocate the pages of physical memory to user
+//	programs, to share them among programs, and to take them back
+//	when memory is full.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "frames.h"
+#include "addrspace.h"
+#include "synch.h"
+#include "tlb.h"
+#include "synchdisk.h"
+#include "openfile.h"
+
+//----------------------------------------------------------------------
+// FrameAllocator::FrameAllocator
+// 	Initialize an allocator with all "numFrames" frames of physical
+//	memory free.  They are stacked so that the lowest is taken first.
+//
+//	"policy" -- how to choose the page to take a frame back from
+//----------------------------------------------------------------------
+
+FrameAllocator::FrameAllocator(int numFrames, ReplacePolicy policy)
+{
+    this->numFrames = numFrames;
+    this->policy = policy;
+    inUse = new Bitmap(numFrames);
+    freeFrames = new int[numFrames];
+    for (int i = 0; i < numFrames; i++)
+	freeFrames[i] = numFrames - 1 - i;
+    numFree = numFrames;
+    zeroed = new Bitmap(numFrames);	// as memory starts out
+    for (int i = 0; i < numFrames; i++)
+	zeroed->Mark(i);
+    numZeroed = numFrames;
+    frames = new FrameEntry[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+	frames[i].sharers = NULL;
+	frames[i].cached = FALSE;
+	frames[i].filling = FALSE;
+	frames[i].referenced = FALSE;
+    }
+    numCached = 0;
+    fileSectors = new Bitmap(MaxStripeDisks * MaxTracks * SectorsPerTrack);
+					// however big the volume is
+    hand = 0;
+    numTaken = 0;
+    pagingLock = new Lock("paging");
+    pageOut = NULL;
+    pageOutWakeup = NULL;
+    pageOutPending = FALSE;
+    lowWater = highWater = 0;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::~FrameAllocator
+// 	De-allocate the allocator.
+//----------------------------------------------------------------------
+
+FrameAllocator::~FrameAllocator()
+{
+    delete inUse;
+    delete zeroed;
+    delete fileSectors;
+    delete [] freeFrames;
+    for (int i = 0; i < numFrames; i++)
+	delete frames[i].sharers;
+    delete [] frames;
+    delete pagingLock;
+    delete pageOutWakeup;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::TakeFrame
+// 	Take the frame on top of the free stack, or if there is none, one
+//	taken back -- a cached frame not read from lately if there is one,
+//	or else from the page the replacement policy chooses (see Reclaim),
+//	or if every such page is pinned, any cached frame -- zero it,
+//	unless it was zeroed while free, and return its number.  Taking a frame
+//	back may block, so the caller must hold the paging lock.  The
+//	pageout thread, if there is one, is woken when few frames are
+//	left, to free some before the next fault has to.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::TakeFrame()
+{
+    int frame;
+    bool clean = FALSE;
+
+    ASSERT(pagingLock->IsHeldByCurrentThread());
+    if (numFree > 0) {
+	frame = freeFrames[--numFree];
+	ASSERT(!inUse->Test(frame));
+	inUse->Mark(frame);
+	if (zeroed->Test(frame)) {
+	    zeroed->Clear(frame);
+	    numZeroed--;
+	    clean = TRUE;
+	}
+    } else {
+	frame = (numCached > 0) ? TakeCached() : -1;
+	if (frame < 0)
+	    frame = Reclaim();
+	if (frame < 0)			// the rest are all pinned
+	    frame = TakeCached();
+	ASSERT(frame >= 0);
+    }
+    frames[frame].owner = NULL;
+    frames[frame].page = NULL;
+    frames[frame].sharers = NULL;
+    frames[frame].loadedAt = numTaken++;
+    frames[frame].pinned = 0;
+    frames[frame].filling = FALSE;
+    frames[frame].referenced = FALSE;
+    if (!clean)
+	bzero(&kernel->machine->mainMemory[frame * PageSize], PageSize);
+    if (pageOut != NULL && !pageOutPending &&
+	    numFree + numCached < lowWater) {
+	pageOutPending = TRUE;
+	pageOutWakeup->V();
+    }
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Reclaim
+// 	Take back the frame of the page the replacement policy chooses
+//	(see Evict), and return its number, still marked in use; or -1
+//	if every frame in use is pinned or cached.  The TLB is flushed
+//	first, so that it keeps no translation to the frame, and the use
+//	and dirty bits in the page tables are those the hardware set.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::Reclaim()
+{
+    int frame;
+
+    if (kernel->tlbManager != NULL)	// bring the bits up to date
+	kernel->tlbManager->Flush();
+    frame = ChooseVictim();
+    if (frame >= 0)
+	Evict(frame);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Evict
+// 	Take "frame" back from the pages mapping it, leaving it in use,
+//	with the paging lock held.  A private page is paged out by its
+//	owner, which may block writing it (and the dirty pages next to
+//	it) to swap.  The pages sharing a frame are just made invalid;
+//	they can be read in again from their file -- after the frame is
+//	written back to it, if a program wrote to the page through a
+//	mapping.  The TLB must keep no translation to the frame.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Evict(int frame)
+{
+    FrameEntry *f = &frames[frame];
+
+    ASSERT(pagingLock->IsHeldByCurrentThread() && Reclaimable(frame));
+    if (f->sharers != NULL) {
+	bool dirty = Dirty(frame);
+
+	DEBUG(dbgAddr, "Taking back shared frame " << frame);
+	while (!f->sharers->IsEmpty()) {
+	    TranslationEntry *page = f->sharers->RemoveFront();
+	    page->valid = FALSE;
+	    page->dirty = FALSE;
+	    page->physicalPage = -1;
+	}
+	delete f->sharers;
+	f->sharers = NULL;
+	if (dirty && f->sector >= 0)
+	    WriteBack(frame, f->sector, f->filePage);
+    } else {
+	DEBUG(dbgAddr, "Taking back frame " << frame
+	      << " from virtual page " << f->page->virtualPage);
+	f->owner->PageOut(f->page->virtualPage);
+    }
+    kernel->stats->numPageEvictions++;
+}
+
+//----------------------------------------------------------------------
+// PageOutThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the loop of the pageout thread.
+//----------------------------------------------------------------------
+
+static void
+PageOutThread(FrameAllocator *frames)
+{
+    frames->PageOut();
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::StartPageOut
+// 	Fork the pageout thread.  From now on, a frame taken that leaves
+//	fewer than "low" free (or cached) wakes it, to take frames back
+//	until "high" are.  In a small memory, at most half the frames
+//	are kept free.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::StartPageOut(int low, int high)
+{
+    ASSERT(pageOut == NULL && low > 0 && high >= low);
+    highWater = min(high, numFrames / 2);
+    lowWater = min(low, highWater);
+    pageOutWakeup = new Semaphore("pageout", 0);
+    pageOut = new Thread("pageout", -1);
+    pageOut->Fork((VoidFunctionPtr) PageOutThread, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::PageOut
+// 	Loop forever, waiting to be woken up and then taking frames back,
+//	as a fault would, and freeing them, until highWater frames are
+//	free or cached, or nothing more can be.  Dirty pages are written
+//	to swap now, ahead of the faults that will want their frames,
+//	which then find a frame ready without waiting for a write.  The
+//	paging lock is let go between frames, so that faults are not
+//	held up for long.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::PageOut()
+{
+    int frame = 0;
+
+    for (;;) {
+	pageOutWakeup->P();
+	DEBUG(dbgAddr, "Pageout pass, " << numFree << " frames free");
+	while (frame >= 0 && numFree + numCached < highWater) {
+	    pagingLock->Acquire();
+	    if (numFree + numCached < highWater) {
+		frame = Reclaim();
+		if (frame >= 0)
+		    Free(frame);
+	    }
+	    pagingLock->Release();
+	}
+	frame = 0;
+	pageOutPending = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::TakeCached
+// 	Take back a cached frame, the next one on from the clock hand, for
+//	TakeFrame to use again.  Those ReadAt has read from since the
+//	last time are passed over, as the clock passes over pages that
+//	were used, their bits cleared; return -1 if all of them were.
+//	Cached frames are clean, so none need writing back.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::TakeCached()
+{
+    for (int i = 0; i < numFrames; i++) {
+	int frame = (hand + i) % numFrames;
+
+	if (!frames[frame].cached) {
+	    continue;
+	} else if (frames[frame].referenced) {
+	    frames[frame].referenced = FALSE;
+	} else {
+	    DEBUG(dbgAddr, "Taking back cached frame " << frame);
+	    frames[frame].cached = FALSE;
+	    numCached--;
+	    delete frames[frame].sharers;
+	    frames[frame].sharers = NULL;
+	    hand = (frame + 1) % numFrames;
+	    return frame;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Allocate
+// 	Take a zeroed frame for "page" of the address space "owner", and
+//	return its number.  The caller must hold the paging lock.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::Allocate(AddrSpace *owner, TranslationEntry *page)
+{
+    int frame = TakeFrame();
+
+    frames[frame].owner = owner;
+    frames[frame].page = page;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::AllocateShared
+// 	Take a zeroed frame to hold page "filePage" of the file whose
+//	header is at "sector", for the caller to read in and Share, and
+//	return its number.  Till it is shared, ReadAt does not copy from
+//	it.  The caller must hold the paging lock.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::AllocateShared(int sector, int filePage)
+{
+    int frame = TakeFrame();
+
+    frames[frame].sharers = new List<TranslationEntry *>;
+    frames[frame].sector = sector;
+    frames[frame].filePage = filePage;
+    frames[frame].filling = TRUE;
+    if (sector >= 0)
+	fileSectors->Mark(sector);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::FindShared
+// 	Return the frame holding page "filePage" of the file whose header
+//	is at "sector", for sharing, or -1 if none does.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::FindShared(int sector, int filePage)
+{
+    for (int i = 0; i < numFrames; i++)
+	if (inUse->Test(i) && frames[i].sharers != NULL &&
+		frames[i].sector == sector && frames[i].filePage == filePage)
+	    return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::FindFilePage
+// 	Return the frame holding page "filePage" of the file whose header
+//	is at "sector", for ReadAt and WriteAt, or -1 if none does, or the
+//	one that does is still being read in.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::FindFilePage(int sector, int filePage)
+{
+    int frame = FindShared(sector, filePage);
+
+    if (frame >= 0 && frames[frame].filling)
+	return -1;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::ZeroFrame
+// 	Return the frame of zeroes that pages not written to yet share,
+//	taking one if it was taken back, or never taken.  It is shared
+//	as the pages of executables are, and so is cached, or taken back,
+//	as they are.  The caller must hold the paging lock.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::ZeroFrame()
+{
+    int frame = FindShared(ZeroSector, 0);
+
+    if (frame < 0)
+	frame = AllocateShared(ZeroSector, 0);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Share/Unshare
+// 	Map "page" to the shared "frame", read-only unless "writable" (a
+//	page of a mapped file); or take it off the frame, which is kept,
+//	cached, when the last page mapping it goes -- unless a new file
+//	has been made at its file's header since, when it is freed.
+//
+//	A page written to leaves the frame dirty: the pages still mapping
+//	it carry that, and the last to go writes it back to the file, so
+//	that cached frames are always clean.  That may block, with the
+//	paging lock held.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Share(int frame, TranslationEntry *page, bool writable)
+{
+    ASSERT(inUse->Test(frame) && frames[frame].sharers != NULL);
+    if (frames[frame].cached) {
+	DEBUG(dbgAddr, "Reusing cached frame " << frame);
+	frames[frame].cached = FALSE;
+	numCached--;
+    }
+    frames[frame].filling = FALSE;
+    frames[frame].sharers->Append(page);
+    page->physicalPage = frame;
+    page->readOnly = !writable;
+    page->use = FALSE;
+    page->referenced = FALSE;
+    page->dirty = FALSE;
+    page->valid = TRUE;
+}
+
+void
+FrameAllocator::Unshare(int frame, TranslationEntry *page)
+{
+    FrameEntry *f = &frames[frame];
+
+    ASSERT(inUse->Test(frame) && f->sharers != NULL);
+    f->sharers->Remove(page);
+    if (page->dirty && !f->sharers->IsEmpty()) {
+	f->sharers->Front()->dirty = TRUE;
+    } else if (page->dirty && f->sector >= 0) {
+	DEBUG(dbgAddr, "Writing back shared frame " << frame);
+	WriteBack(frame, f->sector, f->filePage);
+    }
+    page->dirty = FALSE;
+    if (!f->sharers->IsEmpty())
+	return;
+    if (f->sector == -1) {
+	Free(frame);
+    } else {
+	f->cached = TRUE;
+	numCached++;
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::ForgetImage
+// 	A new file is being made with its header at "sector": stop
+//	sharing the frames holding the file that was there, so no program
+//	run from now on sees its pages.  Frames no one maps are freed; the
+//	rest stay with the programs mapping them, till those let them go,
+//	and are never written back.
+//
+//	It returns at once unless some frame may hold a page of a file at
+//	this sector.  It does not take the paging lock, which a program
+//	loading a page holds while it reads the file; it never blocks, so
+//	nothing else runs while it changes the frames.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::ForgetImage(int sector)
+{
+    if (!HoldsFile(sector))
+	return;
+    fileSectors->Clear(sector);
+    for (int i = 0; i < numFrames; i++) {
+	FrameEntry *f = &frames[i];
+
+	if (inUse->Test(i) && f->sharers != NULL && f->sector == sector) {
+	    f->sector = -1;
+	    if (f->cached)
+		Free(i);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::CopyCached
+// 	Copy into "into" the bytes from "position" on, "numBytes" of them,
+//	of the file whose header is at "sector", that frames hold -- as a
+//	program mapping the file sees them, which the file may not yet --
+//	leaving the rest of "into" alone.  If "onlyIfAll", copy nothing
+//	unless frames hold every one of the bytes.  Return TRUE if any
+//	were copied.  The frames copied from count as used.
+//
+//	Called on every read of a file, so it returns at once unless
+//	some frame may hold a page of it.  Like ForgetImage, it never
+//	blocks, and so takes no lock.
+//----------------------------------------------------------------------
+
+bool
+FrameAllocator::CopyCached(int sector, char *into, int numBytes,
+			   int position, bool onlyIfAll)
+{
+    char *mem = kernel->machine->mainMemory;
+    int firstPage = divRoundDown(position, PageSize);
+    int lastPage = divRoundDown(position + numBytes - 1, PageSize);
+    bool copied = FALSE;
+
+    if (numBytes <= 0 || !HoldsFile(sector))
+	return FALSE;
+    if (onlyIfAll)
+	for (int p = firstPage; p <= lastPage; p++)
+	    if (FindFilePage(sector, p) < 0)
+		return FALSE;
+    for (int p = firstPage; p <= lastPage; p++) {
+	int frame = FindFilePage(sector, p);
+	int start = max(position, p * PageSize);
+	int end = min(position + numBytes, (p + 1) * PageSize);
+
+	if (frame < 0)
+	    continue;
+	bcopy(&mem[frame * PageSize + start - p * PageSize],
+	      &into[start - position], end - start);
+	frames[frame].referenced = TRUE;
+	copied = TRUE;
+    }
+    return copied;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::FileWritten
+// 	"numBytes" bytes, from "from", were just written to the file whose
+//	header is at "sector", at "position": copy them into the frames
+//	holding those pages of it, so the programs mapping them see the
+//	write, and ReadAt does not copy back what was there.  Frames
+//	holding pages of it as an executable read segment by segment,
+//	which are not its pages as they are, are forgotten instead, as
+//	ForgetImage does.
+//
+//	Called on every write to a file, so it returns at once unless
+//	some frame may hold a page of it; it never blocks.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::FileWritten(int sector, char *from, int numBytes,
+			    int position)
+{
+    char *mem = kernel->machine->mainMemory;
+
+    if (numBytes <= 0 || !HoldsFile(sector))
+	return;
+    for (int i = 0; i < numFrames; i++) {
+	FrameEntry *f = &frames[i];
+	int start, end;
+	char *to;
+
+	if (!inUse->Test(i) || f->sharers == NULL || f->sector != sector)
+	    continue;
+	if (f->filePage < 0) {
+	    f->sector = -1;
+	    if (f->cached)
+		Free(i);
+	    continue;
+	}
+	start = max(position, f->filePage * PageSize);
+	end = min(position + numBytes, (f->filePage + 1) * PageSize);
+	to = &mem[i * PageSize + start - f->filePage * PageSize];
+	if (start < end && to != &from[start - position])
+	    bcopy(&from[start - position], to, end - start);
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::WriteBack
+// 	Write dirty "frame" to page "filePage" of the file whose header
+//	is at "sector" -- as much of it as is in the file now, the rest
+//	being zeroed again -- keeping it pinned meanwhile, with the
+//	paging lock held.  The frame is its own source, so WriteAt's copy
+//	into the frames skips it.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::WriteBack(int frame, int sector, int filePage)
+{
+#ifndef FILESYS_STUB
+    char *page = &kernel->machine->mainMemory[frame * PageSize];
+    OpenFile *file = new OpenFile(sector);
+    int bytes = max(0, min(PageSize, file->Length() - filePage * PageSize));
+
+    ASSERT(pagingLock->IsHeldByCurrentThread() && filePage >= 0);
+    DEBUG(dbgAddr, "Writing frame " << frame << " to page " << filePage
+	  << " of its file");
+    Pin(frame);
+    if (bytes > 0)
+	file->WriteAt(page, bytes, filePage * PageSize);
+    bzero(&page[bytes], PageSize - bytes);
+    Unpin(frame);
+    delete file;
+    kernel->stats->numFileWriteBacks++;
+#endif
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::MakePrivate
+// 	Give the shared "frame", with just one page mapping it left, to
+//	that page of "owner", as when the owner writes to it: no one else
+//	needs the frame as it was.  Making the page writable is up to the
+//	owner.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::MakePrivate(int frame, AddrSpace *owner)
+{
+    FrameEntry *f = &frames[frame];
+
+    ASSERT(inUse->Test(frame) && f->sharers != NULL &&
+	   f->sharers->NumInList() == 1 && f->sharers->Front()->readOnly);
+    f->page = f->sharers->RemoveFront();
+    f->owner = owner;
+    delete f->sharers;
+    f->sharers = NULL;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Free
+// 	Give back "frame", which must be in use, to be taken next.  A
+//	caller giving back a run of frames should do so from the last
+//	to the first, so that they are taken again in order.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Free(int frame)
+{
+    ASSERT(frame >= 0 && frame < numFrames && inUse->Test(frame));
+    ASSERT(frames[frame].pinned == 0);
+    inUse->Clear(frame);
+    if (frames[frame].cached) {
+	frames[frame].cached = FALSE;
+	numCached--;
+    }
+    frames[frame].owner = NULL;
+    frames[frame].page = NULL;
+    delete frames[frame].sharers;
+    frames[frame].sharers = NULL;
+    freeFrames[numFree++] = frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::ZeroFreeFrames
+// 	Zero each free frame that is not zero already, so that taking it
+//	later needs no clearing.  Called when the machine is idle, with
+//	nothing else running; so it takes no lock.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::ZeroFreeFrames()
+{
+    for (int i = numFree - 1; i >= 0 && numZeroed < numFree; i--) {
+	int frame = freeFrames[i];
+
+	if (!zeroed->Test(frame)) {
+	    bzero(&kernel->machine->mainMemory[frame * PageSize], PageSize);
+	    zeroed->Mark(frame);
+	    numZeroed++;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Pin/Unpin
+// 	Keep "frame" from being taken back while the kernel reads or
+//	writes it in place, which may block; and let it go again.  Pins
+//	nest.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Pin(int frame)
+{
+    ASSERT(frame >= 0 && frame < numFrames && inUse->Test(frame));
+    frames[frame].pinned++;
+}
+
+void
+FrameAllocator::Unpin(int frame)
+{
+    ASSERT(frame >= 0 && frame < numFrames && frames[frame].pinned > 0);
+    frames[frame].pinned--;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Used/ClearUsed/Dirty
+// 	The use and dirty bits of a frame, from the translations of the
+//	page (or pages, if it is shared) mapping it.  A shared frame
+//	ReadAt has read from counts as used too.  Only the pages of a
+//	mapped file are ever shared writable, and so dirty.
+//----------------------------------------------------------------------
+
+bool
+FrameAllocator::Used(int frame)
+{
+    FrameEntry *f = &frames[frame];
+
+    if (f->sharers == NULL)
+	return f->page->use;
+    if (f->referenced)
+	return TRUE;
+    for (ListIterator<TranslationEntry *> it(f->sharers); !it.IsDone();
+	    it.Next())
+	if (it.Item()->use)
+	    return TRUE;
+    return FALSE;
+}
+
+void
+FrameAllocator::ClearUsed(int frame)
+{
+    FrameEntry *f = &frames[frame];
+
+    if (f->sharers == NULL) {
+	f->page->use = FALSE;
+	return;
+    }
+    f->referenced = FALSE;
+    for (ListIterator<TranslationEntry *> it(f->sharers); !it.IsDone();
+	    it.Next())
+	it.Item()->use = FALSE;
+}
+
+bool
+FrameAllocator::Dirty(int frame)
+{
+    FrameEntry *f = &frames[frame];
+
+    if (f->sharers == NULL)
+	return f->page->dirty;
+    for (ListIterator<TranslationEntry *> it(f->sharers); !it.IsDone();
+	    it.Next())
+	if (it.Item()->dirty)
+	    return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::ChooseVictim
+// 	Return the frame to take back, memory being full, according to
+//	the replacement policy, or -1 if there is none.  Pinned frames are
+//	passed over; there is nearly always some other, since the kernel
+//	pins only the few frames of the buffers it is moving, and shared
+//	memory segments.  So are free frames, when the pageout thread is
+//	looking, and cached ones, which it counts as free.
+//
+//	The clock hand goes around the frames, clearing the use bits of
+//	those it passes over, so that a page survives only if it was used
+//	again since the hand last came by.  The enhanced clock goes around
+//	up to four times: looking for a page neither used nor dirty,
+//	without clearing anything; then for one dirty but not used,
+//	clearing use bits; then the same two again, which must succeed.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::ChooseVictim()
+{
+    int victim = -1;
+
+    switch (policy) {
+      case FifoReplace:
+	for (int i = 0; i < numFrames; i++)
+	    if (Reclaimable(i) && (victim < 0 ||
+		    frames[i].loadedAt < frames[victim].loadedAt))
+		victim = i;
+	break;
+      case ClockReplace:
+	for (int n = 0; n < 2 * numFrames && victim < 0; n++) {
+	    if (Reclaimable(hand)) {
+		if (Used(hand))
+		    ClearUsed(hand);
+		else
+		    victim = hand;
+	    }
+	    hand = (hand + 1) % numFrames;
+	}
+	break;
+      case EnhancedClockReplace:
+	for (int pass = 0; pass < 4 && victim < 0; pass++)
+	    for (int n = 0; n < numFrames && victim < 0; n++) {
+		if (Reclaimable(hand)) {
+		    if (!Used(hand) && Dirty(hand) == (pass % 2 == 1))
+			victim = hand;
+		    else if (pass % 2 == 1)
+			ClearUsed(hand);
+		}
+		hand = (hand + 1) % numFrames;
+	    }
+	break;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::SelfTest
+// 	Check that frames are taken lowest first, that frames given back
+//	are taken again in order, that each policy chooses the page it
+//	should, that a shared frame lasts as long as its sharers, and
+//	that it is cached after them till a new file is made in place of
+//	its own; that reads and writes of the file see the frames, and a
+//	cached frame read from lately is not taken back first; and that
+//	free frames are zeroed while idle, and the frame of zeroes
+//	shared.  Leaves the allocator as it found it, and so must be run
+//	before any program is loaded.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::SelfTest()
+{
+    TranslationEntry *pages = new TranslationEntry[numFrames];
+    int *taken = new int[numFrames];
+    ReplacePolicy saved = policy;
+    char *mem = kernel->machine->mainMemory;
+    char buf[8], xy[] = "XY";
+    int frame;
+
+    ASSERT(numFree == numFrames);
+    pagingLock->Acquire();
+    for (int i = 0; i < numFrames; i++) {
+	pages[i].virtualPage = i;
+	pages[i].use = pages[i].dirty = FALSE;
+	taken[i] = Allocate(NULL, &pages[i]);
+	ASSERT(taken[i] == i);
+    }
+    ASSERT(NumFree() == 0);
+    for (int i = 7; i >= 3; i--)
+	Free(taken[i]);
+    for (int i = 3; i <= 7; i++)
+	ASSERT(Allocate(NULL, &pages[i]) == i);
+
+    policy = FifoReplace;		// 3 to 7 were taken again last
+    ASSERT(ChooseVictim() == 0);
+    Pin(0);
+    ASSERT(ChooseVictim() == 1);
+    Unpin(0);
+
+    policy = ClockReplace;
+    hand = 0;
+    for (int i = 0; i < 10; i++)
+	pages[i].use = TRUE;
+    ASSERT(ChooseVictim() == 10 && !pages[0].use && !pages[9].use);
+
+    policy = EnhancedClockReplace;
+    for (int i = 0; i < numFrames; i++)
+	pages[i].dirty = TRUE;
+    pages[20].dirty = FALSE;
+    pages[20].use = TRUE;
+    pages[30].dirty = FALSE;
+    ASSERT(ChooseVictim() == 30);	// the first clean one not used
+    pages[30].dirty = TRUE;
+    pages[31].use = TRUE;
+    ASSERT(ChooseVictim() == 32 && !pages[31].use);
+
+    policy = saved;
+    hand = 0;
+    for (int i = numFrames - 1; i >= 0; i--)
+	Free(taken[i]);
+
+    ASSERT(AllocateShared(50, 2) == 0 && FindShared(50, 2) == 0);
+    ASSERT(FindShared(50, 3) == -1 && FindShared(51, 2) == -1);
+    Share(0, &pages[0]);
+    Share(0, &pages[1]);
+    ASSERT(NumSharers(0) == 2 && pages[1].readOnly &&
+	   pages[1].physicalPage == 0);
+    Unshare(0, &pages[0]);
+    MakePrivate(0, NULL);		// the last sharer writes to it
+    ASSERT(FindShared(50, 2) == -1 && frames[0].page == &pages[1]);
+    Free(0);
+    ASSERT(AllocateShared(50, 2) == 0);
+    Share(0, &pages[2]);
+    Unshare(0, &pages[2]);		// the last sharer goes
+    ASSERT(NumCached() == 1 && FindShared(50, 2) == 0);
+    Share(0, &pages[3]);		// and the next one finds it
+    ASSERT(NumCached() == 0 && NumSharers(0) == 1);
+    Unshare(0, &pages[3]);
+    ForgetImage(51);
+    ASSERT(NumCached() == 1);
+    ForgetImage(50);			// a new file is made there
+    ASSERT(NumCached() == 0 && FindShared(50, 2) == -1);
+    ASSERT(NumFree() == numFrames);
+
+    frame = AllocateShared(60, 1);	// still being read in
+    bcopy("abcdefgh", &mem[frame * PageSize], 8);
+    ASSERT(!CopyCached(60, buf, 4, PageSize + 4, FALSE));
+    Share(frame, &pages[0], TRUE);	// mapped, and written to
+    ASSERT(!pages[0].readOnly && !CopyCached(60, buf, 8, 0, FALSE));
+    ASSERT(!CopyCached(60, buf, 8, PageSize - 4, TRUE));
+    ASSERT(CopyCached(60, buf, 8, PageSize - 4, FALSE) &&
+	   strncmp(&buf[4], "abcd", 4) == 0);
+    FileWritten(60, xy, 2, PageSize + 5);
+    ASSERT(CopyCached(60, buf, 4, PageSize + 4, TRUE) &&
+	   strncmp(buf, "eXYh", 4) == 0);
+    Unshare(frame, &pages[0]);
+    ASSERT(NumCached() == 1);
+    ASSERT(TakeCached() == -1);		// it was read from lately
+    ASSERT(TakeCached() == frame && NumCached() == 0);
+    Free(frame);
+    frame = AllocateShared(61, -1 - 3);	// an executable read by segment
+    Share(frame, &pages[0]);
+    Unshare(frame, &pages[0]);
+    FileWritten(61, xy, 2, 3 * PageSize);
+    ASSERT(NumCached() == 0 && FindShared(61, -1 - 3) == -1);
+    ForgetImage(60);
+    ForgetImage(61);
+    ASSERT(NumFree() == numFrames);
+
+    ASSERT(NumZeroed() == 0);		// every frame was taken since
+    ZeroFreeFrames();			// the machine idles
+    ASSERT(NumZeroed() == numFrames);
+    frame = ZeroFrame();
+    ASSERT(HoldsZeroes(frame) && ZeroFrame() == frame &&
+	   NumZeroed() == numFrames - 1);
+    Share(frame, &pages[0]);
+    Share(frame, &pages[1]);
+    Unshare(frame, &pages[0]);
+    MakePrivate(frame, NULL);		// the last sharer writes to it
+    ASSERT(!HoldsZeroes(frame) && FindShared(ZeroSector, 0) == -1);
+    Free(frame);
+    ASSERT(NumFree() == numFrames);
+    pagingLock->Release();
+    ASSERT(NumFree() == numFrames);
+    delete [] taken;
+    delete [] pages;
+}
@@ -0,0 +1,228 @@
+// frames.h
+//	Data structures to keep track of the pages of physical memory
+//	given to user programs.
+//
+//	A bitmap records which frames are in use, and a stack holds the
+//	free ones, so that taking or giving back a frame takes constant
+//	time while there are free frames.  Frames given back are reused
+//	first, in the order they were given back in, so a program that
+//	follows another gets mostly the same, consecutive frames.
+//
+//	When memory is full, a frame is taken back from some page, which
+//	is written to the swap area first if it changed (see swap.h).  The
+//	page is chosen by the replacement policy, from the use and dirty
+//	bits the hardware sets in the page's translation.  Frames the
+//	kernel is moving data in or out of are pinned, and never taken.
+//
+//	So that a fault seldom has to wait for that, a pageout thread
+//	keeps a few frames free: woken when fewer than a low watermark
+//	are left, it takes frames back the same way, writing dirty pages
+//	out ahead of need, until a high watermark are free.
+//
+//	A page read from a program's executable can be shared by all the
+//	programs running the same executable: the frame records which page
+//	of which executable it holds, and the translations mapping it.  They
+//	are all read-only; a program writing to one (initialized data) gets
+//	a copy of its own.
+//
+//	When the last program mapping a shared frame lets it go, the frame
+//	is kept, cached, for the next program to run the executable, which
+//	then maps its pages without reading them again.  Making a new file
+//	at the executable's header's sector forgets its frames (see
+//	ForgetImage).
+//
+//	The same frames are the page cache of every file: a frame holds
+//	page "filePage" of the file whose header is at "sector", and is
+//	found by that.  The pages of a mapped file are shared this way,
+//	writable, so that all the programs mapping it see each other's
+//	writes; so are the pages of an executable laid out as memory is,
+//	which are pages of its file too (an executable read segment by
+//	segment has its pages under negative numbers, which no file page
+//	has).  ReadAt copies from the frames of the file that hold what it
+//	reads rather than from the buffer cache, and WriteAt copies what
+//	it writes into them, so a read sees what a program wrote to a
+//	mapped page, and a mapped page what was written (see CopyCached,
+//	FileWritten); a write to an executable read segment by segment
+//	forgets its frames instead.  A dirty frame is written to its file
+//	when it is taken back, or when the last page mapping it goes, so
+//	cached frames are always clean.
+//	The buffer cache below still holds the sectors; those read to fill
+//	a frame are the first it replaces, so they are not kept twice.
+//
+//	Cached frames are the first taken back when no frame is free,
+//	before the replacement policy looks at a page any program is
+//	using -- but one that ReadAt has used since the clock hand last
+//	passed it gets a second chance, as a page that was used does, and
+//	if all of them have, a page in use is taken back instead.  A
+//	mapped frame ReadAt has used counts as used, too.  So a file being
+//	read stays in memory as much as a program's pages do.
+//
+//	Pages that start out zero -- uninitialized data, stacks, the heap
+//	-- are shared the same way until written to, all mapping one frame
+//	of zeroes, as if it held a page of an executable at ZeroSector.  A
+//	frame is zeroed as it is taken, but the free frames are zeroed
+//	ahead of time while the machine is idle, so that a page fault
+//	seldom waits for it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include "bitmap.h"
+#include "translate.h"
+#include "list.h"
+
+class AddrSpace;
+class Lock;
+class Semaphore;
+class Thread;
+
+#define ZeroSector	-2		// the "file" the shared frame of
+					// zeroes holds
+#define PageOutLow	4		// frames free (or cached) below which
+					// the pageout thread is woken
+#define PageOutHigh	8		// and that it frees up to
+
+// How the page to take a frame back from is chosen.
+
+enum ReplacePolicy {
+    FifoReplace,		// the page loaded longest ago
+    ClockReplace,		// second chance: sweep the frames, passing
+				// over (and clearing) those recently used
+    EnhancedClockReplace	// the same, sweeping first for pages
+				// neither used nor dirty, then for those
+				// dirty but not used, so that clean pages,
+				// which need not be written out, go first
+};
+
+// The following class defines the use of one physical page.
+
+class FrameEntry {
+  public:
+    AddrSpace *owner;			// The address space it belongs to,
+    TranslationEntry *page;		// and its page there
+    List<TranslationEntry *> *sharers;	// Or, if shared, the pages mapping
+    int sector;				// it, and which page of which file
+    int filePage;			// (by its header's sector) it holds
+    int loadedAt;			// When it was taken, for FIFO
+    int pinned;				// How many times it is pinned
+    bool cached;			// Shared, but mapped by no page
+    bool filling;			// Shared, but not read in yet
+    bool referenced;			// Read from by ReadAt since the
+					// clock hand passed it
+};
+
+// The following class defines the allocator of physical pages.
+
+class FrameAllocator {
+  public:
+    FrameAllocator(int numFrames, ReplacePolicy policy = ClockReplace);
+					// All "numFrames" frames free
+    ~FrameAllocator();
+
+    int Allocate(AddrSpace *owner, TranslationEntry *page);
+					// Take a frame for "page", zeroed,
+					// taking one back if none is free
+    void Free(int frame);		// Give "frame" back
+    void Evict(int frame);		// Take it back from its pages
+    int NumFree() { return numFree; }	// Frames free
+
+    int AllocateShared(int sector, int filePage);
+					// Take a frame to share page
+					// "filePage" of the file at "sector"
+    int FindShared(int sector, int filePage);
+					// The frame that holds it, or -1
+    int ZeroFrame();			// The shared frame of zeroes,
+					// taking one if there is none
+    bool HoldsZeroes(int frame)		// Is it that frame?
+	{ return frames[frame].sharers != NULL &&
+		 frames[frame].sector == ZeroSector; }
+    void Share(int frame, TranslationEntry *page, bool writable = FALSE);
+					// Map "page" to "frame", read-only
+					// unless "writable"
+    bool IsShared(int frame) { return frames[frame].sharers != NULL; }
+    bool HoldsFile(int sector)		// May some frame hold a page of
+					// the file at "sector"?
+	{ return sector >= 0 && fileSectors->Test(sector); }
+    void Unshare(int frame, TranslationEntry *page);
+					// Unmap it; the last to go frees
+					// the frame
+    int NumSharers(int frame) { return frames[frame].sharers->NumInList(); }
+    void MakePrivate(int frame, AddrSpace *owner);
+					// Turn a frame left with one sharer
+					// into that sharer's own
+    void ForgetImage(int sector);	// A new file is made at "sector":
+					// share none of the frames holding
+					// the old one from now on
+    bool CopyCached(int sector, char *into, int numBytes, int position,
+		    bool onlyIfAll);	// Copy the bytes of the file at
+					// "sector" its frames hold
+    void FileWritten(int sector, char *from, int numBytes, int position);
+					// Bring its frames up to date with
+					// a write
+    int NumCached() { return numCached; }
+					// Frames kept for no one
+
+    void Pin(int frame);		// Keep "frame" from being taken
+    void Unpin(int frame);		// back, while kernel I/O uses it
+    bool Pinned(int frame) { return frames[frame].pinned > 0; }
+
+    void ZeroFreeFrames();		// Zero the free frames not zeroed
+					// yet, while the machine is idle
+    int NumZeroed() { return numZeroed; }
+					// Free frames zeroed already
+
+    Lock *PagingLock() { return pagingLock; }
+					// Held while paging, so that one
+					// page moves in or out at a time
+    void StartPageOut(int low, int high);
+    					// Fork the pageout thread
+    void PageOut();			// Its loop: keep "high" frames free
+
+    void SelfTest();			// Test the allocator
+
+  private:
+    int TakeFrame();			// A free frame, or one taken back
+    int TakeCached();			// A cached frame, to use again, or
+					// -1 if all were read from lately
+    int FindFilePage(int sector, int filePage);
+					// The frame holding that page, read
+					// in, or -1
+    void WriteBack(int frame, int sector, int filePage);
+					// Write a dirty frame to its file
+    int Reclaim();			// Take back the frame of some page
+    int ChooseVictim();			// The frame to take back
+    bool Reclaimable(int frame)		// May it be?
+	{ return inUse->Test(frame) && frames[frame].pinned == 0 &&
+		 !frames[frame].cached; }
+    bool Used(int frame);		// Was it used since last cleared?
+    void ClearUsed(int frame);
+    bool Dirty(int frame);		// Does it need writing back?
+
+    Bitmap *inUse;			// Frames taken
+    int *freeFrames;			// Stack of the free frames; the
+    int numFree;			// top is at freeFrames[numFree - 1]
+    Bitmap *zeroed;			// Free frames known to be zero
+    int numZeroed;
+    int numCached;			// Shared frames no one maps
+    Bitmap *fileSectors;		// The sectors of the files shared
+					// frames may hold
+    int numFrames;
+    FrameEntry *frames;			// Who uses each frame
+    ReplacePolicy policy;
+    int hand;				// Next frame for the clock to look at
+    int numTaken;			// Frames taken so far, to order FIFO
+    Lock *pagingLock;
+    Thread *pageOut;			// The pageout thread, or NULL
+    Semaphore *pageOutWakeup;		// Wakes it
+    bool pageOutPending;		// Woken, and not done yet
+    int lowWater, highWater;		// Free frames that wake it, and
+					// that it frees up to
+};
+
+#endif // FRAMES_H
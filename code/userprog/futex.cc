@@ -0,0 +1,133 @@
+// futex.cc
+//	Routines for user programs to wait on words of memory, and to
+//	wake those waiting (see futex.h).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "futex.h"
+#include "addrspace.h"
+#include "frames.h"
+#include "synch.h"
+
+static int QueueKey(FutexQueue *q) { return q->address; }
+static unsigned QueueHash(int address) { return (unsigned) address; }
+
+//----------------------------------------------------------------------
+// FutexTable::FutexTable
+// 	Initialize a table with no one waiting.
+//----------------------------------------------------------------------
+
+FutexTable::FutexTable()
+{
+    queues = new OpenHashTable<int, FutexQueue *>(QueueKey, QueueHash);
+}
+
+//----------------------------------------------------------------------
+// FutexTable::~FutexTable
+// 	De-allocate the table, and the queues of any programs still
+//	waiting at Halt.
+//----------------------------------------------------------------------
+
+FutexTable::~FutexTable()
+{
+    while (!queues->IsEmpty()) {
+	OpenHashIterator<int, FutexQueue *> iter(queues);
+	FutexQueue *q = iter.Item();
+
+	queues->Remove(q->address);
+	delete q->waiters;
+	delete q;
+    }
+    delete queues;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wait
+// 	If the running program's word at "vaddr" holds "expected", sleep
+//	till FutexWake on it, and return 1; or return 0 at once if it
+//	holds something else, as when the lock it is a part of has been
+//	let go meanwhile.  Return -1 if "vaddr" is not a word the program
+//	may write.
+//
+//	Translating the word may page it in, and block; but from then on
+//	nothing else runs till the program is queued, so no one can
+//	change the word and wake the queue in between.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wait(int vaddr, int expected)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    unsigned int paddr;
+    IntStatus oldLevel;
+    FutexQueue *q;
+    Semaphore *woken;
+    int value;
+
+    if (vaddr < 0 || vaddr % 4 != 0 ||
+	    space->Translate(vaddr, &paddr, 1) != NoException)
+	return -1;
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    value = WordToHost(*(unsigned int *) &kernel->machine->mainMemory[paddr]);
+    if (value != expected) {
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	return 0;
+    }
+    if (!queues->Find(paddr, &q)) {
+	q = new FutexQueue;
+	q->address = paddr;
+	q->waiters = new List<Semaphore *>;
+	queues->Insert(q);
+    }
+    woken = new Semaphore("futex", 0);
+    q->waiters->Append(woken);
+    kernel->frameAllocator->Pin(paddr / PageSize);
+    DEBUG(dbgSys, "Waiting on the word at " << paddr);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    woken->P();
+    kernel->frameAllocator->Unpin(paddr / PageSize);
+    delete woken;
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wake
+// 	Wake up to "count" of the programs waiting on the running
+//	program's word at "vaddr" -- those that came first -- and return
+//	how many were woken; -1 if "vaddr" is not a word the program may
+//	write.  Interrupts are off while the queue is changed, so that no
+//	waiter woken runs, and waits again, meanwhile.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wake(int vaddr, int count)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    unsigned int paddr;
+    IntStatus oldLevel;
+    FutexQueue *q;
+    int n = 0;
+
+    if (vaddr < 0 || vaddr % 4 != 0 ||
+	    space->Translate(vaddr, &paddr, 1) != NoException)
+	return -1;
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    if (queues->Find(paddr, &q)) {
+	while (n < count && !q->waiters->IsEmpty()) {
+	    q->waiters->RemoveFront()->V();
+	    n++;
+	}
+	if (q->waiters->IsEmpty()) {
+	    queues->Remove(paddr);
+	    delete q->waiters;
+	    delete q;
+	}
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    DEBUG(dbgSys, "Woke " << n << " waiting on the word at " << paddr);
+    return n;
+}
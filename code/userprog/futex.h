@@ -0,0 +1,60 @@
+// futex.h
+//	Data structures for user programs waiting on words of memory.
+//
+//	A futex is any word of a program's memory: FutexWait sleeps if
+//	the word holds the value the program expects, till FutexWake on
+//	the same word wakes it (see syscall.h).  Programs keep their own
+//	locks in such words, changing them with LL and SC, so they need
+//	the kernel only to wait for a lock someone else holds, and to wake
+//	whoever waits for it.
+//
+//	The waiters on each word are queued by the word's physical
+//	address, so that programs sharing the word in a shared memory
+//	segment find the same queue.  A waiter pins the word's frame
+//	till it is woken, so the address stays where it is; and both
+//	waiting and waking translate the word as if writing it, so that a
+//	page shared copy-on-write is copied first, rather than waited on
+//	in the frame the program is about to leave.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "list.h"
+#include "openhash.h"
+
+class Semaphore;
+
+// The following class defines the waiters on one word.
+
+class FutexQueue {
+  public:
+    int address;			// The word, in physical memory
+    List<Semaphore *> *waiters;		// Each waiter's own, in the order
+					// they came to wait
+};
+
+// The following class defines the queues of all the words waited on.
+
+class FutexTable {
+  public:
+    FutexTable();			// No one waiting
+    ~FutexTable();
+
+    int Wait(int vaddr, int expected);	// Sleep, if the running program's
+					// word at "vaddr" is "expected",
+					// till woken: 1; 0 if it was not;
+					// -1 if "vaddr" is no such word
+    int Wake(int vaddr, int count);	// Wake up to "count" of those
+					// waiting on it; how many were
+
+  private:
+    OpenHashTable<int, FutexQueue *> *queues;	// by address
+};
+
+#endif // FUTEX_H
@@ -14,6 +14,14 @@
 #include "kernel.h"
 
 #include "synchconsole.h"
+#include "ptable.h"
+#include "shm.h"
+#include "futex.h"
+#include "ring.h"
+#include "bufcache.h"
+#include "dcache.h"
+#include "ftable.h"
+#include "directory.h"
 
 typedef int OpenFileId;	
 
@@ -22,6 +30,66 @@ void SysHalt()
   kernel->interrupt->Halt();
 }
 
+SpaceId SysExec(char *name)
+{
+  return kernel->interrupt->Exec(name);
+}
+
+SpaceId SysExecWith(char *name, OpenFileId input, OpenFileId output)
+{
+  return kernel->interrupt->ExecWith(name, input, output);
+}
+
+int SysJoin(SpaceId id)
+{
+  return kernel->interrupt->Join(id);
+}
+
+// Exit ends the calling thread; the program is done once the last of
+// its threads is.  Exit then gives back everything the program holds
+// -- its poller, its open files and its memory -- before its parent is
+// woken, so a parent that joins it sees the files closed.  With -st or
+// -d a, what it did in memory is printed first.
+
+void SysExit(int status)
+{
+  Thread *thread = kernel->currentThread;
+  AddrSpace *space = thread->space;
+  SpaceId id = space->GetId();
+
+  if (space->EndThread(status) > 0) {
+    thread->space = NULL;
+    thread->Finish();
+  }
+  if (space->GetRing() != NULL)
+    space->GetRing()->StopPoller();
+  if (kernel->statsFlag || debug->IsEnabled(dbgAddr)) {
+    char title[64];
+
+    sprintf(title, "Process %.50s", thread->getName());
+    space->Usage()->Print(title);
+  }
+  thread->space = NULL;
+  delete space;
+  kernel->processTable->Exit(id, status);
+  thread->Finish();
+}
+
+ThreadId SysThreadFork(int func, int arg, int root)
+{
+  return kernel->ThreadFork(func, arg, root);
+}
+
+void SysThreadYield()
+{
+  kernel->currentThread->Yield();
+}
+
+int SysThreadJoin(ThreadId id)
+{
+  return kernel->currentThread->space->JoinThread(id);
+}
+
 int SysAdd(int op1, int op2)
 {
   return op1 + op2;
@@ -39,16 +107,470 @@ OpenFileId SysOpen(char *name) {
     return kernel->interrupt->myOpen(name);
 }
 
-int SysRead(char *buffer, int size, OpenFileId id) {
-    return kernel->interrupt->Read(buffer, size, id);
+// Read and Write move the data straight between the file system and
+// the frames of the user buffer at "buffer", a run of contiguous
+// memory at a time.  They stop at a bad address, returning what was
+// moved before it (or -1, if nothing was).  The frames of a run are
+// pinned while the file system moves it, since that may block.
+
+int SysRead(int buffer, int size, OpenFileId id) {
+    AddrSpace *space = kernel->currentThread->space;
+    int done = 0, run, n;
+    char *at;
+
+    if (size <= 0)
+        return kernel->interrupt->Read(NULL, 0, id);
+    for (; done < size; done += n) {
+        run = space->UserRun(buffer + done, size - done, TRUE, &at);
+        if (run < 0)
+            return (done > 0) ? done : -1;
+        space->Pin(buffer + done, run);
+        n = kernel->interrupt->Read(at, run, id);
+        space->Unpin(buffer + done, run);
+        if (n < 0)
+            return -1;
+        if (n < run)
+            return done + n;		// end of file
+    }
+    return done;
 }
 
-int SysWrite(char *buffer, int size, OpenFileId id) {
-    return kernel->interrupt->Write(buffer, size, id);
+int SysWrite(int buffer, int size, OpenFileId id) {
+    AddrSpace *space = kernel->currentThread->space;
+    int done = 0, run, n;
+    char *at;
+
+    if (size <= 0)
+        return kernel->interrupt->Write(NULL, 0, id);
+    for (; done < size; done += n) {
+        run = space->UserRun(buffer + done, size - done, FALSE, &at);
+        if (run < 0)
+            return (done > 0) ? done : -1;
+        space->Pin(buffer + done, run);
+        n = kernel->interrupt->Write(at, run, id);
+        space->Unpin(buffer + done, run);
+        if (n < 0)
+            return -1;
+        if (n < run)
+            return done + n;		// disk full
+    }
+    return done;
+}
+
+// ReadV and WriteV take a user vector of "count" (buffer, length)
+// pairs, two words each.  A lone piece is moved as by Read or Write;
+// otherwise the pieces are gathered into (or scattered from) a kernel
+// buffer of up to IoVecChunk bytes, so that the file sees one request
+// for each chunk of them, and its sectors move in runs rather than
+// piece by piece.  The vector itself, a bad piece, or pieces adding up
+// to more than MaxIoVecBytes fail the call before any of the file is
+// moved.
+
+#define IoVecChunk	(4 * PageSize)	// most bytes gathered at a time
+#define MaxIoVecBytes	(1 << 30)	// most bytes in all the pieces
+
+static int *
+SysFetchVec(int vec, int count, bool writing, int *total)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    int *pairs;
+    char *at;
+
+    if (count <= 0 || count > MaxIoVecs)
+        return NULL;
+    pairs = new int[2 * count];
+    if (!space->CopyIn(vec, (char *) pairs, 2 * count * sizeof(int))) {
+        delete [] pairs;
+        return NULL;
+    }
+    *total = 0;
+    for (int i = 0; i < count; i++) {
+        int len = pairs[2 * i + 1];
+        bool bad = (len < 0 || len > MaxIoVecBytes - *total);
+
+        for (int done = 0, run; !bad && done < len; done += run) {
+            run = space->UserRun(pairs[2 * i] + done, len - done, writing,
+                                 &at);
+            bad = (run < 0);
+        }
+        if (bad) {
+            delete [] pairs;
+            return NULL;
+        }
+        *total += len;
+    }
+    return pairs;
+}
+
+// Move "len" bytes between "buf" and the pieces, from byte "*offset"
+// of piece "*piece" on, and advance the two past them.
+
+static bool
+SysCopyVec(int *pairs, int *piece, int *offset, char *buf, int len,
+           bool toUser)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    bool ok;
+
+    for (int done = 0, n; done < len; done += n) {
+        while (*offset == pairs[2 * *piece + 1]) {
+            (*piece)++;			// spent, or empty
+            *offset = 0;
+        }
+        n = min(len - done, pairs[2 * *piece + 1] - *offset);
+        if (toUser)
+            ok = space->CopyOut(&buf[done], pairs[2 * *piece] + *offset, n);
+        else
+            ok = space->CopyIn(pairs[2 * *piece] + *offset, &buf[done], n);
+        if (!ok)
+            return FALSE;
+        *offset += n;
+    }
+    return TRUE;
+}
+
+int SysReadV(int vec, int count, OpenFileId id) {
+    int total, n, chunk, done = 0, piece = 0, offset = 0;
+    int *pairs = SysFetchVec(vec, count, TRUE, &total);
+    char *buf;
+
+    if (pairs == NULL)
+        return -1;
+    if (count == 1) {
+        n = SysRead(pairs[0], pairs[1], id);
+        delete [] pairs;
+        return n;
+    }
+    if (total == 0) {
+        delete [] pairs;
+        return kernel->interrupt->Read(NULL, 0, id);
+    }
+    buf = new char[min(total, IoVecChunk)];
+    for (; done < total; done += n) {
+        chunk = min(total - done, IoVecChunk);
+        n = kernel->interrupt->Read(buf, chunk, id);
+        if (n < 0 || !SysCopyVec(pairs, &piece, &offset, buf, n, TRUE)) {
+            n = -1;
+            break;
+        }
+        if (n < chunk) {
+            done += n;			// end of file
+            break;
+        }
+    }
+    delete [] buf;
+    delete [] pairs;
+    return (n < 0 && done == 0) ? -1 : done;
+}
+
+int SysWriteV(int vec, int count, OpenFileId id) {
+    int total, n, chunk, done = 0, piece = 0, offset = 0;
+    int *pairs = SysFetchVec(vec, count, FALSE, &total);
+    char *buf;
+
+    if (pairs == NULL)
+        return -1;
+    if (count == 1) {
+        n = SysWrite(pairs[0], pairs[1], id);
+        delete [] pairs;
+        return n;
+    }
+    if (total == 0) {
+        delete [] pairs;
+        return kernel->interrupt->Write(NULL, 0, id);
+    }
+    buf = new char[min(total, IoVecChunk)];
+    for (; done < total; done += n) {
+        chunk = min(total - done, IoVecChunk);
+        if (!SysCopyVec(pairs, &piece, &offset, buf, chunk, FALSE)) {
+            n = -1;
+            break;
+        }
+        n = kernel->interrupt->Write(buf, chunk, id);
+        if (n < 0)
+            break;
+        if (n < chunk) {
+            done += n;			// disk full
+            break;
+        }
+    }
+    delete [] buf;
+    delete [] pairs;
+    return (n < 0 && done == 0) ? -1 : done;
 }
 
 int SysClose(OpenFileId id) {
     return kernel->interrupt->Close(id);
 }
 
+int SysFsync(OpenFileId id) {
+    return kernel->interrupt->Fsync(id);
+}
+
+int SysSeek(int offset, int whence, OpenFileId id) {
+    return kernel->interrupt->Seek(offset, whence, id);
+}
+
+int SysFileSize(OpenFileId id) {
+    return kernel->interrupt->FileSize(id);
+}
+
+int SysCopyRange(OpenFileId from, OpenFileId to, int size) {
+    return kernel->interrupt->CopyRange(from, to, size);
+}
+
+int SysPreallocate(OpenFileId id, int size, int flags) {
+    return kernel->interrupt->Preallocate(id, size, flags);
+}
+
+int SysPipe(int ids) {
+    int pair[2];
+
+    if (kernel->interrupt->MakePipe(pair) < 0)
+        return -1;
+    if (!kernel->currentThread->space->CopyOut((char *) pair, ids,
+                                               sizeof(pair))) {
+        kernel->interrupt->Close(pair[0]);
+        kernel->interrupt->Close(pair[1]);
+        return -1;
+    }
+    return 1;
+}
+
+int SysMkdir(char *name) {
+    return kernel->interrupt->CreateDir(name);
+}
+
+// ReadDir takes the entries into kernel buffers, and copies them out
+// to the program as DirEntry records, with the new cursor, at the end.
+
+int SysReadDir(char *name, int entries, int count, int cursor) {
+    AddrSpace *space = kernel->currentThread->space;
+    DirectoryEntry *found;
+    DirEntry *out;
+    int *sizes;
+    int at, n;
+
+    if (count < 0 || !space->CopyIn(cursor, (char *) &at, sizeof(at)))
+        return -1;
+    count = min(count, MaxReadDir);
+    found = new DirectoryEntry[count];
+    sizes = new int[count];
+    out = new DirEntry[count];
+    n = kernel->interrupt->ReadDir(name, &at, found, sizes, count);
+    for (int i = 0; i < n; i++) {
+        ASSERT(DirNameMaxLen == FileNameMaxLen);
+        strncpy(out[i].name, found[i].name, DirNameMaxLen + 1);
+        out[i].type = found[i].type;
+        out[i].sector = found[i].sector;
+        out[i].size = sizes[i];
+    }
+    if (n >= 0 &&
+            (!space->CopyOut((char *) out, entries, n * sizeof(DirEntry)) ||
+             !space->CopyOut((char *) &at, cursor, sizeof(at))))
+        n = -1;
+    delete [] found;
+    delete [] sizes;
+    delete [] out;
+    return n;
+}
+
+int SysMmap(OpenFileId id) {
+    AddrSpace *space = kernel->currentThread->space;
+    OpenFile *file = space->GetFile(id);
+
+    if (file == NULL)
+        return -1;
+    return space->Map(file);
+}
+
+int SysMunmap(int addr) {
+    return kernel->currentThread->space->Unmap(addr) ? 0 : -1;
+}
+
+int SysSbrk(int increment) {
+    return kernel->currentThread->space->Sbrk(increment);
+}
+
+int SysCheckpoint(char *name) {
+    return kernel->currentThread->space->Checkpoint(name) ? 0 : -1;
+}
+
+int SysShmCreate(int size) {
+    int id = kernel->sharedMemory->Create(size);
+
+    if (id >= 0 && !kernel->currentThread->space->HoldSegment(id)) {
+        kernel->sharedMemory->Release(id);
+        return -1;
+    }
+    return id;
+}
+
+int SysShmAttach(int id, int addr) {
+    return kernel->currentThread->space->Attach(id, addr);
+}
+
+int SysShmDetach(int addr) {
+    return kernel->currentThread->space->Detach(addr) ? 0 : -1;
+}
+
+int SysFutexWait(int addr, int expected) {
+    return kernel->futexes->Wait(addr, expected);
+}
+
+int SysFutexWake(int addr, int count) {
+    return kernel->futexes->Wake(addr, count);
+}
+
+int SysRemove(char *name) {
+    return kernel->interrupt->RemoveFile(name);
+}
+
+int SysRename(char *from, char *to) {
+    return kernel->interrupt->RenameFile(from, to);
+}
+
+// A thread that lowers its priority gives the CPU to any thread that
+// now comes before it.  The old priority returned is its own, not what
+// it may have run at while holding a lock.
+
+int SysSetPriority(int priority) {
+    Thread *thread = kernel->currentThread;
+    int old = thread->getBasePriority();
+    int running = thread->getPriority();
+
+    if (priority < MinPriority || priority > MaxPriority)
+        return -1;
+    thread->setPriority(priority);
+    if (thread->getPriority() < running)
+        thread->Yield();
+    return old;
+}
+
+int SysSetTickets(int tickets) {
+    Thread *thread = kernel->currentThread;
+    int old = thread->tickets;
+
+    if (tickets < MinTickets || tickets > MaxTickets)
+        return -1;
+    thread->setTickets(tickets);
+    return old;
+}
+
+int SysSetIoClass(int ioClass) {
+    Thread *thread = kernel->currentThread;
+    int old = thread->ioClass;
+
+    if (ioClass < IoRealtime || ioClass > IoIdle)
+        return -1;
+    thread->ioClass = (IoClass) ioClass;
+    return old;
+}
+
+int SysSleep(int ticks) {
+    if (ticks < 0)
+        return -1;
+    kernel->alarm->WaitUntil(ticks);
+    return 0;
+}
+
+int SysGetUsage(int usage) {
+    ThreadUsage u = kernel->currentThread->Usage();
+    CpuUsage out;
+
+    out.userTicks = u.userTicks;
+    out.systemTicks = u.systemTicks;
+    out.readyTicks = u.readyTicks;
+    out.blockedTicks = u.blockedTicks;
+    out.voluntarySwitches = u.voluntarySwitches;
+    out.involuntarySwitches = u.involuntarySwitches;
+    if (!kernel->currentThread->space->CopyOut((char *) &out, usage,
+                                               sizeof(out)))
+        return -1;
+    return 0;
+}
+
+int SysGetNetStats(int stats) {
+    Statistics *s = kernel->stats;
+    NetStats out;
+
+    ASSERT(NetLatencyBuckets == NumAckLatencies &&
+           NetMailBoxes == NumMailBoxStats);
+    out.packetsSent = s->numPacketsSent;
+    out.packetsRecvd = s->numPacketsRecvd;
+    out.bytesSent = s->numBytesSent;
+    out.bytesRecvd = s->numBytesRecvd;
+    out.packetsDropped = s->numPacketsDropped;
+    out.packetsRefused = s->numPacketsRefused;
+    out.retransmits = s->numRetransmits;
+    for (int i = 0; i < NetLatencyBuckets; i++)
+        out.ackLatency[i] = s->ackLatencies[i];
+    for (int i = 0; i < NetMailBoxes; i++)
+        out.mailBoxDepth[i] = s->mailBoxDepths[i];
+    if (!kernel->currentThread->space->CopyOut((char *) &out, stats,
+                                               sizeof(out)))
+        return -1;
+    return 0;
+}
+
+int SysGetFsStats(int stats) {
+    Statistics *s = kernel->stats;
+    FsStats out;
+
+    ASSERT(FsNumOps == NumFsOps && FsCreateOp == FsCreate &&
+           FsLookupOp == FsLookup);
+    for (int i = 0; i < FsNumOps; i++) {
+        out.ops[i] = s->fsOps[i];
+        out.opTicks[i] = s->fsOpTicks[i];
+    }
+    out.lookupComponents = s->numLookupComponents;
+    out.userBytesRead = s->numUserBytesRead;
+    out.userBytesWritten = s->numUserBytesWritten;
+    out.diskBytesRead = s->numDiskReads * SectorSize;
+    out.diskBytesWritten = s->numDiskWrites * SectorSize;
+    out.bufferHits = kernel->bufferCache->Hits();
+    out.bufferMisses = kernel->bufferCache->Misses();
+    out.bufferEvictions = kernel->bufferCache->Evictions();
+    out.dentryHits = kernel->dentryCache->Hits();
+    out.dentryMisses = kernel->dentryCache->Misses();
+    out.dentryEvictions = kernel->dentryCache->Evictions();
+    out.headerHits = kernel->fileTable->Hits();
+    out.headerMisses = kernel->fileTable->Misses();
+    out.headerEvictions = kernel->fileTable->Evictions();
+    if (!kernel->currentThread->space->CopyOut((char *) &out, stats,
+                                               sizeof(out)))
+        return -1;
+    return 0;
+}
+
+int SysGetStats(int stats, int size) {
+    StatsSnapshot out;
+
+    kernel->stats->Snapshot(&out);
+    size = max(0, min(size, (int) sizeof(out)));
+    if (!kernel->currentThread->space->CopyOut((char *) &out, stats, size))
+        return -1;
+    return size;
+}
+
+int SysPutString(char *str) {
+    int n = strlen(str);
+
+    kernel->synchConsoleOut->PutString(str, n);
+    return n;
+}
+
+int SysReadLine(int buffer, int size) {
+    char line[ConsoleLineSize + 1];
+    int n;
+
+    if (size <= 0)
+        return -1;
+    n = kernel->synchConsoleIn->GetLine(line, min(size - 1, ConsoleLineSize));
+    line[n] = '\0';
+    if (!kernel->currentThread->space->CopyOut(line, buffer, n + 1))
+        return -1;
+    return n;
+}
+
 #endif /* ! __USERPROG_KSYSCALL_H__ */
@@ -5,9 +5,21 @@
  *	code (read-only), initialized data, and unitialized data
  */
 
+#ifndef NOFF_H
+#define NOFF_H
+
 #define NOFFMAGIC	0xbadfad 	/* magic number denoting Nachos 
 					 * object code file 
 					 */
+#define NOFFALIGNED	0x01000000	/* or'd into the magic number if the
+					 * file is laid out as memory is:
+					 * every segment's inFileAddr is its
+					 * virtualAddr plus the same multiple
+					 * of the page size, and the bytes
+					 * between segments are zero, so a
+					 * page is read whole from the file
+					 * (coff2noff -a)
+					 */
 
 typedef struct segment {
   int virtualAddr;		/* location of segment in virt addr space */
@@ -26,3 +38,5 @@ typedef struct noffHeader {
 				 * should be zero'ed before use 
 				 */
 } NoffHeader;
+
+#endif /* NOFF_H */
@@ -0,0 +1,177 @@
+// pipe.cc
+//	Routines for pipes between user programs (see pipe.h).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "pipe.h"
+#include "synch.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// PipeBuffer::PipeBuffer
+// 	Initialize an empty pipe.  Its ends are counted as they are
+//	opened.
+//----------------------------------------------------------------------
+
+PipeBuffer::PipeBuffer()
+{
+    head = count = 0;
+    readers = writers = 0;
+    lock = new Lock("pipe");
+    notEmpty = new Condition("pipe not empty");
+    notFull = new Condition("pipe not full");
+}
+
+PipeBuffer::~PipeBuffer()
+{
+    ASSERT(readers == 0 && writers == 0);
+    delete lock;
+    delete notEmpty;
+    delete notFull;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Read
+// 	Wait until there is data in the pipe, or no writer is left, and
+//	copy up to "numBytes" of it to "into".  Return how many bytes
+//	were copied: 0 means end of file.
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Read(char *into, int numBytes)
+{
+    int n;
+
+    lock->Acquire();
+    while (count == 0 && writers > 0 && numBytes > 0)
+	notEmpty->Wait(lock);
+    n = min(numBytes, count);
+    for (int done = 0; done < n; ) {	// at most two pieces
+	int piece = min(n - done, PipeSize - head);
+
+	bcopy(&buffer[head], &into[done], piece);
+	head = (head + piece) % PipeSize;
+	done += piece;
+    }
+    count -= n;
+    if (n > 0)
+	notFull->Broadcast(lock);
+    lock->Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Write
+// 	Copy the "numBytes" bytes at "from" into the pipe, waiting for
+//	readers to make room as it fills.  Return "numBytes"; or, if no
+//	reader is left, how many went in before that, or -1 if none did.
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Write(char *from, int numBytes)
+{
+    int done = 0;
+
+    lock->Acquire();
+    while (done < numBytes && readers > 0) {
+	if (count == PipeSize) {
+	    notFull->Wait(lock);
+	    continue;
+	}
+	int tail = (head + count) % PipeSize;
+	int piece = min(numBytes - done,
+			min(PipeSize - count, PipeSize - tail));
+
+	bcopy(&from[done], &buffer[tail], piece);
+	count += piece;
+	done += piece;
+	notEmpty->Broadcast(lock);
+    }
+    if (readers == 0 && done == 0)
+	done = -1;
+    lock->Release();
+    DEBUG(dbgSys, "Pipe write of " << numBytes << " bytes, " << done
+		  << " went in");
+    return done;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Open, PipeBuffer::Close
+// 	Count an end of the pipe opened, or closed.  Closing the last end
+//	on one side wakes whoever waits on the other: a reader to find
+//	end of file, a writer to fail.  Close returns TRUE once no end at
+//	all is left, and the pipe can go.
+//----------------------------------------------------------------------
+
+void
+PipeBuffer::Open(bool writing)
+{
+    lock->Acquire();
+    if (writing)
+	writers++;
+    else
+	readers++;
+    lock->Release();
+}
+
+bool
+PipeBuffer::Close(bool writing)
+{
+    bool last;
+
+    lock->Acquire();
+    if (writing) {
+	ASSERT(writers > 0);
+	if (--writers == 0)
+	    notEmpty->Broadcast(lock);
+    } else {
+	ASSERT(readers > 0);
+	if (--readers == 0)
+	    notFull->Broadcast(lock);
+    }
+    last = (readers == 0 && writers == 0);
+    lock->Release();
+    return last;
+}
+
+//----------------------------------------------------------------------
+// PipeEnd::PipeEnd, PipeEnd::~PipeEnd
+// 	Open, and close, one end of "pipe" for a program.
+//----------------------------------------------------------------------
+
+PipeEnd::PipeEnd(PipeBuffer *pipe, bool writing)
+{
+    this->pipe = pipe;
+    this->writing = writing;
+    pipe->Open(writing);
+}
+
+PipeEnd::~PipeEnd()
+{
+    if (pipe->Close(writing))
+	delete pipe;
+}
+
+//----------------------------------------------------------------------
+// PipeEnd::Read, PipeEnd::Write
+// 	Move data through the pipe, at the end it is meant for.
+//----------------------------------------------------------------------
+
+int
+PipeEnd::Read(char *into, int numBytes)
+{
+    if (writing)
+	return -1;
+    return pipe->Read(into, numBytes);
+}
+
+int
+PipeEnd::Write(char *from, int numBytes)
+{
+    if (!writing)
+	return -1;
+    return pipe->Write(from, numBytes);
+}
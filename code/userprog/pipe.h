@@ -0,0 +1,82 @@
+// pipe.h
+//	Data structures for pipes between user programs.
+//
+//	A pipe is a ring buffer in the kernel, with a read end and a
+//	write end (see Pipe in syscall.h).  A reader waits while the
+//	buffer is empty, and a writer while it is full, so a producer
+//	and a consumer move their data at memory speed, each waiting only
+//	for the other.  Once every write end is closed, a reader gets
+//	what is left and then end of file; once every read end is
+//	closed, a write fails.
+//
+//	A program names its ends by OpenFileIds from PipeIdBase on, above
+//	those of its own files.  ExecWith passes ends to a child as its
+//	console input and output, so programs that use the console can be
+//	run as the stages of a pipeline.  Each program has its own
+//	PipeEnd for the ends it holds, and the pipe counts them; an end
+//	is closed by Close, or when the program exits.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#define PipeSize	1024		// bytes a pipe buffers
+#define PipeIdBase	32		// OpenFileIds of pipe ends start here
+#define MaxPipeEnds	16		// pipe ends per address space
+
+class Lock;
+class Condition;
+
+// The following class defines a pipe: its buffer, and the ends that
+// are open on it.
+
+class PipeBuffer {
+  public:
+    PipeBuffer();			// An empty pipe, with no ends open
+    ~PipeBuffer();
+
+    int Read(char *into, int numBytes);	// Wait for data, and take up to
+					// "numBytes" of it; 0 once no
+					// writer is left
+    int Write(char *from, int numBytes);// Put all of it in, waiting for
+					// room; -1 if no reader is left
+    void Open(bool writing);		// Count an end opened, or closed;
+    bool Close(bool writing);		// TRUE once none is left at all
+
+  private:
+    char buffer[PipeSize];
+    int head;				// first byte not read yet
+    int count;				// bytes waiting to be read
+    int readers, writers;		// ends open on each side
+    Lock *lock;				// protects all of the above
+    Condition *notEmpty;		// signalled as data comes in
+    Condition *notFull;			// signalled as data goes out
+};
+
+// The following class defines one program's hold on one end of a
+// pipe.  Deleting it closes the end.
+
+class PipeEnd {
+  public:
+    PipeEnd(PipeBuffer *pipe, bool writing);
+    					// Open an end of "pipe"
+    ~PipeEnd();				// Close it; the last end frees
+					// the pipe
+
+    PipeEnd *Copy() { return new PipeEnd(pipe, writing); }
+    					// Another hold on the same end
+    bool IsWriteEnd() { return writing; }
+    int Read(char *into, int numBytes);	// -1 on a write end
+    int Write(char *from, int numBytes);// -1 on a read end
+
+  private:
+    PipeBuffer *pipe;
+    bool writing;			// the write end?
+};
+
+#endif // PIPE_H
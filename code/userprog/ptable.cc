@@ -0,0 +1,162 @@
+// ptable.cc
+//	Routines to manage the table of running user programs.
+//
+//	A program's entry is found by the SpaceId its address space
+//	keeps, so a system call from any of its threads knows which
+//	program made it.  Only the program that started a
+//	child may join it, and only once: the join takes the child's exit
+//	status and frees the entry.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "ptable.h"
+#include "synch.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ProcessTable::ProcessTable
+// 	Initialize an empty table of programs.
+//----------------------------------------------------------------------
+
+ProcessTable::ProcessTable()
+{
+    entries = new List<ProcessTableEntry *>;
+    nextId = 1;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::~ProcessTable
+// 	De-allocate the table, and whatever entries are left at shutdown.
+//----------------------------------------------------------------------
+
+ProcessTable::~ProcessTable()
+{
+    while (!entries->IsEmpty())
+	Drop(entries->Front());
+    delete entries;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Find/Self
+// 	Return the entry with SpaceId "id", or the one for the program
+//	the running thread is one of; NULL if there is none.
+//----------------------------------------------------------------------
+
+ProcessTableEntry *
+ProcessTable::Find(SpaceId id)
+{
+    ListIterator<ProcessTableEntry *> it(entries);
+
+    for (; !it.IsDone(); it.Next())
+	if (it.Item()->id == id)
+	    return it.Item();
+    return NULL;
+}
+
+ProcessTableEntry *
+ProcessTable::Self()
+{
+    AddrSpace *space = kernel->currentThread->space;
+
+    return (space == NULL) ? NULL : Find(space->GetId());
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Drop
+// 	Take entry "e" out of the table, and free it.
+//----------------------------------------------------------------------
+
+void
+ProcessTable::Drop(ProcessTableEntry *e)
+{
+    entries->Remove(e);
+    delete e->exited;
+    delete [] e->name;
+    delete e;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Add
+// 	Enter a new program, from executable "name", as a child of the
+//	running program (or of no one, if the kernel itself started it).
+//	Return its SpaceId.
+//
+//	"name" -- its threads' name, new'd; the table frees it with the
+//	entry, after the threads are gone
+//----------------------------------------------------------------------
+
+SpaceId
+ProcessTable::Add(char *name)
+{
+    ProcessTableEntry *e = new ProcessTableEntry;
+    ProcessTableEntry *parent = Self();
+
+    e->id = nextId++;
+    e->parent = (parent == NULL) ? 0 : parent->id;
+    e->running = TRUE;
+    e->name = name;
+    e->status = 0;
+    e->exited = new Semaphore("process exit", 0);
+    entries->Append(e);
+    return e->id;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Join
+// 	Wait until the running program's child "id" has exited, and
+//	return the status it passed to Exit.  Return -1 if "id" is not a
+//	child of the running program that has not been joined yet.
+//----------------------------------------------------------------------
+
+int
+ProcessTable::Join(SpaceId id)
+{
+    ProcessTableEntry *self = Self();
+    ProcessTableEntry *e = Find(id);
+    int status;
+
+    if (self == NULL || e == NULL || e->parent != self->id)
+	return -1;
+    e->exited->P();
+    status = e->status;
+    Drop(e);
+    return status;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Exit
+// 	Note that program "id", whose last thread is running, has exited
+//	with "status", waking its parent if it is waiting in Join.  Its
+//	children can no longer be joined.
+//
+//	Entries no one can join are dropped here too, but only those of
+//	programs that exited earlier: the running thread still goes by
+//	the name in its entry until it is deleted, after it finishes.
+//----------------------------------------------------------------------
+
+void
+ProcessTable::Exit(SpaceId id, int status)
+{
+    ProcessTableEntry *self = Find(id);
+    ListIterator<ProcessTableEntry *> it(entries);
+    List<ProcessTableEntry *> dead;
+
+    if (self == NULL)
+	return;
+    for (; !it.IsDone(); it.Next()) {
+	if (it.Item()->parent == self->id)
+	    it.Item()->parent = 0;
+	if (it.Item()->parent == 0 && !it.Item()->running)
+	    dead.Append(it.Item());
+    }
+    while (!dead.IsEmpty())
+	Drop(dead.RemoveFront());
+
+    self->running = FALSE;
+    self->status = status;
+    if (self->parent != 0)
+	self->exited->V();
+}
@@ -0,0 +1,61 @@
+// ptable.h
+//	Data structures for the table of running user programs.
+//
+//	Every program started by Exec -- from the command line, or by
+//	another program -- has an entry here, under the SpaceId Exec
+//	returned for it.  The entry outlives the program, holding its exit
+//	status, until the program that started it joins it; a program no
+//	one can join any more (its parent has exited, or it was started
+//	from the command line) is dropped soon after it exits.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef PTABLE_H
+#define PTABLE_H
+
+#include "list.h"
+#include "syscall.h"
+
+class Semaphore;
+
+// The following class defines one program in the table.
+
+class ProcessTableEntry {
+  public:
+    SpaceId id;				// What Exec returned for it
+    SpaceId parent;			// The program that may join it, or
+					// 0 if none
+    bool running;			// FALSE once it has exited
+    char *name;				// The executable's name, and its
+					// threads'
+    int status;				// What it passed to Exit
+    Semaphore *exited;			// Signalled when it exits
+};
+
+// The following class defines the table of user programs.
+
+class ProcessTable {
+  public:
+    ProcessTable();			// Create an empty table
+    ~ProcessTable();			// De-allocate the table
+
+    SpaceId Add(char *name);		// Enter a new program, started by
+					// the running one
+    int Join(SpaceId id);		// Wait for the running program's
+					// child "id", and return its status
+    void Exit(SpaceId id, int status);	// Program "id" is done
+
+  private:
+    ProcessTableEntry *Find(SpaceId id);
+    ProcessTableEntry *Self();		// The running program's entry
+    void Drop(ProcessTableEntry *e);	// Remove and free an entry
+
+    List<ProcessTableEntry *> *entries;	// The programs, by start order
+    SpaceId nextId;			// SpaceId of the next program
+};
+
+#endif // PTABLE_H
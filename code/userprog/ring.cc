@@ -0,0 +1,195 @@
+// ring.cc
+//	Routines to carry out the system calls a program queues in its
+//	system call ring.  See ring.h, and syscall.h for the layout of
+//	the ring.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "ring.h"
+#include "addrspace.h"
+#include "synch.h"
+
+#include <stddef.h>
+
+//----------------------------------------------------------------------
+// SyscallRing::SyscallRing
+// 	Initialize the kernel's side of the ring at user address "addr"
+//	in "space".  Attach must be called before it is used.
+//----------------------------------------------------------------------
+
+SyscallRing::SyscallRing(AddrSpace *space, int addr)
+{
+    this->space = space;
+    this->addr = addr;
+    sqHead = cqTail = 0;
+    lock = new Lock("syscall ring");
+    polling = FALSE;
+    stopped = new Semaphore("ring poller stopped", 0);
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::~SyscallRing
+// 	De-allocate the ring.  Its poller must have stopped.
+//----------------------------------------------------------------------
+
+SyscallRing::~SyscallRing()
+{
+    delete lock;
+    delete stopped;
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::Fetch/Store
+// 	Copy "size" bytes, "offset" bytes into the Ring, in from the
+//	program's memory or out to it.  Return FALSE if they are not at
+//	valid addresses.
+//----------------------------------------------------------------------
+
+bool
+SyscallRing::Fetch(int offset, char *into, int size)
+{
+    return space->CopyIn(addr + offset, into, size);
+}
+
+bool
+SyscallRing::Store(int offset, char *from, int size)
+{
+    return space->CopyOut(from, addr + offset, size);
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::Attach
+// 	Start from the indices the program left in the ring -- normally
+//	zeros.  Return FALSE if the ring is not all at valid addresses.
+//----------------------------------------------------------------------
+
+bool
+SyscallRing::Attach()
+{
+    char probe;
+
+    return Fetch(offsetof(Ring, sqHead), (char *) &sqHead, sizeof(int)) &&
+	   Fetch(offsetof(Ring, cqTail), (char *) &cqTail, sizeof(int)) &&
+	   Fetch(sizeof(Ring) - 1, &probe, 1);
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::Process
+// 	Take the calls queued in the ring, in order, and carry them out,
+//	posting each result as it completes.  Stop when the queue is
+//	empty, or the completions fill up.  Return the number of calls
+//	taken, or -1 if the ring is damaged: it is no longer mapped, or
+//	claims more calls are queued than it holds.
+//
+//	The indices are read again after each call, so calls that are
+//	queued meanwhile are taken too.
+//----------------------------------------------------------------------
+
+int
+SyscallRing::Process()
+{
+    int sqTail, cqHead, taken = 0;
+    RingRequest req;
+    RingCompletion done;
+
+    lock->Acquire();
+    for (;;) {
+	if (!Fetch(offsetof(Ring, sqTail), (char *) &sqTail, sizeof(int)) ||
+		!Fetch(offsetof(Ring, cqHead), (char *) &cqHead, sizeof(int)) ||
+		sqTail - sqHead < 0 || sqTail - sqHead > RingSize) {
+	    taken = -1;
+	    break;
+	}
+	if (sqTail == sqHead || cqTail - cqHead >= RingSize)
+	    break;			// nothing queued, or no room
+
+	int slot = (unsigned) sqHead % RingSize;
+	if (!Fetch(offsetof(Ring, sq) + slot * sizeof(RingRequest),
+		   (char *) &req, sizeof(req))) {
+	    taken = -1;
+	    break;
+	}
+	sqHead++;
+	(void) Store(offsetof(Ring, sqHead), (char *) &sqHead, sizeof(int));
+
+	int args[4] = { req.arg[0], req.arg[1], req.arg[2], 0 };
+	done.tag = req.tag;
+	done.result = RingSyscall(req.op, args);
+	slot = (unsigned) cqTail % RingSize;
+	(void) Store(offsetof(Ring, cq) + slot * sizeof(RingCompletion),
+		     (char *) &done, sizeof(done));
+	cqTail++;
+	(void) Store(offsetof(Ring, cqTail), (char *) &cqTail, sizeof(int));
+	taken++;
+    }
+    lock->Release();
+    return taken;
+}
+
+//----------------------------------------------------------------------
+// PollThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the poller of a ring.
+//----------------------------------------------------------------------
+
+static void
+PollThread(SyscallRing *ring)
+{
+    ring->Poll();
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::StartPoller
+// 	Fork a kernel thread to carry out calls as they are queued.  It
+//	runs in the program's address space, so the calls act on the
+//	program's open files and memory.
+//----------------------------------------------------------------------
+
+void
+SyscallRing::StartPoller()
+{
+    Thread *thread = new Thread("ring poller", -1);
+
+    ASSERT(!polling);
+    polling = TRUE;
+    thread->space = space;
+    thread->Fork((VoidFunctionPtr) PollThread, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::StopPoller
+// 	Have the poller finish the next time it looks at the ring, and
+//	wait until it has, so that the program's address space can go.
+//	Called as the program exits.
+//----------------------------------------------------------------------
+
+void
+SyscallRing::StopPoller()
+{
+    if (!polling)
+	return;
+    polling = FALSE;
+    stopped->P();
+}
+
+//----------------------------------------------------------------------
+// SyscallRing::Poll
+// 	Look at the ring each time the poller gets the CPU, until told
+//	to stop.  Between looks it yields, so the program (or anyone
+//	else) runs until the next time slice.
+//----------------------------------------------------------------------
+
+void
+SyscallRing::Poll()
+{
+    while (polling) {
+	(void) Process();
+	kernel->currentThread->Yield();
+    }
+    kernel->currentThread->space = NULL;	// it is about to go
+    stopped->V();
+}
@@ -0,0 +1,67 @@
+// ring.h
+//	Data structures for a program's system call ring.
+//
+//	A program that registers a ring (see RingSetup in syscall.h)
+//	queues its system calls in its own memory, and the kernel takes
+//	them from there and posts their results back -- all of the calls
+//	queued at once, when the program calls RingSubmit, or one by one
+//	as they are queued, if a poller thread watches the ring.  Either
+//	way the program crosses into the kernel far less often than with
+//	a syscall per call.
+//
+//	The kernel keeps its own copies of the indices it advances, so
+//	the program cannot make it take a call twice by scribbling on
+//	them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef RING_H
+#define RING_H
+
+#include "syscall.h"
+
+class AddrSpace;
+class Lock;
+class Semaphore;
+
+extern int RingSyscall(int code, int *args);
+					// Carry out one queued call; in
+					// exception.cc
+
+// The following class defines the kernel's side of a ring.
+
+class SyscallRing {
+  public:
+    SyscallRing(AddrSpace *space, int addr);
+					// The ring at user address "addr"
+    ~SyscallRing();
+
+    bool Attach();			// Pick up the program's indices;
+					// FALSE if the ring is not mapped
+    int Process();			// Carry out the queued calls; return
+					// how many, or -1 if the ring is bad
+
+    void StartPoller();			// Fork a thread to watch the ring
+    void StopPoller();			// Have it stop, and wait until it
+					// has
+    void Poll();			// The poller's loop
+
+  private:
+    AddrSpace *space;			// The program the ring belongs to
+    int addr;				// Where the Ring is in its memory
+    int sqHead;				// Calls taken so far
+    int cqTail;				// Completions posted so far
+    Lock *lock;				// One Process at a time
+    bool polling;			// Should the poller keep going?
+    Semaphore *stopped;			// Signalled as the poller stops
+
+    bool Fetch(int offset, char *into, int size);
+    bool Store(int offset, char *from, int size);
+					// Copy part of the Ring in or out
+};
+
+#endif // RING_H
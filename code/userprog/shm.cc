@@ -0,0 +1,146 @@
+// shm.cc
+//	Routines to create and free segments of memory shared between
+//	user programs (see shm.h).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "shm.h"
+#include "frames.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// SharedMemory::SharedMemory
+// 	Initialize an empty table of segments.
+//----------------------------------------------------------------------
+
+SharedMemory::SharedMemory()
+{
+    for (int i = 0; i < MaxSegments; i++) {
+	segments[i].numPages = 0;
+	segments[i].holds = 0;
+    }
+    numFrames = 0;
+}
+
+//----------------------------------------------------------------------
+// SharedMemory::~SharedMemory
+// 	De-allocate the table.  The frames of any segments left, held by
+//	programs still running at Halt, go with the frame allocator.
+//----------------------------------------------------------------------
+
+SharedMemory::~SharedMemory()
+{
+}
+
+//----------------------------------------------------------------------
+// SharedMemory::Create
+// 	Make a segment of "size" bytes, rounded up to pages, with a zeroed
+//	frame for each page, pinned; it starts with one hold, its
+//	creator's.  Taking a frame may page out someone else's page, so
+//	this holds the paging lock.
+//
+//	Return the segment's id, or -1 if "size" is not from 1 byte to
+//	MaxSegmentPages pages, or every slot is in use, or the segments
+//	would have more than a quarter of memory.
+//----------------------------------------------------------------------
+
+int
+SharedMemory::Create(int size)
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    int count = divRoundUp(size, PageSize);
+    SharedSegment *s = NULL;
+    int id;
+
+    if (size <= 0 || count > MaxSegmentPages ||
+	    numFrames + count > NumPhysPages / 4)
+	return -1;
+    for (id = 0; id < MaxSegments; id++)
+	if (segments[id].holds == 0) {
+	    s = &segments[id];
+	    break;
+	}
+    if (s == NULL)
+	return -1;
+    s->holds = 1;			// taken, before we may block; but
+    numFrames += count;			// no one attaches it till it has
+					// its frames
+    frames->PagingLock()->Acquire();
+    for (int i = 0; i < count; i++) {
+	s->frames[i] = frames->Allocate(NULL, NULL);
+	frames->Pin(s->frames[i]);
+    }
+    frames->PagingLock()->Release();
+    s->numPages = count;
+    DEBUG(dbgAddr, "Shared segment " << id << " of " << count << " pages");
+    return id;
+}
+
+//----------------------------------------------------------------------
+// SharedMemory::NumPages
+// 	Return how many pages segment "id" has, or 0 if there is no such
+//	segment.
+//----------------------------------------------------------------------
+
+int
+SharedMemory::NumPages(int id)
+{
+    if (id < 0 || id >= MaxSegments)
+	return 0;
+    return segments[id].numPages;
+}
+
+//----------------------------------------------------------------------
+// SharedMemory::Frame
+// 	Return the frame holding page "page" of segment "id".
+//----------------------------------------------------------------------
+
+int
+SharedMemory::Frame(int id, int page)
+{
+    ASSERT(page >= 0 && page < NumPages(id));
+    return segments[id].frames[page];
+}
+
+//----------------------------------------------------------------------
+// SharedMemory::Hold/Release
+// 	Count one more hold on segment "id", or one fewer.  When the last
+//	goes, the segment's frames are freed -- last first, so they are
+//	taken again in order -- and its id may be given out again.  No
+//	page may map them by then.
+//----------------------------------------------------------------------
+
+void
+SharedMemory::Hold(int id)
+{
+    ASSERT(NumPages(id) > 0);
+    segments[id].holds++;
+}
+
+void
+SharedMemory::Release(int id)
+{
+    FrameAllocator *frames = kernel->frameAllocator;
+    SharedSegment *s = &segments[id];
+    int taken[MaxSegmentPages];
+    int count = s->numPages;
+
+    ASSERT(count > 0 && s->holds > 0);
+    if (--s->holds > 0)
+	return;
+    DEBUG(dbgAddr, "Freeing shared segment " << id);
+    for (int i = 0; i < count; i++)	// the slot is free once we block
+	taken[i] = s->frames[i];
+    s->numPages = 0;
+    numFrames -= count;
+    frames->PagingLock()->Acquire();
+    for (int i = count - 1; i >= 0; i--) {
+	frames->Unpin(taken[i]);
+	frames->Free(taken[i]);
+    }
+    frames->PagingLock()->Release();
+}
@@ -0,0 +1,62 @@
+// shm.h
+//	Data structures for memory shared between user programs.
+//
+//	A segment is a few frames of physical memory, named by an id that
+//	any program may attach it by (see ShmCreate in syscall.h).  Each
+//	program attaching it maps the same frames, writable, at pages of
+//	its own in the map window, so what one writes there the others
+//	see at once, without a copy through the kernel.
+//
+//	A segment is held once by the program that created it, and once
+//	more for each attachment; the last hold to go, by ShmDetach or
+//	when the program exits, frees its frames.  Its frames are pinned
+//	while it lasts: they are no one page's, so there is nowhere to page
+//	them out to.  To leave the rest of memory to paging, the segments
+//	together may have at most a quarter of it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SHM_H
+#define SHM_H
+
+#define MaxSegments	8		// segments at once
+#define MaxSegmentPages	8		// pages in one segment
+#define MaxSegmentHolds	8		// holds on segments per address
+					// space, attachments included
+
+// The following class defines one segment.
+
+class SharedSegment {
+  public:
+    int numPages;			// Its pages; 0 till it has them
+    int frames[MaxSegmentPages];	// The frames holding them
+    int holds;				// Creator's and attachments; 0
+					// if the slot is free
+};
+
+// The following class defines the table of segments.
+
+class SharedMemory {
+  public:
+    SharedMemory();			// No segments yet
+    ~SharedMemory();
+
+    int Create(int size);		// A new segment of "size" bytes,
+					// zeroed and held once; return its
+					// id, or -1 if there is no room
+    int NumPages(int id);		// Pages of segment "id"; 0 if there
+					// is no such segment
+    int Frame(int id, int page);	// The frame holding "page" of it
+    void Hold(int id);			// Count a hold on it, or let one
+    void Release(int id);		// go; the last frees the segment
+
+  private:
+    SharedSegment segments[MaxSegments];
+    int numFrames;			// Frames all the segments have
+};
+
+#endif // SHM_H
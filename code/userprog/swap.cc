@@ -0,0 +1,134 @@
+// swap.cc
+//	Routines to manage the swap area.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "swap.h"
+#include "synchdisk.h"
+
+//----------------------------------------------------------------------
+// SwapSpace::SwapSpace
+// 	Open the swap disk, SWAP_<host> (creating it if it is not there).
+//	Its contents do not outlive Nachos, so all of it starts free.
+//----------------------------------------------------------------------
+
+SwapSpace::SwapSpace()
+{
+    ASSERT(PageSize % SectorSize == 0);	// a page is whole sectors
+    sectorsPerPage = PageSize / SectorSize;
+    disk = new SynchDisk(FifoSchedule, FALSE, "SWAP");
+    inUse = new Bitmap(disk->VolumeSectors() / sectorsPerPage);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::~SwapSpace
+// 	Close the swap disk.
+//----------------------------------------------------------------------
+
+SwapSpace::~SwapSpace()
+{
+    delete disk;
+    delete inUse;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Allocate
+// 	Take "count" free slots, and put their numbers in "slots", or
+//	return FALSE, taking none, if fewer are free.
+//----------------------------------------------------------------------
+
+bool
+SwapSpace::Allocate(int count, int *slots)
+{
+    if (NumFree() < count)
+	return FALSE;
+    for (int i = 0; i < count; i++)
+	slots[i] = inUse->FindAndSet();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Free
+// 	Give back "slot".
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Free(int slot)
+{
+    ASSERT(inUse->Test(slot));
+    inUse->Clear(slot);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::ReadPage/WritePage
+// 	Read the page kept in "slot" into the frame at "into", or write
+//	the frame at "from" to it.  Return once the transfer is done.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::ReadPage(int slot, char *into)
+{
+    ASSERT(inUse->Test(slot));
+    disk->ReadSectors(slot * sectorsPerPage, sectorsPerPage, into);
+}
+
+void
+SwapSpace::WritePage(int slot, char *from)
+{
+    ASSERT(inUse->Test(slot));
+    disk->WriteSectors(slot * sectorsPerPage, sectorsPerPage, from);
+    kernel->stats->numPageOuts++;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::ReadPages/WritePages
+// 	Read the consecutive slots from "slot" on into the "count" frames
+//	at "into", or write the frames at "from" to them, with one request
+//	to the swap disk, so that they take one seek and one rotation
+//	between them.  The frames are scattered from, or gathered into, a
+//	buffer; those being written can be changed again as soon as
+//	WritePages is called.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::ReadPages(int slot, int count, char **into)
+{
+    char *buffer;
+
+    ASSERT(count > 0 && count <= MaxPageCluster);
+    if (count == 1) {
+	ReadPage(slot, into[0]);
+	return;
+    }
+    buffer = new char[count * PageSize];
+    for (int i = 0; i < count; i++)
+	ASSERT(inUse->Test(slot + i));
+    disk->ReadSectors(slot * sectorsPerPage, count * sectorsPerPage, buffer);
+    for (int i = 0; i < count; i++)
+	bcopy(&buffer[i * PageSize], into[i], PageSize);
+    delete [] buffer;
+}
+
+void
+SwapSpace::WritePages(int slot, int count, char **from)
+{
+    char *buffer;
+
+    ASSERT(count > 0 && count <= MaxPageCluster);
+    if (count == 1) {
+	WritePage(slot, from[0]);
+	return;
+    }
+    buffer = new char[count * PageSize];
+    for (int i = 0; i < count; i++) {
+	ASSERT(inUse->Test(slot + i));
+	bcopy(from[i], &buffer[i * PageSize], PageSize);
+    }
+    disk->WriteSectors(slot * sectorsPerPage, count * sectorsPerPage, buffer);
+    delete [] buffer;
+    kernel->stats->numPageOuts += count;
+}
@@ -0,0 +1,56 @@
+// swap.h
+//	Data structures for the swap area, where pages of user programs
+//	are kept while physical memory is taken back from them.
+//
+//	The swap area is a disk of its own, so that paging does not go
+//	through the file system, and a page goes to a slot of as many
+//	sectors as it takes, laid end to end.  Each page of an address
+//	space is given its slot on the swap disk when the program is
+//	loaded, so that the program can always be paged out; the size of
+//	the swap disk bounds the total size of the running programs.
+//	A program's slots are mostly consecutive, so dirty pages next to
+//	each other can go out together, in one write to the swap disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "bitmap.h"
+
+#define MaxPageCluster	8		// pages moved to or from swap at
+					// once
+
+class SynchDisk;
+
+// The following class defines the swap area.
+
+class SwapSpace {
+  public:
+    SwapSpace();			// Open the swap disk, all of it free
+    ~SwapSpace();
+
+    bool Allocate(int count, int *slots);
+					// Give "slots" "count" free slots;
+					// FALSE, giving none, if too few
+    void Free(int slot);		// Give "slot" back
+    int NumFree() { return inUse->NumClear(); }
+
+    void ReadPage(int slot, char *into);	// Move a page between
+    void WritePage(int slot, char *from);	// memory and its slot
+    void ReadPages(int slot, int count, char **into);
+    void WritePages(int slot, int count, char **from);
+    					// Move "count" pages, in the
+					// slots from "slot" on, at once
+
+  private:
+    SynchDisk *disk;			// The swap disk
+    Bitmap *inUse;			// Slots taken
+    int sectorsPerPage;			// The sectors of a slot
+};
+
+#endif // SWAP_H
@@ -0,0 +1,218 @@
+// swapper.cc
+//	Routines of the medium-term scheduler, which swaps whole programs
+//	out of memory, and back in, so that those in memory fit (see
+//	swapper.h).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "swapper.h"
+#include "addrspace.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// SwapperThread
+// 	Dummy function, because Thread::Fork cannot call a member
+//	function; runs the loop of the swapper.
+//----------------------------------------------------------------------
+
+static void
+SwapperThread(Swapper *swapper)
+{
+    swapper->Run();
+}
+
+//----------------------------------------------------------------------
+// Swapper::Swapper
+// 	Start with no programs, and fork the thread that makes a pass
+//	every "interval" ticks.
+//----------------------------------------------------------------------
+
+Swapper::Swapper(int interval)
+{
+    ASSERT(interval > 0);
+    this->interval = interval;
+    nextPass = kernel->stats->totalTicks + interval;
+    pending = FALSE;
+    due = new Semaphore("swapper", 0);
+    lock = new Lock("swapper");
+    in = new List<AddrSpace *>;
+    out = new List<AddrSpace *>;
+    (new Thread("swapper", -1))->Fork((VoidFunctionPtr) SwapperThread,
+				      (void *) this);
+}
+
+//----------------------------------------------------------------------
+// Swapper::~Swapper
+// 	Nachos is halting.  The programs left go with the kernel.
+//----------------------------------------------------------------------
+
+Swapper::~Swapper()
+{
+    delete due;
+    delete lock;
+    delete in;
+    delete out;
+}
+
+//----------------------------------------------------------------------
+// Swapper::Add
+// 	Program "space" is starting, in memory; it counts as just
+//	swapped in.
+//----------------------------------------------------------------------
+
+void
+Swapper::Add(AddrSpace *space)
+{
+    lock->Acquire();
+    in->Append(space);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Swapper::Forget
+// 	Program "space" has exited, and is being deleted.  If a pass is
+//	going on, wait for it to end, since it may be moving the program.
+//	With programs out, the memory it leaves may let one back in, so a
+//	pass is due at once.
+//----------------------------------------------------------------------
+
+void
+Swapper::Forget(AddrSpace *space)
+{
+    lock->Acquire();
+    if (in->IsInList(space))
+	in->Remove(space);
+    else if (out->IsInList(space))
+	out->Remove(space);
+    if (!out->IsEmpty())
+	nextPass = kernel->stats->totalTicks;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Swapper::Run
+// 	Wait for a pass to be due, and make it, over and over.
+//----------------------------------------------------------------------
+
+void
+Swapper::Run()
+{
+    for (;;) {
+	due->P();
+	Balance();
+	nextPass = kernel->stats->totalTicks + interval;
+	pending = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Swapper::Tick
+// 	Called on each timer interrupt: once the next pass is due, wake
+//	the thread to make it.  Passes are counted from the end of the
+//	last, so one that took long is not followed at once by another.
+//----------------------------------------------------------------------
+
+void
+Swapper::Tick()
+{
+    if (pending || kernel->stats->totalTicks < nextPass)
+	return;
+    pending = TRUE;
+    due->V();
+}
+
+//----------------------------------------------------------------------
+// Swapper::Balance
+// 	Make one pass.  While the working sets of the programs in memory
+//	add up to more frames than there are, swap out the ones ChooseOut
+//	gives, keeping at least one in.  Then swap in the programs out
+//	longest, as long as each fits -- or has been out SwapQuantum
+//	ticks, when one that has been in as long is swapped out for it.
+//	With no program in memory, the first out comes in whether it
+//	fits or not.
+//----------------------------------------------------------------------
+
+void
+Swapper::Balance()
+{
+    AddrSpace *space, *victim;
+    int pages = 0;
+
+    lock->Acquire();
+    for (ListIterator<AddrSpace *> i(in); !i.IsDone(); i.Next())
+	pages += i.Item()->WorkingSet();
+    DEBUG(dbgAddr, "Swapper pass: " << in->NumInList() << " programs in, "
+	  << pages << " pages, " << out->NumInList() << " out");
+    while (pages > NumPhysPages && in->NumInList() > 1 &&
+	   (victim = ChooseOut()) != NULL) {
+	pages -= victim->WorkingSet();
+	SwapOut(victim);
+    }
+    while (!out->IsEmpty()) {
+	space = out->Front();
+	if (!in->IsEmpty() && pages + space->WorkingSet() > NumPhysPages) {
+	    if (kernel->stats->totalTicks - space->SwappedAt() < SwapQuantum ||
+		    (victim = ChooseOut()) == NULL)
+		break;
+	    pages -= victim->WorkingSet();
+	    SwapOut(victim);
+	}
+	pages += space->WorkingSet();
+	SwapIn(space);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Swapper::ChooseOut
+// 	Return the program to swap out: of those in memory SwapQuantum
+//	ticks or more, one of the lowest priority, and of those the one
+//	in longest.  Return NULL if none has been in that long.
+//----------------------------------------------------------------------
+
+AddrSpace *
+Swapper::ChooseOut()
+{
+    AddrSpace *victim = NULL;
+
+    for (ListIterator<AddrSpace *> i(in); !i.IsDone(); i.Next()) {
+	AddrSpace *space = i.Item();
+
+	if (kernel->stats->totalTicks - space->SwappedAt() >= SwapQuantum &&
+		(victim == NULL || space->Priority() < victim->Priority()))
+	    victim = space;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// Swapper::SwapOut/SwapIn
+// 	Move program "space" out of memory, to the back of those out, or
+//	from the front of those out back into memory.
+//----------------------------------------------------------------------
+
+void
+Swapper::SwapOut(AddrSpace *space)
+{
+    DEBUG(dbgAddr, "Swapping out a program of working set "
+	  << space->WorkingSet());
+    in->Remove(space);
+    space->SwapOut();
+    out->Append(space);
+    kernel->stats->numSwapOuts++;
+}
+
+void
+Swapper::SwapIn(AddrSpace *space)
+{
+    DEBUG(dbgAddr, "Swapping in a program of working set "
+	  << space->WorkingSet());
+    out->Remove(space);
+    space->SwapIn();
+    in->Append(space);
+    kernel->stats->numSwapIns++;
+}
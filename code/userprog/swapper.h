@@ -0,0 +1,86 @@
+// swapper.h
+//	Data structures for the medium-term scheduler (-ms), which swaps
+//	whole programs out of memory when together they need more of it
+//	than there is.
+//
+//	Page replacement alone cannot help then: each program takes the
+//	frames the others are about to touch, and all of them fault on
+//	nearly every slice.  So every so often the swapper thread adds up
+//	the working sets of the programs in memory (sampled as they run,
+//	see AddrSpace::SampleWorkingSet), and while they are more frames
+//	than the machine has, swaps one out -- of those of the lowest
+//	priority, the one in memory longest.  Its pages go to swap, and
+//	its threads wait at their next fault; the rest run in the memory
+//	it gave up.
+//
+//	The program out longest is swapped back in -- the pages it had in
+//	memory read back all at once -- once its working set fits; or,
+//	if it has been out SwapQuantum ticks, in place of one that has
+//	been in that long, so that every program gets its turn.  With
+//	more programs than fit, they run in batches, each batch in the
+//	memory it needs.
+//
+//	Like the -statlog thread, the swapper is woken by the timer
+//	interrupt (see Alarm::CallBack), so it does not keep Nachos from
+//	halting -- unless a program is swapped out, when the timer goes on
+//	till it is back in.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SWAPPER_H
+#define SWAPPER_H
+
+#include "copyright.h"
+#include "list.h"
+
+class AddrSpace;
+class Lock;
+class Semaphore;
+
+#define SwapInterval	50000		// ticks between passes, by default
+#define SwapQuantum	200000		// ticks a program stays in memory,
+					// or out, before it may be swapped
+					// to let another take its turn
+
+// The following class defines the medium-term scheduler, and its
+// thread.
+
+class Swapper {
+  public:
+    Swapper(int interval);		// Fork the thread, to make a pass
+					// every "interval" ticks
+    ~Swapper();
+
+    void Add(AddrSpace *space);		// A program starting, in memory
+    void Forget(AddrSpace *space);	// "space" is being deleted
+    bool Waiting() { return !out->IsEmpty(); }
+					// Are any programs swapped out, to
+					// be swapped back in?
+
+    void Run();				// The thread's loop; never returns
+    void Tick();			// On a timer interrupt, wake the
+					// thread if a pass is due
+
+  private:
+    void Balance();			// Swap programs out, or in, to fit
+					// their working sets in memory
+    AddrSpace *ChooseOut();		// The program to swap out; NULL if
+					// none has been in long enough
+    void SwapOut(AddrSpace *space);
+    void SwapIn(AddrSpace *space);
+
+    int interval;			// ticks between passes
+    int nextPass;			// when the next one is due
+    bool pending;			// Woken, and not done yet
+    Semaphore *due;			// what the thread waits for it on
+    Lock *lock;				// held for a pass, so that no
+					// program goes away during it
+    List<AddrSpace *> *in;		// The programs in memory, by when
+					// they came in
+    List<AddrSpace *> *out;		// And those swapped out, by when
+					// they went
+};
+
+#endif // SWAPPER_H
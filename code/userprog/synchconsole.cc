@@ -8,6 +8,7 @@
 
 #include "copyright.h"
 #include "synchconsole.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // SynchConsoleInput::SynchConsoleInput
@@ -22,6 +23,8 @@ SynchConsoleInput::SynchConsoleInput(char *inputFile)
     consoleInput = new ConsoleInput(inputFile, this);
     lock = new Lock("console in");
     waitFor = new Semaphore("console in", 0);
+    aheadStart = aheadLength = 0;
+    atEnd = waiting = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -36,6 +39,40 @@ SynchConsoleInput::~SynchConsoleInput()
     delete waitFor;
 }
 
+//----------------------------------------------------------------------
+// SynchConsoleInput::NextChar
+//      Return the next character typed at the keyboard, or EOF: from
+//	what was read ahead, if any is left; else, when the keyboard is
+//	a file, from ConsoleLineSize more read at once; else from the
+//	interrupt, waiting for it if necessary.  Once EOF has come it is
+//	returned at once, as no more interrupts will.  Called with the
+//	lock held.
+//----------------------------------------------------------------------
+
+char
+SynchConsoleInput::NextChar()
+{
+    char ch;
+
+    if (atEnd)
+	return EOF;
+    if (aheadLength == 0) {
+	aheadStart = 0;
+	aheadLength = max(consoleInput->GetChars(ahead, ConsoleLineSize), 0);
+    }
+    if (aheadLength > 0) {
+	aheadLength--;
+	return ahead[aheadStart++];
+    }
+    waiting = TRUE;
+    waitFor->P();	// wait for EOF or a char to be available.
+    waiting = FALSE;
+    ch = consoleInput->GetChar();
+    if (ch == EOF)
+	atEnd = TRUE;
+    return ch;
+}
+
 //----------------------------------------------------------------------
 // SynchConsoleInput::GetChar
 //      Read a character typed at the keyboard, waiting if necessary.
@@ -47,12 +84,37 @@ SynchConsoleInput::GetChar()
     char ch;
 
     lock->Acquire();
-    waitFor->P();	// wait for EOF or a char to be available.
-    ch = consoleInput->GetChar();
+    ch = NextChar();
     lock->Release();
     return ch;
 }
 
+//----------------------------------------------------------------------
+// SynchConsoleInput::GetLine
+//      Read up to "most" characters typed at the keyboard into "into",
+//	stopping after a '\n', or at EOF.  Return how many were read:
+//	0 only at EOF.  No other reader's characters come in between.
+//----------------------------------------------------------------------
+
+int
+SynchConsoleInput::GetLine(char *into, int most)
+{
+    int n = 0;
+    char ch;
+
+    lock->Acquire();
+    while (n < most) {
+	ch = NextChar();
+	if (ch == EOF)
+	    break;
+	into[n++] = ch;
+	if (ch == '\n')
+	    break;
+    }
+    lock->Release();
+    return n;
+}
+
 //----------------------------------------------------------------------
 // SynchConsoleInput::CallBack
 //      Interrupt handler called when keystroke is hit; wake up
@@ -77,7 +139,10 @@ SynchConsoleOutput::SynchConsoleOutput(char *outputFile)
 {
     consoleOutput = new ConsoleOutput(outputFile, this);
     lock = new Lock("console out");
-    waitFor = new Semaphore("console out", 0);
+    room = new Semaphore("console out room", ConsoleRingSize);
+    drained = new Semaphore("console out drained", 0);
+    head = count = 0;
+    busy = flushing = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -89,31 +154,106 @@ SynchConsoleOutput::~SynchConsoleOutput()
 { 
     delete consoleOutput; 
     delete lock; 
-    delete waitFor;
+    delete room;
+    delete drained;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::Enqueue
+//      Wait for a place in the ring, and put "ch" there -- or straight
+//	on the display, if it is idle.  Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::Enqueue(char ch)
+{
+    IntStatus oldLevel;
+
+    room->P();
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    if (!busy) {
+	busy = TRUE;
+	consoleOutput->PutChar(ch);
+    } else {
+	ring[(head + count) % ConsoleRingSize] = ch;
+	count++;
+    }
+    kernel->interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
 // SynchConsoleOutput::PutChar
-//      Write a character to the console display, waiting if necessary.
+//      Write a character to the console display, waiting only if the
+//	ring is full.
 //----------------------------------------------------------------------
 
 void
 SynchConsoleOutput::PutChar(char ch)
 {
     lock->Acquire();
-    consoleOutput->PutChar(ch);
-    waitFor->P();
+    Enqueue(ch);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::PutString
+//      Write "length" characters at "s" to the console display, with
+//	no other writer's in between, waiting only while the ring is
+//	full.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::PutString(char *s, int length)
+{
+    lock->Acquire();
+    for (int i = 0; i < length; i++)
+	Enqueue(s[i]);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::Flush
+//      Wait until every character written has been displayed -- before
+//	something else is printed, or Nachos halts.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::Flush()
+{
+    IntStatus oldLevel;
+    bool wait;
+
+    if (!busy)		// the usual case; and taking the lock here
+	return;		// would cost ticks every program exit
+    lock->Acquire();
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    wait = flushing = busy;
+    kernel->interrupt->SetLevel(oldLevel);
+    if (wait)
+	drained->P();
     lock->Release();
 }
 
 //----------------------------------------------------------------------
 // SynchConsoleOutput::CallBack
 //      Interrupt handler called when it's safe to send the next 
-//	character can be sent to the display.
+//	character can be sent to the display: give back the place of
+//	the one just displayed, and start on the next in the ring.
 //----------------------------------------------------------------------
 
 void
 SynchConsoleOutput::CallBack()
 {
-    waitFor->V();
+    room->V();
+    if (count > 0) {
+	consoleOutput->PutChar(ring[head]);
+	head = (head + 1) % ConsoleRingSize;
+	count--;
+    } else {
+	busy = FALSE;
+	if (flushing) {
+	    flushing = FALSE;
+	    drained->V();
+	}
+    }
 }
@@ -4,6 +4,10 @@
 //
 //	NOTE: this abstraction is not completely implemented.
 //
+//	Output is buffered: characters written go into a ring, which the
+//	display's interrupt handler drains one character at a time, so a
+//	writer only waits when the ring is full.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -17,6 +21,11 @@
 #include "console.h"
 #include "synch.h"
 
+#define ConsoleRingSize	256	// characters waiting to be displayed
+#define ConsoleLineSize	256	// characters read ahead from a console
+				// input file, and the most GetLine
+				// returns at once
+
 // The following two classes define synchronized input and output to
 // a console device
 
@@ -28,12 +37,22 @@ class SynchConsoleInput : public CallBackObj {
 	void Disable() { consoleInput->Disable(); }// 2015.11.25
 
     char GetChar();		// Read a character, waiting if necessary
+    int GetLine(char *into, int most);
+				// Read up to "most" characters, through
+				// the end of the line; return how many
+    bool Waiting() { return waiting; }
+				// Is a reader waiting for a keystroke?
     
   private:
     ConsoleInput *consoleInput;	// the hardware keyboard
     Lock *lock;			// only one reader at a time
     Semaphore *waitFor;		// wait for callBack
+    char ahead[ConsoleLineSize];	// read from the input file in bulk,
+    int aheadStart, aheadLength;	// and not yet asked for
+    bool atEnd;			// EOF has come
+    bool waiting;		// a reader is waiting on the interrupt
 
+    char NextChar();		// GetChar, with the lock held
     void CallBack();		// called when a keystroke is available
 };
 
@@ -42,13 +61,28 @@ class SynchConsoleOutput : public CallBackObj {
     SynchConsoleOutput(char *outputFile); // Initialize the console device
     ~SynchConsoleOutput();
 
-    void PutChar(char ch);	// Write a character, waiting if necessary
+    void PutChar(char ch);	// Write a character, waiting only if
+				// the ring is full
+    void PutString(char *s, int length);
+				// Write "length" characters at "s", all
+				// together
+    void Flush();		// Wait until all written is displayed
    
   private:
     ConsoleOutput *consoleOutput;// the hardware display
     Lock *lock;			// only one writer at a time
-    Semaphore *waitFor;		// wait for callBack
+    Semaphore *room;		// a count of the free places in the
+				// ring (the character being displayed
+				// keeps its place until it is done)
+    Semaphore *drained;		// V'ed when the ring empties, if Flush
+				// is waiting for it
+    char ring[ConsoleRingSize];	// the characters waiting
+    int head;			// where the oldest one is
+    int count;			// how many there are
+    bool busy;			// is a character being displayed?
+    bool flushing;		// is Flush waiting?
 
+    void Enqueue(char ch);	// Put a character in the ring
     void CallBack();		// called when more data can be written
 };
 
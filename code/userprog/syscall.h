@@ -34,7 +34,39 @@
 #define SC_ExecV	13
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
+#define SC_Fsync	16
+#define SC_ReadV	17
+#define SC_WriteV	18
+#define SC_RingSetup	19
+#define SC_RingSubmit	20
+#define SC_FileSize	21
+#define SC_SetPriority	22
+#define SC_Sleep	23
+#define SC_GetUsage	24
+#define SC_GetNetStats	25
+#define SC_PutString	26
+#define SC_ReadLine	27
+#define SC_GetFsStats	28
+#define SC_GetStats	29
+#define SC_Mmap		30
+#define SC_Munmap	31
+#define SC_CopyRange	32
+#define SC_Mkdir	33
+#define SC_ReadDir	34
+#define SC_Pipe		35
+#define SC_ExecWith	36
+#define SC_ShmCreate	37
+#define SC_ShmAttach	38
+#define SC_ShmDetach	39
+#define SC_FutexWait	40
+#define SC_FutexWake	41
 #define SC_Add		42
+#define SC_Sbrk		43
+#define SC_Checkpoint	44
+#define SC_Rename	45
+#define SC_Preallocate	46
+#define SC_SetTickets	47
+#define SC_SetIoClass	48
 #define SC_MSG		100
 
 #ifndef IN_ASM
@@ -64,7 +96,12 @@ void MSG(char *msg);
 
 /* Address space control operations: Exit, Exec, Execv, and Join */
 
-/* This user program is done (status = 0 means exited normally). */
+/* This user program is done (status = 0 means exited normally).  Only
+ * the calling thread is, if the program has others (see ThreadExit).
+ * A thread that faults -- touches an address outside its program,
+ * writes to read-only memory, or makes an unknown system call -- is
+ * ended as if it had called Exit(-1).
+ */
 void Exit(int status);	
 
 /* A unique identifier for an executing user program (address space) */
@@ -75,6 +112,8 @@ typedef int ThreadId;
 
 /* Run the specified executable, with no args */
 /* This can be implemented as a call to ExecV.
+ * The program runs concurrently with the caller, which may Join it.
+ * Return a negative error code if it cannot be loaded.
  */ 
 SpaceId Exec(char* exec_name);
 
@@ -85,7 +124,8 @@ SpaceId Exec(char* exec_name);
 SpaceId ExecV(int argc, char* argv[]);
  
 /* Only return once the user program "id" has finished.  
- * Return the exit status.
+ * Return the exit status.  Only the program that Exec'd "id" may join
+ * it, and only once; otherwise a negative error code is returned.
  */
 int Join(SpaceId id); 	
  
@@ -116,9 +156,48 @@ typedef int OpenFileId;
 /* Return 1 on success, negative error code on failure */
 int Create(char *name, int size);
 
-/* Remove a Nachos file, with name "name" */
+/* Remove a Nachos file, with name "name".  A file that is still open
+ * stays readable and writable through its OpenFileIds until they are
+ * closed.
+ * Return 1 on success, negative error code on failure
+ */
 int Remove(char *name);
 
+/* Give the Nachos file or directory "from" the name "to", in the same
+ * directory or another, without copying it: only the directory entry
+ * moves, in one step, and files open under the old name stay open.
+ * "to" must not exist, and a directory cannot move into its own tree.
+ * Return 1 on success, negative error code on failure
+ */
+int Rename(char *from, char *to);
+
+/* Create a directory, with the absolute path "name"; its parent must
+ * exist already.
+ * Return 1 on success, negative error code on failure
+ */
+int Mkdir(char *name);
+
+/* An entry of a directory, as ReadDir returns it. */
+#define DirNameMaxLen	255	/* longest name, without the '\0' */
+#define MaxReadDir	32	/* most entries one ReadDir returns */
+
+typedef struct {
+    char name[DirNameMaxLen + 1];
+    int type;			/* 'F' for a file, 'D' for a directory */
+    int sector;			/* where its header is on disk */
+    int size;			/* length in bytes */
+} DirEntry;
+
+/* Fill in up to "count" (at most MaxReadDir) entries of the directory
+ * "name", from "*cursor" on -- 0 the first time -- and move "*cursor"
+ * past them, so that the next call goes on where this one stopped.
+ * An entry there for the whole listing is returned once; one added or
+ * removed in between may or may not be.
+ * Return the number of entries filled in, 0 once the directory has no
+ * more, or a negative error code if "name" is not a directory.
+ */
+int ReadDir(char *name, DirEntry *entries, int count, int *cursor);
+
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
  * be used to read and write to the file.
  */
@@ -138,28 +217,260 @@ int Write(char *buffer, int size, OpenFileId id);
  */
 int Read(char *buffer, int size, OpenFileId id);
 
-/* Set the seek position of the open file "id"
- * to the byte "position".
+/* Set the seek position of the open file "id" to "offset" bytes from
+ * the start of the file, from the current seek position, or from the
+ * end of the file, as "whence" is SeekSet, SeekCurrent or SeekEnd.
+ * The position may be past the end of the file.
+ * Return the new position on success, negative error code on failure
  */
-int Seek(int position, OpenFileId id);
+#define SeekSet		0
+#define SeekCurrent	1
+#define SeekEnd		2
+
+int Seek(int offset, int whence, OpenFileId id);
+
+/* Return the number of bytes in the open file "id", negative error
+ * code on failure.
+ */
+int FileSize(OpenFileId id);
+
+/* Copy "size" bytes from the open file "from", at its position, to
+ * the open file "to", at its position, in the kernel: the bytes are
+ * not read into the program and written back out, and where both
+ * positions are at the start of a sector, whole sectors go from one
+ * file's buffers in the buffer cache to the other's.  Both positions
+ * move past the bytes copied.
+ * Return the number of bytes copied -- fewer than "size" if "from"
+ * ends first, or the disk fills up -- negative error code on failure.
+ */
+int CopyRange(OpenFileId from, OpenFileId to, int size);
+
+/* Give the first "size" bytes of the open file "id" their disk space
+ * now, before they are written, as one contiguous run if the disk has
+ * one: a program that knows how big a file will be gets it laid out
+ * sequentially, instead of a sector at a time as it writes.  Nothing
+ * is written to the space; it reads as zeros until it is.  The file
+ * grows to "size" bytes, unless "flags" has PreallocKeepSize; then the
+ * space past the end is kept for writes there until the file is last
+ * closed.
+ * Return 1 on success, negative error code on failure
+ */
+#define PreallocKeepSize	1
+
+int Preallocate(OpenFileId id, int size, int flags);
 
 /* Close the file, we're done reading and writing to it.
  * Return 1 on success, negative error code on failure
  */
 int Close(OpenFileId id);
 
+/* Make a pipe, and put the OpenFileIds of its read end and its write
+ * end in "ids[0]" and "ids[1]".  The pipe buffers what is written to
+ * it in the kernel until it is read: Read waits until there is
+ * something to return, and returns 0 once no program holds the write
+ * end open any longer; Write waits for room, and fails once none holds
+ * the read end.  Programs started by ExecWith can be given the ends.
+ * Return 1 on success, negative error code on failure
+ */
+int Pipe(OpenFileId *ids);
+
+/* Run the executable "exec_name" like Exec, but with its console input
+ * reading from the pipe end "input", and its console output writing to
+ * the pipe end "output" (see Pipe); -1 for either leaves it on the
+ * console.  The program gets ends of its own, so the caller may close
+ * its copies -- and should, or the program will never see end of file.
+ * Return a negative error code if it cannot be loaded, or an end is
+ * not one of the caller's, or is the wrong one.
+ */
+SpaceId ExecWith(char* exec_name, OpenFileId input, OpenFileId output);
+
+/* Force everything written to the open file so far out to the disk.
+ * Return 1 on success, negative error code on failure
+ */
+int Fsync(OpenFileId id);
+
+/* Map the open file "id" into the address space, and return the
+ * address of its first byte: its bytes are then read and written in
+ * place, there, rather than copied with Read and Write.  Each page is
+ * read from the file the first time it is touched; a page written to
+ * is written back to the file when its memory is taken back, and at
+ * Munmap or Exit.  The file may be closed meanwhile.  The mapping is
+ * of the file's length when mapped, rounded up to a page; the bytes
+ * past the end read as zeros, and writes to them are lost.
+ * Return a negative error code if "id" is not an open file, or it is
+ * empty, or there is no room left to map it.
+ */
+int Mmap(OpenFileId id);
+
+/* Write back the written pages of the file mapped at "addr", as Mmap
+ * returned it, and unmap it.
+ * Return 0 on success, negative error code if nothing is mapped there.
+ */
+int Munmap(void *addr);
+
+/* Move the end of the program's heap by "increment" bytes -- up,
+ * or down to give memory back -- and return where it was; Sbrk(0)
+ * returns where it is.  The heap starts empty at the bottom of the
+ * part of the address space files are mapped in (see Mmap), which maps
+ * them from the top down; it may grow until it reaches something
+ * mapped there.  Its pages take no memory till they are touched, and
+ * then read as zeros.  malloc, in the test programs' runtime, takes
+ * its memory from here.
+ * Return (void *) -1 if the heap cannot move that far.
+ */
+void *Sbrk(int increment);
+
+/* Save the program in the file "name", replacing any file of that
+ * name, so that "nachos -restore name" can start it again from here:
+ * its registers, its heap, and the pages it has written to.  The rest
+ * are loaded from its executable again, which must still be there, as
+ * it was.  A program slow to start can so be saved once past its
+ * start-up, and restored as often as need be.
+ * Return 0 once it is saved, and 1 when it goes on, restored; or a
+ * negative error code if it runs other threads, or holds open files,
+ * pipes, mapped files, shared segments or a system call ring, which
+ * cannot be saved, or the file cannot be written.
+ */
+int Checkpoint(char *name);
+
+/* Make a segment of "size" bytes of memory, zeroed, that programs may
+ * share, and return its id, by which any program may ShmAttach it.
+ * The segment lasts as long as the caller, or any program it is
+ * attached to, holds it; it is not freed by the caller's exiting
+ * while others have it attached.
+ * Return a negative error code if "size" is not from 1 byte to 8
+ * pages, or there is no memory left for shared segments.
+ */
+int ShmCreate(int size);
+
+/* Map shared segment "id" into the address space, at "addr", which
+ * must be the start of a page in the part of it files are mapped in
+ * (see Mmap), or wherever it fits there if "addr" is 0; and return
+ * the address of its first byte.  Every program attaching it sees the
+ * same bytes, and what one writes there the others see at once.  A
+ * program may attach a segment more than once.
+ * Return a negative error code if there is no segment "id", or it
+ * does not fit at "addr", or the program holds too many segments.
+ */
+int ShmAttach(int id, void *addr);
+
+/* Unmap the shared segment attached at "addr", as ShmAttach returned
+ * it.  Exit detaches every segment still attached.
+ * Return 0 on success, negative error code if none is attached there.
+ */
+int ShmDetach(void *addr);
+
+/* Sleep, if the word at "addr" holds "expected", till FutexWake on the
+ * same word -- in this program's memory, or in a shared segment, by
+ * whatever address another program has it attached at.  The check and
+ * the sleep are one step: a FutexWake after the word changed cannot
+ * come between them.  Locks kept in memory (see CompareAndSwap) use
+ * this to wait, only when they find the lock held.
+ * Return 1 once woken; 0 at once if the word did not hold "expected";
+ * a negative error code if "addr" is not a word the program may write.
+ */
+int FutexWait(int *addr, int expected);
+
+/* Wake up to "count" of the programs waiting on the word at "addr",
+ * those that have waited longest first.
+ * Return how many were woken, or a negative error code if "addr" is
+ * not a word the program may write.
+ */
+int FutexWake(int *addr, int count);
+
+/* Not a system call: if the word at "addr" holds "old", replace it
+ * with "value", atomically (with LL and SC); return what it held.
+ */
+int CompareAndSwap(int *addr, int old, int value);
+
+/* A piece of a vectored read or write: "length" bytes at "buffer". */
+typedef struct {
+    char *buffer;
+    int length;
+} IoVec;
+
+#define MaxIoVecs	64	/* most pieces in one ReadV or WriteV */
+
+/* Read from the open file into the "count" pieces of "vec", filling
+ * each in turn, or write the pieces to it, in one system call.  The
+ * file sees a single read or write of all the bytes.  Return the
+ * number of bytes read or written, as for Read and Write; a negative
+ * error code on failure.
+ */
+int ReadV(IoVec *vec, int count, OpenFileId id);
+int WriteV(IoVec *vec, int count, OpenFileId id);
+
+/* A system call ring lets a program queue many Create, Remove, Rename,
+ * Mkdir, ReadDir, Open, Read, Write, ReadV, WriteV, Seek, FileSize,
+ * CopyRange, Preallocate, Close and Fsync calls in
+ * its own memory, and have the kernel carry them out with one
+ * RingSubmit -- or with none, if a kernel thread polls the ring for
+ * them.
+ *
+ * To make a call, the program fills in sq[sqTail % RingSize], with the
+ * SC_* code in "op", the arguments (addresses cast to int) in "arg",
+ * and anything it likes in "tag", and then increments sqTail.  It may
+ * queue up to RingSize calls that have not been taken yet.  For each
+ * call it takes, in order, the kernel increments sqHead, and once the
+ * call is done, fills in cq[cqTail % RingSize] with the call's tag and
+ * result and increments cqTail.  The program reaps completions from
+ * cqHead up to cqTail, incrementing cqHead; the kernel stops taking
+ * calls while RingSize completions are waiting to be reaped.
+ *
+ * The indices only ever grow.  The program writes only sqTail and
+ * cqHead, and the kernel only sqHead and cqTail.
+ */
+
+#define RingSize	16	/* slots in each queue */
+#define RingPoll	1	/* RingSetup flag: a kernel thread polls */
+
+typedef struct {
+    int op;			/* SC_* code of the call */
+    int arg[3];			/* its arguments */
+    int tag;			/* handed back with the result */
+} RingRequest;
+
+typedef struct {
+    int tag;
+    int result;			/* what the call returned */
+} RingCompletion;
+
+typedef struct {
+    int sqHead, sqTail;		/* calls taken, and queued */
+    int cqHead, cqTail;		/* completions reaped, and posted */
+    RingRequest sq[RingSize];
+    RingCompletion cq[RingSize];
+} Ring;
+
+/* Register "ring" as the program's system call ring; "flags" may be
+ * RingPoll.  Return 1 on success, negative error code on failure (in
+ * particular, if the program already has a ring).
+ */
+int RingSetup(Ring *ring, int flags);
+
+/* Carry out the calls queued in the ring.  Return how many were
+ * taken, negative error code on failure.
+ */
+int RingSubmit();
+
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 
  *
- * Could define other operations, such as LockAcquire, LockRelease, etc.
+ * The threads share the program's memory, open files and pipe ends;
+ * each has its own registers and a stack of its own, of UserStackSize
+ * bytes, in the map window (see Mmap).  A program has at most 8
+ * threads at once, counting its first, which is ThreadId 0.  Locks
+ * among them are kept in user memory, with FutexWait and FutexWake, as
+ * they are between programs.
  */
 
 /* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
+ * as the current thread, passing it "arg".  Returning from "func" is
+ * the same as calling ThreadExit with what it returns.
  * Return a positive ThreadId on success, negative error code on failure
  */
-ThreadId ThreadFork(void (*func)());
+ThreadId ThreadFork(int (*func)(int), int arg);
 
 /* Yield the CPU to another runnable thread, whether in this address space 
  * or not. 
@@ -169,14 +480,179 @@ void ThreadYield();
 /*
  * Blocks current thread until lokal thread ThreadID exits with ThreadExit.
  * Function returns the ExitCode of ThreadExit() of the exiting thread.
+ * Each thread can be joined once, by one other thread; its ThreadId may
+ * then be given out again.  Return a negative error code if "id" is not
+ * a thread that can be joined.
  */
 int ThreadJoin(ThreadId id);
 
 /*
- * Deletes current thread and returns ExitCode to every waiting lokal thread.
+ * Deletes current thread and returns ExitCode to the lokal thread joining it.
+ * Exit does the same: the program ends once all of its threads have,
+ * with the ExitCode of the last.
  */
 void ThreadExit(int ExitCode);	
 
+/* Set the priority of the calling thread to "priority", from 0 (the
+ * lowest) to 31; threads start at 16.  Priorities only matter when
+ * Nachos is started with "-sched priority": a ready thread of a higher
+ * priority then always runs before one of a lower priority.
+ * Return the old priority, or a negative error code if "priority" is
+ * out of range.
+ */
+int SetPriority(int priority);
+
+/* Give the calling thread "tickets" tickets, from 1 to 1000; threads
+ * start with 100.  Tickets only matter when Nachos is started with
+ * "-sched stride": each thread that wants the CPU then gets a share of
+ * it in proportion to its tickets.
+ * Return the old number of tickets, or a negative error code if
+ * "tickets" is out of range.
+ */
+int SetTickets(int tickets);
+
+/* The I/O classes of SetIoClass. */
+#define IoClassRealtime		0
+#define IoClassBestEffort	1
+#define IoClassIdle		2
+
+/* Put the disk requests of the calling thread in class "ioClass";
+ * threads start best-effort, and those of ThreadFork in the class of
+ * the thread forking them.  Classes only matter when Nachos is started
+ * with "-dq": queued realtime requests are then served before any
+ * others, best-effort ones in turns given to each program, and idle
+ * ones only when nothing else is waiting.
+ * Return the old class, or a negative error code if "ioClass" is not
+ * one of them.
+ */
+int SetIoClass(int ioClass);
+
+/* Suspend the calling thread, without using the CPU, for at least
+ * "ticks" ticks of simulated time.
+ * Return 0 on success, negative error code if "ticks" is negative.
+ */
+int Sleep(int ticks);
+
+/* What the calling thread has had of the CPU, in ticks, and how often
+ * it has given it up: to wait (voluntary) or while it could still run
+ * -- time sliced, preempted or yielding (involuntary).
+ */
+typedef struct {
+    int userTicks;		/* running user code */
+    int systemTicks;		/* running the kernel, for it */
+    int readyTicks;		/* ready to run, but not running */
+    int blockedTicks;		/* waiting for something */
+    int voluntarySwitches;
+    int involuntarySwitches;
+} CpuUsage;
+
+/* Fill in "usage" for the calling thread.
+ * Return 0 on success, negative error code if "usage" is not a valid
+ * address.
+ */
+int GetUsage(CpuUsage *usage);
+
+/* What this machine's network has carried.  Packets lost are counted
+ * as sent.  ackLatency counts the segments of reliable connections
+ * acknowledged under 1, 4, 16, ... NetworkTimes after they first went
+ * out; the last bucket is "or more".
+ */
+#define NetLatencyBuckets	8
+#define NetMailBoxes		16
+
+typedef struct {
+    int packetsSent, packetsRecvd;
+    int bytesSent, bytesRecvd;
+    int packetsDropped;		/* lost by the reliability setting */
+    int packetsRefused;		/* lost, as the receiver had no room */
+    int retransmits;		/* segments sent again */
+    int ackLatency[NetLatencyBuckets];
+    int mailBoxDepth[NetMailBoxes];	/* most mails waiting at once */
+} NetStats;
+
+/* Fill in "stats".
+ * Return 0 on success, negative error code if "stats" is not a valid
+ * address.
+ */
+int GetNetStats(NetStats *stats);
+
+/* Write the string "s", up to its '\0', to the console, with no other
+ * program's output in between.  Returns once it is buffered, which it
+ * is unless the console is far behind.  Return the number of characters
+ * written, or a negative error code if "s" is not a valid string.
+ */
+int PutString(char *s);
+
+/* Read a line typed at the console into "buffer", through its '\n', in
+ * one system call; at most "size" - 1 characters, and then a '\0'.  A
+ * line longer than that is returned in pieces.  Return the number of
+ * characters read, 0 at the end of the input, or a negative error code
+ * if "buffer" is not valid.
+ */
+int ReadLine(char *buffer, int size);
+
+/* What the file system has done.  ops counts the calls of each
+ * operation, and opTicks the time they took, waits for the disk
+ * included; an open counts a lookup too.  Bytes are those user
+ * programs read and wrote through Read and Write, and those the disk
+ * moved for everyone, paging included.  The caches are the buffer
+ * cache of disk sectors, the cache of path name lookups, and the
+ * table of the headers of open files.
+ */
+#define FsCreateOp	0
+#define FsOpenOp	1
+#define FsReadOp	2
+#define FsWriteOp	3
+#define FsRemoveOp	4
+#define FsLookupOp	5
+#define FsNumOps	6
+
+typedef struct {
+    int ops[FsNumOps];
+    int opTicks[FsNumOps];
+    int lookupComponents;	/* path names searched for in directories */
+    int userBytesRead, userBytesWritten;
+    int diskBytesRead, diskBytesWritten;
+    int bufferHits, bufferMisses, bufferEvictions;
+    int dentryHits, dentryMisses, dentryEvictions;
+    int headerHits, headerMisses, headerEvictions;
+} FsStats;
+
+/* Fill in "stats".
+ * Return 0 on success, negative error code if "stats" is not a valid
+ * address.
+ */
+int GetFsStats(FsStats *stats);
+
+/* The machine's statistics as they stand, to watch them change while
+ * programs run.  "version" is the StatsVersion of the kernel, and
+ * "size" the bytes of the snapshot it filled in.  Later versions only
+ * add fields at the end, so a program built with an earlier struct
+ * just gets the fields it knows of.  The rest are totals since Nachos
+ * started, as Halt prints them with -st.
+ */
+#define StatsVersion	1
+
+typedef struct StatsSnapshot {
+    int version;
+    int size;
+    int totalTicks, idleTicks, systemTicks, userTicks;
+    int diskReads, diskWrites;
+    int consoleCharsRead, consoleCharsWritten;
+    int pageFaults, pageEvictions, pageOuts;
+    int tlbHits, tlbMisses;
+    int packetsSent, packetsRecvd;
+    int contextSwitches;
+    int fsOps;			/* file system operations, lookups aside */
+    int userBytesRead, userBytesWritten;
+} StatsSnapshot;
+
+/* Fill in the first "size" bytes of "stats", at most those of a
+ * StatsSnapshot.  Return the number of bytes filled in, or a negative
+ * error code if "stats" is not a valid address.
+ */
+int GetStats(StatsSnapshot *stats, int size);
+
 #endif /* IN_ASM */
 
 #endif /* SYSCALL_H */
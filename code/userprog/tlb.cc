@@ -0,0 +1,184 @@
+// tlb.cc
+//	Routines to load the TLB on a miss, and to keep the page table
+//	up to date with it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "tlb.h"
+
+//----------------------------------------------------------------------
+// TLBManager::TLBManager
+// 	Initialize the handler of the machine's TLB, which must be empty.
+//
+//	"policy" -- which entry to put out when a set is full
+//----------------------------------------------------------------------
+
+TLBManager::TLBManager(TLBPolicy policy)
+{
+    Machine *machine = kernel->machine;
+
+    ASSERT(machine->tlb != NULL);
+    this->policy = policy;
+    pageTable = NULL;
+    nextOut = new int[machine->tlbSize / machine->tlbWays];
+    for (int i = 0; i < machine->tlbSize / machine->tlbWays; i++)
+	nextOut[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::~TLBManager
+// 	De-allocate the handler.
+//----------------------------------------------------------------------
+
+TLBManager::~TLBManager()
+{
+    delete [] nextOut;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::PutOut
+// 	Invalidate TLB entry "entry", first or-ing the use, referenced and
+//	dirty bits the hardware set in it into the page table it came from.  (The
+//	kernel may have set them there as well, by its own Translate.)  If
+//	the page table has dropped the entry meanwhile, the bits go.
+//----------------------------------------------------------------------
+
+void
+TLBManager::PutOut(int entry)
+{
+    TranslationEntry *e = &kernel->machine->tlb[entry];
+    TranslationEntry *pte;
+
+    if (e->valid) {
+	pte = pageTable->Lookup(e->virtualPage);
+	if (pte != NULL) {
+	    pte->use |= e->use;
+	    pte->referenced |= e->referenced;
+	    pte->dirty |= e->dirty;
+	}
+	e->valid = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// TLBManager::ChooseEntry
+// 	Return the entry of the set beginning at "first" to load a new
+//	translation into: a free one, or else the one the policy puts out.
+//----------------------------------------------------------------------
+
+int
+TLBManager::ChooseEntry(int first)
+{
+    Machine *machine = kernel->machine;
+    int ways = machine->tlbWays;
+    int entry = first;
+
+    for (int i = first; i < first + ways; i++)
+	if (!machine->tlb[i].valid)
+	    return i;
+    switch (policy) {
+      case RandomTLB:
+	entry = first + RandomNumber() % ways;
+	break;
+      case FifoTLB:
+	entry = first + nextOut[first / ways];
+	nextOut[first / ways] = (nextOut[first / ways] + 1) % ways;
+	break;
+      case LruTLB:
+	for (int i = first + 1; i < first + ways; i++)
+	    if (machine->tlbLastUsed[i] < machine->tlbLastUsed[entry])
+		entry = i;
+	break;
+    }
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Refill
+// 	Handle a TLB miss on virtual page "vpn", which must be valid in
+//	"pageTable", the current address space's: copy its translation
+//	into the set it maps to, putting out an entry if need be.  If the
+//	TLB holds entries of another page table, from before a context
+//	switch, they are flushed first.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Refill(PageTable *pageTable, int vpn)
+{
+    Machine *machine = kernel->machine;
+    int entry;
+
+    ASSERT(pageTable->Lookup(vpn) != NULL && pageTable->Lookup(vpn)->valid);
+    if (this->pageTable != pageTable)
+	Flush();
+    this->pageTable = pageTable;
+    entry = ChooseEntry((vpn % (machine->tlbSize / machine->tlbWays)) *
+			machine->tlbWays);
+    PutOut(entry);
+    machine->tlb[entry] = *pageTable->Lookup(vpn);
+    machine->tlb[entry].use = FALSE;
+    machine->tlb[entry].referenced = FALSE;
+    machine->tlb[entry].dirty = FALSE;
+    machine->tlbLastUsed[entry] = 0;
+    DEBUG(dbgAddr, "TLB entry " << entry << " for virtual page " << vpn);
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Flush
+// 	Put out every entry of the TLB, writing its bits back.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Flush()
+{
+    if (pageTable == NULL)
+	return;
+    for (int i = 0; i < kernel->machine->tlbSize; i++)
+	PutOut(i);
+    pageTable = NULL;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Forget
+// 	Empty the TLB, without writing back, if its entries come from
+//	"pageTable", which is about to be deleted.
+//----------------------------------------------------------------------
+
+void
+TLBManager::Forget(PageTable *pageTable)
+{
+    if (this->pageTable != pageTable)
+	return;
+    for (int i = 0; i < kernel->machine->tlbSize; i++)
+	kernel->machine->tlb[i].valid = FALSE;
+    this->pageTable = NULL;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::GatherReferenced
+// 	Or the referenced bits the hardware set in the TLB into
+//	"pageTable", if its entries come from there, and clear them in
+//	the TLB -- leaving the entries in, unlike PutOut.
+//----------------------------------------------------------------------
+
+void
+TLBManager::GatherReferenced(PageTable *pageTable)
+{
+    TranslationEntry *e, *pte;
+
+    if (this->pageTable != pageTable)
+	return;
+    for (int i = 0; i < kernel->machine->tlbSize; i++) {
+	e = &kernel->machine->tlb[i];
+	if (e->valid && e->referenced) {
+	    pte = pageTable->Lookup(e->virtualPage);
+	    if (pte != NULL)
+		pte->referenced = TRUE;
+	    e->referenced = FALSE;
+	}
+    }
+}
@@ -0,0 +1,62 @@
+// tlb.h
+//	Data structures for the kernel's management of the TLB, when the
+//	machine translates addresses with one (see Machine::UseTLB).
+//
+//	The TLB holds copies of translations from the page table of one
+//	address space at a time, and the hardware sets the use and dirty
+//	bits in the copies.  So the bits are written back to the page table
+//	when an entry is put out, and whenever the TLB is flushed: on a
+//	context switch, and before the kernel reads the bits or changes
+//	the translations (page replacement, copy-on-write).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef TLBMGR_H
+#define TLBMGR_H
+
+#include "translate.h"
+
+// Which entry of the set a page maps to is put out for it, when none
+// is free.
+
+enum TLBPolicy {
+    RandomTLB,			// any of them
+    FifoTLB,			// the one loaded longest ago
+    LruTLB			// the one used least recently
+};
+
+// The following class defines the kernel's TLB miss handler.
+
+class TLBManager {
+  public:
+    TLBManager(TLBPolicy policy);	// The machine's TLB, empty
+    ~TLBManager();
+
+    void Refill(PageTable *pageTable, int vpn);
+					// Load the translation of "vpn" from
+					// "pageTable", on a miss
+    void Flush();			// Write the bits back, and empty
+					// the TLB
+    void Forget(PageTable *pageTable);
+					// Empty it of "pageTable", which is
+					// going away
+    void GatherReferenced(PageTable *pageTable);
+					// Write back the referenced bits of
+					// "pageTable", for a working set
+
+  private:
+    void PutOut(int entry);		// Write back and invalidate "entry"
+    int ChooseEntry(int first);		// The entry of the set at "first"
+					// to load into
+
+    TLBPolicy policy;
+    PageTable *pageTable;		// Where the entries come from, or
+					// NULL if there are none
+    int *nextOut;			// For FIFO, each set's oldest entry
+};
+
+#endif // TLBMGR_H
@@ -10,6 +10,11 @@
  * 	ld with  -N -T 0
  * to make sure the object file has no shared text.
  *
+ * With "-a <page size>", the segments are laid out in the NOFF file as
+ * they are in memory, past the header padded out to a page, so that
+ * each page of the address space is a page of the file; the noffMagic
+ * then has NOFFALIGNED set.  Otherwise they are written back to back.
+ *
  * Also assumes that the COFF file has at most 3 segments:
  *	.text	-- read-only executable instructions 
  *	.data	-- initialized data
@@ -148,17 +153,49 @@ void Write(int fd, char *buf, int nBytes)
     }
 }
 
+/* where a segment at "virtualAddr" goes in the NOFF file: next, at
+ * "*inNoffFile", or at the same place in a page as in memory, if
+ * "imageBase" (the start of the pages of the image) is not 0
+ */
+int Place(int *inNoffFile, int imageBase, int virtualAddr, int size)
+{
+    int at = (imageBase > 0) ? imageBase + virtualAddr : *inNoffFile;
+
+    *inNoffFile = at + size;
+    return at;
+}
+
+/* copy a section of "size" bytes at "from" in the COFF file to "to" in
+ * the NOFF file
+ */
+void CopySection(int fdIn, int from, int fdOut, int to, int size)
+{
+    char *buffer = malloc(size);
+
+    lseek(fdIn, from, 0);
+    Read(fdIn, buffer, size);
+    lseek(fdOut, to, 0);
+    Write(fdOut, buffer, size);
+    free(buffer);
+}
+
 int main(int argc, char **argv)
 {
     int fdIn, fdOut, numsections, i, inNoffFile;
+    int pageSize = 0, imageBase = 0;
     struct filehdr fileh;
     struct aouthdr systemh;
     struct scnhdr *sections;
-    char *buffer;
     NoffHeader noffH;
 
-    if (argc < 2) {
-	fprintf(stderr, "Usage: %s <coffFileName> <noffFileName>\n", argv[0]);
+    if (argc > 2 && !strcmp(argv[1], "-a")) {
+	pageSize = atoi(argv[2]);
+	argv += 2;
+	argc -= 2;
+    }
+    if (argc < 3 || pageSize < 0 || (pageSize & (pageSize - 1)) != 0) {
+	fprintf(stderr, "Usage: %s [-a pageSize] <coffFileName> <noffFileName>\n",
+		argv[0]);
 	exit(1);
     }
     
@@ -212,6 +249,10 @@ int main(int argc, char **argv)
   * in the COFF file
   */
     noffH.noffMagic = NOFFMAGIC;
+    if (pageSize > 0) {
+	noffH.noffMagic |= NOFFALIGNED;
+	imageBase = (sizeof(NoffHeader) + pageSize - 1) / pageSize * pageSize;
+    }
     noffH.code.size = 0;
     noffH.initData.size = 0;
     noffH.uninitData.size = 0;
@@ -222,7 +263,6 @@ int main(int argc, char **argv)
 
  /* Copy the segments in */
     inNoffFile = sizeof(NoffHeader);
-    lseek(fdOut, inNoffFile, 0);
     printf("Loading %d sections:\n", numsections);
     for (i = 0; i < numsections; i++) {
 	printf("\t\"%s\", filepos 0x%x, mempos 0x%x, size 0x%x\n",
@@ -232,37 +272,31 @@ int main(int argc, char **argv)
 		/* do nothing! */	
 	} else if (!strcmp(sections[i].s_name, ".text")) {
 	    noffH.code.virtualAddr = sections[i].s_paddr;
-	    noffH.code.inFileAddr = inNoffFile;
+	    noffH.code.inFileAddr = Place(&inNoffFile, imageBase,
+					  sections[i].s_paddr,
+					  sections[i].s_size);
 	    noffH.code.size = sections[i].s_size;
-    	    lseek(fdIn, sections[i].s_scnptr, 0);
-    	    buffer = malloc(sections[i].s_size);
-    	    Read(fdIn, buffer, sections[i].s_size);
-    	    Write(fdOut, buffer, sections[i].s_size);
-    	    free(buffer);
-	    inNoffFile += sections[i].s_size;
+	    CopySection(fdIn, sections[i].s_scnptr, fdOut,
+			noffH.code.inFileAddr, sections[i].s_size);
  	} else if (!strcmp(sections[i].s_name, ".data")){
 
 	    noffH.initData.virtualAddr = sections[i].s_paddr;
-	    noffH.initData.inFileAddr = inNoffFile;
+	    noffH.initData.inFileAddr = Place(&inNoffFile, imageBase,
+					      sections[i].s_paddr,
+					      sections[i].s_size);
 	    noffH.initData.size = sections[i].s_size;
-	    lseek(fdIn, sections[i].s_scnptr, 0);
-	    buffer = malloc(sections[i].s_size);
-	    Read(fdIn, buffer, sections[i].s_size);
-	    Write(fdOut, buffer, sections[i].s_size);
-	    free(buffer);
-	    inNoffFile += sections[i].s_size;
+	    CopySection(fdIn, sections[i].s_scnptr, fdOut,
+			noffH.initData.inFileAddr, sections[i].s_size);
 #ifdef RDATA
 	} else if (!strcmp(sections[i].s_name, ".rdata")){
 
 	    noffH.readonlyData.virtualAddr = sections[i].s_paddr;
-	    noffH.readonlyData.inFileAddr = inNoffFile;
+	    noffH.readonlyData.inFileAddr = Place(&inNoffFile, imageBase,
+						  sections[i].s_paddr,
+						  sections[i].s_size);
 	    noffH.readonlyData.size = sections[i].s_size;
-	    lseek(fdIn, sections[i].s_scnptr, 0);
-	    buffer = malloc(sections[i].s_size);
-	    Read(fdIn, buffer, sections[i].s_size);
-	    Write(fdOut, buffer, sections[i].s_size);
-	    free(buffer);
-	    inNoffFile += sections[i].s_size;
+	    CopySection(fdIn, sections[i].s_scnptr, fdOut,
+			noffH.readonlyData.inFileAddr, sections[i].s_size);
 #endif
 	} else if (!strcmp(sections[i].s_name, ".bss")){
   	    /* need to check if we have both .bss and .sbss -- make sure they 
@@ -287,6 +321,7 @@ int main(int argc, char **argv)
 	    exit(1);
 	}
     }
+    /* the gaps seeked over between segments read as zeros */
     lseek(fdOut, 0, 0);
 
     // convert the NOFF header to little-endian before
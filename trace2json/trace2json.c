@@ -0,0 +1,168 @@
+/* trace2json.c
+ *
+ * This program reads a trace written by "nachos -trace", and writes it
+ * out as the JSON of Chrome's trace viewer:
+ *
+ *	trace2json trace.bin > trace.json
+ *
+ * Each thread gets a row, naming it by its ID, with a slice for each
+ * time it ran, and its page faults marked; and a second row, with a
+ * slice for each system call it made, which may span several of the
+ * first.  Each disk gets a row with a slice for each request, and
+ * interrupts are marked on a row of their own.  A tick is shown as a
+ * microsecond.
+ *
+ * The layout of the file must be kept in step with trace.h in
+ * code/threads.
+ *
+ * Copyright (c) 1992-1996 The Regents of the University of California.
+ * All rights reserved.  See copyright.h for copyright notice and limitation
+ * of liability and disclaimer of warranty provisions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TraceMagic	0x4e545243
+
+enum TraceEvent {	/* as in trace.h */
+    TraceSwitch = 1, TraceSyscall, TraceSyscallDone, TraceDiskRead,
+    TraceDiskWrite, TraceDiskDone, TracePageFault, TraceInterrupt
+};
+
+typedef struct {
+    int tick;
+    int event;
+    int thread;
+    int args[3];
+} TraceRecord;
+
+typedef struct {
+    int magic;
+    int recordSize;
+    int numRecords;
+    int numLost;
+} TraceHeader;
+
+#define KernelPid	1	/* the rows of threads */
+#define DiskPid		2	/* of disks */
+#define InterruptPid	3	/* of interrupts */
+#define SyscallPid	4	/* of system calls */
+
+#define MaxRunning	1024	/* threads whose slice can be open */
+
+static int running[MaxRunning];	/* threads in a "running" slice */
+static int numRunning = 0;
+static int first = 1;		/* no event written yet? */
+
+/* Start writing an event of phase "ph", on row "tid" of "pid", at
+ * "tick"; the caller finishes it with its own fields and "}".
+ */
+static void
+Event(char *ph, int pid, int tid, int tick)
+{
+    printf("%s\n{\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%d",
+	   first ? "" : ",", ph, pid, tid, tick);
+    first = 0;
+}
+
+/* Open or close the "running" slice of thread "tid". */
+static void
+Running(int tid, int tick, int starting)
+{
+    int i;
+
+    for (i = 0; i < numRunning && running[i] != tid; i++)
+	;
+    if (starting && i == numRunning && numRunning < MaxRunning) {
+	running[numRunning++] = tid;
+	Event("B", KernelPid, tid, tick);
+	printf(",\"name\":\"running\"}");
+    } else if (!starting && i < numRunning) {
+	running[i] = running[--numRunning];
+	Event("E", KernelPid, tid, tick);
+	printf("}");
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *in;
+    TraceHeader header;
+    TraceRecord r;
+    int lastTick = 0;
+
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "rb")) == NULL) {
+	perror(argv[1]);
+	exit(1);
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+	header.magic != TraceMagic || header.recordSize != sizeof(r)) {
+	fprintf(stderr, "%s: not a Nachos trace\n", argv[1]);
+	exit(1);
+    }
+    if (header.numLost > 0)
+	fprintf(stderr, "%s: the first %d events were lost\n", argv[1],
+		header.numLost);
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    Event("M", KernelPid, 0, 0);
+    printf(",\"name\":\"process_name\",\"args\":{\"name\":\"threads\"}}");
+    Event("M", DiskPid, 0, 0);
+    printf(",\"name\":\"process_name\",\"args\":{\"name\":\"disks\"}}");
+    Event("M", InterruptPid, 0, 0);
+    printf(",\"name\":\"process_name\",\"args\":{\"name\":\"interrupts\"}}");
+    Event("M", SyscallPid, 0, 0);
+    printf(",\"name\":\"process_name\",\"args\":{\"name\":\"system calls\"}}");
+
+    while (fread(&r, sizeof(r), 1, in) == 1) {
+	switch (r.event) {
+	  case TraceSwitch:
+	    Running(r.args[0], r.tick, 0);
+	    Running(r.args[1], r.tick, 1);
+	    break;
+	  case TraceSyscall:
+	    Event("B", SyscallPid, r.thread, r.tick);
+	    printf(",\"name\":\"system call %d\"}", r.args[0]);
+	    break;
+	  case TraceSyscallDone:
+	    Event("E", SyscallPid, r.thread, r.tick);
+	    printf(",\"args\":{\"result\":%d}}", r.args[1]);
+	    break;
+	  case TraceDiskRead:
+	  case TraceDiskWrite:
+	    Event("B", DiskPid, r.args[0], r.tick);
+	    printf(",\"name\":\"%s\",\"args\":{\"sector\":%d,\"sectors\":%d}}",
+		   r.event == TraceDiskRead ? "read" : "write", r.args[1],
+		   r.args[2]);
+	    break;
+	  case TraceDiskDone:
+	    Event("E", DiskPid, r.args[0], r.tick);
+	    printf("}");
+	    break;
+	  case TracePageFault:
+	    Event("i", KernelPid, r.thread, r.tick);
+	    printf(",\"s\":\"t\",\"name\":\"%s\",\"args\":{\"address\":%d}}",
+		   r.args[1] ? "copy on write" : "page fault", r.args[0]);
+	    break;
+	  case TraceInterrupt:
+	    Event("i", InterruptPid, 0, r.tick);
+	    printf(",\"s\":\"t\",\"name\":\"interrupt %d\"}", r.args[0]);
+	    break;
+	  default:
+	    fprintf(stderr, "%s: unknown event %d\n", argv[1], r.event);
+	    break;
+	}
+	lastTick = r.tick;
+    }
+    while (numRunning > 0)
+	Running(running[numRunning - 1], lastTick, 0);
+    printf("\n]}\n");
+    fclose(in);
+    return 0;
+}